@@ -0,0 +1,149 @@
+#ifndef BackgroundPeakCache_h
+#define BackgroundPeakCache_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <mutex>
+#include <memory>
+#include <vector>
+
+#include "InterSpec/PeakDef.h"
+
+namespace SpecUtils
+{
+  class Measurement;
+  class EnergyCalibration;
+}
+
+
+/** A server-wide cache of background spectrum models, so that repeated analyses against the same
+ (usually long) background measurement share one set of its peaks, sorted by energy for quick
+ lookup, and one re-binning of its counts per foreground energy calibration.
+
+ Nothing is fit here; a #BackgroundModel is made from the peaks the user already has for the
+ background.  It provides live-time scaled peak areas, which #ShieldingSourceChi2Fcn and
+ #DetectionLimitCalc::currie_mda_calc subtract from the foreground peaks, and re-binned channel
+ counts, which #RelActCalcAuto subtracts from the foreground spectrum.
+
+ Models are keyed by the identity of the background spectrum (its address, and the addresses of
+ its channel counts and energy calibration), its live-time, and a hash of the peaks, so looking up
+ a model does not touch the channel counts.
+
+ All functions are thread-safe.
+ */
+namespace BackgroundPeakCache
+{
+  class BackgroundModel
+  {
+  public:
+    /** Creates a model from a background spectrum, and peaks fit to it.
+
+     Non-Gaussian peaks are not used for subtraction; their energies are available from
+     #nonGaussianPeakEnergies so callers can warn the user.
+
+     Throws exception if spectrum is nullptr, or has a non-positive live-time.
+     */
+    BackgroundModel( const std::shared_ptr<const SpecUtils::Measurement> &spectrum,
+                     const std::vector<PeakDef> &peaks );
+
+    /** The background spectrum the model is of. */
+    const std::shared_ptr<const SpecUtils::Measurement> &spectrum() const;
+
+    /** The live-time of the background spectrum; areas are scaled by "live_time / liveTime()". */
+    double liveTime() const;
+
+    /** The Gaussian background peaks, sorted by mean; areas are for the backgrounds live-time. */
+    const std::vector<PeakDef> &peaks() const;
+
+    /** The energies of the non-Gaussian peaks that will not be subtracted. */
+    const std::vector<double> &nonGaussianPeakEnergies() const;
+
+    /** Gives the sum of the areas of the background peaks whose mean is strictly within 'window' of
+     'energy', scaled to 'live_time'.
+
+     @param energy The energy to find background peaks near.
+     @param window The maximum distance, in keV, a background peaks mean can be from 'energy'.
+     @param live_time The live-time to scale the background to (e.g., the foregrounds live-time).
+     @param area Set to the scaled sum of areas; zero if no background peaks are near.
+     @param uncert2 Set to the scaled sum of squared area uncertainties.
+     */
+    void peakAreaNear( const double energy, const double window, const double live_time,
+                       double &area, double &uncert2 ) const;
+
+    /** Gives the Gaussian integral, between 'lower' and 'upper' energies, of all background peaks,
+     scaled to 'live_time'.  The uncertainty is the peak area uncertainties scaled by the fraction
+     of each peak within the range.
+     */
+    void peakAreaInRange( const double lower, const double upper, const double live_time,
+                          double &area, double &uncert2 ) const;
+
+    /** Returns the background spectrums channel counts re-binned to the given energy calibration
+     (see #SpecUtils::rebin_by_lower_edge), without any live-time scaling.
+
+     The last few re-binnings are cached, so calling this for each foreground spectrum of a series
+     that share a calibration only re-bins once.
+
+     Throws exception if 'cal' is invalid.
+     */
+    std::shared_ptr<const std::vector<float>>
+              countsForCalibration( const std::shared_ptr<const SpecUtils::EnergyCalibration> &cal ) const;
+
+  protected:
+    std::shared_ptr<const SpecUtils::Measurement> m_spectrum;
+
+    /** The channel counts and energy calibration of #m_spectrum when the model was created. */
+    std::shared_ptr<const std::vector<float>> m_counts;
+    std::shared_ptr<const SpecUtils::EnergyCalibration> m_energyCal;
+
+    double m_liveTime;
+    std::vector<PeakDef> m_peaks;
+    std::vector<double> m_peakMeans;
+    std::vector<double> m_nonGaussianEnergies;
+
+    /** The largest sigma of any of #m_peaks; used to limit what peaks #peakAreaInRange looks at. */
+    double m_maxSigma;
+
+    mutable std::mutex m_rebinnedMutex;
+    mutable std::vector<std::pair<std::shared_ptr<const SpecUtils::EnergyCalibration>,
+                                  std::shared_ptr<const std::vector<float>>>> m_rebinned;
+  };//class BackgroundModel
+
+
+  /** Returns the model of a background spectrum using already fit (e.g., user) peaks; 'peaks' may
+   be empty if only #BackgroundModel::countsForCalibration is needed.  A previous model is returned
+   if the spectrum and peaks are unchanged since it was created.
+
+   Throws exception if background is nullptr or invalid.
+   */
+  std::shared_ptr<const BackgroundModel> background_model(
+                                     const std::shared_ptr<const SpecUtils::Measurement> &background,
+                                     const std::vector<PeakDef> &peaks );
+
+
+  /** Removes all models from the cache; models still in use are unaffected. */
+  void clear_cache();
+}//namespace BackgroundPeakCache
+
+#endif //BackgroundPeakCache_h
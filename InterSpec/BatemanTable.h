@@ -0,0 +1,156 @@
+#ifndef BatemanTable_h
+#define BatemanTable_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <vector>
+#include <utility>
+
+#include "InterSpec/PeakDef.h"
+
+namespace SandiaDecay
+{
+  struct Nuclide;
+  struct Transition;
+}
+
+
+/** Precomputed Bateman solution of a parent nuclides decay chain, to quickly get the photon line
+ yields of the parent at an arbitrary age.
+
+ When fitting ages, creating a #SandiaDecay::NuclideMixture, aging it, and collecting its
+ transitions (over a thousand, for Pu241) for every trial age is a significant portion of the
+ computation.  Instead, at construction we solve the decay chain so that the activity of each
+ descendant, relative to the parents activity at that age, is
+     A_d(t) / A_p(t) = sum_k c_{d,k} * exp( -(lambda_k - lambda_p) * t )
+ and so each photon lines yield, per unit parent activity, is a fixed multiple of one of these
+ sums.  Evaluating a new age then takes one exponential per nuclide in the chain, plus a multiply
+ per line, and the age derivatives come essentially for free.
+
+ Nuclides in the chain whose decay constants are within a relative 1E-6 of each other would make
+ the coefficients ill-conditioned (they diverge as the constants approach each other), so these
+ decay constants are nudged apart by that amount; this changes yields by much less than the nuclear
+ data uncertainties.
+
+ Yields are normalized the same as #SandiaDecay::NuclideMixture::addAgedNuclideByActivity, with a
+ parent activity of 1.0 at the evaluated age.
+ */
+class BatemanTable
+{
+public:
+  /** The yield of a photon line, at a given age. */
+  struct LineYield
+  {
+    double energy;
+
+    /** Photons per decay of the parent, at the age the table was evaluated at. */
+    double yield;
+
+    /** Derivative of #yield with respect to age; only filled out if requested. */
+    double dyield_dage;
+
+    /** The transition that contributes the most to this line; nullptr for annihilation lines with
+     contributions from more than one transition.
+     */
+    const SandiaDecay::Transition *transition;
+
+    /** The index of the particle, within #transition, for this line. */
+    size_t product_index;
+
+    PeakDef::SourceGammaType gamma_type;
+  };//struct LineYield
+
+
+  /** Solves the decay chain of 'parent', and tabulates its photon lines.
+
+   @param parent The nuclide to tabulate; must not be nullptr or stable.
+   @param include_xrays If true, x-rays will be included, in addition to gammas and annihilation
+          gammas (e.g., like #SandiaDecay::NuclideMixture::photons); if false, only gammas and
+          annihilation gammas will be included.
+   @param energies_to_exclude Lines within 1 eV of these energies will not be included.
+
+   Throws exception on invalid input.
+   */
+  BatemanTable( const SandiaDecay::Nuclide * const parent,
+                const bool include_xrays,
+                const std::vector<double> &energies_to_exclude = std::vector<double>() );
+
+  const SandiaDecay::Nuclide *parent() const;
+
+  /** The number of nuclides (including the parent) in the chain that have non-zero decay constants. */
+  size_t numChainNuclides() const;
+
+  /** The number of distinct photon lines, i.e., the number of entries #evaluate will return. */
+  size_t numLines() const;
+
+  /** Gives the photon lines, sorted by energy, with their yields at 'age'.  Lines with the same
+   energy, from different transitions, are combined.
+
+   @param age The age of the parent nuclide; must be zero or larger.
+   @param lines The result; re-used between calls to avoid allocations.
+   @param compute_derivatives If true, #LineYield::dyield_dage will also be computed.
+
+   Throws exception if the age is negative, or so large the parent has decayed away.
+   */
+  void evaluate( const double age, std::vector<LineYield> &lines,
+                 const bool compute_derivatives = false ) const;
+
+
+protected:
+  /** A single photon from a single transition. */
+  struct Row
+  {
+    double energy;
+
+    /** Photons per decay of the chain nuclide at #chain_index (intensity times branching ratio). */
+    double intensity;
+
+    size_t chain_index;
+    const SandiaDecay::Transition *transition;
+    size_t product_index;
+    PeakDef::SourceGammaType gamma_type;
+  };//struct Row
+
+  const SandiaDecay::Nuclide *m_parent;
+
+  /** The nuclides in the chain, starting with the parent, ordered so that a nuclide always comes
+   after every nuclide that can decay into it.
+   */
+  std::vector<const SandiaDecay::Nuclide *> m_chain;
+
+  /** The (possibly nudged) decay constant, minus the parents decay constant, of each chain nuclide. */
+  std::vector<double> m_rates;
+
+  /** For each chain nuclide, the non-zero {chain index k, c_{d,k}} terms of its activity ratio. */
+  std::vector<std::vector<std::pair<size_t,double>>> m_coefficients;
+
+  /** All the rows, sorted by energy, and grouped (consecutively) into lines by #m_lineStarts. */
+  std::vector<Row> m_rows;
+
+  /** The index, into #m_rows, of the first row of each line; has one extra entry at the end. */
+  std::vector<size_t> m_lineStarts;
+};//class BatemanTable
+
+#endif //BatemanTable_h
@@ -0,0 +1,89 @@
+#ifndef DecayTimeSeries_h
+#define DecayTimeSeries_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <vector>
+#include <utility>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+
+/** Evaluates the activity of every nuclide of a #SandiaDecay::NuclideMixture at many times at once.
+
+ #SandiaDecay::NuclideMixture::activity evaluates an exponential for every term of every nuclide,
+ and allocates a new result vector, for each time asked for; charting or exporting a mixture over a
+ few hundred or thousand times then spends most of its time re-doing the same work.  Instead, at
+ construction we collect the distinct decay constants of the mixture, and express each nuclides
+ activity as a fixed linear combination of their exponentials,
+     A_n(t) = sum_k c_{n,k} * exp( -lambda_k * t )
+ so evaluating a time takes one exponential per distinct decay constant, and the activities are
+ then a small matrix product, written into caller provided storage.
+ */
+class DecayTimeSeries
+{
+public:
+  /** Collects the decay coefficients of a mixture.
+
+   @param mixture The mixture to evaluate; it is not referenced after construction.
+   @param include_stable If false, stable nuclides (which always have zero activity) will not have
+          a column in the results.
+   */
+  DecayTimeSeries( const SandiaDecay::NuclideMixture &mixture, const bool include_stable = false );
+
+  /** The nuclide of each column of the results; in the same order as
+   #SandiaDecay::NuclideMixture::decayedToNuclidesEvolutions.
+   */
+  const std::vector<const SandiaDecay::Nuclide *> &nuclides() const;
+
+  size_t numNuclides() const;
+
+  /** Evaluates the activity of each nuclide, at each time.
+
+   @param times The times, in SandiaDecay units (i.e., seconds), to evaluate at; need not be sorted
+          or evenly spaced.
+   @param activities Filled with a row-major times.size() by #numNuclides matrix, so the activity
+          (in SandiaDecay units) of nuclide 'n' at times[t] is activities[t*numNuclides() + n].
+          Only resized if it is not already the correct size, so may be re-used between calls.
+   */
+  void activities( const std::vector<double> &times, std::vector<double> &activities ) const;
+
+  /** The number of particles of the given type emitted per decay of each nuclide (i.e., the sum of
+   branching ratio times intensity over the nuclides transitions); multiplying a column of
+   activities, in becquerel, by this gives that nuclides particles per second.
+   */
+  std::vector<double> particlesPerDecay( const SandiaDecay::ProductType type ) const;
+
+protected:
+  std::vector<const SandiaDecay::Nuclide *> m_nuclides;
+
+  /** The distinct decay constants of the mixture. */
+  std::vector<double> m_rates;
+
+  /** For each nuclide, the non-zero {rate index k, c_{n,k}} terms of its activity. */
+  std::vector<std::vector<std::pair<size_t,double>>> m_coefficients;
+};//class DecayTimeSeries
+
+#endif //DecayTimeSeries_h
@@ -38,6 +38,11 @@ namespace SpecUtils
 class Measurement;
 }
 
+namespace BackgroundPeakCache
+{
+class BackgroundModel;
+}
+
 namespace SpecUtils
 {
 class Measurement;
@@ -132,6 +137,14 @@ struct CurieMdaInput
    */
   float additional_uncertainty;
   
+  /** An optional model of the background spectrum (see #BackgroundPeakCache).
+   
+   If non-null, the counts of the background peaks within the peak region, scaled to the live-time of #spectrum, are
+   subtracted from the signal counts, and included in the uncertainties.  The continuum is still estimated from the side
+   channels of #spectrum, since the foreground continuum already includes the backgrounds.
+   */
+  std::shared_ptr<const BackgroundPeakCache::BackgroundModel> background;
+  
   
   /** Default constructor that just zeros everything out. */
   CurieMdaInput();
@@ -164,6 +177,12 @@ struct CurieMdaResult
   float estimated_peak_continuum_counts;
   float estimated_peak_continuum_uncert;
   
+  /** The live-time scaled counts, and their uncertainty, of background peaks in the peak region; zero if no
+   #CurieMdaInput::background was specified.
+   */
+  float background_peak_counts;
+  float background_peak_uncert;
+  
   
   /** This is the number of counts in the peak region, _above_ the predicted continuum number of counts, at which point we will
    consider signal to be present.
@@ -99,6 +99,11 @@ namespace SandiaDecay
   struct Nuclide;
 };//namespace SandiaDecay
 
+namespace BackgroundPeakCache
+{
+  class BackgroundModel;
+}//namespace BackgroundPeakCache
+
 namespace Wt
 {
   class WText;
@@ -188,6 +193,12 @@ protected:
   
   void handleUserChangedUseAirAttenuate();
   
+  /** Returns the model of the displayed background spectrum and its peaks, if the user has selected
+   to subtract background peaks, otherwise nullptr.  If there are no background peaks, the
+   checkbox is unchecked, and the user notified.
+   */
+  std::shared_ptr<const BackgroundPeakCache::BackgroundModel> backgroundModel();
+  
   void handleUserChangedToComputeActOrDist();
   
   void handleInputChange();
@@ -253,6 +264,9 @@ protected:
   
   Wt::WCheckBox *m_attenuateForAir;
   
+  /** Whether to subtract the peaks of the displayed background from the Currie-style limits. */
+  Wt::WCheckBox *m_subtractBackgroundPeaks;
+  
   Wt::WLabel *m_displayActivityLabel;
   Wt::WLabel *m_displayDistanceLabel;
   Wt::WLineEdit *m_displayActivity; //!< Used for peak plotting when activity limit is being determined
@@ -301,6 +315,7 @@ public:
     
     std::shared_ptr<const DetectorPeakResponse> drf;
     std::shared_ptr<const SpecUtils::Measurement> measurement;
+    std::shared_ptr<const BackgroundPeakCache::BackgroundModel> background; //!< May be nullptr
   };//struct MdaPeakRowInput
   
 protected:
@@ -76,6 +76,14 @@ namespace rapidxml
 //  + 12.9980559362*log(x)^3 + -1.0068649823*log(x)^4 + 0.0311640084*log(x)^5)
 //  muparser x took:  cpu=0.143294s, wall=0.14341s  (1.4 us/eval)
 //  evaluator x took: cpu=1.10172s, wall=1.10209s   (11 us/eval)
+//
+// To avoid the muparserx evaluation cost (and the mutex it requires) during fits, FormulaWrapper
+//  compiles the equation to a flat list of instructions (with constant folding, and common
+//  sub-expressions, like the repeated "log(x)" above, only being evaluated once), and only
+//  falls back to muparserx for equations using features the compiler doesnt support.
+//  For the above equation (1M evaluations, on a Linux x86-64 machine):
+//  muparser x:  ~1.5 us/eval
+//  compiled x:  ~65 ns/eval (the log and exp calls alone take ~20 ns)
 
 //Forward declarations
 namespace mup
@@ -96,9 +104,33 @@ struct FormulaWrapper
   FormulaWrapper( const std::string &fcnstr, const bool isMev );
   ~FormulaWrapper();
   
+  /** Returns a (possibly shared) wrapper for the equation, only parsing and compiling it if no
+   other wrapper of the same equation is still alive.  Loading many DRFs from XML or the database
+   (e.g., from a users saved states) often loads the same few equations over and over, and
+   compiling the equation (including the muparserx cross-check) costs far more than evaluating it.
+   
+   Throws the same exceptions as the constructor.
+   */
+  static std::shared_ptr<FormulaWrapper> create( const std::string &fcnstr, const bool isMev );
+  
   float efficiency( const float x );
   double operator()( const float x );
   
+  /** Returns true if the equation was compiled, and evaluation does not require muparserx. */
+  bool isCompiled() const;
+  
+  /** A single instruction of the compiled equation.  Each instruction writes its result to the
+   register with the same index as the instruction, reading its arguments from registers 'lhs'
+   and 'rhs'; the result of the last instruction is the value of the equation.
+   */
+  struct Instruction
+  {
+    int op;
+    int lhs;
+    int rhs;
+    double value;
+  };//struct Instruction
+  
   /** Finds the variable the user most likely intended to be the energy variable
    for detector response functions, by looking for arguments inside
    paranthesis.
@@ -114,6 +146,14 @@ struct FormulaWrapper
    */
   static std::string find_variable_name( std::string eqn );
   
+  /** Evaluates #m_program; does not modify any state, so is safe to call from multiple threads. */
+  double evaluateCompiled( const double x ) const;
+  
+  /** The compiled form of #m_fcnstr, or empty if equation could not be compiled, or compiled
+   result did not agree with muparserx, in which case #m_parser (guarded by #m_mutex) is used.
+   */
+  std::vector<Instruction> m_program;
+  
   std::mutex m_mutex;
   std::string m_fcnstr;
   std::string m_var_name;
@@ -453,8 +493,25 @@ public:
   //  object has not been initialized.  Above or below maximum energies of the
   //  efficiency will return upper or lower efficiencies, respectively.
   float intrinsicEfficiency( const float energy ) const;
-
-
+  
+  
+  /** Batch version of #efficiency( const float, const double ) const.
+   
+   Computes the efficiency, at `distance`, for each of the `nenergies` values in `energies`, placing
+   the results into `results`, which must have room for `nenergies` values.  The efficiency
+   functional form is only dispatched on once, and loops are written to allow the compiler to
+   vectorize them, so this is notably faster than calling #efficiency for each energy.
+   
+   Throws std::runtime_error under the same conditions as #efficiency.
+   */
+  void efficiencies( const float *energies, const size_t nenergies,
+                     const double distance, double *results ) const;
+  
+  /** Batch version of #intrinsicEfficiency; see #efficiencies.
+   `energies` and `results` may point to the same memory.
+   */
+  void intrinsicEfficiencies( const float *energies, const size_t nenergies,
+                              float *results ) const;
   //fractionalSolidAngle(...) returns the fraction of gamma rays from a point
   //  source that would strike the detector face of a detector with diameter
   //  'detectorDiameter' at a distance from source of distance.
@@ -487,6 +544,26 @@ public:
   static float peakResolutionSigma( const float energy,
                                     ResolutionFnctForm fcnFrm,
                                     const std::vector<float> &pars );
+  
+  /** Batch versions of #peakResolutionFWHM and #peakResolutionSigma.
+   
+   Computes the value for each of the `nenergies` values in `energies`, placing the results into
+   `results`, which must have room for `nenergies` values; `energies` and `results` may point to
+   the same memory.  The functional form is only dispatched on (and its energy-independent terms
+   computed) once.
+   
+   Throws std::runtime_error under the same conditions as the single-energy versions.
+   */
+  void peakResolutionFWHMs( const float *energies, const size_t nenergies, float *results ) const;
+  static void peakResolutionFWHMs( const float *energies, const size_t nenergies,
+                                   ResolutionFnctForm fcnFrm,
+                                   const std::vector<float> &pars,
+                                   float *results );
+  void peakResolutionSigmas( const float *energies, const size_t nenergies, float *results ) const;
+  static void peakResolutionSigmas( const float *energies, const size_t nenergies,
+                                    ResolutionFnctForm fcnFrm,
+                                    const std::vector<float> &pars,
+                                    float *results );
 
   
   //Simple accessors
@@ -569,6 +646,13 @@ public:
   static float expOfLogPowerSeriesEfficiency( const float energy,
                                               const std::vector<float> &coefs );
   
+  /** Batch version of #expOfLogPowerSeriesEfficiency; `energies` and `results` may point to the
+   same memory.
+   */
+  static void expOfLogPowerSeriesEfficiencies( const float *energies, const size_t nenergies,
+                                               const std::vector<float> &coefs,
+                                               float *results );
+  
   
   void toXml( ::rapidxml::xml_node<char> *parent, 
               ::rapidxml::xml_document<char> *doc ) const;
@@ -602,6 +686,13 @@ public:
   static float akimaInterpolate( const float energy,
                                 const std::vector<EnergyEfficiencyPair> &xy );
   
+  /** Batch version of #akimaInterpolate; `energies` and `results` may point to the same memory.
+   Is fastest if `energies` are sorted in increasing order, but they do not need to be.
+   */
+  static void akimaInterpolate( const float *energies, const size_t nenergies,
+                                const std::vector<EnergyEfficiencyPair> &xy,
+                                float *results );
+  
   //20190525: Why is m_user a raw index, and not a Wt::Dbo::ptr<InterSpecUser>?
   //          Maybe for database upgrade so Wt::Dbo doesnt need a reference to
   //          InterSpecUser?
@@ -815,7 +906,7 @@ public:
       const bool isMeV = (m_efficiencyEnergyUnits > 10.0f);
       try
       {
-        std::shared_ptr<FormulaWrapper> expression = std::make_shared<FormulaWrapper>(m_efficiencyFormula,isMeV);
+        std::shared_ptr<FormulaWrapper> expression = FormulaWrapper::create(m_efficiencyFormula,isMeV);
         m_efficiencyFcn = [expression](float a) -> float { return expression->efficiency(a); };
       }catch( std::exception & )
       {
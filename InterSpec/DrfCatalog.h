@@ -0,0 +1,115 @@
+#ifndef DrfCatalog_h
+#define DrfCatalog_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class DetectorPeakResponse;
+
+/** A server-wide catalog of detector response functions available on the filesystem.
+
+ Walking directory trees looking for GADRAS DRFs (directories with both a "Efficiency.csv" and
+ "Detector.dat" file, matched case-insensitively), and parsing every DRF found, can take tens of seconds for shared drives with
+ thousands of detector directories.  This catalog instead:
+   - Remembers the directory tree (each directories modification time, and sub-directories), so
+     re-walking a tree only requires a stat of each directory, and re-listing the ones that changed.
+   - Remembers each DRFs files modification time and size, so changed DRFs are noticed.
+   - Only parses a DRF when it is actually requested (e.g., the user selects it), and caches the
+     result, and its #DetectorPeakResponse::hashValue, until its files change.
+   - Persists the directory tree and hashes to a file in the writable data directory (or the
+     servers temporary directory, for web deployments), so it survives application restarts.
+   - Walks the filesystem without holding the catalogs lock, and then swaps the results in, so one
+     slow directory tree doesnt block other sessions.
+
+ Similarly, relative efficiency CSV/TSV files are only re-parsed when their modification time or
+ size changes.
+
+ All functions are thread-safe, and are intended to be called off of the GUI thread.
+ */
+namespace DrfCatalog
+{
+  /** Information about a GADRAS DRF directory, that doesnt require parsing the DRF. */
+  struct GadrasDrfInfo
+  {
+    /** The directory containing the "Efficiency.csv" and "Detector.dat" files. */
+    std::string path;
+
+    /** The display name of the DRF; the last component of #path. */
+    std::string name;
+
+    /** The #DetectorPeakResponse::hashValue of the DRF, or zero if the DRF has not been parsed
+     since its files were last modified.
+     */
+    uint64_t hash;
+  };//struct GadrasDrfInfo
+
+
+  /** Returns the GADRAS DRFs at, or below, 'basedir', as known by the catalog, without touching the
+   filesystem.  Will be empty if 'basedir' has not been previously walked (in this, or a previous
+   session, if the catalog is persisted).
+
+   Results are sorted by name.
+   */
+  std::vector<GadrasDrfInfo> cached_gadras_drfs( const std::string &basedir );
+
+
+  /** Walks 'basedir' (recursively) updating the catalog for any changes, and returns the GADRAS
+   DRFs found.  Only directories whose modification time has changed are re-listed, and directories
+   that no longer exist are removed from the catalog.  DRFs are not parsed, except ones that had
+   been parsed before and whose files have since changed, so their hash stays current.  If anything
+   changed, the catalog is saved to disk.
+
+   Results are sorted by name.
+   */
+  std::vector<GadrasDrfInfo> refresh_gadras_drfs( const std::string &basedir );
+
+
+  /** Returns the parsed DRF for a GADRAS DRF directory, parsing it if it hasnt been parsed since its
+   files were last modified.  The returned object is a copy, so it may be modified by the caller.
+
+   Returns nullptr on error.
+   */
+  std::shared_ptr<DetectorPeakResponse> parse_gadras_drf( const std::string &path );
+
+
+  /** Returns the DRFs from a relative efficiency CSV/TSV file (see
+   #DetectorPeakResponse::parseMultipleRelEffDrfCsv), only re-parsing the file if its modification
+   time or size has changed.  Returned objects are copies, so may be modified by the caller.
+
+   @param path The path to the CSV/TSV file.
+   @param credits The '#credit:' lines from the file.
+   @param drfs The DRFs in the file; empty if file couldnt be opened, or contained no DRFs.
+   @returns If the file could be opened.
+   */
+  bool parse_rel_eff_file( const std::string &path,
+                           std::vector<std::string> &credits,
+                           std::vector<std::shared_ptr<DetectorPeakResponse>> &drfs );
+}//namespace DrfCatalog
+
+#endif //DrfCatalog_h
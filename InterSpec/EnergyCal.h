@@ -89,6 +89,58 @@ double fit_energy_cal_frf( const std::vector<EnergyCal::RecalPeakInfo> &peakinfo
                            std::vector<float> &coefs,
                            std::vector<float> &coefs_uncert );
 
+
+/** Per-file fit information from #fit_energy_cal_poly_multi_file. */
+struct MultiFileCalResidual
+{
+  /** Number of peaks from the file used in the fit. */
+  size_t num_peaks = 0;
+
+  /** Additional offset (keV) fit for this file, relative to the shared calibration; will be zero
+   if per-file offsets were not fit for, or for the reference (first with peaks) file.
+   */
+  double offset = 0.0;
+  double offset_uncert = 0.0;
+
+  /** The chi2 contribution of this files peaks. */
+  double chi2 = 0.0;
+
+  /** Statistics of (predicted energy - photopeak energy), in keV. */
+  double mean_residual = 0.0;
+  double rms_residual = 0.0;
+  double max_abs_residual = 0.0;
+};//struct MultiFileCalResidual
+
+
+/** Fits a single polynomial energy calibration to the peaks of multiple files, optionally also
+ fitting an additional offset for each file, in a single linear least squares solve.
+
+ The per-file offsets are relative to the shared calibration, with the first file that has peaks
+ being the reference (i.e., its offset is fixed to zero), so the shared coefficients coorespond to
+ that file.
+
+ @param peakinfos The peaks for each file; files with no peaks are allowed, and will have a
+        #MultiFileCalResidual with zero peaks.
+ @param fitfor Same as for #fit_energy_cal_poly.
+ @param fit_file_offsets Whether to fit an offset for each file (after the first with peaks).
+ @param nchannels The number of channels of the spectra.
+ @param dev_pairs The non-linear deviation pairs.
+ @param coefs Same as for #fit_energy_cal_poly.
+ @param coefs_uncert The uncertainties on the fit parameters.
+ @param residuals The per-file offset and residual information; will be same size as 'peakinfos'.
+ @returns Chi2 of the found solution.
+
+ Throws exception on error.
+ */
+double fit_energy_cal_poly_multi_file( const std::vector<std::vector<EnergyCal::RecalPeakInfo>> &peakinfos,
+                                       const std::vector<bool> &fitfor,
+                                       const bool fit_file_offsets,
+                                       const size_t nchannels,
+                                       const std::vector<std::pair<float,float>> &dev_pairs,
+                                       std::vector<float> &coefs,
+                                       std::vector<float> &coefs_uncert,
+                                       std::vector<MultiFileCalResidual> &residuals );
+
 /// \TODO: we could probably make a fit_energy_cal_lower_channel_energies that adjusts the offset
 ///        and gain equivalents for lower channel energy defined calibrations.
 
@@ -207,6 +259,58 @@ propogate_energy_cal_change( const std::shared_ptr<const SpecUtils::EnergyCalibr
                              const std::shared_ptr<const SpecUtils::EnergyCalibration> &other_cal );
 
 
+/** Batch version of #propogate_energy_cal_change, meant for files with many samples and detectors
+ (e.g., portal files with tens of thousands of measurements) where re-computing the calibration for
+ each #SpecUtils::Measurement would be slow.
+
+ Input calibrations are de-duplicated by value (type, number of channels, coefficients, deviation
+ pairs, and for lower channel energies, the channel energies), so each distinct calibration is only
+ computed once, and all inputs that were equal will share the same output object.  The distinct
+ calibrations are computed in parallel.
+
+ @param orig_cal The calibration before the change (e.g., what the user saw in the GUI)
+ @param new_cal The calibration after the change.
+ @param other_cals The calibrations to propagate the change to; entries equal to 'orig_cal' (by
+        pointer or value) will be mapped to 'new_cal'.
+ @param offset_only If true, only the change in offset (zeroth coefficient) is propagated to the
+        other calibrations, rather than the full channel-by-channel mapping.
+ @returns the updated calibrations, in the same order, and same number of entries, as 'other_cals'.
+
+ Throws exception if any input is null or invalid, or any resulting calibration would be invalid.
+ */
+std::vector<std::shared_ptr<const SpecUtils::EnergyCalibration>>
+propogate_energy_cal_changes( const std::shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                   const std::shared_ptr<const SpecUtils::EnergyCalibration> &new_cal,
+                   const std::vector<std::shared_ptr<const SpecUtils::EnergyCalibration>> &other_cals,
+                   const bool offset_only );
+
+
+/** A set of peaks, and the energy calibration change to translate them for; used by
+ #translatePeaksForCalibrationChanges.
+ */
+struct PeakCalTranslation
+{
+  std::shared_ptr<const std::deque<std::shared_ptr<const PeakDef>>> peaks;
+  std::shared_ptr<const SpecUtils::EnergyCalibration> old_cal;
+  std::shared_ptr<const SpecUtils::EnergyCalibration> new_cal;
+};//struct PeakCalTranslation
+
+
+/** Batch version of #translatePeaksForCalibrationChange that translates many sets of peaks (e.g.,
+ the peaks for each sample number group of a file) at once, in parallel.
+
+ Entries with null or empty peaks, or where 'old_cal' and 'new_cal' are the same object, are
+ returned unchanged (i.e., a copy of the input peaks).
+
+ @returns the translated peaks, in the same order, and same number of entries, as 'translations'.
+
+ Throws exception if any of the individual translations fail; in which case none of the results are
+ returned.
+ */
+std::vector<std::deque<std::shared_ptr<const PeakDef>>>
+translatePeaksForCalibrationChanges( const std::vector<PeakCalTranslation> &translations );
+
+
 /** Reads an input CALp file and returns a valid energy calibration.
  
  @param input Input stream with CALp file information.  If nullptr is returned, this function will seekg the stream back to its tellg position
@@ -58,6 +58,10 @@ namespace SpecUtils{ struct EnergyCalibration; }
    - have a model column that gives new energy difference of updated calibration
    - give total offset before, and with new calibration
    - The view for multi-sample files isnt displaying well
+ 
+ Optionally the peaks of all files can be re-fit (concurrently) before fitting the calibration, and
+ an additional offset can be fit for each file, in which case the per-file offsets and residuals are
+ reported in the fit summary.
  */
 
 class EnergyCalMultiFile : public Wt::WContainerWidget
@@ -74,6 +78,12 @@ public:
 protected:
   void updateCoefDisplay();
   
+  /** Re-fits the ROIs of the peaks selected for use in the fit, for each file and sample set, in
+   parallel, returning the updated peak info, indexed the same as #EnergyCalMultiFileModel::m_data.
+   ROIs that fail to refit will have their original peaks returned.
+   */
+  std::vector<std::vector<std::vector<std::shared_ptr<const PeakDef>>>> refitSelectedPeaks();
+  
   EnergyCalTool *m_calibrator;
   AuxWindow *m_parent;
   EnergyCalMultiFileModel *m_model;
@@ -83,11 +93,18 @@ protected:
   Wt::WPushButton *m_cancel;
   Wt::WPushButton *m_fit;
   Wt::WTextArea *m_fitSumary;
+  Wt::WCheckBox *m_refitPeaks;
+  Wt::WCheckBox *m_fitFileOffsets;
   
   
   std::vector<float> m_calVal;
   std::vector<float> m_calUncert;
   std::vector<std::pair<float,float>> m_devPairs;
+  
+  /** The additional offset (keV) fit for each file (same indexing as
+   #EnergyCalMultiFileModel::m_data); empty, or all zeros, if per-file offsets were not fit.
+   */
+  std::vector<double> m_fileOffsets;
 };//class EnergyCalMultiFile
 
 
@@ -0,0 +1,189 @@
+#ifndef ExternalRidWorkerPool_h
+#define ExternalRidWorkerPool_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <set>
+#include <list>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+
+/** Running the Full-Spectrum executable (i.e., "full-spec") for the #RemoteRid tool.
+
+ Starting the executable, and having it load its detector library, takes much longer than the
+ analysis itself, so #WorkerPool keeps instances of the executable running in its web-service mode,
+ listening on localhost, and sends them the same "/info" and "/analysis" requests the REST service
+ gets.  Analyses never wait on a worker to start up; until one is ready (or if the executable cant
+ be started as a service), each analysis is run as its own "--mode=command-line" process.
+ */
+namespace ExternalRid
+{
+  /** The inputs for a single analysis. */
+  struct AnalysisRequest
+  {
+    AnalysisRequest();
+
+    /** Path to the N42-2012 file of the spectrum to analyze. */
+    std::string spectrum_file;
+
+    /** Name of the detector response function to use. */
+    std::string drf;
+
+    /** If the executable should synthesize a background (e.g., the file has no background). */
+    bool synthesize_background;
+  };//struct AnalysisRequest
+
+
+  /** Returns the arguments to analyze the request with "--mode=command-line". */
+  std::vector<std::string> command_line_arguments( const AnalysisRequest &request );
+
+
+  /** Runs an executable (from within its own directory) with the specified arguments, and returns
+   what it wrote to stdout.
+
+   Throws exception if the executable cant be started, doesnt finish within 'timeout' (in which
+   case it is terminated), or if it returns a non-success code and either wrote to stderr, or didnt
+   write to stdout.
+   */
+  std::string run_command( const std::string &exe, const std::vector<std::string> &args,
+                           const std::chrono::seconds timeout );
+
+
+  class Worker;
+
+
+  /** A pool of long-lived Full-Spectrum processes.
+
+   Limits the number of concurrent analyses, reuses idle workers (checking that ones that have sat
+   idle still respond), shuts down workers that havent been used in a while, and starts new workers
+   on a background thread when there isnt an idle one available.
+   */
+  class WorkerPool
+  {
+  public:
+    struct Options
+    {
+      Options();
+
+      /** Maximum number of analyses that can run at once; also the maximum number of idle workers. */
+      size_t max_concurrent;
+
+      std::chrono::seconds startup_timeout;
+      std::chrono::seconds analysis_timeout;
+
+      /** Workers idle for longer than this are sent an "/info" request before being used. */
+      std::chrono::seconds ping_after_idle;
+      std::chrono::seconds ping_timeout;
+
+      std::chrono::seconds shutdown_after_idle;
+
+      /** How long to wait before trying to start a worker again, after a start failed; doubled for
+       each failure in a row.
+       */
+      std::chrono::seconds startup_retry_delay;
+    };//struct Options
+
+
+    /** The server-wide pool, using default #Options. */
+    static WorkerPool &instance();
+
+    explicit WorkerPool( const Options &options );
+
+    /** Terminates all workers, and waits on any being started. */
+    ~WorkerPool();
+
+    /** Runs an analysis, returning the JSON results from the executable.
+
+     Blocks until a slot is available, if the maximum number of analyses are already running, and
+     then until the analysis is complete.  Throws exception on error.
+     */
+    std::string analyze( const std::string &exe, const AnalysisRequest &request );
+
+    /** Starts a worker for the executable in the background, if there isnt already one idle, so
+     that the first analysis can use it.  Does not block.
+     */
+    void prestart( const std::string &exe );
+
+    /** Returns the number of idle workers for the executable; intended for testing. */
+    size_t numIdleWorkers( const std::string &exe );
+
+  protected:
+    /** Removes and returns an idle worker for the executable (or nullptr if there isnt one), and
+     shuts down workers that have been idle for too long.  Must be called with #m_mutex locked.
+     */
+    std::unique_ptr<Worker> takeIdleWorker( const std::string &exe );
+
+    /** Starts a worker on a background thread, if one isnt already being started for the
+     executable, the executable isnt known to not support the web-service mode, and we arent backing
+     off from a recent failure to start.  Must be called with #m_mutex locked.
+     */
+    void startWorker( const std::string &exe );
+
+    void returnToPool( std::unique_ptr<Worker> &&worker );
+
+    struct StarterThread
+    {
+      std::shared_ptr<std::atomic<bool>> done;
+      std::thread thread;
+    };//struct StarterThread
+
+    /** Failures to start a worker for an executable, since it last started successfully. */
+    struct StartFailures
+    {
+      StartFailures() : num_failures( 0 ), num_exits( 0 ), retry_after() {}
+
+      size_t num_failures;
+
+      /** Number of the most recent failures in a row where the executable exited on its own. */
+      size_t num_exits;
+
+      std::chrono::steady_clock::time_point retry_after;
+    };//struct StartFailures
+
+    const Options m_options;
+
+    std::atomic<bool> m_shutting_down;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_num_running;
+    std::deque<std::unique_ptr<Worker>> m_idle;
+    std::set<std::string> m_exes_starting;
+    std::set<std::string> m_exes_without_worker_mode;
+    std::map<std::string,StartFailures> m_start_failures;
+    std::list<StarterThread> m_starter_threads;
+  };//class WorkerPool
+}//namespace ExternalRid
+
+#endif //ExternalRidWorkerPool_h
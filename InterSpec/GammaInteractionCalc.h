@@ -30,6 +30,7 @@
 #include <tuple>
 #include <array>
 #include <atomic>
+#include <memory>
 #include <vector>
 #include <utility>
 
@@ -37,11 +38,12 @@
 
 #include <Wt/WColor>
 
-#include "Minuit2/FCNBase.h"
+#include "Minuit2/FCNGradientBase.h"
 
 
 class PeakDef;
 struct Material;
+class BatemanTable;
 class DetectorPeakResponse;
 
 namespace SandiaDecay
@@ -50,6 +52,11 @@ namespace SandiaDecay
   class NuclideMixture;
 }
 
+namespace BackgroundPeakCache
+{
+  class BackgroundModel;
+}
+
 namespace GammaInteractionCalc
 {
 
@@ -134,6 +141,8 @@ double transmission_length_coefficient_air( float energy );
 //  material with given atomic number and areal_density.
 //  The quantity retuned by this function is commonly labeled μ
 //Energy units should be in SandiaDecay/PhysicalUnits units.
+//Fractional atomic numbers are smoothly interpolated between elements, with a continuous
+//  derivative, so the atomic number of generic shielding can be fit for.
 double mass_attenuation_coef( float atomic_number, float energy );
 double transmition_coefficient_generic( float atomic_number, float areal_density,
                                 float energy );
@@ -386,7 +395,7 @@ struct DistributedSrcCalc
 
 
 class ShieldingSourceChi2Fcn
-    : public ROOT::Minuit2::FCNBase
+    : public ROOT::Minuit2::FCNGradientBase
 {
 //This class evaluated the chi2 of a given hypothesis, where it is assumed the
 //  radioactive source is a point source located at the center of concentric
@@ -540,6 +549,14 @@ public:
    */
   void setSelfAttMultiThread( const bool do_multithread );
   
+  /** Sets which parameters are fixed in the fit, so #Gradient does not spend time computing
+   derivatives for them (Minuit ignores the gradient components of fixed parameters, but for
+   volumetric sources they may require re-evaluating the self-attenuation integrals).
+   
+   An empty vector (the default) means no parameters are fixed.
+   */
+  void setFixedParameters( const std::vector<bool> &fixed );
+  
 
 /*
    Need to add method to extract mass fraction for isotopes fitting for the mass
@@ -575,11 +592,12 @@ public:
   
 
   
-  //setBackgroundPeaks(...): if you wish to correct for background counts, you
-  //  can set that here.  The peaks you pass in should be the original
-  //  background peaks for the background; similarly for the live time.  This
-  //  function will scale peak areas/uncertainties for the live time
-  void setBackgroundPeaks( const std::vector<PeakDef> &peaks, double liveTime );
+  //setBackground(...): if you wish to correct for background counts, you
+  //  can set that here (see BackgroundPeakCache::background_model(...)).
+  //  Background peak areas will be
+  //  scaled to the foreground live time when they are subtracted.  Pass in
+  //  nullptr to not correct for background.
+  void setBackground( std::shared_ptr<const BackgroundPeakCache::BackgroundModel> background );
   
   
   /** The calculation status for ShieldingSourceChi2Fcn. */
@@ -613,13 +631,36 @@ public:
   /** For interface compatibility; calls directly to #DoEval */
   virtual double operator()( const std::vector<double> &x ) const;
   
+  /** Returns the gradient of the chi2 returned by #DoEval, with respect to the parameters, so Minuit
+   doesnt have to numerically differentiate the chi2 (which would take at least two evaluations
+   per parameter, per iteration).
+   
+   For point sources the derivatives with respect to activities, shielding thicknesses, and generic
+   shielding atomic numbers and areal densities are analytic; the derivative with respect to age is
+   taken numerically, but only of the decay calculation, which is cheap.
+   For self-attenuating and trace sources, the derivatives with respect to trace activities are
+   analytic (counts are linear in them), while for other parameters the volumetric contributions
+   are re-integrated once, with the parameter slightly changed (e.g., a one-sided difference).
+   
+   May throw CancelException, just like #DoEval.  If there is any other error, falls back to
+   numerically differentiating the chi2 (see #numericalGradient).
+   */
+  virtual std::vector<double> Gradient( const std::vector<double> &x ) const;
+  
+  /** Returns false, so Minuit doesnt compare #Gradient to its own numerical derivative before
+   fitting; the volumetric source derivatives come from numerical integrations, so may not agree to
+   Minuits tolerances.
+   */
+  virtual bool CheckGradient() const;
+  
   
   //energy_chi_contributions(...): gives the chi2 contributions for each energy
   //  of peak, for the parameter values of x.
   //Does not take into account self attenuation.
   //'mixturecache' is to speed up multiple computations, and may be empty at
-  //  first.
-  typedef std::map< const SandiaDecay::Nuclide *, SandiaDecay::NuclideMixture> NucMixtureCache;
+  //  first; it holds the solved decay chain of each nuclide, so evaluating
+  //  a new age doesnt require re-decaying the nuclide.
+  typedef std::map< const SandiaDecay::Nuclide *, std::shared_ptr<const BatemanTable> > NucMixtureCache;
   
   //If 'info' is non-null then it will be filled with information about how much
   //  each nuclide/peak was attributed to each detected peak (currently not
@@ -770,19 +811,105 @@ public:
                   const double energyToCluster,
                   std::vector<std::string> *info
               );
+  
+  //cluster_line_activities(...): same as cluster_peak_activities(...), but
+  //  with the photon lines given directly, as {energy, photons per decay of
+  //  the parent}; each lines contribution is 'act' times its yield.  Since
+  //  the clustering is linear in the yields, this can also be used to
+  //  cluster derivatives of the yields.
+  static void cluster_line_activities( std::map<double,double> &energy_count_map,
+                  const std::vector< std::pair<double,double> > &energie_widths,
+                  const std::vector< std::pair<double,double> > &line_yields,
+                  const double act,
+                  const double photopeakClusterSigma,
+                  const double energyToCluster,
+                  std::vector<std::string> *info
+              );
 
 
   //returns the chi computed from the expected verses observed counts; one
   //  chi2 for each peak energy.  Each returned entry is {energy,chi,scale,PeakColor,ScaleUncert},
-  //  where scale is observed/expected
+  //  where scale is observed/expected.  If background is non-null, its peak
+  //  areas, scaled to liveTime, are subtracted from the observed peak areas.
   static std::vector< std::tuple<double,double,double,Wt::WColor,double> > expected_observed_chis(
                               const std::vector<PeakDef> &peaks,
-                              const std::vector<PeakDef> &backgroundPeaks,
+                              const BackgroundPeakCache::BackgroundModel *background,
+                              const double liveTime,
                               const std::map<double,double> &energy_count_map,
                               std::vector<std::string> *info = 0 );
 protected:
   
   void zombieCallback( const boost::system::error_code &ec );
+  
+  /** Throws CancelException if the user has cancelled the fit, or it has timed out. */
+  void throwIfCancelled() const;
+  
+  /** Adds the gammas of a nuclide, with activity 'act' at age 'age', to 'energy_count_map',
+   clustering them to the observed peaks (i.e., 'energie_widths'), taking into account
+   #m_allowMultipleNucsContribToPeaks.  No attenuation or detector effects are applied.
+   
+   \param dcounts_dage If non-null, the derivative of the added counts, with respect to age, will
+          be added to it.
+   */
+  void nuclide_peak_activities( std::map<double,double> &energy_count_map,
+                                const std::vector<std::pair<double,double>> &energie_widths,
+                                const SandiaDecay::Nuclide *nuclide,
+                                const double act,
+                                const double age,
+                                NucMixtureCache &mixturecache,
+                                std::vector<std::string> *info,
+                                std::map<double,double> *dcounts_dage = nullptr ) const;
+  
+  /** Computes the contributions of self-attenuating and trace sources, per unit live time, and adds
+   them to 'energy_count_map'.
+   
+   \param per_nuclide If non-null, will be filled with the contributions of each nuclide.
+   */
+  void volumetric_source_activities( const std::vector<double> &x,
+                                     NucMixtureCache &mixturecache,
+                                     const std::vector<std::pair<double,double>> &energie_widths,
+                                     std::map<double,double> &energy_count_map,
+                                     std::map<const SandiaDecay::Nuclide *,std::map<double,double>> *per_nuclide,
+                                     std::vector<std::string> *info ) const;
+  
+  /** Returns the index of the parameter that determines the age of the nuclide at index 'nuc_index'
+   (it may be the age of a different nuclide, see #age), or x.size() if the age is not currently
+   varying with any parameter (e.g., it is clamped at zero).
+   */
+  size_t ageParameterIndex( const size_t nuc_index, const std::vector<double> &x ) const;
+  
+  /** Returns if changing parameter 'par_index' changes the contributions of the self-attenuating or
+   trace sources; trace activities are not included, as they are handled analytically.
+   */
+  bool parameterAffectsVolumetricSources( const size_t par_index, const std::vector<double> &x ) const;
+  
+  /** Computes the expected counts, per unit live time, at each of 'energies' (the distinct energies
+   of 'energie_widths') from the point sources, after shielding, air, and detector effects.
+   Self-attenuating and trace sources are not included (see #volumetric_source_activities).
+   
+   This is the shared computation behind both #energy_chi_contributions and #Gradient, so the chi2
+   and its gradient always come from the same model.
+   
+   \param dcounts If non-null, will be resized to the number of parameters, and each non-fixed
+          parameter the point-source counts depend on will have the derivative of 'counts' with
+          respect to it; other entries are left empty.
+   \param info If non-null, descriptions of each step are added to it.
+   */
+  void point_source_counts( const std::vector<double> &x,
+                            const std::vector<std::pair<double,double>> &energie_widths,
+                            const std::vector<double> &energies,
+                            NucMixtureCache &mixturecache,
+                            std::vector<double> &counts,
+                            std::vector<std::vector<double>> *dcounts,
+                            std::vector<std::string> *info ) const;
+  
+  /** Computes the chi2 for parameters 'x', like #DoEval, but without reporting the evaluation to
+   #m_guiUpdateInfo.  Returns max double on error, and may throw CancelException.
+   */
+  double evaluateChi2( const std::vector<double> &x ) const;
+  
+  /** Numerically differentiates #evaluateChi2; used by #Gradient if there is an error. */
+  std::vector<double> numericalGradient( const std::vector<double> &x ) const;
 
 
 protected:
@@ -810,7 +937,7 @@ protected:
   //  from
   double m_photopeakClusterSigma;
   std::vector<PeakDef> m_peaks;
-  std::vector<PeakDef> m_backgroundPeaks;
+  std::shared_ptr<const BackgroundPeakCache::BackgroundModel> m_background;
   std::shared_ptr<const DetectorPeakResponse> m_detector;
   std::vector<ShieldingInfo> m_materials;
   std::vector<const SandiaDecay::Nuclide *> m_nuclides; //sorted alphebetically and unique
@@ -835,6 +962,12 @@ protected:
    */
   bool m_self_att_multithread;
   
+  /** Which parameters are fixed in the fit; used by #Gradient to skip them.
+   
+   \sa setFixedParameters
+   */
+  std::vector<bool> m_fixedParameters;
+  
   
   //A cache of nuclide mixtures to
   mutable NucMixtureCache m_mixtureCache;
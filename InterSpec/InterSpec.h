@@ -27,6 +27,7 @@
 
 #include <set>
 #include <deque>
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -604,9 +605,28 @@ public:
   //  is created and added to the tabs widget at bottom tool tabs.
   void closeGammaLinesWindow();
 
-  //handleToolTabChanged(...): sets focus to isotope line edit
+  //handleToolTabChanged(...): sets focus to isotope line edit, and creates the
+  //  tools contents, if they were deferred.
   void handleToolTabChanged( int tabSwitchedTo );
 
+  /** Creates the tool shown in the specified tool tab, if it hasn't been created yet.  Also sets
+   the focus to the nuclide input, if its the Reference Photopeak tab.
+   */
+  void createToolTabContents( const int tab );
+
+  /** Returns the Nuclide Search widget, creating it if it hasn't been yet; it is not created in the
+   constructor since it is rarely used, and relatively expensive to create.
+   */
+  IsotopeSearchByEnergy *nuclideSearch();
+
+  /** Returns the Peak Manager widget, creating it if it hasn't been yet. */
+  PeakInfoDisplay *peakInfoDisplay();
+
+  /** Called once, right after the first render of the page; creates the tool in the current tool
+   tab, and for non-web builds, creates the tools whose creation was deferred.
+   */
+  void finishDeferredStartup();
+
 
   SpecMeasManager *fileManager();
   
@@ -638,8 +658,14 @@ public:
   void showEnergyCalWindow();
   void handEnergyCalWindowClose();
 
+  /** Returns the energy calibration tool, creating it if it hasn't been yet. */
   EnergyCalTool *energyCalTool();
   
+  /** Passes the right-click-drag on the spectrum to #energyCalTool, so the tool doesnt need to be
+   created to connect to the signal.
+   */
+  void handleGraphicalRecalRequest( double xstart, double xfinish );
+  
   
   void showWarningsWindow();
   void handleWarningsWindowClose( bool closeWindowTo );
@@ -812,6 +838,11 @@ protected:
   void displaySecondForegroundData();
   void displayBackgroundData();
   void displayTimeSeriesData();
+  
+  /** Creates #m_timeSeries, hidden, and places it below the spectrum chart; it is not created until
+   a file with time-series data is shown.
+   */
+  void createTimeChart();
 
   
   //detectorsToDisplayChanged(): a callback function for when the user selects a
@@ -994,6 +1025,9 @@ public:
   void setXAxisCompact( bool compact );
   void setShowYAxisScalers( bool show );
   
+  /** Returns the Reference Photopeak widget.  When tool tabs are showing, it is created if it
+   hasn't been yet; when they are hidden, will be nullptr unless its window is showing.
+   */
   ReferencePhotopeakDisplay *referenceLinesWidget();
 
 #if( defined(WIN32) && BUILD_AS_ELECTRON_APP )
@@ -1102,6 +1136,8 @@ protected:
 protected:
   PeakModel *m_peakModel;
   D3SpectrumDisplayDiv *m_spectrum;
+  
+  /** Will be nullptr until a file with time-series data is first displayed; see #createTimeChart. */
   D3TimeChart *m_timeSeries;
   
   PopupDivMenu *m_detectorToShowMenu;
@@ -1136,9 +1172,14 @@ protected:
   
   Wt::WContainerWidget   *m_menuDiv; // The top menu bar.
 
+  //m_peakInfoContainer: holds m_peakInfoDisplay in its tab, when tool tabs are
+  //  visible; null when tool tabs are hidden.
+  Wt::WContainerWidget   *m_peakInfoContainer;
+  
   //m_peakInfoWindow is deleted when tool tabs are shown because the layout
   //  gets all messed up for some reason when m_peakInfoDisplay is removed
   //  and placed back in it.
+  //m_peakInfoDisplay will be nullptr until first needed (see peakInfoDisplay()).
   PeakInfoDisplay        *m_peakInfoDisplay;
   AuxWindow              *m_peakInfoWindow;
 
@@ -1158,6 +1199,11 @@ protected:
   //  when they are visible
   Wt::WTabWidget *m_toolsTabs;
 
+  //m_energyCalContainer: holds m_energyCalTool in its tab, when tool tabs are
+  //  visible, and the tool isnt in m_energyCalWindow; null otherwise.
+  Wt::WContainerWidget   *m_energyCalContainer;
+  
+  //m_energyCalTool: will be nullptr until first needed (see energyCalTool()).
   EnergyCalTool          *m_energyCalTool;
   AuxWindow              *m_energyCalWindow;
   GammaCountDialog       *m_gammaCountDialog;
@@ -1187,8 +1233,9 @@ protected:
   //  not.
   WContainerWidget       *m_nuclideSearchContainer;
   
-  //m_nuclideSearch: Nuclide Search widget.  Will always be a valid pointer,
-  //  although not always in the DOM (specifically when tool tabs are hidden).
+  //m_nuclideSearch: Nuclide Search widget.  Will be nullptr until first needed
+  //  (see nuclideSearch()); after that will always be a valid pointer, although
+  //  not always in the DOM (specifically when tool tabs are hidden).
   IsotopeSearchByEnergy  *m_nuclideSearch;
   
   //DataBaseUtils::DbSession is an indirect way to holds the Wt::Dbo::Session
@@ -1344,9 +1391,15 @@ protected:
   //  to know something.  Bits are set according to ClientDeviceType enum.
   unsigned int m_clientDeviceType;
 
+  //m_referenceLinesContainer: holds m_referencePhotopeakLines in its tab, when
+  //  tool tabs are visible, and the m_referencePhotopeakLinesWindow isnt
+  //  showing; null otherwise.
+  Wt::WContainerWidget      *m_referenceLinesContainer;
+  
   //m_referencePhotopeakLines: is a pointer to the widget where you can type in
   //  nuclides, reactions or elements (ex "U235", "W", "Ge(n,n)") to see the
-  //  reference photpeaks on the energy spectrum chart.
+  //  reference photpeaks on the energy spectrum chart.  Not created until
+  //  needed (see referenceLinesWidget()).
   ReferencePhotopeakDisplay *m_referencePhotopeakLines;
   AuxWindow                 *m_referencePhotopeakLinesWindow;
 
@@ -1444,6 +1497,18 @@ protected:
   bool m_findingHintPeaks;
   std::deque<boost::function<void()> > m_hintQueue;
   
+  //m_automatedPeakSearchRunning: so m_peakInfoDisplay can disable its search
+  //  button, if its created while a search is running.
+  bool m_automatedPeakSearchRunning;
+  
+  //m_startupFinished: set by finishDeferredStartup(); before then, tool tab
+  //  contents are not created.
+  bool m_startupFinished;
+  
+  //m_constructionStart: when the constructor started; finishDeferredStartup()
+  //  logs the time since then, as the time-to-interactive.
+  const std::chrono::steady_clock::time_point m_constructionStart;
+  
   static std::mutex sm_staticDataDirectoryMutex;
   static std::string sm_staticDataDirectory;
   
@@ -27,13 +27,16 @@
 
 #include <set>
 #include <mutex>
+#include <atomic>
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include <Wt/WApplication>
 #include <Wt/WContainerWidget>
 
 
+class SpecMeas;
 class InterSpec;
 namespace Wt
 {
@@ -147,12 +150,82 @@ public:
   
 #if( !BUILD_FOR_WEB_DEPLOYMENT )
   bool userOpenFromFileSystem( const std::string &path );
+#endif
   
+  /** Returns all currently running app instances.
+   
+   Note that you still need to take an WApplication::UpdateLock before accessing an instance.
+   */
   static std::set<InterSpecApp *> runningInstances();
   
-  //Need put put in a function that will minimize memmorry usage of all cuurently
-  //  running sessions.
-#endif
+  /** The resources used by a session, as of its last accounting update (which happens at most
+   every few seconds, as the user interacts with the session).
+   */
+  struct SessionResourceUsage
+  {
+    std::string sessionId;
+    
+    /** Approximate number of bytes of spectrum data the session holds in memory; this includes the
+     displayed foreground, background, and secondary spectrum files, as well as other files kept in
+     the #SpecMeasManager cache, or by their #SpectraFileHeader.
+     */
+    size_t residentBytes;
+    
+    /** The portion of #residentBytes for files not currently displayed, that can be written to
+     temporary files to free memory.
+     */
+    size_t cachedBytes;
+    
+    /** CPU time, in seconds, spent fitting peaks, shielding/sources, or relative activities; this
+     includes the time of threads the fits use, so is approximate when fits overlap in time.
+     */
+    double fitCpuSeconds;
+    
+    /** Time since the user last interacted with the session. */
+    std::chrono::steady_clock::duration idleTime;
+  };//struct SessionResourceUsage
+  
+  /** Returns the resource usage of all running sessions; does not require any app locks. */
+  static std::vector<SessionResourceUsage> sessionResourceUsage();
+  
+  /** Returns a human-readable summary of #sessionResourceUsage, with one line per session.
+   
+   This report is also written to the server log every ten minutes, and when the spectrum files of
+   all sessions are over the server memory budget.
+   */
+  static std::string sessionResourceUsageReport();
+  
+  /** Adds CPU time spent in a fit to a sessions accounting.  Thread safe, and may be called from
+   worker threads, or after the session has ended (in which case nothing is done).
+   */
+  static void addFitCpuTime( const std::string &sessionId, const double cpu_seconds );
+  
+  /** Measures the CPU time the process uses during the objects lifetime, and adds it to a sessions
+   accounting when destructed.  Intended to be created at the start of fit functions.
+   
+   Process CPU time is used so that the threads a fit farms its work out to are counted; when
+   multiple fits run at the same time, the CPU time is split evenly between them.
+   */
+  class FitCpuTimer
+  {
+  public:
+    explicit FitCpuTimer( const std::string &sessionId );
+    ~FitCpuTimer();
+    
+  protected:
+    const std::string m_sessionId;
+    const int m_startActiveTimers;
+    const uint64_t m_startTimersStarted;
+    const double m_startCpuTime;
+  };//class FitCpuTimer
+  
+  /** Writes spectrum files that arent currently being displayed to temporary files (or the database,
+   if the user preference is for that), and releases them from memory, including files their
+   #SpectraFileHeader was keeping in memory; they will be re-read if the user displays them again.
+   
+   Must be called from within this sessions event loop (e.g., using WServer::post).
+   */
+  void spillCachedMeasurements();
 
 #if( defined(WIN32) && BUILD_AS_ELECTRON_APP )
   //When users drag files from Outlook on windows into the app
@@ -266,6 +339,29 @@ protected:
   std::chrono::steady_clock::time_point m_lastAccessTime;
   std::chrono::steady_clock::time_point::duration m_activeTimeInSession;
   
+  //updateResourceAccounting(): updates m_residentBytes and m_cachedBytes, and
+  //  if the sum of all sessions memory is over the server budget (see
+  //  MAX_SERVER_SPECTRUM_MEMMORY_SIZE_MB), requests the least recently active
+  //  sessions to spill their cached measurements to disk.  Called from
+  //  notify(...), but only does anything every few seconds.
+  void updateResourceAccounting();
+  
+  //displayedMeasurements(): returns the foreground, background, and secondary
+  //  spectrum files currently displayed.
+  std::set<const SpecMeas *> displayedMeasurements() const;
+  
+  //The below are read from other sessions threads (without taking this
+  //  sessions lock), by sessionResourceUsage(), so are atomic.
+  std::atomic<size_t> m_residentBytes;
+  std::atomic<size_t> m_cachedBytes;
+  std::atomic<int64_t> m_fitCpuMicroSeconds;
+  
+  //m_lastActiveTicks: same as m_lastAccessTime, but as the number of
+  //  std::chrono::steady_clock ticks, so it can be atomic.
+  std::atomic<int64_t> m_lastActiveTicks;
+  
+  std::chrono::steady_clock::time_point m_lastAccountingTime;
+  
 #define OPTIMISTICALLY_SAVE_USER_STATE 0
   //If OPTIMISTICALLY_SAVE_USER_STATE is enabled, then the users state will
   //  attempt to be saved whenever a 'onbeforeunload' is recieved.  The downside
@@ -105,6 +105,12 @@ public:
   
   static std::set<const SandiaDecay::Element *> possibleElements( const std::vector<std::string> &alphastrs );
   
+  /** Builds the server-wide index of element and nuclide names that suggestions are looked up
+   from; if not called, the index is built on first use.  Initializes #DecayDataBaseServer if it
+   isnt already.
+   */
+  static void initializeSuggestionIndex();
+  
   static void replacerJs( std::string &js );
   static void nuclideNameMatcherJs( std::string &js );
 
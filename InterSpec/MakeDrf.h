@@ -31,12 +31,12 @@
 
 #include "InterSpec/AuxWindow.h"
 #include "InterSpec/MakeDrfFit.h"
+#include "InterSpec/MakeDrfChart.h"
+#include "InterSpec/DetectorPeakResponse.h"
 
 class PeakDef;
 class InterSpec;
 class MaterialDB;
-class MakeDrfChart;
-class DetectorPeakResponse;
 
 namespace Wt
 {
@@ -62,6 +62,62 @@ public:
   
   virtual ~MakeDrf();
   
+  /** The data points and fit equations a DRF is made from; everything needed to create the DRF,
+   or write its summary and reference sheet, without the widget (e.g., from #MakeDrfBatch).
+   */
+  struct FitResults
+  {
+    FitResults();
+    
+    /** The peaks, and their source information, the equations were fit to. */
+    std::vector<MakeDrfChart::DataPoint> data;
+    
+    /** Detector diameter, in PhysicalUnits; zero or negative if invalid. */
+    double diameter;
+    
+    /** Whether the efficiency equation takes energy in MeV (otherwise keV). */
+    bool effInMeV;
+    
+    std::vector<float> effCoefs, effCoefUncerts;
+    double effChi2;
+    float effLowerEnergy; ///< The lowest energy peak used for eff calculation
+    float effUpperEnergy; ///< The highest energy peak used for eff calculation
+    
+    DetectorPeakResponse::ResolutionFnctForm fwhmForm;
+    std::vector<float> fwhmCoefs, fwhmCoefUncerts;
+    double fwhmChi2;
+    
+    /** Any problems encountered assembling the data points; empty if none. */
+    std::string errorMessage;
+  };//struct FitResults
+  
+  
+  /** The gammas from one source that contribute to a peak; see #efficiencyDataPoint. */
+  struct PeakSourceRate
+  {
+    /** Gammas per second, into 4pi, at the peaks energy, after shielding and air attenuation. */
+    double rate;
+    
+    /** Distance, in PhysicalUnits, from the source to the detector face. */
+    double distance;
+    
+    /** Fractional uncertainty of the sources activity (e.g., 0.05 for 5%). */
+    double fractionalUncert;
+  };//struct PeakSourceRate
+  
+  /** Fills in the source count rate, and its uncertainty, of a data point from the sources that
+   contribute to its peak, and returns the intrinsic efficiency data point (with energy in keV).
+   
+   The energy, live time, and (background subtracted) peak area and uncertainty of 'point' must
+   already be filled in.  Used by both the GUI and #MakeDrfBatch, so they give the same efficiencies.
+   
+   Throws exception if the sources do not contribute any gammas.
+   */
+  static MakeDrfFit::DetEffDataPoint efficiencyDataPoint( MakeDrfChart::DataPoint &point,
+                                                          const std::vector<PeakSourceRate> &sources,
+                                                          const double diameter );
+  
+  
   /** Create a AuxWindow with the MakeDrf widget as the primary content.
       Returns pointer to the created AuxWindow, but is will already be shown,
       and have the signals to delete it when closed hooked up, so you probably
@@ -100,6 +156,14 @@ public:
   std::shared_ptr<DetectorPeakResponse> assembleDrf( const std::string &drfname,
                                                     const std::string &drfdescrip ) const;
   
+  /** Same as non-static version, but from the given fit results. */
+  static std::shared_ptr<DetectorPeakResponse> assembleDrf( const std::string &drfname,
+                                                           const std::string &drfdescrip,
+                                                           const FitResults &results );
+  
+  /** Returns the current data points, fit equations, and GUI inputs. */
+  FitResults currentFitResults() const;
+  
   /** Writes fit parameters and input data to a CSV-style file.  Tries to
      capture most of the relevant information in a the user can reference later.
      The import tab of Detector Select tool should also be able to import the
@@ -109,11 +173,36 @@ public:
                         std::string drfname,
                         std::string drfdescription );
   
+  /** Same as non-static version, but from the given fit results.
+   
+   @param utcOffsetMinutes The local time zone offset to write the creation time in.
+   */
+  static void writeCsvSummary( std::ostream &output,
+                               std::string drfname,
+                               std::string drfdescription,
+                               const FitResults &results,
+                               const int utcOffsetMinutes );
+  
   /** Writes a 3x5 style reference card in HTML to print on detectors. */
   void writeRefSheet( std::ostream &output,
                        std::string drfname,
                        std::string drfdescription );
   
+  /** Same as non-static version, but from the given fit results.
+   
+   Creates (but does not display) Wt widgets to render the chart and template, so requires a
+   #Wt::WApplication for the current thread, but not a MakeDrf widget.
+   
+   @param docroot The directory containing "InterSpec_resources", to read the template from.
+   @param utcOffsetMinutes The local time zone offset to write the creation date in.
+   */
+  static void writeRefSheet( std::ostream &output,
+                             std::string drfname,
+                             std::string drfdescription,
+                             const FitResults &results,
+                             const std::string &docroot,
+                             const int utcOffsetMinutes );
+  
   
   /** Access the user input widget to check if equation is in MeV or keV. */
   bool isEffEqnInMeV() const;
@@ -134,18 +223,24 @@ protected:
   
   void fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
                    const bool isHighResolution );
+  /** 'resampled' is only non-null if uncertainties were resampled; its band is drawn on the chart. */
   void updateFwhmEqn( std::vector<float> coefs, std::vector<float> uncerts,
                       const double chi2,
                       const int functionalForm, //see DetectorPeakResponse::ResolutionFnctForm
-                      const int fitid );
+                      const int fitid,
+                      std::shared_ptr<const MakeDrfFit::BootstrapResult> resampled );
   
   void fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data );
   
-  /** Error message is not empty, only when there is an error. */
+  /** Error message is not empty, only when there is an error.
+   'resampled' is only non-null if uncertainties were resampled; its band, whose energies are in the
+   units of the equation, is drawn on the chart.
+   */
   void updateEffEqn( std::vector<float> coefs, std::vector<float> uncerts,
                      const double chi2,
                     const float lowestEnergy, const float highestEnergy,
-                    const int fitid, const std::string errormsg );
+                    const int fitid, const std::string errormsg,
+                    std::shared_ptr<const MakeDrfFit::BootstrapResult> resampled );
 
   
   InterSpec *m_interspec;
@@ -181,6 +276,11 @@ protected:
   
   Wt::WCheckBox *m_airAttenuate;
   
+  /** If checked, the efficiency and FWHM coefficient uncertainties are estimated by refitting
+   resampled data (see #MakeDrfFit::bootstrap_efficiency_fit), rather than taken from the fit.
+   */
+  Wt::WCheckBox *m_bootstrapUncerts;
+  
   /** ToDo: make chart properly interactive so user doesnt need to input the
    energy range manually.
    */
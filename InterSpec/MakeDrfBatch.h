@@ -0,0 +1,196 @@
+#ifndef MakeDrfBatch_h
+#define MakeDrfBatch_h
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include "SpecUtils/DateTime.h"
+
+#include "InterSpec/MakeDrf.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+namespace SandiaDecay
+{
+  struct Nuclide;
+}
+
+
+/** Creates detector response functions (DRFs) for many detectors at once, from calibration
+ spectrum files with known sources, without a GUI session.
+
+ The detectors, files, and sources are given by a plain-text manifest, for example:
+ \verbatim
+   # Lines starting with '#' are comments
+   detector: Lab HPGe 1; 6.5 cm; P-type coax in room 112
+   option: eff_order=6
+   option: fwhm_form=sqrt_poly
+   file: calib/ba133_25cm.n42
+   source: Ba133; 9.8 uCi; 25 cm; uncert=3%; assay=2019-06-01
+   file: calib/mixed_50cm.n42
+   source: Cs137; 1.02 uCi; 50 cm; uncert=5%
+   source: Co60; 0.88 uCi; 50 cm; uncert=5%; an=26; ad=2.5
+   background: calib/background.n42
+
+   detector: Lab NaI; 3 in
+   file: ...
+ \endverbatim
+
+ Each "detector:" line starts a new detector, with fields name, diameter, and (optionally)
+ description separated by semicolons.  "option:" lines set the fit options of the current detector;
+ valid keys are "eff_order" (number of efficiency equation parameters, 1 to 8), "eff_units"
+ ("keV" or "MeV"), "fwhm_form" ("gadras", "sqrt_plus_inverse", or "sqrt_poly"), "sqrt_order", and
+ "air_attenuation" ("true" or "false").  "file:" and "background:" lines add a spectrum file to the
+ current detector, and "source:" lines add a source to the most recent file; source fields are
+ nuclide, activity at the assay date, and distance, followed by optional "uncert" (activity
+ uncertainty, in percent), "assay" (the assay date; if not given, the activity is assumed to be at
+ the measurement time), "age" (age at assay; defaults to the nuclides default age), "an" and "ad"
+ (atomic number and areal density, in g/cm2, of generic shielding) key/value pairs.  Relative file
+ paths are relative to the manifest.
+
+ Peaks saved in the spectrum files (e.g., an InterSpec N42 file) are used if present, otherwise the
+ automated peak search is done.  Peaks with a nuclide assigned are used for that source (and
+ skipped if it is not one of the files sources); other peaks are matched to the strongest source
+ photon line within 1.25 sigma of them.  Efficiencies are then computed the same as in the
+ #MakeDrf tool (see #MakeDrf::efficiencyDataPoint).
+
+ An example manifest, for the spectra in the "example_spectra" directory, is
+ "example_spectra/make_drf_batch_manifest.txt".
+ */
+namespace MakeDrfBatch
+{
+  /** A source measured in a calibration spectrum; the equivalent of #MakeDrfSrcDef. */
+  struct SourceDef
+  {
+    SourceDef();
+
+    const SandiaDecay::Nuclide *nuclide;
+
+    /** Activity, in PhysicalUnits, at #assay_date (or at the measurement time if no assay date). */
+    double activity;
+
+    /** Fractional uncertainty of #activity (e.g., 0.05 for 5%). */
+    double activity_uncertainty;
+
+    /** The date activity was determined; if special (i.e., not set), #activity is taken to be at the
+     time of measurement, and the nuclides default age is used.
+     */
+    SpecUtils::time_point_t assay_date;
+
+    /** The age of the source at #assay_date, in PhysicalUnits; if zero or less, the nuclides
+     default age (see #PeakDef::defaultDecayTime) is used.
+     */
+    double age_at_assay;
+
+    /** Distance, in PhysicalUnits, from source to the detector face. */
+    double distance;
+
+    /** Generic shielding around the source; an areal density of zero means no shielding. */
+    float shield_atomic_number;
+    float shield_areal_density;
+  };//struct SourceDef
+
+
+  /** A calibration spectrum file, and the sources in it. */
+  struct SpectrumFile
+  {
+    std::string filename;
+
+    /** If true, file is a background, and its peaks will be subtracted from the other files. */
+    bool is_background;
+
+    std::vector<SourceDef> sources;
+  };//struct SpectrumFile
+
+
+  /** The inputs to create the DRF for a single detector. */
+  struct DetectorDef
+  {
+    DetectorDef();
+
+    std::string name;
+    std::string description;
+
+    /** Detector diameter, in PhysicalUnits. */
+    double diameter;
+
+    std::vector<SpectrumFile> files;
+
+    /** The number of efficiency equation parameters; if zero or less, chosen from number of peaks
+     the same as the #MakeDrf tool defaults.
+     */
+    int eff_order;
+
+    bool eff_in_mev;
+    DetectorPeakResponse::ResolutionFnctForm fwhm_form;
+
+    /** The number of parameters for #DetectorPeakResponse::kSqrtPolynomial; if zero or less,
+     min(NumPeaks/2,4)+1 is used.
+     */
+    int sqrt_eqn_order;
+
+    bool air_attenuation;
+  };//struct DetectorDef
+
+
+  /** Parses a manifest, of the format described above.
+
+   @param input The manifest text.
+   @param basedir The directory relative file paths are relative to.
+
+   Throws exception, with the line number, on error.
+   */
+  std::vector<DetectorDef> parse_manifest( std::istream &input, const std::string &basedir );
+
+
+  /** Fits the peaks (if necessary), and efficiency and FWHM equations, for a detector.
+
+   Does not need a #Wt::WApplication, and may be called from any thread.
+
+   Throws exception if no files could be used, or the efficiency could not be fit; problems with
+   individual files or sources are noted in #MakeDrf::FitResults::errorMessage.
+   */
+  MakeDrf::FitResults fit_detector( const DetectorDef &detector );
+
+
+  /** Fits all the detectors in a manifest (in parallel), and writes to 'output_dir', for each
+   detector, a DRF XML file ("<name>.drf.xml"), the CSV summary ("<name>.csv", see
+   #MakeDrf::writeCsvSummary), and the reference sheet ("<name>_ref_sheet.html", see
+   #MakeDrf::writeRefSheet).
+
+   @param manifest_path Path to the manifest file.
+   @param output_dir Directory to write results to; created if it does not exist.
+   @param docroot The directory containing "InterSpec_resources".
+
+   Returns the number of detectors that failed (so zero on complete success); problems are printed
+   to stderr.
+   */
+  int run_batch( const std::string &manifest_path, const std::string &output_dir,
+                 const std::string &docroot );
+}//namespace MakeDrfBatch
+
+#endif //MakeDrfBatch_h
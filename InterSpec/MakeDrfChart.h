@@ -120,6 +120,33 @@ public:
                                   const std::vector<float> &uncerts,
                                   const EqnEnergyUnits units );
   
+  /** Returns the energies, in keV, the efficiency and FWHM equations are currently drawn at; these
+      change with the x-range of the data.
+   */
+  std::vector<float> equationEnergies() const;
+  
+  /** Set the band, e.g., the central 68% of resampled fits (see
+      #MakeDrfFit::bootstrap_efficiency_fit), to draw around the efficiency equation.
+   
+      @param energies Ascending energies, in keV, the band is given at; the band is interpolated
+             between these, and not drawn outside of them.
+      @param lower The lower edge of the band at each energy.
+      @param upper The upper edge of the band at each energy.
+   
+      Passing empty vectors removes the band from the chart; the band is also removed whenever
+      #setEfficiencyCoefficients is called.
+   */
+  void setEfficiencyBand( const std::vector<float> &energies,
+                          const std::vector<float> &lower,
+                          const std::vector<float> &upper );
+  
+  /** Same as #setEfficiencyBand, but for the FWHM equation; removed whenever #setFwhmCoefficients
+      is called.
+   */
+  void setFwhmBand( const std::vector<float> &energies,
+                    const std::vector<float> &lower,
+                    const std::vector<float> &upper );
+  
   /**
    */
   void setDataPoints( const std::vector<DataPoint> &datapoints,
@@ -175,6 +202,17 @@ protected:
   
   std::vector<float> m_efficiencyCoefUncerts;
   
+  /** Band drawn around an equation; all three vectors have the same size, or are empty. */
+  struct EqnBand
+  {
+    std::vector<float> energies;
+    std::vector<float> lower;
+    std::vector<float> upper;
+  };//struct EqnBand
+  
+  EqnBand m_efficiencyBand;
+  EqnBand m_fwhmBand;
+  
   FwhmCoefType m_fwhmEqnType;
   
   Wt::Signal<double,double> m_xRangeChanged;
@@ -67,7 +67,14 @@ namespace MakeDrfFit
   
   
   
-  struct DetEffDataPoint{ float energy, efficiency, efficiency_uncert; };
+  struct DetEffDataPoint
+  {
+    float energy;
+    float efficiency;
+    
+    /** Fractional uncertainty of #efficiency (e.g., 0.05 for 5%), as #MakeDrf fills it in. */
+    float efficiency_uncert;
+  };
   
   /** Performs fit of data efficiencies to:
       eff(x) = exp(A + B*log(x) + C*log(x)^2 + ...)
@@ -88,6 +95,68 @@ namespace MakeDrfFit
                              std::vector<float> &result,
                              std::vector<float> &uncerts );
   
+  
+  /** Results of refitting many resampled data sets; see #bootstrap_efficiency_fit and
+   #bootstrap_resolution_fit.
+   */
+  struct BootstrapResult
+  {
+    /** The number of resampled data sets that were successfully fit. */
+    size_t num_successful_fits;
+    
+    /** The mean of each fit coefficient, over the successful fits. */
+    std::vector<double> coef_means;
+    
+    /** The covariance of the fit coefficients, over the successful fits. */
+    std::vector<std::vector<double>> coef_covariance;
+    
+    /** The energies the confidence bands are evaluated at; the same as passed in. */
+    std::vector<float> energies;
+    
+    /** For each of #energies, the lower and upper bounds of the central (e.g., 68%) interval of the
+     fit functions value (efficiency or FWHM), over the successful fits.
+     */
+    std::vector<float> lower_band;
+    std::vector<float> upper_band;
+  };//struct BootstrapResult
+  
+  
+  /** Estimates the uncertainties of the #performEfficiencyFit coefficients by parametric
+   resampling: each data sets efficiencies are drawn from a log-normal distribution using the
+   fractional #DetEffDataPoint::efficiency_uncert, and refit using the (fast) general linear least
+   squares fit.  Resampled data sets are fit in parallel.
+   
+   Sampling is seeded by trial number, so results are reproducible.
+   
+   @param data The same data passed to #performEfficiencyFit.
+   @param fcnOrder The same order passed to #performEfficiencyFit.
+   @param num_trials The number of resampled data sets to fit; a few hundred is usually plenty.
+   @param energies The energies, in the same units as the data, to evaluate the efficiency band at.
+   @param confidence_level The fraction of resampled fits within the band.
+   
+   Throws exception on invalid input, or if less than half of the resampled data sets could be fit.
+   */
+  BootstrapResult bootstrap_efficiency_fit( const std::vector<DetEffDataPoint> &data,
+                                            const int fcnOrder,
+                                            const size_t num_trials,
+                                            const std::vector<float> &energies,
+                                            const double confidence_level = 0.6827 );
+  
+  /** Same as #bootstrap_efficiency_fit, but for #performResolutionFit; each peaks FWHM is sampled
+   using its sigma uncertainty (or 5% if not available).  The sqrt functional forms are refit using
+   #fit_sqrt_poly_fwhm_lls, while #DetectorPeakResponse::kGadrasResolutionFcn is refit with a
+   single Minuit minimization starting from 'nominal_coefs' (the result of #performResolutionFit).
+   
+   @param energies The energies, in keV, to evaluate the FWHM band at.
+   */
+  BootstrapResult bootstrap_resolution_fit( const std::deque< std::shared_ptr<const PeakDef> > &peaks,
+                                            const DetectorPeakResponse::ResolutionFnctForm fnctnlForm,
+                                            const bool highResolution,
+                                            const int sqrtEqnOrder,
+                                            const std::vector<float> &nominal_coefs,
+                                            const size_t num_trials,
+                                            const std::vector<float> &energies,
+                                            const double confidence_level = 0.6827 );
 }//namespace MakeDrfFit
 
 #endif  //MakeDrfFit_h
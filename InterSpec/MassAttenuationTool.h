@@ -94,6 +94,10 @@ namespace MassAttenuation
    *  Will throw ErrorLoadingDataException if the XS data cannot be loaded.
    *  Will throw std::runtime_error if atomic_number or energy is less than 1.01 keV, or larger than 100 MeV.
    *
+   * Between 1.02 keV and ~99 MeV, the result is linearly interpolated from values precomputed on a
+   * grid uniform in log(energy) (except near absorption edges), and agrees with the full calculation
+   * from the tabulated data to about one part in 10^4.
+   *
    * \param atomic_number Atomic number ranging from 1 to 98, inclusive
    * \param energy Energy (in keV), between 1.01 and 100,000.
    * \returns The mass attenuation coefficient for:
@@ -111,6 +115,39 @@ namespace MassAttenuation
    */
   float massAttenuationCoeficientFracAN( const float atomic_number, const float energy );
   
+  /** Same as #massAttenuationCoeficient, but for many energies at once; 'coefficients' will be
+   * resized to the same size as 'energies'.  Cheaper than calling #massAttenuationCoeficient for
+   * each energy, e.g., when computing attenuation for every channel of a spectrum.
+   *
+   * Throws the same exceptions as #massAttenuationCoeficient.
+   */
+  void massAttenuationCoeficients( const int atomic_number,
+                                   const std::vector<float> &energies,
+                                   std::vector<float> &coefficients );
+  
+  
+  /** Similar to #massAttenuationCoeficientFracAN, but instead of linearly interpolating between
+   * integer atomic numbers, log(μ) is interpolated using a monotonic cubic in atomic number, so both
+   * the result and its derivative with respect to atomic number are continuous.  This allows
+   * atomic number to be a regular continuous parameter when fitting.  At integer atomic numbers the
+   * result is the same as #massAttenuationCoeficient.
+   *
+   * For a fractional atomic number (or when 'dmu_dan' is requested), the result comes from a surface
+   * of log(μ), and its derivative in atomic number, precomputed for all elements on the same
+   * log-energy grid #massAttenuationCoeficient uses; the surface is built (loading all elements) the
+   * first time it is needed.  Near absorption edges, and off the grid, the four nearest elements are
+   * instead computed at the exact energy.  For an integer atomic number (and 'dmu_dan' null) this is
+   * just a call to #massAttenuationCoeficient.
+   *
+   * \param atomic_number Atomic number; clamped to the range 1 to 98.
+   * \param energy Energy (in keV), between 1.01 and 100,000.
+   * \param dmu_dan If non-null, will be set to the derivative of the result with respect to atomic
+   *        number (zero if atomic number had to be clamped).
+   * \returns The mass attenuation coefficient, in the same units as #massAttenuationCoeficient.
+   */
+  float massAttenuationCoeficientSmoothAN( const float atomic_number, const float energy,
+                                           float *dmu_dan = nullptr );
+  
   
   /** Compute the total attenuation coefficient using GADRASs CrossSection.lib.
    * Assumes "data/CrossSection.lib" (from GADRAS) exists, and upon first calling
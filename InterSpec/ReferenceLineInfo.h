@@ -26,6 +26,7 @@
 #include "InterSpec_config.h"
 
 #include <tuple>
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -133,6 +134,12 @@ struct ReferenceLineInfo
   /** Color to draw the line with.  Alpha not currently supported. */
   Wt::WColor lineColor;
   
+  /** The JSON array of lines (i.e., #linesToJson of #energies, #intensities, etc), if it has already
+   been computed; if non-null, #toJson will use this, instead of re-creating it.
+   Must be reset if any of the line vectors are changed.
+   */
+  std::shared_ptr<const std::string> linesJson;
+  
   ReferenceLineInfo();
   bool operator==( const ReferenceLineInfo &rhs ) const;
   void reset();
@@ -147,6 +154,10 @@ struct ReferenceLineInfo
   //        doing it by hand
   void toJson( std::string &json ) const;
   
+  //linesToJson(): returns the JSON array of lines used by toJson(...); does not
+  //  consult linesJson.  Lines are assumed to be sorted by energy.
+  std::string linesToJson() const;
+  
   std::string parentLabel() const;
   
   void sortByEnergy();
@@ -318,6 +318,13 @@ protected:
   
   
   bool m_is_calculating;
+  
+  /** Set when the user changes something while a calculation is running; the running calculation
+   is cancelled, and when it returns, a single new calculation (warm-started from #m_solution) is
+   started with the then-current state, so rapid edits coalesce into one solve.
+   */
+  bool m_calc_pending;
+  
   std::shared_ptr<std::atomic_bool> m_cancel_calc;
   std::shared_ptr<RelActCalcAuto::RelActAutoSolution> m_solution;
   
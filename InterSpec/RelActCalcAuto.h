@@ -242,6 +242,13 @@ FwhmForm fwhm_form_from_str( const char *str );
 /** Evaluates the FWHM equation for the input energy, returning the FWHM. */
 float eval_fwhm( const float energy, const FwhmForm form, const std::vector<float> &coeffs );
 
+/** Evaluates the FWHM equation for each of the `nenergies` energies, placing the FWHMs into
+ `results` (which must have room for `nenergies` values).  Quicker than calling the single-energy
+ version for each energy.
+ */
+void eval_fwhm( const float *energies, const size_t nenergies, const FwhmForm form,
+                const std::vector<float> &coeffs, float *results );
+
 size_t num_parameters( const FwhmForm eqn_form );
 
 
@@ -487,6 +494,12 @@ struct RelActAutoSolution
  
  @param rel_eff_order The number of energy dependent terms to have in the relative efficiency
         equation (e.g., one more parameter than this will be fit for).
+ @param previous_solution An optional previous solution, for the same foreground and background,
+        to warm-start from (e.g., when the user edits one thing in the GUI).  The final parameter
+        values of unchanged nuclides, floating peaks, and equations will be used as the starting
+        point, and if the nuclides are unchanged, the initial fit to the full input ROIs is skipped,
+        with input ROIs unchanged from the previous solution re-using its final ROIs.  Ignored if
+        it was not successful, or was for different spectra.
  */
 RelActAutoSolution solve( const Options options,
                          const std::vector<RoiRange> energy_ranges,
@@ -496,7 +509,8 @@ RelActAutoSolution solve( const Options options,
                          std::shared_ptr<const SpecUtils::Measurement> background,
                          std::shared_ptr<const DetectorPeakResponse> drf,
                          std::vector<std::shared_ptr<const PeakDef>> all_peaks,
-                         std::shared_ptr<std::atomic_bool> cancel_calc = nullptr
+                         std::shared_ptr<std::atomic_bool> cancel_calc = nullptr,
+                         std::shared_ptr<const RelActAutoSolution> previous_solution = nullptr
                          );
 
 
@@ -144,6 +144,16 @@ namespace SpecFileQuery
   const char *to_string( const NumericFieldMatchType type );
   bool from_string( const std::string &val, NumericFieldMatchType &type );
   
+  /** A SQL boolean expression, along with the values to bind to its '?' placeholders, in order.
+   Values are either a double, long long, or std::string.
+   */
+  struct SqlCondition
+  {
+    std::string sql;
+    std::vector<boost::any> values;
+  };//struct SqlCondition
+  
+  
   class SpecTest
   {
   public:
@@ -163,6 +173,14 @@ namespace SpecFileQuery
     
     bool test( const SpecFileInfoToQuery &meas ) const;
     
+    /** Sets `cond` to a SQL expression, against the tables of #SpecFileQueryDbCache, that is
+     true exactly when #test would return true.
+     
+     Returns false, and `cond` is unchanged, if this test can not be expressed in SQL (e.g., regex
+     tests, or nuclide tests that require the decay database).
+     */
+    bool to_sql( SqlCondition &cond ) const;
+    
     std::string summary() const;
     
     //Throw exception with explanation if not valid
@@ -302,6 +320,18 @@ namespace SpecFileQuery
 
     bool test( const SpecFileInfoToQuery &meas ) const;
     
+    /** Converts this test into SQL expressions, against the tables of #SpecFileQueryDbCache, so
+     cached files can be tested without loading them from the database.
+     
+     Tests that can not be expressed in SQL (Event XML tests, regex, etc) are treated as unknown,
+     so two conditions are produced: files matching `definite` will pass #test, files not matching
+     `possible` will fail #test, and the remaining files must be checked using #test.  If all tests
+     could be expressed in SQL, the two conditions will be identical.
+     
+     Returns false if the test could not be converted (e.g., the logic is malformed).
+     */
+    bool to_sql( SqlCondition &definite, SqlCondition &possible ) const;
+    
     //Throws exception if invalid
     void isvalid();
     
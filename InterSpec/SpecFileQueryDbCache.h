@@ -30,7 +30,10 @@
 #include <ctime>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
+#include <functional>
+#include <unordered_map>
 #include <condition_variable>
 
 #include <Wt/Dbo/Dbo>
@@ -39,6 +42,11 @@
 #include "SpecUtils/SpecFile.h"
 #include "SpecUtils/EnergyCalibration.h"
 
+namespace SpecFileQuery
+{
+  class SpecLogicTest;
+}
+
 //Forward declarations and Wt::Dbo::overhead ish. 
 namespace Wt {
   namespace Dbo {
@@ -179,6 +187,17 @@ struct SpecFileInfoToQuery
   std::string file_path;
   long long int file_size;
   long long int file_path_hash;
+  
+  /** Modification time of the file, in seconds since the epoch, when it was cached; zero if not
+   known (e.g., entries cached by older versions of InterSpec).
+   */
+  long long int file_mtime;
+  
+  /** A hash of the files size, and its first and last 64 kb, to check if a file whose modification
+   time has changed actually has different contents; zero if not known.
+   */
+  long long int content_hash;
+  
   bool is_file;
   bool is_spectrum_file;
   bool is_event_xml_file;
@@ -234,6 +253,8 @@ struct SpecFileInfoToQuery
     Wt::Dbo::id( a, file_path_hash, "file_path_hash" );
     Wt::Dbo::field( a, file_path, "file_path" );
     Wt::Dbo::field( a, file_size, "file_size" );
+    Wt::Dbo::field( a, file_mtime, "file_mtime" );
+    Wt::Dbo::field( a, content_hash, "content_hash" );
     Wt::Dbo::field( a, is_file, "is_file" );
     Wt::Dbo::field( a, is_spectrum_file, "is_spectrum_file" );
     Wt::Dbo::field( a, is_event_xml_file, "is_event_xml_file" );
@@ -307,6 +328,24 @@ public:
    */
   void cache_results( const std::vector<std::string> &&files );
   
+  /** Starts a background thread that keeps the database up to date as files in the base directory
+   are added, modified, or removed, so searches dont return stale results, or have to parse many
+   new files.
+   
+   On Linux, inotify is used to be notified of changes as they happen; additionally, and on other
+   platforms, the directory is re-scanned every few minutes, since inotify does not see changes
+   made by other hosts on network shares.  Re-scans only stat files, unless a file has changed.
+   
+   @param recursive Whether to watch sub-directories of the base directory.
+   @param filter Returns if a file should be cached; called from the watching thread.
+   
+   Does nothing if caching is not enabled.  If already watching, the previous watch is stopped.
+   */
+  void start_watching( const bool recursive, std::function<bool(const std::string &)> filter );
+  
+  /** Stops the thread started by #start_watching, if running. */
+  void stop_watching();
+  
   /** Stops #cache_results if executing in another thread.
    Subsequent calls to #cache_results will immediately return until
    #allow_start_caching is called.
@@ -332,13 +371,65 @@ public:
   /** Returns the #SpecFileInfoToQuery information for a given
       file on the filesystem.  If database caching is enabled, will first check
       the database for the information, and if found, return that (assuming
-      file size hasnt changed; this may switch to files modification date in the
-      future).  If not from the database then the spectrum file will be parsed
-      and information filled out from that; if DB caching is enabled the info
-      will also be stored to the databsae.
+      the file hasnt changed, see #entry_is_current).  If not from the database
+      then the spectrum file will be parsed and information filled out from
+      that; if DB caching is enabled the info will also be stored to the
+      databsae.
    */
   std::unique_ptr<SpecFileInfoToQuery> spec_file_info( const std::string &filepath );
-
+  
+  
+  /** The results of testing every file in the database against a query at once, using SQL.
+   */
+  struct PrefilterResults
+  {
+    enum class Result
+    {
+      /** The file passes the query; its #SpecFileInfoToQuery must still be retrieved to display. */
+      Pass,
+      
+      /** The file fails the query. */
+      Fail,
+      
+      /** The query has tests that can not be done in SQL, so the file must be tested normally. */
+      Undetermined
+    };//enum class Result
+    
+    struct Entry
+    {
+      long long file_size;
+      long long file_mtime;
+      bool is_spectrum_file;
+      std::string uuid;
+      Result result;
+    };//struct Entry
+    
+    /** Returns the entry for a file, or nullptr if the file wasnt in the database, or its size or
+     modification time have changed since it was cached (in which case it must be tested normally).
+     */
+    const Entry *find( const std::string &filepath ) const;
+    
+    /** Entries keyed by #SpecFileInfoToQuery::file_path_hash. */
+    std::unordered_map<long long,Entry> entries;
+  };//struct PrefilterResults
+  
+  
+  /** Tests all files cached in the database against `query`, using SQL, so searches over cached
+   files dont need to load, and test, every file individually.
+   
+   Returns nullptr if database caching isnt enabled, the query could not be converted to SQL, or
+   there is an error.
+   */
+  std::unique_ptr<PrefilterResults> prefilter( const SpecFileQuery::SpecLogicTest &query );
+  
+  
+  /** Tables that hold the multi-valued, and string, fields of #SpecFileInfoToQuery, one value per
+   row, so they can be searched on using indexes; see #SpecFileQuery::SpecTest::to_sql.
+   Columns are "file_path_hash", "field" (a #SpecFileQuery::FileDataField), and "value".
+   */
+  static const char * const sm_text_values_table;
+  static const char * const sm_numeric_values_table;
+  
 protected:
   bool open_db( const std::string &path, const bool create_tables );
   
@@ -351,6 +442,44 @@ protected:
   /** Constructs a unique file */
   static std::string construct_persisted_db_filename( std::string basepath );
   
+  /** Creates the #sm_text_values_table and #sm_numeric_values_table tables, and indexes, if they
+   dont already exist, filling them out from the existing database entries if necessary.
+   Returns if the tables are available.
+   You should have a lock on m_db_mutex while calling this function (or be in the constructor).
+   */
+  bool init_query_value_tables();
+  
+  /** Adds the rows of #sm_text_values_table and #sm_numeric_values_table for `info`.
+   You should have a lock on m_db_mutex, and an active transaction, while calling.
+   */
+  void add_query_values( const SpecFileInfoToQuery &info );
+  
+  /** Removes the rows of #sm_text_values_table and #sm_numeric_values_table for a file.
+   You should have a lock on m_db_mutex, and an active transaction, while calling.
+   */
+  void remove_query_values( const long long file_path_hash );
+  
+  /** Returns if a database entry is still valid for the file on disk.  The file size must match,
+   and if the modification time has changed, the contents hash must match; in which case the
+   entries modification time is updated (so you must commit the active transaction).
+   You should have a lock on m_db_mutex, and an active transaction, while calling.
+   */
+  bool entry_is_current( Wt::Dbo::ptr<SpecFileInfoToQuery> &entry, const std::string &filepath );
+  
+  /** Parses and adds a file to the database, if it isnt already there and current. */
+  void cache_file( const std::string &filepath );
+  
+  /** Removes a file from the database. */
+  void remove_cached_file( const std::string &filepath );
+  
+  /** The function run by the thread started by #start_watching. */
+  void watch_directory( const bool recursive, const std::function<bool(const std::string &)> filter );
+  
+  /** Re-lists the base directory, caching new or changed files, and removing entries for files that
+   no longer exist.  Returns early if #stop_watching is called.
+   */
+  void rescan_directory( const bool recursive, const std::function<bool(const std::string &)> &filter );
+  
 protected:
   bool m_use_db_caching;
   bool m_using_persist_caching;
@@ -367,7 +496,15 @@ protected:
   std::unique_ptr<Wt::Dbo::backend::Sqlite3> m_db;
   std::unique_ptr<Wt::Dbo::Session> m_db_session;
   
+  /** If #sm_text_values_table and #sm_numeric_values_table are available in the database. */
+  bool m_have_query_values;
+  
   const std::vector<EventXmlFilterInfo> m_xmlfilters;
+  
+  std::mutex m_watch_mutex;
+  std::condition_variable m_watch_cv;
+  bool m_stop_watching;
+  std::thread m_watch_thread;
 };//class SpecFileQueryDbCache
 
 
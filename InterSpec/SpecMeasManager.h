@@ -25,8 +25,10 @@
 
 #include "InterSpec_config.h"
 
+#include <set>
 #include <deque>
 #include <mutex>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <string>
@@ -307,6 +309,19 @@ public:
   void removeFromSpectrumInfoCache( std::shared_ptr<const SpecMeas> meas,
                                     bool saveToDisk ) const;
 
+  //cachedSpectraMemorySize(...): returns the approximate memory taken up by the
+  //  SpecMeas objects in m_tempSpectrumInfoCache, or kept in memory by their
+  //  SpectraFileHeader (see SpectraFileHeader::setKeepCachedInMemmorry()), not
+  //  counting those in 'exclude' (e.g., the currently displayed files, that
+  //  will remain in memory even if the caches are released).
+  size_t cachedSpectraMemorySize( const std::set<const SpecMeas *> &exclude ) const;
+  
+  //releaseCachedSpectra(...): clears m_tempSpectrumInfoCache, and has the
+  //  SpectraFileHeaders release the SpecMeas they are keeping in memory, except
+  //  for those in 'exclude', after saving them to disk.  The SpecMeas will be
+  //  re-read if the user displays them again.
+  void releaseCachedSpectra( const std::set<const SpecMeas *> &exclude );
+
   //serializeToTempFile(...): intended to be called right before a
   //  SpecMeas object is expected to be destructed in order to save it to a
   //  temporary file or the database, so that if the user loads it later it can
@@ -399,8 +414,11 @@ public:
   //group should have three buttons coorespnding SpecUtils::SpectrumType::Foreground, SpecUtils::SpectrumType::Background, and
   //  SpecUtils::SpectrumType::SecondForeground.
   //if index is valid, open the file that row cooreponds to; if not, will open
-  //  the selected row (if none selected open nothin, but that shouldnt ever
-  //  happen)
+  //  the selected rows (if none selected open nothin, but that shouldnt ever
+  //  happen).  Files are inflated and parsed (in parallel, if more than one)
+  //  off of the event loop, and then, back in the session, the first one is
+  //  displayed, and the rest added to the spectrum file manager; 'window' is
+  //  deleted before this function returns.
   void extractAndOpenFromZip( const std::string &spoolName,
                               Wt::WButtonGroup *group,
                               Wt::WTreeView *table,
@@ -414,15 +432,22 @@ public:
   //  Note: This function may return immediately, posting doing the actual work to another thread.
   //        If you want to complete the parsing/opening of the file before returning, call
   //        #handleFileDropWorker.
+  //  Multiple files dropped at once are each parsed in their own thread.
   void handleFileDrop( const std::string &name,
                        const std::string &spoolName,
                        SpecUtils::SpectrumType type );
   
+  //Parses the file without holding the WApplication::UpdateLock, and then takes the lock only to
+  //  add the parsed file to the model and display it (zip files, and files that arent spectrum
+  //  files, are handled while holding the lock).
+  //  If 'cancelled' is non-null, and set to true before parsing finishes, the parsed file is
+  //  discarded.  'dialog' is accepted, if it hasnt been cancelled, once everything is done.
   void handleFileDropWorker( const std::string &name,
                        const std::string &spoolName,
                        SpecUtils::SpectrumType type,
                        SimpleDialog *dialog,
-                       Wt::WApplication *app );
+                       Wt::WApplication *app,
+                       std::shared_ptr<std::atomic<bool>> cancelled = nullptr );
 
 protected:
   //Called from inside displayFile(...) to see if there are options for
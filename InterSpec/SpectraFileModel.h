@@ -153,8 +153,12 @@ public:
   //  If errors are encountered, setKeepCachedInMemmorry(true) is called, but
   //  no exceptions thrown
   //  The saving is actually done in a thread owned by WServer.
+  //  Returns false if the save could not be started, in which case the
+  //  SpecMeas is now cached in memory (see cachedMeasurement()); returns true
+  //  if the save was started (if writing the file later fails,
+  //  errorSavingCallback(...) caches the SpecMeas instead).
   //XXX - Should consider adding an on error callback!
-  void saveToFileSystem( std::shared_ptr<SpecMeas> measurment )  const;
+  bool saveToFileSystem( std::shared_ptr<SpecMeas> measurment )  const;
 
   //saveToFileSystemImmediately(...): saves (in calling thread) the passed in
   //  SpecMeas object; if a copy of the SpecMeas object in memmory can be
@@ -196,6 +200,10 @@ public:
   void setKeepCachedInMemmorry( bool cache = true );
 
   std::shared_ptr<SpecMeas> measurementIfInMemory() const;
+  
+  //cachedMeasurement(): returns the SpecMeas this header is keeping in memory
+  //  because of m_keepCache (i.e., m_cachedMeasurement), which may be null.
+  std::shared_ptr<SpecMeas> cachedMeasurement() const;
 
 #if( USE_DB_TO_STORE_SPECTRA )
   //Experimental DB section
@@ -181,6 +181,17 @@ public:
   //  An empty boost::any() is returned if data is not avaliable
   virtual boost::any displayBinValue( int row, ColumnType column ) const;
 
+  //rowValues(...): fills 'values' with what data(index(row,column)) would
+  //  return (i.e., including background subtraction) for each row from
+  //  'firstRow' through 'lastRow', and 'lowEdges' with the lower x-value of
+  //  each of these rows, plus the upper edge of the last row.  Avoids the
+  //  per-row WModelIndex and boost::any overhead, for when rendering spectra
+  //  with many channels.  Rows are clamped to the valid range.
+  //  Returns false (and clears the vectors) if the column has no data.
+  bool rowValues( const int column, int firstRow, int lastRow,
+                  std::vector<double> &lowEdges,
+                  std::vector<double> &values ) const;
+
 
   void addIntegralOfHistogramToLegend( const bool doIt = true );
 
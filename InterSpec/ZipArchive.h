@@ -31,10 +31,22 @@
 #include <iostream>
 #include <stdint.h>
 
+namespace boost
+{
+  namespace interprocess
+  {
+    class file_mapping;
+    class mapped_region;
+  }
+}
+
 /** ZipArchive opens a ZIP file and allows you to extract files it contains.
    Its not incredibly well tested, and could definetly stand to use more error
    checking, but it does seem to work.
  
+   ZIP64 archives (more than 65535 entries, or entries/archives larger than
+   4 GB) are supported, but multi-disk archives, and encrypted entries are not.
+ 
    To use this code, you must link to zlib as well as have zlib.h in your 
    include path.
 */
@@ -48,10 +60,10 @@ namespace ZipArchive
     uint16_t compression_type;
     uint16_t stamp_date,stamp_time;
     uint32_t crc;
-    uint32_t compressed_size;
-    uint32_t uncompressed_size;
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
     std::string filename;
-    uint32_t header_offset; // local header offset
+    uint64_t header_offset; // local header offset
     
     bool init( std::istream &istream, const bool global );
   };//struct ZipFileHeader
@@ -73,5 +85,56 @@ namespace ZipArchive
   size_t read_file_from_zip( std::istream &instrm,
                              std::shared_ptr<const ZipFileHeader> header,
                              std::ostream &output );
+  
+  
+  /** A ZIP archive memory-mapped from the filesystem, so entries can be inflated directly from
+   the mapped memory, by multiple threads at once, without seeking a shared stream.
+   
+   Constructor throws std::exception with descriptive message if the file cant be mapped, or isnt a
+   valid ZIP archive.
+   */
+  class MappedZipArchive
+  {
+  public:
+    explicit MappedZipArchive( const std::string &filename );
+    ~MappedZipArchive();
+    
+    MappedZipArchive( const MappedZipArchive & ) = delete;
+    MappedZipArchive &operator=( const MappedZipArchive & ) = delete;
+    
+    /** The entries of the archive; garunteed to have at least one entry. */
+    const FilenameToZipHeaderMap &headers() const;
+    
+    /** Inflates an entry into a memory buffer.
+     
+     Throws std::exception on error.  Is thread-safe.
+     */
+    std::vector<char> read_file( std::shared_ptr<const ZipFileHeader> header ) const;
+    
+    /** The result of inflating one entry with #read_files. */
+    struct ExtractedFile
+    {
+      std::shared_ptr<const ZipFileHeader> header;
+      
+      /** The uncompressed file contents; empty if there was an error. */
+      std::vector<char> data;
+      
+      /** Error message if the entry could not be inflated; empty on success. */
+      std::string error;
+    };//struct ExtractedFile
+    
+    /** Inflates the requested entries in parallel; results are in the same order as 'headers'.
+     Errors inflating individual entries are reported in #ExtractedFile::error, rather than thrown.
+     */
+    std::vector<ExtractedFile> read_files(
+                  const std::vector<std::shared_ptr<const ZipFileHeader>> &headers ) const;
+    
+  protected:
+    std::unique_ptr<boost::interprocess::file_mapping> m_file;
+    std::unique_ptr<boost::interprocess::mapped_region> m_region;
+    const char *m_data;
+    size_t m_size;
+    FilenameToZipHeaderMap m_headers;
+  };//class MappedZipArchive
 }//namespace ZipArchive
 #endif
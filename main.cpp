@@ -53,6 +53,10 @@
 #include "testing/developcode.h"
 #endif
 
+#if( USE_MAKE_DRF_BATCH )
+#include "InterSpec/MakeDrfBatch.h"
+#endif
+
 //Forward declaration
 Wt::WApplication *createApplication( const Wt::WEnvironment &env );
 
@@ -133,6 +137,32 @@ int main( int argc, char **argv )
   
   processCustomArgs( argc, argv );
   
+#if( USE_MAKE_DRF_BATCH )
+  {//begin check if creating DRFs from the command line
+    std::string manifest, outdir = ".", docroot = ".";
+    for( int i = 1; i < argc; ++i )
+    {
+      const std::string arg = argv[i];
+      if( (arg == "--make-drf-batch") && ((i+1) < argc) )
+        manifest = argv[++i];
+      else if( (arg == "--drf-output-dir") && ((i+1) < argc) )
+        outdir = argv[++i];
+      else if( (arg == "--docroot") && ((i+1) < argc) )
+        docroot = argv[++i];
+      else if( arg.size() > 10 && arg.substr(0,10) == "--docroot=" )
+        docroot = arg.substr(10);
+    }//for( int i = 1; i < argc; ++i )
+    
+    // Wt allows the docroot to have a ";" separated list of paths to serve
+    const size_t semicolon_pos = docroot.find( ';' );
+    if( semicolon_pos != std::string::npos )
+      docroot = docroot.substr( 0, semicolon_pos );
+    
+    if( !manifest.empty() )
+      return MakeDrfBatch::run_batch( manifest, outdir, docroot );
+  }//end check if creating DRFs from the command line
+#endif
+  
   DataBaseVersionUpgrade::checkAndUpgradeVersion();
   
   // TODO: switch to using InterSpecServer::startServer(), etc
@@ -0,0 +1,340 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <cmath>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/functional/hash.hpp>
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/EnergyCalibration.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/BackgroundPeakCache.h"
+
+using namespace std;
+
+namespace
+{
+  /** The number of background models kept around after their last use. */
+  const size_t ns_max_cached_models = 8;
+
+  /** The number of re-binnings each model keeps. */
+  const size_t ns_max_cached_rebinnings = 4;
+
+  /** Models are keyed by the identity of the background spectrum, its channel counts, and its
+   energy calibration (SpecUtils replaces, rather than modifies, the counts and calibration when they
+   change), its live-time, and a hash of the peaks.  Each cached model holds on to all of these
+   objects, so their addresses can not be re-used while they are in the cache.
+   */
+  typedef std::tuple<const void *,const void *,const void *,double,uint64_t> ModelKey;
+
+  struct CachedModel
+  {
+    shared_ptr<const BackgroundPeakCache::BackgroundModel> model;
+    uint64_t last_used;
+  };//struct CachedModel
+
+  std::mutex sm_cache_mutex;
+  uint64_t sm_use_counter = 0;
+  std::map<ModelKey,CachedModel> sm_cache;
+
+
+  shared_ptr<const BackgroundPeakCache::BackgroundModel> cached_model( const ModelKey &key )
+  {
+    std::lock_guard<std::mutex> lock( sm_cache_mutex );
+    auto pos = sm_cache.find( key );
+    if( pos == end(sm_cache) )
+      return nullptr;
+    pos->second.last_used = ++sm_use_counter;
+    return pos->second.model;
+  }//cached_model(...)
+
+
+  /** Inserts the model into the cache, unless another thread beat us to it, in which case the
+   already cached model is returned, so all callers share the same model.
+   */
+  shared_ptr<const BackgroundPeakCache::BackgroundModel>
+           cache_model( const ModelKey &key, shared_ptr<const BackgroundPeakCache::BackgroundModel> model )
+  {
+    std::lock_guard<std::mutex> lock( sm_cache_mutex );
+
+    auto pos = sm_cache.find( key );
+    if( pos != end(sm_cache) )
+    {
+      pos->second.last_used = ++sm_use_counter;
+      return pos->second.model;
+    }
+
+    CachedModel &entry = sm_cache[key];
+    entry.model = model;
+    entry.last_used = ++sm_use_counter;
+
+    while( sm_cache.size() > ns_max_cached_models )
+    {
+      auto oldest = begin(sm_cache);
+      for( auto iter = begin(sm_cache); iter != end(sm_cache); ++iter )
+      {
+        if( iter->second.last_used < oldest->second.last_used )
+          oldest = iter;
+      }
+      sm_cache.erase( oldest );
+    }//while( sm_cache.size() > ns_max_cached_models )
+
+    return model;
+  }//cache_model(...)
+
+
+  uint64_t peaks_hash( const vector<PeakDef> &peaks )
+  {
+    size_t seed = peaks.size();
+    for( const PeakDef &p : peaks )
+    {
+      boost::hash_combine( seed, p.gausPeak() );
+      boost::hash_combine( seed, p.mean() );
+      boost::hash_combine( seed, p.peakArea() );
+      boost::hash_combine( seed, p.peakAreaUncert() );
+      if( p.gausPeak() )
+        boost::hash_combine( seed, p.sigma() );
+      else
+        boost::hash_combine( seed, p.roiWidth() );
+    }//for( const PeakDef &p : peaks )
+
+    return static_cast<uint64_t>( seed );
+  }//peaks_hash(...)
+
+
+  bool same_calibration( const SpecUtils::EnergyCalibration &lhs,
+                         const SpecUtils::EnergyCalibration &rhs )
+  {
+    if( &lhs == &rhs )
+      return true;
+
+    if( (lhs.type() != rhs.type()) || (lhs.num_channels() != rhs.num_channels()) )
+      return false;
+
+    if( lhs.type() == SpecUtils::EnergyCalType::LowerChannelEdge )
+    {
+      const auto &lhs_energies = lhs.channel_energies();
+      const auto &rhs_energies = rhs.channel_energies();
+      return (lhs_energies == rhs_energies)
+             || (lhs_energies && rhs_energies && ((*lhs_energies) == (*rhs_energies)));
+    }//if( LowerChannelEdge )
+
+    return (lhs.coefficients() == rhs.coefficients())
+           && (lhs.deviation_pairs() == rhs.deviation_pairs());
+  }//same_calibration(...)
+}//namespace
+
+
+namespace BackgroundPeakCache
+{
+
+BackgroundModel::BackgroundModel( const std::shared_ptr<const SpecUtils::Measurement> &spectrum,
+                                  const std::vector<PeakDef> &peaks )
+  : m_spectrum( spectrum ),
+    m_counts( nullptr ),
+    m_energyCal( nullptr ),
+    m_liveTime( 0.0 ),
+    m_peaks{},
+    m_peakMeans{},
+    m_nonGaussianEnergies{},
+    m_maxSigma( 0.0 ),
+    m_rebinnedMutex{},
+    m_rebinned{}
+{
+  if( !spectrum )
+    throw runtime_error( "BackgroundModel: no background spectrum." );
+
+  m_counts = spectrum->gamma_counts();
+  m_energyCal = spectrum->energy_calibration();
+  m_liveTime = spectrum->live_time();
+  if( (m_liveTime <= 0.0) || IsNan(m_liveTime) || IsInf(m_liveTime) )
+    throw runtime_error( "BackgroundModel: background spectrum has invalid live-time." );
+
+  for( const PeakDef &p : peaks )
+  {
+    if( p.gausPeak() )
+    {
+      m_peaks.push_back( p );
+      m_maxSigma = std::max( m_maxSigma, p.sigma() );
+    }else
+    {
+      m_nonGaussianEnergies.push_back( p.mean() );
+    }
+  }//for( const PeakDef &p : peaks )
+
+  std::sort( begin(m_peaks), end(m_peaks), &PeakDef::lessThanByMean );
+
+  m_peakMeans.reserve( m_peaks.size() );
+  for( const PeakDef &p : m_peaks )
+    m_peakMeans.push_back( p.mean() );
+}//BackgroundModel constructor
+
+
+const std::shared_ptr<const SpecUtils::Measurement> &BackgroundModel::spectrum() const
+{
+  return m_spectrum;
+}
+
+
+double BackgroundModel::liveTime() const
+{
+  return m_liveTime;
+}
+
+
+const std::vector<PeakDef> &BackgroundModel::peaks() const
+{
+  return m_peaks;
+}
+
+
+const std::vector<double> &BackgroundModel::nonGaussianPeakEnergies() const
+{
+  return m_nonGaussianEnergies;
+}
+
+
+void BackgroundModel::peakAreaNear( const double energy, const double window,
+                                    const double live_time,
+                                    double &area, double &uncert2 ) const
+{
+  area = uncert2 = 0.0;
+
+  const double scale = live_time / m_liveTime;
+  auto pos = std::lower_bound( begin(m_peakMeans), end(m_peakMeans), energy - window );
+  for( ; (pos != end(m_peakMeans)) && ((*pos) < (energy + window)); ++pos )
+  {
+    if( fabs((*pos) - energy) >= window )
+      continue;
+
+    const PeakDef &p = m_peaks[pos - begin(m_peakMeans)];
+    area += scale * p.peakArea();
+    uncert2 += scale * scale * p.peakAreaUncert() * p.peakAreaUncert();
+  }//for( loop over peaks within window )
+}//void peakAreaNear(...)
+
+
+void BackgroundModel::peakAreaInRange( const double lower, const double upper,
+                                       const double live_time,
+                                       double &area, double &uncert2 ) const
+{
+  area = uncert2 = 0.0;
+
+  if( upper <= lower )
+    return;
+
+  // Peaks further than 8 sigma away contribute nothing meaningful
+  const double scale = live_time / m_liveTime;
+  auto pos = std::lower_bound( begin(m_peakMeans), end(m_peakMeans), lower - 8.0*m_maxSigma );
+  for( ; (pos != end(m_peakMeans)) && ((*pos) < (upper + 8.0*m_maxSigma)); ++pos )
+  {
+    const PeakDef &p = m_peaks[pos - begin(m_peakMeans)];
+    const double integral = p.gauss_integral( lower, upper );
+    const double frac = (p.peakArea() > 0.0) ? (integral / p.peakArea()) : 0.0;
+
+    area += scale * integral;
+    uncert2 += scale * scale * frac * frac * p.peakAreaUncert() * p.peakAreaUncert();
+  }//for( loop over peaks near range )
+}//void peakAreaInRange(...)
+
+
+std::shared_ptr<const std::vector<float>> BackgroundModel::countsForCalibration(
+                       const std::shared_ptr<const SpecUtils::EnergyCalibration> &cal ) const
+{
+  if( !cal || !cal->valid() || !cal->channel_energies() )
+    throw runtime_error( "BackgroundModel::countsForCalibration: invalid energy calibration." );
+
+  const shared_ptr<const SpecUtils::EnergyCalibration> &back_cal = m_energyCal;
+  const shared_ptr<const vector<float>> &back_counts = m_counts;
+  if( !back_cal || !back_cal->valid() || !back_cal->channel_energies() || !back_counts )
+    throw runtime_error( "BackgroundModel::countsForCalibration: invalid background spectrum." );
+
+  {//begin lock on m_rebinnedMutex
+    std::lock_guard<std::mutex> lock( m_rebinnedMutex );
+    for( size_t i = 0; i < m_rebinned.size(); ++i )
+    {
+      if( same_calibration( *m_rebinned[i].first, *cal ) )
+      {
+        auto answer = m_rebinned[i].second;
+        std::rotate( begin(m_rebinned), begin(m_rebinned) + i, begin(m_rebinned) + i + 1 );
+        return answer;
+      }
+    }//for( loop over previous re-binnings )
+  }//end lock on m_rebinnedMutex
+
+  auto counts = make_shared<vector<float>>();
+  if( same_calibration( *back_cal, *cal ) )
+    *counts = *back_counts;
+  else
+    SpecUtils::rebin_by_lower_edge( *back_cal->channel_energies(), *back_counts,
+                                    *cal->channel_energies(), *counts );
+
+  std::lock_guard<std::mutex> lock( m_rebinnedMutex );
+  m_rebinned.insert( begin(m_rebinned), make_pair(cal, counts) );
+  if( m_rebinned.size() > ns_max_cached_rebinnings )
+    m_rebinned.resize( ns_max_cached_rebinnings );
+
+  return counts;
+}//countsForCalibration(...)
+
+
+std::shared_ptr<const BackgroundModel> background_model(
+                                     const std::shared_ptr<const SpecUtils::Measurement> &background,
+                                     const std::vector<PeakDef> &peaks )
+{
+  if( !background )
+    throw runtime_error( "background_model: invalid background spectrum." );
+
+  // The key only looks at pointers and the peaks, so is cheap compared to creating the model
+  const ModelKey key{ background.get(), background->gamma_counts().get(),
+                      background->energy_calibration().get(), background->live_time(),
+                      peaks_hash(peaks) };
+
+  shared_ptr<const BackgroundModel> model = cached_model( key );
+  if( model )
+    return model;
+
+  model = make_shared<BackgroundModel>( background, peaks );
+
+  return cache_model( key, model );
+}//background_model(...)
+
+
+void clear_cache()
+{
+  std::lock_guard<std::mutex> lock( sm_cache_mutex );
+  sm_cache.clear();
+}//void clear_cache()
+
+}//namespace BackgroundPeakCache
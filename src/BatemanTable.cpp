@@ -0,0 +1,382 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <set>
+#include <cmath>
+#include <cassert>
+#include <limits>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "InterSpec/BatemanTable.h"
+
+using namespace std;
+
+namespace
+{
+  /** Decay constants closer than this (relative) are nudged apart; see #BatemanTable. */
+  const double sm_min_rel_lambda_diff = 1.0E-6;
+
+  /** The energy of annihilation gammas; same value as used elsewhere in InterSpec. */
+  const double sm_annihilation_energy = 510.998910 * SandiaDecay::keV;
+
+  double decay_constant( const SandiaDecay::Nuclide * const nuc )
+  {
+    if( !nuc || nuc->isStable() || !(nuc->halfLife > 0.0) || IsInf(nuc->halfLife) )
+      return 0.0;
+    return std::log(2.0) / nuc->halfLife;
+  }
+}//namespace
+
+
+BatemanTable::BatemanTable( const SandiaDecay::Nuclide * const parent,
+                            const bool include_xrays,
+                            const std::vector<double> &energies_to_exclude )
+  : m_parent( parent )
+{
+  if( !parent )
+    throw runtime_error( "BatemanTable: null parent nuclide." );
+
+  const double parent_lambda = decay_constant( parent );
+  if( parent_lambda <= 0.0 )
+    throw runtime_error( "BatemanTable: " + parent->symbol + " is stable." );
+
+  // Find all the radioactive nuclides in the chain, and what feeds into each of them
+  map<const SandiaDecay::Nuclide *,vector<pair<const SandiaDecay::Nuclide *,double>>> feeders;
+  set<const SandiaDecay::Nuclide *> in_chain{ parent };
+  vector<const SandiaDecay::Nuclide *> to_visit{ parent };
+
+  while( !to_visit.empty() )
+  {
+    const SandiaDecay::Nuclide * const nuc = to_visit.back();
+    to_visit.pop_back();
+
+    for( const SandiaDecay::Transition * const trans : nuc->decaysToChildren )
+    {
+      if( !trans || !trans->child || (decay_constant(trans->child) <= 0.0)
+         || (trans->branchRatio <= 0.0) )
+        continue;
+
+      feeders[trans->child].emplace_back( nuc, trans->branchRatio );
+      if( in_chain.insert( trans->child ).second )
+        to_visit.push_back( trans->child );
+    }//for( loop over transitions )
+  }//while( !to_visit.empty() )
+
+  // Order the chain so feeders always come before the nuclides they feed (Kahn's algorithm).
+  map<const SandiaDecay::Nuclide *,size_t> num_unplaced_feeders;
+  for( const SandiaDecay::Nuclide * const nuc : in_chain )
+  {
+    set<const SandiaDecay::Nuclide *> unique_feeders;
+    for( const auto &f : feeders[nuc] )
+      unique_feeders.insert( f.first );
+    num_unplaced_feeders[nuc] = unique_feeders.size();
+  }//for( loop over chain nuclides )
+
+  if( num_unplaced_feeders[parent] != 0 )
+    throw runtime_error( "BatemanTable: decay chain of " + parent->symbol + " has a cycle." );
+
+  m_chain.push_back( parent );
+  for( size_t index = 0; index < m_chain.size(); ++index )
+  {
+    const SandiaDecay::Nuclide * const nuc = m_chain[index];
+    set<const SandiaDecay::Nuclide *> children;
+    for( const SandiaDecay::Transition * const trans : nuc->decaysToChildren )
+    {
+      if( trans && trans->child && in_chain.count(trans->child) )
+        children.insert( trans->child );
+    }
+
+    for( const SandiaDecay::Nuclide * const child : children )
+    {
+      size_t &nremaining = num_unplaced_feeders[child];
+      assert( nremaining > 0 );
+      nremaining -= 1;
+      if( nremaining == 0 )
+        m_chain.push_back( child );
+    }
+  }//for( size_t index = 0; index < m_chain.size(); ++index )
+
+  if( m_chain.size() != in_chain.size() )
+    throw runtime_error( "BatemanTable: decay chain of " + parent->symbol + " has a cycle." );
+
+  const size_t nchain = m_chain.size();
+  map<const SandiaDecay::Nuclide *,size_t> chain_index;
+  for( size_t i = 0; i < nchain; ++i )
+    chain_index[m_chain[i]] = i;
+
+  // Get the decay constants, nudging apart any that are too close to each other.
+  vector<double> lambdas( nchain, 0.0 );
+  for( size_t i = 0; i < nchain; ++i )
+  {
+    double lambda = decay_constant( m_chain[i] );
+    for( bool nudged = true; nudged; )
+    {
+      nudged = false;
+      for( size_t j = 0; j < i; ++j )
+      {
+        if( fabs(lambda - lambdas[j]) < sm_min_rel_lambda_diff*std::max(lambda,lambdas[j]) )
+        {
+          lambda = lambdas[j] * (1.0 + 2.0*sm_min_rel_lambda_diff);
+          nudged = true;
+        }
+      }//for( size_t j = 0; j < i; ++j )
+    }//for( bool nudged = true; nudged; )
+
+    lambdas[i] = lambda;
+  }//for( size_t i = 0; i < nchain; ++i )
+
+  // Solve for the number of atoms, N_d(t) = sum_k b_{d,k} exp(-lambda_k t), for one initial atom of
+  //  parent.  For d != parent:
+  //    b_{d,k} = sum_m( br_{m->d} * lambda_m * b_{m,k} ) / (lambda_d - lambda_k),  for k != d
+  //    b_{d,d} = -sum_{k != d} b_{d,k}
+  vector<vector<double>> b( nchain, vector<double>(nchain, 0.0) );
+  b[0][0] = 1.0;
+  for( size_t d = 1; d < nchain; ++d )
+  {
+    double sum = 0.0;
+    for( size_t k = 0; k < d; ++k )
+    {
+      double feed = 0.0;
+      for( const auto &f : feeders[m_chain[d]] )
+      {
+        const size_t m = chain_index[f.first];
+        feed += f.second * lambdas[m] * b[m][k];
+      }
+
+      b[d][k] = feed / (lambdas[d] - lambdas[k]);
+      sum += b[d][k];
+    }//for( size_t k = 0; k < d; ++k )
+
+    b[d][d] = -sum;
+  }//for( size_t d = 1; d < nchain; ++d )
+
+  // The activity ratio A_d(t)/A_p(t) = sum_k (lambda_d/lambda_p) b_{d,k} exp(-(lambda_k - lambda_p) t)
+  m_rates.resize( nchain );
+  m_coefficients.resize( nchain );
+  for( size_t k = 0; k < nchain; ++k )
+    m_rates[k] = lambdas[k] - lambdas[0];
+
+  for( size_t d = 0; d < nchain; ++d )
+  {
+    for( size_t k = 0; k <= d; ++k )
+    {
+      if( b[d][k] != 0.0 )
+        m_coefficients[d].emplace_back( k, (lambdas[d] / lambdas[0]) * b[d][k] );
+    }
+  }//for( size_t d = 0; d < nchain; ++d )
+
+
+  // Now collect the photons
+  const auto excluded = [&energies_to_exclude]( const double energy ) -> bool {
+    for( const double exclude_energy : energies_to_exclude )
+    {
+      if( fabs(energy - exclude_energy) < 0.001 )
+        return true;
+    }
+    return false;
+  };//excluded lambda
+
+  const bool exclude_annihilation = excluded( sm_annihilation_energy );
+
+  for( size_t d = 0; d < nchain; ++d )
+  {
+    const SandiaDecay::Nuclide * const nuc = m_chain[d];
+    for( const SandiaDecay::Transition * const trans : nuc->decaysToChildren )
+    {
+      if( !trans )
+        continue;
+
+      for( size_t product_index = 0; product_index < trans->products.size(); ++product_index )
+      {
+        const SandiaDecay::RadParticle &particle = trans->products[product_index];
+
+        Row row;
+        row.chain_index = d;
+        row.transition = trans;
+        row.product_index = product_index;
+
+        switch( particle.type )
+        {
+          case SandiaDecay::ProductType::GammaParticle:
+            row.energy = particle.energy;
+            row.intensity = particle.intensity * trans->branchRatio;
+            row.gamma_type = PeakDef::SourceGammaType::NormalGamma;
+            break;
+
+          case SandiaDecay::ProductType::XrayParticle:
+            if( !include_xrays )
+              continue;
+            row.energy = particle.energy;
+            row.intensity = particle.intensity * trans->branchRatio;
+            row.gamma_type = PeakDef::SourceGammaType::XrayGamma;
+            break;
+
+          case SandiaDecay::ProductType::PositronParticle:
+            if( exclude_annihilation )
+              continue;
+            row.energy = sm_annihilation_energy;
+            row.intensity = 2.0 * particle.intensity * trans->branchRatio;
+            row.gamma_type = PeakDef::SourceGammaType::AnnihilationGamma;
+            break;
+
+          default:
+            continue;
+        }//switch( particle.type )
+
+        if( (row.intensity <= 0.0)
+           || ((row.gamma_type != PeakDef::SourceGammaType::AnnihilationGamma) && excluded(row.energy)) )
+          continue;
+
+        m_rows.push_back( row );
+      }//for( loop over products )
+    }//for( loop over transitions )
+  }//for( size_t d = 0; d < nchain; ++d )
+
+  // Sort by energy, keeping annihilation rows separate from any gamma of the same energy
+  std::stable_sort( begin(m_rows), end(m_rows), []( const Row &lhs, const Row &rhs ) -> bool {
+    if( lhs.energy != rhs.energy )
+      return lhs.energy < rhs.energy;
+    return (lhs.gamma_type < rhs.gamma_type);
+  } );
+
+  for( size_t i = 0; i < m_rows.size(); ++i )
+  {
+    if( !i || (m_rows[i].energy != m_rows[i-1].energy)
+       || (m_rows[i].gamma_type != m_rows[i-1].gamma_type) )
+      m_lineStarts.push_back( i );
+  }
+  m_lineStarts.push_back( m_rows.size() );
+}//BatemanTable constructor
+
+
+const SandiaDecay::Nuclide *BatemanTable::parent() const
+{
+  return m_parent;
+}
+
+
+size_t BatemanTable::numChainNuclides() const
+{
+  return m_chain.size();
+}
+
+
+size_t BatemanTable::numLines() const
+{
+  return m_lineStarts.size() - 1;
+}
+
+
+void BatemanTable::evaluate( const double age, std::vector<LineYield> &lines,
+                             const bool compute_derivatives ) const
+{
+  if( (age < 0.0) || IsNan(age) || IsInf(age) )
+    throw runtime_error( "BatemanTable::evaluate: invalid age." );
+
+  const size_t nchain = m_chain.size();
+
+  // The exponentials, one per chain nuclide; these are the only transcendental functions we need.
+  //  Rates may be negative, for descendants longer lived than the parent, in which case the
+  //  activity ratio grows with age.
+  vector<double> exps( nchain );
+  for( size_t k = 0; k < nchain; ++k )
+  {
+    exps[k] = std::exp( -m_rates[k] * age );
+    if( IsInf(exps[k]) || IsNan(exps[k]) )
+      throw runtime_error( "BatemanTable::evaluate: " + m_parent->symbol
+                           + " has decayed away by the requested age." );
+  }//for( size_t k = 0; k < nchain; ++k )
+
+  vector<double> ratios( nchain, 0.0 ), dratios( compute_derivatives ? nchain : size_t(0), 0.0 );
+  for( size_t d = 0; d < nchain; ++d )
+  {
+    double ratio = 0.0, dratio = 0.0;
+    for( const pair<size_t,double> &term : m_coefficients[d] )
+    {
+      const double val = term.second * exps[term.first];
+      ratio += val;
+      dratio -= m_rates[term.first] * val;
+    }
+
+    // At age zero, only the parent has activity, and in general round-off can give descendants a
+    //  tiny negative activity, which we dont want to propagate
+    if( (d > 0) && ((age == 0.0) || (ratio < 0.0)) )
+      ratio = 0.0;
+
+    ratios[d] = ratio;
+    if( compute_derivatives )
+      dratios[d] = dratio;
+  }//for( size_t d = 0; d < nchain; ++d )
+
+  const size_t nlines = numLines();
+  lines.resize( nlines );
+
+  for( size_t line_index = 0; line_index < nlines; ++line_index )
+  {
+    LineYield &line = lines[line_index];
+    const size_t first_row = m_lineStarts[line_index];
+    const size_t end_row = m_lineStarts[line_index + 1];
+
+    line.energy = m_rows[first_row].energy;
+    line.gamma_type = m_rows[first_row].gamma_type;
+    line.yield = line.dyield_dage = 0.0;
+    line.transition = nullptr;
+    line.product_index = 0;
+
+    double max_row_yield = -1.0;
+    size_t num_contributing = 0;
+    for( size_t row_index = first_row; row_index < end_row; ++row_index )
+    {
+      const Row &row = m_rows[row_index];
+      const double row_yield = row.intensity * ratios[row.chain_index];
+      line.yield += row_yield;
+      if( compute_derivatives )
+        line.dyield_dage += row.intensity * dratios[row.chain_index];
+
+      if( row_yield > 0.0 )
+        num_contributing += 1;
+
+      if( row_yield > max_row_yield )
+      {
+        max_row_yield = row_yield;
+        line.transition = row.transition;
+        line.product_index = row.product_index;
+      }
+    }//for( loop over rows of this line )
+
+    // For annihilation gammas we only attribute a transition if there is a single source of them
+    if( (line.gamma_type == PeakDef::SourceGammaType::AnnihilationGamma) && (num_contributing != 1) )
+    {
+      line.transition = nullptr;
+      line.product_index = 0;
+    }
+  }//for( size_t line_index = 0; line_index < nlines; ++line_index )
+}//void evaluate(...)
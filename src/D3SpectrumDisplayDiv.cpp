@@ -1697,6 +1697,8 @@ void D3SpectrumDisplayDiv::performExistingRoiEdgeDragWork(
   PeakModel *peakModel = spectrum->m_peakModel;
   shared_ptr<const Measurement> foreground = spectrum->data();
   
+  InterSpecApp::FitCpuTimer cpu_timer( wApp ? wApp->sessionId() : string() );
+  
   try
   {
     if( !peakModel || !foreground )  //Shouldnt ever happen
@@ -1870,6 +1872,7 @@ void D3SpectrumDisplayDiv::performDragCreateRoiWork( double lower_energy, double
 
   InterSpecApp *app = dynamic_cast<InterSpecApp *>(wApp);
   InterSpec *viewer = app ? app->viewer() : nullptr;
+  InterSpecApp::FitCpuTimer cpu_timer( app ? app->sessionId() : string() );
   PeakModel *peakModel = spectrum->m_peakModel;
   std::shared_ptr<const SpecMeas> meas = viewer ? viewer->measurment(SpecUtils::SpectrumType::Foreground) : nullptr;
   std::shared_ptr<const DetectorPeakResponse> detector = meas ? meas->detector() : nullptr;
@@ -76,6 +76,7 @@
 #include "InterSpec/PhysicalUnits.h"
 #include "SandiaDecay/SandiaDecay.h"
 #include "InterSpec/DecayChainChart.h"
+#include "InterSpec/DecayTimeSeries.h"
 #include "InterSpec/DecayActivityDiv.h"
 #include "InterSpec/DecayDataBaseServer.h"
 #include "InterSpec/MassAttenuationTool.h"
@@ -1335,16 +1336,29 @@ namespace
         //const bool mutliple_types = (int(m_activity) + int(m_xrays) + int(m_gammas) + int(m_alphas) + int(m_betas)) > 1;
         const auto order = SandiaDecay::NuclideMixture::OrderByEnergy;
         
-        const vector<SandiaDecay::NuclideTimeEvolution> &decayEvolutions = mixture->decayedToNuclidesEvolutions();
+        const double numerator = (m_numRows > 1 ? (m_numRows-1.0) : 1.0);
+        
+        vector<double> times( m_numRows );
+        for( size_t row = 0; row < m_numRows; ++row )
+        {
+          // If you are only requesting one row, make it the full time span time, not t=0.
+          times[row] = m_timeSpan * ((m_numRows > 1) ? row : 1u) / numerator;
+        }
+        
+        // Stable nuclides dont get an activity column.
+        const DecayTimeSeries series( *mixture );
+        const vector<const SandiaDecay::Nuclide *> &activity_nucs = series.nuclides();
+        const size_t num_activity_nucs = activity_nucs.size();
+        
+        vector<double> activities;
+        if( m_activity )
+          series.activities( times, activities );
         
         response.out() << "Time (" << time_unit_str << ")";
         if( m_activity )
         {
-          for( const auto &evo : decayEvolutions )
-          {
-            if( evo.nuclide && !IsInf(evo.nuclide->halfLife) )  //dont print out activity for stable nuclides.
-              response.out() << "," << evo.nuclide->symbol << " (" << act_unit_str << ")";
-          }
+          for( const SandiaDecay::Nuclide *nuc : activity_nucs )
+            response.out() << "," << nuc->symbol << " (" << act_unit_str << ")";
         }//if( m_activity )
         
         if( m_xrays )
@@ -1374,21 +1388,17 @@ namespace
         }//if( m_betas )
         
         response.out() << eol_char;
-      
-        const double numerator = (m_numRows > 1 ? (m_numRows-1.0) : 1.0);
         
         for( size_t row = 0; row < m_numRows; ++row )
         {
-          // If you are only requesting one row, make it the full time span time, not t=0.
-          const double time_now = m_timeSpan * ((m_numRows > 1) ? row : 1u) / numerator;
+          const double time_now = times[row];
           
           response.out() << (time_now/time_unit);
           
           if( m_activity )
           {
-            for( auto &x : mixture->activity(time_now) )
-              if( x.nuclide && !IsInf(x.nuclide->halfLife) )
-              response.out() << "," << (x.activity/act_unit);
+            for( size_t i = 0; i < num_activity_nucs; ++i )
+              response.out() << "," << (activities[row*num_activity_nucs + i]/act_unit);
           }//if( m_activity )
           
           if( m_xrays )
@@ -3180,18 +3190,29 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
     return;
   
   const int nRows = m_currentNumXPoints;
-  const vector<SandiaDecay::NuclideTimeEvolution> &origEvolutions
-                              = m_currentMixture->decayedToNuclidesEvolutions();
-  vector<SandiaDecay::NuclideTimeEvolution> evolutions;
-  for( const SandiaDecay::NuclideTimeEvolution &evo : origEvolutions )
-  {
-    if( evo.nuclide && !IsInf(evo.nuclide->halfLife) && !IsNan( evo.nuclide->halfLife ) )
-      evolutions.push_back( evo );
-  }//for( const SandiaDecay::NuclideTimeEvolution &evo : origEvolutions )
   
-  const int nElements = static_cast<int>( evolutions.size() );
+  // Evaluate all the activities for all the time points at once, rather than asking the mixture
+  //  for each point.
+  const DecayTimeSeries series( *m_currentMixture );
+  const vector<const SandiaDecay::Nuclide *> &nuclides = series.nuclides();
+  const int nElements = static_cast<int>( nuclides.size() );
 
   const double dt = maxDiplayTime / nRows;
+  
+  vector<double> times( nRows ), activities;
+  for( int row = 0; row < nRows; ++row )
+    times[row] = row * dt;
+  series.activities( times, activities );
+  
+  // For the particle y-axes, the particles per decay of each nuclide doesnt change with time.
+  vector<double> particles_per_decay;
+  switch( yaxis )
+  {
+    case ActivityAxis:  case NumYAxisType:                                                      break;
+    case GammasAxis:    particles_per_decay = series.particlesPerDecay( SandiaDecay::GammaParticle ); break;
+    case BetasAxis:     particles_per_decay = series.particlesPerDecay( SandiaDecay::BetaParticle );  break;
+    case AlphasAxis:    particles_per_decay = series.particlesPerDecay( SandiaDecay::AlphaParticle ); break;
+  }//switch( yaxis )
   m_decayModel->insertColumns( 0, nElements + 2 );
   m_decayModel->insertRows( 0, nRows );
 
@@ -3208,8 +3229,6 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
   
   for( int row = 0; row < nRows; ++row )
   {
-    const double row_time = (row * dt);
-
     //We will set the x-axis data as a formatted string since
     //  WAxis::setLabelFormat( "%.3g" ); doesnt seem to work
     stringstream labelText;
@@ -3220,34 +3239,13 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
     for( int elN = 0; elN < nElements; ++elN )
     {
       const int column = elN + 1;
+      const double activity = activities[row*nElements + elN];
+      
       double yval = 0;
-      double activity = evolutions[elN].activity(row_time);
-
-      if( yaxis == ActivityAxis )
-      {
+      if( particles_per_decay.empty() )
         yval = activity / actunit;
-      }else
-      {
-        SandiaDecay::ProductType particletype = SandiaDecay::GammaParticle;
-        
-        switch( yaxis )
-        {
-          case ActivityAxis:  case NumYAxisType:                         break;
-          case GammasAxis:    particletype = SandiaDecay::GammaParticle; break;
-          case BetasAxis:     particletype = SandiaDecay::BetaParticle;  break;
-          case AlphasAxis:    particletype = SandiaDecay::AlphaParticle; break;
-        }//switch( yaxis )
-        
-        activity /= SandiaDecay::becquerel;
-        for( const SandiaDecay::Transition *trans : evolutions[elN].nuclide->decaysToChildren )
-        {
-          for( const SandiaDecay::RadParticle &particle : trans->products )
-          {
-            if( particle.type == particletype )
-              yval += activity * trans->branchRatio * particle.intensity;
-          }
-        }//for( const SandiaDecay::Transition *trans : decays )
-      }//if( yaxis == ActivityAxis ) / else
+      else
+        yval = (activity / SandiaDecay::becquerel) * particles_per_decay[elN];
 
       if( IsInf(yval) || IsNan(yval) )
         continue;
@@ -3261,7 +3259,7 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
       //if( yval < 10*FLT_EPSILON )
       //{
       //  yval = 0.0;
-      //  cout << "[" << row << "," << evolutions[elN].nuclide->symbol << "," << elN << "," << labelText.str() << "]=" << yval << endl;
+      //  cout << "[" << row << "," << nuclides[elN]->symbol << "," << elN << "," << labelText.str() << "]=" << yval << endl;
       //}
 #endif
 //      if( activity >= (0.00001*endActivity) )
@@ -3279,8 +3277,8 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
 
   for( int column = 1; column <= nElements; ++column )
   {
-    const WString name = evolutions[column-1].nuclide->symbol;
-    m_decayModel->setNuclide( column, evolutions[column-1].nuclide->symbol ); //duplicating lots here
+    const WString name = nuclides[column-1]->symbol;
+    m_decayModel->setNuclide( column, nuclides[column-1]->symbol ); //duplicating lots here
     m_decayModel->setHeaderData( column, boost::any( name ) );
     m_decayModel->setHeaderData( column, Wt::Horizontal, true, Wt::UserRole );
   }//for( int column = 0; column < nElements; ++column )
@@ -3327,7 +3325,7 @@ void DecayActivityDiv::refreshDecayDisplay( const bool update_calc )
   for( int column = 1; column <= nElements; ++column )
   {
     //nuclide also containted in m_decayModel->headerData(column, Wt::Horizontal, Wt::UserRole);
-    const string name = evolutions[column-1].nuclide->symbol;
+    const string name = nuclides[column-1]->symbol;
     nuclidesset.push_back( name );
   }
   
@@ -0,0 +1,156 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "InterSpec/DecayTimeSeries.h"
+
+using namespace std;
+
+
+DecayTimeSeries::DecayTimeSeries( const SandiaDecay::NuclideMixture &mixture,
+                                  const bool include_stable )
+{
+  const vector<SandiaDecay::NuclideTimeEvolution> &evolutions
+                                                 = mixture.decayedToNuclidesEvolutions();
+  
+  for( const SandiaDecay::NuclideTimeEvolution &evo : evolutions )
+  {
+    for( const SandiaDecay::TimeEvolutionTerm &term : evo.evolutionTerms )
+      m_rates.push_back( term.exponentialCoeff );
+  }
+  
+  std::sort( begin(m_rates), end(m_rates) );
+  m_rates.erase( std::unique( begin(m_rates), end(m_rates) ), end(m_rates) );
+  
+  for( const SandiaDecay::NuclideTimeEvolution &evo : evolutions )
+  {
+    const SandiaDecay::Nuclide * const nuc = evo.nuclide;
+    if( !nuc )
+      continue;
+    
+    const bool is_stable = (std::isinf(nuc->halfLife) || std::isnan(nuc->halfLife));
+    if( is_stable && !include_stable )
+      continue;
+    
+    // NuclideTimeEvolution::activity(t) is the number of atoms, sum_k termCoeff_k*exp(-exponentialCoeff_k*t),
+    //  times the nuclides decay constant; we fold the decay constant into the coefficients.
+    const double lambda = nuc->decayConstant();
+    
+    vector<pair<size_t,double>> coefs;
+    for( const SandiaDecay::TimeEvolutionTerm &term : evo.evolutionTerms )
+    {
+      const double c = lambda * term.termCoeff;
+      if( c == 0.0 )
+        continue;
+      
+      const auto pos = std::lower_bound( begin(m_rates), end(m_rates), term.exponentialCoeff );
+      const size_t rate_index = static_cast<size_t>( pos - begin(m_rates) );
+      
+      auto existing = std::find_if( begin(coefs), end(coefs),
+                                    [rate_index]( const pair<size_t,double> &p ){
+        return p.first == rate_index;
+      } );
+      
+      if( existing != end(coefs) )
+        existing->second += c;
+      else
+        coefs.emplace_back( rate_index, c );
+    }//for( loop over evolution terms )
+    
+    m_nuclides.push_back( nuc );
+    m_coefficients.push_back( std::move(coefs) );
+  }//for( const SandiaDecay::NuclideTimeEvolution &evo : evolutions )
+}//DecayTimeSeries constructor
+
+
+const std::vector<const SandiaDecay::Nuclide *> &DecayTimeSeries::nuclides() const
+{
+  return m_nuclides;
+}
+
+
+size_t DecayTimeSeries::numNuclides() const
+{
+  return m_nuclides.size();
+}
+
+
+void DecayTimeSeries::activities( const std::vector<double> &times,
+                                  std::vector<double> &activities ) const
+{
+  const size_t num_nuc = m_nuclides.size();
+  const size_t num_rates = m_rates.size();
+  
+  if( activities.size() != times.size()*num_nuc )
+    activities.resize( times.size()*num_nuc );
+  
+  // With no nuclides the result is empty, and there are no rows to fill in
+  if( !num_nuc )
+    return;
+  
+  vector<double> exps( num_rates );
+  
+  for( size_t time_index = 0; time_index < times.size(); ++time_index )
+  {
+    const double t = times[time_index];
+    for( size_t k = 0; k < num_rates; ++k )
+      exps[k] = std::exp( -m_rates[k] * t );
+    
+    double * const row = &(activities[time_index*num_nuc]);
+    for( size_t n = 0; n < num_nuc; ++n )
+    {
+      double act = 0.0;
+      for( const pair<size_t,double> &c : m_coefficients[n] )
+        act += c.second * exps[c.first];
+      row[n] = act;
+    }//for( loop over nuclides )
+  }//for( loop over times )
+}//void activities(...)
+
+
+std::vector<double> DecayTimeSeries::particlesPerDecay( const SandiaDecay::ProductType type ) const
+{
+  vector<double> answer( m_nuclides.size(), 0.0 );
+  
+  for( size_t n = 0; n < m_nuclides.size(); ++n )
+  {
+    for( const SandiaDecay::Transition *trans : m_nuclides[n]->decaysToChildren )
+    {
+      for( const SandiaDecay::RadParticle &particle : trans->products )
+      {
+        if( particle.type == type )
+          answer[n] += trans->branchRatio * particle.intensity;
+      }
+    }//for( loop over transitions )
+  }//for( loop over nuclides )
+  
+  return answer;
+}//particlesPerDecay(...)
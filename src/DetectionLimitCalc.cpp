@@ -35,6 +35,7 @@
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/DetectionLimitCalc.h"
+#include "InterSpec/BackgroundPeakCache.h"
 #include "InterSpec/GammaInteractionCalc.h"
 #include "InterSpec/DetectorPeakResponse.h"
 
@@ -47,7 +48,8 @@ CurieMdaInput::CurieMdaInput()
   : spectrum(nullptr),
     gamma_energy(0.0f), roi_lower_energy(0.0f), roi_upper_energy(0.0f),
     num_lower_side_channels(0), num_upper_side_channels(0),
-    detection_probability(0.0f), additional_uncertainty(0.0f)
+    detection_probability(0.0f), additional_uncertainty(0.0f),
+    background(nullptr)
 {
 }
 
@@ -58,6 +60,7 @@ CurieMdaResult::CurieMdaResult()
     first_peak_region_channel(0), last_peak_region_channel(0), peak_region_counts_sum(0.0f),
     continuum_eqn{ 0.0f, 0.0f },
     estimated_peak_continuum_counts(0.0f), estimated_peak_continuum_uncert(0.0f),
+    background_peak_counts(0.0f), background_peak_uncert(0.0f),
     decision_threshold(0.0f), detection_limit(0.0f), source_counts(0.0f),
     lower_limit(0.0f), upper_limit(0.0f)
 {
@@ -190,6 +193,22 @@ void CurieMdaResult::equal_enough( const CurieMdaResult &test, const CurieMdaRes
     errors.push_back( buffer );
   }
   
+  if( !floats_equiv_enough(test.background_peak_counts, expected.background_peak_counts) )
+  {
+    snprintf( buffer, sizeof(buffer),
+             "Test background_peak_counts (%.6G) does not equal expected (%.6G)",
+             test.background_peak_counts, expected.background_peak_counts );
+    errors.push_back( buffer );
+  }
+  
+  
+  if( !floats_equiv_enough(test.background_peak_uncert, expected.background_peak_uncert) )
+  {
+    snprintf( buffer, sizeof(buffer),
+             "Test background_peak_uncert (%.6G) does not equal expected (%.6G)",
+             test.background_peak_uncert, expected.background_peak_uncert );
+    errors.push_back( buffer );
+  }
   
 
   if( !floats_equiv_enough(test.decision_threshold, expected.decision_threshold) )
@@ -299,7 +318,9 @@ std::ostream &print_summary( std::ostream &strm, const CurieMdaResult &result, c
   
   
   strm << "Gross Counts in Peak Foreground: " << result.source_counts << endl;
-  //Gross Counts in Peak Background: 0
+  if( result.input.background )
+    strm << "Gross Counts in Peak Background: " << result.background_peak_counts
+         << " +- " << result.background_peak_uncert << endl;
   strm << "Gross Counts in Continuum Foreground: " << result.estimated_peak_continuum_counts << endl;
   //Gross Counts in Continuum Background: 0
   strm << "Uncert in Peak Region: " << result.estimated_peak_continuum_uncert << endl;
@@ -443,6 +464,22 @@ CurieMdaResult currie_mda_calc( const CurieMdaInput &input )
   result.estimated_peak_continuum_counts = static_cast<float>( peak_cont_sum );
   result.estimated_peak_continuum_uncert = static_cast<float>( peak_cont_sum_uncert );
   
+  // Background peaks within the peak region are counts we would expect even without any signal, so
+  //  they are subtracted like the continuum is, and their statistical fluctuations add to the
+  //  uncertainty of the null hypothesis.
+  double back_peak_counts = 0.0, back_peak_uncert2 = 0.0;
+  if( input.background )
+  {
+    const double peak_lower_energy = spec->gamma_channel_lower(result.first_peak_region_channel);
+    const double peak_upper_energy = spec->gamma_channel_upper(result.last_peak_region_channel);
+    input.background->peakAreaInRange( peak_lower_energy, peak_upper_energy, spec->live_time(),
+                                       back_peak_counts, back_peak_uncert2 );
+    back_peak_counts = std::max( back_peak_counts, 0.0 );
+  }//if( input.background )
+  
+  result.background_peak_counts = static_cast<float>( back_peak_counts );
+  result.background_peak_uncert = static_cast<float>( sqrt(back_peak_uncert2) );
+  
   
   // The equation is centered around the input.gamma_energy with the density of counts at normal
   //  value at that point.  The Slope will be through the midpoints of each continuum.
@@ -477,7 +514,8 @@ CurieMdaResult currie_mda_calc( const CurieMdaInput &input )
   const float k = boost::math::quantile( gaus_dist, input.detection_probability );
   
   
-  const double peak_cont_sigma = sqrt( peak_cont_sum_uncert*peak_cont_sum_uncert + peak_cont_sum );
+  const double peak_cont_sigma = sqrt( peak_cont_sum_uncert*peak_cont_sum_uncert + peak_cont_sum
+                                       + back_peak_counts + back_peak_uncert2 );
   
   result.decision_threshold = k * peak_cont_sigma; //Note if using non-symmetric coverage, we would use k_alpha here
   
@@ -497,10 +535,12 @@ CurieMdaResult currie_mda_calc( const CurieMdaInput &input )
   }
   
   
-  const float source_counts = result.peak_region_counts_sum - result.estimated_peak_continuum_counts;
+  const float source_counts = result.peak_region_counts_sum - result.estimated_peak_continuum_counts
+                             - result.background_peak_counts;
   result.source_counts = source_counts;
   
-  double region_sigma = peak_cont_sum_uncert*peak_cont_sum_uncert + result.peak_region_counts_sum;
+  double region_sigma = peak_cont_sum_uncert*peak_cont_sum_uncert + result.peak_region_counts_sum
+                        + back_peak_uncert2;
   
   // TODO: I *think* this is right; e.g., use the nominal estimate of signal counts to estimate total uncertainty impact due to the "additional uncertainty" of the measurement, but I need to double check this.
   if( (source_counts > 0) && (add_uncert > 0) )
@@ -74,6 +74,7 @@
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/MaterialDB.h"
 #include "InterSpec/ColorTheme.h"
+#include "InterSpec/WarningWidget.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "InterSpec/PeakFitChi2Fcn.h"
 #include "InterSpec/SwitchCheckbox.h"
@@ -91,6 +92,7 @@
 #include "InterSpec/DetectorPeakResponse.h"
 #include "InterSpec/IsotopeNameFilterModel.h"
 #include "InterSpec/ShieldingSourceDisplay.h"
+#include "InterSpec/BackgroundPeakCache.h"
 #include "InterSpec/ReferencePhotopeakDisplay.h"
 
 using namespace std;
@@ -179,6 +181,7 @@ public:
       input.num_upper_side_channels = nsidebin;
       input.detection_probability = m_input.confidence_level;
       input.additional_uncertainty = 0.0f;  // TODO: can we get the DRFs contribution to form this?
+      input.background = m_input.background;
       
       const double det_eff = m_input.drf->efficiency(m_input.energy, m_input.distance);
       const double counts_4pi = (m_input.do_air_attenuation ? m_input.counts_per_bq_into_4pi_with_air
@@ -671,6 +674,7 @@ DetectionLimitTool::DetectionLimitTool( InterSpec *viewer,
     m_shieldingSelect( nullptr ),
     m_minRelIntensity( nullptr ),
     m_attenuateForAir( nullptr ),
+    m_subtractBackgroundPeaks( nullptr ),
     m_displayActivityLabel( nullptr ),
     m_displayDistanceLabel( nullptr ),
     m_displayActivity( nullptr ),
@@ -874,6 +878,12 @@ DetectionLimitTool::DetectionLimitTool( InterSpec *viewer,
   m_attenuateForAir->checked().connect(this, &DetectionLimitTool::handleUserChangedUseAirAttenuate );
   m_attenuateForAir->unChecked().connect(this, &DetectionLimitTool::handleUserChangedUseAirAttenuate );
   
+  m_subtractBackgroundPeaks = new WCheckBox( "Subtract background peaks", inputTable );
+  m_subtractBackgroundPeaks->addStyleClass( "FourthCol FourthRow SpanTwoCol" );
+  m_subtractBackgroundPeaks->setChecked( false );
+  m_subtractBackgroundPeaks->checked().connect( this, &DetectionLimitTool::handleInputChange );
+  m_subtractBackgroundPeaks->unChecked().connect( this, &DetectionLimitTool::handleInputChange );
+  
   
   label = new WLabel( "Peaks disp. act.:", inputTable );
   label->addStyleClass( "SixthCol FirstRow" );
@@ -1249,6 +1259,36 @@ void DetectionLimitTool::handleUserChangedUseAirAttenuate()
 }
 
 
+shared_ptr<const BackgroundPeakCache::BackgroundModel> DetectionLimitTool::backgroundModel()
+{
+  if( !m_subtractBackgroundPeaks->isChecked() )
+    return nullptr;
+  
+  const SpecUtils::SpectrumType type = SpecUtils::SpectrumType::Background;
+  shared_ptr<const SpecMeas> back = m_interspec->measurment( type );
+  shared_ptr<const SpecUtils::Measurement> backhist = m_interspec->displayedHistogram( type );
+  
+  shared_ptr<const deque<shared_ptr<const PeakDef>>> backpeaks;
+  if( back && backhist )
+    backpeaks = back->peaks( m_interspec->displayedSamples( type ) );
+  
+  if( !backpeaks || backpeaks->empty() )
+  {
+    m_subtractBackgroundPeaks->setUnChecked();
+    passMessage( "There are no background peaks defined, not subtracting them",
+                 WarningWidget::WarningMsgInfo );
+    return nullptr;
+  }//if( !backpeaks || backpeaks->empty() )
+  
+  vector<PeakDef> peaks;
+  for( const shared_ptr<const PeakDef> &p : *backpeaks )
+    peaks.push_back( *p );
+  
+  // The model is cached by background spectrum and peaks, so re-computing the limits will re-use it.
+  return BackgroundPeakCache::background_model( backhist, peaks );
+}//backgroundModel()
+
+
 void DetectionLimitTool::handleUserChangedToComputeActOrDist()
 {
   const bool distanceLimit = m_distOrActivity->isChecked();
@@ -1626,6 +1666,17 @@ void DetectionLimitTool::handleInputChange()
   
   const float confLevel = currentConfidenceLevel();
   
+  shared_ptr<const BackgroundPeakCache::BackgroundModel> background;
+  try
+  {
+    background = backgroundModel();
+  }catch( std::exception &e )
+  {
+    m_errorMsg->setText( "Error with background: " + string(e.what()) );
+    m_errorMsg->show();
+    return;
+  }//try / catch
+  
   for( const auto &line : lines )
   {
     const float energy = get<0>(line);
@@ -1646,6 +1697,7 @@ void DetectionLimitTool::handleInputChange()
     input.limit_type = type;
     input.do_air_attenuation = do_air_atten;
     input.measurement = spec;
+    input.background = background;
     input.drf = drf;
     
     input.energy = energy;
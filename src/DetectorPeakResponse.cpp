@@ -23,9 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <mutex>
 #include <cmath>
 #include <ctime>
+#include <tuple>
+#include <limits>
 #include <memory>
 #include <cctype>
 #include <string>
@@ -117,6 +120,46 @@ namespace
   }//float calcA(...)
   
   
+  /** Akima interpolation of `xy` at energy `z`, where `pos` is the result of
+   `lower_bound( xy.begin(), xy.end(), z )`.
+   */
+  float akima_interpolate_at( const float z,
+                  std::vector<DetectorPeakResponse::EnergyEfficiencyPair>::const_iterator pos,
+                  const std::vector<DetectorPeakResponse::EnergyEfficiencyPair> &xy )
+  {
+    //adapted from http://users-phys.au.dk/fedorov/nucltheo/Numeric/now/interp.pdf
+    const size_t n = xy.size();
+    
+    if( pos == xy.begin() )
+      return xy.front().efficiency;
+    if( pos == xy.end() )
+      return xy.back().efficiency;
+    
+    const size_t i = (pos-1) - xy.begin();
+    
+    const float x_i = xy[i].energy;
+    const float x_p1 = xy[i+1].energy;
+    const float y_i = xy[i].efficiency;
+    const float y_p1 = xy[i+1].efficiency;
+    
+    if( n < 6 || i < 2 || (n-i) < 3  ) //We'll just use linear interpolation here
+    {
+      const float d = (z - x_i) / (x_p1 - x_i);
+      return y_i + d*(y_p1 - y_i);
+    }//if( n < 6 )
+    
+    const float dx = z - x_i;
+    const float h_i = (x_p1 - x_i);
+    const float A_i = calcA( i, xy );
+    const float A_p1 = calcA( i+1, xy );
+    const float p_i = (y_p1 - y_i) / h_i;
+    const float c_i = (3.0f*p_i - 2.0f*A_i - A_p1) / h_i;
+    const float d_i = (A_p1 + A_i - 2.0f*p_i) / h_i / h_i;
+    
+    return y_i + dx*(A_i + dx*(c_i + dx*d_i));
+  }//float akima_interpolate_at(...)
+  
+  
   template<class T> struct index_compare_descend
   {
     index_compare_descend(const T arr) : arr(arr) {} //pass the actual values you want sorted into here
@@ -244,6 +287,457 @@ namespace
 }//namespace
 
 
+namespace
+{
+  /** The operations of a compiled #FormulaWrapper equation. */
+  enum FormulaOp
+  {
+    kFormulaConstant, kFormulaVariable,
+    kFormulaAdd, kFormulaSub, kFormulaMul, kFormulaDiv, kFormulaPow, kFormulaIntPow, kFormulaNegate,
+    //Operations with a constant argument stored in the instruction, to save a register load
+    kFormulaAddConst, kFormulaSubConst, kFormulaConstSub,
+    kFormulaMulConst, kFormulaDivConst, kFormulaConstDiv,
+    kFormulaSin, kFormulaCos, kFormulaTan, kFormulaASin, kFormulaACos, kFormulaATan,
+    kFormulaSinH, kFormulaCosH, kFormulaTanH, kFormulaASinH, kFormulaACosH, kFormulaATanH,
+    kFormulaLog, kFormulaLog10, kFormulaLog2, kFormulaSqrt, kFormulaCbrt, kFormulaExp, kFormulaAbs,
+    kFormulaHypot, kFormulaATan2, kFormulaFmod, kFormulaRemainder
+  };//enum FormulaOp
+  
+  
+  /** The maximum number of instructions a compiled equation may have; the registers are kept on
+   the stack during evaluation, so we need an upper limit.
+   */
+  const size_t ns_max_formula_instructions = 256;
+  
+  
+  /** Applies a (non-constant, non-variable) operation to the arguments.
+   'value' is only used by #kFormulaIntPow, where it holds the (integer) exponent, and the
+   operations with a constant argument, where it holds the constant.
+   */
+  inline double apply_formula_op( const int op, const double a, const double b, const double value )
+  {
+    switch( op )
+    {
+      case kFormulaAdd:       return a + b;
+      case kFormulaSub:       return a - b;
+      case kFormulaMul:       return a * b;
+      case kFormulaDiv:       return a / b;
+      case kFormulaPow:       return std::pow( a, b );
+      case kFormulaNegate:    return -a;
+      case kFormulaAddConst:  return a + value;
+      case kFormulaSubConst:  return a - value;
+      case kFormulaConstSub:  return value - a;
+      case kFormulaMulConst:  return a * value;
+      case kFormulaDivConst:  return a / value;
+      case kFormulaConstDiv:  return value / a;
+        
+      case kFormulaIntPow:
+      {
+        int n = static_cast<int>( value );
+        const bool invert = (n < 0);
+        n = (invert ? -n : n);
+        double answer = 1.0, base = a;
+        while( n )
+        {
+          if( n & 1 )
+            answer *= base;
+          base *= base;
+          n >>= 1;
+        }
+        return invert ? (1.0 / answer) : answer;
+      }//case kFormulaIntPow:
+        
+      case kFormulaSin:       return std::sin( a );
+      case kFormulaCos:       return std::cos( a );
+      case kFormulaTan:       return std::tan( a );
+      case kFormulaASin:      return std::asin( a );
+      case kFormulaACos:      return std::acos( a );
+      case kFormulaATan:      return std::atan( a );
+      case kFormulaSinH:      return std::sinh( a );
+      case kFormulaCosH:      return std::cosh( a );
+      case kFormulaTanH:      return std::tanh( a );
+      case kFormulaASinH:     return std::asinh( a );
+      case kFormulaACosH:     return std::acosh( a );
+      case kFormulaATanH:     return std::atanh( a );
+      case kFormulaLog:       return std::log( a );
+      case kFormulaLog10:     return std::log10( a );
+      case kFormulaLog2:      return std::log2( a );
+      case kFormulaSqrt:      return std::sqrt( a );
+      case kFormulaCbrt:      return std::cbrt( a );
+      case kFormulaExp:       return std::exp( a );
+      case kFormulaAbs:       return std::fabs( a );
+      case kFormulaHypot:     return std::hypot( a, b );
+      case kFormulaATan2:     return std::atan2( a, b );
+      case kFormulaFmod:      return std::fmod( a, b );
+      case kFormulaRemainder: return std::remainder( a, b );
+    }//switch( op )
+    
+    assert( 0 );
+    return std::numeric_limits<double>::quiet_NaN();
+  }//apply_formula_op(...)
+  
+  
+  /** Compiles an equation, in the (subset of) muparserx syntax, to a flat list of instructions.
+   
+   Supports numbers, the variable, the "pi" and "e" constants, the +, -, *, /, and ^ operators
+   (with muparserx precedence), and the real-valued functions muparserx defines.  Anything else
+   (e.g., comparisons, the ternary operator, units, strings, or matrices) causes compilation to fail,
+   in which case muparserx will be used to evaluate the equation.
+   
+   Operations whose arguments are all constants are evaluated at compile time, and identical
+   sub-expressions are only evaluated once.
+   */
+  class FormulaCompiler
+  {
+  public:
+    FormulaCompiler( const std::string &eqn, const std::string &var_name )
+      : m_eqn( eqn ), m_var_name( var_name ), m_pos( 0 )
+    {
+    }
+    
+    /** Returns the compiled equation; will be empty if the equation couldnt be compiled. */
+    std::vector<FormulaWrapper::Instruction> compile()
+    {
+      try
+      {
+        const int root = expression();
+        skip_whitespace();
+        if( m_pos != m_eqn.size() )
+          throw runtime_error( "Unexpected trailing characters" );
+        
+        return remove_unused( root );
+      }catch( std::exception & )
+      {
+      }
+      
+      return {};
+    }//compile()
+    
+  private:
+    void skip_whitespace()
+    {
+      while( (m_pos < m_eqn.size()) && std::isspace( static_cast<unsigned char>(m_eqn[m_pos]) ) )
+        ++m_pos;
+    }
+    
+    bool consume( const char c )
+    {
+      skip_whitespace();
+      if( (m_pos < m_eqn.size()) && (m_eqn[m_pos] == c) )
+      {
+        ++m_pos;
+        return true;
+      }
+      return false;
+    }//consume(...)
+    
+    //expression := term (('+'|'-') term)*
+    int expression()
+    {
+      int lhs = term();
+      while( true )
+      {
+        if( consume('+') )
+          lhs = add_node( kFormulaAdd, lhs, term() );
+        else if( consume('-') )
+          lhs = add_node( kFormulaSub, lhs, term() );
+        else
+          return lhs;
+      }
+    }//expression()
+    
+    //term := sign (('*'|'/') sign)*
+    int term()
+    {
+      int lhs = sign();
+      while( true )
+      {
+        if( consume('*') )
+          lhs = add_node( kFormulaMul, lhs, sign() );
+        else if( consume('/') )
+          lhs = add_node( kFormulaDiv, lhs, sign() );
+        else
+          return lhs;
+      }
+    }//term()
+    
+    //sign := ('-'|'+') sign | power
+    //  muparserx gives the sign operators lower precedence than '^', so "-x^2" is "-(x^2)"
+    int sign()
+    {
+      if( consume('-') )
+        return add_node( kFormulaNegate, sign() );
+      if( consume('+') )
+        return sign();
+      return power();
+    }//sign()
+    
+    //power := primary ('^' sign)?
+    //  Right associative, so "a^b^c" is "a^(b^c)"
+    int power()
+    {
+      const int base = primary();
+      if( !consume('^') )
+        return base;
+      
+      const int exponent = sign();
+      const double exp_value = m_nodes[exponent].value;
+      if( (m_nodes[exponent].op == kFormulaConstant)
+          && (exp_value == std::floor(exp_value))
+          && (std::fabs(exp_value) <= 16.0) )
+      {
+        if( m_nodes[base].op == kFormulaConstant )
+          return add_node( kFormulaIntPow, base, base, exp_value );
+        
+        // Expand small integer powers into multiplications, so that, e.g., log(x)^2, log(x)^3,
+        //  and log(x)^4 share intermediate results.
+        const int n = static_cast<int>( std::fabs(exp_value) );
+        const int result = integer_power( base, n );
+        if( exp_value >= 0.0 )
+          return result;
+        return add_node( kFormulaDiv, add_node( kFormulaConstant, 0, 0, 1.0 ), result );
+      }//if( small integer exponent )
+      
+      return add_node( kFormulaPow, base, exponent );
+    }//power()
+    
+    /** Returns node for base^n, using only multiplications, for n >= 0. */
+    int integer_power( const int base, const int n )
+    {
+      if( n == 0 )
+        return add_node( kFormulaConstant, 0, 0, 1.0 );
+      if( n == 1 )
+        return base;
+      
+      const int half = integer_power( base, n / 2 );
+      const int square = add_node( kFormulaMul, half, half );
+      return (n % 2) ? add_node( kFormulaMul, square, base ) : square;
+    }//integer_power(...)
+    
+    int primary()
+    {
+      skip_whitespace();
+      if( m_pos >= m_eqn.size() )
+        throw runtime_error( "Unexpected end of equation" );
+      
+      if( consume('(') )
+      {
+        const int inner = expression();
+        if( !consume(')') )
+          throw runtime_error( "Missing closing parenthesis" );
+        return inner;
+      }//if( consume('(') )
+      
+      const char c = m_eqn[m_pos];
+      if( std::isdigit( static_cast<unsigned char>(c) ) || (c == '.') )
+        return number();
+      
+      if( !std::isalpha( static_cast<unsigned char>(c) ) && (c != '_') )
+        throw runtime_error( "Unsupported character" );
+      
+      const size_t start = m_pos;
+      while( (m_pos < m_eqn.size())
+             && (std::isalnum( static_cast<unsigned char>(m_eqn[m_pos]) ) || (m_eqn[m_pos] == '_')) )
+        ++m_pos;
+      const string name = m_eqn.substr( start, m_pos - start );
+      
+      if( consume('(') )
+        return function( name );
+      
+      if( name == m_var_name )
+        return add_node( kFormulaVariable, 0, 0 );
+      if( name == "pi" )
+        return add_node( kFormulaConstant, 0, 0, 3.141592653589793238462643 );
+      if( name == "e" )
+        return add_node( kFormulaConstant, 0, 0, 2.718281828459045235360287 );
+      
+      throw runtime_error( "Unknown name '" + name + "'" );
+    }//primary()
+    
+    int number()
+    {
+      // Hex and binary values (e.g., "0x1F") are not supported
+      if( (m_eqn[m_pos] == '0') && (m_pos + 1 < m_eqn.size()) && std::isalpha( static_cast<unsigned char>(m_eqn[m_pos+1]) )
+          && (m_eqn[m_pos+1] != 'e') )
+        throw runtime_error( "Unsupported number format" );
+      
+      const size_t start = m_pos;
+      while( (m_pos < m_eqn.size()) && (std::isdigit( static_cast<unsigned char>(m_eqn[m_pos]) ) || (m_eqn[m_pos] == '.')) )
+        ++m_pos;
+      
+      // Exponent, ex "1.2e-3"; "2e" would be an error in muparserx, so we'll let that fail too
+      if( (m_pos < m_eqn.size()) && (m_eqn[m_pos] == 'e') )
+      {
+        ++m_pos;
+        if( (m_pos < m_eqn.size()) && ((m_eqn[m_pos] == '+') || (m_eqn[m_pos] == '-')) )
+          ++m_pos;
+        while( (m_pos < m_eqn.size()) && std::isdigit( static_cast<unsigned char>(m_eqn[m_pos]) ) )
+          ++m_pos;
+      }//if( exponent )
+      
+      const string numstr = m_eqn.substr( start, m_pos - start );
+      size_t nparsed = 0;
+      const double value = std::stod( numstr, &nparsed );
+      if( nparsed != numstr.size() )
+        throw runtime_error( "Invalid number" );
+      
+      return add_node( kFormulaConstant, 0, 0, value );
+    }//number()
+    
+    int function( const string &name )
+    {
+      vector<int> args;
+      if( !consume(')') )
+      {
+        do
+        {
+          args.push_back( expression() );
+        }while( consume(',') );
+        
+        if( !consume(')') )
+          throw runtime_error( "Missing closing parenthesis for function" );
+      }//if( function has arguments )
+      
+      static const std::map<string,int> unary_fcns = {
+        {"sin", kFormulaSin}, {"cos", kFormulaCos}, {"tan", kFormulaTan},
+        {"asin", kFormulaASin}, {"acos", kFormulaACos}, {"atan", kFormulaATan},
+        {"sinh", kFormulaSinH}, {"cosh", kFormulaCosH}, {"tanh", kFormulaTanH},
+        {"asinh", kFormulaASinH}, {"acosh", kFormulaACosH}, {"atanh", kFormulaATanH},
+        {"log", kFormulaLog}, {"ln", kFormulaLog}, {"log10", kFormulaLog10}, {"log2", kFormulaLog2},
+        {"sqrt", kFormulaSqrt}, {"cbrt", kFormulaCbrt}, {"exp", kFormulaExp}, {"abs", kFormulaAbs}
+      };
+      
+      static const std::map<string,int> binary_fcns = {
+        {"pow", kFormulaPow}, {"hypot", kFormulaHypot}, {"atan2", kFormulaATan2},
+        {"fmod", kFormulaFmod}, {"remainder", kFormulaRemainder}
+      };
+      
+      const auto unary_pos = unary_fcns.find( name );
+      if( (unary_pos != end(unary_fcns)) && (args.size() == 1) )
+        return add_node( unary_pos->second, args[0] );
+      
+      const auto binary_pos = binary_fcns.find( name );
+      if( (binary_pos != end(binary_fcns)) && (args.size() == 2) )
+        return add_node( binary_pos->second, args[0], args[1] );
+      
+      throw runtime_error( "Unsupported function '" + name + "'" );
+    }//function(...)
+    
+    /** Adds a node, or returns the index of an identical existing node.  If all the arguments are
+     constants, the result is computed now, and a constant node is added.
+     */
+    int add_node( int op, const int lhs, int rhs = -1, double value = 0.0 )
+    {
+      if( rhs < 0 )
+        rhs = lhs;  //Unary operation; we'll just read the same register twice.
+      
+      if( (op != kFormulaConstant) && (op != kFormulaVariable)
+          && (m_nodes[lhs].op == kFormulaConstant) && (m_nodes[rhs].op == kFormulaConstant) )
+      {
+        value = apply_formula_op( op, m_nodes[lhs].value, m_nodes[rhs].value, value );
+        op = kFormulaConstant;
+      }else if( (op == kFormulaAdd) || (op == kFormulaSub) || (op == kFormulaMul) || (op == kFormulaDiv) )
+      {
+        // If one of the arguments is a constant, store it in the instruction
+        const bool lhs_const = (m_nodes[lhs].op == kFormulaConstant);
+        const bool rhs_const = (m_nodes[rhs].op == kFormulaConstant);
+        
+        if( lhs_const || rhs_const )
+        {
+          value = lhs_const ? m_nodes[lhs].value : m_nodes[rhs].value;
+          const int other = lhs_const ? rhs : lhs;
+          
+          switch( op )
+          {
+            case kFormulaAdd: op = kFormulaAddConst; break;
+            case kFormulaMul: op = kFormulaMulConst; break;
+            case kFormulaSub: op = lhs_const ? kFormulaConstSub : kFormulaSubConst; break;
+            case kFormulaDiv: op = lhs_const ? kFormulaConstDiv : kFormulaDivConst; break;
+          }//switch( op )
+          
+          return add_node( op, other, other, value );
+        }//if( lhs_const || rhs_const )
+      }//if( all arguments constant ) / else if( one argument might be constant )
+      
+      if( (op == kFormulaConstant) || (op == kFormulaVariable) )
+        rhs = 0;
+      const int key_lhs = ((op == kFormulaConstant) || (op == kFormulaVariable)) ? 0 : lhs;
+      
+      // Use the bits of the value as part of the key, so NaN's dont mess up the map ordering.
+      uint64_t value_bits;
+      static_assert( sizeof(value_bits) == sizeof(value), "" );
+      memcpy( &value_bits, &value, sizeof(value) );
+      
+      const auto key = std::make_tuple( op, key_lhs, rhs, value_bits );
+      const auto pos = m_node_indexes.find( key );
+      if( pos != end(m_node_indexes) )
+        return pos->second;
+      
+      if( m_nodes.size() >= 4*ns_max_formula_instructions )
+        throw runtime_error( "Equation too long to compile" );
+      
+      FormulaWrapper::Instruction inst;
+      inst.op = op;
+      inst.lhs = key_lhs;
+      inst.rhs = rhs;
+      inst.value = value;
+      
+      const int index = static_cast<int>( m_nodes.size() );
+      m_nodes.push_back( inst );
+      m_node_indexes[key] = index;
+      
+      return index;
+    }//add_node(...)
+    
+    /** Removes nodes not needed to compute 'root' (e.g., constants that have been folded), and
+     returns the program with 'root' as the last instruction.
+     */
+    std::vector<FormulaWrapper::Instruction> remove_unused( const int root ) const
+    {
+      vector<bool> used( m_nodes.size(), false );
+      used[root] = true;
+      for( int i = root; i >= 0; --i )
+      {
+        const FormulaWrapper::Instruction &inst = m_nodes[i];
+        if( used[i] && (inst.op != kFormulaConstant) && (inst.op != kFormulaVariable) )
+          used[inst.lhs] = used[inst.rhs] = true;
+      }
+      
+      vector<int> new_index( m_nodes.size(), -1 );
+      vector<FormulaWrapper::Instruction> program;
+      for( int i = 0; i <= root; ++i )
+      {
+        if( !used[i] )
+          continue;
+        
+        FormulaWrapper::Instruction inst = m_nodes[i];
+        if( (inst.op != kFormulaConstant) && (inst.op != kFormulaVariable) )
+        {
+          inst.lhs = new_index[inst.lhs];
+          inst.rhs = new_index[inst.rhs];
+          assert( (inst.lhs >= 0) && (inst.rhs >= 0) );
+        }
+        
+        new_index[i] = static_cast<int>( program.size() );
+        program.push_back( inst );
+      }//for( int i = 0; i <= root; ++i )
+      
+      if( program.size() > ns_max_formula_instructions )
+        throw runtime_error( "Equation too long to compile" );
+      
+      return program;
+    }//remove_unused(...)
+    
+    const std::string &m_eqn;
+    const std::string &m_var_name;
+    size_t m_pos;
+    
+    std::vector<FormulaWrapper::Instruction> m_nodes;
+    std::map<std::tuple<int,int,int,uint64_t>,int> m_node_indexes;
+  };//class FormulaCompiler
+}//namespace
+
+
   
 FormulaWrapper::FormulaWrapper( const std::string &fcnstr, const bool isMev )
   : m_fcnstr( fcnstr ), m_var_name( "x" )
@@ -330,12 +824,90 @@ FormulaWrapper::FormulaWrapper( const std::string &fcnstr, const bool isMev )
     throw std::runtime_error( "Error parsing expression: " + string(e.what()) );
   }//try / catch
   
+  
+  // Compile the equation so we can evaluate it without muparserx, or locking the mutex.
+  m_program = FormulaCompiler( m_fcnstr, m_var_name ).compile();
+  
+  // Make sure the compiled equation agrees with muparserx over the range of energies we care
+  //  about; if it doesnt, we'll just use muparserx.
+  const double test_energies[] = { 10.0, 30.0, 59.5, 122.0, 186.2, 356.0, 661.7, 1001.0,
+                                   1332.5, 2614.5, 5000.0, 10000.0 };
+  for( size_t i = 0; !m_program.empty() && (i < sizeof(test_energies)/sizeof(test_energies[0])); ++i )
+  {
+    const double x = test_energies[i] * (isMev ? 0.001 : 1.0);
+    
+    double expected;
+    try
+    {
+      *m_value = x;
+      expected = m_parser->Eval().GetFloat();
+    }catch( std::exception & )
+    {
+      m_program.clear();
+      break;
+    }
+    
+    const double compiled = evaluateCompiled( x );
+    
+    if( std::isnan(expected) || std::isnan(compiled) )
+    {
+      if( std::isnan(expected) != std::isnan(compiled) )
+        m_program.clear();
+    }else if( expected != compiled )
+    {
+      const double diff = std::fabs( expected - compiled );
+      if( std::isinf(diff) || (diff > 1.0E-9*std::max(std::fabs(expected), std::fabs(compiled))) )
+        m_program.clear();
+    }
+  }//for( loop over test energies )
+  
+#if( PERFORM_DEVELOPER_CHECKS )
+  if( m_program.empty() )
+    cerr << "FormulaWrapper: could not compile '" << m_fcnstr << "', will use muparserx." << endl;
+#endif
 }//FormulaWrapper
   
 FormulaWrapper::~FormulaWrapper()
 {
 }
 
+
+std::shared_ptr<FormulaWrapper> FormulaWrapper::create( const std::string &fcnstr, const bool isMev )
+{
+  // We only keep weak references, so equations no DRF uses anymore dont stick around.
+  static std::mutex s_cache_mutex;
+  static std::map<std::pair<std::string,bool>,std::weak_ptr<FormulaWrapper>> s_cache;
+  
+  const std::pair<std::string,bool> key( fcnstr, isMev );
+  
+  {//begin lock on s_cache_mutex
+    std::lock_guard<std::mutex> lock( s_cache_mutex );
+    const auto pos = s_cache.find( key );
+    if( pos != end(s_cache) )
+    {
+      shared_ptr<FormulaWrapper> cached = pos->second.lock();
+      if( cached )
+        return cached;
+    }
+  }//end lock on s_cache_mutex
+  
+  // Compile without holding the lock; if another thread compiled the same equation meanwhile, we
+  //  will just end up with two equivalent wrappers.
+  auto wrapper = std::make_shared<FormulaWrapper>( fcnstr, isMev );
+  
+  std::lock_guard<std::mutex> lock( s_cache_mutex );
+  for( auto iter = begin(s_cache); iter != end(s_cache); )
+  {
+    if( iter->second.expired() )
+      iter = s_cache.erase( iter );
+    else
+      ++iter;
+  }
+  s_cache[key] = wrapper;
+  
+  return wrapper;
+}//FormulaWrapper::create(...)
+
 std::string FormulaWrapper::find_variable_name( std::string eqn )
 {
   //Make case-insensitive
@@ -407,8 +979,59 @@ std::string FormulaWrapper::find_variable_name( std::string eqn )
 }//void find_variable_name( std::string eqn )
   
   
+bool FormulaWrapper::isCompiled() const
+{
+  return !m_program.empty();
+}
+
+
+double FormulaWrapper::evaluateCompiled( const double x ) const
+{
+  assert( !m_program.empty() && (m_program.size() <= ns_max_formula_instructions) );
+  
+  double registers[ns_max_formula_instructions];
+  
+  const size_t ninst = m_program.size();
+  for( size_t i = 0; i < ninst; ++i )
+  {
+    const Instruction &inst = m_program[i];
+    switch( inst.op )
+    {
+      case kFormulaConstant:
+        registers[i] = inst.value;
+        break;
+        
+      case kFormulaVariable:
+        registers[i] = x;
+        break;
+      
+      // Handle the cheap, and most common, operations here, to avoid a second switch.
+      case kFormulaAdd:      registers[i] = registers[inst.lhs] + registers[inst.rhs]; break;
+      case kFormulaSub:      registers[i] = registers[inst.lhs] - registers[inst.rhs]; break;
+      case kFormulaMul:      registers[i] = registers[inst.lhs] * registers[inst.rhs]; break;
+      case kFormulaDiv:      registers[i] = registers[inst.lhs] / registers[inst.rhs]; break;
+      case kFormulaAddConst: registers[i] = registers[inst.lhs] + inst.value; break;
+      case kFormulaSubConst: registers[i] = registers[inst.lhs] - inst.value; break;
+      case kFormulaConstSub: registers[i] = inst.value - registers[inst.lhs]; break;
+      case kFormulaMulConst: registers[i] = registers[inst.lhs] * inst.value; break;
+      case kFormulaDivConst: registers[i] = registers[inst.lhs] / inst.value; break;
+      case kFormulaConstDiv: registers[i] = inst.value / registers[inst.lhs]; break;
+        
+      default:
+        registers[i] = apply_formula_op( inst.op, registers[inst.lhs], registers[inst.rhs], inst.value );
+        break;
+    }//switch( inst.op )
+  }//for( size_t i = 0; i < ninst; ++i )
+  
+  return registers[ninst - 1];
+}//double evaluateCompiled( const double x ) const
+  
+  
 float FormulaWrapper::efficiency( const float x )
 {
+  if( !m_program.empty() )
+    return static_cast<float>( evaluateCompiled( x ) );
+  
   try
   {
     std::lock_guard<std::mutex> lock( m_mutex );
@@ -799,7 +1422,7 @@ void DetectorPeakResponse::setIntrinsicEfficiencyFormula( const string &fcnstr,
 {
   const bool isMeV = (energyUnits > 10.f);
   std::shared_ptr<FormulaWrapper > expression
-                                = std::make_shared<FormulaWrapper>( fcnstr, isMeV );
+                                = FormulaWrapper::create( fcnstr, isMeV );
   
   m_efficiencyForm = kFunctialEfficienyForm;
   m_efficiencyFormula = fcnstr;
@@ -1489,7 +2112,7 @@ void DetectorPeakResponse::fromAppUrl( std::string url_query )
     try
     {
       const bool isMeV = (efficiencyEnergyUnits > 10.0f);
-      auto expression = std::make_shared<FormulaWrapper>( m_efficiencyFormula, isMeV );
+      auto expression = FormulaWrapper::create( eqn, isMeV );
       efficiencyFcn = boost::bind( &FormulaWrapper::efficiency, expression, boost::placeholders::_1  );
     }catch( std::exception &e )
     {
@@ -2025,7 +2648,7 @@ void DetectorPeakResponse::fromXml( const ::rapidxml::xml_node<char> *parent )
       
       try
       {
-        auto expression = std::make_shared<FormulaWrapper>( m_efficiencyFormula, isMeV );
+        auto expression = FormulaWrapper::create( m_efficiencyFormula, isMeV );
         m_efficiencyFcn = boost::bind( &FormulaWrapper::efficiency, expression,
                                       boost::placeholders::_1  );
       }catch( std::exception &e )
@@ -2413,6 +3036,24 @@ double DetectorPeakResponse::efficiency( const float energy, const double dist )
 }//float efficiency( const float energy ) const
 
 
+void DetectorPeakResponse::efficiencies( const float *energies, const size_t nenergies,
+                                         const double distance, double *results ) const
+{
+  const double fracSolidAngle = fractionalSolidAngle( m_detectorDiameter, distance );
+  
+  const size_t block_size = 64;
+  float intrinsic[block_size];
+  
+  for( size_t start = 0; start < nenergies; start += block_size )
+  {
+    const size_t n = std::min( block_size, nenergies - start );
+    intrinsicEfficiencies( energies + start, n, intrinsic );
+    for( size_t i = 0; i < n; ++i )
+      results[start + i] = fracSolidAngle * intrinsic[i];
+  }//for( loop over blocks of energies )
+}//void efficiencies(...)
+
+
 const vector<DetectorPeakResponse::EnergyEfficiencyPair> &DetectorPeakResponse::getEnergyEfficiencyPair() const
 {
   return m_energyEfficiencies;
@@ -2435,39 +3076,29 @@ float DetectorPeakResponse::intrinsicEfficiencyFromPairs( float energy ) const
 float DetectorPeakResponse::akimaInterpolate( const float z,
             const std::vector<DetectorPeakResponse::EnergyEfficiencyPair> &xy )
 {
-  //adapted from http://users-phys.au.dk/fedorov/nucltheo/Numeric/now/interp.pdf
-  vector<DetectorPeakResponse::EnergyEfficiencyPair>::const_iterator pos;
-  pos = lower_bound( xy.begin(), xy.end(), z );
-  const size_t n = xy.size();
-  
-  if( pos == xy.begin() )
-    return xy.front().efficiency;
-  if( pos == xy.end() )
-    return xy.back().efficiency;
-  
-  const size_t i = (pos-1) - xy.begin();
-  
-  const float x_i = xy[i].energy;
-  const float x_p1 = xy[i+1].energy;
-  const float y_i = xy[i].efficiency;
-  const float y_p1 = xy[i+1].efficiency;
+  const auto pos = lower_bound( xy.begin(), xy.end(), z );
+  return akima_interpolate_at( z, pos, xy );
+}//akimaInterpolate(...)
+
+
+void DetectorPeakResponse::akimaInterpolate( const float *energies, const size_t nenergies,
+                                             const std::vector<EnergyEfficiencyPair> &xy,
+                                             float *results )
+{
+  // Energies are usually sorted, so we'll start each search from where the last one ended
+  auto pos = xy.begin();
+  float last_energy = -std::numeric_limits<float>::infinity();
   
-  if( n < 6 || i < 2 || (n-i) < 3  ) //We'll just use linear interpolation here
+  for( size_t i = 0; i < nenergies; ++i )
   {
-    const float d = (z - x_i) / (x_p1 - x_i);
-    return y_i + d*(y_p1 - y_i);
-  }//if( n < 6 )
-  
-  const float dx = z - x_i;
-  const float h_i = (x_p1 - x_i);
-  const float A_i = calcA( i, xy );
-  const float A_p1 = calcA( i+1, xy );
-  const float p_i = (y_p1 - y_i) / h_i;
-  const float c_i = (3.0f*p_i - 2.0f*A_i - A_p1) / h_i;
-  const float d_i = (A_p1 + A_i - 2.0f*p_i) / h_i / h_i;
-  
-  return y_i + dx*(A_i + dx*(c_i + dx*d_i));
-}//akimaInterpolate(...)
+    const float z = energies[i];
+    const auto search_start = (z >= last_energy) ? pos : xy.begin();
+    pos = lower_bound( search_start, xy.end(), z );
+    last_energy = z;
+    
+    results[i] = akima_interpolate_at( z, pos, xy );
+  }//for( size_t i = 0; i < nenergies; ++i )
+}//void akimaInterpolate(...)
 
 
 float DetectorPeakResponse::intrinsicEfficiencyFromFcn( float energy ) const
@@ -2495,14 +3126,50 @@ float DetectorPeakResponse::intrinsicEfficiencyFromExpLnEqn( float energy ) cons
 float DetectorPeakResponse::expOfLogPowerSeriesEfficiency( const float energy,
                                            const std::vector<float> &coefs )
 {
-  float exparg = 0.0f;
-  const float x = log( energy );
-  for( size_t i = 0; i < coefs.size(); ++i )
-    exparg += coefs[i] * pow(x,static_cast<float>(i));
-  return exp( exparg );
+  // Horner's method; same order of operations as expOfLogPowerSeriesEfficiencies(...)
+  const double x = log( energy );
+  double exparg = 0.0;
+  for( size_t i = coefs.size(); i > 0; --i )
+    exparg = exparg*x + coefs[i-1];
+  return static_cast<float>( exp( exparg ) );
 }//float expOfLogPowerSeriesEfficiency(...)
 
 
+void DetectorPeakResponse::expOfLogPowerSeriesEfficiencies( const float *energies,
+                                                           const size_t nenergies,
+                                                           const std::vector<float> &coefs,
+                                                           float *results )
+{
+  // We'll work in blocks, so the inner loops are simple enough for the compiler to vectorize;
+  //  the log and exp wont be vectorized (without -ffast-math), but the polynomial will.
+  const size_t block_size = 64;
+  double x[block_size], exparg[block_size];
+  
+  const size_t ncoefs = coefs.size();
+  
+  for( size_t start = 0; start < nenergies; start += block_size )
+  {
+    const size_t n = std::min( block_size, nenergies - start );
+    
+    for( size_t i = 0; i < n; ++i )
+      x[i] = log( energies[start + i] );
+    
+    for( size_t i = 0; i < n; ++i )
+      exparg[i] = 0.0;
+    
+    for( size_t j = ncoefs; j > 0; --j )
+    {
+      const double c = coefs[j-1];
+      for( size_t i = 0; i < n; ++i )
+        exparg[i] = exparg[i]*x[i] + c;
+    }
+    
+    for( size_t i = 0; i < n; ++i )
+      results[start + i] = static_cast<float>( exp( exparg[i] ) );
+  }//for( loop over blocks of energies )
+}//void expOfLogPowerSeriesEfficiencies(...)
+
+
 float DetectorPeakResponse::intrinsicEfficiency( const float energy ) const
 {
   
@@ -2527,6 +3194,57 @@ float DetectorPeakResponse::intrinsicEfficiency( const float energy ) const
 }//float intrinsicEfficiency( const float energy ) const;
 
 
+void DetectorPeakResponse::intrinsicEfficiencies( const float *energies, const size_t nenergies,
+                                                  float *results ) const
+{
+  const float units = m_efficiencyEnergyUnits;
+  
+  switch( m_efficiencyForm )
+  {
+    case kEnergyEfficiencyPairs:
+    {
+      if( m_energyEfficiencies.size() < 2 )
+        throw runtime_error("DetectorPeakResponse objects must be initialized "
+                            "before calling intrinsicEfficiencies(...)");
+      
+      for( size_t i = 0; i < nenergies; ++i )
+        results[i] = energies[i] / units;
+      akimaInterpolate( results, nenergies, m_energyEfficiencies, results );
+      return;
+    }//case kEnergyEfficiencyPairs:
+      
+    case kFunctialEfficienyForm:
+    {
+      if( !m_efficiencyFcn )
+        throw runtime_error( "DetectorPeakResponse objects must be initialized "
+                             "before calling intrinsicEfficiencies(...)" );
+      
+      for( size_t i = 0; i < nenergies; ++i )
+        results[i] = m_efficiencyFcn( energies[i] / units );
+      return;
+    }//case kFunctialEfficienyForm:
+      
+    case kExpOfLogPowerSeries:
+    {
+      if( m_expOfLogPowerSeriesCoeffs.empty() )
+        throw runtime_error( "DetectorPeakResponse objects must be initialized "
+                             "before calling intrinsicEfficiencies(...)" );
+      
+      for( size_t i = 0; i < nenergies; ++i )
+        results[i] = energies[i] / units;
+      expOfLogPowerSeriesEfficiencies( results, nenergies, m_expOfLogPowerSeriesCoeffs, results );
+      return;
+    }//case kExpOfLogPowerSeries:
+      
+    case kNumEfficiencyFnctForms:
+      break;
+  }//switch( m_efficiencyForm )
+  
+  throw runtime_error( "DetectorPeakResponse::intrinsicEfficiencies:"
+                       " undefined efficiency" );
+}//void intrinsicEfficiencies(...)
+
+
 
 float DetectorPeakResponse::peakResolutionFWHM( float energy,
                                                 ResolutionFnctForm fcnFrm,
@@ -2580,10 +3298,11 @@ float DetectorPeakResponse::peakResolutionFWHM( float energy,
       energy /= PhysicalUnits::MeV;
       //return  A1 + A2*std::pow( energy + A3*energy*energy, A4 );
       
+      // Horner's method; same order of operations as peakResolutionFWHMs(...)
       double val = 0.0;
-      for( size_t i = 0; i < pars.size(); ++i )
-        val += pars[i] * pow(energy, static_cast<float>(i) );
-      return sqrt( val );
+      for( size_t i = pars.size(); i > 0; --i )
+        val = val*energy + pars[i-1];
+      return static_cast<float>( sqrt( val ) );
     }//case kSqrtPolynomial:
       
     case kNumResolutionFnctForm:
@@ -2606,6 +3325,118 @@ float DetectorPeakResponse::peakResolutionSigma( const float energy,
 }//static double peakResolutionSigma(...)
 
 
+void DetectorPeakResponse::peakResolutionFWHMs( const float *energies, const size_t nenergies,
+                                                ResolutionFnctForm fcnFrm,
+                                                const std::vector<float> &pars,
+                                                float *results )
+{
+  switch( fcnFrm )
+  {
+    case kGadrasResolutionFcn:
+    {
+      if( pars.size() != 3 )
+        throw std::runtime_error( "DetectorPeakResponse::peakResolutionFWHMs():"
+                                 " pars not defined" );
+      
+      const float &a = pars[0];
+      const float &b = pars[1];
+      const float &c = pars[2];
+      
+      // Compute the energy-independent terms (see peakResolutionFWHM) once
+      const bool a_is_zero = (fabs(a) < float(1.0E-6));
+      const float low_exp = (a < 0.0) ? pow( c, float(1.0f/log(1.0f-a)) ) : c;
+      const float A7 = ((a > 0.0f) && (a <= 6.61f*b))
+                       ? sqrt( pow(float(6.61f*b), float(2.0f))-a*a )/6.61f
+                       : 0.0f;
+      
+      for( size_t i = 0; i < nenergies; ++i )
+      {
+        const float energy = energies[i] / static_cast<float>(PhysicalUnits::keV);
+        
+        if( energy >= 661.0f || a_is_zero )
+          results[i] = 6.61f * b * pow(energy/661.0f, c);
+        else if( a < 0.0 )
+          results[i] = 6.61f * b * pow(energy/661.0f, low_exp);
+        else if( a > 6.61f*b )
+          results[i] = a;
+        else
+          results[i] = sqrt(a*a + pow(float(6.61f * A7 * pow(energy/661.0f, c)), 2.0f));
+      }//for( size_t i = 0; i < nenergies; ++i )
+      
+      return;
+    }//case kGadrasResolutionFcn:
+      
+    case kSqrtEnergyPlusInverse:
+    {
+      if( pars.size() != 3 )
+        throw std::runtime_error( "DetectorPeakResponse::peakResolutionFWHMs():"
+                                 " pars not defined" );
+      
+      const float p0 = pars[0], p1 = pars[1], p2 = pars[2];
+      for( size_t i = 0; i < nenergies; ++i )
+      {
+        const float energy = energies[i] / static_cast<float>(PhysicalUnits::keV);
+        results[i] = sqrt( p0 + p1*energy + p2/energy );
+      }
+      
+      return;
+    }//case kSqrtEnergyPlusInverse:
+      
+    case kSqrtPolynomial:
+    {
+      if( pars.size() < 1 )
+        throw runtime_error( "DetectorPeakResponse::peakResolutionFWHMs():"
+                             " pars not defined" );
+      
+      // Blocked so the compiler can vectorize the Horner polynomial evaluation
+      const size_t block_size = 64;
+      double x[block_size], val[block_size];
+      const size_t npars = pars.size();
+      
+      for( size_t start = 0; start < nenergies; start += block_size )
+      {
+        const size_t n = std::min( block_size, nenergies - start );
+        
+        for( size_t i = 0; i < n; ++i )
+        {
+          x[i] = energies[start + i] / static_cast<float>(PhysicalUnits::MeV);
+          val[i] = 0.0;
+        }
+        
+        for( size_t j = npars; j > 0; --j )
+        {
+          const double c = pars[j-1];
+          for( size_t i = 0; i < n; ++i )
+            val[i] = val[i]*x[i] + c;
+        }
+        
+        for( size_t i = 0; i < n; ++i )
+          results[start + i] = static_cast<float>( sqrt( val[i] ) );
+      }//for( loop over blocks of energies )
+      
+      return;
+    }//case kSqrtPolynomial:
+      
+    case kNumResolutionFnctForm:
+      break;
+  }//switch( fcnFrm )
+  
+  throw std::runtime_error( "DetectorPeakResponse::peakResolutionFWHMs():"
+                            " Resolution not defined" );
+}//void peakResolutionFWHMs(...)
+
+
+void DetectorPeakResponse::peakResolutionSigmas( const float *energies, const size_t nenergies,
+                                                 ResolutionFnctForm fcnFrm,
+                                                 const std::vector<float> &pars,
+                                                 float *results )
+{
+  peakResolutionFWHMs( energies, nenergies, fcnFrm, pars, results );
+  for( size_t i = 0; i < nenergies; ++i )
+    results[i] /= 2.35482f;
+}//void peakResolutionSigmas(...)
+
+
 float DetectorPeakResponse::peakResolutionFWHM( const float energy ) const
 {
   return peakResolutionFWHM( energy, m_resolutionForm, m_resolutionCoeffs );
@@ -2618,6 +3449,20 @@ float DetectorPeakResponse::peakResolutionSigma( const float energy ) const
 }//double peakResolutionSigma( float energy ) const
 
 
+void DetectorPeakResponse::peakResolutionFWHMs( const float *energies, const size_t nenergies,
+                                                float *results ) const
+{
+  peakResolutionFWHMs( energies, nenergies, m_resolutionForm, m_resolutionCoeffs, results );
+}//void peakResolutionFWHMs(...) const
+
+
+void DetectorPeakResponse::peakResolutionSigmas( const float *energies, const size_t nenergies,
+                                                 float *results ) const
+{
+  peakResolutionSigmas( energies, nenergies, m_resolutionForm, m_resolutionCoeffs, results );
+}//void peakResolutionSigmas(...) const
+
+
 float DetectorPeakResponse::detectorDiameter() const
 {
   return m_detectorDiameter;
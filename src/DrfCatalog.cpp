@@ -0,0 +1,745 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#include "InterSpec/InterSpec.h"
+#include "SpecUtils/StringAlgo.h"
+#include "InterSpec/InterSpecApp.h"
+#include "SpecUtils/Filesystem.h"
+#include "InterSpec/DrfCatalog.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+using namespace std;
+
+namespace
+{
+  const char * const ns_catalog_filename = "drf_catalog.txt";
+  const char * const ns_catalog_header = "# InterSpec DRF catalog v2";
+
+  /** Modification time and size of a file; both zero if file doesnt exist. */
+  struct FileStamp
+  {
+    int64_t mtime = 0;
+    int64_t size = 0;
+
+    bool exists() const { return (mtime != 0) || (size != 0); }
+    bool operator==( const FileStamp &rhs ) const { return (mtime == rhs.mtime) && (size == rhs.size); }
+    bool operator!=( const FileStamp &rhs ) const { return !(*this == rhs); }
+  };//struct FileStamp
+
+
+  FileStamp file_stamp( const string &path )
+  {
+    FileStamp stamp;
+
+    boost::system::error_code ec;
+#ifdef _WIN32
+    const boost::filesystem::path p( SpecUtils::convert_from_utf8_to_utf16(path) );
+#else
+    const boost::filesystem::path p( path );
+#endif
+
+    if( !boost::filesystem::is_regular_file( p, ec ) || ec )
+      return stamp;
+
+    const std::time_t mtime = boost::filesystem::last_write_time( p, ec );
+    if( ec )
+      return stamp;
+
+    const boost::uintmax_t size = boost::filesystem::file_size( p, ec );
+    if( ec )
+      return stamp;
+
+    stamp.mtime = static_cast<int64_t>( mtime );
+    stamp.size = static_cast<int64_t>( size );
+    if( !stamp.exists() )
+      stamp.size = 1; //Make sure an empty file with zero mtime still counts as existing
+
+    return stamp;
+  }//FileStamp file_stamp( const string &path )
+
+
+  /** Returns false if 'path' isnt a directory. */
+  bool directory_mtime( const string &path, int64_t &mtime )
+  {
+    boost::system::error_code ec;
+#ifdef _WIN32
+    const boost::filesystem::path p( SpecUtils::convert_from_utf8_to_utf16(path) );
+#else
+    const boost::filesystem::path p( path );
+#endif
+
+    if( !boost::filesystem::is_directory( p, ec ) || ec )
+      return false;
+
+    mtime = static_cast<int64_t>( boost::filesystem::last_write_time( p, ec ) );
+
+    return !ec;
+  }//bool directory_mtime(...)
+
+
+  /** Lists the sub-directories of 'path', and finds the files that match "Efficiency.csv" and
+   "Detector.dat", case-insensitively (the same as #DetectorPeakResponse::fromGadrasDirectory).
+   */
+  void list_directory( const string &path, vector<string> &subdirs,
+                       string &csv_name, string &dat_name )
+  {
+    subdirs.clear();
+    csv_name.clear();
+    dat_name.clear();
+
+    const auto check_filename = [&csv_name,&dat_name]( const string &fname ){
+      if( SpecUtils::iequals_ascii( fname, "Efficiency.csv" ) )
+        csv_name = fname;
+      else if( SpecUtils::iequals_ascii( fname, "Detector.dat" ) )
+        dat_name = fname;
+    };//check_filename
+
+#if( ANDROID )
+    for( const string &subdir : SpecUtils::ls_directories_in_directory( path ) )
+      subdirs.push_back( SpecUtils::filename(subdir) );
+    for( const string &file : SpecUtils::ls_files_in_directory( path ) )
+      check_filename( SpecUtils::filename(file) );
+#else
+    using namespace boost::filesystem;
+
+    try
+    {
+      directory_iterator end_itr;
+      for( directory_iterator itr( path ); itr != end_itr; ++itr )
+      {
+        boost::system::error_code ec;
+        const file_status status = itr->status(ec);
+        if( ec )
+          continue;
+
+        if( is_directory( status ) )
+          subdirs.push_back( itr->path().filename().string<string>() );
+        else if( is_regular_file( status ) )
+          check_filename( itr->path().filename().string<string>() );
+      }//for( loop over directory entries )
+    }catch( std::exception & )
+    {
+      //ex: boost::filesystem::filesystem_error: boost::filesystem::directory_iterator::construct: Permission denied: "..."
+    }
+#endif //if ANDROID / else
+
+    std::sort( begin(subdirs), end(subdirs) );
+  }//void list_directory(...)
+
+
+  /** What we know about a directory that is, or is below, a directory that has been searched for
+   GADRAS DRFs.
+   */
+  struct DirEntry
+  {
+    int64_t dir_mtime = 0;
+    std::vector<std::string> subdirs;
+
+    /** The names, as on disk, of the "Efficiency.csv" and "Detector.dat" files; empty if none. */
+    std::string csv_name;
+    std::string dat_name;
+
+    FileStamp csv_stamp;
+    FileStamp dat_stamp;
+
+    /** #DetectorPeakResponse::hashValue of the DRF, or zero if not parsed since files changed. */
+    uint64_t hash = 0;
+
+    /** Not persisted to disk; only filled out once a DRF has been requested. */
+    std::shared_ptr<const DetectorPeakResponse> drf;
+
+    bool has_drf() const { return csv_stamp.exists() && dat_stamp.exists(); }
+  };//struct DirEntry
+
+
+  struct RelEffFileEntry
+  {
+    FileStamp stamp;
+    std::vector<std::string> credits;
+    std::vector<std::shared_ptr<const DetectorPeakResponse>> drfs;
+  };//struct RelEffFileEntry
+
+
+  // Protects the following variables; the filesystem is never accessed while this is held.
+  std::mutex ns_catalog_mutex;
+  bool ns_catalog_loaded = false;
+  bool ns_catalog_dirty = false;
+  size_t ns_catalog_generation = 0;
+  std::map<std::string,DirEntry> ns_dirs;
+  std::map<std::string,RelEffFileEntry> ns_rel_eff_files;
+
+  // Serializes writing the catalog file; protects ns_saved_generation.
+  std::mutex ns_save_mutex;
+  size_t ns_saved_generation = 0;
+
+
+  /** Returns the file to persist the catalog to, or empty if there isnt a writable directory.
+
+   For web-server deployments, where there isnt a per-user data directory, the servers temporary
+   directory is used, since the catalog describes the servers filesystem, and not a users.
+   */
+  string catalog_file_path()
+  {
+    try
+    {
+#if( BUILD_AS_ELECTRON_APP || IOS || ANDROID || BUILD_AS_OSX_APP || BUILD_AS_LOCAL_SERVER )
+      const string datadir = InterSpec::writableDataDirectory();
+#else
+      const string datadir = InterSpecApp::tempDirectory();
+#endif
+      if( !datadir.empty() )
+        return SpecUtils::append_path( datadir, ns_catalog_filename );
+    }catch( std::exception & )
+    {
+    }
+
+    return "";
+  }//string catalog_file_path()
+
+
+  /** Reads the catalog from disk; does not require any locks. */
+  std::map<std::string,DirEntry> read_catalog_file()
+  {
+    std::map<std::string,DirEntry> dirs;
+
+    const string filepath = catalog_file_path();
+    if( filepath.empty() )
+      return dirs;
+
+#ifdef _WIN32
+    ifstream input( SpecUtils::convert_from_utf8_to_utf16(filepath).c_str(), ios::in | ios::binary );
+#else
+    ifstream input( filepath.c_str(), ios::in | ios::binary );
+#endif
+
+    if( !input.is_open() )
+      return dirs;
+
+    string line;
+    if( !SpecUtils::safe_get_line( input, line ) || (line != ns_catalog_header) )
+    {
+      cerr << "DrfCatalog: '" << filepath << "' is not a current catalog; ignoring." << endl;
+      return dirs;
+    }
+
+    while( SpecUtils::safe_get_line( input, line ) )
+    {
+      // Fields: path, dir mtime, csv name, csv mtime, csv size, dat name, dat mtime, dat size, hash,
+      //  then sub-directory names.  File names are empty if the file isnt present.
+      vector<string> fields;
+      SpecUtils::split_no_delim_compress( fields, line, "\t" );
+      if( fields.size() < 9 )
+        continue;
+
+      try
+      {
+        DirEntry entry;
+        entry.dir_mtime = std::stoll( fields[1] );
+        entry.csv_name = fields[2];
+        entry.csv_stamp.mtime = std::stoll( fields[3] );
+        entry.csv_stamp.size = std::stoll( fields[4] );
+        entry.dat_name = fields[5];
+        entry.dat_stamp.mtime = std::stoll( fields[6] );
+        entry.dat_stamp.size = std::stoll( fields[7] );
+        entry.hash = std::stoull( fields[8], nullptr, 16 );
+        entry.subdirs.insert( end(entry.subdirs), begin(fields) + 9, end(fields) );
+
+        dirs[fields[0]] = std::move(entry);
+      }catch( std::exception & )
+      {
+        //Corrupt line - we'll just re-discover this directory when walking.
+      }
+    }//while( SpecUtils::safe_get_line( input, line ) )
+
+    return dirs;
+  }//std::map<std::string,DirEntry> read_catalog_file()
+
+
+  /** Loads the catalog from disk, if it hasnt been already.  The file is read without holding
+   ns_catalog_mutex, so must not be called with it held.
+   */
+  void load_catalog_if_needed()
+  {
+    {//begin lock on ns_catalog_mutex
+      std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+      if( ns_catalog_loaded )
+        return;
+    }//end lock on ns_catalog_mutex
+
+    std::map<std::string,DirEntry> dirs = read_catalog_file();
+
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+    if( ns_catalog_loaded )
+      return;
+
+    ns_catalog_loaded = true;
+
+    // Anything already in memory was learned this session, so is more current than the file.
+    for( auto &path_entry : ns_dirs )
+      dirs[path_entry.first] = std::move(path_entry.second);
+    ns_dirs.swap( dirs );
+  }//void load_catalog_if_needed()
+
+
+  /** If the catalog has changed, serializes it to 'contents'; ns_catalog_mutex must be held.
+   Returns the generation to pass to #write_catalog_file, or zero if there is nothing to save.
+   */
+  size_t serialize_catalog_if_dirty( string &contents )
+  {
+    if( !ns_catalog_dirty )
+      return 0;
+
+    ns_catalog_dirty = false;
+
+    stringstream output;
+    output << ns_catalog_header << "\n";
+
+    char hashstr[32] = { '\0' };
+    for( const auto &path_entry : ns_dirs )
+    {
+      const string &path = path_entry.first;
+      const DirEntry &entry = path_entry.second;
+
+      // Paths with tabs or newlines would mess up our simple format; just dont persist them.
+      if( path.find_first_of("\t\r\n") != string::npos )
+        continue;
+
+      snprintf( hashstr, sizeof(hashstr), "%llx", static_cast<unsigned long long>(entry.hash) );
+
+      output << path << "\t" << entry.dir_mtime
+             << "\t" << entry.csv_name << "\t" << entry.csv_stamp.mtime << "\t" << entry.csv_stamp.size
+             << "\t" << entry.dat_name << "\t" << entry.dat_stamp.mtime << "\t" << entry.dat_stamp.size
+             << "\t" << hashstr;
+      for( const string &subdir : entry.subdirs )
+      {
+        if( subdir.find_first_of("\t\r\n") == string::npos )
+          output << "\t" << subdir;
+      }
+      output << "\n";
+    }//for( loop over directory entries )
+
+    contents = output.str();
+
+    return ++ns_catalog_generation;
+  }//size_t serialize_catalog_if_dirty( string &contents )
+
+
+  /** Writes a serialized catalog to disk, unless a newer one has already been written; must not be
+   called with ns_catalog_mutex held.
+   */
+  void write_catalog_file( const string &contents, const size_t generation )
+  {
+    if( !generation )
+      return;
+
+    const string filepath = catalog_file_path();
+    if( filepath.empty() )
+      return;
+
+    std::lock_guard<std::mutex> lock( ns_save_mutex );
+    if( generation <= ns_saved_generation )
+      return;
+
+    // Write to a temporary file, then rename, so a crash or another process wont see a partial file
+    const string tmppath = filepath + ".tmp";
+
+    {//begin write to tmppath
+#ifdef _WIN32
+      ofstream output( SpecUtils::convert_from_utf8_to_utf16(tmppath).c_str(), ios::out | ios::binary );
+#else
+      ofstream output( tmppath.c_str(), ios::out | ios::binary );
+#endif
+      if( !output.is_open() )
+      {
+        cerr << "DrfCatalog: unable to write '" << tmppath << "'" << endl;
+        return;
+      }
+
+      output.write( contents.c_str(), contents.size() );
+    }//end write to tmppath
+
+    if( SpecUtils::rename_file( tmppath, filepath ) != 0 )
+    {
+      SpecUtils::remove_file( filepath );
+      if( SpecUtils::rename_file( tmppath, filepath ) != 0 )
+      {
+        cerr << "DrfCatalog: unable to rename '" << tmppath << "' to '" << filepath << "'" << endl;
+        return;
+      }
+    }
+
+    ns_saved_generation = generation;
+  }//void write_catalog_file(...)
+
+
+  /** Calls 'fcn' for 'path', and each directory below it, that is in 'dirs'. */
+  template<class Function>
+  void visit_subtree( const std::map<std::string,DirEntry> &dirs, const string &path,
+                      Function fcn, const size_t depth = 0 )
+  {
+    const auto pos = dirs.find( path );
+    if( (pos == end(dirs)) || (depth > 64) )
+      return;
+
+    fcn( path, pos->second );
+
+    for( const string &subdir : pos->second.subdirs )
+      visit_subtree( dirs, SpecUtils::append_path(path, subdir), fcn, depth + 1 );
+  }//void visit_subtree(...)
+
+
+  /** Collects the GADRAS DRFs at, or below, 'path'. */
+  void collect_drfs( const std::map<std::string,DirEntry> &dirs, const string &path,
+                     vector<DrfCatalog::GadrasDrfInfo> &results )
+  {
+    visit_subtree( dirs, path, [&results]( const string &p, const DirEntry &entry ){
+      if( entry.has_drf() )
+        results.push_back( DrfCatalog::GadrasDrfInfo{ p, SpecUtils::filename(p), entry.hash } );
+    } );
+  }//void collect_drfs(...)
+
+
+  /** Walks 'path' and below, starting from what was previously known ('previous'), and puts the
+   current state of each directory into 'walked'.  Does not use any global state, so is called
+   without holding ns_catalog_mutex.
+
+   @param changed Set to true if anything differs from 'previous'.
+   @param stale_hashes Directories whose DRF had previously been parsed, but whose files changed.
+   */
+  void refresh_dir( const string &path,
+                    const std::map<std::string,DirEntry> &previous,
+                    std::map<std::string,DirEntry> &walked,
+                    bool &changed,
+                    vector<string> &stale_hashes,
+                    const size_t depth )
+  {
+    // Protect against symlink loops
+    if( (depth > 64) || walked.count(path) )
+      return;
+
+    int64_t dir_mtime = 0;
+    if( !directory_mtime( path, dir_mtime ) )
+    {
+      if( previous.count(path) )
+        changed = true;
+      return;
+    }//if( not a directory anymore )
+
+    const auto prev_pos = previous.find( path );
+    DirEntry entry = (prev_pos == end(previous)) ? DirEntry() : prev_pos->second;
+
+    // Directory modification time changes when entries are added, removed, or renamed, so we only
+    //  need to re-list it if it changed.
+    if( (prev_pos == end(previous)) || (entry.dir_mtime != dir_mtime) || !dir_mtime )
+    {
+      vector<string> subdirs;
+      string csv_name, dat_name;
+      list_directory( path, subdirs, csv_name, dat_name );
+      if( (subdirs != entry.subdirs) || (entry.dir_mtime != dir_mtime)
+          || (csv_name != entry.csv_name) || (dat_name != entry.dat_name) )
+        changed = true;
+      entry.subdirs.swap( subdirs );
+      entry.csv_name = csv_name;
+      entry.dat_name = dat_name;
+      entry.dir_mtime = dir_mtime;
+    }//if( directory contents may have changed )
+
+    // File contents changing doesnt change the directory modification time, so we always have to
+    //  check the DRF files themselves.
+    const FileStamp csv_stamp = entry.csv_name.empty() ? FileStamp()
+                                      : file_stamp( SpecUtils::append_path( path, entry.csv_name ) );
+    const FileStamp dat_stamp = entry.dat_name.empty() ? FileStamp()
+                                      : file_stamp( SpecUtils::append_path( path, entry.dat_name ) );
+
+    if( (csv_stamp != entry.csv_stamp) || (dat_stamp != entry.dat_stamp) )
+    {
+      if( entry.hash && csv_stamp.exists() && dat_stamp.exists() )
+        stale_hashes.push_back( path );
+
+      entry.csv_stamp = csv_stamp;
+      entry.dat_stamp = dat_stamp;
+      entry.hash = 0;
+      entry.drf.reset();
+      changed = true;
+    }//if( DRF files have changed )
+
+    const vector<string> subdirs = entry.subdirs;
+    walked[path] = std::move(entry);
+
+    for( const string &subdir : subdirs )
+      refresh_dir( SpecUtils::append_path(path, subdir), previous, walked, changed, stale_hashes, depth + 1 );
+  }//void refresh_dir(...)
+
+
+  void sort_by_name( vector<DrfCatalog::GadrasDrfInfo> &drfs )
+  {
+    std::stable_sort( begin(drfs), end(drfs),
+                      []( const DrfCatalog::GadrasDrfInfo &lhs, const DrfCatalog::GadrasDrfInfo &rhs ){
+      return lhs.name < rhs.name;
+    } );
+  }//void sort_by_name( vector<DrfCatalog::GadrasDrfInfo> &drfs )
+}//namespace
+
+
+namespace DrfCatalog
+{
+
+std::vector<GadrasDrfInfo> cached_gadras_drfs( const std::string &basedir )
+{
+  vector<GadrasDrfInfo> answer;
+
+  load_catalog_if_needed();
+
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+    collect_drfs( ns_dirs, basedir, answer );
+  }//end lock on ns_catalog_mutex
+
+  sort_by_name( answer );
+
+  return answer;
+}//cached_gadras_drfs(...)
+
+
+std::vector<GadrasDrfInfo> refresh_gadras_drfs( const std::string &basedir )
+{
+  load_catalog_if_needed();
+
+  // Take a copy of what we know about this tree, so we can walk the filesystem without the lock.
+  std::map<std::string,DirEntry> previous;
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+    visit_subtree( ns_dirs, basedir, [&previous]( const string &path, const DirEntry &entry ){
+      previous[path] = entry;
+    } );
+  }//end lock on ns_catalog_mutex
+
+  bool changed = false;
+  vector<string> stale_hashes;
+  std::map<std::string,DirEntry> walked;
+  refresh_dir( basedir, previous, walked, changed, stale_hashes, 0 );
+
+  // DRFs that had been parsed before (e.g., were used by a user), and have since changed, are
+  //  re-parsed so their hash is current for matching against previously used DRFs.
+  for( const string &path : stale_hashes )
+  {
+    DirEntry &entry = walked[path];
+    try
+    {
+      auto drf = make_shared<DetectorPeakResponse>( SpecUtils::filename(path), "" );
+      drf->fromGadrasDirectory( path );
+      entry.hash = drf->hashValue();
+      entry.drf = drf;
+    }catch( std::exception &e )
+    {
+      cerr << "DrfCatalog::refresh_gadras_drfs(): failed to re-parse '" << path << "': "
+           << e.what() << endl;
+    }
+  }//for( const string &path : stale_hashes )
+
+  vector<GadrasDrfInfo> answer;
+  collect_drfs( walked, basedir, answer );
+  sort_by_name( answer );
+
+  string contents;
+  size_t generation = 0;
+
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+
+    // Remove directories that were in this tree, but no longer are (e.g., were deleted or moved).
+    vector<string> removed;
+    visit_subtree( ns_dirs, basedir, [&removed,&walked]( const string &path, const DirEntry & ){
+      if( !walked.count(path) )
+        removed.push_back( path );
+    } );
+
+    for( const string &path : removed )
+      ns_dirs.erase( path );
+
+    for( auto &path_entry : walked )
+    {
+      DirEntry &entry = path_entry.second;
+
+      // The DRF may have been parsed by #parse_gadras_drf while we were walking the filesystem.
+      const auto pos = ns_dirs.find( path_entry.first );
+      if( (pos != end(ns_dirs)) && pos->second.hash && !entry.hash
+          && (pos->second.csv_stamp == entry.csv_stamp) && (pos->second.dat_stamp == entry.dat_stamp) )
+      {
+        entry.hash = pos->second.hash;
+        entry.drf = pos->second.drf;
+      }
+
+      ns_dirs[path_entry.first] = std::move(entry);
+    }//for( auto &path_entry : walked )
+
+    if( changed || !removed.empty() || !stale_hashes.empty() )
+      ns_catalog_dirty = true;
+
+    generation = serialize_catalog_if_dirty( contents );
+  }//end lock on ns_catalog_mutex
+
+  write_catalog_file( contents, generation );
+
+  return answer;
+}//refresh_gadras_drfs(...)
+
+
+std::shared_ptr<DetectorPeakResponse> parse_gadras_drf( const std::string &path )
+{
+  load_catalog_if_needed();
+
+  string csv_name, dat_name;
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+    const auto pos = ns_dirs.find( path );
+    if( pos != end(ns_dirs) )
+    {
+      csv_name = pos->second.csv_name;
+      dat_name = pos->second.dat_name;
+    }
+  }//end lock on ns_catalog_mutex
+
+  if( csv_name.empty() || dat_name.empty() )
+  {
+    vector<string> subdirs;
+    list_directory( path, subdirs, csv_name, dat_name );
+  }
+
+  const FileStamp csv_stamp = csv_name.empty() ? FileStamp()
+                                    : file_stamp( SpecUtils::append_path( path, csv_name ) );
+  const FileStamp dat_stamp = dat_name.empty() ? FileStamp()
+                                    : file_stamp( SpecUtils::append_path( path, dat_name ) );
+
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+
+    const auto pos = ns_dirs.find( path );
+    if( (pos != end(ns_dirs)) && pos->second.drf
+        && (pos->second.csv_stamp == csv_stamp) && (pos->second.dat_stamp == dat_stamp) )
+      return make_shared<DetectorPeakResponse>( *pos->second.drf );
+  }//end lock on ns_catalog_mutex
+
+  // We'll parse the DRF without holding the lock, since it may take a little while
+  shared_ptr<DetectorPeakResponse> drf;
+  try
+  {
+    const string name = SpecUtils::filename( path );
+    drf = make_shared<DetectorPeakResponse>( name, "" );
+    drf->fromGadrasDirectory( path );
+  }catch( std::exception &e )
+  {
+    cerr << "DrfCatalog::parse_gadras_drf() caught: " << e.what() << endl;
+    return nullptr;
+  }
+
+  string contents;
+  size_t generation = 0;
+
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+
+    DirEntry &entry = ns_dirs[path];
+    const uint64_t hash = drf->hashValue();
+    if( (entry.hash != hash) || (entry.csv_stamp != csv_stamp) || (entry.dat_stamp != dat_stamp) )
+      ns_catalog_dirty = true;
+
+    entry.csv_name = csv_name;
+    entry.dat_name = dat_name;
+    entry.csv_stamp = csv_stamp;
+    entry.dat_stamp = dat_stamp;
+    entry.hash = hash;
+    entry.drf = make_shared<DetectorPeakResponse>( *drf );
+
+    generation = serialize_catalog_if_dirty( contents );
+  }//end lock on ns_catalog_mutex
+
+  write_catalog_file( contents, generation );
+
+  return drf;
+}//parse_gadras_drf(...)
+
+
+bool parse_rel_eff_file( const std::string &path,
+                         std::vector<std::string> &credits,
+                         std::vector<std::shared_ptr<DetectorPeakResponse>> &drfs )
+{
+  credits.clear();
+  drfs.clear();
+
+  const FileStamp stamp = file_stamp( path );
+  if( !stamp.exists() )
+    return false;
+
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+
+    const auto pos = ns_rel_eff_files.find( path );
+    if( (pos != end(ns_rel_eff_files)) && (pos->second.stamp == stamp) )
+    {
+      credits = pos->second.credits;
+      for( const auto &drf : pos->second.drfs )
+        drfs.push_back( make_shared<DetectorPeakResponse>( *drf ) );
+      return true;
+    }
+  }//end lock on ns_catalog_mutex
+
+#ifdef _WIN32
+  ifstream input( SpecUtils::convert_from_utf8_to_utf16(path).c_str(), ios::in | ios::binary );
+#else
+  ifstream input( path.c_str(), ios::in | ios::binary );
+#endif
+
+  if( !input.is_open() )
+    return false;
+
+  DetectorPeakResponse::parseMultipleRelEffDrfCsv( input, credits, drfs );
+
+  RelEffFileEntry entry;
+  entry.stamp = stamp;
+  entry.credits = credits;
+  for( const auto &drf : drfs )
+    entry.drfs.push_back( make_shared<DetectorPeakResponse>( *drf ) );
+
+  {//begin lock on ns_catalog_mutex
+    std::lock_guard<std::mutex> lock( ns_catalog_mutex );
+    ns_rel_eff_files[path] = std::move(entry);
+  }//end lock on ns_catalog_mutex
+
+  return true;
+}//parse_rel_eff_file(...)
+
+}//namespace DrfCatalog
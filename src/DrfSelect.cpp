@@ -84,6 +84,7 @@
 #include "SpecUtils/ParseUtils.h"
 #include "SpecUtils/StringAlgo.h"
 #include "InterSpec/ColorTheme.h"
+#include "InterSpec/DrfCatalog.h"
 #include "InterSpec/HelpSystem.h"
 #include "InterSpec/SimpleDialog.h"
 #include "InterSpec/InterSpecApp.h"
@@ -793,6 +794,13 @@ protected:
   DrfSelect *m_drfSelect;
   
   Wt::WComboBox *m_detectorSelect;
+  
+  /** The DRFs available in the directory, as known by the #DrfCatalog; DRFs are only parsed once
+   selected, or needed for comparison, with the parsed DRFs being placed in #m_responses.
+   */
+  std::vector<DrfCatalog::GadrasDrfInfo> m_drfInfos;
+  
+  /** Same size as #m_drfInfos; entries are nullptr until the DRF has been parsed. */
   std::vector<std::shared_ptr<DetectorPeakResponse> > m_responses;
 
   Wt::WText *m_msg;
@@ -816,12 +824,26 @@ protected:
   
   bool trySelectDetector( std::shared_ptr<DetectorPeakResponse> det );
   
+  /** Returns the DRF at the given index of #m_drfInfos, parsing it if it hasnt been already.
+   Returns nullptr if index is invalid, or DRF cant be parsed.
+   */
+  std::shared_ptr<DetectorPeakResponse> response( const size_t index );
+  
+  /** Returns the index, within #m_drfInfos, of the passed in DRF, or -1 if not found.
+   Uses the DRF hash values known by the #DrfCatalog, and only parses DRFs whose hash isnt known,
+   and whose name matches the wanted DRF.
+   */
+  int indexOfDetector( const std::shared_ptr<DetectorPeakResponse> &det );
+  
   //parseDetector() returns null on error
   static std::shared_ptr<DetectorPeakResponse> parseDetector( const string directory );
   static vector<string> recursive_list_gadras_drfs( const string &sourcedir );
   
   void initDetectors();
   void detectorSelected( const int index );
+  
+  /** Sets the DRFs available in the directory, keeping the current selection if possible. */
+  void setAvailableDrfs( const std::vector<DrfCatalog::GadrasDrfInfo> &drfs );
 };//class GadrasDirectory
 
 
@@ -1186,18 +1208,28 @@ void RelEffFile::initDetectors()
     pathstr = m_existingFilePath;
   }
 
+  bool file_opened = false;
+  
+  if( m_fileUpload )
+  {
 #ifdef _WIN32
-  const std::wstring wpathstr = SpecUtils::convert_from_utf8_to_utf16(pathstr);
-  std::ifstream input( wpathstr.c_str(), ios::in | ios::binary );
+    const std::wstring wpathstr = SpecUtils::convert_from_utf8_to_utf16(pathstr);
+    std::ifstream input( wpathstr.c_str(), ios::in | ios::binary );
 #else
-  std::ifstream input( pathstr.c_str(), ios::in | ios::binary );
+    std::ifstream input( pathstr.c_str(), ios::in | ios::binary );
 #endif
-  
-  const bool file_opened = input.is_open();
+    
+    file_opened = input.is_open();
+    if( file_opened )
+      DetectorPeakResponse::parseMultipleRelEffDrfCsv( input, credits, m_responses );
+  }else
+  {
+    // Files on disk are only re-parsed if they have changed since last time
+    file_opened = DrfCatalog::parse_rel_eff_file( pathstr, credits, m_responses );
+  }//if( m_fileUpload ) / else
   
   if( file_opened )
   {
-    DetectorPeakResponse::parseMultipleRelEffDrfCsv( input, credits, m_responses );
     
 //#if( PERFORM_DEVELOPER_CHECKS )
 //    for( auto drf : m_responses )
@@ -1607,16 +1639,12 @@ bool GadrasDetSelect::trySelectDetector( std::shared_ptr<DetectorPeakResponse> d
     if( !d )
       continue;  //shouldnt ever happen, but JIC
     
-    for( size_t i = 0; i < d->m_responses.size(); ++i )
+    const int index = d->indexOfDetector( det );
+    if( index >= 0 )
     {
-      auto response = d->m_responses[i];
-      
-      if( response == det || det->hashValue()==response->hashValue() )
-      {
-        d->m_detectorSelect->setCurrentIndex( i+1 );
-        return true;
-      }
-    }//for( size_t i = 0; i < d->m_responses.size(); ++i )
+      d->m_detectorSelect->setCurrentIndex( index + 1 );
+      return true;
+    }
     
     d->m_detectorSelect->setCurrentIndex( 0 );
   }//for( auto w : m_directories->children() )
@@ -1943,8 +1971,8 @@ void GadrasDirectory::detectorSelectCallback()
   const int index = m_detectorSelect->currentIndex();
   
   //Item at index 0 is always a non-detector.
-  if( index > 0 && (index-1) < m_responses.size() )
-    det = m_responses[index-1];
+  if( index > 0 )
+    det = response( static_cast<size_t>(index - 1) );
   
   if( m_parent )
     m_parent->detectorSelected( this, det );
@@ -1962,88 +1990,78 @@ bool GadrasDirectory::trySelectDetector( std::shared_ptr<DetectorPeakResponse> d
     return false;
   }//if( !det )
   
-  for( size_t i = 0; i < m_responses.size(); ++i )
+  const int index = indexOfDetector( det );
+  if( index >= 0 )
   {
-    if( m_responses[i]->hashValue() == det->hashValue() )
-    {
-      m_detectorSelect->setCurrentIndex( i+1 );
-      return true;
-    }
-  }//for( size_t i = 0; i < m_responses.size(); ++i )
+    m_detectorSelect->setCurrentIndex( index + 1 );
+    return true;
+  }
   
   m_detectorSelect->setCurrentIndex( 0 );
   return false;
 }//bool trySelectDetector( std::shared_ptr<DetectorPeakResponse> det )
 
 
-//parseDetector() returns null on error
-std::shared_ptr<DetectorPeakResponse> GadrasDirectory::parseDetector( string path )
+std::shared_ptr<DetectorPeakResponse> GadrasDirectory::response( const size_t index )
 {
-  try
-  {
-    const string name = SpecUtils::filename( path );
-    auto drf = make_shared<DetectorPeakResponse>( name, "" );
-    drf->fromGadrasDirectory( path );
-    
-//#if( PERFORM_DEVELOPER_CHECKS )
-//    check_url_serialization( drf );
-//#endif
-    
-    return drf;
-  }catch( std::exception &e )
+  if( index >= m_drfInfos.size() )
+    return nullptr;
+  
+  assert( m_responses.size() == m_drfInfos.size() );
+  
+  if( !m_responses[index] )
   {
-    cerr << "GadrasDirectory::parseDetector() caught: " << e.what() << endl;
+    m_responses[index] = parseDetector( m_drfInfos[index].path );
+    if( m_responses[index] )
+      m_drfInfos[index].hash = m_responses[index]->hashValue();
   }
- 
-  return nullptr;
-}//shared_ptr<DetectorPeakResponse> parseDetector( const string directory )
+  
+  return m_responses[index];
+}//std::shared_ptr<DetectorPeakResponse> response( const size_t index )
 
 
-vector<string> GadrasDirectory::recursive_list_gadras_drfs( const string &sourcedir )
+int GadrasDirectory::indexOfDetector( const std::shared_ptr<DetectorPeakResponse> &det )
 {
-  vector<string> files;
-  if( !SpecUtils::is_directory( sourcedir ) )
-    return files;
-  
-  const string csv_file = SpecUtils::append_path( sourcedir, "Efficiency.csv");
-  const string dat_file = SpecUtils::append_path( sourcedir, "Detector.dat");
-  
-  if( SpecUtils::is_file(csv_file) && SpecUtils::is_file(dat_file) )
-    files.push_back( sourcedir );
+  if( !det )
+    return -1;
   
-  //ToDo: Maybe we should use the Android implemenatation always.
-#if( ANDROID )
-  const vector<string> subdirs = SpecUtils::ls_directories_in_directory( sourcedir );
-  for( const string &subdirpath : subdirs )
-  {
-    auto subsubdirs = recursive_list_gadras_drfs( subdirpath );
-    files.insert( end(files), begin(subsubdirs), end(subsubdirs) );
-  }//for( const string &subdir : subdirs )
-#else
-using namespace boost::filesystem;
-  directory_iterator end_itr; // default construction yields past-the-end
+  const uint64_t wanted_hash = det->hashValue();
   
-  directory_iterator itr;
-  try
+  for( size_t i = 0; i < m_drfInfos.size(); ++i )
   {
-    itr = directory_iterator( sourcedir );
-  }catch( std::exception & )
-  {
-    //ex: boost::filesystem::filesystem_error: boost::filesystem::directory_iterator::construct: Permission denied: "..."
-    return files;
+    if( (m_responses[i] == det) || (m_drfInfos[i].hash == wanted_hash) )
+      return static_cast<int>( i );
   }
   
-  for( ; itr != end_itr; ++itr )
+  // We dont know the hash of DRFs that havent been parsed yet, so parse ones with the same name.
+  for( size_t i = 0; i < m_drfInfos.size(); ++i )
   {
-    const boost::filesystem::path &p = itr->path();
-    const string pstr = p.string<string>();
-    if( SpecUtils::is_directory( pstr ) )
-    {
-      auto subdirs = recursive_list_gadras_drfs(pstr);
-      files.insert( end(files), begin(subdirs), end(subdirs) );
-    }
-  }//for( loop over
-#endif //if ANDROID / else
+    if( m_drfInfos[i].hash || (m_drfInfos[i].name != det->name()) )
+      continue;
+    
+    const shared_ptr<DetectorPeakResponse> drf = response( i );
+    if( drf && (drf->hashValue() == wanted_hash) )
+      return static_cast<int>( i );
+  }//for( size_t i = 0; i < m_drfInfos.size(); ++i )
+  
+  return -1;
+}//int indexOfDetector( const std::shared_ptr<DetectorPeakResponse> &det )
+
+
+//parseDetector() returns null on error
+std::shared_ptr<DetectorPeakResponse> GadrasDirectory::parseDetector( string path )
+{
+  // The catalog caches parsed DRFs until their files change, so this is cheap after first call.
+  return DrfCatalog::parse_gadras_drf( path );
+}//shared_ptr<DetectorPeakResponse> parseDetector( const string directory )
+
+
+vector<string> GadrasDirectory::recursive_list_gadras_drfs( const string &sourcedir )
+{
+  // The catalog only re-lists directories that have changed since it last looked at them.
+  vector<string> files;
+  for( const DrfCatalog::GadrasDrfInfo &info : DrfCatalog::refresh_gadras_drfs( sourcedir ) )
+    files.push_back( info.path );
   
   return files;
 }//vector<string> recursive_list_gadras_drfs( const string &sourcedir )
@@ -2052,6 +2070,7 @@ using namespace boost::filesystem;
 void GadrasDirectory::initDetectors()
 {
   m_detectorSelect->clear();
+  m_drfInfos.clear();
   m_responses.clear();
   
   m_msg->setText( "" );
@@ -2081,7 +2100,7 @@ void GadrasDirectory::initDetectors()
   const std::string objname = objectName();
   const std::string sessid = wApp->sessionId();
   
-  auto updategui = [this,objname]( std::vector<std::shared_ptr<DetectorPeakResponse> > drfs ){
+  auto updategui = [this,objname]( std::vector<DrfCatalog::GadrasDrfInfo> drfs ){
     
     //Lets make sure this widget hasnt been deleted, by looking for it in the DOM
     WWidget *w = wApp->findWidget(objname);
@@ -2093,70 +2112,31 @@ void GadrasDirectory::initDetectors()
     
     //cout << "Found widget '" << objname << "' in the DOM!" << endl;
     
-    for( auto drf : drfs )
-    {
-      if( drf )
-        m_responses.push_back( drf );
-    }
-    
-    if( m_responses.empty() )
-    {
-      m_detectorSelect->addItem( "<no responses in directory>" );
-      m_detectorSelect->disable();
-    }else
-    {
-      m_detectorSelect->addItem( "<select detector>" );
-      m_detectorSelect->enable();
-    }
-    
-    std::sort( begin(m_responses), end(m_responses),
-               []( const shared_ptr<DetectorPeakResponse> &lhs,
-                   const shared_ptr<DetectorPeakResponse> &rhs ) -> bool {
-     if( !lhs || !rhs )
-       return false;
-      return lhs->name() < rhs->name();
-    } );
-    
-    
-    for( const auto drf : m_responses )
-      m_detectorSelect->addItem( drf->name() );
-    m_detectorSelect->setCurrentIndex( 0 );
-    
-    if( m_responses.empty() )
-    {
-      m_msg->setText( "<span style=\"color:red;\">No valid DRFs in directory, or its subdirectories.</span>" );
-      m_msg->show();
-    }else
-    {
-      m_detectorSelect->enable();
-    }
+    setAvailableDrfs( drfs );
     
     this->enable();
     
-    
     wApp->triggerUpdate();
   };//updategui lambda
   
   auto searchpaths = [basedir, objname, sessid, updategui](){
-    const vector<string> dirs = recursive_list_gadras_drfs( basedir );
-    std::vector<std::shared_ptr<DetectorPeakResponse> > dets( dirs.size(), nullptr );
-    
-    SpecUtilsAsync::ThreadPool pool;
-    for( size_t i = 0; i < dirs.size(); ++i )
-      pool.post( [i,&dets,&dirs](){ dets[i] = GadrasDirectory::parseDetector( dirs[i] ); } );
-    pool.join();
-    
-    //for( const auto &d : dirs )
-    //{
-    //  auto drf = parseDetector( d );
-    //  if( drf )
-    //    m_responses.push_back( drf );
-    //}
-    //end section that should be done off the main thread
+    // First show what the catalog already knows about (e.g., from a previous session), which
+    //  doesnt require touching the filesystem, and then update the catalog for any changes.
+    //  DRFs are only parsed once the user selects one.
+    const vector<DrfCatalog::GadrasDrfInfo> cached = DrfCatalog::cached_gadras_drfs( basedir );
     
     Wt::WServer *server = Wt::WServer::instance();
-    if( server )
-      server->post(sessid, std::bind( [updategui,dets](){ updategui(dets); } ) );
+    if( server && !cached.empty() )
+      server->post(sessid, std::bind( [updategui,cached](){ updategui(cached); } ) );
+    
+    const vector<DrfCatalog::GadrasDrfInfo> current = DrfCatalog::refresh_gadras_drfs( basedir );
+    
+    bool changed = (cached.empty() || (cached.size() != current.size()));
+    for( size_t i = 0; !changed && (i < current.size()); ++i )
+      changed = (cached[i].path != current[i].path);
+    
+    if( server && changed )
+      server->post(sessid, std::bind( [updategui,current](){ updategui(current); } ) );
   };//searchpaths lamda
   
   
@@ -2166,11 +2146,71 @@ void GadrasDirectory::initDetectors()
 }//void initDetectors()
 
 
+void GadrasDirectory::setAvailableDrfs( const std::vector<DrfCatalog::GadrasDrfInfo> &drfs )
+{
+  // Keep track of what was selected, so we can re-select it
+  string prev_selected;
+  const int prev_index = m_detectorSelect->currentIndex();
+  if( (prev_index > 0) && ((prev_index - 1) < static_cast<int>(m_drfInfos.size())) )
+    prev_selected = m_drfInfos[prev_index - 1].path;
+  
+  // Keep any DRFs we have already parsed
+  map<string,shared_ptr<DetectorPeakResponse>> parsed;
+  for( size_t i = 0; i < m_drfInfos.size(); ++i )
+  {
+    if( m_responses[i] )
+      parsed[m_drfInfos[i].path] = m_responses[i];
+  }
+  
+  m_drfInfos = drfs;
+  m_responses.clear();
+  m_responses.resize( m_drfInfos.size() );
+  for( size_t i = 0; i < m_drfInfos.size(); ++i )
+  {
+    const auto pos = parsed.find( m_drfInfos[i].path );
+    if( pos != end(parsed) )
+      m_responses[i] = pos->second;
+  }
+  
+  m_detectorSelect->clear();
+  
+  if( m_drfInfos.empty() )
+  {
+    m_detectorSelect->addItem( "<no responses in directory>" );
+    m_detectorSelect->disable();
+  }else
+  {
+    m_detectorSelect->addItem( "<select detector>" );
+    m_detectorSelect->enable();
+  }
+  
+  int new_index = 0;
+  for( size_t i = 0; i < m_drfInfos.size(); ++i )
+  {
+    m_detectorSelect->addItem( m_drfInfos[i].name );
+    if( !prev_selected.empty() && (m_drfInfos[i].path == prev_selected) )
+      new_index = static_cast<int>( i + 1 );
+  }
+  
+  m_detectorSelect->setCurrentIndex( new_index );
+  
+  if( m_drfInfos.empty() )
+  {
+    m_msg->setText( "<span style=\"color:red;\">No valid DRFs in directory, or its subdirectories.</span>" );
+    m_msg->show();
+  }else
+  {
+    m_msg->setText( "" );
+    m_msg->hide();
+  }
+}//void setAvailableDrfs( const std::vector<DrfCatalog::GadrasDrfInfo> &drfs )
+
+
 void GadrasDirectory::detectorSelected( const int index )
 {
   std::shared_ptr<DetectorPeakResponse> det;
   if( index > 0 )
-    det = m_responses.at( index - 1 );
+    det = response( static_cast<size_t>(index - 1) );
   
   m_drfSelect->setDetector( det );
   m_drfSelect->emitChangedSignal();
@@ -4144,31 +4184,28 @@ vector<pair<string,string>> DrfSelect::avaliableGadrasDetectors() const
   for( std::string path : paths )
   {
     SpecUtils::trim( path );
-    const vector<string> csvs = SpecUtils::recursive_ls( path, "Efficiency.csv" ); //ending string is case-insensitive
+    if( path.empty() )
+      continue;
+    
+    // The catalog only re-lists directories that have changed since it was last called
+    const vector<DrfCatalog::GadrasDrfInfo> drfs = DrfCatalog::refresh_gadras_drfs( path );
     
-    for( const std::string &csv : csvs )
+    for( const DrfCatalog::GadrasDrfInfo &drf : drfs )
     {
-      const string parent = SpecUtils::parent_path(csv);
-      vector<string> files = SpecUtils::ls_files_in_directory(parent);
-      bool found_dat = false;
-      for( size_t i = 0; !found_dat && i < files.size(); ++i )
-        found_dat = SpecUtils::iends_with( files[i], "Detector.dat" );
-      if( found_dat )
+      const string &parent = drf.path;
+      try
       {
-        try
-        {
-          //fs_relative probably shouldnt throw, but JIC.
-          //fs_relative( const std::string &from_path, const std::string &to_path )
-          string displayname = SpecUtils::fs_relative( path, parent );
-          if( displayname.empty() || displayname == "." )
-            displayname = SpecUtils::filename(parent);
-          
-          answer.push_back( make_pair(parent, displayname) );
-        }catch(...)
-        {
-        }
-      }//if( found_dat )
-    }
+        //fs_relative probably shouldnt throw, but JIC.
+        //fs_relative( const std::string &from_path, const std::string &to_path )
+        string displayname = SpecUtils::fs_relative( path, parent );
+        if( displayname.empty() || displayname == "." )
+          displayname = SpecUtils::filename(parent);
+        
+        answer.push_back( make_pair(parent, displayname) );
+      }catch(...)
+      {
+      }
+    }//for( const DrfCatalog::GadrasDrfInfo &drf : drfs )
   }//for( const std::string &path : paths )
 
   return answer;
@@ -59,6 +59,7 @@
 #include "InterSpec/EnergyCal.h"
 #include "SpecUtils/ParseUtils.h"
 #include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/SpecUtilsAsync.h"
 #include "SpecUtils/EnergyCalibration.h"
 
 using namespace std;
@@ -456,6 +457,88 @@ protected:
   std::vector< std::pair<float,float> > m_devpair;
 };//class PolyCalibCoefMinFcn
 
+
+/** Orders energy calibrations by value, rather than pointer, so we can de-duplicate the (often
+ many thousands of) calibrations in a file that are separate objects, but otherwise the same.
+ */
+struct EnergyCalValueLess
+{
+  bool operator()( const shared_ptr<const SpecUtils::EnergyCalibration> &lhs,
+                   const shared_ptr<const SpecUtils::EnergyCalibration> &rhs ) const
+  {
+    if( lhs == rhs )
+      return false;
+    if( !lhs || !rhs )
+      return !lhs;
+
+    if( lhs->type() != rhs->type() )
+      return (lhs->type() < rhs->type());
+
+    if( lhs->num_channels() != rhs->num_channels() )
+      return (lhs->num_channels() < rhs->num_channels());
+
+    if( lhs->coefficients() != rhs->coefficients() )
+      return (lhs->coefficients() < rhs->coefficients());
+
+    if( lhs->deviation_pairs() != rhs->deviation_pairs() )
+      return (lhs->deviation_pairs() < rhs->deviation_pairs());
+
+    if( lhs->type() == SpecUtils::EnergyCalType::LowerChannelEdge )
+    {
+      const auto &lhs_energies = lhs->channel_energies();
+      const auto &rhs_energies = rhs->channel_energies();
+      if( !lhs_energies || !rhs_energies )
+        return (!lhs_energies && rhs_energies);
+      return (*lhs_energies < *rhs_energies);
+    }//if( lower channel energy )
+
+    return false;
+  }//operator()
+};//struct EnergyCalValueLess
+
+
+/** Applies only the change in offset between 'orig_cal' and 'new_cal' to 'other_cal'. */
+shared_ptr<const SpecUtils::EnergyCalibration>
+propogate_energy_cal_offset_change( const shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                                    const shared_ptr<const SpecUtils::EnergyCalibration> &new_cal,
+                                    const shared_ptr<const SpecUtils::EnergyCalibration> &other_cal )
+{
+  using namespace SpecUtils;
+
+  const vector<float> &new_disp_coefs = new_cal->coefficients();
+  const vector<float> &prev_disp_coefs = orig_cal->coefficients();
+  const vector<pair<float,float>> &dev_pairs = other_cal->deviation_pairs();
+
+  if( new_disp_coefs.empty() || prev_disp_coefs.empty() || other_cal->coefficients().empty() )
+    throw runtime_error( "propogate_energy_cal_offset_change: missing coefficients" );
+
+  vector<float> new_coefs = other_cal->coefficients();
+  new_coefs[0] += (new_disp_coefs[0] - prev_disp_coefs[0]);
+
+  auto cal = make_shared<EnergyCalibration>();
+  switch( other_cal->type() )
+  {
+    case SpecUtils::EnergyCalType::Polynomial:
+    case SpecUtils::EnergyCalType::UnspecifiedUsingDefaultPolynomial:
+      cal->set_polynomial( other_cal->num_channels(), new_coefs, dev_pairs );
+      break;
+
+    case SpecUtils::EnergyCalType::FullRangeFraction:
+      cal->set_full_range_fraction( other_cal->num_channels(), new_coefs, dev_pairs );
+      break;
+
+    case SpecUtils::EnergyCalType::LowerChannelEdge:
+      cal->set_lower_channel_energy( other_cal->num_channels(), new_coefs ); //eh, whatever
+      break;
+
+    case SpecUtils::EnergyCalType::InvalidEquationType:
+      throw runtime_error( "propogate_energy_cal_offset_change: invalid calibration" );
+      break;
+  }//switch( other_cal->type() )
+
+  return cal;
+}//propogate_energy_cal_offset_change(...)
+
 }//namespace
 
 
@@ -484,6 +567,173 @@ double EnergyCal::fit_energy_cal_poly( const std::vector<EnergyCal::RecalPeakInf
 }//double fit_energy_cal_poly(...)
 
 
+double EnergyCal::fit_energy_cal_poly_multi_file( const vector<vector<EnergyCal::RecalPeakInfo>> &peakinfos,
+                                       const vector<bool> &fitfor,
+                                       const bool fit_file_offsets,
+                                       const size_t nchannels,
+                                       const vector<pair<float,float>> &dev_pairs,
+                                       vector<float> &coefs,
+                                       vector<float> &coefs_uncert,
+                                       vector<EnergyCal::MultiFileCalResidual> &residuals )
+{
+  const size_t nfiles = peakinfos.size();
+  const size_t nparsfit = static_cast<size_t>( std::count(begin(fitfor),end(fitfor),true) );
+  
+  residuals.clear();
+  residuals.resize( nfiles );
+  
+  // The column, in the least squares matrix, of each files offset; files without peaks, or the
+  //  reference file, dont get an offset.
+  const size_t no_offset_col = std::numeric_limits<size_t>::max();
+  vector<size_t> offset_col( nfiles, no_offset_col );
+  
+  size_t npeaks = 0, noffsets = 0;
+  bool have_reference_file = false;
+  for( size_t file_index = 0; file_index < nfiles; ++file_index )
+  {
+    const size_t nfilepeaks = peakinfos[file_index].size();
+    npeaks += nfilepeaks;
+    residuals[file_index].num_peaks = nfilepeaks;
+    
+    if( !nfilepeaks )
+      continue;
+    
+    if( have_reference_file && fit_file_offsets )
+      offset_col[file_index] = nparsfit + (noffsets++);
+    have_reference_file = true;
+  }//for( loop over files )
+  
+  const size_t nfitpars = nparsfit + noffsets;
+  
+  if( npeaks < 1 )
+    throw runtime_error( "Must have at least one peak" );
+  
+  if( nparsfit < 1 )
+    throw runtime_error( "Must fit for at least one coefficient" );
+  
+  if( nfitpars > npeaks )
+    throw runtime_error( "Must have at least as many peaks as coefficients and file offsets fitting for" );
+  
+  if( (nparsfit != fitfor.size()) && (coefs.size() != fitfor.size()) )
+    throw runtime_error( "You must supply input coefficient when any of the coefficients are fixed" );
+  
+  // Same least linear squares approach as fit_energy_cal_imp(...), but with additional columns for
+  //  the per-file offsets.
+  using namespace boost::numeric;
+  
+  ublas::matrix<double> A( npeaks, nfitpars, 0.0 );
+  ublas::vector<double> b( npeaks );
+  
+  vector<size_t> peak_file( npeaks );
+  vector<double> mean_bin( npeaks ), true_energies( npeaks ), energy_uncerts( npeaks );
+  
+  for( size_t file_index = 0, row = 0; file_index < nfiles; ++file_index )
+  {
+    for( const EnergyCal::RecalPeakInfo &info : peakinfos[file_index] )
+    {
+      peak_file[row] = file_index;
+      mean_bin[row] = info.peakMeanBinNumber;
+      true_energies[row] = info.photopeakEnergy;
+      energy_uncerts[row] = fabs( info.photopeakEnergy * info.peakMeanUncert / std::max(info.peakMean,1.0) );
+      
+      if( IsNan(energy_uncerts[row]) || IsInf(energy_uncerts[row]) || (energy_uncerts[row] <= 0.0) )
+        throw runtime_error( "Invalid peak mean uncertainty" );
+      
+      const double data_y_uncert = energy_uncerts[row];
+      double data_y = true_energies[row];
+      data_y -= SpecUtils::correction_due_to_dev_pairs( true_energies[row], dev_pairs );
+      
+      for( size_t col = 0, coef_index = 0; coef_index < fitfor.size(); ++coef_index )
+      {
+        if( fitfor[coef_index] )
+        {
+          assert( col < nparsfit );
+          A(row,col) = poly_coef_fcn( coef_index, mean_bin[row], nchannels ) / data_y_uncert;
+          ++col;
+        }else
+        {
+          data_y -= coefs[coef_index] * poly_coef_fcn( coef_index, mean_bin[row], nchannels );
+        }
+      }//for( loop over coefficients )
+      
+      if( offset_col[file_index] != no_offset_col )
+        A(row,offset_col[file_index]) = 1.0 / data_y_uncert;
+      
+      b(row) = data_y / data_y_uncert;
+      ++row;
+    }//for( loop over peaks in file )
+  }//for( loop over files )
+  
+  const ublas::matrix<double> A_transpose = ublas::trans( A );
+  const ublas::matrix<double> alpha = prod( A_transpose, A );
+  ublas::matrix<double> C( alpha.size1(), alpha.size2() );
+  const bool success = matrix_invert( alpha, C );
+  if( !success )
+    throw runtime_error( "Trouble inverting least linear squares matrix" );
+  
+  const ublas::vector<double> beta = prod( A_transpose, b );
+  const ublas::vector<double> a = prod( C, beta );
+  
+  coefs.resize( fitfor.size(), 0.0 );
+  coefs_uncert.resize( fitfor.size(), 0.0 );
+  
+  for( size_t col = 0, coef_index = 0; coef_index < fitfor.size(); ++coef_index )
+  {
+    if( fitfor[coef_index] )
+    {
+      assert( col < nparsfit );
+      coefs[coef_index] = static_cast<float>( a(col) );
+      coefs_uncert[coef_index] = static_cast<float>( std::sqrt( C(col,col) ) );
+      ++col;
+    }else
+    {
+      coefs_uncert[coef_index] = 0.0;
+    }
+  }//for( int coef = 0; coef < order; ++coef )
+  
+  for( size_t file_index = 0; file_index < nfiles; ++file_index )
+  {
+    const size_t col = offset_col[file_index];
+    if( col != no_offset_col )
+    {
+      residuals[file_index].offset = a(col);
+      residuals[file_index].offset_uncert = std::sqrt( C(col,col) );
+    }
+  }//for( loop over files )
+  
+  double chi2 = 0.0;
+  for( size_t row = 0; row < npeaks; ++row )
+  {
+    EnergyCal::MultiFileCalResidual &residual = residuals[peak_file[row]];
+    
+    double y_pred = residual.offset;
+    for( size_t i = 0; i < fitfor.size(); ++i )
+      y_pred += coefs[i] * poly_coef_fcn( i, mean_bin[row], nchannels );
+    y_pred += SpecUtils::deviation_pair_correction( y_pred, dev_pairs );
+    
+    const double diff = y_pred - true_energies[row];
+    const double peak_chi2 = std::pow( diff / energy_uncerts[row], 2.0 );
+    
+    chi2 += peak_chi2;
+    residual.chi2 += peak_chi2;
+    residual.mean_residual += diff;
+    residual.rms_residual += diff*diff;
+    residual.max_abs_residual = std::max( residual.max_abs_residual, fabs(diff) );
+  }//for( size_t row = 0; row < npeaks; ++row )
+  
+  for( EnergyCal::MultiFileCalResidual &residual : residuals )
+  {
+    if( residual.num_peaks )
+    {
+      residual.mean_residual /= residual.num_peaks;
+      residual.rms_residual = std::sqrt( residual.rms_residual / residual.num_peaks );
+    }
+  }//for( loop over residuals )
+  
+  return chi2;
+}//double fit_energy_cal_poly_multi_file(...)
+
+
 double EnergyCal::fit_poly_from_channel_energies( const size_t ncoeffs,
                                              const std::vector<float> &channel_energies,
                                              std::vector<float> &coefs )
@@ -1051,6 +1301,164 @@ EnergyCal::propogate_energy_cal_change( const shared_ptr<const SpecUtils::Energy
 }//propogate_energy_cal_change(...)
 
 
+vector<shared_ptr<const SpecUtils::EnergyCalibration>>
+EnergyCal::propogate_energy_cal_changes( const shared_ptr<const SpecUtils::EnergyCalibration> &orig_cal,
+                   const shared_ptr<const SpecUtils::EnergyCalibration> &new_cal,
+                   const vector<shared_ptr<const SpecUtils::EnergyCalibration>> &other_cals,
+                   const bool offset_only )
+{
+  using namespace SpecUtils;
+
+  if( !orig_cal || !new_cal || !orig_cal->valid() || !new_cal->valid() )
+    throw runtime_error( "EnergyCal::propogate_energy_cal_changes invalid input" );
+
+  // First find the unique calibrations, by value; for portal files there may be ~100k Measurement
+  //  objects, but usually only a handful of distinct calibrations.
+  map<shared_ptr<const EnergyCalibration>,size_t,EnergyCalValueLess> unique_index;
+  vector<shared_ptr<const EnergyCalibration>> unique_cals;
+  vector<size_t> input_to_unique( other_cals.size() );
+
+  for( size_t i = 0; i < other_cals.size(); ++i )
+  {
+    const shared_ptr<const EnergyCalibration> &cal = other_cals[i];
+    if( !cal || !cal->valid() )
+      throw runtime_error( "EnergyCal::propogate_energy_cal_changes: invalid calibration to update" );
+
+    // Check the previous entry first, as consecutive measurements usually share a calibration.
+    if( i && (cal == other_cals[i-1]) )
+    {
+      input_to_unique[i] = input_to_unique[i-1];
+      continue;
+    }
+
+    const auto pos = unique_index.find( cal );
+    if( pos != end(unique_index) )
+    {
+      input_to_unique[i] = pos->second;
+    }else
+    {
+      input_to_unique[i] = unique_cals.size();
+      unique_index[cal] = unique_cals.size();
+      unique_cals.push_back( cal );
+    }
+  }//for( size_t i = 0; i < other_cals.size(); ++i )
+
+  const EnergyCalValueLess value_less;
+  const auto same_as_orig = [&orig_cal,&value_less]( const shared_ptr<const EnergyCalibration> &cal ){
+    return (cal == orig_cal) || (!value_less(cal,orig_cal) && !value_less(orig_cal,cal));
+  };
+
+  vector<shared_ptr<const EnergyCalibration>> unique_answers( unique_cals.size() );
+  vector<string> errors( unique_cals.size() );
+
+  const auto compute_cal = [&]( const size_t index ){
+    try
+    {
+      const shared_ptr<const EnergyCalibration> &cal = unique_cals[index];
+      shared_ptr<const EnergyCalibration> answer;
+      if( same_as_orig(cal) )
+        answer = new_cal;
+      else if( offset_only )
+        answer = propogate_energy_cal_offset_change( orig_cal, new_cal, cal );
+      else
+        answer = propogate_energy_cal_change( orig_cal, new_cal, cal );
+
+      if( !answer || !answer->valid() )
+        throw runtime_error( "resulting calibration is invalid" );
+
+      unique_answers[index] = answer;
+    }catch( std::exception &e )
+    {
+      errors[index] = e.what();
+      if( errors[index].empty() )
+        errors[index] = "unknown error";
+    }//try / catch
+  };//compute_cal lambda
+
+  if( unique_cals.size() < 2 )
+  {
+    for( size_t i = 0; i < unique_cals.size(); ++i )
+      compute_cal( i );
+  }else
+  {
+    SpecUtilsAsync::ThreadPool pool;
+    for( size_t i = 0; i < unique_cals.size(); ++i )
+      pool.post( [i,&compute_cal](){ compute_cal( i ); } );
+    pool.join();
+  }//if( only a single calibration ) / else
+
+  for( const string &error : errors )
+  {
+    if( !error.empty() )
+      throw runtime_error( error );
+  }
+
+  vector<shared_ptr<const EnergyCalibration>> answer( other_cals.size() );
+  for( size_t i = 0; i < other_cals.size(); ++i )
+  {
+    assert( input_to_unique[i] < unique_answers.size() );
+    answer[i] = unique_answers[input_to_unique[i]];
+    assert( answer[i] && answer[i]->valid() );
+  }
+
+  return answer;
+}//propogate_energy_cal_changes(...)
+
+
+vector<deque<shared_ptr<const PeakDef>>>
+EnergyCal::translatePeaksForCalibrationChanges( const vector<EnergyCal::PeakCalTranslation> &translations )
+{
+  vector<deque<shared_ptr<const PeakDef>>> answer( translations.size() );
+  vector<string> errors( translations.size() );
+
+  const auto translate = [&translations,&answer,&errors]( const size_t index ){
+    const EnergyCal::PeakCalTranslation &input = translations[index];
+    if( !input.peaks || input.peaks->empty() )
+      return;
+
+    if( input.old_cal == input.new_cal )
+    {
+      answer[index] = *input.peaks;
+      return;
+    }
+
+    try
+    {
+      answer[index] = translatePeaksForCalibrationChange( *input.peaks, input.old_cal, input.new_cal );
+    }catch( std::exception &e )
+    {
+      errors[index] = e.what();
+      if( errors[index].empty() )
+        errors[index] = "unknown error";
+    }
+  };//translate lambda
+
+  size_t num_to_translate = 0;
+  for( const EnergyCal::PeakCalTranslation &input : translations )
+    num_to_translate += (input.peaks && !input.peaks->empty() && (input.old_cal != input.new_cal));
+
+  if( num_to_translate < 2 )
+  {
+    for( size_t i = 0; i < translations.size(); ++i )
+      translate( i );
+  }else
+  {
+    SpecUtilsAsync::ThreadPool pool;
+    for( size_t i = 0; i < translations.size(); ++i )
+      pool.post( [i,&translate](){ translate( i ); } );
+    pool.join();
+  }//if( not worth using threads ) / else
+
+  for( const string &error : errors )
+  {
+    if( !error.empty() )
+      throw runtime_error( error );
+  }
+
+  return answer;
+}//translatePeaksForCalibrationChanges(...)
+
+
 
 std::shared_ptr<SpecUtils::EnergyCalibration>
 EnergyCal::energy_cal_from_CALp_file( std::istream &input, const size_t num_channels,
@@ -36,6 +36,7 @@
 #include <Wt/WPushButton>
 
 
+#include "InterSpec/PeakFit.h"
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/PeakModel.h"
 #include "InterSpec/EnergyCal.h"
@@ -44,6 +45,7 @@
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/StringAlgo.h"
 #include "InterSpec/ReactionGamma.h"
+#include "SpecUtils/SpecUtilsAsync.h"
 #include "SandiaDecay/SandiaDecay.h"
 #include "InterSpec/EnergyCalTool.h"
 #include "InterSpec/SpecMeasManager.h"
@@ -179,8 +181,12 @@ EnergyCalMultiFile::EnergyCalMultiFile( EnergyCalTool *cal, AuxWindow *parent )
   m_cancel( nullptr ),
   m_fit( nullptr ),
   m_fitSumary( nullptr ),
+  m_refitPeaks( nullptr ),
+  m_fitFileOffsets( nullptr ),
   m_calVal(),
-  m_calUncert()
+  m_calUncert(),
+  m_devPairs(),
+  m_fileOffsets()
 {
   InterSpec *viewer = InterSpec::instance();
  
@@ -232,6 +238,15 @@ EnergyCalMultiFile::EnergyCalMultiFile( EnergyCalTool *cal, AuxWindow *parent )
     fitForLayout->addWidget( fitcb,   i, 2 );
   }//for( int i = 0; i < sm_numCoefs; ++i )
   
+  m_refitPeaks = new WCheckBox( "Refit peaks first" );
+  m_refitPeaks->setToolTip( "Refit the selected peaks in each file, before fitting the calibration;"
+                            " the peaks saved in the files are not changed." );
+  fitForLayout->addWidget( m_refitPeaks, static_cast<int>(ns_min_num_coef), 0, 1, 2 );
+  
+  m_fitFileOffsets = new WCheckBox( "Fit offset per file" );
+  m_fitFileOffsets->setToolTip( "Fit an additional offset for each file, relative to the first file"
+                                " with selected peaks." );
+  fitForLayout->addWidget( m_fitFileOffsets, static_cast<int>(ns_min_num_coef) + 1, 0, 1, 2 );
                   
   fitForLayout->setColumnStretch( 1, 1 );
   
@@ -305,6 +320,137 @@ EnergyCalMultiFile::~EnergyCalMultiFile()
 }//~EnergyCalMultiFile()
 
 
+vector<vector<vector<shared_ptr<const PeakDef>>>> EnergyCalMultiFile::refitSelectedPeaks()
+{
+  typedef shared_ptr<const PeakDef> PeakPtr;
+  
+  const vector<vector<EnergyCalMultiFileModel::SamplesPeakInfo_t>> &data = m_model->m_data;
+  
+  vector<vector<vector<PeakPtr>>> answer( data.size() );
+  
+  // We'll parse the files, and sum the spectra, here in the main thread, and then just do the
+  //  fitting in parallel.
+  struct RoiToFit
+  {
+    size_t file_index, samples_index;
+    shared_ptr<const SpecUtils::Measurement> spectrum;
+    vector<PeakPtr> roi_peaks;
+    vector<PeakPtr> fit_peaks;
+  };//struct RoiToFit
+  
+  vector<RoiToFit> rois;
+  
+  for( size_t file_index = 0; file_index < data.size(); ++file_index )
+  {
+    const vector<EnergyCalMultiFileModel::SamplesPeakInfo_t> &samplesinfos = data[file_index];
+    answer[file_index].resize( samplesinfos.size() );
+    
+    for( size_t samples_index = 0; samples_index < samplesinfos.size(); ++samples_index )
+    {
+      const EnergyCalMultiFileModel::SamplesPeakInfo_t &samplesinfo = samplesinfos[samples_index];
+      const shared_ptr<SpectraFileHeader> &header = get<0>(samplesinfo);
+      const set<int> &samples = get<1>(samplesinfo);
+      const shared_ptr<const EnergyCalibration> &peakcal = get<2>(samplesinfo);
+      const vector<EnergyCalMultiFileModel::UsePeakInfo_t> &peakinfos = get<3>(samplesinfo);
+      
+      vector<PeakPtr> &result_peaks = answer[file_index][samples_index];
+      for( const EnergyCalMultiFileModel::UsePeakInfo_t &info : peakinfos )
+        result_peaks.push_back( get<1>(info) );
+      
+      set<shared_ptr<const PeakContinuum>> used_conts;
+      for( const EnergyCalMultiFileModel::UsePeakInfo_t &info : peakinfos )
+      {
+        if( get<0>(info) && get<1>(info) && get<1>(info)->gausPeak() )
+          used_conts.insert( get<1>(info)->continuum() );
+      }
+      
+      if( used_conts.empty() || !header || !peakcal || !peakcal->valid() )
+        continue;
+      
+      shared_ptr<SpecMeas> spec;
+      shared_ptr<const SpecUtils::Measurement> spectrum;
+      try
+      {
+        spec = header->parseFile();
+        if( spec )
+          spectrum = spec->sum_measurements( samples, spec->gamma_detector_names(), peakcal );
+      }catch( std::exception &e )
+      {
+        cerr << "EnergyCalMultiFile::refitSelectedPeaks: failed to get spectrum: " << e.what() << endl;
+      }
+      
+      const auto allpeaks = spec ? spec->peaks( samples ) : nullptr;
+      if( !spectrum || !allpeaks )
+        continue;
+      
+      // We need all the peaks in a ROI, not just the ones used for calibration
+      for( const shared_ptr<const PeakContinuum> &cont : used_conts )
+      {
+        RoiToFit roi;
+        roi.file_index = file_index;
+        roi.samples_index = samples_index;
+        roi.spectrum = spectrum;
+        
+        bool all_gaus = true;
+        for( const PeakPtr &p : *allpeaks )
+        {
+          if( p && (p->continuum() == cont) )
+          {
+            all_gaus = (all_gaus && p->gausPeak());
+            roi.roi_peaks.push_back( p );
+          }
+        }//for( loop over all peaks )
+        
+        if( !all_gaus || roi.roi_peaks.empty() )
+          continue;
+        
+        std::sort( begin(roi.roi_peaks), end(roi.roi_peaks), &PeakDef::lessThanByMeanShrdPtr );
+        rois.push_back( std::move(roi) );
+      }//for( loop over ROIs to fit )
+    }//for( loop over sample sets )
+  }//for( loop over files )
+  
+  {//begin fit ROIs in parallel
+    SpecUtilsAsync::ThreadPool pool;
+    for( RoiToFit &roi : rois )
+    {
+      pool.post( [&roi](){
+        const shared_ptr<const DetectorPeakResponse> nodrf;
+        roi.fit_peaks = refitPeaksThatShareROI( roi.spectrum, nodrf, roi.roi_peaks, 0.25 );
+        if( roi.fit_peaks.size() != roi.roi_peaks.size() )
+          roi.fit_peaks.clear();
+        std::sort( begin(roi.fit_peaks), end(roi.fit_peaks), &PeakDef::lessThanByMeanShrdPtr );
+      } );
+    }//for( loop over ROIs )
+    pool.join();
+  }//end fit ROIs in parallel
+  
+  size_t nfailed = 0;
+  for( const RoiToFit &roi : rois )
+  {
+    if( roi.fit_peaks.empty() )
+    {
+      nfailed += 1;
+      continue;
+    }
+    
+    vector<PeakPtr> &result_peaks = answer[roi.file_index][roi.samples_index];
+    for( size_t i = 0; i < roi.roi_peaks.size(); ++i )
+    {
+      auto pos = std::find( begin(result_peaks), end(result_peaks), roi.roi_peaks[i] );
+      if( pos != end(result_peaks) )
+        *pos = roi.fit_peaks[i];
+    }
+  }//for( const RoiToFit &roi : rois )
+  
+  if( nfailed )
+    cerr << "EnergyCalMultiFile::refitSelectedPeaks: " << nfailed << " of " << rois.size()
+         << " ROIs failed to refit; using original peaks for them." << endl;
+  
+  return answer;
+}//refitSelectedPeaks()
+
+
 void EnergyCalMultiFile::doFit()
 {
   auto interspec = InterSpec::instance();
@@ -313,6 +459,7 @@ void EnergyCalMultiFile::doFit()
   m_calVal.clear();
   m_calUncert.clear();
   m_devPairs.clear();
+  m_fileOffsets.clear();
   
   shared_ptr<const SpecMeas> meas = interspec->measurment(SpectrumType::Foreground);
   shared_ptr<const Measurement> dispmeas = interspec->displayedHistogram(SpectrumType::Foreground);
@@ -328,27 +475,48 @@ void EnergyCalMultiFile::doFit()
   
   try
   {
+    const vector<vector<EnergyCalMultiFileModel::SamplesPeakInfo_t>> &data = m_model->m_data;
+    
+    // If wanted, refit the peaks; the refit peaks are only used here, and not set to the files.
+    vector<vector<vector<shared_ptr<const PeakDef>>>> refit_peaks;
+    if( m_refitPeaks->isChecked() )
+      refit_peaks = refitSelectedPeaks();
+    
     vector<EnergyCal::RecalPeakInfo> peakInfos;
+    vector<vector<EnergyCal::RecalPeakInfo>> filePeakInfos( data.size() );
     
-    for( const auto &samplesinfos : m_model->m_data )
+    for( size_t file_index = 0; file_index < data.size(); ++file_index )
     {
-      for( const EnergyCalMultiFileModel::SamplesPeakInfo_t &samplesinfo : samplesinfos )
+      const vector<EnergyCalMultiFileModel::SamplesPeakInfo_t> &samplesinfos = data[file_index];
+      
+      for( size_t samples_index = 0; samples_index < samplesinfos.size(); ++samples_index )
       {
+        const EnergyCalMultiFileModel::SamplesPeakInfo_t &samplesinfo = samplesinfos[samples_index];
         const shared_ptr<const SpecUtils::EnergyCalibration> &peakcal = get<2>(samplesinfo);
         const vector<EnergyCalMultiFileModel::UsePeakInfo_t> &peakinfos = get<3>(samplesinfo);
         
         if( !peakcal || !peakcal->valid() )
           continue;
         
-        for( const EnergyCalMultiFileModel::UsePeakInfo_t &info : peakinfos )
+        for( size_t peak_index = 0; peak_index < peakinfos.size(); ++peak_index )
         {
+          const EnergyCalMultiFileModel::UsePeakInfo_t &info = peakinfos[peak_index];
           const bool use = get<0>(info);
-          const shared_ptr<const PeakDef> &peakptr = get<1>(info);
+          shared_ptr<const PeakDef> peakptr = get<1>(info);
+          
+          if( !refit_peaks.empty() )
+          {
+            assert( refit_peaks.size() == data.size() );
+            assert( refit_peaks[file_index].size() == samplesinfos.size() );
+            assert( refit_peaks[file_index][samples_index].size() == peakinfos.size() );
+            peakptr = refit_peaks[file_index][samples_index][peak_index];
+          }
           
           if( use && peakptr )
           {
             const PeakDef &peak = *peakptr;
-            const double wantedEnergy = peak.gammaParticleEnergy();
+            // Use the photopeak energy from the original peak, incase refitting lost it.
+            const double wantedEnergy = get<1>(info)->gammaParticleEnergy();
             
             EnergyCal::RecalPeakInfo peakInfo;
             peakInfo.peakMean = peak.mean();
@@ -362,6 +530,7 @@ void EnergyCalMultiFile::doFit()
               throw runtime_error( "Invalid result from EnergyCalibration::channel_for_energy(...)" );
             
             peakInfos.push_back( peakInfo );
+            filePeakInfos[file_index].push_back( peakInfo );
           }//if( energy cal and peak ptrs are valid, and we should use this peak for fitting )
         }//for( loop over peaks for a file )
       }//for( int col = 0; col < numModelCol; ++col )
@@ -370,6 +539,7 @@ void EnergyCalMultiFile::doFit()
     const size_t npeaks = peakInfos.size();
     const size_t ncoeffs = m_fitFor.size();
     const size_t nchannel = disp_cal->num_channels();
+    const bool fit_offsets = m_fitFileOffsets->isChecked();
     
     int num_coeff_fit = 0;
     vector<bool> fitfor( ncoeffs, false );
@@ -379,6 +549,14 @@ void EnergyCalMultiFile::doFit()
       num_coeff_fit += m_fitFor[i]->isChecked();
     }
     
+    int num_offsets_fit = 0;
+    if( fit_offsets )
+    {
+      for( const vector<EnergyCal::RecalPeakInfo> &infos : filePeakInfos )
+        num_offsets_fit += !infos.empty();
+      num_offsets_fit = std::max( num_offsets_fit - 1, 0 );
+    }//if( fit_offsets )
+    
     if( num_coeff_fit < 1 )
     {
       const char *msg = "You must select at least one coefficient to fit for";
@@ -386,26 +564,29 @@ void EnergyCalMultiFile::doFit()
       return;
     }//if( num_coeff_fit < 1 )
     
-    if( num_coeff_fit > static_cast<int>(npeaks) )
+    if( (num_coeff_fit + num_offsets_fit) > static_cast<int>(npeaks) )
     {
-      const char *msg = "You must select at least as many peaks as coefficients to fit for";
+      const char *msg = (num_offsets_fit
+                         ? "You must select at least as many peaks as coefficients and file offsets to fit for"
+                         : "You must select at least as many peaks as coefficients to fit for");
       interspec->logMessage( msg, 3 );
       return;
     }//if( num_coeff_fit < 1 )
     
     
     bool fit_coefs = false;
+    vector<EnergyCal::MultiFileCalResidual> residuals;
     try
     {
       vector<float> lls_fit_coefs( ncoeffs, 0.0f ), lls_fit_coefs_uncert( ncoeffs, 0.0f );
       
-      const double chi2 = EnergyCal::fit_energy_cal_poly( peakInfos, fitfor,
-                                               disp_cal->num_channels(),
+      const double chi2 = EnergyCal::fit_energy_cal_poly_multi_file( filePeakInfos, fitfor,
+                                               fit_offsets, disp_cal->num_channels(),
                                                disp_cal->deviation_pairs(),
-                                              lls_fit_coefs, lls_fit_coefs_uncert );
+                                               lls_fit_coefs, lls_fit_coefs_uncert, residuals );
       
       stringstream msg;
-      msg << "\nfit_energy_cal_poly gave chi2=" << chi2 << " with coefs={";
+      msg << "\nfit_energy_cal_poly_multi_file gave chi2=" << chi2 << " with coefs={";
       for( size_t i = 0; i < lls_fit_coefs.size(); ++i )
         msg << lls_fit_coefs[i] << "+-" << lls_fit_coefs_uncert[i] << ", ";
       msg << "}\n";
@@ -415,15 +596,21 @@ void EnergyCalMultiFile::doFit()
       m_calVal = lls_fit_coefs;
       m_calUncert = lls_fit_coefs_uncert;
       m_devPairs = disp_cal->deviation_pairs();
+      
+      m_fileOffsets.resize( residuals.size(), 0.0 );
+      for( size_t i = 0; i < residuals.size(); ++i )
+        m_fileOffsets[i] = residuals[i].offset;
     }catch( std::exception &e )
     {
-      cerr << "fit_energy_cal_poly threw: " << e.what() << endl;
+      cerr << "fit_energy_cal_poly_multi_file threw: " << e.what() << endl;
 #if( PERFORM_DEVELOPER_CHECKS )
       char buffer[512] = { '\0' };
-      snprintf( buffer, sizeof(buffer)-1, "fit_energy_cal_poly threw: %s", e.what() );
+      snprintf( buffer, sizeof(buffer)-1, "fit_energy_cal_poly_multi_file threw: %s", e.what() );
       log_developer_error( __func__, buffer );
 #endif
       fit_coefs = false;
+      residuals.clear();
+      m_fileOffsets.clear();
     }//try / catch fit for coefficents using least linear squares
     
     
@@ -431,7 +618,7 @@ void EnergyCalMultiFile::doFit()
     {
       //This Minuit based fitting methodolgy is depreciated I think; the LLS code
       //  should work better, and seems to be releiabel, but leaving this code
-      //  in for a while as a backup
+      //  in for a while as a backup.  Note that per-file offsets are not fit for here.
       const auto &devpairs = disp_cal->deviation_pairs();
       vector<float> starting_coefs( ncoeffs, 0.0 );
       starting_coefs[1] = disp_cal->upper_energy() / disp_cal->num_channels();
@@ -442,6 +629,10 @@ void EnergyCalMultiFile::doFit()
                               SpecUtils::EnergyCalType::Polynomial, fitfor, starting_coefs,
                               devpairs, coefs, coefs_uncert, warning_msg );
       
+      if( fit_offsets )
+        warning_msg += string(warning_msg.empty() ? "" : " ")
+                       + "Per-file offsets could not be fit for; a single calibration was used.";
+      
       if( warning_msg.size() )
         interspec->logMessage( warning_msg, 3 );
       
@@ -461,17 +652,40 @@ void EnergyCalMultiFile::doFit()
     //Try to loop over peaks to give chi2 values and such
     //  \TODO: Put this information in the table (e.g., modify EnergyCalMultiFileModel to hold it)
     stringstream msg;
-    for( const EnergyCal::RecalPeakInfo &info : peakInfos )
+    for( size_t file_index = 0; file_index < filePeakInfos.size(); ++file_index )
     {
-      const double predictedMean = SpecUtils::polynomial_energy( info.peakMeanBinNumber, m_calVal, m_devPairs );
-      double uncert = ((info.peakMeanUncert<=0.0) ? 1.0 : info.peakMeanUncert );
-      double chi2 = pow(predictedMean - info.photopeakEnergy, 2.0 ) / (uncert*uncert);
-      
-      msg << "-Peak originally at " << info.peakMean << " +- "
-          << info.peakMeanUncert << " keV for photopeak at "
-          << info.photopeakEnergy << " keV ended up at " << predictedMean
-          << " keV and contributed " << chi2 << " towards the chi2.\n";
-    }//for( const &RecalPeakInfo info : peakInfo )
+      if( filePeakInfos[file_index].empty() )
+        continue;
+      
+      const double offset = (file_index < m_fileOffsets.size()) ? m_fileOffsets[file_index] : 0.0;
+      
+      if( file_index < residuals.size() )
+      {
+        const EnergyCal::MultiFileCalResidual &residual = residuals[file_index];
+        const auto &header = data[file_index].empty() ? nullptr : get<0>(data[file_index][0]);
+        const string filename = header ? header->displayName().toUTF8()
+                                       : ("File " + std::to_string(file_index));
+        
+        msg << "File '" << filename << "': " << residual.num_peaks << " peaks";
+        if( fit_offsets )
+          msg << ", offset " << residual.offset << " +- " << residual.offset_uncert << " keV";
+        msg << ", residuals mean=" << residual.mean_residual << ", rms=" << residual.rms_residual
+            << ", max=" << residual.max_abs_residual << " keV, chi2=" << residual.chi2 << ".\n";
+      }//if( we have residual info )
+      
+      for( const EnergyCal::RecalPeakInfo &info : filePeakInfos[file_index] )
+      {
+        const double predictedMean = offset
+                  + SpecUtils::polynomial_energy( info.peakMeanBinNumber, m_calVal, m_devPairs );
+        double uncert = ((info.peakMeanUncert<=0.0) ? 1.0 : info.peakMeanUncert );
+        double chi2 = pow(predictedMean - info.photopeakEnergy, 2.0 ) / (uncert*uncert);
+        
+        msg << "-Peak originally at " << info.peakMean << " +- "
+            << info.peakMeanUncert << " keV for photopeak at "
+            << info.photopeakEnergy << " keV ended up at " << predictedMean
+            << " keV and contributed " << chi2 << " towards the chi2.\n";
+      }//for( const &RecalPeakInfo info : peakInfo )
+    }//for( loop over files )
     
     m_fitSumary->setText( msg.str() );
     m_fitSumary->show();
@@ -575,6 +789,11 @@ void EnergyCalMultiFile::applyCurrentFit()
     if( !num_samples_used )
       continue;
     
+    // If we fit an offset for each file, apply it here.
+    vector<float> file_cal_coefs = m_calVal;
+    if( filenum < m_fileOffsets.size() )
+      file_cal_coefs[0] += static_cast<float>( m_fileOffsets[filenum] );
+    
     
     // We will apply the calibrations on a file-by-file level; this has the side-effect that if we
     //  do run into an issue, that one file wont pick up the change, but all other files will...
@@ -611,7 +830,7 @@ void EnergyCalMultiFile::applyCurrentFit()
         }else
         {
           auto cal = make_shared<EnergyCalibration>();
-          cal->set_polynomial( dispcal->num_channels(), m_calVal, m_devPairs );
+          cal->set_polynomial( dispcal->num_channels(), file_cal_coefs, m_devPairs );
           newcal = cal;
           calpos = updated_cals.insert( {dispcal, newcal} ).first;
         }
@@ -664,7 +883,7 @@ void EnergyCalMultiFile::applyCurrentFit()
           dispcal = oldcal;
         
         auto newdispcal = make_shared<EnergyCalibration>();
-        newdispcal->set_polynomial( oldcal->num_channels(), m_calVal, m_devPairs);
+        newdispcal->set_polynomial( oldcal->num_channels(), file_cal_coefs, m_devPairs);
         
         auto newcal = EnergyCal::propogate_energy_cal_change( dispcal, newdispcal, oldcal );
         updated_cals[oldcal] = newcal;
@@ -2153,23 +2153,31 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
   // Create a cache of modified calibration both to save time/memory, but also keep it so previous
   //  samples that share a energy calibration will continue to do so (if possible based on what user
   //  wanted calibration applied to).  Also, we wont set any new calibrations until we know all
-  //  updated calibrations and peaks are valid
-  //Note: we could take this oppritunity to share calibration across SpecFile objects by not just
-  //      comparing pointers, but also the actual EnergyCalibration object.  But for now we'll
-  //      skip this to avoid trouble, and it isnt clear that it would actually be overall beneficial
+  //  updated calibrations and peaks are valid.
+  //  Within a file, calibrations that are equal by value (not just pointer) are only computed once,
+  //  and will share the resulting calibration (see EnergyCal::propogate_energy_cal_changes); we
+  //  still dont share calibrations across SpecFile objects to avoid trouble.
   map<shared_ptr<const EnergyCalibration>,shared_ptr<const EnergyCalibration>> old_to_new_cals;
   
+  // The Measurements to update, for each entry of 'changemeas'; we'll collect these once, by
+  //  looping over the measurements of each file, rather than looking up each sample/detector
+  //  combination, which is slow for files with many thousands of samples.
+  vector<vector<shared_ptr<const SpecUtils::Measurement>>> meas_to_update( changemeas.size() );
+  
   // We will store updated peaks and not set any of them until we know all the energy calibrations
-  //  and peak shifts were successfully done.
-  map<shared_ptr<deque<shared_ptr<const PeakDef>>>,deque<shared_ptr<const PeakDef>>> updated_peaks;
+  //  and peak shifts were successfully done.  The peaks for all files are translated in a single
+  //  batch, after all the new calibrations are known.
+  vector<shared_ptr<deque<shared_ptr<const PeakDef>>>> peaks_to_translate;
+  vector<EnergyCal::PeakCalTranslation> peak_translations;
   
   // const vector<MeasToApplyCoefChangeTo> changemeas = measurementsToApplyCoeffChangeTo();
   
   //We will loop over the changes to apply twice.  Once to calculate new calibrations, and make sure
   //  they are valid, then a second time to actually set them.  If a new calibration is invalid,
   //  an exception will be thrown so we will catch that.
-  for( const MeasToApplyCoefChangeTo &change : changemeas )
+  for( size_t change_index = 0; change_index < changemeas.size(); ++change_index )
   {
+    const MeasToApplyCoefChangeTo &change = changemeas[change_index];
     assert( change.meas );
     
     string dbgmsg = "For '" + change.meas->filename() + "' will apply changes to Detectors: {";
@@ -2182,70 +2190,48 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
     cout << dbgmsg << endl;
     //wApp->log("app:debug") << dbgmsg;
     
+    vector<shared_ptr<const SpecUtils::Measurement>> &change_meas = meas_to_update[change_index];
+    vector<shared_ptr<const EnergyCalibration>> cals_to_compute;
+    
+    for( const shared_ptr<const SpecUtils::Measurement> &m : change.meas->measurements() )
+    {
+      if( !m || m->num_gamma_channels() <= 4 )
+        continue;
+      
+      if( !change.sample_numbers.count( m->sample_number() )
+          || !change.detectors.count( m->detector_name() ) )
+        continue;
+      
+      const auto meas_old_cal = m->energy_calibration();
+      assert( meas_old_cal );
+      
+      if( !meas_old_cal || !meas_old_cal->valid() )
+        continue;
+      
+      change_meas.push_back( m );
+      
+      //If we have already computed the new calibration for a EnergyCalibration object, lets not
+      //  re-due it.
+      if( old_to_new_cals.count(meas_old_cal) )
+        continue;
+      
+      // Mark as being computed; we'll fill in the value below
+      old_to_new_cals[meas_old_cal] = nullptr;
+      cals_to_compute.push_back( meas_old_cal );
+    }//for( loop over measurements of the file )
+    
     try
     {
-      for( const int sample : change.sample_numbers )
+      const vector<shared_ptr<const EnergyCalibration>> new_cals
+                           = EnergyCal::propogate_energy_cal_changes( disp_prev_cal, new_disp_cal,
+                                                                      cals_to_compute, isOffsetOnly );
+      assert( new_cals.size() == cals_to_compute.size() );
+      
+      for( size_t i = 0; i < cals_to_compute.size(); ++i )
       {
-        for( const string &detname : change.detectors )
-        {
-          auto m = change.meas->measurement( sample, detname );
-          if( !m || m->num_gamma_channels() <= 4 )
-            continue;
-          
-          const auto meas_old_cal = m->energy_calibration();
-          assert( meas_old_cal );
-          
-          if( !meas_old_cal || !meas_old_cal->valid() )
-            continue;
-          
-          //If we have already computed the new calibration for a EnergyCalibration object, lets not
-          //  re-due it.
-          if( old_to_new_cals.count(meas_old_cal) )
-            continue;
-          
-          shared_ptr<const SpecUtils::EnergyCalibration> new_meas_cal;
-          if( meas_old_cal == disp_prev_cal )
-          {
-            new_meas_cal = new_disp_cal;
-          }else if( isOffsetOnly )
-          {
-            const vector<float> &new_disp_coefs = new_disp_cal->coefficients();
-            const vector<float> &prev_disp_coefs = disp_prev_cal->coefficients();
-            const vector<pair<float,float>> &dev_pairs = meas_old_cal->deviation_pairs();
-            
-            vector<float> new_coefs = meas_old_cal->coefficients();
-            new_coefs[0] += (new_disp_coefs[0] - prev_disp_coefs[0]);
-            
-            auto cal = make_shared<EnergyCalibration>();
-            switch( meas_old_cal->type() )
-            {
-              case SpecUtils::EnergyCalType::Polynomial:
-              case SpecUtils::EnergyCalType::UnspecifiedUsingDefaultPolynomial:
-                cal->set_polynomial( meas_old_cal->num_channels(), new_coefs, dev_pairs );
-                break;
-                
-              case SpecUtils::EnergyCalType::FullRangeFraction:
-                cal->set_full_range_fraction( meas_old_cal->num_channels(), new_coefs, dev_pairs );
-                break;
-                
-              case SpecUtils::EnergyCalType::LowerChannelEdge:
-                cal->set_lower_channel_energy( meas_old_cal->num_channels(), new_coefs ); //eh, whatever
-                break;
-                
-              case SpecUtils::EnergyCalType::InvalidEquationType:
-                assert( 0 );
-                break;
-            }//switch( meas_old_cal->type() )
-            
-            new_meas_cal = cal;
-          }else
-          {
-            new_meas_cal = EnergyCal::propogate_energy_cal_change( disp_prev_cal, new_disp_cal, meas_old_cal );
-          }
-          assert( new_meas_cal && new_meas_cal->valid() );
-          old_to_new_cals[meas_old_cal] = new_meas_cal;
-        }//for( const string &detname : change.detectors )
-      }//for( loop over sample numbers )
+        assert( new_cals[i] && new_cals[i]->valid() );
+        old_to_new_cals[cals_to_compute[i]] = new_cals[i];
+      }
     }catch( std::exception &e )
     {
       string msg = "Calibration change made a energy calibration become invalid";
@@ -2266,8 +2252,8 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
     }//try catch
     
     
-    // Now go through and translate the peaks, but we wont actually update them to the SpecMeas
-    //  until we know we can update all the peaks
+    // Now go through and collect the peaks to translate, but we wont actually update them to the
+    //  SpecMeas until we know we can update all the peaks
     const set<set<int>> peaksamples = change.meas->sampleNumsWithPeaks();
     
     // The peaks position (i.e., mean channel number) is determined by
@@ -2333,24 +2319,37 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
         continue;
       }
       
-      try
-      {
-        auto newpeaks = EnergyCal::translatePeaksForCalibrationChange( *oldpeaks, oldcal, newcal );
-        updated_peaks[oldpeaks] = newpeaks;
-      }catch( std::exception &e )
-      {
-        string msg = "There was an issue translating peaks for this energy change;"
-        " not applying change.  Error: " + string(e.what());
-#if( PERFORM_DEVELOPER_CHECKS )
-        log_developer_error( __func__, msg.c_str() );
-#endif
-        
-        throw runtime_error( msg );
-      }//try / catch
+      EnergyCal::PeakCalTranslation translation;
+      translation.peaks = oldpeaks;
+      translation.old_cal = oldcal;
+      translation.new_cal = newcal;
       
+      peaks_to_translate.push_back( oldpeaks );
+      peak_translations.push_back( translation );
     }//for( const set<int> &samples : peaksampels )
   }//for( const MeasToApplyCoefChangeTo &change : changemeas )
   
+  map<shared_ptr<deque<shared_ptr<const PeakDef>>>,deque<shared_ptr<const PeakDef>>> updated_peaks;
+  
+  try
+  {
+    vector<deque<shared_ptr<const PeakDef>>> newpeaks
+                            = EnergyCal::translatePeaksForCalibrationChanges( peak_translations );
+    assert( newpeaks.size() == peaks_to_translate.size() );
+    
+    for( size_t i = 0; i < peaks_to_translate.size(); ++i )
+      updated_peaks[peaks_to_translate[i]] = std::move( newpeaks[i] );
+  }catch( std::exception &e )
+  {
+    string msg = "There was an issue translating peaks for this energy change;"
+    " not applying change.  Error: " + string(e.what());
+#if( PERFORM_DEVELOPER_CHECKS )
+    log_developer_error( __func__, msg.c_str() );
+#endif
+    
+    throw runtime_error( msg );
+  }//try / catch
+  
   if( old_to_new_cals.find(disp_prev_cal) == end(old_to_new_cals) )
   {
     //Shouldnt ever happen; check is for development
@@ -2371,41 +2370,35 @@ void EnergyCalTool::applyCalChange( std::shared_ptr<const SpecUtils::EnergyCalib
   
   // Now go through and actually set the energy calibrations; they should all be valid and computed,
   //  as should all the shifted peaks.
-  for( const MeasToApplyCoefChangeTo &change : changemeas )
+  for( size_t change_index = 0; change_index < changemeas.size(); ++change_index )
   {
+    const MeasToApplyCoefChangeTo &change = changemeas[change_index];
     assert( change.meas );
-    for( const int sample : change.sample_numbers )
+    
+    for( const shared_ptr<const SpecUtils::Measurement> &m : meas_to_update[change_index] )
     {
-      for( const string &detname : change.detectors )
+      const auto measoldcal = m->energy_calibration();
+      assert( measoldcal );
+      
+      auto iter = old_to_new_cals.find( measoldcal );
+      if( (iter == end(old_to_new_cals)) || !iter->second )
       {
-        auto m = change.meas->measurement( sample, detname );
-        if( !m || m->num_gamma_channels() <= 4 )
-          continue;
-        
-        const auto measoldcal = m->energy_calibration();
-        assert( measoldcal );
-        
-        auto iter = old_to_new_cals.find( measoldcal );
-        if( iter == end(old_to_new_cals) )
-        {
-          //Shouldnt ever happen
-          string msg = "There was an internal error updating energy calibration - precomputed"
-          " calibration couldnt be found - energy calibation will not be fully updated";
+        //Shouldnt ever happen
+        string msg = "There was an internal error updating energy calibration - precomputed"
+        " calibration couldnt be found - energy calibation will not be fully updated";
 #if( PERFORM_DEVELOPER_CHECKS )
-          log_developer_error( __func__, msg.c_str() );
+        log_developer_error( __func__, msg.c_str() );
 #endif
-          
-          m_interspec->logMessage( msg, 3 );
-          assert( 0 );
-          continue;
-        }//if( we havent already computed a new energy cal )
-        
-        assert( iter->second );
-        assert( iter->second->num_channels() == m->num_gamma_channels() );
         
-        change.meas->set_energy_calibration( iter->second, m );
-      }//for( loop over detector names )
-    }//for( loop over sample numbers )
+        m_interspec->logMessage( msg, 3 );
+        assert( 0 );
+        continue;
+      }//if( we havent already computed a new energy cal )
+      
+      assert( iter->second->num_channels() == m->num_gamma_channels() );
+      
+      change.meas->set_energy_calibration( iter->second, m );
+    }//for( loop over measurements to update )
     
     
     //Now actually set the updated peaks
@@ -0,0 +1,738 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include <boost/asio.hpp>
+#include <boost/process.hpp>
+#include <boost/filesystem.hpp>
+
+#include "InterSpec/ExternalRidWorkerPool.h"
+
+using namespace std;
+
+
+namespace
+{
+  const char * const ns_multipart_boundary = "InterSpec_MultipartBoundary_InterSpec";
+
+
+  struct HttpResponse
+  {
+    int status;
+    string body;
+  };//struct HttpResponse
+
+
+  /** Makes a HTTP/1.0 POST request to localhost; throws exception on connection error, or if the
+   response isnt fully received within 'timeout'.
+   */
+  HttpResponse http_post( const unsigned short port, const string &target,
+                          const string &content_type, const string &body,
+                          const std::chrono::milliseconds timeout )
+  {
+    namespace asio = boost::asio;
+
+    asio::io_context ioc;
+    asio::ip::tcp::socket socket( ioc );
+    const asio::ip::tcp::endpoint endpoint( asio::ip::address_v4::loopback(), port );
+
+    // We use HTTP/1.0 so the response wont be chunked, and the server closing the connection marks
+    //  the end of the response.
+    const string header = "POST " + target + " HTTP/1.0\r\n"
+                          "Host: 127.0.0.1:" + std::to_string(port) + "\r\n"
+                          "Content-Type: " + content_type + "\r\n"
+                          "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                          "Connection: close\r\n"
+                          "\r\n";
+
+    asio::streambuf response_buffer;
+    boost::system::error_code error;
+    bool finished = false;
+
+    socket.async_connect( endpoint, [&]( const boost::system::error_code &connect_ec ){
+      if( connect_ec )
+      {
+        error = connect_ec;
+        finished = true;
+        return;
+      }
+
+      const std::array<asio::const_buffer,2> buffers{ { asio::buffer(header), asio::buffer(body) } };
+      asio::async_write( socket, buffers, [&]( const boost::system::error_code &write_ec, size_t ){
+        if( write_ec )
+        {
+          error = write_ec;
+          finished = true;
+          return;
+        }
+
+        asio::async_read( socket, response_buffer, asio::transfer_all(),
+                          [&]( const boost::system::error_code &read_ec, size_t ){
+          if( read_ec != asio::error::eof )
+            error = read_ec;
+          finished = true;
+        } );
+      } );
+    } );
+
+    ioc.run_for( timeout );
+
+    if( !finished )
+      throw runtime_error( "no response within " + std::to_string(timeout.count()) + " ms" );
+
+    if( error )
+      throw runtime_error( error.message() );
+
+    const string response( asio::buffers_begin(response_buffer.data()),
+                           asio::buffers_end(response_buffer.data()) );
+
+    // Status line looks like "HTTP/1.1 200 OK"
+    HttpResponse answer;
+    const size_t status_pos = response.find( ' ' );
+    const size_t header_end = response.find( "\r\n\r\n" );
+    if( (response.compare( 0, 5, "HTTP/" ) != 0) || (status_pos == string::npos)
+       || (header_end == string::npos) || (status_pos > header_end) )
+      throw runtime_error( "invalid HTTP response" );
+
+    answer.status = atoi( response.c_str() + status_pos + 1 );
+    answer.body = response.substr( header_end + 4 );
+
+    return answer;
+  }//http_post(...)
+
+
+  /** Returns a port on localhost that nothing is currently listening on.
+
+   There is a small window between us closing the port, and the worker opening it, where something
+   else could grab it; if this happens the worker will exit during startup, and we'll try again
+   (with a new port) the next time a worker is needed.
+   */
+  unsigned short find_free_port()
+  {
+    namespace asio = boost::asio;
+
+    asio::io_context ioc;
+    asio::ip::tcp::acceptor acceptor( ioc,
+                                      asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0) );
+    return acceptor.local_endpoint().port();
+  }//unsigned short find_free_port()
+
+
+  string json_escape( const string &input )
+  {
+    string answer;
+    answer.reserve( input.size() + 2 );
+    for( const char c : input )
+    {
+      switch( c )
+      {
+        case '"':  answer += "\\\""; break;
+        case '\\': answer += "\\\\"; break;
+        case '\n': answer += "\\n";  break;
+        case '\r': answer += "\\r";  break;
+        case '\t': answer += "\\t";  break;
+        default:
+          if( static_cast<unsigned char>(c) < 0x20 )
+          {
+            char buffer[8];
+            snprintf( buffer, sizeof(buffer), "\\u%04x", static_cast<int>(c) );
+            answer += buffer;
+          }else
+          {
+            answer += c;
+          }
+      }//switch( c )
+    }//for( const char c : input )
+
+    return answer;
+  }//string json_escape( const string &input )
+
+  /** Thrown by the #ExternalRid::Worker constructor when the executable exits on its own before it
+   responds to a "/info" request.
+   */
+  struct WorkerExitedError : public std::runtime_error
+  {
+    explicit WorkerExitedError( const int exit_code )
+      : std::runtime_error( "exited during startup with code " + std::to_string(exit_code) ),
+        code( exit_code )
+    {
+    }
+
+    const int code;
+  };//struct WorkerExitedError
+
+
+  /** The number of times in a row the executable has to exit during startup, each time on a
+   different port, before we decide it doesnt support the web-service mode; a single exit could be
+   from losing the race for the port (see #find_free_port).
+   */
+  const size_t ns_exits_for_unsupported_mode = 2;
+
+  /** The most a failed worker start is backed off, as a multiple of #Options::startup_retry_delay. */
+  const size_t ns_max_retry_delay_multiple = 64;
+}//namespace
+
+
+namespace ExternalRid
+{
+/** A Full-Spectrum executable running in its web-service mode, listening on localhost.
+
+ The worker is started with "--mode=http-server --http-address=127.0.0.1 --http-port=<port>", and is
+ considered started once it successfully responds to a "/info" request.  Analyses are then
+ requested by POSTing to "/analysis" the same multipart form (an "options" JSON field, and a
+ "foreground" N42 file) as the REST service receives from #RestRidInputResource.
+ */
+class Worker
+{
+public:
+  /** Starts the executable, and waits for it to respond to a "/info" request.
+
+   Throws exception if executable fails to start, doesnt respond within 'timeout', or 'abort'
+   becomes true; throws #WorkerExitedError if the executable exits on its own before responding.
+   */
+  Worker( const string &exe, const std::chrono::seconds timeout, const std::atomic<bool> &abort )
+    : m_exe( exe ),
+      m_port( find_free_port() ),
+      m_broken( false ),
+      m_last_used( std::chrono::steady_clock::now() )
+  {
+    namespace bp = boost::process;
+
+    const auto pp = boost::filesystem::path(exe).parent_path();
+    const vector<string> args{ "--mode=http-server", "--http-address=127.0.0.1",
+                               "--http-port=" + std::to_string(m_port) };
+
+#ifdef _WIN32
+    m_child.reset( new bp::child( exe, bp::args(args), bp::start_dir(pp), bp::std_in < bp::null,
+                                  bp::std_out > bp::null, bp::std_err > bp::null,
+                                  bp::windows::create_no_window ) );
+#else
+    m_child.reset( new bp::child( exe, bp::args(args), bp::start_dir(pp), bp::std_in < bp::null,
+                                  bp::std_out > bp::null, bp::std_err > bp::null ) );
+#endif
+
+    try
+    {
+      const auto give_up_time = std::chrono::steady_clock::now() + timeout;
+
+      while( true )
+      {
+        if( abort )
+          throw runtime_error( "shutting down" );
+
+        std::error_code ec;
+        if( !m_child->running( ec ) )
+          throw WorkerExitedError( m_child->exit_code() );
+
+        // The connection will be refused until the worker has loaded and is listening
+        HttpResponse response;
+        bool connected = false;
+        try
+        {
+          response = http_post( m_port, "/info", "application/json", "",
+                                std::chrono::milliseconds(1000) );
+          connected = true;
+        }catch( std::exception & )
+        {
+        }
+
+        if( connected )
+        {
+          if( response.status != 200 )
+            throw runtime_error( "\"/info\" request returned HTTP status "
+                                 + std::to_string(response.status) );
+          break;
+        }//if( connected )
+
+        if( std::chrono::steady_clock::now() > give_up_time )
+          throw runtime_error( "didnt respond within " + std::to_string(timeout.count())
+                               + " seconds" );
+
+        std::this_thread::sleep_for( std::chrono::milliseconds(100) );
+      }//while( true )
+    }catch( std::exception & )
+    {
+      std::error_code ec;
+      m_child->terminate( ec );
+      throw;
+    }//try / catch
+  }//Worker constructor
+
+
+  ~Worker()
+  {
+    std::error_code ec;
+    if( m_child && m_child->running( ec ) )
+      m_child->terminate( ec );
+  }//~Worker()
+
+
+  /** Sends the analysis request to the worker, and returns the JSON results.
+
+   Throws exception if the worker reports an error, or if there is a communication error or the
+   results arent received within 'timeout'; in the latter two cases the worker is terminated, and
+   #broken will return true.
+   */
+  string analyze( const AnalysisRequest &request, const std::chrono::seconds timeout )
+  {
+    if( m_broken )
+      throw runtime_error( "External RID worker is no longer running." );
+
+    string n42_content;
+    {//begin read spectrum file
+      ifstream input( request.spectrum_file.c_str(), ios::in | ios::binary );
+      if( !input.is_open() )
+        throw runtime_error( "Could not open '" + request.spectrum_file + "' for analysis." );
+      n42_content.assign( std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>() );
+    }//end read spectrum file
+
+    string options = "{\"drf\": \"" + json_escape(request.drf) + "\"";
+    if( request.synthesize_background )
+      options += ", \"synthesizeBackground\": true";
+    options += "}";
+
+    const string boundary = ns_multipart_boundary;
+    const string body =
+    "--" + boundary
+    + "\r\nContent-Disposition: form-data; name=\"options\""
+    + "\r\nContent-type: application/octet-stream"
+    + "\r\n\r\n" + options + "\r\n"
+    + "--" + boundary
+    + "\r\nContent-Disposition: form-data; name=\"foreground\"; filename=\"spectrum.n42\""
+    + "\r\nContent-type: application/octet-stream"
+    + "\r\n\r\n" + n42_content + "\r\n"
+    + "--" + boundary + "--\r\n";
+
+    HttpResponse response;
+    try
+    {
+      response = post( "/analysis", "multipart/form-data; boundary=" + boundary, body, timeout );
+    }catch( std::exception &e )
+    {
+      throw runtime_error( "Error communicating with external RID worker: " + string(e.what()) );
+    }
+
+    if( response.status != 200 )
+      throw runtime_error( response.body.empty()
+                           ? ("External RID worker returned HTTP status "
+                              + std::to_string(response.status))
+                           : response.body );
+
+    return response.body;
+  }//string analyze(...)
+
+
+  /** Returns if the worker process is still running, and, if it has been idle for a while, that it
+   still responds to a "/info" request.
+   */
+  bool isHealthy( const std::chrono::seconds ping_after_idle, const std::chrono::seconds timeout )
+  {
+    std::error_code ec;
+    if( m_broken || !m_child || !m_child->running(ec) )
+      return false;
+
+    if( (std::chrono::steady_clock::now() - m_last_used) < ping_after_idle )
+      return true;
+
+    try
+    {
+      return (post( "/info", "application/json", "", timeout ).status == 200);
+    }catch( std::exception & )
+    {
+    }
+
+    return false;
+  }//bool isHealthy(...)
+
+
+  const string &exe() const { return m_exe; }
+  bool broken() const { return m_broken; }
+  std::chrono::steady_clock::time_point lastUsed() const { return m_last_used; }
+
+protected:
+  /** Makes the request, marking the worker as broken, and terminating it, on failure. */
+  HttpResponse post( const string &target, const string &content_type, const string &body,
+                     const std::chrono::seconds timeout )
+  {
+    try
+    {
+      HttpResponse response = http_post( m_port, target, content_type, body, timeout );
+      m_last_used = std::chrono::steady_clock::now();
+      return response;
+    }catch( std::exception & )
+    {
+      m_broken = true;
+      std::error_code ec;
+      m_child->terminate( ec );
+      throw;
+    }//try / catch
+  }//HttpResponse post(...)
+
+
+  const string m_exe;
+  const unsigned short m_port;
+  bool m_broken;
+  std::chrono::steady_clock::time_point m_last_used;
+  std::unique_ptr<boost::process::child> m_child;
+};//class Worker
+
+
+AnalysisRequest::AnalysisRequest()
+  : spectrum_file(),
+    drf(),
+    synthesize_background( false )
+{
+}
+
+
+vector<string> command_line_arguments( const AnalysisRequest &request )
+{
+  vector<string> arguments;
+  arguments.push_back( "--mode=command-line" );
+  arguments.push_back( "--out-format=json" );
+  arguments.push_back( "--drf" );
+  arguments.push_back( request.drf );
+
+  if( request.synthesize_background )
+    arguments.push_back( "--synthesize-background=1" );
+
+  arguments.push_back( request.spectrum_file );
+
+  return arguments;
+}//command_line_arguments(...)
+
+
+string run_command( const string &exe, const vector<string> &args,
+                    const std::chrono::seconds timeout )
+{
+  namespace bp = boost::process;
+
+  const auto pp = boost::filesystem::path(exe).parent_path();
+
+  // We read stdout/stderr asynchronously so a process writing a lot of output cant block on a full
+  //  pipe, and so we can give up on it after 'timeout'.
+  boost::asio::io_context ioc;
+  std::future<string> proc_stdout, proc_stderr;
+
+#ifdef _WIN32
+  bp::child c( exe, bp::args(args), bp::start_dir(pp), bp::std_in < bp::null,
+               bp::std_out > proc_stdout, bp::std_err > proc_stderr, ioc,
+               bp::windows::create_no_window );
+#else
+  bp::child c( exe, bp::args(args), bp::start_dir(pp), bp::std_in < bp::null,
+               bp::std_out > proc_stdout, bp::std_err > proc_stderr, ioc );
+#endif
+
+  ioc.run_for( timeout );
+
+  if( !ioc.stopped() )
+  {
+    std::error_code ec;
+    c.terminate( ec );
+    throw runtime_error( "External RID executable didnt finish within "
+                         + std::to_string(timeout.count()) + " seconds." );
+  }//if( !ioc.stopped() )
+
+  c.wait();
+
+  const string output = proc_stdout.get();
+  const string error = proc_stderr.get();
+  const int result = c.exit_code();
+
+  // Throw exception only if return code is not success, and either there is some error output,
+  //  or no stdout
+  if( (result != EXIT_SUCCESS) && (error.size() || output.empty()) )
+    throw runtime_error( error );
+
+  return output;
+}//run_command(...)
+
+
+WorkerPool::Options::Options()
+  : max_concurrent( 4 ),
+    startup_timeout( 30 ),
+    analysis_timeout( 120 ),
+    ping_after_idle( 60 ),
+    ping_timeout( 5 ),
+    shutdown_after_idle( 15*60 ),
+    startup_retry_delay( 5 )
+{
+}
+
+
+WorkerPool &WorkerPool::instance()
+{
+  static WorkerPool s_pool{ Options() };
+  return s_pool;
+}
+
+
+WorkerPool::WorkerPool( const Options &options )
+  : m_options( options ),
+    m_shutting_down( false ),
+    m_num_running( 0 )
+{
+}
+
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_shutting_down = true;
+  }
+
+  for( StarterThread &starter : m_starter_threads )
+  {
+    if( starter.thread.joinable() )
+      starter.thread.join();
+  }
+}//~WorkerPool()
+
+
+string WorkerPool::analyze( const string &exe, const AnalysisRequest &request )
+{
+  std::unique_ptr<Worker> worker;
+
+  {//begin lock on m_mutex
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_cv.wait( lock, [this](){ return m_num_running < m_options.max_concurrent; } );
+    ++m_num_running;
+
+    worker = takeIdleWorker( exe );
+  }//end lock on m_mutex
+
+  // Make sure we give back our slot, no matter how we exit this function
+  struct SlotReleaser
+  {
+    WorkerPool *m_pool;
+    ~SlotReleaser()
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_pool->m_mutex );
+        --m_pool->m_num_running;
+      }
+      m_pool->m_cv.notify_one();
+    }
+  } slot_releaser{ this };
+
+  if( worker && !worker->isHealthy( m_options.ping_after_idle, m_options.ping_timeout ) )
+    worker.reset();
+
+  if( !worker )
+  {
+    // Dont make the user wait on a worker to start; run this analysis as its own process, and have
+    //  a worker ready for next time.
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      startWorker( exe );
+    }
+
+    return run_command( exe, command_line_arguments(request), m_options.analysis_timeout );
+  }//if( !worker )
+
+  string result;
+  try
+  {
+    result = worker->analyze( request, m_options.analysis_timeout );
+  }catch( std::exception & )
+  {
+    // The worker reporting an analysis error doesnt mean it cant be used again
+    if( !worker->broken() )
+      returnToPool( std::move(worker) );
+    throw;
+  }//try / catch
+
+  returnToPool( std::move(worker) );
+
+  return result;
+}//string analyze(...)
+
+
+void WorkerPool::prestart( const string &exe )
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  for( const std::unique_ptr<Worker> &worker : m_idle )
+  {
+    if( worker->exe() == exe )
+      return;
+  }
+
+  startWorker( exe );
+}//void prestart( const string &exe )
+
+
+size_t WorkerPool::numIdleWorkers( const string &exe )
+{
+  std::lock_guard<std::mutex> lock( m_mutex );
+
+  size_t num_idle = 0;
+  for( const std::unique_ptr<Worker> &worker : m_idle )
+    num_idle += (worker->exe() == exe);
+
+  return num_idle;
+}//size_t numIdleWorkers( const string &exe )
+
+
+std::unique_ptr<Worker> WorkerPool::takeIdleWorker( const string &exe )
+{
+  std::unique_ptr<Worker> worker;
+
+  const auto now = std::chrono::steady_clock::now();
+  for( auto iter = begin(m_idle); iter != end(m_idle); )
+  {
+    if( !worker && ((*iter)->exe() == exe) )
+    {
+      worker = std::move( *iter );
+      iter = m_idle.erase( iter );
+    }else if( (now - (*iter)->lastUsed()) > m_options.shutdown_after_idle )
+    {
+      iter = m_idle.erase( iter );
+    }else
+    {
+      ++iter;
+    }
+  }//for( loop over idle workers )
+
+  return worker;
+}//std::unique_ptr<Worker> takeIdleWorker( const string &exe )
+
+
+void WorkerPool::startWorker( const string &exe )
+{
+  if( m_shutting_down || m_exes_starting.count(exe) || m_exes_without_worker_mode.count(exe) )
+    return;
+
+  const auto failures = m_start_failures.find( exe );
+  if( (failures != end(m_start_failures))
+     && (std::chrono::steady_clock::now() < failures->second.retry_after) )
+    return;
+
+  // Clean up threads from previous worker starts
+  for( auto iter = begin(m_starter_threads); iter != end(m_starter_threads); )
+  {
+    if( *iter->done )
+    {
+      iter->thread.join();
+      iter = m_starter_threads.erase( iter );
+    }else
+    {
+      ++iter;
+    }
+  }//for( loop over m_starter_threads )
+
+  m_exes_starting.insert( exe );
+
+  auto done = std::make_shared<std::atomic<bool>>( false );
+
+  std::thread starter( [this,exe,done](){
+    std::unique_ptr<Worker> worker;
+    string error_msg;
+    bool exited = false;
+
+    try
+    {
+      worker.reset( new Worker( exe, m_options.startup_timeout, m_shutting_down ) );
+    }catch( WorkerExitedError &e )
+    {
+      exited = true;
+      error_msg = e.what();
+    }catch( std::exception &e )
+    {
+      error_msg = e.what();
+    }
+
+    {//begin lock on m_mutex
+      std::lock_guard<std::mutex> lock( m_mutex );
+      m_exes_starting.erase( exe );
+
+      if( !m_shutting_down )
+      {
+        if( worker )
+        {
+          m_start_failures.erase( exe );
+          if( m_idle.size() < m_options.max_concurrent )
+            m_idle.push_back( std::move(worker) );
+        }else
+        {
+          StartFailures &failures = m_start_failures[exe];
+          failures.num_failures += 1;
+          failures.num_exits = exited ? (failures.num_exits + 1) : 0;
+
+          if( failures.num_exits >= ns_exits_for_unsupported_mode )
+          {
+            cerr << "External RID executable '" << exe << "' could not be started as a service ("
+                 << error_msg << "); will start a new process for each analysis." << endl;
+            m_exes_without_worker_mode.insert( exe );
+            m_start_failures.erase( exe );
+          }else
+          {
+            // Back off exponentially, in case the failure is from the system being busy, or the
+            //  executable taking longer than usual to load.
+            const size_t multiple = std::min( size_t(1) << std::min( failures.num_failures - 1, size_t(16) ),
+                                              ns_max_retry_delay_multiple );
+            const std::chrono::seconds delay = m_options.startup_retry_delay * static_cast<int>(multiple);
+            failures.retry_after = std::chrono::steady_clock::now() + delay;
+
+            cerr << "External RID executable '" << exe << "' failed to start as a service ("
+                 << error_msg << "); will try again in " << delay.count() << " seconds." << endl;
+          }//if( decided exe doesnt support service mode ) / else
+        }//if( worker ) / else
+      }//if( !m_shutting_down )
+    }//end lock on m_mutex
+
+    // If the worker didnt get added to the pool, it will be terminated here, outside the lock.
+    worker.reset();
+    *done = true;
+  } );
+
+  m_starter_threads.push_back( StarterThread{ done, std::move(starter) } );
+}//void startWorker( const string &exe )
+
+
+void WorkerPool::returnToPool( std::unique_ptr<Worker> &&worker )
+{
+  // A worker we dont keep is terminated when this goes out of scope, after releasing the lock
+  std::unique_ptr<Worker> extra_worker;
+
+  {
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if( !m_shutting_down && (m_idle.size() < m_options.max_concurrent) )
+      m_idle.push_back( std::move(worker) );
+    else
+      extra_worker = std::move( worker );
+  }
+}//void returnToPool(...)
+
+}//namespace ExternalRid
@@ -64,10 +64,12 @@
 #include "SpecUtils/StringAlgo.h"
 #include "InterSpec/MaterialDB.h"
 #include "InterSpec/InterSpecApp.h"
+#include "InterSpec/BatemanTable.h"
 #include "InterSpec/WarningWidget.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "SandiaDecay/SandiaDecay.h"
 #include "SpecUtils/SpecUtilsAsync.h"
+#include "InterSpec/BackgroundPeakCache.h"
 #include "InterSpec/MassAttenuationTool.h"
 #include "InterSpec/DecayDataBaseServer.h"
 #include "InterSpec/DetectorPeakResponse.h"
@@ -221,9 +223,11 @@ double transmission_coefficient_air( float energy, float length )
 //  gives you the probability a gamma of given energy will go through the
 //  material with given atomic number and areal_density.
 //  The quantity retuned by this function is commonly labeled μ
+//  Fractional atomic numbers are smoothly interpolated (see
+//  MassAttenuation::massAttenuationCoeficientSmoothAN), so atomic number can be fit for.
 double mass_attenuation_coef( float atomic_number, float energy )
 {
-  const double xs_per_mass = MassAttenuation::massAttenuationCoeficient( atomic_number, energy );
+  const double xs_per_mass = MassAttenuation::massAttenuationCoeficientSmoothAN( atomic_number, energy );
   
   return xs_per_mass;
 }
@@ -2543,7 +2547,7 @@ ShieldingSourceChi2Fcn::ShieldingSourceChi2Fcn(
                                  const GeometryType geometry,
                                  const bool allowMultipleNucsContribToPeaks,
                                  const bool attenuateForAir )
-  : ROOT::Minuit2::FCNBase(),
+  : ROOT::Minuit2::FCNGradientBase(),
     m_cancel( CalcStatus::NotCanceled ),
     m_isFitting( false ),
     m_distance( distance ),
@@ -2713,6 +2717,12 @@ void ShieldingSourceChi2Fcn::setSelfAttMultiThread( const bool do_multithread )
 {
   m_self_att_multithread = do_multithread;
 }
+
+
+void ShieldingSourceChi2Fcn::setFixedParameters( const std::vector<bool> &fixed )
+{
+  m_fixedParameters = fixed;
+}
   
 const SandiaDecay::Nuclide *ShieldingSourceChi2Fcn::nuclide( const int nuc ) const
 {
@@ -2735,12 +2745,14 @@ ShieldingSourceChi2Fcn &ShieldingSourceChi2Fcn::operator=( const ShieldingSource
   m_liveTime = rhs.m_liveTime;
   m_photopeakClusterSigma = rhs.m_photopeakClusterSigma;
   m_peaks = rhs.m_peaks;
+  m_background = rhs.m_background;
   m_detector = rhs.m_detector;
   m_materials = rhs.m_materials;
   m_nuclides = rhs.m_nuclides;
   m_allowMultipleNucsContribToPeaks = rhs.m_allowMultipleNucsContribToPeaks;
   m_nuclidesToFitMassFractionFor    = rhs.m_nuclidesToFitMassFractionFor;
   m_self_att_multithread = rhs.m_self_att_multithread;
+  m_fixedParameters = rhs.m_fixedParameters;
   
   //m_isFitting
   //m_guiUpdateInfo
@@ -3966,7 +3978,7 @@ ShieldingSourceChi2Fcn::CancelException::CancelException( const ShieldingSourceC
 }
 
 
-double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
+void ShieldingSourceChi2Fcn::throwIfCancelled() const
 {
   const CalcStatus cancelCode = m_cancel.load();
   switch( cancelCode )
@@ -3983,6 +3995,23 @@ double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
       throw CancelException( cancelCode );
       break;
   }//switch( m_cancel.load() )
+}//void throwIfCancelled() const
+
+
+double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
+{
+  const double chi2 = evaluateChi2( x );
+  
+  if( m_isFitting && m_guiUpdateInfo && (chi2 != std::numeric_limits<double>::max()) )
+    m_guiUpdateInfo->completed_eval( chi2, x );
+  
+  return chi2;
+}//double DoEval( const std::vector<double> &x ) const
+
+
+double ShieldingSourceChi2Fcn::evaluateChi2( const std::vector<double> &x ) const
+{
+  throwIfCancelled();
 
   try
   {
@@ -4007,9 +4036,6 @@ double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
     for( size_t i = 0; i < npoints; ++i )
       chi2 += pow( std::get<1>(chi2s[i]), 2.0 );
     
-    if( m_isFitting && m_guiUpdateInfo )
-      m_guiUpdateInfo->completed_eval( chi2, x );
-    
     //cout << "Returning chi2=" << chi2 << " for {" ;
     //for( size_t i = 0; i < x.size(); ++i )
     //  cout << (i ? "," : "") << x[i];
@@ -4021,7 +4047,398 @@ double ShieldingSourceChi2Fcn::DoEval( const std::vector<double> &x ) const
   }
 
   return std::numeric_limits<double>::max();
-}//double DoEval( const std::vector<double> &x ) const
+}//double evaluateChi2( const std::vector<double> &x ) const
+
+
+bool ShieldingSourceChi2Fcn::CheckGradient() const
+{
+  return false;
+}//bool CheckGradient() const
+
+
+size_t ShieldingSourceChi2Fcn::ageParameterIndex( const size_t nuc_index,
+                                                  const std::vector<double> &x ) const
+{
+  const size_t npars = x.size();
+  
+  // See #age for how the age parameters are interpreted
+  size_t index = 2*nuc_index + 1;
+  if( index >= npars )
+    return npars;
+  
+  if( x[index] < -0.00001 )
+  {
+    const int nearFIndex = static_cast<int>( std::round( -1.0*x[index] ) );
+    if( nearFIndex < 1 )
+      return npars;
+    
+    index = 2*static_cast<size_t>(nearFIndex - 1) + 1;
+    if( index >= npars )
+      return npars;
+  }//if( the age is defined by another nuclide )
+  
+  // Ages are clamped to be non-negative
+  return (x[index] >= 0.0) ? index : npars;
+}//size_t ageParameterIndex(...)
+
+
+bool ShieldingSourceChi2Fcn::parameterAffectsVolumetricSources( const size_t par_index,
+                                                                const std::vector<double> &x ) const
+{
+  bool has_volumetric = false;
+  for( const ShieldingInfo &shield : m_materials )
+    has_volumetric |= (!shield.self_atten_sources.empty() || !shield.trace_sources.empty());
+  
+  if( !has_volumetric )
+    return false;
+  
+  const size_t nnucs = m_nuclides.size();
+  
+  if( par_index < 2*nnucs )
+  {
+    // Activity parameters are either not used (self-attenuating sources), or are handled
+    //  analytically (trace sources)
+    if( (par_index % 2) == 0 )
+      return false;
+    
+    for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
+    {
+      if( isVolumetricSource( m_nuclides[nuc_index] )
+         && (ageParameterIndex( nuc_index, x ) == par_index) )
+        return true;
+    }//for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
+    
+    return false;
+  }//if( an activity or age parameter )
+  
+  // Mass fraction parameters come after all the shielding parameters
+  if( par_index >= (2*nnucs + 3*m_materials.size()) )
+    return true;
+  
+  const size_t material_index = (par_index - 2*nnucs) / 3;
+  const size_t sub_index = (par_index - 2*nnucs) % 3;
+  
+  // A generic shielding at the very center has zero volume, so is not used for volumetric sources
+  if( !m_materials[material_index].material )
+    return ((material_index > 0) && (sub_index < 2));
+  
+  switch( m_geometry )
+  {
+    case GeometryType::Spherical:
+      return (sub_index == 0);
+      
+    case GeometryType::CylinderEndOn:
+    case GeometryType::CylinderSideOn:
+      return (sub_index < 2);
+      
+    case GeometryType::Rectangular:
+      return true;
+      
+    case GeometryType::NumGeometryType:
+      assert( 0 );
+      break;
+  }//switch( m_geometry )
+  
+  return true;
+}//bool parameterAffectsVolumetricSources(...)
+
+
+std::vector<double> ShieldingSourceChi2Fcn::numericalGradient( const std::vector<double> &x ) const
+{
+  const size_t npars = x.size();
+  vector<double> gradient( npars, 0.0 );
+  vector<double> xstep = x;
+  
+  for( size_t i = 0; i < npars; ++i )
+  {
+    if( (i < m_fixedParameters.size()) && m_fixedParameters[i] )
+      continue;
+    
+    const double h = std::max( 1.0E-4*fabs(x[i]), 1.0E-6 );
+    
+    // We dont go through DoEval, so these probes arent reported to the GUI as fit evaluations
+    xstep[i] = x[i] + h;
+    const double upper = evaluateChi2( xstep );
+    xstep[i] = x[i] - h;
+    const double lower = evaluateChi2( xstep );
+    xstep[i] = x[i];
+    
+    // evaluateChi2 returns max double on error, in which case we'll leave the gradient as zero
+    if( (upper != std::numeric_limits<double>::max())
+       && (lower != std::numeric_limits<double>::max()) )
+      gradient[i] = (upper - lower) / (2.0*h);
+  }//for( size_t i = 0; i < npars; ++i )
+  
+  return gradient;
+}//std::vector<double> numericalGradient(...)
+
+
+namespace
+{
+/** Gives the observed counts of a peak, and their uncertainty, after subtracting the counts of any
+ background peaks within one sigma of it.
+ */
+void background_subtracted_counts( const PeakDef &peak,
+                                   const BackgroundPeakCache::BackgroundModel *background,
+                                   const double liveTime,
+                                   double &observed_counts, double &observed_uncertainty,
+                                   double &backCounts, double &backUncert2 )
+{
+  observed_counts = peak.peakArea();
+  observed_uncertainty = peak.peakAreaUncert();
+  backCounts = backUncert2 = 0.0;
+  const double nsigmaNear = 1.0;
+  
+  if( !background )
+    return;
+  
+  const double sigma = peak.gausPeak() ? peak.sigma() : 0.25*peak.roiWidth();
+  background->peakAreaNear( peak.mean(), nsigmaNear*sigma, liveTime, backCounts, backUncert2 );
+  
+  if( backCounts > 0.0 )
+  {
+    observed_counts -= backCounts;
+    observed_uncertainty = sqrt( observed_uncertainty*observed_uncertainty + backUncert2 );
+  }
+}//void background_subtracted_counts(...)
+
+
+/** Returns if the expected counts at 'energy' (one of the clustered peak energies) are attributed
+ to 'peak'.
+ */
+bool energy_contributes_to_peak( const double energy, const PeakDef &peak )
+{
+  const double sigma = peak.gausPeak() ? peak.sigma() : 0.25*peak.roiWidth();
+  return (fabs(energy - peak.gammaParticleEnergy()) < (0.1*sigma));
+}//bool energy_contributes_to_peak(...)
+
+
+/** Returns the distinct energies of the (sorted) results of
+ #ShieldingSourceChi2Fcn::observedPeakEnergyWidths; these are the energies expected counts are
+ computed at.
+ */
+vector<double> unique_peak_energies( const vector<pair<double,double>> &energie_widths )
+{
+  vector<double> energies;
+  for( const pair<double,double> &ew : energie_widths )
+  {
+    if( energies.empty() || (energies.back() != ew.first) )
+      energies.push_back( ew.first );
+  }
+  return energies;
+}//vector<double> unique_peak_energies(...)
+}//namespace
+
+
+std::vector<double> ShieldingSourceChi2Fcn::Gradient( const std::vector<double> &x ) const
+{
+  throwIfCancelled();
+  
+  typedef map<double,double> EnergyCountMap;
+  
+  try
+  {
+    const size_t npars = x.size();
+    if( npars != numExpectedFitParameters() )
+      throw runtime_error( "ShieldingSourceChi2Fcn::Gradient(...): invalid params size" );
+    
+    for( size_t i = 0; i < npars; ++i )
+    {
+      if( IsNan(x[i]) || IsInf(x[i]) )
+        throw runtime_error( "Invalid parameter (" + std::to_string(i) + ", "
+                            + std::to_string(x[i]) + ") passed to chi2 gradient" );
+    }//for( size_t i = 0; i < npars; ++i )
+    
+    if( m_mixtureCache.size() > sm_maxMixtureCacheSize )
+      m_mixtureCache.clear();
+    
+    const auto is_fixed = [this]( const size_t index ) -> bool {
+      return (index < m_fixedParameters.size()) && m_fixedParameters[index];
+    };
+    
+    const size_t nnucs = m_nuclides.size();
+    const vector<pair<double,double> > energie_widths = observedPeakEnergyWidths( m_peaks );
+    
+    // The energies expected counts are computed at, which are the fit peak energies
+    const vector<double> energies = unique_peak_energies( energie_widths );
+    const size_t nenergy = energies.size();
+    
+    const auto to_vector = [&energies,nenergy]( const EnergyCountMap &counts ) -> vector<double> {
+      vector<double> answer( nenergy, 0.0 );
+      for( size_t i = 0; i < nenergy; ++i )
+      {
+        const auto pos = counts.find( energies[i] );
+        if( pos != end(counts) )
+          answer[i] = pos->second;
+      }
+      return answer;
+    };//to_vector lambda
+    
+    // The expected counts (per unit live time) from point sources, and their derivatives; this is
+    //  the same computation #energy_chi_contributions uses
+    vector<double> expected;
+    vector<vector<double>> dexpected;
+    point_source_counts( x, energie_widths, energies, m_mixtureCache, expected, &dexpected, nullptr );
+    
+    
+    // Now the self-attenuating and trace sources
+    bool has_volumetric = false;
+    for( const ShieldingInfo &shield : m_materials )
+      has_volumetric |= (!shield.self_atten_sources.empty() || !shield.trace_sources.empty());
+    
+    if( has_volumetric )
+    {
+      EnergyCountMap volumetric_counts;
+      map<const SandiaDecay::Nuclide *,EnergyCountMap> per_nuclide_counts;
+      volumetric_source_activities( x, m_mixtureCache, energie_widths, volumetric_counts,
+                                    &per_nuclide_counts, nullptr );
+      
+      const vector<double> volumetric = to_vector( volumetric_counts );
+      for( size_t i = 0; i < nenergy; ++i )
+        expected[i] += volumetric[i];
+      
+      vector<size_t> step_pars;
+      for( size_t par_index = 0; par_index < npars; ++par_index )
+      {
+        if( !is_fixed(par_index) && parameterAffectsVolumetricSources(par_index, x) )
+          step_pars.push_back( par_index );
+      }
+      
+      // Counts are proportional to trace source activities
+      for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
+      {
+        const SandiaDecay::Nuclide * const nuc = m_nuclides[nuc_index];
+        const size_t act_index = 2*nuc_index;
+        if( is_fixed(act_index) || !isTraceSource(nuc) )
+          continue;
+        
+        if( x[act_index] == 0.0 )
+        {
+          step_pars.push_back( act_index );
+          continue;
+        }
+        
+        const vector<double> counts = to_vector( per_nuclide_counts[nuc] );
+        vector<double> &dact = dexpected[act_index];
+        dact.resize( nenergy, 0.0 );
+        for( size_t i = 0; i < nenergy; ++i )
+          dact[i] += counts[i] / x[act_index];
+      }//for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
+      
+      // For everything else, we will re-integrate the volumetric sources with the parameter
+      //  slightly changed.  The integrals use the same subdivision for small changes, so their
+      //  (1E-4 relative) integration error mostly cancels in the difference.
+      vector<double> xstep = x;
+      for( const size_t par_index : step_pars )
+      {
+        throwIfCancelled();
+        
+        double h = 0.0;
+        const size_t mat_par_start = 2*nnucs, mat_par_end = 2*nnucs + 3*m_materials.size();
+        if( par_index < mat_par_start )
+        {
+          if( (par_index % 2) == 0 )
+            h = 1.0;  //Counts are linear in activity, so step size doesnt matter
+          else
+            h = std::max( 1.0E-3*fabs(x[par_index]), 1.0E-6*m_nuclides[par_index/2]->halfLife );
+        }else if( par_index < mat_par_end )
+        {
+          const size_t material_index = (par_index - mat_par_start) / 3;
+          const size_t sub_index = (par_index - mat_par_start) % 3;
+          
+          if( m_materials[material_index].material )
+            h = std::max( 1.0E-3*fabs(x[par_index]), 1.0E-3*PhysicalUnits::mm );
+          else if( sub_index == 0 )
+            h = 0.01;
+          else
+            h = std::max( 1.0E-3*fabs(x[par_index]), 1.0E-4*PhysicalUnits::g/PhysicalUnits::cm2 );
+        }else
+        {
+          h = std::max( 1.0E-3*fabs(x[par_index]), 1.0E-5 );
+        }//if( activity or age ) / else if( shielding ) / else ( mass fraction )
+        
+        EnergyCountMap stepped_counts;
+        xstep[par_index] = x[par_index] + h;
+        try
+        {
+          volumetric_source_activities( xstep, m_mixtureCache, energie_widths, stepped_counts,
+                                        nullptr, nullptr );
+        }catch( std::exception & )
+        {
+          // We may have stepped to an invalid configuration (e.g., shielding past the detector),
+          //  so try stepping the other way.
+          h = -h;
+          stepped_counts.clear();
+          xstep[par_index] = x[par_index] + h;
+          volumetric_source_activities( xstep, m_mixtureCache, energie_widths, stepped_counts,
+                                        nullptr, nullptr );
+        }//try / catch
+        xstep[par_index] = x[par_index];
+        
+        const vector<double> stepped = to_vector( stepped_counts );
+        vector<double> &dpar = dexpected[par_index];
+        dpar.resize( nenergy, 0.0 );
+        for( size_t i = 0; i < nenergy; ++i )
+          dpar[i] += (stepped[i] - volumetric[i]) / h;
+      }//for( const size_t par_index : step_pars )
+    }//if( has_volumetric )
+    
+    
+    // Finally, chain the derivatives of the expected counts through the chi2 of each peak, using
+    //  the same background subtraction and peak matching as #expected_observed_chis
+    vector<double> gradient( npars, 0.0 );
+    vector<double> dchi2_dexpected( nenergy, 0.0 );
+    
+    for( const PeakDef &peak : m_peaks )
+    {
+      if( !peak.decayParticle() && (peak.sourceGammaType() != PeakDef::AnnihilationGamma) )
+        continue;
+      
+      double observed_counts, observed_uncertainty, backCounts, backUncert2;
+      background_subtracted_counts( peak, m_background.get(), m_liveTime, observed_counts,
+                                    observed_uncertainty, backCounts, backUncert2 );
+      
+      vector<size_t> energy_indexes;
+      double expected_counts = 0.0;
+      for( size_t i = 0; i < nenergy; ++i )
+      {
+        if( energy_contributes_to_peak( energies[i], peak ) )
+        {
+          energy_indexes.push_back( i );
+          expected_counts += m_liveTime * expected[i];
+        }
+      }//for( size_t i = 0; i < nenergy; ++i )
+      
+      const double chi = (observed_counts - expected_counts) / observed_uncertainty;
+      for( const size_t i : energy_indexes )
+        dchi2_dexpected[i] += -2.0 * chi * m_liveTime / observed_uncertainty;
+    }//for( const PeakDef &peak : m_peaks )
+    
+    for( size_t par_index = 0; par_index < npars; ++par_index )
+    {
+      const vector<double> &dpar = dexpected[par_index];
+      for( size_t i = 0; i < dpar.size(); ++i )
+        gradient[par_index] += dchi2_dexpected[i] * dpar[i];
+    }//for( size_t par_index = 0; par_index < npars; ++par_index )
+    
+    for( const double g : gradient )
+    {
+      if( IsNan(g) || IsInf(g) )
+        throw runtime_error( "Invalid gradient" );
+    }
+    
+    return gradient;
+  }catch( CancelException & )
+  {
+    throw;
+  }catch( std::exception &e )
+  {
+    cerr << "ShieldingSourceChi2Fcn::Gradient(...): " << e.what()
+         << "; will numerically differentiate instead." << endl;
+  }//try / catch
+  
+  return numericalGradient( x );
+}//std::vector<double> Gradient( const std::vector<double> &x ) const
 
 
 namespace
@@ -4043,14 +4460,6 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
                                                            const double energyToCluster,
                                                            vector<string> *info )
 {
-  typedef pair<double,double> DoublePair;
-
-  if( energy_count_map.empty() )
-  {
-    for( const DoublePair &dp : energie_widths )
-      energy_count_map[dp.first] = 0.0;
-  }//if( energy_count_map.empty() )
-
   if( info )
   {
     stringstream msg;
@@ -4087,30 +4496,57 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
   }//for( size_t i = 0; i < aged_activities.size(); ++i )
   
   
+  vector<pair<double,double>> line_yields;
+  line_yields.reserve( gammas.size() );
   for( const SandiaDecay::EnergyRatePair &aep : gammas )
+    line_yields.emplace_back( aep.energy, aep.numPerSecond * age_sf / sm_activityUnits );
+  
+  cluster_line_activities( energy_count_map, energie_widths, line_yields, act,
+                           photopeakClusterSigma, energyToCluster, info );
+}//cluster_peak_activities(...)
+
+
+void ShieldingSourceChi2Fcn::cluster_line_activities( std::map<double,double> &energy_count_map,
+                                         const std::vector< pair<double,double> > &energie_widths,
+                                         const std::vector< pair<double,double> > &line_yields,
+                                         const double act,
+                                         const double photopeakClusterSigma,
+                                         const double energyToCluster,
+                                         vector<string> *info )
+{
+  typedef pair<double,double> DoublePair;
+
+  if( energy_count_map.empty() )
   {
-    const pair<double,double> epair(aep.energy,0.0);
+    for( const DoublePair &dp : energie_widths )
+      energy_count_map[dp.first] = 0.0;
+  }//if( energy_count_map.empty() )
+
+  for( const pair<double,double> &line : line_yields )
+  {
+    const double line_energy = line.first;
+    const pair<double,double> epair(line_energy,0.0);
     vector< pair<double,double> >::const_iterator epos;
     epos = lower_bound( energie_widths.begin(), energie_widths.end(),
                         epair, &first_lessthan );
 
     if( photopeakClusterSigma<=0.0
-        && (epos==energie_widths.end() || epos->first!=aep.energy) )  //queezy double compare
+        && (epos==energie_widths.end() || epos->first!=line_energy) )  //queezy double compare
       continue;
 
     if( epos == energie_widths.end() )
     {
-      //aep.energy is larger than the largest fit peak energy
-      if( (aep.energy - energie_widths.back().first)
+      //line_energy is larger than the largest fit peak energy
+      if( (line_energy - energie_widths.back().first)
           > (energie_widths.back().second*photopeakClusterSigma) )
         continue;
       epos--;
-    }else if( epos == energie_widths.begin() && epos->first!=aep.energy ) //queezy double compare
+    }else if( epos == energie_widths.begin() && epos->first!=line_energy ) //queezy double compare
     {
-      //aep.energy is less than the largest fit peak energy
-      if( (epos->first - aep.energy) > (epos->second*photopeakClusterSigma) )
+      //line_energy is less than the largest fit peak energy
+      if( (epos->first - line_energy) > (epos->second*photopeakClusterSigma) )
         continue;
-    }else if( epos->first != aep.energy )
+    }else if( epos->first != line_energy )
     {
       //see if the nearest peaks are close enough; if so, assign to closest
       //  peak
@@ -4119,10 +4555,10 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
       const double prev_width = (epos-1)->second;
       const double prev_energy = (epos-1)->first;
 
-      const double prev_sigma = (aep.energy - prev_energy) / prev_width;
-      const double next_sigma = (next_energy - aep.energy) / next_width;
+      const double prev_sigma = (line_energy - prev_energy) / prev_width;
+      const double next_sigma = (next_energy - line_energy) / next_width;
 /*
-      cerr << "aep.energy=" << aep.energy << ", next_energy=" << next_energy
+      cerr << "line_energy=" << line_energy << ", next_energy=" << next_energy
            << ", next_width=" << next_width << ", prev_energy="
            << prev_energy << ", prev_width=" << prev_width << endl
            << "prev_sigma=" << prev_sigma << ", next_sigma=" << next_sigma
@@ -4132,14 +4568,14 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
       if( prev_sigma < next_sigma && prev_sigma < photopeakClusterSigma )
       {
         epos--;
-//          cout << "Assigning (prev) " << aep.energy << " to fit peak " << epos->first << endl << endl;
+//          cout << "Assigning (prev) " << line_energy << " to fit peak " << epos->first << endl << endl;
       }else if( next_sigma < photopeakClusterSigma )
       {
         //epos is already the correct value
-//          cout << "Assigning (next) " << aep.energy << " to fit peak " << epos->first << endl << endl;
+//          cout << "Assigning (next) " << line_energy << " to fit peak " << epos->first << endl << endl;
       }else
       {
-//          cout << "not assigning " << aep.energy << " to a fit photopeak" << endl << endl;
+//          cout << "not assigning " << line_energy << " to a fit photopeak" << endl << endl;
         continue;
       }
     }//if / else
@@ -4158,18 +4594,14 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
     {
       stringstream msg;
       msg << "There is a programming logic error in "
-             "ShieldingSourceChi2Fcn::cluster_peak_activities(...)"
+             "ShieldingSourceChi2Fcn::cluster_line_activities(...)"
              " which is keeping this activity/shielding fit from happening "
              "(place a) - please complain to Will Johnson about this";
       passMessage( msg.str(), WarningWidget::WarningMsgHigh );
       throw std::runtime_error( msg.str() );
     }//if( energy_count_map.count( energy ) == 0 )
 
-//    cerr << "Letting " << mixture.initialNuclide(0)->symbol << " contribute "
-//         << (aep.numPerSecond * act * age_sf / sm_activityUnits) << " counts to "
-//         << energy << " keV" << endl;
-    
-    const double contribution = aep.numPerSecond * act * age_sf / sm_activityUnits;
+    const double contribution = line.second * act;
     energy_count_map[energy] += contribution;
     
     if( info )
@@ -4177,11 +4609,11 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
       stringstream msg;
       msg << "\tPeak attributed to " << energy << " keV received "
           << contribution*PhysicalUnits::second
-          << " cps from " << aep.energy << " keV line, which has I="
-          << age_sf * aep.numPerSecond/sm_activityUnits << "";
+          << " cps from " << line_energy << " keV line, which has I="
+          << line.second << "";
       info->push_back( msg.str() );
     }//if( info )
-  }//for( const SandiaDecay::AbundanceEnergyPair &aep : gammas )
+  }//for( const pair<double,double> &line : line_yields )
 /*
   cout << "For " << nuclide->symbol << " unshielded " << endl;
   for( EnergyCountMap::value_type &energy_count : energy_count_map )
@@ -4190,12 +4622,14 @@ void ShieldingSourceChi2Fcn::cluster_peak_activities( std::map<double,double> &e
          << " rate=" << energy_count.second*PhysicalUnits::second << "/s"
          << endl;
 */
-}//cluster_peak_activities(...)
+}//cluster_line_activities(...)
+
 
 
 vector< tuple<double,double,double,Wt::WColor,double> > ShieldingSourceChi2Fcn::expected_observed_chis(
                                            const std::vector<PeakDef> &peaks,
-                                           const std::vector<PeakDef> &backPeaks,
+                                           const BackgroundPeakCache::BackgroundModel *background,
+                                           const double liveTime,
                                            const std::map<double,double> &energy_count_map,
                                            vector<string> *info )
 {
@@ -4218,22 +4652,9 @@ vector< tuple<double,double,double,Wt::WColor,double> > ShieldingSourceChi2Fcn::
     
     const double energy = peak.gammaParticleEnergy();
     
-    double observed_counts = peak.peakArea();
-    double observed_uncertainty = peak.peakAreaUncert();
-    double backCounts = 0.0, backUncert2 = 0.0;
-    const double nsigmaNear = 1.0;
-    
-    //XXX - this linear search is bad, and should be fixed
-    for( const PeakDef &backPeak : backPeaks )
-    {
-      const double sigma = peak.gausPeak() ? peak.sigma() : 0.25*peak.roiWidth();
-      if( fabs(backPeak.mean()-peak.mean()) < (nsigmaNear*sigma) )
-      {
-        backCounts += backPeak.peakArea();
-        backUncert2 += backPeak.peakAreaUncert()*backPeak.peakAreaUncert();
-      }//if( fabs(backPeak.mean()-peak.mean()) < sigma )
-    }//for( const PeakDef &peak : backPeaks )
-    
+    double observed_counts, observed_uncertainty, backCounts, backUncert2;
+    background_subtracted_counts( peak, background, liveTime, observed_counts,
+                                  observed_uncertainty, backCounts, backUncert2 );
     
     if( energy_count_map.count(energy) == 0 )
     {
@@ -4249,17 +4670,10 @@ vector< tuple<double,double,double,Wt::WColor,double> > ShieldingSourceChi2Fcn::
     double expected_counts = 0.0;
     for( const EnergyCountMap::value_type &energy_count : energy_count_map )
     {
-      const double sigma = peak.gausPeak() ? peak.sigma() : 0.25*peak.roiWidth();
-      if( fabs(energy_count.first-energy) < (0.1*sigma) )  //XXX - in principle we have already clustered phootpopeaks, and could just quicly access the energies
+      if( energy_contributes_to_peak( energy_count.first, peak ) )  //XXX - in principle we have already clustered phootpopeaks, and could just quicly access the energies
         expected_counts += energy_count.second;
     }
 
-    if( backCounts > 0.0 )
-    {
-      observed_counts -= backCounts;
-      observed_uncertainty = sqrt( observed_uncertainty*observed_uncertainty + backUncert2 );
-    }
-    
     const double chi = (observed_counts - expected_counts) / observed_uncertainty;
     const double scale = observed_counts / expected_counts;
     const double scale_uncert = observed_uncertainty / expected_counts;
@@ -4465,202 +4879,189 @@ void ShieldingSourceChi2Fcn::selfShieldingIntegration( DistributedSrcCalc &calcu
 }//void selfShieldingIntegration(...)
 
   
-void ShieldingSourceChi2Fcn::setBackgroundPeaks(
-                                              const std::vector<PeakDef> &peaks,
-                                              double liveTime )
+void ShieldingSourceChi2Fcn::setBackground(
+                      std::shared_ptr<const BackgroundPeakCache::BackgroundModel> background )
 {
-  m_backgroundPeaks.clear();
-  const double scale = m_liveTime / liveTime;
+  m_background = background;
+  
+  if( !m_background )
+    return;
   
-  for( PeakDef p : peaks )
+  for( const double energy : m_background->nonGaussianPeakEnergies() )
   {
-    if( p.gausPeak() )
-    {
-      p.setPeakArea( scale * p.peakArea() );
-      p.setPeakAreaUncert( scale * p.peakAreaUncert() );
-      m_backgroundPeaks.push_back( p );
-    }else
-    {
-      stringstream msg;
-      msg << "The non-gaussian background peak at " << p.mean() << " keV "
-          << " will not be used for background peak area subtraction;"
-          << " non-gaussian peaks may be supported for this in the future";
-      passMessage( msg.str(), WarningWidget::WarningMsgHigh );
-    }//if( p.gausPeak() ) / else
-  }//for( PeakDef &p : m_backgroundPeaks )
-}//void setBackgroundPeaks(...)
+    stringstream msg;
+    msg << "The non-gaussian background peak at " << energy << " keV "
+        << " will not be used for background peak area subtraction;"
+        << " non-gaussian peaks may be supported for this in the future";
+    passMessage( msg.str(), WarningWidget::WarningMsgHigh );
+  }//for( loop over non-gaussian background peaks )
+}//void setBackground(...)
   
   
-vector< tuple<double,double,double,Wt::WColor,double> >
-       ShieldingSourceChi2Fcn::energy_chi_contributions( const std::vector<double> &x,
+void ShieldingSourceChi2Fcn::point_source_counts( const std::vector<double> &x,
+                                         const std::vector<std::pair<double,double>> &energie_widths,
+                                         const std::vector<double> &energies,
                                          ShieldingSourceChi2Fcn::NucMixtureCache &mixturecache,
+                                         std::vector<double> &counts,
+                                         std::vector<std::vector<double>> *dcounts,
                                          std::vector<std::string> *info ) const
 {
-  //XXX - this function compares a lot of doubles, and this always makes me
-  //      queezy - this should be checked on!
   typedef map<double,double> EnergyCountMap;
-
-//  cerr << "energy_chi_contributions: vals={ ";
-//  for( size_t i = 0; i < x.size(); ++i )
-//    cerr << x[i] << ", ";
-//  cerr << "}; size=" << x.size() << endl;
   
-  if( info )
-  {
-    info->push_back( "LiveTime="
-                    + std::to_string(m_liveTime/PhysicalUnits::second)
-                    + " s (" + PhysicalUnits::printToBestTimeUnits(m_liveTime)
-                    + ")" );
-    info->push_back( "Distance to source center from detector: "
-                      + PhysicalUnits::printToBestLengthUnits(m_distance) );
-    if( m_detector && m_detector->isValid() )
-      info->push_back( "Detector: "
-                        + m_detector->name() + " radius "
-                        + std::to_string( 0.5*m_detector->detectorDiameter()/PhysicalUnits::cm )
-                      + " cm" );
-    if( m_allowMultipleNucsContribToPeaks )
-      info->push_back( "Allowing multiple nuclides being fit for to potentially contribute to the same photopeak" );
-    else
-      info->push_back( "Not allowing multiple nuclides being fit for to contribute to the same photopeak" );
-    
-    //SHould put in information about the shielding here
-  }//if( info )
+  const size_t npars = x.size();
+  const size_t nnucs = m_nuclides.size();
+  const size_t nenergy = energies.size();
   
+  const auto is_fixed = [this]( const size_t index ) -> bool {
+    return (index < m_fixedParameters.size()) && m_fixedParameters[index];
+  };
   
-  EnergyCountMap energy_count_map;
-  const vector<pair<double,double> > energie_widths = observedPeakEnergyWidths( m_peaks );
+  const auto to_vector = [&energies,nenergy]( const EnergyCountMap &energy_counts ) -> vector<double> {
+    vector<double> answer( nenergy, 0.0 );
+    for( size_t i = 0; i < nenergy; ++i )
+    {
+      const auto pos = energy_counts.find( energies[i] );
+      if( pos != end(energy_counts) )
+        answer[i] = pos->second;
+    }
+    return answer;
+  };//to_vector lambda
   
-  if( m_allowMultipleNucsContribToPeaks )
+  counts.assign( nenergy, 0.0 );
+  if( dcounts )
   {
-    //Get the number of source gammas from each nuclide
-    for( const SandiaDecay::Nuclide *nuclide : m_nuclides )
-    {
-      if( isVolumetricSource(nuclide) )
-        continue;
-      
-      const double act = activity( nuclide, x );
-      const double thisage = age( nuclide, x );
-      
-      //{
-      //  static std::mutex s_debug_mutex;
-      //  std::lock_guard<std::mutex> lock( s_debug_mutex );
-      //  cout << "\tActivity of " << nuclide->symbol << " is "
-      //       << PhysicalUnits::printToBestActivityUnits(act)
-      //       << " with age " << PhysicalUnits::printToBestTimeUnits(thisage) << endl;
-      //}
-      
-      
-      if( mixturecache.find(nuclide) == mixturecache.end() )
-        mixturecache[nuclide].addNuclideByActivity( nuclide, sm_activityUnits );
-      
-      cluster_peak_activities( energy_count_map, energie_widths,
-                               mixturecache[nuclide], act, thisage,
-                               m_photopeakClusterSigma, -1.0, info );
-    }//for( const SandiaDecay::Nuclide *nuclide : m_nuclides )
-  }else
+    dcounts->clear();
+    dcounts->resize( npars );
+  }
+  
+  //Get the number of source gammas from each point-source nuclide.  Counts are linear in the
+  //  activity parameter, so if we want derivatives we get the counts per unit of it.
+  vector<double> source_counts( nenergy, 0.0 );
+  vector<vector<double>> unit_counts( nnucs ), unit_counts_dage( nnucs );
+  vector<size_t> age_par_index( nnucs, npars );
+  
+  for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
   {
-    for( const PeakDef &peak : m_peaks )
+    const SandiaDecay::Nuclide * const nuclide = m_nuclides[nuc_index];
+    if( isVolumetricSource(nuclide) )
+      continue;
+    
+    const double act_par = x[2*nuc_index];
+    const double act = dcounts ? sm_activityUnits : activity( nuclide, x );
+    const double thisage = age( nuclide, x );
+    const size_t age_index = ageParameterIndex( nuc_index, x );
+    const bool fitting_age = (dcounts && (age_index < npars) && !is_fixed(age_index) && (act_par != 0.0));
+    
+    EnergyCountMap nuc_counts, nuc_dcounts_dage;
+    nuclide_peak_activities( nuc_counts, energie_widths, nuclide, act, thisage,
+                             mixturecache, info, (fitting_age ? &nuc_dcounts_dage : nullptr) );
+    
+    unit_counts[nuc_index] = to_vector( nuc_counts );
+    const double scale = dcounts ? act_par : 1.0;
+    for( size_t i = 0; i < nenergy; ++i )
+      source_counts[i] += scale * unit_counts[nuc_index][i];
+    
+    if( fitting_age )
     {
-      const SandiaDecay::Nuclide *nuclide = peak.parentNuclide();
-      const SandiaDecay::RadParticle *particle = peak.decayParticle();
-      
-      if( !nuclide
-          || (!particle && (peak.sourceGammaType() != PeakDef::AnnihilationGamma))
-          || isVolumetricSource(nuclide) )
-        continue;
-      
-      const double act = activity( nuclide, x );
-      const double thisage = age( nuclide, x );
-      
-      if( mixturecache.find(nuclide) == mixturecache.end() )
-        mixturecache[nuclide].addNuclideByActivity( nuclide, sm_activityUnits );
-      
-      const float energy = peak.gammaParticleEnergy();
-      cluster_peak_activities( energy_count_map, energie_widths,
-                               mixturecache[nuclide], act, thisage,
-                               m_photopeakClusterSigma, energy, info);
-    }//for( const PeakDef &peak : m_peaks )
-  }//if( m_allowMultipleNucsContribToPeaks )
-
+      age_par_index[nuc_index] = age_index;
+      unit_counts_dage[nuc_index] = to_vector( nuc_dcounts_dage );
+    }
+  }//for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
+  
+  
   //Propagate the gammas through each material - note we are using the fit peak
-  //  mean here, and not the (pre-cluster) photopeak energy
+  //  mean here, and not the (pre-cluster) photopeak energy.
+  //  'point_factor' is the fraction of gammas, at each energy, that make it through the shielding
+  //  and air, and are detected, and 'dln_point_factor' is the derivative of the log of this
+  //  fraction with respect to the shielding parameters.
+  vector<double> point_factor( nenergy, 1.0 );
+  map<size_t,vector<double>> dln_point_factor;
+  vector<size_t> thickness_par_indexes;
   double shield_outer_rad = 0.0;
+  
   const int nMaterials = static_cast<int>( m_materials.size() );
   for( int materialN = 0; materialN < nMaterials; ++materialN )
   {
-    boost::function<double(float)> att_coef_fcn;
+    const size_t par_start = 2*nnucs + 3*static_cast<size_t>(materialN);
     const ShieldingInfo &shielding = m_materials[materialN];
     const Material * const material = shielding.material;
-
+    
+    // The fraction of gammas that make it through this shielding, at each energy
+    vector<double> frac( nenergy, 1.0 );
+    
     if( !material )
     {
       // Generic material here.
-      
-      float atomic_number = static_cast<float>(atomicNumber( materialN, x ));
-      float areal_density = static_cast<float>(arealDensity( materialN, x ));
+      const double raw_an = atomicNumber( materialN, x );
+      const double raw_ad = arealDensity( materialN, x );
+      const double max_ad = sm_max_areal_density_g_cm2*PhysicalUnits::g/PhysicalUnits::cm2;
       
       // Even though we always set AD and AN limits on the parameters when creating them in
       //  ShieldingSourceDisplay::shieldingFitnessFcn(...), sometimes Minuit will go (way!) outside
-      //  those bounds, and then everything becomes wack - so we'll clamp the values of AN/AD.
-      if( atomic_number < MassAttenuation::sm_min_xs_atomic_number )
-        atomic_number = MassAttenuation::sm_min_xs_atomic_number;
-      if( atomic_number > MassAttenuation::sm_max_xs_atomic_number )
-        atomic_number = MassAttenuation::sm_max_xs_atomic_number;
+      //  those bounds, and then everything becomes wack - so we'll clamp the values of AN/AD; the
+      //  chi2 doesnt change with them when they are clamped.
+      const bool an_clamped = ((raw_an < MassAttenuation::sm_min_xs_atomic_number)
+                               || (raw_an > MassAttenuation::sm_max_xs_atomic_number));
+      const bool ad_clamped = ((raw_ad < 0.0) || (raw_ad > max_ad));
+      
+      const float atomic_number = static_cast<float>( std::min( std::max( raw_an,
+                                       static_cast<double>(MassAttenuation::sm_min_xs_atomic_number) ),
+                                       static_cast<double>(MassAttenuation::sm_max_xs_atomic_number) ) );
+      const float areal_density = static_cast<float>( std::min( std::max( raw_ad, 0.0 ), max_ad ) );
       
-      const double ad_in_gcm2 = areal_density * PhysicalUnits::cm2 / PhysicalUnits::g;
-      if( ad_in_gcm2 < 0.0 )
-        areal_density = 0.0;
-      if( ad_in_gcm2 > sm_max_areal_density_g_cm2 )
-        areal_density = static_cast<float>(sm_max_areal_density_g_cm2*PhysicalUnits::g/PhysicalUnits::cm2);
-  
-      att_coef_fcn = boost::bind( &transmition_coefficient_generic, atomic_number, areal_density,
-                                 boost::placeholders::_1 );
+      vector<double> *dln_an = nullptr, *dln_ad = nullptr;
+      if( dcounts )
+      {
+        dln_an = &(dln_point_factor[par_start]);
+        dln_ad = &(dln_point_factor[par_start + 1]);
+        dln_an->resize( nenergy, 0.0 );
+        dln_ad->resize( nenergy, 0.0 );
+      }//if( dcounts )
+      
+      for( size_t i = 0; i < nenergy; ++i )
+      {
+        float dmu_dan = 0.0f;
+        const double mu = MassAttenuation::massAttenuationCoeficientSmoothAN( atomic_number,
+                                 static_cast<float>(energies[i]), (dcounts ? &dmu_dan : nullptr) );
+        frac[i] = exp( -1.0 * areal_density * mu );
+        
+        if( dcounts )
+        {
+          (*dln_an)[i] = an_clamped ? 0.0 : (-1.0 * areal_density * dmu_dan);
+          (*dln_ad)[i] = ad_clamped ? 0.0 : (-1.0 * mu);
+        }
+      }//for( size_t i = 0; i < nenergy; ++i )
     }else
     {
-      double thickness = 0.0;
+      size_t thickness_index = par_start;
       switch( m_geometry )
       {
-        case GeometryType::Spherical:
-          thickness = sphericalThickness(materialN,x);
-          break;
-          
-        case GeometryType::CylinderEndOn:
-          thickness = cylindricalLengthThickness(materialN,x);
-          break;
-          
-        case GeometryType::CylinderSideOn:
-          thickness = cylindricalRadiusThickness(materialN,x);
-          break;
-          
-        case GeometryType::Rectangular:
-          thickness = rectangularDepthThickness(materialN,x);
-          break;
-          
-        case GeometryType::NumGeometryType:
-          assert( 0 );
-          break;
+        case GeometryType::Spherical:      thickness_index = par_start;     break;
+        case GeometryType::CylinderEndOn:  thickness_index = par_start + 1; break;
+        case GeometryType::CylinderSideOn: thickness_index = par_start;     break;
+        case GeometryType::Rectangular:    thickness_index = par_start + 2; break;
+        case GeometryType::NumGeometryType: assert( 0 ); break;
       }//switch( m_geometry )
       
+      const double thickness = x.at( thickness_index );
       shield_outer_rad += thickness;
-      att_coef_fcn = boost::bind( &transmition_coefficient_material, material,
-                                 boost::placeholders::_1, static_cast<float>(thickness) );
+      thickness_par_indexes.push_back( thickness_index );
+      
+      vector<double> *dln_thick = nullptr;
+      if( dcounts )
+      {
+        dln_thick = &(dln_point_factor[thickness_index]);
+        dln_thick->resize( nenergy, 0.0 );
+      }
+      
+      for( size_t i = 0; i < nenergy; ++i )
+      {
+        const double mu = transmition_length_coefficient( material, static_cast<float>(energies[i]) );
+        frac[i] = exp( -1.0 * static_cast<float>(thickness) * mu );
+        if( dln_thick )
+          (*dln_thick)[i] = -1.0 * mu;
+      }//for( size_t i = 0; i < nenergy; ++i )
     }//if( generic material ) / else
-
-/*
-    //Uncomment out this section if you want to print out the transmission
-    //  coefficients
-    cout << "On material " << materialN << endl;
-    for( EnergyCountMap::value_type &energy_count : energy_count_map )
-    {
-      //adxs is in
-      double adxs = transmition_length_coefficient( material, energy_count.first );
-      adxs /= material->density;
-      adxs *= PhysicalUnits::gram / PhysicalUnits::cm2;
-      cout << energy_count.first << ", " << adxs << endl;
-    }//for( EnergyCountMap::value_type &energy_count : energy_count_map )
-*/
-
-    assert( att_coef_fcn );
     
     if( info )
     {
@@ -4725,40 +5126,42 @@ vector< tuple<double,double,double,Wt::WColor,double> >
         info->push_back( title.str() );
       }//if( isGenericMaterial(materialN) ) / else
       
-      for( EnergyCountMap::value_type &energy_count : energy_count_map )
+      for( size_t i = 0; i < nenergy; ++i )
       {
-        if( energy_count.second <= 0.0 )
+        const double before = source_counts[i] * point_factor[i];
+        if( before <= 0.0 )
           continue;
         
-        const double f = exp( -1.0 * att_coef_fcn( energy_count.first ) );
         stringstream msg;
-        msg << "\tReduced counts of " << energy_count.first
-            << " keV photopeak by " << f << " from "
-            << energy_count.second * PhysicalUnits::second << " cps, to "
-            << f * energy_count.second * PhysicalUnits::second << " cps";
+        msg << "\tReduced counts of " << energies[i]
+            << " keV photopeak by " << frac[i] << " from "
+            << before * PhysicalUnits::second << " cps, to "
+            << frac[i] * before * PhysicalUnits::second << " cps";
         info->push_back( msg.str() );
-      }//for( EnergyCountMap::value_type &energy_count : energy_count_map )
+      }//for( size_t i = 0; i < nenergy; ++i )
     }//if( info )
     
-    for( EnergyCountMap::value_type &energy_count : energy_count_map )
-    {
-      const double energy = energy_count.first;
-      const double frac = exp( -1.0 * att_coef_fcn( energy ) );
-      
-      energy_count.second *= frac;
-    }
+    for( size_t i = 0; i < nenergy; ++i )
+      point_factor[i] *= frac[i];
   }//for( int materialN = 0; materialN < nMaterials; ++materialN )
-
+  
   
   if( m_attenuateForAir )
   {
     const double air_dist = std::max( 0.0, m_distance - shield_outer_rad );
     
-    for( EnergyCountMap::value_type &energy_count : energy_count_map )
+    for( size_t i = 0; i < nenergy; ++i )
     {
-      const double coef = transmission_length_coefficient_air( energy_count.first );
-      energy_count.second *= exp( -1.0 * coef * air_dist );
-    }
+      const double coef = transmission_length_coefficient_air( static_cast<float>(energies[i]) );
+      point_factor[i] *= exp( -1.0 * coef * air_dist );
+      
+      // Thicker shielding means less air to go through
+      if( dcounts && (air_dist > 0.0) )
+      {
+        for( const size_t thickness_index : thickness_par_indexes )
+          dln_point_factor[thickness_index][i] += coef;
+      }
+    }//for( size_t i = 0; i < nenergy; ++i )
   }//if( m_attenuateForAir )
   
   
@@ -4768,53 +5171,224 @@ vector< tuple<double,double,double,Wt::WColor,double> >
     if( info )
       info->push_back( "Detector Efficiency Effects" );
     
-    for( EnergyCountMap::value_type &energy_count : energy_count_map )
+    // Evaluate the efficiency for all the energies at once, which is a lot quicker than one at a time
+    const vector<float> float_energies( begin(energies), end(energies) );
+    vector<double> efficiencies( nenergy );
+    m_detector->efficiencies( float_energies.data(), nenergy, m_distance, efficiencies.data() );
+    
+    for( size_t i = 0; i < nenergy; ++i )
     {
-//      cerr << "Absolute efficiency at " << energy_count.first << " keV is "
-//           << m_detector->intrinsicEfficiency( energy_count.first ) << " and the "
-//           << " total efficiency is " << m_detector->efficiency( energy_count.first, m_distance ) << endl;
-      
-      const double eff = m_detector->efficiency( energy_count.first, m_distance );
+      const double eff = efficiencies[i];
       
       if( info )
       {
-        if( energy_count.second > 0.0 )
+        const double before = source_counts[i] * point_factor[i];
+        const double deteff = m_detector->intrinsicEfficiency( float_energies[i] );
+        
+        stringstream msg;
+        if( before > 0.0 )
         {
-          double deteff = m_detector->intrinsicEfficiency( energy_count.first );
-          stringstream msg;
-          msg << "\t" << energy_count.first << " keV photopeak reduced by "
+          msg << "\t" << energies[i] << " keV photopeak reduced by "
               << eff/deteff << " * " << deteff
               << " (solid angle)*(det intrinsic eff) from "
-              << energy_count.second*PhysicalUnits::second << " cps "
-              << "to " << energy_count.second*PhysicalUnits::second*eff << " cps";
-          info->push_back( msg.str() );
+              << before*PhysicalUnits::second << " cps "
+              << "to " << before*PhysicalUnits::second*eff << " cps";
         }else
         {
-          double deteff = m_detector->intrinsicEfficiency( energy_count.first );
-          stringstream msg;
-          msg << "\t" << energy_count.first << " keV photopeak reduced by "
+          msg << "\t" << energies[i] << " keV photopeak reduced by "
               << deteff << " by the detectors absolute efficiency.";
-          info->push_back( msg.str() );
         }
+        info->push_back( msg.str() );
       }//if( info )
       
-      energy_count.second *= eff;
-    }//for( EnergyCountMap::value_type &energy_count : energy_count_map )
-  }else 
+      point_factor[i] *= eff;
+    }//for( size_t i = 0; i < nenergy; ++i )
+  }else
   {
     const double detDiam = 1.0 * PhysicalUnits::cm;
     const double r = 0.5 * detDiam;
     const double D = m_distance;
     const double fracAngle = 0.5*(1.0 - (D/sqrt(D*D+r*r)));
-    for( EnergyCountMap::value_type &energy_count : energy_count_map )
-      energy_count.second *= fracAngle;
+    for( size_t i = 0; i < nenergy; ++i )
+      point_factor[i] *= fracAngle;
     
     if( info )
       info->push_back( "Solid angle reduces counts by a factor of " + std::to_string(fracAngle) );
   }//if( m_detector && m_detector->isValid() ) / else
+  
+  
+  for( size_t i = 0; i < nenergy; ++i )
+    counts[i] = point_factor[i] * source_counts[i];
+  
+  if( !dcounts )
+    return;
+  
+  // The derivatives with respect to activity and age
+  for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
+  {
+    if( unit_counts[nuc_index].empty() )
+      continue;
+    
+    const double act_par = x[2*nuc_index];
+    const vector<double> &nuc_counts = unit_counts[nuc_index];
+    
+    if( !is_fixed(2*nuc_index) )
+    {
+      vector<double> &dact = (*dcounts)[2*nuc_index];
+      dact.resize( nenergy, 0.0 );
+      for( size_t i = 0; i < nenergy; ++i )
+        dact[i] += point_factor[i] * nuc_counts[i];
+    }//if( activity is being fit for )
+    
+    const size_t age_index = age_par_index[nuc_index];
+    if( age_index < npars )
+    {
+      const vector<double> &nuc_dcounts = unit_counts_dage[nuc_index];
+      vector<double> &dage = (*dcounts)[age_index];
+      dage.resize( nenergy, 0.0 );
+      for( size_t i = 0; i < nenergy; ++i )
+        dage[i] += point_factor[i] * act_par * nuc_dcounts[i];
+    }//if( age is being fit for )
+  }//for( size_t nuc_index = 0; nuc_index < nnucs; ++nuc_index )
+  
+  // The derivatives with respect to the shielding
+  for( const auto &index_dln : dln_point_factor )
+  {
+    if( is_fixed(index_dln.first) )
+      continue;
+    
+    vector<double> &dpar = (*dcounts)[index_dln.first];
+    dpar.resize( nenergy, 0.0 );
+    for( size_t i = 0; i < nenergy; ++i )
+      dpar[i] += counts[i] * index_dln.second[i];
+  }//for( const auto &index_dln : dln_point_factor )
+}//void point_source_counts(...)
 
 
+vector< tuple<double,double,double,Wt::WColor,double> >
+       ShieldingSourceChi2Fcn::energy_chi_contributions( const std::vector<double> &x,
+                                         ShieldingSourceChi2Fcn::NucMixtureCache &mixturecache,
+                                         std::vector<std::string> *info ) const
+{
+  //XXX - this function compares a lot of doubles, and this always makes me
+  //      queezy - this should be checked on!
+  typedef map<double,double> EnergyCountMap;
+
+//  cerr << "energy_chi_contributions: vals={ ";
+//  for( size_t i = 0; i < x.size(); ++i )
+//    cerr << x[i] << ", ";
+//  cerr << "}; size=" << x.size() << endl;
+  
+  if( info )
+  {
+    info->push_back( "LiveTime="
+                    + std::to_string(m_liveTime/PhysicalUnits::second)
+                    + " s (" + PhysicalUnits::printToBestTimeUnits(m_liveTime)
+                    + ")" );
+    info->push_back( "Distance to source center from detector: "
+                      + PhysicalUnits::printToBestLengthUnits(m_distance) );
+    if( m_detector && m_detector->isValid() )
+      info->push_back( "Detector: "
+                        + m_detector->name() + " radius "
+                        + std::to_string( 0.5*m_detector->detectorDiameter()/PhysicalUnits::cm )
+                      + " cm" );
+    if( m_allowMultipleNucsContribToPeaks )
+      info->push_back( "Allowing multiple nuclides being fit for to potentially contribute to the same photopeak" );
+    else
+      info->push_back( "Not allowing multiple nuclides being fit for to contribute to the same photopeak" );
+    
+    //SHould put in information about the shielding here
+  }//if( info )
+  
+  
+  const vector<pair<double,double> > energie_widths = observedPeakEnergyWidths( m_peaks );
+  const vector<double> energies = unique_peak_energies( energie_widths );
+  
+  //Get the counts from the point-source nuclides, after shielding, air, and detector effects
+  vector<double> point_counts;
+  point_source_counts( x, energie_widths, energies, mixturecache, point_counts, nullptr, info );
+  
+  EnergyCountMap energy_count_map;
+  for( size_t i = 0; i < energies.size(); ++i )
+    energy_count_map[energies[i]] = point_counts[i];
+  
   //This is where contributions from self-attenuating and traces source are calculated
+  volumetric_source_activities( x, mixturecache, energie_widths, energy_count_map, nullptr, info );
+
+  //Account for live time
+  for( EnergyCountMap::value_type &energy_count : energy_count_map )
+    energy_count.second *= m_liveTime;
+
+  return expected_observed_chis( m_peaks, m_background.get(), m_liveTime, energy_count_map, info );
+}//vector<tuple<double,double,double> > energy_chi_contributions(...) const
+
+
+void ShieldingSourceChi2Fcn::nuclide_peak_activities( std::map<double,double> &energy_count_map,
+                                         const std::vector<std::pair<double,double>> &energie_widths,
+                                         const SandiaDecay::Nuclide *nuclide,
+                                         const double act,
+                                         const double age,
+                                         ShieldingSourceChi2Fcn::NucMixtureCache &mixturecache,
+                                         std::vector<std::string> *info,
+                                         std::map<double,double> *dcounts_dage ) const
+{
+  shared_ptr<const BatemanTable> &table = mixturecache[nuclide];
+  if( !table )
+    table = make_shared<BatemanTable>( nuclide, true );
+  
+  vector<BatemanTable::LineYield> lines;
+  table->evaluate( age, lines, (dcounts_dage != nullptr) );
+  
+  vector<pair<double,double>> line_yields, line_dyields;
+  line_yields.reserve( lines.size() );
+  for( const BatemanTable::LineYield &line : lines )
+  {
+    line_yields.emplace_back( line.energy, line.yield );
+    if( dcounts_dage )
+      line_dyields.emplace_back( line.energy, line.dyield_dage );
+  }//for( const BatemanTable::LineYield &line : lines )
+  
+  if( info )
+  {
+    stringstream msg;
+    msg << "For " << nuclide->symbol << " at age " << PhysicalUnits::printToBestTimeUnits(age) << ":";
+    info->push_back( msg.str() );
+  }//if( info )
+  
+  // Clustering is linear in the yields, so the age derivatives cluster the same way
+  const auto cluster = [&]( const double energyToCluster ){
+    cluster_line_activities( energy_count_map, energie_widths, line_yields, act,
+                             m_photopeakClusterSigma, energyToCluster, info );
+    if( dcounts_dage )
+      cluster_line_activities( *dcounts_dage, energie_widths, line_dyields, act,
+                               m_photopeakClusterSigma, energyToCluster, nullptr );
+  };//cluster lambda
+  
+  if( m_allowMultipleNucsContribToPeaks )
+  {
+    cluster( -1.0 );
+  }else
+  {
+    for( const PeakDef &peak : m_peaks )
+    {
+      if( (peak.parentNuclide() == nuclide)
+         && (peak.decayParticle() || (peak.sourceGammaType() == PeakDef::AnnihilationGamma)) )
+        cluster( peak.gammaParticleEnergy() );
+    }//for( const PeakDef &peak : m_peaks )
+  }//if( m_allowMultipleNucsContribToPeaks ) / else
+}//void nuclide_peak_activities(...)
+
+
+void ShieldingSourceChi2Fcn::volumetric_source_activities( const std::vector<double> &x,
+                                         ShieldingSourceChi2Fcn::NucMixtureCache &mixturecache,
+                                         const std::vector<std::pair<double,double>> &energie_widths,
+                                         std::map<double,double> &energy_count_map,
+                                         std::map<const SandiaDecay::Nuclide *,std::map<double,double>> *per_nuclide,
+                                         std::vector<std::string> *info ) const
+{
+  typedef map<double,double> EnergyCountMap;
+  
+  const int nMaterials = static_cast<int>( m_materials.size() );
   
   // We'll make a copy of materials since we may mass-fraction vary the isotopics
   vector<ShieldingInfo> materials = m_materials;
@@ -5026,26 +5600,8 @@ vector< tuple<double,double,double,Wt::WColor,double> >
       //           << "), actPerMass=" << actPerMass << ", massFraction="
       //           << massFraction << endl;
       
-      if( mixturecache.find(src) == mixturecache.end() )
-        mixturecache[src].addNuclideByActivity( src, sm_activityUnits );
-      
-      if( m_allowMultipleNucsContribToPeaks )
-      {
-        cluster_peak_activities( local_energy_count_map, energie_widths,
-                                 mixturecache[src], actPerVol, thisage,
-                                 m_photopeakClusterSigma, -1.0, info );
-      }else
-      {
-        for( const PeakDef &peak : m_peaks )
-        {
-          if( peak.parentNuclide()==src
-             && (peak.decayParticle() || (peak.sourceGammaType()==PeakDef::AnnihilationGamma)) )
-            cluster_peak_activities( local_energy_count_map, energie_widths,
-                                     mixturecache[src], actPerVol, thisage,
-                                      m_photopeakClusterSigma,
-                                     peak.gammaParticleEnergy(), info );
-        }//for( const PeakDef &peak : m_peaks )
-      }//if( m_allowMultipleNucsContribToPeaks ) / else
+      nuclide_peak_activities( local_energy_count_map, energie_widths, src, actPerVol, thisage,
+                               mixturecache, info );
 
       for( const EnergyCountMap::value_type &energy_count : local_energy_count_map )
       {
@@ -5206,13 +5762,25 @@ vector< tuple<double,double,double,Wt::WColor,double> >
     }//if( info )
     
     
-    for( const DistributedSrcCalc &calculator : calculators )
+    vector<float> calculator_intrinsic_effs;
+    if( m_detector && m_detector->isValid() )
     {
+      calculator_intrinsic_effs.resize( calculators.size() );
+      for( size_t i = 0; i < calculators.size(); ++i )
+        calculator_intrinsic_effs[i] = static_cast<float>( calculators[i].m_energy );
+      
+      m_detector->intrinsicEfficiencies( calculator_intrinsic_effs.data(),
+                                calculator_intrinsic_effs.size(), calculator_intrinsic_effs.data() );
+    }//if( m_detector && m_detector->isValid() )
+    
+    for( size_t calc_index = 0; calc_index < calculators.size(); ++calc_index )
+    {
+      const DistributedSrcCalc &calculator = calculators[calc_index];
       double contrib = calculator.integral * calculator.m_srcVolumetricActivity;
 
       
-      if( m_detector && m_detector->isValid() )
-        contrib *= m_detector->intrinsicEfficiency( calculator.m_energy );
+      if( !calculator_intrinsic_effs.empty() )
+        contrib *= calculator_intrinsic_effs[calc_index];
 
       if( energy_count_map.find( calculator.m_energy ) != energy_count_map.end() )
       {
@@ -5229,6 +5797,9 @@ vector< tuple<double,double,double,Wt::WColor,double> >
         energy_count_map[calculator.m_energy] = contrib;
       }
       
+      if( per_nuclide )
+        (*per_nuclide)[calculator.m_nuclide][calculator.m_energy] += contrib;
+      
       if( info )
       {
         const Material *const material = materials[calculator.m_sourceIndex].material;
@@ -5278,16 +5849,9 @@ vector< tuple<double,double,double,Wt::WColor,double> >
         
         info->push_back( msg.str() );
       }//if( info )
-    }//for( DistributedSrcCalc &calculator : calculators )
+    }//for( size_t calc_index = 0; calc_index < calculators.size(); ++calc_index )
   }//if( calculators.size() )
-
-  
-  //Account for live time
-  for( EnergyCountMap::value_type &energy_count : energy_count_map )
-    energy_count.second *= m_liveTime;
-
-  return expected_observed_chis( m_peaks, m_backgroundPeaks, energy_count_map, info );
-}//vector<tuple<double,double,double> > energy_chi_contributions(...) const
+}//void volumetric_source_activities(...)
 
 
 ShieldingSourceChi2Fcn::GuiProgressUpdateInfo::GuiProgressUpdateInfo( const size_t updateFreqMs,
@@ -31,6 +31,7 @@
 
 #include <ctime>
 #include <tuple>
+#include <chrono>
 #include <mutex>
 #include <locale>
 #include <vector>
@@ -38,6 +39,7 @@
 #include <limits>
 #include <sstream>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <stdexcept>
 #include <sys/stat.h>
@@ -51,10 +53,12 @@
 #include <Wt/WText>
 #include <Wt/Utils>
 #include <Wt/WLabel>
+#include <Wt/WTimer>
 #include <Wt/WImage>
 #include <Wt/WBreak>
 #include <Wt/WPoint>
 #include <Wt/WServer>
+#include <Wt/WLogger>
 #include <Wt/Dbo/Dbo>
 #include <Wt/WSpinBox>
 #include <Wt/WTextArea>
@@ -273,6 +277,91 @@ namespace
     }
   };//struct csv_reader
   
+  
+  /** Returns a container, with a zero-margin grid layout, to hold a tool in a tool tab; the tool
+   itself is created the first time it is needed, and placed in the container using
+   #set_tool_tab_contents.
+   */
+  WContainerWidget *tool_tab_container()
+  {
+    WContainerWidget *container = new WContainerWidget();
+    WGridLayout *layout = new WGridLayout();
+    layout->setContentsMargins( 0, 0, 0, 0 );
+    layout->setRowStretch( 0, 1 );
+    layout->setColumnStretch( 0, 1 );
+    container->setLayout( layout );
+    container->setMargin( 0 );
+    container->setPadding( 0 );
+    
+    return container;
+  }//WContainerWidget *tool_tab_container()
+  
+  
+  /** Places a tool into a container created by #tool_tab_container. */
+  void set_tool_tab_contents( WContainerWidget *container, WWidget *tool )
+  {
+    WGridLayout *layout = container ? dynamic_cast<WGridLayout *>( container->layout() ) : nullptr;
+    assert( layout && tool );
+    if( layout && tool )
+      layout->addWidget( tool, 0, 0 );
+  }//void set_tool_tab_contents(...)
+  
+  
+  /** A placeholder for the contents of a tool tab, that only creates the actual contents the first
+   time the tab is shown (see #InterSpec::handleToolTabChanged), or when
+   #InterSpec::finishDeferredStartup creates all deferred tools, for non-web builds.
+   
+   This keeps the cost of tools the user may never look at out of session creation.
+   */
+  class DeferredToolTab : public WContainerWidget
+  {
+  public:
+    explicit DeferredToolTab( std::function<WWidget *()> creator )
+      : WContainerWidget(),
+        m_creator( std::move(creator) )
+    {
+      WGridLayout *layout = new WGridLayout();
+      layout->setContentsMargins( 0, 0, 0, 0 );
+      layout->setRowStretch( 0, 1 );
+      layout->setColumnStretch( 0, 1 );
+      setLayout( layout );
+      setMargin( 0 );
+      setPadding( 0 );
+    }
+    
+    /** Creates the contents, if they havent been already; returns true if created by this call. */
+    bool create()
+    {
+      if( !m_creator )
+        return false;
+      
+      std::function<WWidget *()> creator;
+      creator.swap( m_creator );
+      
+      set_tool_tab_contents( this, creator() );
+      
+      return true;
+    }//bool create()
+    
+  protected:
+    std::function<WWidget *()> m_creator;
+  };//class DeferredToolTab
+  
+  
+  /** Returns a tab, that when first shown, will create a #CompactFileManager. */
+  DeferredToolTab *deferred_compact_file_manager( InterSpec *viewer )
+  {
+    auto creator = [viewer]() -> WWidget * {
+      CompactFileManager *compact = new CompactFileManager( viewer->fileManager(), viewer,
+                                                            CompactFileManager::LeftToRight );
+      viewer->spectrum()->yAxisScaled().connect( boost::bind( &CompactFileManager::handleSpectrumScale,
+                                   compact, boost::placeholders::_1, boost::placeholders::_2 ) );
+      return compact;
+    };//creator
+    
+    return new DeferredToolTab( creator );
+  }//deferred_compact_file_manager(...)
+  
 
   
   //Returns -1 if you shouldnt add the peak to the hint peaks
@@ -354,11 +443,13 @@ InterSpec::InterSpec( WContainerWidget *parent )
     m_toolsLayout( 0 ),
 #endif
     m_menuDiv( 0 ),
+    m_peakInfoContainer( nullptr ),
     m_peakInfoDisplay( 0 ),
     m_peakInfoWindow( 0 ),
     m_peakEditWindow( 0 ),
     m_currentToolsTab( 0 ),
     m_toolsTabs( 0 ),
+    m_energyCalContainer( nullptr ),
     m_energyCalTool( 0 ),
     m_energyCalWindow( 0 ),
     m_gammaCountDialog( 0 ),
@@ -429,6 +520,7 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_remoteRidWindow( nullptr ),
 #endif
   m_clientDeviceType( 0x0 ),
+  m_referenceLinesContainer( nullptr ),
   m_referencePhotopeakLines( 0 ),
   m_referencePhotopeakLinesWindow( 0 ),
   m_licenseWindow( nullptr ),
@@ -438,10 +530,14 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_renderedWidth( 0 ),
   m_renderedHeight( 0 ),
   m_colorPeaksBasedOnReferenceLines( true ),
-  m_findingHintPeaks( false )
+  m_findingHintPeaks( false ),
+  m_automatedPeakSearchRunning( false ),
+  m_startupFinished( false ),
+  m_constructionStart( std::chrono::steady_clock::now() )
 {
   //Initialization of the app (this function) takes about 11ms on my 2.6 GHz
   //  Intel Core i7, as of (20150316).
+  //  The tools, and time chart, are not created until needed (see #finishDeferredStartup).
   
   addStyleClass( "InterSpec" );
   
@@ -534,14 +630,14 @@ InterSpec::InterSpec( WContainerWidget *parent )
 
   m_peakModel = new PeakModel( this );
   m_spectrum   = new D3SpectrumDisplayDiv();
-  m_timeSeries = new D3TimeChart();
+  // m_timeSeries will be created when a file with time-series data is first shown; see
+  //  #createTimeChart()
   
   if( isPhone() )
   {
     //TODO: layoutSizeChanged(...) will trigger the compact axis anyway, but
     //      I should check if doing it here saves a roundtrip
     m_spectrum->setCompactAxis( true );
-    m_timeSeries->setCompactAxis( true );
     
     //For iPhoneX we need to:
     //  X - adjust padding for safe area
@@ -568,19 +664,15 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_spectrum->existingRoiEdgeDragUpdate().connect( m_spectrum, &D3SpectrumDisplayDiv::performExistingRoiEdgeDragWork );
   m_spectrum->dragCreateRoiUpdate().connect( m_spectrum, &D3SpectrumDisplayDiv::performDragCreateRoiWork );
       
-  m_nuclideSearch = new IsotopeSearchByEnergy( this, m_spectrum );
-  m_nuclideSearch->setLoadLaterWhenInvisible(true);
-
+  // m_nuclideSearch will be created the first time it is needed; see #nuclideSearch()
+  
   m_warnings = new WarningWidget( this );
 
-  // Set up the energy calibration tool
-  m_energyCalTool = new EnergyCalTool( this, m_peakModel );
-  m_spectrum->rightMouseDragg().connect( m_energyCalTool, &EnergyCalTool::handleGraphicalRecalRequest );
-  displayedSpectrumChanged().connect( m_energyCalTool, &EnergyCalTool::displayedSpecChangedCallback );
+  // The energy calibration tool, Peak Manager, and Reference Photopeak tool are created when first
+  //  needed; see #energyCalTool(), #peakInfoDisplay(), and #referenceLinesWidget().
+  m_spectrum->rightMouseDragg().connect( this, &InterSpec::handleGraphicalRecalRequest );
 
   m_fileManager = new SpecMeasManager( this );
-  
-  m_peakInfoDisplay = new PeakInfoDisplay( this, m_spectrum, m_peakModel );
 
   initMaterialDbAndSuggestions();
   
@@ -765,7 +857,7 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_chartResizer->addStyleClass( "Wt-vsh2" );
   m_chartResizer->setHeight( 5 );
   
-  addWidget( m_timeSeries );
+  // m_timeSeries will be inserted here, when created
   
   m_toolsResizer = new WContainerWidget( this );
   m_toolsResizer->addStyleClass( "Wt-vsh2" );
@@ -778,47 +870,24 @@ InterSpec::InterSpec( WContainerWidget *parent )
     
     m_toolsTabs = new WTabWidget( this );
     
-    CompactFileManager *compact = new CompactFileManager( m_fileManager, this, CompactFileManager::LeftToRight );
-    m_toolsTabs->addTab( compact, FileTabTitle, TabLoadPolicy );
+    m_toolsTabs->addTab( deferred_compact_file_manager( this ), FileTabTitle, TabLoadPolicy );
     
-    m_spectrum->yAxisScaled().connect( boost::bind( &CompactFileManager::handleSpectrumScale, compact,
-                                                   boost::placeholders::_1, boost::placeholders::_2 ) );
+    // The tools will be placed in their containers when created; see #createToolTabContents
+    m_peakInfoContainer = tool_tab_container();
+    m_toolsTabs->addTab( m_peakInfoContainer, PeakInfoTabTitle, TabLoadPolicy );
     
-    m_toolsTabs->addTab( m_peakInfoDisplay, PeakInfoTabTitle, TabLoadPolicy );
+    m_referenceLinesContainer = tool_tab_container();
+    m_toolsTabs->addTab( m_referenceLinesContainer, GammaLinesTabTitle, TabLoadPolicy );
     
-    m_referencePhotopeakLines = new ReferencePhotopeakDisplay( m_spectrum,
-                                                              m_materialDB.get(),
-                                                              m_shieldingSuggestion,
-                                                              this );
-    setReferenceLineColors( nullptr );
-    
-    //PreLoading is necessary on the m_referencePhotopeakLines widget, so that the
-    //  "Isotope Search" widget will work properly when a nuclide is clicked
-    //  on to display its photpeaks
-    //XXX In Wt 3.3.4 at least, the contents of m_referencePhotopeakLines
-    //  are not actually loaded to the client until the tab is clicked, and I
-    //  cant seem to get this to actually happen.
-    //WMenuItem *refPhotoTab =
-    m_toolsTabs->addTab( m_referencePhotopeakLines, GammaLinesTabTitle, TabLoadPolicy );
-    
-    m_toolsTabs->currentChanged().connect( this, &InterSpec::handleToolTabChanged );
-    
-    m_energyCalTool->setWideLayout();
-    m_toolsTabs->addTab( m_energyCalTool, CalibrationTabTitle, TabLoadPolicy );
+    m_energyCalContainer = tool_tab_container();
+    m_toolsTabs->addTab( m_energyCalContainer, CalibrationTabTitle, TabLoadPolicy );
     
     m_toolsTabs->setHeight( 245 );
     
     assert( !m_nuclideSearchContainer );
     
-    m_nuclideSearchContainer = new WContainerWidget();
-    WGridLayout *isoSearchLayout = new WGridLayout();
-    m_nuclideSearchContainer->setLayout( isoSearchLayout );
-    isoSearchLayout->setContentsMargins( 0, 0, 0, 0 );
-    isoSearchLayout->addWidget( m_nuclideSearch, 0, 0 );
-    m_nuclideSearchContainer->setMargin( 0 );
-    m_nuclideSearchContainer->setPadding( 0 );
-    isoSearchLayout->setRowStretch( 0, 1 );
-    isoSearchLayout->setColumnStretch( 0, 1 );
+    // m_nuclideSearch will be placed in m_nuclideSearchContainer when its created
+    m_nuclideSearchContainer = tool_tab_container();
     
     //WMenuItem *nuclideTab =
     m_toolsTabs->addTab( m_nuclideSearchContainer, NuclideSearchTabTitle, TabLoadPolicy );
@@ -833,7 +902,12 @@ InterSpec::InterSpec( WContainerWidget *parent )
 #endif
     
     //Make sure the current tab is the peak info display
-    m_toolsTabs->setCurrentWidget( m_peakInfoDisplay );
+    m_toolsTabs->setCurrentWidget( m_peakInfoContainer );
+    m_currentToolsTab = m_toolsTabs->currentIndex();
+    
+    // Connected after setting the current tab, so the Peak Manager wont be created until after the
+    //  page has loaded
+    m_toolsTabs->currentChanged().connect( this, &InterSpec::handleToolTabChanged );
     
     m_toolsTabs->setJavaScriptMember( WT_RESIZE_JS, "function(self,w,h,layout){ console.log( 'wtResize called for tools tab:', w, h, layout ); }" );
     
@@ -891,12 +965,8 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_chartResizer = new WContainerWidget( m_charts );
   m_chartResizer->addStyleClass( "Wt-hrh2" );
   m_chartResizer->setHeight( isMobile() ? 10 : 5 );
-  m_charts->addWidget( m_timeSeries );
-  
-  m_chartResizer->setHidden( m_timeSeries->isHidden() );
   
-  LOAD_JAVASCRIPT(wApp, "js/InterSpec.js", "InterSpec", wtjsInitFlexResizer);
-  m_charts->doJavaScript( "Wt.WT.InitFlexResizer('" + m_chartResizer->id() + "','" + m_timeSeries->id() + "');" );
+  // m_timeSeries will be added to m_charts, and the resizer initialized, when it is created
   
   m_layout = new WGridLayout();
   m_layout->setContentsMargins( 0, 0, 0, 0 );
@@ -911,14 +981,6 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_layout->setRowStretch( m_layout->rowCount() - 1, 1 );
 #endif
   
-  // No need to updated the default axis titles
-  //m_timeSeries->setY1AxisTitle( "Gamma CPS" );
-  //m_timeSeries->setY2AxisTitle( "Neutron CPS" );
-  //m_timeSeries->setXAxisTitle( "Time of Measurement (seconds)", "Time (seconds)" );
-  
-  m_timeSeries->chartDragged().connect( this, &InterSpec::timeChartDragged );
-  m_timeSeries->chartClicked().connect( this, &InterSpec::timeChartClicked );
-  
   m_spectrum->setXAxisTitle( "Energy (keV)" );
   m_spectrum->setYAxisTitle( "Counts" );
 
@@ -1014,8 +1076,7 @@ InterSpec::InterSpec( WContainerWidget *parent )
   m_spectrum->doubleLeftClick().connect( boost::bind( &InterSpec::searchForSinglePeak, this,
                                                      boost::placeholders::_1 ) );
 
-  m_timeSeries->setHidden( true );
-  m_chartResizer->setHidden( m_timeSeries->isHidden() );
+  m_chartResizer->setHidden( true );
   
 #if( USE_OSX_NATIVE_MENU || USING_ELECTRON_NATIVE_MENU )
   if( InterSpecApp::isPrimaryWindowInstance() )
@@ -1047,6 +1108,9 @@ InterSpec::InterSpec( WContainerWidget *parent )
 #endif
   
   applyColorTheme( nullptr );
+  
+  // The timer fires once the client has loaded the page, and run its JavaScript
+  WTimer::singleShot( 0, boost::bind( &InterSpec::finishDeferredStartup, this ) );
 }//InterSpec( constructor )
 
 InterSpec *InterSpec::instance()
@@ -1145,8 +1209,8 @@ InterSpec::~InterSpec() noexcept(true)
   
   if( m_peakInfoDisplay )
   {
-    if( m_toolsTabs && m_toolsTabs->indexOf(m_peakInfoDisplay)>=0 )
-        m_toolsTabs->removeTab( m_peakInfoDisplay );
+    if( m_peakInfoContainer && !m_peakInfoWindow )
+      m_peakInfoContainer->layout()->removeWidget( m_peakInfoDisplay );
     if( m_peakInfoWindow )
       m_peakInfoWindow->contents()->removeWidget( m_peakInfoDisplay );
     delete m_peakInfoDisplay;
@@ -1161,8 +1225,10 @@ InterSpec::~InterSpec() noexcept(true)
   
   if( m_energyCalTool )
   {
-    if( m_toolsTabs && m_toolsTabs->indexOf(m_energyCalTool)>=0 )
-      m_toolsTabs->removeTab( m_energyCalTool );
+    if( m_energyCalContainer && !m_energyCalWindow )
+      m_energyCalContainer->layout()->removeWidget( m_energyCalTool );
+    else if( m_energyCalWindow )
+      m_energyCalWindow->stretcher()->removeWidget( m_energyCalTool );
     
     delete m_energyCalTool;
     m_energyCalTool = nullptr;
@@ -1194,8 +1260,8 @@ InterSpec::~InterSpec() noexcept(true)
   
   if( m_referencePhotopeakLines )
   {
-    if( m_toolsTabs && m_toolsTabs->indexOf(m_referencePhotopeakLines)>=0 )
-      m_toolsTabs->removeTab( m_referencePhotopeakLines );
+    if( m_referenceLinesContainer && !m_referencePhotopeakLinesWindow )
+      m_referenceLinesContainer->layout()->removeWidget( m_referencePhotopeakLines );
     
     m_referencePhotopeakLines->clearAllLines();
     delete m_referencePhotopeakLines;
@@ -1348,7 +1414,7 @@ void InterSpec::layoutSizeChanged( int w, int h )
     if( comactX && !m_spectrum->isAxisCompacted() )
       m_spectrum->setCompactAxis( comactX );
     
-    if( comactX && !m_timeSeries->isAxisCompacted() )
+    if( comactX && m_timeSeries && !m_timeSeries->isAxisCompacted() )
       m_timeSeries->setCompactAxis( comactX );
   }
 }//void layoutSizeChanged( int w, int h )
@@ -2267,10 +2333,11 @@ void InterSpec::handleLeftClick( double energy, double counts,
   }
 #endif
   
-  if( (m_toolsTabs && (m_currentToolsTab == m_toolsTabs->indexOf(m_peakInfoDisplay)))
+  if( (m_toolsTabs && m_peakInfoContainer
+       && (m_currentToolsTab == m_toolsTabs->indexOf(m_peakInfoContainer)))
      || m_peakInfoWindow )
   {
-    m_peakInfoDisplay->handleChartLeftClick( energy );
+    peakInfoDisplay()->handleChartLeftClick( energy );
     return;
   }
 }//void handleLeftClick(...)
@@ -3370,9 +3437,10 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
     if( m_shieldingSourceFitWindow )
       m_shieldingSourceFitWindow->hide();
     
-    if( m_nuclideSearchWindow )
+    if( m_nuclideSearchWindow && m_nuclideSearchContainer )
     {
-      m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
+      if( m_nuclideSearch )
+        m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
       delete m_nuclideSearchContainer;
       m_nuclideSearchContainer = nullptr;
     }
@@ -3417,8 +3485,11 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
       const bool horizontalGridLines = (entry->shownDisplayFeatures & UserState::kVerticalGridLines);
       m_spectrum->showVerticalLines( vertGridLines );
       m_spectrum->showHorizontalLines( horizontalGridLines );
-      m_timeSeries->showVerticalLines( vertGridLines );
-      m_timeSeries->showHorizontalLines( horizontalGridLines );
+      if( m_timeSeries )
+      {
+        m_timeSeries->showVerticalLines( vertGridLines );
+        m_timeSeries->showHorizontalLines( horizontalGridLines );
+      }
       
       if( (entry->shownDisplayFeatures & UserState::kSpectrumLegend) )
       {
@@ -3487,7 +3558,7 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
     if( entry->gammaLinesXml.size() )
     {
       bool toolTabsHidden = false;
-      if( !m_referencePhotopeakLines )    //tool tabs must be hidden, so lets show the window
+      if( !referenceLinesWidget() )    //tool tabs must be hidden, so lets show the window
       {
         showGammaLinesWindow();//if entry->showingWindows was implemented
         toolTabsHidden = true;
@@ -3501,7 +3572,7 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
         closeGammaLinesWindow();
     }//if( entry->gammaLinesXml.size() )
     
-    if( m_nuclideSearch && entry->isotopeSearchEnergiesXml.size() )
+    if( entry->isotopeSearchEnergiesXml.size() )
     {
       string data = entry->isotopeSearchEnergiesXml;
       
@@ -3514,8 +3585,8 @@ void InterSpec::loadStateFromDb( Wt::Dbo::ptr<UserState> entry )
           showNuclideSearchWindow();
       }//if( !wasDocked )
       
-      m_nuclideSearch->deSerialize( data, display );
-    }//if( m_nuclideSearch && entry->isotopeSearchEnergiesXml.size() )
+      nuclideSearch()->deSerialize( data, display );
+    }//if( entry->isotopeSearchEnergiesXml.size() )
 
     for( SpectrumChart::PeakLabels label = SpectrumChart::PeakLabels(0);
         label < SpectrumChart::kNumPeakLabels;
@@ -3730,7 +3801,8 @@ void InterSpec::applyColorTheme( shared_ptr<const ColorTheme> theme )
 
   
   m_spectrum->applyColorTheme( theme );
-  m_timeSeries->applyColorTheme( theme );
+  if( m_timeSeries )
+    m_timeSeries->applyColorTheme( theme );
   
   setReferenceLineColors( theme );
   
@@ -4173,17 +4245,11 @@ void InterSpec::showPeakInfoWindow()
     cerr << "nterSpec::showPeakInfoWindow()\n\tTemporary hack - we dont want to show the"
          << " peak info window when tool tabs are showing since things get funky"
          << endl;
-    m_toolsTabs->setCurrentWidget( m_peakInfoDisplay );
+    m_toolsTabs->setCurrentWidget( m_peakInfoContainer );
     m_currentToolsTab = m_toolsTabs->currentIndex();
+    peakInfoDisplay();
     return;
   }//if( m_toolsTabs )
- 
-  if( m_toolsTabs && m_peakInfoDisplay )
-  {
-    m_toolsTabs->removeTab( m_peakInfoDisplay );
-    m_toolsTabs->setCurrentIndex( 0 );
-    m_currentToolsTab = 0;
-  }//if( m_toolsTabs && m_peakInfoDisplay )
   
   if( !m_peakInfoWindow )
   {
@@ -4195,7 +4261,7 @@ void InterSpec::showPeakInfoWindow()
     //m_peakInfoWindow->contents()->setPadding(0);
     //m_peakInfoWindow->contents()->setMargin(0);
     
-    layout->addWidget( m_peakInfoDisplay, Wt::WBorderLayout::Center );
+    layout->addWidget( peakInfoDisplay(), Wt::WBorderLayout::Center );
     WContainerWidget *buttons = new WContainerWidget();
     layout->addWidget( buttons, Wt::WBorderLayout::South );
 
@@ -4233,11 +4299,14 @@ void InterSpec::handlePeakInfoClose()
   if( m_toolsTabs )
   {
     m_peakInfoWindow->contents()->removeWidget( m_peakInfoDisplay );
-    if( m_toolsTabs->indexOf(m_peakInfoDisplay) < 0 )
+    if( !m_peakInfoContainer )
     {
-      m_toolsTabs->addTab( m_peakInfoDisplay, PeakInfoTabTitle, TabLoadPolicy );
-      m_toolsTabs->setCurrentIndex( m_toolsTabs->indexOf(m_peakInfoDisplay) );
-    }//if( m_toolsTabs->indexOf(m_peakInfoDisplay) < 0 )
+      m_peakInfoContainer = tool_tab_container();
+      m_toolsTabs->addTab( m_peakInfoContainer, PeakInfoTabTitle, TabLoadPolicy );
+    }//if( !m_peakInfoContainer )
+    
+    set_tool_tab_contents( m_peakInfoContainer, m_peakInfoDisplay );
+    m_toolsTabs->setCurrentWidget( m_peakInfoContainer );
     m_currentToolsTab = m_toolsTabs->currentIndex();
     
     delete m_peakInfoWindow;
@@ -5592,14 +5661,16 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     m_toolsTabs = new WTabWidget();
     //m_toolsTabs->addStyleClass( "ToolsTabs" );
     
-    CompactFileManager *compact = new CompactFileManager( m_fileManager, this, CompactFileManager::LeftToRight );
-    m_toolsTabs->addTab( compact, FileTabTitle, TabLoadPolicy );
+    m_toolsTabs->addTab( deferred_compact_file_manager( this ), FileTabTitle, TabLoadPolicy );
     
-    m_spectrum->yAxisScaled().connect( boost::bind( &CompactFileManager::handleSpectrumScale, compact,
-                                                   boost::placeholders::_1, boost::placeholders::_2 ) );
+    // The tools are placed in their containers when created; see #createToolTabContents
+    assert( !m_peakInfoContainer );
+    m_peakInfoContainer = tool_tab_container();
+    if( m_peakInfoDisplay )
+      set_tool_tab_contents( m_peakInfoContainer, m_peakInfoDisplay );
     
     //WMenuItem * peakManTab =
-    m_toolsTabs->addTab( m_peakInfoDisplay, PeakInfoTabTitle, TabLoadPolicy );
+    m_toolsTabs->addTab( m_peakInfoContainer, PeakInfoTabTitle, TabLoadPolicy );
 //    const char *tooltip = "Displays parameters of all identified peaks in a sortable table.";
 //    HelpSystem::attachToolTipOn( peakManTab, tooltip, showToolTips, HelpSystem::ToolTipPosition::Top );
     
@@ -5607,17 +5678,16 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     {
       m_referencePhotopeakLines->clearAllLines();
       delete m_referencePhotopeakLines;
-    }
+      m_referencePhotopeakLines = nullptr;
+    }//if( m_referencePhotopeakLines )
       
     if( m_referencePhotopeakLinesWindow )
       delete m_referencePhotopeakLinesWindow;
     m_referencePhotopeakLinesWindow = NULL;
-      
-    m_referencePhotopeakLines = new ReferencePhotopeakDisplay( m_spectrum,
-                                              m_materialDB.get(),
-                                              m_shieldingSuggestion,
-                                              this );
-    setReferenceLineColors( nullptr );
+    
+    //m_referencePhotopeakLines will be created when the tab is first shown, or its needed
+    assert( !m_referenceLinesContainer );
+    m_referenceLinesContainer = tool_tab_container();
     
     //PreLoading is necessary on the m_referencePhotopeakLines widget, so that the
     //  "Isotope Search" widget will work properly when a nuclide is clicked
@@ -5626,18 +5696,22 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     //  are not actually loaded to the client until the tab is clicked, and I
     //  cant seem to get this to actually happen.
     //WMenuItem *refPhotoTab =
-    m_toolsTabs->addTab( m_referencePhotopeakLines, GammaLinesTabTitle, TabLoadPolicy );
+    m_toolsTabs->addTab( m_referenceLinesContainer, GammaLinesTabTitle, TabLoadPolicy );
       
 //      const char *tooltip = "Allows user to display x-rays and/or gammas from "
 //                            "elements, isotopes, or nuclear reactions. Also "
 //                            "provides user with a shortcut to change detector "
 //                            "and account for shielding.";
 //      HelpSystem::attachToolTipOn( refPhotoTab, tooltip, showToolTips, HelpSystem::ToolTipPosition::Top );
-      
-    m_toolsTabs->currentChanged().connect( this, &InterSpec::handleToolTabChanged );
     
-    m_energyCalTool->setWideLayout();
-    m_toolsTabs->addTab( m_energyCalTool, CalibrationTabTitle, TabLoadPolicy );
+    assert( !m_energyCalContainer );
+    m_energyCalContainer = tool_tab_container();
+    if( m_energyCalTool )
+    {
+      m_energyCalTool->setWideLayout();
+      set_tool_tab_contents( m_energyCalContainer, m_energyCalTool );
+    }//if( m_energyCalTool )
+    m_toolsTabs->addTab( m_energyCalContainer, CalibrationTabTitle, TabLoadPolicy );
     
     m_toolsLayout = new WGridLayout();
     m_toolsLayout->setContentsMargins( 0, 0, 0, 0 );
@@ -5677,15 +5751,9 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     
     assert( !m_nuclideSearchContainer );
     
-    m_nuclideSearchContainer = new WContainerWidget();
-    WGridLayout *isoSearchLayout = new WGridLayout();
-    m_nuclideSearchContainer->setLayout( isoSearchLayout );
-    isoSearchLayout->setContentsMargins( 0, 0, 0, 0 );
-    isoSearchLayout->addWidget( m_nuclideSearch, 0, 0 );
-    m_nuclideSearchContainer->setMargin( 0 );
-    m_nuclideSearchContainer->setPadding( 0 );
-    isoSearchLayout->setRowStretch( 0, 1 );
-    isoSearchLayout->setColumnStretch( 0, 1 );
+    m_nuclideSearchContainer = tool_tab_container();
+    if( m_nuclideSearch )  //If not created yet, #nuclideSearch() will add it when it is
+      set_tool_tab_contents( m_nuclideSearchContainer, m_nuclideSearch );
     
     //WMenuItem *nuclideTab =
     m_toolsTabs->addTab( m_nuclideSearchContainer, NuclideSearchTabTitle, TabLoadPolicy );
@@ -5704,10 +5772,18 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
 #endif
     
     //Make sure the current tab is the peak info display
-    m_toolsTabs->setCurrentWidget( m_peakInfoDisplay );
+    m_toolsTabs->setCurrentWidget( m_peakInfoContainer );
+    
+    // Connected after setting the current tab, so we can control when the tab contents are created
+    m_toolsTabs->currentChanged().connect( this, &InterSpec::handleToolTabChanged );
     
-    if( m_referencePhotopeakLines && refNucXmlState.size() )
-      m_referencePhotopeakLines->deSerialize( refNucXmlState );
+    // When called from the constructor, the tool will be created after the page has loaded; see
+    //  #finishDeferredStartup
+    if( m_startupFinished )
+      createToolTabContents( m_toolsTabs->currentIndex() );
+    
+    if( refNucXmlState.size() )
+      referenceLinesWidget()->deSerialize( refNucXmlState );
   }else
   {
     //We are hiding the tool tabs
@@ -5715,8 +5791,23 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     
     if( m_menuDiv )
       m_layout->removeWidget( m_menuDiv );
-    m_toolsTabs->removeTab( m_peakInfoDisplay );
-    m_toolsTabs->removeTab( m_energyCalTool );
+    if( m_peakInfoContainer )
+    {
+      if( m_peakInfoDisplay )
+        m_peakInfoContainer->layout()->removeWidget( m_peakInfoDisplay );
+      m_toolsTabs->removeTab( m_peakInfoContainer );
+      delete m_peakInfoContainer;
+      m_peakInfoContainer = nullptr;
+    }//if( m_peakInfoContainer )
+    
+    if( m_energyCalContainer )
+    {
+      if( m_energyCalTool )
+        m_energyCalContainer->layout()->removeWidget( m_energyCalTool );
+      m_toolsTabs->removeTab( m_energyCalContainer );
+      delete m_energyCalContainer;
+      m_energyCalContainer = nullptr;
+    }//if( m_energyCalContainer )
     
     if( m_relActManualGui )
     {
@@ -5737,8 +5828,11 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     }
 #endif
     
-    m_nuclideSearch->clearSearchEnergiesOnClient();
-    m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
+    if( m_nuclideSearch )
+    {
+      m_nuclideSearch->clearSearchEnergiesOnClient();
+      m_nuclideSearchContainer->layout()->removeWidget( m_nuclideSearch );
+    }
     m_toolsTabs->removeTab( m_nuclideSearchContainer );
     delete m_nuclideSearchContainer;
     m_nuclideSearchContainer = nullptr;
@@ -5748,6 +5842,8 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
     
     m_toolsTabs = nullptr;
     
+    //m_referenceLinesContainer, and m_referencePhotopeakLines if its in it, are deleted with the tabs
+    m_referenceLinesContainer = nullptr;
     if( !m_referencePhotopeakLinesWindow )
       m_referencePhotopeakLines = nullptr;
     m_toolsLayout = nullptr;
@@ -5775,7 +5871,8 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
   //  the bindings to watch for mousedown and touchstart were removed, so lets re-instate them.
 #if( USE_CSS_FLEX_LAYOUT )
 #else
-  m_charts->doJavaScript( "Wt.WT.InitFlexResizer('" + m_chartResizer->id() + "','" + m_timeSeries->id() + "');" );
+  if( m_timeSeries )
+    m_charts->doJavaScript( "Wt.WT.InitFlexResizer('" + m_chartResizer->id() + "','" + m_timeSeries->id() + "');" );
 #endif
   
   if( m_toolsTabs )
@@ -5806,7 +5903,8 @@ void InterSpec::setToolTabsVisible( bool showToolTabs )
   m_spectrum->scheduleUpdateBackground();
   m_spectrum->scheduleUpdateSecondData();
   
-  m_timeSeries->scheduleRenderAll();
+  if( m_timeSeries )
+    m_timeSeries->scheduleRenderAll();
 #endif // USE_CSS_FLEX_LAYOUT / else
 }//void setToolTabsVisible( bool showToolTabs )
 
@@ -5874,7 +5972,8 @@ void InterSpec::addDisplayMenu( WWidget *parent )
   m_verticalLinesItems[0]->setHidden( verticleLines );
   m_verticalLinesItems[1]->setHidden( !verticleLines );
   m_spectrum->showVerticalLines( verticleLines );
-  m_timeSeries->showVerticalLines( verticleLines );
+  if( m_timeSeries )
+    m_timeSeries->showVerticalLines( verticleLines );
   InterSpecUser::addCallbackWhenChanged( m_user, "ShowVerticalGridlines", this, &InterSpec::setVerticalLines );
   
   const bool horizontalLines = InterSpecUser::preferenceValue<bool>( "ShowHorizontalGridlines", this );
@@ -5885,7 +5984,8 @@ void InterSpec::addDisplayMenu( WWidget *parent )
   m_horizantalLinesItems[0]->setHidden( horizontalLines );
   m_horizantalLinesItems[1]->setHidden( !horizontalLines );
   m_spectrum->showHorizontalLines( horizontalLines );
-  m_timeSeries->showHorizontalLines( horizontalLines );
+  if( m_timeSeries )
+    m_timeSeries->showHorizontalLines( horizontalLines );
   InterSpecUser::addCallbackWhenChanged( m_user, "ShowHorizontalGridlines", this, &InterSpec::setHorizantalLines );
   
   
@@ -6192,8 +6292,13 @@ void InterSpec::handEnergyCalWindowClose()
   if( m_toolsTabs )
   {
     m_energyCalTool->setWideLayout();
-    if( m_toolsTabs->indexOf(m_energyCalTool) < 0 )
-      m_toolsTabs->addTab( m_energyCalTool, CalibrationTabTitle, TabLoadPolicy );
+    if( !m_energyCalContainer )
+    {
+      m_energyCalContainer = tool_tab_container();
+      m_toolsTabs->addTab( m_energyCalContainer, CalibrationTabTitle, TabLoadPolicy );
+    }//if( !m_energyCalContainer )
+    
+    set_tool_tab_contents( m_energyCalContainer, m_energyCalTool );
     
     m_currentToolsTab = m_toolsTabs->currentIndex();
   }//if( m_toolsTabs )
@@ -6202,8 +6307,28 @@ void InterSpec::handEnergyCalWindowClose()
 
 EnergyCalTool *InterSpec::energyCalTool()
 {
+  if( m_energyCalTool )
+    return m_energyCalTool;
+  
+  m_energyCalTool = new EnergyCalTool( this, m_peakModel );
+  displayedSpectrumChanged().connect( m_energyCalTool, &EnergyCalTool::displayedSpecChangedCallback );
+  m_energyCalTool->refreshGuiFromFiles();
+  
+  // If tool tabs are showing, put in the tab; otherwise #showEnergyCalWindow will place it
+  if( m_energyCalContainer && !m_energyCalWindow )
+  {
+    m_energyCalTool->setWideLayout();
+    set_tool_tab_contents( m_energyCalContainer, m_energyCalTool );
+  }//if( m_energyCalContainer && !m_energyCalWindow )
+  
   return m_energyCalTool;
-}
+}//EnergyCalTool *energyCalTool()
+
+
+void InterSpec::handleGraphicalRecalRequest( double xstart, double xfinish )
+{
+  energyCalTool()->handleGraphicalRecalRequest( xstart, xfinish );
+}//void handleGraphicalRecalRequest( double xstart, double xfinish )
 
 void InterSpec::showEnergyCalWindow()
 {
@@ -6213,14 +6338,20 @@ void InterSpec::showEnergyCalWindow()
     return;
   }
 
-  const int index = (m_toolsTabs ? m_toolsTabs->indexOf(m_energyCalTool) : -1);
+  EnergyCalTool *tool = energyCalTool();
   
-  if( index >= 0 )
-    m_toolsTabs->removeTab( m_energyCalTool );
+  if( m_energyCalContainer )
+  {
+    m_energyCalContainer->layout()->removeWidget( tool );
+    if( m_toolsTabs )
+      m_toolsTabs->removeTab( m_energyCalContainer );
+    delete m_energyCalContainer;
+    m_energyCalContainer = nullptr;
+  }//if( m_energyCalContainer )
   
   if( m_energyCalWindow )
   {
-    m_energyCalWindow->stretcher()->removeWidget(m_energyCalTool);
+    m_energyCalWindow->stretcher()->removeWidget( tool );
     delete m_energyCalWindow;
   }
     
@@ -6277,7 +6408,8 @@ void InterSpec::setVerticalLines( bool show )
   m_verticalLinesItems[0]->setHidden( show );
   m_verticalLinesItems[1]->setHidden( !show );
   m_spectrum->showVerticalLines( show );
-  m_timeSeries->showVerticalLines( show );
+  if( m_timeSeries )
+    m_timeSeries->showVerticalLines( show );
 }//void setVerticalLines( bool show )
 
 
@@ -6287,7 +6419,8 @@ void InterSpec::setHorizantalLines( bool show )
   m_horizantalLinesItems[0]->setHidden( show );
   m_horizantalLinesItems[1]->setHidden( !show );
   m_spectrum->showHorizontalLines( show );
-  m_timeSeries->showHorizontalLines( show );
+  if( m_timeSeries )
+    m_timeSeries->showHorizontalLines( show );
 }//void setHorizantalLines( bool show )
 
 
@@ -6512,7 +6645,8 @@ void InterSpec::setXAxisSlider( bool show )
       m_compactXAxisItems[1]->setHidden( false );
     
      m_spectrum->setCompactAxis( true );
-    m_timeSeries->setCompactAxis( true );
+    if( m_timeSeries )
+      m_timeSeries->setCompactAxis( true );
   }else
   {
     //Go back to whatever the user wants/selects
@@ -6524,7 +6658,8 @@ void InterSpec::setXAxisSlider( bool show )
       m_compactXAxisItems[1]->setHidden( !makeCompact );
     
     m_spectrum->setCompactAxis( makeCompact );
-    m_timeSeries->setCompactAxis( makeCompact );
+    if( m_timeSeries )
+      m_timeSeries->setCompactAxis( makeCompact );
   }//show /hide
   
   m_spectrum->showXAxisSliderChart( show );
@@ -6541,7 +6676,8 @@ void InterSpec::setXAxisCompact( bool compact )
     m_compactXAxisItems[1]->setHidden( !compact );
   
   m_spectrum->setCompactAxis( compact );
-  m_timeSeries->setCompactAxis( compact );
+  if( m_timeSeries )
+    m_timeSeries->setCompactAxis( compact );
 }//void setXAxisCompact( bool compact )
 
 
@@ -6573,8 +6709,19 @@ void InterSpec::setShowYAxisScalers( bool show )
 
 ReferencePhotopeakDisplay *InterSpec::referenceLinesWidget()
 {
+  // When tool tabs are hidden, the widget only exists while #showGammaLinesWindow is showing
+  if( m_referencePhotopeakLines || !m_referenceLinesContainer )
+    return m_referencePhotopeakLines;
+  
+  m_referencePhotopeakLines = new ReferencePhotopeakDisplay( m_spectrum,
+                                                            m_materialDB.get(),
+                                                            m_shieldingSuggestion,
+                                                            this );
+  set_tool_tab_contents( m_referenceLinesContainer, m_referencePhotopeakLines );
+  setReferenceLineColors( nullptr );
+  
   return m_referencePhotopeakLines;
-}
+}//ReferencePhotopeakDisplay *referenceLinesWidget()
 
 #if( defined(WIN32) && BUILD_AS_ELECTRON_APP )
   //When users drag files from Outlook on windows into the app
@@ -6987,7 +7134,7 @@ void InterSpec::saveChartToImg( const bool spectrum, const bool asPng )
   if( spectrum )
   {
     m_spectrum->saveChartToImg( filename, asPng );
-  }else
+  }else if( m_timeSeries )
   {
     m_timeSeries->saveChartToPng( filename );
   }
@@ -7914,13 +8061,8 @@ void InterSpec::closeNuclideSearchWindow()
   
   if( m_toolsTabs )
   {
-    m_nuclideSearchContainer = new WContainerWidget();
-    WGridLayout *isotopeSearchGridLayout = new WGridLayout();
-    m_nuclideSearchContainer->setLayout( isotopeSearchGridLayout );
-
-    isotopeSearchGridLayout->addWidget( m_nuclideSearch, 0, 0 );
-    isotopeSearchGridLayout->setRowStretch( 0, 1 );
-    isotopeSearchGridLayout->setColumnStretch( 0, 1 );
+    m_nuclideSearchContainer = tool_tab_container();
+    set_tool_tab_contents( m_nuclideSearchContainer, m_nuclideSearch );
 
     m_toolsTabs->addTab( m_nuclideSearchContainer, NuclideSearchTabTitle, TabLoadPolicy );
     m_currentToolsTab = m_toolsTabs->currentIndex();
@@ -7929,6 +8071,8 @@ void InterSpec::closeNuclideSearchWindow()
 
 void InterSpec::showNuclideSearchWindow()
 {
+  nuclideSearch();  //Make sure m_nuclideSearch is created
+  
   if( m_nuclideSearchWindow )
   {
     m_nuclideSearchWindow->show();
@@ -7990,7 +8134,6 @@ void InterSpec::showShieldingSourceFitWindow()
 {
   if( !m_shieldingSourceFit )
   {
-    assert( m_peakInfoDisplay );
     auto widgets = ShieldingSourceDisplay::createWindow( this );
     
     m_shieldingSourceFit = widgets.first;
@@ -8048,10 +8191,6 @@ void InterSpec::showGammaLinesWindow()
     return;
   }
 
-  if( m_toolsTabs && m_referencePhotopeakLines )
-    m_toolsTabs->removeTab( m_referencePhotopeakLines );
-
-  
   std::string xml_state;
   
   if( m_referencePhotopeakLines )
@@ -8064,6 +8203,14 @@ void InterSpec::showGammaLinesWindow()
     delete m_referencePhotopeakLines;
     m_referencePhotopeakLines = NULL;
   }//if( m_referencePhotopeakLines )
+  
+  if( m_referenceLinesContainer )
+  {
+    if( m_toolsTabs )
+      m_toolsTabs->removeTab( m_referenceLinesContainer );
+    delete m_referenceLinesContainer;
+    m_referenceLinesContainer = nullptr;
+  }//if( m_referenceLinesContainer )
 
   m_referencePhotopeakLinesWindow = new AuxWindow( GammaLinesTabTitle,
                                                   (Wt::WFlags<AuxWindowProperties>(AuxWindowProperties::TabletNotFullScreen)
@@ -8137,8 +8284,6 @@ void InterSpec::closeGammaLinesWindow()
          || m_referencePhotopeakLines->persistedNuclides().size() )
       m_referencePhotopeakLines->serialize( xmlstate );
     m_referencePhotopeakLines->clearAllLines();
-    if( m_toolsTabs && m_toolsTabs->indexOf( m_referencePhotopeakLines ) >= 0 )
-      m_toolsTabs->removeTab( m_referencePhotopeakLines );
     delete m_referencePhotopeakLines;
     m_referencePhotopeakLines = nullptr;
   }//if( m_referencePhotopeakLines )
@@ -8148,16 +8293,13 @@ void InterSpec::closeGammaLinesWindow()
 
   if( m_toolsTabs )
   {
-    m_referencePhotopeakLines = new ReferencePhotopeakDisplay( m_spectrum,
-                                                   m_materialDB.get(),
-                                                   m_shieldingSuggestion,
-                                                   this );
-    setReferenceLineColors( nullptr );
-    
-    m_toolsTabs->addTab( m_referencePhotopeakLines, GammaLinesTabTitle, TabLoadPolicy );
+    assert( !m_referenceLinesContainer );
+    m_referenceLinesContainer = tool_tab_container();
+    m_toolsTabs->addTab( m_referenceLinesContainer, GammaLinesTabTitle, TabLoadPolicy );
     
+    // If no lines were showing, the widget will be created when the tab is shown, or its needed
     if( xmlstate.size() )
-      m_referencePhotopeakLines->deSerialize( xmlstate );
+      referenceLinesWidget()->deSerialize( xmlstate );
   }//if( m_toolsTabs )
   
   if( m_toolsTabs )
@@ -8170,18 +8312,16 @@ void InterSpec::handleToolTabChanged( int tab )
   if( !m_toolsTabs )
     return;
   
-  const int refTab = m_toolsTabs->indexOf(m_referencePhotopeakLines);
-  const int calibtab = m_toolsTabs->indexOf(m_energyCalTool);
+  const int calibtab = m_toolsTabs->indexOf(m_energyCalContainer);
   const int searchTab = m_toolsTabs->indexOf(m_nuclideSearchContainer);
   
-  if( m_referencePhotopeakLines && (tab == refTab) && !isMobile() )
-    m_referencePhotopeakLines->setFocusToIsotopeEdit();
-    
   if( m_nuclideSearch && (m_currentToolsTab==searchTab) )
     m_nuclideSearch->clearSearchEnergiesOnClient();
   
-  if( m_nuclideSearch && (tab==searchTab) )
-    m_nuclideSearch->loadSearchEnergiesToClient();
+  createToolTabContents( tab );
+  
+  if( tab == searchTab )
+    nuclideSearch()->loadSearchEnergiesToClient();
   
   if( tab == calibtab )
   {
@@ -8195,6 +8335,104 @@ void InterSpec::handleToolTabChanged( int tab )
 }//void InterSpec::handleToolTabChanged( int tabSwitchedTo )
 
 
+void InterSpec::createToolTabContents( const int tab )
+{
+  if( !m_toolsTabs || (tab < 0) || (tab >= m_toolsTabs->count()) )
+    return;
+  
+  WWidget *contents = m_toolsTabs->widget( tab );
+  
+  if( m_peakInfoContainer && (contents == m_peakInfoContainer) )
+  {
+    peakInfoDisplay();
+  }else if( m_referenceLinesContainer && (contents == m_referenceLinesContainer) )
+  {
+    ReferencePhotopeakDisplay *display = referenceLinesWidget();
+    if( display && !isMobile() )
+      display->setFocusToIsotopeEdit();
+  }else if( m_energyCalContainer && (contents == m_energyCalContainer) )
+  {
+    energyCalTool();
+  }else if( m_nuclideSearchContainer && (contents == m_nuclideSearchContainer) )
+  {
+    nuclideSearch();
+  }else
+  {
+    DeferredToolTab *deferred = dynamic_cast<DeferredToolTab *>( contents );
+    if( deferred )
+      deferred->create();
+  }
+}//void createToolTabContents( const int tab )
+
+
+IsotopeSearchByEnergy *InterSpec::nuclideSearch()
+{
+  if( m_nuclideSearch )
+    return m_nuclideSearch;
+  
+  m_nuclideSearch = new IsotopeSearchByEnergy( this, m_spectrum );
+  m_nuclideSearch->setLoadLaterWhenInvisible( true );
+  
+  // If tool tabs are showing, put in the tab; otherwise #showNuclideSearchWindow will place it
+  if( m_nuclideSearchContainer && !m_nuclideSearchWindow )
+    set_tool_tab_contents( m_nuclideSearchContainer, m_nuclideSearch );
+  
+  return m_nuclideSearch;
+}//IsotopeSearchByEnergy *nuclideSearch()
+
+
+PeakInfoDisplay *InterSpec::peakInfoDisplay()
+{
+  if( m_peakInfoDisplay )
+    return m_peakInfoDisplay;
+  
+  m_peakInfoDisplay = new PeakInfoDisplay( this, m_spectrum, m_peakModel );
+  if( m_automatedPeakSearchRunning )
+    m_peakInfoDisplay->enablePeakSearchButton( false );
+  
+  // If tool tabs are showing, put in the tab; otherwise #showPeakInfoWindow will place it
+  if( m_peakInfoContainer && !m_peakInfoWindow )
+    set_tool_tab_contents( m_peakInfoContainer, m_peakInfoDisplay );
+  
+  return m_peakInfoDisplay;
+}//PeakInfoDisplay *peakInfoDisplay()
+
+
+void InterSpec::finishDeferredStartup()
+{
+  m_startupFinished = true;
+  
+  // The tab showing when the page loads
+  if( m_toolsTabs )
+    createToolTabContents( m_toolsTabs->currentIndex() );
+  
+#if( !BUILD_FOR_WEB_DEPLOYMENT )
+  // There is only a single user, so we'll create the deferred tools now that the page is showing,
+  //  so switching to them later is snappy.  For web deployments we only create tools when first
+  //  used, to keep session creation cheap, and memory use down, when there are many sessions.
+  nuclideSearch();
+  peakInfoDisplay();
+  energyCalTool();
+  
+  for( int i = 0; m_toolsTabs && (i < m_toolsTabs->count()); ++i )
+  {
+    DeferredToolTab *deferred = dynamic_cast<DeferredToolTab *>( m_toolsTabs->widget(i) );
+    if( deferred )
+      deferred->create();
+  }//for( loop over tool tabs )
+  
+  if( m_referenceLinesContainer )
+    referenceLinesWidget();
+#endif
+  
+  // From the start of the constructor, through the client loading the page, until the tools are
+  //  ready; this is roughly how long until the user can interact with the app.
+  const auto elapsed = std::chrono::steady_clock::now() - m_constructionStart;
+  const auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>( elapsed ).count();
+  Wt::log("info") << "Time to interactive: " << elapsed_ms << " ms after InterSpec construction started";
+}//void finishDeferredStartup()
+
+
 SpecMeasManager *InterSpec::fileManager()
 {
   return m_fileManager;
@@ -9045,14 +9283,14 @@ void InterSpec::setSpectrum( std::shared_ptr<SpecMeas> meas,
   deleteEnergyCalPreserveWindow();
   
   if( options.testFlag(SetSpectrumOptions::CheckToPreservePreviousEnergyCal)
-      && !sameSpecFile && m_energyCalTool && !!meas && !!m_dataMeasurement )
+      && !sameSpecFile && !!meas && !!m_dataMeasurement )
   {
     switch( spec_type )
     {
       case SpecUtils::SpectrumType::Foreground:
         if( EnergyCalPreserveWindow::candidate(meas,previous) )
           m_preserveCalibWindow = new EnergyCalPreserveWindow( meas, spec_type,
-                                         previous, spec_type, m_energyCalTool );
+                                         previous, spec_type, energyCalTool() );
       break;
     
       case SpecUtils::SpectrumType::SecondForeground:
@@ -9060,7 +9298,7 @@ void InterSpec::setSpectrum( std::shared_ptr<SpecMeas> meas,
         if( EnergyCalPreserveWindow::candidate(meas,m_dataMeasurement) )
           m_preserveCalibWindow = new EnergyCalPreserveWindow( meas, spec_type,
                                                 m_dataMeasurement, SpecUtils::SpectrumType::Foreground,
-                                                m_energyCalTool );
+                                                energyCalTool() );
       break;
     };//switch( spec_type )
   
@@ -9081,7 +9319,7 @@ void InterSpec::setSpectrum( std::shared_ptr<SpecMeas> meas,
       }//if( propigate_peaks_fcns ) / else
       
     }
-  }//if( !sameSpecFile && m_energyCalTool && !!meas )
+  }//if( !sameSpecFile && !!meas )
   
   if( propigate_peaks_fcns )
   {
@@ -9655,9 +9893,12 @@ void InterSpec::updateGuiForPrimarySpecChange( std::set<int> display_sample_nums
 #endif
   }//if( m_detectorToShowMenu )
   
-  m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::Foreground );
-  m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::Background );
-  m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::SecondForeground );
+  if( m_timeSeries )
+  {
+    m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::Foreground );
+    m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::Background );
+    m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::SecondForeground );
+  }//if( m_timeSeries )
   
   if( m_displayedSamples.empty() )
     m_displayedSamples = validForegroundSamples();
@@ -9818,6 +10059,8 @@ void InterSpec::searchForSinglePeak( const double x )
   if( !m_dataMeasurement || !data )
     return;
   
+  InterSpecApp::FitCpuTimer cpu_timer( wApp->sessionId() );
+  
   const double xmin = m_spectrum->xAxisMinimum();
   const double xmax = m_spectrum->xAxisMaximum();
   
@@ -9941,6 +10184,8 @@ void InterSpec::searchForSinglePeak( const double x )
 
 void InterSpec::automatedPeakSearchStarted()
 {
+  m_automatedPeakSearchRunning = true;
+  
   if( m_peakInfoDisplay )
     m_peakInfoDisplay->enablePeakSearchButton( false );
 }//void automatedPeakSearchStarted()
@@ -9948,6 +10193,8 @@ void InterSpec::automatedPeakSearchStarted()
 
 void InterSpec::automatedPeakSearchCompleted()
 {
+  m_automatedPeakSearchRunning = false;
+  
   if( m_peakInfoDisplay )
     m_peakInfoDisplay->enablePeakSearchButton( true );
 }//void automatedPeakSearchCompleted()
@@ -10518,6 +10765,9 @@ void InterSpec::displayTimeSeriesData()
 {
   if( m_dataMeasurement && m_dataMeasurement->passthrough() )
   {
+    if( !m_timeSeries )
+      createTimeChart();
+    
     if( m_timeSeries->isHidden() )
     {
       m_timeSeries->setHidden( false );
@@ -10537,7 +10787,7 @@ void InterSpec::displayTimeSeriesData()
     m_timeSeries->setHighlightedIntervals( fore, SpecUtils::SpectrumType::Foreground );
     m_timeSeries->setHighlightedIntervals( back, SpecUtils::SpectrumType::Background );
     m_timeSeries->setHighlightedIntervals( second, SpecUtils::SpectrumType::SecondForeground );
-  }else
+  }else if( m_timeSeries )
   {
     m_timeSeries->setData( nullptr, {} );
     m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::Foreground );
@@ -10549,10 +10799,44 @@ void InterSpec::displayTimeSeriesData()
       m_timeSeries->setHidden( true );
       m_chartResizer->setHidden( m_timeSeries->isHidden() );
     }//if( !m_timeSeries->isHidden() )
-  }//if( passthrough ) / else
+  }//if( passthrough ) / else if( m_timeSeries )
 }//void displayTimeSeriesData()
 
 
+void InterSpec::createTimeChart()
+{
+  if( m_timeSeries )
+    return;
+  
+  m_timeSeries = new D3TimeChart();
+  m_timeSeries->setHidden( true );
+  
+  // Match the current state of the spectrum chart
+  m_timeSeries->setCompactAxis( m_spectrum->isAxisCompacted() );
+  m_timeSeries->showVerticalLines( m_spectrum->verticalLinesShowing() );
+  m_timeSeries->showHorizontalLines( m_spectrum->horizontalLinesShowing() );
+  if( m_colorTheme )
+    m_timeSeries->applyColorTheme( m_colorTheme );
+  
+  // No need to updated the default axis titles
+  //m_timeSeries->setY1AxisTitle( "Gamma CPS" );
+  //m_timeSeries->setY2AxisTitle( "Neutron CPS" );
+  //m_timeSeries->setXAxisTitle( "Time of Measurement (seconds)", "Time (seconds)" );
+  
+  m_timeSeries->chartDragged().connect( this, &InterSpec::timeChartDragged );
+  m_timeSeries->chartClicked().connect( this, &InterSpec::timeChartClicked );
+  
+#if( USE_CSS_FLEX_LAYOUT )
+  insertBefore( m_timeSeries, m_toolsResizer );
+#else
+  m_charts->addWidget( m_timeSeries );
+  
+  LOAD_JAVASCRIPT(wApp, "js/InterSpec.js", "InterSpec", wtjsInitFlexResizer);
+  m_charts->doJavaScript( "Wt.WT.InitFlexResizer('" + m_chartResizer->id() + "','" + m_timeSeries->id() + "');" );
+#endif
+}//void createTimeChart()
+
+
 std::set<int> InterSpec::sampleRangeToSet( int start_sample,  int end_sample,
                                 std::shared_ptr<const SpecMeas> meas,
                                 const std::set<int> &excluded_samples )
@@ -10845,7 +11129,7 @@ void InterSpec::displayForegroundData( const bool current_energy_range )
   
   m_spectrum->setData( dataH, current_energy_range );
   
-  if( !m_timeSeries->isHidden() )
+  if( m_timeSeries && !m_timeSeries->isHidden() )
     m_timeSeries->setHighlightedIntervals( sample_nums, SpecUtils::SpectrumType::Foreground );
 }//void displayForegroundData()
 
@@ -10867,7 +11151,7 @@ void InterSpec::displaySecondForegroundData()
     if( m_spectrum->secondData() )
       m_spectrum->setSecondData( nullptr );
     
-    if( !m_timeSeries->isHidden() )
+    if( m_timeSeries && !m_timeSeries->isHidden() )
       m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::SecondForeground );
     
     return;
@@ -10882,7 +11166,7 @@ void InterSpec::displaySecondForegroundData()
     
   m_spectrum->setSecondData( histH );
   
-  if( !m_timeSeries->isHidden() )
+  if( m_timeSeries && !m_timeSeries->isHidden() )
     m_timeSeries->setHighlightedIntervals( m_sectondForgroundSampleNumbers, SpecUtils::SpectrumType::SecondForeground );
 }//void displaySecondForegroundData()
 
@@ -10909,7 +11193,7 @@ void InterSpec::displayBackgroundData()
     if( m_spectrum->background() )
       m_spectrum->setBackground( nullptr );
     
-    if( !m_timeSeries->isHidden() )
+    if( m_timeSeries && !m_timeSeries->isHidden() )
       m_timeSeries->setHighlightedIntervals( {}, SpecUtils::SpectrumType::Background );
     
     return;
@@ -10924,14 +11208,14 @@ void InterSpec::displayBackgroundData()
   const float neutronCounts = backgroundH ? backgroundH->neutron_counts_sum() : -1.0f;
   m_spectrum->setBackground( backgroundH );
   
-  if( !m_timeSeries->isHidden() )
+  if( m_timeSeries && !m_timeSeries->isHidden() )
   {
     const auto background = SpecUtils::SpectrumType::Background;
     if( m_backgroundMeasurement != m_dataMeasurement )
       m_timeSeries->setHighlightedIntervals( {}, background );
     else
       m_timeSeries->setHighlightedIntervals( m_backgroundSampleNumbers, background );
-  }//if( !m_timeSeries->isHidden() )
+  }//if( m_timeSeries && !m_timeSeries->isHidden() )
   
   const bool canSub = (m_dataMeasurement && m_backgroundMeasurement);
   const bool isSub = m_spectrum->backgroundSubtract();
@@ -25,7 +25,11 @@
 
 #include <mutex>
 #include <string>
+#include <iomanip>
+#include <sstream>
+#include <time.h>
 #include <stdio.h>
+#include <algorithm>
 
 #if( !(defined(WIN32) || defined(UNDER_CE) || defined(_WIN32) || defined(WIN64)) )
 #include <pwd.h>
@@ -45,6 +49,7 @@
 #include <Wt/WText>
 #include <Wt/WTimer>
 #include <Wt/WLabel>
+#include <Wt/WLogger>
 #include <Wt/WServer>
 #include <Wt/WCheckBox>
 #include <Wt/WIOService>
@@ -68,6 +73,7 @@
 #include "SpecUtils/StringAlgo.h"
 
 #include "InterSpec/PopupDiv.h"
+#include "InterSpec/SpecMeas.h"
 #include "InterSpec/InterSpec.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/InterSpecUser.h"
@@ -77,6 +83,7 @@
 #include "InterSpec/ReactionGamma.h"
 #include "InterSpec/SpecMeasManager.h"
 #include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/IsotopeNameFilterModel.h"
 #include "InterSpec/ShowRiidInstrumentsAna.h"
 
 #if( BUILD_AS_ELECTRON_APP )
@@ -114,12 +121,61 @@ WT_DECLARE_WT_MEMBER
 
 namespace
 {
-#if( !BUILD_FOR_WEB_DEPLOYMENT )
   std::mutex AppInstancesMutex;
   std::set<InterSpecApp *> AppInstances;
   //note: could potentially use Wt::WServer::instance()->sessions() to retrieve
   //      sessionIds.
+  
+  /** How often, at most, a session updates its memory accounting, and checks the server budget. */
+  const std::chrono::seconds ns_resourceAccountingInterval( 5 );
+  
+#if( defined(MAX_SERVER_SPECTRUM_MEMMORY_SIZE_MB) && (MAX_SERVER_SPECTRUM_MEMMORY_SIZE_MB > 0) )
+  /** The total memory all sessions spectrum files can take up, before idle sessions are asked to
+   write their not-displayed files to disk.
+   */
+  const size_t ns_maxServerSpectrumMemory = size_t(1024) * 1024 * MAX_SERVER_SPECTRUM_MEMMORY_SIZE_MB;
+#else
+  const size_t ns_maxServerSpectrumMemory = 0;
 #endif
+  
+  
+  /** How often, at most, the resource usage of all sessions is written to the server log. */
+  const std::chrono::minutes ns_resourceReportInterval( 10 );
+  
+  /** When the usage report was last written to the log, as std::chrono::steady_clock ticks. */
+  std::atomic<int64_t> ns_lastResourceReportTicks( 0 );
+  
+  /** The number of #InterSpecApp::FitCpuTimer currently in existence, and that have ever been
+   created; used to split process CPU time between fits that overlap in time.
+   */
+  std::atomic<int> ns_activeFitTimers( 0 );
+  std::atomic<uint64_t> ns_fitTimersStarted( 0 );
+  
+  
+  /** Returns the CPU time, in seconds, used by all threads of this process, or a negative value if
+   this can not be determined.
+   */
+  double process_cpu_time()
+  {
+#if( defined(_WIN32) )
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if( !GetProcessTimes( GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time ) )
+      return -1.0;
+    
+    const auto to_int = []( const FILETIME &t ) -> uint64_t {
+      return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+    };
+    
+    return 1.0E-7 * static_cast<double>( to_int(kernel_time) + to_int(user_time) );
+#elif( defined(CLOCK_PROCESS_CPUTIME_ID) )
+    struct timespec ts;
+    if( clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts ) != 0 )
+      return -1.0;
+    return static_cast<double>(ts.tv_sec) + 1.0E-9*static_cast<double>(ts.tv_nsec);
+#else
+    return -1.0;
+#endif
+  }//double process_cpu_time()
 }//namespace
 
 
@@ -128,7 +184,12 @@ InterSpecApp::InterSpecApp( const WEnvironment &env )
      m_viewer( 0 ),
      m_layout( nullptr ),
      m_lastAccessTime( std::chrono::steady_clock::now() ),
-     m_activeTimeInSession{ std::chrono::seconds(0) }
+     m_activeTimeInSession{ std::chrono::seconds(0) },
+     m_residentBytes( 0 ),
+     m_cachedBytes( 0 ),
+     m_fitCpuMicroSeconds( 0 ),
+     m_lastActiveTicks( m_lastAccessTime.time_since_epoch().count() ),
+     m_lastAccountingTime( m_lastAccessTime )
 #if( IOS )
     , m_orientation( InterSpecApp::DeviceOrientation::Unknown )
     , m_safeAreas{ 0.0f }
@@ -146,8 +207,12 @@ InterSpecApp::InterSpecApp( const WEnvironment &env )
  
   enableUpdates( true );
   
-  //Might as well initialize the DecayDataBaseServer, but in the background
-  WServer::instance()->ioService().boost::asio::io_service::post( &DecayDataBaseServer::initialize );
+  //Might as well initialize the DecayDataBaseServer, and the nuclide name suggestion index that
+  //  depends on it, but in the background
+  WServer::instance()->ioService().boost::asio::io_service::post( [](){
+    DecayDataBaseServer::initialize();
+    IsotopeNameFilterModel::initializeSuggestionIndex();
+  } );
    
   setupDomEnvironment();
   setupWidgets( true );
@@ -161,12 +226,10 @@ InterSpecApp::~InterSpecApp()
     InterSpecServer::set_session_destructing( m_externalToken.c_str() );
 #endif
 
-#if( !BUILD_FOR_WEB_DEPLOYMENT )
   {
     std::lock_guard<std::mutex> lock( AppInstancesMutex );
     AppInstances.erase( this );
   }
-#endif
 }//~InterSpecApp()
 
 
@@ -764,12 +827,10 @@ void InterSpecApp::setupWidgets( const bool attemptStateLoad  )
     m_viewer->osThemeChange( themeiter->second[0] );
 #endif
 
-#if( !BUILD_FOR_WEB_DEPLOYMENT )
   {
     std::lock_guard<std::mutex> lock( AppInstancesMutex );
     AppInstances.insert( this );
   }
-#endif
   
   if( m_viewer->m_user )
     cerr << "Have started session " << sessionId() << " for user "
@@ -940,6 +1001,7 @@ bool InterSpecApp::userOpenFromFileSystem( const std::string &path )
     return false;
   return m_viewer->userOpenFileFromFilesystem( path );
 }//bool userOpenFromFileSystem(...)
+#endif //#if( !BUILD_FOR_WEB_DEPLOYMENT )
 
 
 std::set<InterSpecApp *> InterSpecApp::runningInstances()
@@ -948,7 +1010,233 @@ std::set<InterSpecApp *> InterSpecApp::runningInstances()
   return AppInstances;
 }//set<InterSpecApp *> runningInstances()
 
-#endif //#if( !BUILD_FOR_WEB_DEPLOYMENT )
+
+std::vector<InterSpecApp::SessionResourceUsage> InterSpecApp::sessionResourceUsage()
+{
+  const int64_t now_ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+  
+  std::vector<SessionResourceUsage> answer;
+  
+  std::lock_guard<std::mutex> lock( AppInstancesMutex );
+  for( InterSpecApp *app : AppInstances )
+  {
+    SessionResourceUsage usage;
+    usage.sessionId = app->sessionId();
+    usage.residentBytes = app->m_residentBytes.load();
+    usage.cachedBytes = app->m_cachedBytes.load();
+    usage.fitCpuSeconds = 1.0E-6 * static_cast<double>( app->m_fitCpuMicroSeconds.load() );
+    const int64_t idle_ticks = std::max( now_ticks - app->m_lastActiveTicks.load(), int64_t(0) );
+    usage.idleTime = std::chrono::steady_clock::duration( idle_ticks );
+    answer.push_back( usage );
+  }//for( InterSpecApp *app : AppInstances )
+  
+  return answer;
+}//std::vector<SessionResourceUsage> sessionResourceUsage()
+
+
+std::string InterSpecApp::sessionResourceUsageReport()
+{
+  const std::vector<SessionResourceUsage> usages = sessionResourceUsage();
+  
+  size_t total_resident = 0, total_cached = 0;
+  double total_cpu = 0.0;
+  for( const SessionResourceUsage &usage : usages )
+  {
+    total_resident += usage.residentBytes;
+    total_cached += usage.cachedBytes;
+    total_cpu += usage.fitCpuSeconds;
+  }
+  
+  std::ostringstream report;
+  report << std::fixed << std::setprecision(1)
+         << usages.size() << " sessions, holding " << (total_resident / (1024.0*1024.0))
+         << " MB of spectrum files (" << (total_cached / (1024.0*1024.0)) << " MB not displayed),"
+         << " and having used " << total_cpu << " s of CPU fitting";
+  
+  for( const SessionResourceUsage &usage : usages )
+  {
+    const double idle_seconds = std::chrono::duration<double>( usage.idleTime ).count();
+    report << "\n  session " << usage.sessionId
+           << ": resident=" << (usage.residentBytes / (1024.0*1024.0)) << " MB"
+           << ", cached=" << (usage.cachedBytes / (1024.0*1024.0)) << " MB"
+           << ", fit-cpu=" << usage.fitCpuSeconds << " s"
+           << ", idle=" << idle_seconds << " s";
+  }//for( const SessionResourceUsage &usage : usages )
+  
+  return report.str();
+}//std::string sessionResourceUsageReport()
+
+
+void InterSpecApp::addFitCpuTime( const std::string &sessionId, const double cpu_seconds )
+{
+  if( !(cpu_seconds > 0.0) || IsInf(cpu_seconds) )
+    return;
+  
+  const int64_t micro_seconds = static_cast<int64_t>( 1.0E6 * cpu_seconds );
+  
+  std::lock_guard<std::mutex> lock( AppInstancesMutex );
+  for( InterSpecApp *app : AppInstances )
+  {
+    //WApplication::sessionId() is only changed by WApplication::changeSessionId(), which we dont use
+    if( app->sessionId() == sessionId )
+    {
+      app->m_fitCpuMicroSeconds += micro_seconds;
+      return;
+    }
+  }//for( InterSpecApp *app : AppInstances )
+}//void addFitCpuTime( const std::string &sessionId, const double cpu_seconds )
+
+
+InterSpecApp::FitCpuTimer::FitCpuTimer( const std::string &sessionId )
+  : m_sessionId( sessionId ),
+    m_startActiveTimers( ++ns_activeFitTimers ),
+    m_startTimersStarted( ++ns_fitTimersStarted ),
+    m_startCpuTime( process_cpu_time() )
+{
+}
+
+
+InterSpecApp::FitCpuTimer::~FitCpuTimer()
+{
+  const double end_cpu_time = process_cpu_time();
+  const uint64_t num_started = ns_fitTimersStarted.load();
+  --ns_activeFitTimers;
+  
+  if( (m_startCpuTime < 0.0) || !(end_cpu_time > m_startCpuTime) || m_sessionId.empty() )
+    return;
+  
+  // Split the CPU time evenly between all the fits that ran at some point during this one; the
+  //  GUI and other sessions threads are also counted, but fits should dominate while they run.
+  const uint64_t num_concurrent = static_cast<uint64_t>( std::max(m_startActiveTimers, 1) )
+                                  + (num_started - m_startTimersStarted);
+  
+  InterSpecApp::addFitCpuTime( m_sessionId, (end_cpu_time - m_startCpuTime) / num_concurrent );
+}//~FitCpuTimer()
+
+
+std::set<const SpecMeas *> InterSpecApp::displayedMeasurements() const
+{
+  std::set<const SpecMeas *> displayed;
+  if( !m_viewer )
+    return displayed;
+  
+  for( const auto type : { SpecUtils::SpectrumType::Foreground,
+                           SpecUtils::SpectrumType::Background,
+                           SpecUtils::SpectrumType::SecondForeground } )
+  {
+    const std::shared_ptr<const SpecMeas> meas = m_viewer->measurment( type );
+    if( meas )
+      displayed.insert( meas.get() );
+  }//for( loop over spectrum types )
+  
+  return displayed;
+}//std::set<const SpecMeas *> displayedMeasurements() const
+
+
+void InterSpecApp::spillCachedMeasurements()
+{
+  SpecMeasManager *manager = m_viewer ? m_viewer->fileManager() : nullptr;
+  if( !manager )
+    return;
+  
+  const size_t nbytes = m_cachedBytes.load();
+  manager->releaseCachedSpectra( displayedMeasurements() );
+  
+  // Only the displayed spectra are left in memory now
+  m_residentBytes -= std::min( nbytes, m_residentBytes.load() );
+  m_cachedBytes = 0;
+  
+  log("info") << "Wrote " << (nbytes / 1024) << " kb of not-displayed spectrum files to disk,"
+                 " to stay within the server memory budget";
+}//void spillCachedMeasurements()
+
+
+void InterSpecApp::updateResourceAccounting()
+{
+  const auto now = std::chrono::steady_clock::now();
+  if( (now - m_lastAccountingTime) < ns_resourceAccountingInterval )
+    return;
+  
+  m_lastAccountingTime = now;
+  
+  if( !m_viewer )
+    return;
+  
+  // Count the displayed files, making sure to only count each file once
+  const std::set<const SpecMeas *> displayed = displayedMeasurements();
+  size_t resident_bytes = 0;
+  for( const SpecMeas *meas : displayed )
+    resident_bytes += meas->memmorysize();
+  
+  // And the files kept in memory, but not displayed; both the #SpecMeasManager cache, and the
+  //  files whose #SpectraFileHeader keeps a reference.
+  SpecMeasManager *manager = m_viewer->fileManager();
+  const size_t cached_bytes = manager ? manager->cachedSpectraMemorySize( displayed ) : size_t(0);
+  resident_bytes += cached_bytes;
+  
+  m_residentBytes = resident_bytes;
+  m_cachedBytes = cached_bytes;
+  
+  // Periodically write all sessions usage to the server log; only one session needs to do this.
+  const int64_t now_ticks = now.time_since_epoch().count();
+  const int64_t report_interval_ticks
+                = std::chrono::duration_cast<std::chrono::steady_clock::duration>( ns_resourceReportInterval ).count();
+  int64_t last_report_ticks = ns_lastResourceReportTicks.load();
+  if( ((now_ticks - last_report_ticks) >= report_interval_ticks)
+     && ns_lastResourceReportTicks.compare_exchange_strong( last_report_ticks, now_ticks ) )
+  {
+    Wt::log("info") << "Session resource usage: " << sessionResourceUsageReport();
+  }
+  
+  if( !ns_maxServerSpectrumMemory )
+    return;
+  
+  std::vector<SessionResourceUsage> usages = sessionResourceUsage();
+  
+  size_t total_bytes = 0;
+  for( const SessionResourceUsage &usage : usages )
+    total_bytes += usage.residentBytes;
+  
+  if( total_bytes <= ns_maxServerSpectrumMemory )
+    return;
+  
+  // Ask the least recently active sessions to write their cached (not displayed) files to disk,
+  //  until we estimate we'll be under budget.  We'll include this session, as it may be the one
+  //  that loaded the large file, but since it is most recently active, it will be asked last.
+  std::sort( begin(usages), end(usages), []( const SessionResourceUsage &lhs, const SessionResourceUsage &rhs ){
+    return lhs.idleTime > rhs.idleTime;
+  } );
+  
+  Wt::WServer *server = Wt::WServer::instance();
+  for( const SessionResourceUsage &usage : usages )
+  {
+    if( total_bytes <= ns_maxServerSpectrumMemory )
+      break;
+    
+    if( !usage.cachedBytes )
+      continue;
+    
+    total_bytes -= std::min( usage.cachedBytes, total_bytes );
+    
+    if( usage.sessionId == sessionId() )
+    {
+      spillCachedMeasurements();
+    }else if( server )
+    {
+      server->post( usage.sessionId, [](){
+        InterSpecApp *app = dynamic_cast<InterSpecApp *>( WApplication::instance() );
+        if( app )
+          app->spillCachedMeasurements();
+      } );
+    }//if( this session ) / else
+  }//for( const SessionResourceUsage &usage : usages )
+  
+  if( total_bytes > ns_maxServerSpectrumMemory )
+    Wt::log("warning") << "Spectrum files displayed by all sessions take up "
+                       << (total_bytes / (1024*1024)) << " MB, which is over the server budget of "
+                       << (ns_maxServerSpectrumMemory / (1024*1024)) << " MB; session usage: "
+                       << sessionResourceUsageReport();
+}//void updateResourceAccounting()
 
 #if( defined(WIN32) && BUILD_AS_ELECTRON_APP )
   //When users drag files from Outlook on windows into the app
@@ -1029,10 +1317,14 @@ void InterSpecApp::notify( const Wt::WEvent& event )
       if( duration < std::chrono::seconds(300) )
         m_activeTimeInSession += duration;
       m_lastAccessTime = thistime;
+      m_lastActiveTicks = thistime.time_since_epoch().count();
     }//if( userEvent )
 
      WApplication::notify( event );
     
+    if( userEvent )
+      updateResourceAccounting();
+    
     //Note that event.eventType() may have change (although I dont know how/why)
 //    if( userEvent )
 //    {
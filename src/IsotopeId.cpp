@@ -256,6 +256,35 @@ double fractionDetectedWeight( const std::vector<SandiaDecay::EnergyRatePair> &s
   int num_accounted_for = 0;
   int num_total = 0;
   
+  // Evaluate the detector response for all the gammas at once, instead of one at a time
+  vector<float> gamma_energies( source_gammas.size() );
+  for( size_t i = 0; i < source_gammas.size(); ++i )
+    gamma_energies[i] = static_cast<float>( source_gammas[i].energy );
+  
+  vector<float> gamma_sigmas;
+  if( hasResolutionResponse )
+  {
+    gamma_sigmas.resize( gamma_energies.size() );
+    response->peakResolutionSigmas( gamma_energies.data(), gamma_energies.size(), gamma_sigmas.data() );
+  }
+  
+  vector<double> gamma_effs;
+  if( response )
+  {
+    gamma_effs.resize( gamma_energies.size() );
+    response->efficiencies( gamma_energies.data(), gamma_energies.size(), distance, gamma_effs.data() );
+  }
+  
+  // And the shielding attenuation coefficients; gammas below 1 keV are skipped in the loop below, so
+  //  give them an energy the cross-sections are valid at.
+  vector<float> gamma_xs_energies = gamma_energies;
+  for( float &energy : gamma_xs_energies )
+    energy = (energy < 1.0f) ? static_cast<float>(PhysicalUnits::MeV) : energy;
+  
+  vector<float> gamma_xs;
+  MassAttenuation::massAttenuationCoeficients( static_cast<int>(shielding_an), gamma_xs_energies,
+                                               gamma_xs );
+  
   for( size_t i = 0; i < source_gammas.size(); ++i )
   {
     //check to see if there is a peak cooresponding to this 'aep'
@@ -267,9 +296,9 @@ double fractionDetectedWeight( const std::vector<SandiaDecay::EnergyRatePair> &s
     if( energy < 1.0 )
       continue;
     
-    const double exp_resolution = (hasResolutionResponse ? response->peakResolutionSigma( energy ) : float((highE-lowE)/3.0) );
-    const double det_eff = (!!response ? response->efficiency( energy, distance ) : 1.0);
-    const double xs = MassAttenuation::massAttenuationCoeficient( shielding_an, energy );
+    const double exp_resolution = (hasResolutionResponse ? gamma_sigmas[i] : float((highE-lowE)/3.0) );
+    const double det_eff = (!!response ? gamma_effs[i] : 1.0);
+    const double xs = gamma_xs[i];
     const double transmition = exp( -shielding_ad * xs );
     
     typedef deque< std::shared_ptr<const PeakDef> >::const_iterator Iter_t;
@@ -23,9 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
 #include <string>
 #include <vector>
+#include <utility>
 #include <algorithm>
+#include <stdexcept>
 
 #include <boost/any.hpp>
 
@@ -67,6 +70,72 @@ namespace
     const T arr;
   };//struct index_compare
   
+  
+  /** Server-wide, immutable, lookup tables of element and nuclide names used to generate
+   suggestions, so that each keystroke in each session does not need to loop over the whole
+   nuclide database, lowercasing names and formatting mass numbers as it goes.
+   */
+  struct SuggestionIndex
+  {
+    struct ElementInfo
+    {
+      std::string lower_name;
+      std::string lower_symbol;
+      
+      /** The nuclides of the element that can be suggested (i.e., not stable, and have
+       transitions), along with their mass number as a string.
+       */
+      std::vector<std::pair<const SandiaDecay::Nuclide *,std::string>> nuclides;
+    };//struct ElementInfo
+    
+    /** Lowercase element symbols and names, sorted, so elements can be found by prefix. */
+    std::vector<std::pair<std::string,const SandiaDecay::Element *>> element_labels;
+    
+    std::map<const SandiaDecay::Element *,ElementInfo> elements;
+    
+    /** The suggestable nuclides, by mass number, in database order. */
+    std::map<int,std::vector<const SandiaDecay::Nuclide *>> nuclides_by_mass;
+    
+    SuggestionIndex()
+    {
+      const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+      if( !db )
+        throw runtime_error( "IsotopeNameFilterModel: nuclide database not available" );
+      
+      for( const SandiaDecay::Element *el : db->elements() )
+      {
+        ElementInfo &info = elements[el];
+        info.lower_name = SpecUtils::to_lower_ascii_copy( el->name );
+        info.lower_symbol = SpecUtils::to_lower_ascii_copy( el->symbol );
+        
+        element_labels.emplace_back( info.lower_symbol, el );
+        if( info.lower_name != info.lower_symbol )
+          element_labels.emplace_back( info.lower_name, el );
+        
+        for( const SandiaDecay::Nuclide *nuc : db->nuclides( el ) )
+        {
+          if( IsInf(nuc->halfLife) || nuc->decaysToChildren.empty() )
+            continue;
+          info.nuclides.emplace_back( nuc, std::to_string(nuc->massNumber) );
+        }
+      }//for( const SandiaDecay::Element *el : db->elements() )
+      
+      std::sort( begin(element_labels), end(element_labels) );
+      
+      for( const SandiaDecay::Nuclide *nuc : db->nuclides() )
+      {
+        if( !IsInf(nuc->halfLife) && !nuc->decaysToChildren.empty() )
+          nuclides_by_mass[nuc->massNumber].push_back( nuc );
+      }
+    }//SuggestionIndex()
+  };//struct SuggestionIndex
+  
+  
+  const SuggestionIndex &suggestion_index()
+  {
+    static const SuggestionIndex index;
+    return index;
+  }
 }//namespace
 
 IsotopeNameFilterModel::IsotopeNameFilterModel( WObject *parent )
@@ -85,6 +154,18 @@ IsotopeNameFilterModel::~IsotopeNameFilterModel()
 }
 
 
+void IsotopeNameFilterModel::initializeSuggestionIndex()
+{
+  try
+  {
+    suggestion_index();
+  }catch( std::exception &e )
+  {
+    cerr << "IsotopeNameFilterModel::initializeSuggestionIndex(): " << e.what() << endl;
+  }
+}//void initializeSuggestionIndex()
+
+
 void IsotopeNameFilterModel::excludeNuclides( const bool exclude )
 {
   m_includeNuclides = !exclude;
@@ -494,23 +575,19 @@ std::set<const SandiaDecay::Element *> IsotopeNameFilterModel::possibleElements(
                                         const std::vector<string> &alphastrs )
 {
   std::set<const SandiaDecay::Element *> candidate_elements;
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+  const SuggestionIndex &index = suggestion_index();
+  const auto &labels = index.element_labels;
   
-  //suggest based off of alphastrs
-  const std::vector<const SandiaDecay::Element *> &elements = db->elements();
-  
-  for( const SandiaDecay::Element *el : elements )
+  //suggest based off of alphastrs; labels starting with a string are all consecutive
+  for( const string &str : alphastrs )
   {
-    const string name   = SpecUtils::to_lower_ascii_copy( el->name );
-    const string symbol = SpecUtils::to_lower_ascii_copy( el->symbol );
-    
-    for( string str : alphastrs )
+    const pair<string,const SandiaDecay::Element *> key( str, nullptr );
+    for( auto pos = std::lower_bound( begin(labels), end(labels), key );
+        (pos != end(labels)) && SpecUtils::starts_with( pos->first, str.c_str() ); ++pos )
     {
-      if( SpecUtils::starts_with( symbol, str.c_str() )
-         || SpecUtils::starts_with( name, str.c_str() ) )
-        candidate_elements.insert( el );
-    }//for( const string &str : alphastrs )
-  }//for( const SandiaDecay::Element *el : elements )
+      candidate_elements.insert( pos->second );
+    }
+  }//for( const string &str : alphastrs )
   
   return candidate_elements;
 }//possibleElements
@@ -523,17 +600,20 @@ void IsotopeNameFilterModel::suggestNuclides(
                                           vector<const SandiaDecay::Nuclide *> &suggestions,
                                           vector< const SandiaDecay::Element * > &suggest_elements )
 {
-  const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+  const SuggestionIndex &index = suggestion_index();
   
   for( const SandiaDecay::Element *el : candidate_elements )
   {
+    const auto info_pos = index.elements.find( el );
+    if( info_pos == end(index.elements) )
+      continue;
+    const SuggestionIndex::ElementInfo &info = info_pos->second;
+    
     bool is_exact_element = false;
     if( numericstrs.empty() )
     {
-      const string name   = SpecUtils::to_lower_ascii_copy( el->name );
-      const string symbol = SpecUtils::to_lower_ascii_copy( el->symbol );
-      for( string str : alphastrs )
-        is_exact_element |= (symbol==str || name==str);
+      for( const string &str : alphastrs )
+        is_exact_element |= (info.lower_symbol==str || info.lower_name==str);
     }//if( numericstrs.empty() )
     
     if( numericstrs.empty() && !is_exact_element )
@@ -545,46 +625,35 @@ void IsotopeNameFilterModel::suggestNuclides(
       if( numericstrs.empty() && is_exact_element )
         suggest_elements.push_back( el );
       
-      const vector<const SandiaDecay::Nuclide *> nuclides = db->nuclides( el );
-      
-      for( const SandiaDecay::Nuclide *nuc : nuclides )
+      for( const auto &nuc_mass : info.nuclides )
       {
-        if( IsInf(nuc->halfLife) || nuc->decaysToChildren.empty() )
-          continue;
+        const SandiaDecay::Nuclide *nuc = nuc_mass.first;
         
         bool numeric_compat = false;
         for( const string &str : numericstrs )
-          numeric_compat |= SpecUtils::contains( std::to_string(nuc->massNumber), str.c_str() );
+          numeric_compat |= SpecUtils::contains( nuc_mass.second, str.c_str() );
         
         if( metalevel > 0 && metalevel!=nuc->isomerNumber )
           numeric_compat = false;
         
         if( numeric_compat || numericstrs.empty() )
           suggestions.push_back( nuc );
-      }//for( const SandiaDecay::Nuclide *nuc : nuclides )
+      }//for( const auto &nuc_mass : info.nuclides )
     }//if( there are no numbers, and start of an element name ) / else
   }//for( const SandiaDecay::Element *el : candidate_elements )
   
   
   if( alphastrs.empty() )
   {
-    const std::vector<const SandiaDecay::Nuclide *> &nucs = db->nuclides();
-    std::vector<const SandiaDecay::Nuclide *>::const_iterator pos;
-    for( pos = nucs.begin(); pos != nucs.end(); ++pos )
+    for( const string &str : numericstrs )
     {
-      const SandiaDecay::Nuclide *nuc = (*pos);
-      if( IsInf(nuc->halfLife) || nuc->decaysToChildren.empty() )
-        continue;
-      
-      for( string str : numericstrs )
+      try
       {
-        try
-        {
-          if( nuc->massNumber==std::stoi(str) )
-            suggestions.push_back( nuc );
-        }catch(...){ cerr << "Shouldnt ever be here" << endl; }
-      }//for( string str : numericstrs )
-    }//for( pos = nucs.begin(); pos != nucs.end(); ++pos )
+        const auto pos = index.nuclides_by_mass.find( std::stoi(str) );
+        if( pos != end(index.nuclides_by_mass) )
+          suggestions.insert( end(suggestions), begin(pos->second), end(pos->second) );
+      }catch(...){ cerr << "Shouldnt ever be here" << endl; }
+    }//for( const string &str : numericstrs )
   }//if( the user has only typed in numbers )
 
 }//suggestNuclides(...)
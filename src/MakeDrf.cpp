@@ -24,6 +24,7 @@
 #include "InterSpec_config.h"
 
 #include <set>
+#include <cmath>
 #include <regex>
 #include <deque>
 #include <fstream>
@@ -110,6 +111,9 @@ extern void android_download_workaround( Wt::WResource *resource, std::string de
 namespace
 {
   const float ns_NaI3x3IntrinsicEff = 0.47096f; //linear interpolation based on Efficiency.csv for generic 3x3. So could be improved...
+  
+  /** Number of resampled data sets to fit when estimating coefficient uncertainties by resampling. */
+  const size_t ns_num_bootstrap_trials = 250;
 
   bool source_info_from_lib_file( string srcname, const string &filename,
                                   double &activity, boost::posix_time::ptime &activityDate, string &comments )
@@ -305,6 +309,38 @@ namespace
   }//float effEqnUncert(...)
   
   
+  /** Returns the intrinsic efficiency equation, as HTML, for display. */
+  string intrinsic_eff_eqn_html( const vector<float> &coefs )
+  {
+    if( coefs.empty() )
+      return "";
+    
+    string eqn = "Eff<sub>int.</sub>(x) = exp( ";
+    for( size_t i = 0; i < coefs.size(); ++i )
+    {
+      const float val = fabs(coefs[i]);
+      char buffer[64] = {'\0'};
+      
+      //We will print to 5 significant digits, AFTER the decimal place since
+      //  this is a sum of terms.
+      const string frmtstr = (val > 1.0) ? ("%." + std::to_string( static_cast<int>(std::ceil(std::log10(val)))+5 ) + "g") : string("%.5g");
+      snprintf( buffer, sizeof(buffer), frmtstr.c_str(), val );
+      
+      eqn += (coefs[i]>=0.0) ? "+" : "-";
+      eqn += i ? " " : "";
+      eqn += buffer;
+      eqn += i ? "*log(x)" : "";
+      eqn += (i > 1) ? ("<sup>" + std::to_string(i) + "</sup> ") : string(" ");
+    }
+    eqn += ")";
+    
+    //eqn += " (x in ";
+    //eqn += (isMeV ? "MeV)" : "keV)");
+    
+    return eqn;
+  }//string intrinsic_eff_eqn_html(...)
+  
+  
   
   /** Class to downlaod CSV that contains info fit for. */
   class DrfSummaryBase : public Wt::WResource
@@ -1384,6 +1420,7 @@ MakeDrf::MakeDrf( InterSpec *viewer, MaterialDB *materialDB,
   m_effEqnUnits( nullptr ),
   m_effOptionGroup( nullptr ),
   m_airAttenuate( nullptr ),
+  m_bootstrapUncerts( nullptr ),
   m_chartLowerE( nullptr ),
   m_chartUpperE( nullptr ),
   m_errorMsg( nullptr ),
@@ -1485,6 +1522,15 @@ MakeDrf::MakeDrf( InterSpec *viewer, MaterialDB *materialDB,
   m_airAttenuate->checked().connect( this, &MakeDrf::handleSourcesUpdates );
   m_airAttenuate->unChecked().connect( this, &MakeDrf::handleSourcesUpdates );
   
+  m_bootstrapUncerts = new WCheckBox( "Resample uncerts.", genOpts );
+  m_bootstrapUncerts->setChecked( false );
+  m_bootstrapUncerts->setInline( false );
+  m_bootstrapUncerts->setToolTip( "Estimate the uncertainties of the fit coefficients by refitting"
+                                  " a few hundred data sets, with the peak areas and widths varied"
+                                  " according to their uncertainties." );
+  m_bootstrapUncerts->checked().connect( this, &MakeDrf::handleSourcesUpdates );
+  m_bootstrapUncerts->unChecked().connect( this, &MakeDrf::handleSourcesUpdates );
+  
   m_chart = new MakeDrfChart();
   DrfChartHolder *chartholder = new DrfChartHolder( m_chart, nullptr );
   upperLayout->addWidget( chartholder, 0, 1 );
@@ -2217,13 +2263,12 @@ void MakeDrf::handleSourcesUpdates()
         };//trans_frac lambda
         
         
-        auto src_rate = [&mixtures,trans_frac,diameter]( const float energy, const float width,
-                                                MakeDrfSrcDef * const src, DrfPeak * const peak,
-                                                float &source_count_rate,
-                                                float &incidentGamma, float &fracUncert ) {
-          source_count_rate = incidentGamma = fracUncert = 0.0;
+        auto src_rate = [&mixtures,trans_frac]( const float energy, const float width,
+                                                MakeDrfSrcDef * const src, DrfPeak * const peak ) -> PeakSourceRate {
+          PeakSourceRate answer;
+          answer.rate = 0.0;
+          answer.distance = src->distance();
           
-          const double distance = src->distance();
           const double transmittion_factor = trans_frac( energy, src );
           const SandiaDecay::Nuclide * const nuc = src->nuclide();
           
@@ -2233,7 +2278,7 @@ void MakeDrf::handleSourcesUpdates()
             for( const auto &r : rates )
             {
               if( fabs(r.energy - energy) < width )
-                source_count_rate += (r.numPerSecond * transmittion_factor);
+                answer.rate += (r.numPerSecond * transmittion_factor);
             }
           }else
           {
@@ -2242,19 +2287,14 @@ void MakeDrf::handleSourcesUpdates()
             
             const double activity = src->activityAtSpectrumTime();
             const double br = peak->m_userBr->value();
-            source_count_rate += transmittion_factor * br * activity;
+            answer.rate += transmittion_factor * br * activity;
           }
           
           //If we get here on initial GUI load, we seem to get error validating
           //  the uncertainty (hence a workaround is used to delay first reading)
+          answer.fractionalUncert = (answer.rate > 0.0) ? src->fractionalActivityUncertainty() : 0.0;
           
-          if( source_count_rate > 0.0f )
-          {
-            const double livetime = peak->m_livetime;
-            const double fracSolidAngle = DetectorPeakResponse::fractionalSolidAngle( diameter, distance );
-            incidentGamma = source_count_rate * livetime * fracSolidAngle;
-            fracUncert = src->fractionalActivityUncertainty();
-          }//if( source_count_rate > 0.0f )
+          return answer;
         };//src_rate labmda
         
         MakeDrfFit::DetEffDataPoint effpoint;
@@ -2264,9 +2304,8 @@ void MakeDrf::handleSourcesUpdates()
         {
           point.distance = srcDef->distance();
           
-          float source_count_rate, expected, fracUncert;
-          src_rate( point.energy, width, srcDef, drfPeak, source_count_rate, expected, fracUncert );
-          
+          vector<PeakSourceRate> rates;
+          rates.push_back( src_rate( point.energy, width, srcDef, drfPeak ) );
           
           //Now loop through all the other nuclides and get their expected contribtion
           for( const auto &nuc_to_rates : mixtures )
@@ -2287,36 +2326,11 @@ void MakeDrf::handleSourcesUpdates()
             
             assert( otherSrcDef != srcDef );
             
-            float other_source_count_rate, other_expected, other_fracUncert;
-            src_rate( point.energy, width, otherSrcDef, drfPeak, other_source_count_rate, other_expected, other_fracUncert );
-            
-            if( other_source_count_rate > 0.0 )
-            {
-              fracUncert = sqrt( pow(expected*fracUncert,2.0f) + pow(other_expected*other_fracUncert,2.0f) );
-              expected += other_expected;
-              source_count_rate += other_source_count_rate;
-              
-              //ToDo: To MakeDrfChart::DataPoint add a other source count rate and uncertainty field.
-              
-              fracUncert /= expected;
-            }
+            //ToDo: To MakeDrfChart::DataPoint add a other source count rate and uncertainty field.
+            rates.push_back( src_rate( point.energy, width, otherSrcDef, drfPeak ) );
           }//for( const auto &nuc_to_rates : mixtures )
           
-          
-          point.source_count_rate = source_count_rate;
-          point.source_count_rate_uncertainty = source_count_rate*fracUncert;
-          
-          const double eff = point.peak_area / expected;
-          
-          double fracUncert2 = 0.0;
-          if( point.peak_area_uncertainty > 0.0f )
-            fracUncert2 += std::pow( point.peak_area_uncertainty / point.peak_area, 2.0f );
-          if( point.source_count_rate_uncertainty > 0.0f )
-            fracUncert2 += std::pow( point.source_count_rate_uncertainty / point.source_count_rate, 2.0f );
-          
-          effpoint.energy = point.energy;
-          effpoint.efficiency = eff;
-          effpoint.efficiency_uncert = sqrt(fracUncert2);
+          effpoint = efficiencyDataPoint( point, rates, diameter );
         }catch( std::exception &e )
         {
           cerr << "handleSourcesUpdates: got exception: " << e.what() << endl;
@@ -2547,11 +2561,13 @@ void MakeDrf::fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
   //  not being called if this widget is deleted before fit is done.
   auto updater = boost::bind( &MakeDrf::updateFwhmEqn, this, boost::placeholders::_1,
                              boost::placeholders::_2, boost::placeholders::_3,
-                             static_cast<int>(fnctnlForm), fitid );
+                             static_cast<int>(fnctnlForm), fitid, boost::placeholders::_4 );
   
   const string thisid = id();
+  const bool bootstrap = m_bootstrapUncerts->isChecked();
+  const vector<float> band_energies = bootstrap ? m_chart->equationEnergies() : vector<float>{};
   
-  auto worker = [sessionId,fnctnlForm,peaks,isHighResolution,sqrtEqnOrder,updater,thisid]() {
+  auto worker = [sessionId,fnctnlForm,peaks,isHighResolution,sqrtEqnOrder,updater,thisid,bootstrap,band_energies]() {
     try
     {
       auto peakdequ = std::make_shared<std::deque< std::shared_ptr<const PeakDef> > >( peaks.begin(), peaks.end() );
@@ -2561,6 +2577,23 @@ void MakeDrf::fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
       vector<float> fwhm_coefs, fwhm_coefs_uncert;
       const double chi2 = MakeDrfFit::performResolutionFit( peakdequ, fnctnlForm, isHighResolution, sqrtEqnOrder, fwhm_coefs, fwhm_coefs_uncert );
     
+      std::shared_ptr<const MakeDrfFit::BootstrapResult> resampled;
+      if( bootstrap )
+      {
+        try
+        {
+          resampled = std::make_shared<MakeDrfFit::BootstrapResult>(
+                        MakeDrfFit::bootstrap_resolution_fit( *peakdequ, fnctnlForm, isHighResolution,
+                                                              sqrtEqnOrder, fwhm_coefs, ns_num_bootstrap_trials,
+                                                              band_energies ) );
+          for( size_t i = 0; i < fwhm_coefs_uncert.size() && i < resampled->coef_covariance.size(); ++i )
+            fwhm_coefs_uncert[i] = static_cast<float>( std::sqrt( resampled->coef_covariance[i][i] ) );
+        }catch( std::exception &e )
+        {
+          cerr << "Failed to resample FWHM coefs, using fit uncertainties: " << e.what() << endl;
+        }
+      }//if( bootstrap )
+      
       const double end_time = SpecUtils::get_wall_time();
     
       assert( fwhm_coefs.size() == fwhm_coefs_uncert.size() );
@@ -2569,9 +2602,9 @@ void MakeDrf::fitFwhmEqn( std::vector< std::shared_ptr<const PeakDef> > peaks,
         cout << fwhm_coefs[i] << "+-" << fwhm_coefs_uncert[i] << ", ";
       cout << "}; took " << (end_time-start_time) << " seconds" << endl;
       
-      WServer::instance()->post( sessionId, std::bind( [updater,fwhm_coefs,fwhm_coefs_uncert,thisid,chi2](){
+      WServer::instance()->post( sessionId, std::bind( [updater,fwhm_coefs,fwhm_coefs_uncert,thisid,chi2,resampled](){
         if( wApp->domRoot() && dynamic_cast<MakeDrf *>(wApp->domRoot()->findById(thisid)) )
-          updater(fwhm_coefs,fwhm_coefs_uncert,chi2);
+          updater(fwhm_coefs,fwhm_coefs_uncert,chi2,resampled);
         else
           cerr << "MakeDrf widget was deleted while calculating FWHM coefs" << endl;
       } ) );
@@ -2589,7 +2622,8 @@ void MakeDrf::updateFwhmEqn( std::vector<float> coefs,
                              std::vector<float> uncerts,
                              const double chi2,
                              const int functionalForm,
-                             const int fitid )
+                             const int fitid,
+                             std::shared_ptr<const MakeDrfFit::BootstrapResult> resampled )
 {
   if( fitid != m_fwhmFitId )
     return;
@@ -2623,6 +2657,8 @@ void MakeDrf::updateFwhmEqn( std::vector<float> coefs,
   m_fwhmCoefs = coefs;
   m_fwhmCoefUncerts = uncerts;
   m_chart->setFwhmCoefficients( coefs, uncerts, eqnType, MakeDrfChart::EqnEnergyUnits::keV );
+  if( resampled )
+    m_chart->setFwhmBand( resampled->energies, resampled->lower_band, resampled->upper_band );
   
   wApp->triggerUpdate();
 }//void updateFwhmEqn(...)
@@ -2664,11 +2700,20 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
   auto updater = boost::bind( &MakeDrf::updateEffEqn, this, boost::placeholders::_1,
                              boost::placeholders::_2, boost::placeholders::_3,
                              boost::placeholders::_4, boost::placeholders::_5,
-                             fitid, boost::placeholders::_6 );
+                             fitid, boost::placeholders::_6, boost::placeholders::_7 );
   const string thisid = id();
+  const bool bootstrap = m_bootstrapUncerts->isChecked();
   
+  // Evaluate the resampled band at the energies the chart draws the equation at, in the units of
+  //  the equation.
+  vector<float> band_energies = bootstrap ? m_chart->equationEnergies() : vector<float>{};
+  if( inMeV )
+  {
+    for( float &energy : band_energies )
+      energy /= 1000.0f;
+  }//if( inMeV )
   
-  auto worker = [sessionId,thisid,data,nfitpars,updater,inMeV]() {
+  auto worker = [sessionId,thisid,data,nfitpars,updater,inMeV,bootstrap,band_energies]() {
     try
     {
       //Takes between 5 and 500ms for a HPGe detector
@@ -2676,6 +2721,22 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
       vector<float> result, uncerts;
       const double chi2 = MakeDrfFit::performEfficiencyFit( data, nfitpars, result, uncerts );
       
+      std::shared_ptr<const MakeDrfFit::BootstrapResult> resampled;
+      if( bootstrap )
+      {
+        try
+        {
+          resampled = std::make_shared<MakeDrfFit::BootstrapResult>(
+                        MakeDrfFit::bootstrap_efficiency_fit( data, nfitpars, ns_num_bootstrap_trials,
+                                                              band_energies ) );
+          for( size_t i = 0; i < uncerts.size() && i < resampled->coef_covariance.size(); ++i )
+            uncerts[i] = static_cast<float>( std::sqrt( resampled->coef_covariance[i][i] ) );
+        }catch( std::exception &e )
+        {
+          cerr << "Failed to resample efficiency coefs, using fit uncertainties: " << e.what() << endl;
+        }
+      }//if( bootstrap )
+      
       const double end_time = SpecUtils::get_wall_time();
       
       assert( result.size() == uncerts.size() );
@@ -2691,10 +2752,10 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
         highestEnergy = std::max( highestEnergy, (inMeV ? 1000.0f : 1.0f) * p.energy );
       }
       
-      WServer::instance()->post( sessionId, std::bind( [updater,thisid,result,uncerts,chi2,lowestEnergy,highestEnergy](){
+      WServer::instance()->post( sessionId, std::bind( [updater,thisid,result,uncerts,chi2,lowestEnergy,highestEnergy,resampled](){
         //Make sure *this is still in the widget tree (incase user closed window while computation was being done)
         if( wApp->domRoot() && dynamic_cast<MakeDrf *>(wApp->domRoot()->findById(thisid) ) )
-          updater( result, uncerts, chi2, lowestEnergy, highestEnergy, string("") );
+          updater( result, uncerts, chi2, lowestEnergy, highestEnergy, string(""), resampled );
         else
           cerr << "MakeDrf widget was deleted while efficiency was being calculated" << endl;
       } ) );
@@ -2704,7 +2765,7 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
       cout << "Failed to fit intrinsic eff coefs: " << errmsg << endl;
       WServer::instance()->post( sessionId, std::bind( [updater,errmsg,thisid](){
         if( wApp->domRoot() && dynamic_cast<MakeDrf *>(wApp->domRoot()->findById(thisid) ) )
-          updater( vector<float>(), vector<float>(), -999.9, 0.0f, 0.0f, errmsg );
+          updater( vector<float>(), vector<float>(), -999.9, 0.0f, 0.0f, errmsg, std::shared_ptr<const MakeDrfFit::BootstrapResult>() );
         else
           cerr << "MakeDrf widget was deleted while efficiency was being calculated" << endl;
       } ) );
@@ -2718,7 +2779,8 @@ void MakeDrf::fitEffEqn( std::vector<MakeDrfFit::DetEffDataPoint> data )
 void MakeDrf::updateEffEqn( std::vector<float> coefs, std::vector<float> uncerts,
                             const double chi2,
                             const float lowestEnergy, const float highestEnergy,
-                            const int fitid, const string errmsg )
+                            const int fitid, const string errmsg,
+                            std::shared_ptr<const MakeDrfFit::BootstrapResult> resampled )
 {
   const bool isMeV = isEffEqnInMeV();
   const auto units = (isMeV ? MakeDrfChart::EqnEnergyUnits::MeV : MakeDrfChart::EqnEnergyUnits::keV);
@@ -2731,6 +2793,19 @@ void MakeDrf::updateEffEqn( std::vector<float> coefs, std::vector<float> uncerts
   m_intrinsicEfficiencyIsValid.emit( !m_effEqnCoefs.empty() );
   m_chart->setEfficiencyCoefficients( coefs, uncerts, units );
   
+  if( resampled )
+  {
+    // The chart takes the band energies in keV
+    vector<float> band_energies = resampled->energies;
+    if( isMeV )
+    {
+      for( float &energy : band_energies )
+        energy *= 1000.0f;
+    }//if( isMeV )
+    
+    m_chart->setEfficiencyBand( band_energies, resampled->lower_band, resampled->upper_band );
+  }//if( resampled )
+  
   if( !errmsg.empty() )
   {
     m_intrinsicEffAnswer->setText( "" );
@@ -2746,37 +2821,7 @@ void MakeDrf::updateEffEqn( std::vector<float> coefs, std::vector<float> uncerts
     m_errorMsg->setHidden( false );
   }
   
-  if( !coefs.empty() )
-  {
-    string eqn = "Eff<sub>int.</sub>(x) = exp( ";
-    for( size_t i = 0; i < coefs.size(); ++i )
-    {
-      const float val = fabs(coefs[i]);
-      char buffer[64] = {'\0'};
-      
-      //We will print to 5 significant digits, AFTER the decimal place since
-      //  this is a sum of terms.
-      const string frmtstr = (val > 1.0) ? ("%." + std::to_string( static_cast<int>(std::ceil(std::log10(val)))+5 ) + "g") : string("%.5g");
-      snprintf( buffer, sizeof(buffer), frmtstr.c_str(), val );
-      
-      eqn += (coefs[i]>=0.0) ? "+" : "-";
-      eqn += i ? " " : "";
-      eqn += buffer;
-      eqn += i ? "*log(x)" : "";
-      eqn += (i > 1) ? ("<sup>" + std::to_string(i) + "</sup> ") : string(" ");
-    }
-    eqn += ")";
-    
-    //eqn += " (x in ";
-    //eqn += (isMeV ? "MeV)" : "keV)");
-    
-    m_intrinsicEffAnswer->setText( eqn );
-    //m_intrinsicEffAnswer->setHidden( false );
-  }else
-  {
-    m_intrinsicEffAnswer->setText( "" );
-    //m_intrinsicEffAnswer->setHidden( true );
-  }//if( !coefs.empty() ) / else
+  m_intrinsicEffAnswer->setText( intrinsic_eff_eqn_html( coefs ) );
   
   wApp->triggerUpdate();
 }//void updateEffEqn(...)
@@ -2943,12 +2988,110 @@ std::shared_ptr<SpecMeas> MakeDrf::assembleCalFile()
 }//std::shared_ptr<SpecMeas> assembleCalFile()
 
 
+MakeDrf::FitResults::FitResults()
+  : data(),
+    diameter( 0.0 ),
+    effInMeV( false ),
+    effCoefs(),
+    effCoefUncerts(),
+    effChi2( -999.9 ),
+    effLowerEnergy( 0.0f ),
+    effUpperEnergy( 0.0f ),
+    fwhmForm( DetectorPeakResponse::kNumResolutionFnctForm ),
+    fwhmCoefs(),
+    fwhmCoefUncerts(),
+    fwhmChi2( -999.9 ),
+    errorMessage()
+{
+}
+
+
+MakeDrfFit::DetEffDataPoint MakeDrf::efficiencyDataPoint( MakeDrfChart::DataPoint &point,
+                                                          const std::vector<PeakSourceRate> &sources,
+                                                          const double diameter )
+{
+  // Sum the contributions from all sources to the peak, and their uncertainties in quadrature.
+  double source_count_rate = 0.0, expected = 0.0, uncert2 = 0.0;
+  for( const PeakSourceRate &src : sources )
+  {
+    if( src.rate <= 0.0 )
+      continue;
+    
+    const double fracSolidAngle = DetectorPeakResponse::fractionalSolidAngle( diameter, src.distance );
+    const double incident = src.rate * point.livetime * fracSolidAngle;
+    
+    source_count_rate += src.rate;
+    expected += incident;
+    uncert2 += std::pow( incident * src.fractionalUncert, 2.0 );
+  }//for( const PeakSourceRate &src : sources )
+  
+  if( (expected <= 0.0) || IsNan(expected) || IsInf(expected) )
+    throw runtime_error( "No source gammas expected at " + std::to_string(point.energy) + " keV" );
+  
+  const double fracUncert = sqrt( uncert2 ) / expected;
+  
+  point.source_count_rate = static_cast<float>( source_count_rate );
+  point.source_count_rate_uncertainty = static_cast<float>( source_count_rate*fracUncert );
+  
+  double fracUncert2 = 0.0;
+  if( point.peak_area_uncertainty > 0.0f )
+    fracUncert2 += std::pow( point.peak_area_uncertainty / point.peak_area, 2.0f );
+  if( point.source_count_rate_uncertainty > 0.0f )
+    fracUncert2 += std::pow( point.source_count_rate_uncertainty / point.source_count_rate, 2.0f );
+  
+  MakeDrfFit::DetEffDataPoint effpoint;
+  effpoint.energy = point.energy;
+  effpoint.efficiency = static_cast<float>( point.peak_area / expected );
+  effpoint.efficiency_uncert = static_cast<float>( sqrt(fracUncert2) );
+  
+  return effpoint;
+}//MakeDrfFit::DetEffDataPoint efficiencyDataPoint(...)
+
+
+MakeDrf::FitResults MakeDrf::currentFitResults() const
+{
+  FitResults results;
+  
+  results.data = m_chart->currentDataPoints();
+  
+  try
+  {
+    results.diameter = detectorDiameter();
+  }catch( std::exception & )
+  {
+    results.diameter = -1.0;
+  }
+  
+  results.effInMeV = isEffEqnInMeV();
+  results.effCoefs = m_effEqnCoefs;
+  results.effCoefUncerts = m_effEqnCoefUncerts;
+  results.effChi2 = m_effEqnChi2;
+  results.effLowerEnergy = m_effLowerEnergy;
+  results.effUpperEnergy = m_effUpperEnergy;
+  results.fwhmForm = DetectorPeakResponse::ResolutionFnctForm( m_fwhmEqnType->currentIndex() );
+  results.fwhmCoefs = m_fwhmCoefs;
+  results.fwhmCoefUncerts = m_fwhmCoefUncerts;
+  results.fwhmChi2 = m_fwhmEqnChi2;
+  if( m_errorMsg )
+    results.errorMessage = m_errorMsg->text().toUTF8();
+  
+  return results;
+}//FitResults currentFitResults() const
+
+
 shared_ptr<DetectorPeakResponse> MakeDrf::assembleDrf( const string &name, const string &descrip ) const
 {
-  if( m_effEqnCoefs.empty() )
+  return assembleDrf( name, descrip, currentFitResults() );
+}//assembleDrf(...)
+
+
+shared_ptr<DetectorPeakResponse> MakeDrf::assembleDrf( const string &name, const string &descrip,
+                                                      const FitResults &results )
+{
+  if( results.effCoefs.empty() )
     throw runtime_error( "Equation coefficients are empty." );
   
-  for( const float val : m_effEqnCoefs )
+  for( const float val : results.effCoefs )
   {
     if( IsNan(val) || IsInf(val) )
       throw runtime_error( "An equation coefficient is invalid." );
@@ -2956,49 +3099,38 @@ shared_ptr<DetectorPeakResponse> MakeDrf::assembleDrf( const string &name, const
   
   auto drf = make_shared<DetectorPeakResponse>( name, descrip );
   
-  float diameter;
-  try
-  {
-    const double diam = PhysicalUnits::stringToDistance( m_detDiameter->text().toUTF8() );
-    diameter = static_cast<float>( diam );
-    
-    if( IsNan(diameter) || IsInf(diameter) || (diameter <= 0.0) )
-      throw runtime_error( "invalid diameter." );
-  }catch(...)
-  {
+  const float diameter = static_cast<float>( results.diameter );
+  if( IsNan(diameter) || IsInf(diameter) || (diameter <= 0.0) )
     throw runtime_error( "Detector diameter entered is not a valid distance." );
-  }
   
-  const bool inMeV = isEffEqnInMeV();
-  const float eqnEnergyUnits = inMeV ? 1000.0f : 1.0f;
+  const float eqnEnergyUnits = results.effInMeV ? 1000.0f : 1.0f;
   
   float lowerEnergy = 0.0f, upperEnergy = 0.0f;
-  const std::vector<MakeDrfChart::DataPoint> &data = m_chart->currentDataPoints();
+  const std::vector<MakeDrfChart::DataPoint> &data = results.data;
   if( data.size() >= 2 )
   {
     lowerEnergy = data.front().energy;
     upperEnergy = data.back().energy;
   }
   
-  drf->fromExpOfLogPowerSeriesAbsEff( m_effEqnCoefs, m_effEqnCoefUncerts,
+  drf->fromExpOfLogPowerSeriesAbsEff( results.effCoefs, results.effCoefUncerts,
                                      0.0f, diameter, eqnEnergyUnits, lowerEnergy, upperEnergy );
   drf->setDrfSource( DetectorPeakResponse::DrfSource::UserCreatedDrf );
   
-  if( !m_fwhmCoefs.empty() )
+  if( !results.fwhmCoefs.empty() )
   {
-    const auto fwhmForm = DetectorPeakResponse::ResolutionFnctForm( m_fwhmEqnType->currentIndex() );
-    switch( fwhmForm )
+    switch( results.fwhmForm )
     {
       case DetectorPeakResponse::ResolutionFnctForm::kGadrasResolutionFcn:
-        drf->setFwhmCoefficients( m_fwhmCoefs, DetectorPeakResponse::ResolutionFnctForm::kGadrasResolutionFcn );
+        drf->setFwhmCoefficients( results.fwhmCoefs, DetectorPeakResponse::ResolutionFnctForm::kGadrasResolutionFcn );
         break;
         
       case DetectorPeakResponse::ResolutionFnctForm::kSqrtEnergyPlusInverse:
-        drf->setFwhmCoefficients( m_fwhmCoefs, DetectorPeakResponse::ResolutionFnctForm::kSqrtEnergyPlusInverse );
+        drf->setFwhmCoefficients( results.fwhmCoefs, DetectorPeakResponse::ResolutionFnctForm::kSqrtEnergyPlusInverse );
         break;
         
       case DetectorPeakResponse::ResolutionFnctForm::kSqrtPolynomial:
-        drf->setFwhmCoefficients( m_fwhmCoefs, DetectorPeakResponse::ResolutionFnctForm::kSqrtPolynomial );
+        drf->setFwhmCoefficients( results.fwhmCoefs, DetectorPeakResponse::ResolutionFnctForm::kSqrtPolynomial );
         break;
         
       case DetectorPeakResponse::ResolutionFnctForm::kNumResolutionFnctForm:
@@ -3006,8 +3138,8 @@ shared_ptr<DetectorPeakResponse> MakeDrf::assembleDrf( const string &name, const
         assert( 0 );
         throw runtime_error( "Invalid DRF type selection" );
         break;
-    }//switch( m_fwhmEqnType->currentIndex() )
-  }//if( !m_fwhmCoefs.empty() )
+    }//switch( results.fwhmForm )
+  }//if( !results.fwhmCoefs.empty() )
   
   if( !drf->isValid() )
     throw runtime_error( "DRF wasnt valid after creation" );
@@ -3019,6 +3151,15 @@ shared_ptr<DetectorPeakResponse> MakeDrf::assembleDrf( const string &name, const
 
 void MakeDrf::writeCsvSummary( std::ostream &out,
                                std::string drfname, std::string drfdescription )
+{
+  const int offset = wApp ? wApp->environment().timeZoneOffset() : 0;
+  writeCsvSummary( out, drfname, drfdescription, currentFitResults(), offset );
+}//void writeCsvSummary(...)
+
+
+void MakeDrf::writeCsvSummary( std::ostream &out,
+                               std::string drfname, std::string drfdescription,
+                               const FitResults &results, const int offset )
 {
   const char * const endline = "\r\n";
   
@@ -3029,28 +3170,25 @@ void MakeDrf::writeCsvSummary( std::ostream &out,
   SpecUtils::ireplace_all( drfdescription, "\r", " ");
   SpecUtils::ireplace_all( drfdescription, "\n", " ");
   
-  const double effChi2 = m_effEqnChi2;
-  const double fwhmChi2 = m_fwhmEqnChi2;
-  const vector<float> fwhmCoefs = m_fwhmCoefs;
-  const vector<float> fwhmCoefUncert = m_fwhmCoefUncerts;
-  const vector<float> effEqnCoefs = m_effEqnCoefs;
-  const vector<float> effEqnCoefsUncerts = m_effEqnCoefUncerts;
+  const double effChi2 = results.effChi2;
+  const double fwhmChi2 = results.fwhmChi2;
+  const vector<float> &fwhmCoefs = results.fwhmCoefs;
+  const vector<float> &fwhmCoefUncert = results.fwhmCoefUncerts;
+  const vector<float> &effEqnCoefs = results.effCoefs;
+  const vector<float> &effEqnCoefsUncerts = results.effCoefUncerts;
   
-  const vector<MakeDrfChart::DataPoint> data = m_chart->currentDataPoints();
+  const vector<MakeDrfChart::DataPoint> &data = results.data;
   
   const int effDof = static_cast<int>(data.size()) - effEqnCoefs.size();
   const int fwhmDof = static_cast<int>(data.size()) - fwhmCoefs.size();
   
-  const bool effInMeV = isEffEqnInMeV();
-  const auto resFcnForm = DetectorPeakResponse::ResolutionFnctForm( m_fwhmEqnType->currentIndex() );
+  const bool effInMeV = results.effInMeV;
+  const auto resFcnForm = results.fwhmForm;
   
-  double diam;
-  try
-  {
-    diam = detectorDiameter();
-  }catch( std::exception &e )
+  const double diam = results.diameter;
+  if( diam <= 0.0 )
   {
-    out << "Invalid detector diameter: " << e.what() << endline;
+    out << "Invalid detector diameter." << endline;
     return;
   }
   
@@ -3058,8 +3196,8 @@ void MakeDrf::writeCsvSummary( std::ostream &out,
   {
     out << "Detector response function not valid" << endline;
     
-    if( m_errorMsg )
-      out << m_errorMsg->text().toUTF8() << endline;
+    if( !results.errorMessage.empty() )
+      out << results.errorMessage << endline;
     return;
   }//if( effEqnCoefs.empty() )
   
@@ -3074,9 +3212,6 @@ void MakeDrf::writeCsvSummary( std::ostream &out,
     releffuncert = effEqnUncert( cs137Energy, effEqnCoefs, effEqnCoefsUncerts );
 
   
-  int offset = 0;
-  if( wApp )
-    offset = wApp->environment().timeZoneOffset();
   auto localtime = std::chrono::system_clock::now();
   localtime += std::chrono::seconds(60*offset);
 
@@ -3277,10 +3412,18 @@ void MakeDrf::writeCsvSummary( std::ostream &out,
 
 
 void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::string drfdescrip )
+{
+  const int offset = wApp->environment().timeZoneOffset();
+  writeRefSheet( output, drfname, drfdescrip, currentFitResults(), wApp->docRoot(), offset );
+}//void writeRefSheet(...)
+
+
+void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::string drfdescrip,
+                             const FitResults &results, const std::string &docroot,
+                             const int offset )
 {
   // Use a lambda to read in the template XML, mostly just to control scope and have result be const
-  auto get_tmplt_txt = []() -> string {
-    const string docroot = wApp->docRoot();
+  auto get_tmplt_txt = [&docroot]() -> string {
     const string tmpltpath = SpecUtils::append_path(docroot,"InterSpec_resources/static_text/drf_ref_card.xml");
     
     std::ifstream tmpltfile( tmpltpath.c_str(), ios::in | ios::binary );
@@ -3296,15 +3439,14 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
   // Lets gather all our general information
   const string tmplttxt = get_tmplt_txt();
   
-  const double diam = [this]() -> double {try{return detectorDiameter();}catch(...){return 0.0;}}();
-  const WString diameter = m_detDiameter->text();
+  const double diam = std::max( results.diameter, 0.0 );
+  const WString diameter = WString::fromUTF8( (diam > 0.0) ? PhysicalUnits::printToBestLengthUnits( diam ) : string() );
   
-  const int offset = wApp->environment().timeZoneOffset();
   const WDateTime now = WDateTime::currentDateTime().addSecs(60*offset);
   const string date = now.date().toString("MMM d yyyy").toUTF8();
   
   // Energy range, m_chartLowerE, m_chartUpperE
-  string eff_eqn = m_intrinsicEffAnswer->text().toUTF8();
+  string eff_eqn = intrinsic_eff_eqn_html( results.effCoefs );
   //SpecUtils::ireplace_all( eff_eqn, "*", "&times;" );
   
   // Lets keep the equation from spilling over to the next line without some proper formatting
@@ -3322,19 +3464,23 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
   
   
 
-  const bool effInMeV = isEffEqnInMeV();
-  const auto fwhmForm = DetectorPeakResponse::ResolutionFnctForm( m_fwhmEqnType->currentIndex() );
+  const bool effInMeV = results.effInMeV;
+  const auto fwhmForm = results.fwhmForm;
+  const vector<float> &effEqnCoefs = results.effCoefs;
+  const vector<float> &fwhmCoefs = results.fwhmCoefs;
+  const float effLowerEnergy = results.effLowerEnergy;
+  const float effUpperEnergy = results.effUpperEnergy;
   const float cs137Energy = (effInMeV ? 0.661657f : 661.657f);
-  const float intrinsicEffAt661 = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( cs137Energy, m_effEqnCoefs );
+  const float intrinsicEffAt661 = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( cs137Energy, effEqnCoefs );
   const float relEffPercent = 100.0 * intrinsicEffAt661 / ns_NaI3x3IntrinsicEff;
   char rel_eff_txt[256] = { '\0' };
   
-  if( m_fwhmCoefs.empty() )
+  if( fwhmCoefs.empty() )
   {
     snprintf( rel_eff_txt, sizeof(rel_eff_txt), "%.1f%% eff. (rel. to 3x3 NaI) @661 keV", relEffPercent );
   }else
   {
-    const float fwhm661 = DetectorPeakResponse::peakResolutionSigma( 661.7, fwhmForm, m_fwhmCoefs );
+    const float fwhm661 = DetectorPeakResponse::peakResolutionSigma( 661.7, fwhmForm, fwhmCoefs );
     const float relResolution = 100 * fwhm661 / 661.7;
     
     snprintf( rel_eff_txt, sizeof(rel_eff_txt),
@@ -3343,15 +3489,15 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
   }//if( we have FWHM ) / else.
   
   string fwhm_eqn;
-  if( m_fwhmCoefs.size() )
+  if( fwhmCoefs.size() )
   {
     switch( fwhmForm )
     {
       case DetectorPeakResponse::kGadrasResolutionFcn:
       {
-        const float P6 = m_fwhmCoefs[0];
-        const float P7 = (m_fwhmCoefs.size() > 1) ? m_fwhmCoefs[1] : 0.0f;
-        const float P8 = (m_fwhmCoefs.size() > 2) ? m_fwhmCoefs[2] : 0.0f;
+        const float P6 = fwhmCoefs[0];
+        const float P7 = (fwhmCoefs.size() > 1) ? fwhmCoefs[1] : 0.0f;
+        const float P8 = (fwhmCoefs.size() > 2) ? fwhmCoefs[2] : 0.0f;
         
         char case1_buffer[256] = { '\0' }, case2_buffer[256] = { '\0' };
         char case3_buffer[256] = { '\0' }, case4_buffer[512] = { '\0' };
@@ -3383,15 +3529,15 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
       case DetectorPeakResponse::kSqrtEnergyPlusInverse:
       {
         fwhm_eqn = "FWHM(keV) = sqrt(";
-        for( size_t i = 0; i < m_fwhmCoefs.size(); ++i )
+        for( size_t i = 0; i < fwhmCoefs.size(); ++i )
         {
           if( i == 0 )
-            fwhm_eqn += ((m_fwhmCoefs[i] < 0.0) ? " -" : "");
+            fwhm_eqn += ((fwhmCoefs[i] < 0.0) ? " -" : "");
           else
-            fwhm_eqn += ((m_fwhmCoefs[i] < 0.0) ? " - " : " + ");
+            fwhm_eqn += ((fwhmCoefs[i] < 0.0) ? " - " : " + ");
           
           char buffer[64] = { '\0' };
-          snprintf( buffer, sizeof(buffer), "%.4g", fabs(m_fwhmCoefs[i]) );
+          snprintf( buffer, sizeof(buffer), "%.4g", fabs(fwhmCoefs[i]) );
           fwhm_eqn += buffer;
           
           if( i == 1 )
@@ -3406,15 +3552,15 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
       case DetectorPeakResponse::kSqrtPolynomial:
       {
         fwhm_eqn = "FWHM(keV) = sqrt(";
-        for( size_t i = 0; i < m_fwhmCoefs.size(); ++i )
+        for( size_t i = 0; i < fwhmCoefs.size(); ++i )
         {
           if( i == 0 )
-            fwhm_eqn += ((m_fwhmCoefs[i] < 0.0) ? " -" : "");
+            fwhm_eqn += ((fwhmCoefs[i] < 0.0) ? " -" : "");
           else
-            fwhm_eqn += ((m_fwhmCoefs[i] < 0.0) ? " - " : " + ");
+            fwhm_eqn += ((fwhmCoefs[i] < 0.0) ? " - " : " + ");
           
           char buffer[64] = { '\0' };
-          snprintf( buffer, sizeof(buffer), "%.4g", 0.001*fabs(m_fwhmCoefs[i]) );
+          snprintf( buffer, sizeof(buffer), "%.4g", 0.001*fabs(fwhmCoefs[i]) );
           fwhm_eqn += buffer;
           
           if( i == 1 )
@@ -3432,7 +3578,7 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
         assert( 0 );
         break;
     }//switch( fwhmForm )
-  }//if( m_fwhmCoefs.size() )
+  }//if( fwhmCoefs.size() )
   
   stringstream efftable;
   const double eff_energies[] = { 59.5, 185.7, 413.7, 661.7, 1001.0, 1460.8, 2614.5 };
@@ -3445,7 +3591,7 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
   char buffer[128] = { '\0' };
   for( const double energy : eff_energies )
   {
-    if( (energy < (m_effLowerEnergy - 10)) || (energy > (m_effUpperEnergy + 10)) )
+    if( (energy < (effLowerEnergy - 10)) || (energy > (effUpperEnergy + 10)) )
       continue;
     
     snprintf( buffer, sizeof(buffer), "<th>%.0f&nbsp;keV</th>", std::round(energy) );
@@ -3457,11 +3603,11 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
   efftable << "\t<tr><th>Intrinsic</th>";
   for( double raw_energy : eff_energies )
   {
-    if( (raw_energy < (m_effLowerEnergy - 10)) || (raw_energy > (m_effUpperEnergy + 10)) )
+    if( (raw_energy < (effLowerEnergy - 10)) || (raw_energy > (effUpperEnergy + 10)) )
       continue;
     
     const float energy = raw_energy / (effInMeV ? 1000.0f : 1.0f);
-    const float intrinsic_eff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energy, m_effEqnCoefs );
+    const float intrinsic_eff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energy, effEqnCoefs );
     snprintf( buffer, sizeof(buffer), "<td>%.3G</td>", 100.0*intrinsic_eff );
     efftable << buffer;
   }
@@ -3472,11 +3618,11 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
     efftable << "\t<tr><th>" << dist_cm << " cm</th>";
     for( double raw_energy : eff_energies )
     {
-      if( (raw_energy < (m_effLowerEnergy - 10)) || (raw_energy > (m_effUpperEnergy + 10)) )
+      if( (raw_energy < (effLowerEnergy - 10)) || (raw_energy > (effUpperEnergy + 10)) )
         continue;
       
       const float energy = raw_energy / (effInMeV ? 1000.0f : 1.0f);
-      const float intrinsic_eff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energy, m_effEqnCoefs );
+      const float intrinsic_eff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energy, effEqnCoefs );
       const double frac_solid_angle = DetectorPeakResponse::fractionalSolidAngle( diam, dist_cm*PhysicalUnits::cm );
     
       snprintf( buffer, sizeof(buffer), "<td>%.2G</td>", 100.0*frac_solid_angle*intrinsic_eff );
@@ -3495,10 +3641,10 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
   {// begin make DRF chart
     MakeDrfChart chart;
     chart.resize( chart_width, chart_height );
-    const std::vector<MakeDrfChart::DataPoint> &data = m_chart->currentDataPoints();
-    const float detDiam = m_chart->currentDiameter();
-    const float chartLower = 10.0f * std::round( 0.1f*(m_effLowerEnergy - 6.0f) );
-    const float chartUpper = 10.0f * std::round( 0.1f*(m_effUpperEnergy + 6.0f) );
+    const std::vector<MakeDrfChart::DataPoint> &data = results.data;
+    const float detDiam = static_cast<float>( (diam > 0.0) ? diam : 2.54*PhysicalUnits::cm );
+    const float chartLower = 10.0f * std::round( 0.1f*(effLowerEnergy - 6.0f) );
+    const float chartUpper = 10.0f * std::round( 0.1f*(effUpperEnergy + 6.0f) );
     
     chart.setDataPoints( data, detDiam, chartLower, chartUpper );
     
@@ -3507,7 +3653,7 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
     
     MakeDrfChart::FwhmCoefType fwhmEqnType = MakeDrfChart::FwhmCoefType::Gadras;
     
-    switch( DetectorPeakResponse::ResolutionFnctForm(m_fwhmEqnType->currentIndex()) )
+    switch( fwhmForm )
     {
       case DetectorPeakResponse::kGadrasResolutionFcn:
         fwhmEqnType = MakeDrfChart::FwhmCoefType::Gadras;
@@ -3524,10 +3670,10 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
       case DetectorPeakResponse::kNumResolutionFnctForm:
         assert( 0 );
         break;
-    }//switch( m_fwhmEqnType->currentIndex() )
+    }//switch( fwhmForm )
     
-    chart.setFwhmCoefficients( m_fwhmCoefs, m_fwhmCoefUncerts, fwhmEqnType, units );
-    chart.setEfficiencyCoefficients( m_effEqnCoefs, m_effEqnCoefUncerts, units );
+    chart.setFwhmCoefficients( fwhmCoefs, results.fwhmCoefUncerts, fwhmEqnType, units );
+    chart.setEfficiencyCoefficients( effEqnCoefs, results.effCoefUncerts, units );
     
     WPainter p( &eff_chart );
     chart.paint( p );
@@ -3540,7 +3686,7 @@ void MakeDrf::writeRefSheet( std::ostream &output, std::string drfname, std::str
   string qr_code;
   try
   {
-    shared_ptr<DetectorPeakResponse> drf = assembleDrf( drfname, drfdescrip );
+    shared_ptr<DetectorPeakResponse> drf = assembleDrf( drfname, drfdescrip, results );
     assert( drf && drf->isValid() );
     
     const string url = "interspec://drf/specify?" + drf->toAppUrl();
@@ -0,0 +1,863 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <set>
+#include <deque>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cfloat>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <Wt/WApplication>
+#include <Wt/Test/WTestEnvironment>
+
+#include "rapidxml/rapidxml.hpp"
+#include "rapidxml/rapidxml_print.hpp"
+
+#include "SpecUtils/DateTime.h"
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/Filesystem.h"
+#include "SpecUtils/ParseUtils.h"
+#include "SpecUtils/StringAlgo.h"
+#include "SpecUtils/SpecUtilsAsync.h"
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "InterSpec/PeakFit.h"
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/MakeDrf.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/MakeDrfFit.h"
+#include "InterSpec/MakeDrfBatch.h"
+#include "InterSpec/MakeDrfChart.h"
+#include "InterSpec/PeakFitUtils.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/MassAttenuationTool.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/GammaInteractionCalc.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+using namespace std;
+
+
+namespace
+{
+  /** The peaks of a spectrum file, and the information about it needed to make data points. */
+  struct FilePeaks
+  {
+    const MakeDrfBatch::SpectrumFile *file;
+
+    /** Empty if the file was loaded and peaks found. */
+    string error;
+
+    float live_time;
+    SpecUtils::time_point_t start_time;
+    bool high_resolution;
+    std::deque<std::shared_ptr<const PeakDef>> peaks;
+  };//struct FilePeaks
+
+
+  /** Loads a spectrum file, and gets its peaks; either peaks saved in the file, or if there are
+   none, from the automated peak search.
+
+   Throws exception on error.
+   */
+  void load_file_peaks( const MakeDrfBatch::SpectrumFile &file, FilePeaks &result )
+  {
+    result.file = &file;
+    result.live_time = 0.0f;
+    result.high_resolution = false;
+    result.peaks.clear();
+
+    auto meas = make_shared<SpecMeas>();
+    if( !meas->load_file( file.filename, SpecUtils::ParserType::Auto, file.filename ) )
+      throw runtime_error( "Could not parse spectrum file '" + file.filename + "'" );
+
+    // Use the samples the user fit peaks for, if any; if more than one set of samples has peaks,
+    //  we'll take the one with the most peaks.
+    set<int> samples;
+    std::shared_ptr<const std::deque<std::shared_ptr<const PeakDef>>> filepeaks;
+    for( const set<int> &peaksamples : meas->sampleNumsWithPeaks() )
+    {
+      const auto p = std::const_pointer_cast<const SpecMeas>(meas)->peaks( peaksamples );
+      if( p && !p->empty() && (!filepeaks || (p->size() > filepeaks->size())) )
+      {
+        samples = peaksamples;
+        filepeaks = p;
+      }
+    }//for( const set<int> &peaksamples : meas->sampleNumsWithPeaks() )
+
+    if( samples.empty() )
+      samples = meas->sample_numbers();
+
+    const vector<string> &detnames = meas->detector_names();
+    std::shared_ptr<const SpecUtils::Measurement> summed;
+    if( (samples.size() == 1) && (detnames.size() == 1) )
+      summed = meas->measurement( *begin(samples), detnames[0] );
+    if( !summed )
+      summed = meas->sum_measurements( samples, detnames, nullptr );
+
+    if( !summed || (summed->num_gamma_channels() < 8) || (summed->live_time() <= 0.0f) )
+      throw runtime_error( "No valid gamma spectrum in '" + file.filename + "'" );
+
+    result.live_time = summed->live_time();
+    result.start_time = summed->start_time();
+    result.high_resolution = PeakFitUtils::is_high_res( summed );
+
+    if( filepeaks )
+    {
+      result.peaks.insert( end(result.peaks), begin(*filepeaks), end(*filepeaks) );
+    }else
+    {
+      // We are already running files in parallel, so we wont multithread the search itself.
+      const bool singleThreaded = true;
+      const vector<shared_ptr<const PeakDef>> found
+            = ExperimentalAutomatedPeakSearch::search_for_peaks( summed, nullptr, nullptr, singleThreaded );
+      result.peaks.insert( end(result.peaks), begin(found), end(found) );
+    }//if( filepeaks ) / else
+
+    if( result.peaks.empty() )
+      throw runtime_error( "No peaks found in '" + file.filename + "'" );
+  }//void load_file_peaks(...)
+
+
+  /** Same as #load_file_peaks, but catches exceptions, and records them in #FilePeaks::error. */
+  void load_file_peaks_nothrow( const MakeDrfBatch::SpectrumFile *file, FilePeaks *result )
+  {
+    try
+    {
+      load_file_peaks( *file, *result );
+    }catch( std::exception &e )
+    {
+      result->file = file;
+      result->error = e.what();
+      result->peaks.clear();
+    }
+  }//void load_file_peaks_nothrow(...)
+
+
+  /** Returns the fraction of gammas, at an energy, that make it through the sources shielding, and
+   (optionally) the air between source and detector.
+   */
+  double transmission_fraction( const float energy, const MakeDrfBatch::SourceDef &src,
+                                const bool doAirAtten )
+  {
+    double airTransFrac = 1.0;
+    if( doAirAtten )
+    {
+      const double mu = GammaInteractionCalc::transmission_length_coefficient_air( energy );
+      airTransFrac = exp( -mu * src.distance );
+    }//if( doAirAtten )
+
+    if( src.shield_areal_density <= 0.0f || src.shield_atomic_number < 1.0f )
+      return airTransFrac;
+
+    const int an = static_cast<int>( std::round(src.shield_atomic_number) );
+    const double ad = src.shield_areal_density;
+    const double mu = MassAttenuation::massAttenuationCoeficient( an, energy );
+
+    return airTransFrac * exp( -mu * ad );
+  }//double transmission_fraction(...)
+
+
+  /** The activity and age of a source at the time of measurement. */
+  void source_at_measurement( const MakeDrfBatch::SourceDef &src,
+                              const SpecUtils::time_point_t &meas_time,
+                              double &activity, double &age )
+  {
+    activity = src.activity;
+
+    const bool noAge = PeakDef::ageFitNotAllowed( src.nuclide );
+    const double defaultAge = PeakDef::defaultDecayTime( src.nuclide, nullptr );
+    const double ageAtAssay = (noAge || (src.age_at_assay <= 0.0)) ? defaultAge : src.age_at_assay;
+
+    // Without an assay date, the activity is taken to be at the time of measurement.
+    if( SpecUtils::is_special(src.assay_date) )
+    {
+      age = ageAtAssay;
+      return;
+    }
+
+    if( SpecUtils::is_special(meas_time) )
+      throw runtime_error( "Measurement date invalid" );
+
+    if( src.assay_date > meas_time )
+      throw runtime_error( "Assay date must be before measurement date" );
+
+    const double decay_time = std::chrono::duration<double>(meas_time - src.assay_date).count()
+                              * PhysicalUnits::second;
+
+    SandiaDecay::NuclideMixture mix;
+    mix.addNuclideByActivity( src.nuclide, src.activity );
+    activity = mix.activity( decay_time, src.nuclide );
+
+    age = noAge ? defaultAge : (ageAtAssay + decay_time);
+  }//void source_at_measurement(...)
+
+
+  /** Creates the data points from the files peaks, and fits the efficiency and FWHM; the same as
+   #MakeDrf::handleSourcesUpdates, #MakeDrf::fitEffEqn, and #MakeDrf::fitFwhmEqn, except that peaks
+   without a nuclide assigned are associated with sources by energy.
+   */
+  MakeDrf::FitResults fit_from_peaks( const MakeDrfBatch::DetectorDef &det,
+                                      const vector<FilePeaks> &files )
+  {
+    MakeDrf::FitResults results;
+    results.diameter = det.diameter;
+    results.effInMeV = det.eff_in_mev;
+    results.fwhmForm = det.fwhm_form;
+
+    vector<string> problems;
+
+    if( IsNan(det.diameter) || IsInf(det.diameter) || (det.diameter <= 0.0) )
+      throw runtime_error( "Detector diameter is invalid." );
+
+    // Gather background peaks
+    vector<pair<shared_ptr<const PeakDef>,float>> backgroundpeaks;
+    for( const FilePeaks &f : files )
+    {
+      if( !f.error.empty() )
+      {
+        problems.push_back( f.error );
+        continue;
+      }
+
+      if( !f.file->is_background )
+        continue;
+
+      for( const auto &p : f.peaks )
+        backgroundpeaks.emplace_back( p, f.live_time );
+    }//for( const FilePeaks &f : files )
+
+    bool highres = false;
+    vector<MakeDrfFit::DetEffDataPoint> effpoints;
+    std::deque<std::shared_ptr<const PeakDef>> fwhmpeaks;
+
+    for( const FilePeaks &f : files )
+    {
+      if( !f.error.empty() || f.file->is_background )
+        continue;
+
+      if( f.file->sources.empty() )
+      {
+        problems.push_back( "No sources given for '" + f.file->filename + "'" );
+        continue;
+      }
+
+      highres = (highres || f.high_resolution);
+
+      // Photon rates, at the time of measurement, for each source.
+      vector<vector<SandiaDecay::EnergyRatePair>> mixtures;
+      try
+      {
+        for( const MakeDrfBatch::SourceDef &src : f.file->sources )
+        {
+          double activity, age;
+          source_at_measurement( src, f.start_time, activity, age );
+
+          SandiaDecay::NuclideMixture mix;
+          mix.addAgedNuclideByActivity( src.nuclide, activity, age );
+          mixtures.push_back( mix.photons( 0.0, SandiaDecay::NuclideMixture::HowToOrder::OrderByEnergy ) );
+        }//for( loop over sources )
+      }catch( std::exception &e )
+      {
+        problems.push_back( "Sources for '" + f.file->filename + "': " + e.what() );
+        continue;
+      }//try / catch
+
+      for( const shared_ptr<const PeakDef> &peak : f.peaks )
+      {
+        if( !peak )
+          continue;
+
+        const double width = 1.25*(peak->gausPeak() ? peak->sigma() : 0.25*peak->roiWidth());
+
+        // If the peak was assigned a nuclide (e.g., peaks saved from InterSpec), use that
+        //  assignment, like the GUI does, and skip the peak if it isnt one of the sources;
+        //  otherwise find the strongest source photon line within the peak.
+        size_t src_index = mixtures.size();
+        double line_energy = 0.0, line_rate = 0.0;
+        if( peak->parentNuclide() )
+        {
+          for( size_t i = 0; (src_index >= mixtures.size()) && (i < mixtures.size()); ++i )
+          {
+            if( f.file->sources[i].nuclide == peak->parentNuclide() )
+            {
+              src_index = i;
+              line_energy = peak->gammaParticleEnergy();
+            }
+          }//for( loop over sources )
+        }//if( peak->parentNuclide() )
+
+        for( size_t i = 0; !peak->parentNuclide() && (i < mixtures.size()); ++i )
+        {
+          const MakeDrfBatch::SourceDef &src = f.file->sources[i];
+          for( const SandiaDecay::EnergyRatePair &r : mixtures[i] )
+          {
+            if( fabs(r.energy - peak->mean()) >= width )
+              continue;
+
+            const double rate = r.numPerSecond * transmission_fraction( r.energy, src, det.air_attenuation );
+            if( rate > line_rate )
+            {
+              src_index = i;
+              line_energy = r.energy;
+              line_rate = rate;
+            }
+          }//for( const SandiaDecay::EnergyRatePair &r : mixtures[i] )
+        }//for( size_t i = 0; i < mixtures.size(); ++i )
+
+        if( src_index >= mixtures.size() )
+          continue;
+
+        //Check if we will background subtract
+        double back_peak_area = 0.0, back_peak_area_uncert = 0.0, back_peak_lt = 0.0;
+        for( const auto &b : backgroundpeaks )
+        {
+          const shared_ptr<const PeakDef> &backpeak = b.first;
+          if( fabs(backpeak->mean() - peak->mean()) < 1.5*peak->sigma()
+             || (backpeak->parentNuclide() && peak->parentNuclide() && (fabs(backpeak->gammaParticleEnergy() - peak->gammaParticleEnergy()) < 1.0)) )
+          {
+            back_peak_area += backpeak->peakArea();
+            back_peak_area_uncert = sqrt( back_peak_area_uncert*back_peak_area_uncert + backpeak->peakAreaUncert()*backpeak->peakAreaUncert() );
+            back_peak_lt += b.second;
+          }
+        }//for( const auto &b : backgroundpeaks )
+
+        const bool subBack = (back_peak_area > DBL_EPSILON && back_peak_lt > DBL_EPSILON);
+
+        MakeDrfChart::DataPoint point;
+        point.energy = static_cast<float>( line_energy );
+        point.livetime = f.live_time;
+        point.peak_area = peak->peakArea();
+        point.peak_area_uncertainty = peak->peakAreaUncert();
+
+        if( subBack )
+        {
+          const double frac_back_uncert = back_peak_area_uncert / back_peak_area;
+          const double scaled_back = point.livetime * back_peak_area / back_peak_lt;
+
+          point.peak_area -= scaled_back;
+          point.peak_area_uncertainty = sqrt( point.peak_area_uncertainty*point.peak_area_uncertainty
+                                             + scaled_back*frac_back_uncert*scaled_back*frac_back_uncert );
+        }//if( subBack )
+
+        if( point.peak_area <= 0.0f )
+        {
+          problems.push_back( "Background subtracted peak at " + std::to_string(peak->mean())
+                              + " keV in '" + f.file->filename + "' had no counts" );
+          continue;
+        }
+
+        if( peak->type() == PeakDef::GaussianDefined )
+        {
+          point.peak_fwhm = peak->fwhm();
+          point.peak_fwhm_uncertainty = 2.35482*peak->uncertainty(PeakDef::CoefficientType::Sigma);
+        }else
+        {
+          point.peak_fwhm = point.peak_fwhm_uncertainty = 0.0f;
+        }
+
+        // The contributions from all sources to this line, combined the same as the GUI does.
+        vector<MakeDrf::PeakSourceRate> rates;
+        for( size_t i = 0; i < mixtures.size(); ++i )
+        {
+          const MakeDrfBatch::SourceDef &src = f.file->sources[i];
+
+          MakeDrf::PeakSourceRate rate;
+          rate.rate = 0.0;
+          rate.distance = src.distance;
+          rate.fractionalUncert = src.activity_uncertainty;
+          for( const SandiaDecay::EnergyRatePair &r : mixtures[i] )
+          {
+            if( fabs(r.energy - point.energy) < width )
+              rate.rate += r.numPerSecond * transmission_fraction( point.energy, src, det.air_attenuation );
+          }
+
+          rates.push_back( rate );
+        }//for( size_t i = 0; i < mixtures.size(); ++i )
+
+        MakeDrfFit::DetEffDataPoint effpoint;
+        try
+        {
+          effpoint = MakeDrf::efficiencyDataPoint( point, rates, det.diameter );
+        }catch( std::exception & )
+        {
+          continue;
+        }
+
+        effpoint.energy /= (det.eff_in_mev ? 1000.0f : 1.0f);
+
+        point.distance = f.file->sources[src_index].distance;
+        point.peak_color = peak->lineColor();
+        point.background_peak_area = back_peak_area;
+        point.background_peak_live_time = back_peak_lt;
+
+        const SandiaDecay::Nuclide * const nuc = f.file->sources[src_index].nuclide;
+        char buffer[256] = { '\0' };
+        snprintf( buffer, sizeof(buffer)-1, "%s %.1f keV, Peak %.1f counts",
+                 nuc->symbol.c_str(), point.energy, point.peak_area );
+        point.source_information = buffer;
+
+        effpoints.push_back( effpoint );
+        fwhmpeaks.push_back( peak );
+        results.data.push_back( point );
+      }//for( const shared_ptr<const PeakDef> &peak : f.peaks )
+    }//for( const FilePeaks &f : files )
+
+    for( const string &msg : problems )
+      results.errorMessage += (results.errorMessage.empty() ? "" : "  ") + msg + ".";
+
+    if( effpoints.empty() )
+      throw runtime_error( "No peaks could be matched to sources." + (results.errorMessage.empty() ? string() : ("  " + results.errorMessage)) );
+
+    std::sort( begin(results.data), end(results.data),
+      []( const MakeDrfChart::DataPoint &lhs, const MakeDrfChart::DataPoint &rhs ) -> bool {
+        return lhs.energy < rhs.energy;
+    } );
+
+    const int numPeaks = static_cast<int>( effpoints.size() );
+    const int nfitpars = (det.eff_order > 0) ? std::min( std::min(det.eff_order, 8), numPeaks )
+                                             : std::min( numPeaks, 7 );
+
+    const double effChi2 = MakeDrfFit::performEfficiencyFit( effpoints, nfitpars, results.effCoefs,
+                                                            results.effCoefUncerts );
+    results.effChi2 = effChi2;
+
+    results.effLowerEnergy = results.data.front().energy;
+    results.effUpperEnergy = results.data.back().energy;
+
+    if( det.fwhm_form != DetectorPeakResponse::kNumResolutionFnctForm )
+    {
+      try
+      {
+        auto peaks = make_shared<std::deque<shared_ptr<const PeakDef>>>( fwhmpeaks );
+        
+        // Same default as the MakeDrf tool uses when the number of peaks changes.
+        const int numPeaks = static_cast<int>( fwhmpeaks.size() );
+        const int sqrtOrder = (det.sqrt_eqn_order > 0) ? det.sqrt_eqn_order
+                                                       : (std::min(numPeaks/2,4) + 1);
+        results.fwhmChi2 = MakeDrfFit::performResolutionFit( peaks, det.fwhm_form, highres,
+                                                             sqrtOrder, results.fwhmCoefs,
+                                                             results.fwhmCoefUncerts );
+      }catch( std::exception &e )
+      {
+        results.fwhmCoefs.clear();
+        results.fwhmCoefUncerts.clear();
+        results.errorMessage += string(results.errorMessage.empty() ? "" : "  ")
+                                + "Failed to fit FWHM: " + e.what() + ".";
+      }//try / catch
+    }//if( fit FWHM )
+
+    return results;
+  }//MakeDrf::FitResults fit_from_peaks(...)
+
+
+  /** Returns the string, with characters not allowed in filenames replaced by underscores. */
+  string safe_filename( string name )
+  {
+    const string notallowed = "\\/:?\"<>|*";
+    for( char &c : name )
+    {
+      if( notallowed.find(c) != string::npos )
+        c = '_';
+    }
+
+    return name.empty() ? string("drf") : name;
+  }//string safe_filename( string name )
+
+
+  bool parse_bool( string val )
+  {
+    SpecUtils::trim( val );
+    if( SpecUtils::iequals_ascii(val, "true") || SpecUtils::iequals_ascii(val, "yes") || (val == "1") )
+      return true;
+    if( SpecUtils::iequals_ascii(val, "false") || SpecUtils::iequals_ascii(val, "no") || (val == "0") )
+      return false;
+    throw runtime_error( "Invalid boolean value '" + val + "'" );
+  }//bool parse_bool( string val )
+}//namespace
+
+
+namespace MakeDrfBatch
+{
+
+SourceDef::SourceDef()
+  : nuclide( nullptr ),
+    activity( 0.0 ),
+    activity_uncertainty( 0.0 ),
+    assay_date{},
+    age_at_assay( 0.0 ),
+    distance( 0.0 ),
+    shield_atomic_number( 0.0f ),
+    shield_areal_density( 0.0f )
+{
+}
+
+
+DetectorDef::DetectorDef()
+  : name(),
+    description(),
+    diameter( 0.0 ),
+    files(),
+    eff_order( -1 ),
+    eff_in_mev( false ),
+    fwhm_form( DetectorPeakResponse::kGadrasResolutionFcn ),
+    sqrt_eqn_order( -1 ),
+    air_attenuation( true )
+{
+}
+
+
+std::vector<DetectorDef> parse_manifest( std::istream &input, const std::string &basedir )
+{
+  const SandiaDecay::SandiaDecayDataBase * const db = DecayDataBaseServer::database();
+  if( !db )
+    throw runtime_error( "Nuclear decay database not available" );
+
+  vector<DetectorDef> detectors;
+
+  string line;
+  size_t line_num = 0;
+  while( SpecUtils::safe_get_line( input, line ) )
+  {
+    ++line_num;
+    SpecUtils::trim( line );
+    if( line.empty() || (line[0] == '#') )
+      continue;
+
+    const string::size_type colon_pos = line.find( ':' );
+    if( colon_pos == string::npos )
+      throw runtime_error( "Manifest line " + std::to_string(line_num) + " has no 'key:'" );
+
+    string key = line.substr( 0, colon_pos );
+    string value = line.substr( colon_pos + 1 );
+    SpecUtils::trim( key );
+    SpecUtils::trim( value );
+    SpecUtils::to_lower_ascii( key );
+
+    vector<string> fields;
+    SpecUtils::split( fields, value, ";" );
+    for( string &field : fields )
+      SpecUtils::trim( field );
+
+    try
+    {
+      if( key == "detector" )
+      {
+        if( fields.size() < 2 )
+          throw runtime_error( "detector must have a name and diameter" );
+
+        DetectorDef det;
+        det.name = fields[0];
+        det.diameter = PhysicalUnits::stringToDistance( fields[1] );
+        for( size_t i = 2; i < fields.size(); ++i )
+          det.description += (i==2 ? "" : "; ") + fields[i];
+
+        detectors.push_back( det );
+        continue;
+      }//if( key == "detector" )
+
+      if( detectors.empty() )
+        throw runtime_error( "a 'detector:' line must come first" );
+
+      DetectorDef &det = detectors.back();
+
+      if( key == "option" )
+      {
+        const string::size_type equal_pos = value.find( '=' );
+        if( equal_pos == string::npos )
+          throw runtime_error( "option must be of the form 'key=value'" );
+
+        string optkey = value.substr( 0, equal_pos );
+        string optval = value.substr( equal_pos + 1 );
+        SpecUtils::trim( optkey );
+        SpecUtils::trim( optval );
+
+        if( SpecUtils::iequals_ascii(optkey, "eff_order") )
+        {
+          det.eff_order = std::stoi( optval );
+          if( det.eff_order < 1 || det.eff_order > 8 )
+            throw runtime_error( "eff_order must be between 1 and 8" );
+        }else if( SpecUtils::iequals_ascii(optkey, "eff_units") )
+        {
+          if( SpecUtils::iequals_ascii(optval, "MeV") )
+            det.eff_in_mev = true;
+          else if( SpecUtils::iequals_ascii(optval, "keV") )
+            det.eff_in_mev = false;
+          else
+            throw runtime_error( "eff_units must be keV or MeV" );
+        }else if( SpecUtils::iequals_ascii(optkey, "fwhm_form") )
+        {
+          if( SpecUtils::iequals_ascii(optval, "gadras") )
+            det.fwhm_form = DetectorPeakResponse::kGadrasResolutionFcn;
+          else if( SpecUtils::iequals_ascii(optval, "sqrt_plus_inverse") )
+            det.fwhm_form = DetectorPeakResponse::kSqrtEnergyPlusInverse;
+          else if( SpecUtils::iequals_ascii(optval, "sqrt_poly") )
+            det.fwhm_form = DetectorPeakResponse::kSqrtPolynomial;
+          else if( SpecUtils::iequals_ascii(optval, "none") )
+            det.fwhm_form = DetectorPeakResponse::kNumResolutionFnctForm;
+          else
+            throw runtime_error( "invalid fwhm_form '" + optval + "'" );
+        }else if( SpecUtils::iequals_ascii(optkey, "sqrt_order") )
+        {
+          det.sqrt_eqn_order = std::stoi( optval );
+        }else if( SpecUtils::iequals_ascii(optkey, "air_attenuation") )
+        {
+          det.air_attenuation = parse_bool( optval );
+        }else
+        {
+          throw runtime_error( "unknown option '" + optkey + "'" );
+        }
+      }else if( (key == "file") || (key == "background") )
+      {
+        if( value.empty() )
+          throw runtime_error( "no filename given" );
+
+        SpectrumFile file;
+        file.filename = value;
+        if( !SpecUtils::is_absolute_path(file.filename) && !basedir.empty() )
+          file.filename = SpecUtils::append_path( basedir, file.filename );
+        file.is_background = (key == "background");
+
+        if( !SpecUtils::is_file(file.filename) )
+          throw runtime_error( "file '" + file.filename + "' does not exist" );
+
+        det.files.push_back( file );
+      }else if( key == "source" )
+      {
+        if( det.files.empty() || det.files.back().is_background )
+          throw runtime_error( "a source must follow a 'file:' line" );
+
+        if( fields.size() < 3 )
+          throw runtime_error( "source must have a nuclide, activity, and distance" );
+
+        SourceDef src;
+        src.nuclide = db->nuclide( fields[0] );
+        if( !src.nuclide )
+          throw runtime_error( "invalid nuclide '" + fields[0] + "'" );
+
+        src.activity = PhysicalUnits::stringToActivity( fields[1] );
+        src.distance = PhysicalUnits::stringToDistance( fields[2] );
+
+        for( size_t i = 3; i < fields.size(); ++i )
+        {
+          const string::size_type equal_pos = fields[i].find( '=' );
+          if( equal_pos == string::npos )
+            throw runtime_error( "source field '" + fields[i] + "' is not of the form 'key=value'" );
+
+          string srckey = fields[i].substr( 0, equal_pos );
+          string srcval = fields[i].substr( equal_pos + 1 );
+          SpecUtils::trim( srckey );
+          SpecUtils::trim( srcval );
+
+          if( SpecUtils::iequals_ascii(srckey, "uncert") )
+          {
+            SpecUtils::ireplace_all( srcval, "%", "" );
+            src.activity_uncertainty = std::stod( srcval ) / 100.0;
+          }else if( SpecUtils::iequals_ascii(srckey, "assay") )
+          {
+            src.assay_date = SpecUtils::time_from_string( srcval );
+            if( SpecUtils::is_special(src.assay_date) )
+              throw runtime_error( "invalid assay date '" + srcval + "'" );
+          }else if( SpecUtils::iequals_ascii(srckey, "age") )
+          {
+            src.age_at_assay = PhysicalUnits::stringToTimeDurationPossibleHalfLife( srcval, src.nuclide->halfLife );
+          }else if( SpecUtils::iequals_ascii(srckey, "an") )
+          {
+            src.shield_atomic_number = std::stof( srcval );
+          }else if( SpecUtils::iequals_ascii(srckey, "ad") )
+          {
+            src.shield_areal_density = std::stof( srcval ) * PhysicalUnits::g / PhysicalUnits::cm2;
+          }else
+          {
+            throw runtime_error( "unknown source field '" + srckey + "'" );
+          }
+        }//for( size_t i = 3; i < fields.size(); ++i )
+
+        if( (src.shield_areal_density > 0.0f) && (src.shield_atomic_number < 1.0f) )
+          throw runtime_error( "source shielding must have an atomic number" );
+
+        det.files.back().sources.push_back( src );
+      }else
+      {
+        throw runtime_error( "unknown key '" + key + "'" );
+      }
+    }catch( std::exception &e )
+    {
+      throw runtime_error( "Manifest line " + std::to_string(line_num) + ": " + e.what() );
+    }//try / catch
+  }//while( SpecUtils::safe_get_line( input, line ) )
+
+  for( const DetectorDef &det : detectors )
+  {
+    if( det.files.empty() )
+      throw runtime_error( "Detector '" + det.name + "' has no files" );
+  }
+
+  return detectors;
+}//parse_manifest(...)
+
+
+MakeDrf::FitResults fit_detector( const DetectorDef &detector )
+{
+  vector<FilePeaks> files( detector.files.size() );
+  for( size_t i = 0; i < detector.files.size(); ++i )
+    load_file_peaks_nothrow( &(detector.files[i]), &(files[i]) );
+
+  return fit_from_peaks( detector, files );
+}//MakeDrf::FitResults fit_detector( const DetectorDef &detector )
+
+
+int run_batch( const std::string &manifest_path, const std::string &output_dir,
+               const std::string &docroot )
+{
+  vector<DetectorDef> detectors;
+
+  try
+  {
+#ifdef _WIN32
+    const std::wstring wpath = SpecUtils::convert_from_utf8_to_utf16(manifest_path);
+    ifstream input( wpath.c_str(), ios::in | ios::binary );
+#else
+    ifstream input( manifest_path.c_str(), ios::in | ios::binary );
+#endif
+    if( !input )
+      throw runtime_error( "Could not open manifest '" + manifest_path + "'" );
+
+    detectors = parse_manifest( input, SpecUtils::parent_path(manifest_path) );
+
+    if( detectors.empty() )
+      throw runtime_error( "No detectors in manifest '" + manifest_path + "'" );
+
+    if( !SpecUtils::is_directory(output_dir) && (SpecUtils::create_directory(output_dir) == 0) )
+      throw runtime_error( "Could not create output directory '" + output_dir + "'" );
+  }catch( std::exception &e )
+  {
+    cerr << e.what() << endl;
+    return -1;
+  }//try / catch
+
+  // Peak searches are the expensive part, so we'll do all the files, of all the detectors, at once.
+  vector<vector<FilePeaks>> filepeaks( detectors.size() );
+  {
+    SpecUtilsAsync::ThreadPool pool;
+    for( size_t i = 0; i < detectors.size(); ++i )
+    {
+      filepeaks[i].resize( detectors[i].files.size() );
+      for( size_t j = 0; j < detectors[i].files.size(); ++j )
+      {
+        const SpectrumFile *file = &(detectors[i].files[j]);
+        FilePeaks *result = &(filepeaks[i][j]);
+        pool.post( [file,result](){ load_file_peaks_nothrow( file, result ); } );
+      }
+    }//for( size_t i = 0; i < detectors.size(); ++i )
+    pool.join();
+  }
+
+  vector<MakeDrf::FitResults> results( detectors.size() );
+  vector<string> errors( detectors.size() );
+  {
+    SpecUtilsAsync::ThreadPool pool;
+    for( size_t i = 0; i < detectors.size(); ++i )
+    {
+      pool.post( [i,&detectors,&filepeaks,&results,&errors](){
+        try
+        {
+          results[i] = fit_from_peaks( detectors[i], filepeaks[i] );
+        }catch( std::exception &e )
+        {
+          errors[i] = e.what();
+        }
+      } );
+    }//for( size_t i = 0; i < detectors.size(); ++i )
+    pool.join();
+  }
+
+  // Writing the reference sheet creates Wt widgets, so we need a WApplication; we'll use a test
+  //  environment, since there is no browser session.
+  Wt::Test::WTestEnvironment env( Wt::Application );
+  std::unique_ptr<Wt::WApplication> app( new Wt::WApplication( env ) );
+
+  int nfailed = 0;
+  for( size_t i = 0; i < detectors.size(); ++i )
+  {
+    const DetectorDef &det = detectors[i];
+    const MakeDrf::FitResults &result = results[i];
+
+    if( !errors[i].empty() )
+    {
+      cerr << "Failed to create DRF for '" << det.name << "': " << errors[i] << endl;
+      ++nfailed;
+      continue;
+    }
+
+    if( !result.errorMessage.empty() )
+      cerr << "Warning for '" << det.name << "': " << result.errorMessage << endl;
+
+    const string basename = SpecUtils::append_path( output_dir, safe_filename(det.name) );
+
+    try
+    {
+      shared_ptr<DetectorPeakResponse> drf = MakeDrf::assembleDrf( det.name, det.description, result );
+
+      rapidxml::xml_document<char> doc;
+      drf->toXml( &doc, &doc );
+
+      ofstream drfout( (basename + ".drf.xml").c_str(), ios::out | ios::binary );
+      if( !drfout )
+        throw runtime_error( "Could not open '" + basename + ".drf.xml' for writing" );
+      rapidxml::print( static_cast<std::ostream &>(drfout), doc, 0 );
+
+      ofstream csvout( (basename + ".csv").c_str(), ios::out | ios::binary );
+      if( !csvout )
+        throw runtime_error( "Could not open '" + basename + ".csv' for writing" );
+      MakeDrf::writeCsvSummary( csvout, det.name, det.description, result, 0 );
+
+      ofstream refout( (basename + "_ref_sheet.html").c_str(), ios::out | ios::binary );
+      if( !refout )
+        throw runtime_error( "Could not open '" + basename + "_ref_sheet.html' for writing" );
+      MakeDrf::writeRefSheet( refout, det.name, det.description, result, docroot, 0 );
+
+      cout << "Created DRF for '" << det.name << "' from " << result.data.size()
+           << " peaks; efficiency chi2/dof=" << result.effChi2 << endl;
+    }catch( std::exception &e )
+    {
+      cerr << "Failed to write DRF for '" << det.name << "': " << e.what() << endl;
+      ++nfailed;
+    }//try / catch
+  }//for( size_t i = 0; i < detectors.size(); ++i )
+
+  return nfailed;
+}//int run_batch(...)
+
+}//namespace MakeDrfBatch
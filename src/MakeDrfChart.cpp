@@ -26,6 +26,9 @@
 #include <cmath>
 #include <string>
 #include <vector>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
 
 #include <Wt/WPainter>
 #include <Wt/Chart/WAxis>
@@ -56,16 +59,46 @@ namespace
   const int sm_data_fwhm_col = 2;
   const int sm_equation_eff_col = 3;
   const int sm_equation_fwhm_col = 4;
-  const int sm_equation_eff_neg_uncert_col = 5; //Currently set data for this, but not displaying pending validation of values
-  const int sm_equation_eff_pos_uncert_col = 6; //Currently set data for this, but not displaying pending validation of values
+  const int sm_equation_eff_neg_uncert_col = 5; //Only filled when a band has been set, see MakeDrfChart::setEfficiencyBand
+  const int sm_equation_eff_pos_uncert_col = 6;
+  const int sm_equation_fwhm_neg_uncert_col = 7; //Only filled when a band has been set, see MakeDrfChart::setFwhmBand
+  const int sm_equation_fwhm_pos_uncert_col = 8;
   
-  const int sm_num_model_cols = 7;
+  const int sm_num_model_cols = 9;
   /** The first `sm_num_eqn_energy_rows` rows in the model will all be points
    to chart the effificency and FWHM equations.  After that there will be
    MakeDrfChart::m_datapoints.size() more rows to represent the actual data
    points.
    */
   const int sm_num_eqn_energy_rows = 125; //ToDo: customize this based on chart size...
+  
+  /** Linearly interpolates 'values', given at ascending 'energies', to 'energy'; returns an empty
+   value if 'energy' is outside of 'energies', or there is no band.
+   */
+  boost::any interpolate_band( const std::vector<float> &energies,
+                               const std::vector<float> &values,
+                               const float energy )
+  {
+    if( energies.empty() || (values.size() != energies.size())
+       || (energy < energies.front()) || (energy > energies.back()) )
+      return boost::any();
+    
+    const auto pos = std::upper_bound( begin(energies), end(energies), energy );
+    double value = values.back();
+    if( pos != end(energies) )
+    {
+      const size_t index = static_cast<size_t>( pos - begin(energies) );
+      assert( index > 0 );
+      const double lower_energy = energies[index-1], upper_energy = energies[index];
+      const double frac = (upper_energy > lower_energy) ? ((energy - lower_energy) / (upper_energy - lower_energy)) : 0.0;
+      value = values[index-1] + frac*(values[index] - values[index-1]);
+    }//if( energy is not the last band energy )
+    
+    if( IsNan(value) || IsInf(value) )
+      return boost::any();
+    
+    return boost::any( value );
+  }//interpolate_band(...)
 }//namespace
 
 
@@ -81,6 +114,8 @@ MakeDrfChart::MakeDrfChart( Wt::WContainerWidget *parent )
   m_efficiencyEnergyUnits( EqnEnergyUnits::keV ),
   m_efficiencyCoefs{},
   m_efficiencyCoefUncerts{},
+  m_efficiencyBand{},
+  m_fwhmBand{},
   m_fwhmEqnType( FwhmCoefType::Gadras ),
   m_xRangeChanged(),
   m_chartMarginBrush(),
@@ -125,18 +160,18 @@ MakeDrfChart::MakeDrfChart( Wt::WContainerWidget *parent )
   eqn_eff_series.setMarker( Wt::Chart::MarkerType::NoMarker );
   addSeries( eqn_eff_series );
   
-  //For the moment we wont show the errors since I havent verified they are actually reasonable and correct
-  /*
-  Chart::WDataSeries eqn_eff_neg_uncert_series( sm_equation_eff_neg_uncert_col, Chart::SeriesType::CurveSeries, Chart::YAxis );
-  eqn_eff_neg_uncert_series.setMarker( Wt::Chart::MarkerType::NoMarker );
-  eqn_eff_neg_uncert_series.setPen( WPen(Wt::green) );
-  addSeries( eqn_eff_neg_uncert_series );
-  
-  Chart::WDataSeries eqn_eff_pos_uncert_series( sm_equation_eff_pos_uncert_col, Chart::SeriesType::CurveSeries, Chart::YAxis );
-  eqn_eff_pos_uncert_series.setMarker( Wt::Chart::MarkerType::NoMarker );
-  eqn_eff_pos_uncert_series.setPen( WPen(Wt::red) );
-  addSeries( eqn_eff_pos_uncert_series );
-  */
+  //The bands are only filled in when resampled uncertainties are available; they are drawn as dashed
+  //  lines the same color as their equation, and left out of the legend.
+  for( const int col : {sm_equation_eff_neg_uncert_col, sm_equation_eff_pos_uncert_col} )
+  {
+    Chart::WDataSeries eqn_eff_uncert_series( col, Chart::SeriesType::CurveSeries, Chart::YAxis );
+    eqn_eff_uncert_series.setMarker( Wt::Chart::MarkerType::NoMarker );
+    WPen pen = eqn_eff_uncert_series.pen();
+    pen.setStyle( Wt::DashLine );
+    eqn_eff_uncert_series.setPen( pen );
+    eqn_eff_uncert_series.setLegendEnabled( false );
+    addSeries( eqn_eff_uncert_series );
+  }//for( loop over efficiency band columns )
   
   
   Chart::WDataSeries data_fwhm_series( sm_data_fwhm_col, Chart::SeriesType::PointSeries, Chart::Y2Axis );
@@ -148,6 +183,17 @@ MakeDrfChart::MakeDrfChart( Wt::WContainerWidget *parent )
   eqn_fwhm_series.setMarker( Wt::Chart::MarkerType::NoMarker );
   addSeries( eqn_fwhm_series );
   
+  for( const int col : {sm_equation_fwhm_neg_uncert_col, sm_equation_fwhm_pos_uncert_col} )
+  {
+    Chart::WDataSeries eqn_fwhm_uncert_series( col, Chart::SeriesType::CurveSeries, Chart::Y2Axis );
+    eqn_fwhm_uncert_series.setMarker( Wt::Chart::MarkerType::NoMarker );
+    WPen pen = eqn_fwhm_uncert_series.pen();
+    pen.setStyle( Wt::DashLine );
+    eqn_fwhm_uncert_series.setPen( pen );
+    eqn_fwhm_uncert_series.setLegendEnabled( false );
+    addSeries( eqn_fwhm_uncert_series );
+  }//for( loop over FWHM band columns )
+  
   setPlotAreaPadding(0, Wt::Top);
   setPlotAreaPadding(55, Wt::Right | Wt::Left);
   //axis(Chart::XAxis).setTitle( "Energy (keV)" );
@@ -172,9 +218,11 @@ MakeDrfChart::MakeDrfChart( Wt::WContainerWidget *parent )
   m->setHeaderData( sm_data_eff_col, Wt::Horizontal, boost::any(WString("Data Intrinsic Eff.")), Wt::DisplayRole );
   m->setHeaderData( sm_data_fwhm_col, Wt::Horizontal, boost::any(WString("Data FWHM")), Wt::DisplayRole );
   m->setHeaderData( sm_equation_eff_col, Wt::Horizontal, boost::any(WString("Fit Intrinsic Eff.")), Wt::DisplayRole );
-  m->setHeaderData( sm_equation_eff_neg_uncert_col, Wt::Horizontal, boost::any(WString("Intrinsic Eff. +2&#963;")), Wt::DisplayRole );
-  m->setHeaderData( sm_equation_eff_pos_uncert_col, Wt::Horizontal, boost::any(WString("Fit Intrinsic Eff. -2&#963;")), Wt::DisplayRole );
+  m->setHeaderData( sm_equation_eff_neg_uncert_col, Wt::Horizontal, boost::any(WString("Fit Intrinsic Eff. Lower")), Wt::DisplayRole );
+  m->setHeaderData( sm_equation_eff_pos_uncert_col, Wt::Horizontal, boost::any(WString("Fit Intrinsic Eff. Upper")), Wt::DisplayRole );
   m->setHeaderData( sm_equation_fwhm_col, Wt::Horizontal, boost::any(WString("Fit FWHM")), Wt::DisplayRole );
+  m->setHeaderData( sm_equation_fwhm_neg_uncert_col, Wt::Horizontal, boost::any(WString("Fit FWHM Lower")), Wt::DisplayRole );
+  m->setHeaderData( sm_equation_fwhm_pos_uncert_col, Wt::Horizontal, boost::any(WString("Fit FWHM Upper")), Wt::DisplayRole );
   
   setLegendEnabled( true );
   setLegendLocation( Wt::Chart::LegendLocation::LegendInside, Wt::Top, Wt::AlignmentFlag::AlignRight );
@@ -427,38 +475,8 @@ void MakeDrfChart::updateEffEquationToModel()
     {
       m->setData( row, sm_equation_eff_col, boost::any(eff) );
       
-      boost::any lowerval, upperval;
-      
-      if( m_efficiencyCoefUncerts.size() == m_efficiencyCoefs.size() )
-      {
-        double neguncert = 0.0, posuncert = 0.0;
-        
-        for( size_t i = 0; i < m_efficiencyCoefUncerts.size(); ++i )
-        {
-          const float orig = m_efficiencyCoefs[i];
-          m_efficiencyCoefs[i] = orig + 2.0f*m_efficiencyCoefUncerts[i];
-          const double plus = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energy*units, m_efficiencyCoefs ) - eff;
-          m_efficiencyCoefs[i] = orig - 2.0f*m_efficiencyCoefUncerts[i];
-          const double minus = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energy*units, m_efficiencyCoefs ) - eff;
-          m_efficiencyCoefs[i] = orig;
-          if( plus > 0.0 )
-            posuncert += plus*plus;
-          else
-            neguncert += plus*plus;
-          if( minus > 0.0 )
-            posuncert += minus*minus;
-          else
-            neguncert += minus*minus;
-        }//for( size_t i = 0; i < m_efficiencyCoefUncerts.size(); ++i )
-        
-        posuncert = sqrt(posuncert);
-        neguncert = sqrt(neguncert);
-        
-        if( IsNan(posuncert) || IsInf(posuncert) )
-          upperval = boost::any( eff + posuncert );
-        if( IsNan(neguncert) || IsInf(neguncert) )
-          lowerval = boost::any( eff - neguncert );
-      }//if( we have uncertainties )
+      const boost::any lowerval = interpolate_band( m_efficiencyBand.energies, m_efficiencyBand.lower, energy );
+      const boost::any upperval = interpolate_band( m_efficiencyBand.energies, m_efficiencyBand.upper, energy );
       
       m->setData( row, sm_equation_eff_pos_uncert_col, upperval );
       m->setData( row, sm_equation_eff_neg_uncert_col, lowerval );
@@ -490,7 +508,11 @@ void MakeDrfChart::updateFwhmEquationToModel()
       return;
     
     for( int row = 0; row < sm_num_eqn_energy_rows; ++row )
+    {
       m->setData( row, sm_equation_fwhm_col, boost::any() );
+      m->setData( row, sm_equation_fwhm_pos_uncert_col, boost::any() );
+      m->setData( row, sm_equation_fwhm_neg_uncert_col, boost::any() );
+    }
     return;
   }//if( no equation )
   
@@ -516,6 +538,8 @@ void MakeDrfChart::updateFwhmEquationToModel()
     const float energy = static_cast<float>( m_det_lower_energy + ((m_det_upper_energy * row) / (sm_num_eqn_energy_rows - 1.0)) );
     const double fwhm = DetectorPeakResponse::peakResolutionFWHM( units*energy, eqnType, m_fwhmCoefs );
     m->setData( row, sm_equation_fwhm_col, boost::any(fwhm) );
+    m->setData( row, sm_equation_fwhm_neg_uncert_col, interpolate_band( m_fwhmBand.energies, m_fwhmBand.lower, energy ) );
+    m->setData( row, sm_equation_fwhm_pos_uncert_col, interpolate_band( m_fwhmBand.energies, m_fwhmBand.upper, energy ) );
   }//for( loop over eqn rows )
 }//void updateFwhmEquationToModel()
 
@@ -580,9 +604,10 @@ void MakeDrfChart::updateColorTheme( std::shared_ptr<const ColorTheme> theme )
     fwhmcolor = WColor(GlobalColor::gray);
   setSeriesColor( eqnFwhmSeries, fwhmcolor );
   
-  //Efficiency series not yet implemented
-  //WDataSeries &negEffUncertSeries = series(sm_equation_eff_neg_uncert_col);
-  //WDataSeries &posEffUncertSeries = series(sm_equation_eff_pos_uncert_col);
+  setSeriesColor( series(sm_equation_eff_neg_uncert_col), effcolor );
+  setSeriesColor( series(sm_equation_eff_pos_uncert_col), effcolor );
+  setSeriesColor( series(sm_equation_fwhm_neg_uncert_col), fwhmcolor );
+  setSeriesColor( series(sm_equation_fwhm_pos_uncert_col), fwhmcolor );
   
   update(); //trigger re-render
 }//void updateColorTheme();
@@ -740,6 +765,7 @@ void MakeDrfChart::setFwhmCoefficients( const std::vector<float> &coeffs,
   m_fwhmCoefUncerts = uncerts;
   m_fwhmEqnType = eqnType;
   m_fwhmEnergyUnits = units;
+  m_fwhmBand = EqnBand();
   updateFwhmEquationToModel();
   updateYAxisRange();
 }//void setFwhmCoefficients( const std::vector<double> &coeffs )
@@ -752,11 +778,49 @@ void MakeDrfChart::setEfficiencyCoefficients( const std::vector<float> &coeffs,
   m_efficiencyCoefs = coeffs;
   m_efficiencyCoefUncerts = uncerts;
   m_efficiencyEnergyUnits = units;
+  m_efficiencyBand = EqnBand();
   updateEffEquationToModel();
   updateYAxisRange();
 }//void setEfficiencyCoefficients( const std::vector<double> &coeffs )
 
 
+std::vector<float> MakeDrfChart::equationEnergies() const
+{
+  vector<float> energies( sm_num_eqn_energy_rows );
+  for( int row = 0; row < sm_num_eqn_energy_rows; ++row )
+    energies[row] = static_cast<float>( m_det_lower_energy + ((m_det_upper_energy * row) / (sm_num_eqn_energy_rows - 1.0)) );
+  return energies;
+}//std::vector<float> equationEnergies() const
+
+
+void MakeDrfChart::setEfficiencyBand( const std::vector<float> &energies,
+                                      const std::vector<float> &lower,
+                                      const std::vector<float> &upper )
+{
+  if( (lower.size() != energies.size()) || (upper.size() != energies.size()) )
+    throw runtime_error( "MakeDrfChart::setEfficiencyBand: band and energies must be same size" );
+  
+  m_efficiencyBand.energies = energies;
+  m_efficiencyBand.lower = lower;
+  m_efficiencyBand.upper = upper;
+  updateEffEquationToModel();
+}//void setEfficiencyBand(...)
+
+
+void MakeDrfChart::setFwhmBand( const std::vector<float> &energies,
+                                const std::vector<float> &lower,
+                                const std::vector<float> &upper )
+{
+  if( (lower.size() != energies.size()) || (upper.size() != energies.size()) )
+    throw runtime_error( "MakeDrfChart::setFwhmBand: band and energies must be same size" );
+  
+  m_fwhmBand.energies = energies;
+  m_fwhmBand.lower = lower;
+  m_fwhmBand.upper = upper;
+  updateFwhmEquationToModel();
+}//void setFwhmBand(...)
+
+
 void MakeDrfChart::setDataPoints( const std::vector<MakeDrfChart::DataPoint> &datapoints,
                                   const float det_diameter,
                                   const float lower_energy, const float upper_energy )
@@ -802,6 +866,8 @@ void MakeDrfChart::showFwhmPoints( const bool show )
 {
   series(sm_data_fwhm_col).setHidden( !show );
   series(sm_equation_fwhm_col).setHidden( !show );
+  series(sm_equation_fwhm_neg_uncert_col).setHidden( !show );
+  series(sm_equation_fwhm_pos_uncert_col).setHidden( !show );
   axis(Chart::Y2Axis).setVisible( show );
   setPlotAreaPadding( (show ? 55 : 10), Wt::Right );
 }//void showFwhmPoints( const bool show )
@@ -23,7 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <cmath>
+#include <random>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
 
 #define BOOST_UBLAS_TYPE_CHECK 0
 #include <boost/numeric/ublas/lu.hpp>
@@ -46,6 +51,7 @@
 
 #include "InterSpec/PeakDef.h"
 #include "InterSpec/MakeDrfFit.h"
+#include "SpecUtils/SpecUtilsAsync.h"
 
 
 using namespace std;
@@ -61,12 +67,23 @@ namespace
     std::deque<std::shared_ptr<const PeakDef>> m_peaks;
     DetectorPeakResponse::ResolutionFnctForm m_form;
     
+    /** The means of (non-null) #m_peaks, so we can evaluate the resolution for all of them at once. */
+    std::vector<float> m_energies;
+    
   public:
     DetectorResolutionFitness( const std::deque<std::shared_ptr<const PeakDef>> &peaks,
                               DetectorPeakResponse::ResolutionFnctForm form )
-    : m_peaks( peaks ),
+    : m_peaks(),
     m_form( form )
     {
+      for( const PeakModel::PeakShrdPtr &peak : peaks )
+      {
+        if( peak )  //probably isnt needed
+        {
+          m_peaks.push_back( peak );
+          m_energies.push_back( static_cast<float>( peak->mean() ) );
+        }
+      }//for( const PeakModel::PeakShrdPtr &peak : peaks )
     }
     
     virtual ~DetectorResolutionFitness(){}
@@ -82,17 +99,19 @@ namespace
       for( size_t i = 0; i < x.size(); ++i )
         fx[i] = static_cast<float>( x[i] );
       
+      vector<float> predicted_sigmas( m_energies.size() );
+      DetectorPeakResponse::peakResolutionSigmas( m_energies.data(), m_energies.size(), m_form, fx,
+                                                  predicted_sigmas.data() );
+      
       double chi2 = 0.0;
-      for( const PeakModel::PeakShrdPtr &peak : m_peaks )
+      for( size_t i = 0; i < m_peaks.size(); ++i )
       {
-        if( !peak )  //probably isnt needed
-          continue;
-        const float predicted = DetectorPeakResponse::peakResolutionSigma( peak->mean(), m_form, fx );
+        const float predicted = predicted_sigmas[i];
         if( predicted <= 0.0 || IsNan(predicted) || IsInf(predicted) )
           return 999999.9;
         
-        chi2 += MakeDrfFit::peak_width_chi2( predicted, *peak );
-      }//for( const EnergySigma &es : m_energies_and_sigmas )
+        chi2 += MakeDrfFit::peak_width_chi2( predicted, *m_peaks[i] );
+      }//for( size_t i = 0; i < m_peaks.size(); ++i )
       
       return chi2;
     }//DoEval();
@@ -108,6 +127,7 @@ namespace
       {
         m_peaks = rhs.m_peaks;
         m_form = rhs.m_form;
+        m_energies = rhs.m_energies;
       }
       return *this;
     }
@@ -123,11 +143,16 @@ namespace
     std::vector<MakeDrfFit::DetEffDataPoint> m_data;
     int m_order;
     
+    /** The energies of #m_data, so we can evaluate the efficiency for all of them at once. */
+    std::vector<float> m_energies;
+    
   public:
     DetectorEffFitness( const std::vector<MakeDrfFit::DetEffDataPoint> &data, const int order )
     : m_data( data ),
       m_order( order )
     {
+      for( const MakeDrfFit::DetEffDataPoint &point : m_data )
+        m_energies.push_back( static_cast<float>( point.energy ) );
     }
     
     virtual ~DetectorEffFitness(){}
@@ -142,10 +167,15 @@ namespace
       for( size_t i = 0; i < x.size(); ++i )
         fx[i] = static_cast<float>( x[i] );
       
+      vector<float> eqneffs( m_energies.size() );
+      DetectorPeakResponse::expOfLogPowerSeriesEfficiencies( m_energies.data(), m_energies.size(),
+                                                             fx, eqneffs.data() );
+      
       double chi2 = 0.0;
-      for( const MakeDrfFit::DetEffDataPoint &data : m_data )
+      for( size_t i = 0; i < m_data.size(); ++i )
       {
-        const float eqneff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( data.energy, fx );
+        const MakeDrfFit::DetEffDataPoint &data = m_data[i];
+        const float eqneff = eqneffs[i];
         if( eqneff <= 0.0 || IsNan(eqneff) || IsInf(eqneff) )
           return 999999.9;
         
@@ -170,6 +200,7 @@ namespace
       {
         m_data = rhs.m_data;
         m_order = rhs.m_order;
+        m_energies = rhs.m_energies;
       }
       return *this;
     }
@@ -772,8 +803,9 @@ double fit_intrinsic_eff_least_linear_squares( const std::vector<DetEffDataPoint
   
   for( size_t row = 0; row < nbin; ++row )
   {
+    // The uncertainties are fractional, which is the uncertainty of log(eff) (to first order)
     const double data_y = log(effs[row]);
-    const double data_y_uncert = fabs( log(effs_uncert[row]) );
+    const double data_y_uncert = (effs_uncert[row] > 0.0f) ? effs_uncert[row] : 0.05;
     
     b(row) = data_y / data_y_uncert;
     for( int col = 0; col < order; ++col )
@@ -805,7 +837,8 @@ double fit_intrinsic_eff_least_linear_squares( const std::vector<DetEffDataPoint
     for( int i = 0; i < order; ++i )
       y_pred += a(i) * std::pow( log(x[bin]), double(i) );
     y_pred = exp( y_pred );
-    chi2 += std::pow( (y_pred - effs[bin]) / effs_uncert[bin], 2.0 );
+    const double frac_uncert = (effs_uncert[bin] > 0.0f) ? effs_uncert[bin] : 0.05;
+    chi2 += std::pow( (y_pred - effs[bin]) / (frac_uncert*effs[bin]), 2.0 );
   }//for( int bin = 0; bin < nbin; ++bin )
   
   return chi2;
@@ -970,4 +1003,281 @@ double performEfficiencyFit( const std::vector<DetEffDataPoint> data,
   return (fcnOrder == data.size()) ? chi2 : (chi2 / (data.size() - fcnOrder));
 }//performEfficiencyFit(...)
   
+  
+namespace
+{
+/** Runs 'fit_trial' for each trial index in parallel, and computes the statistics of the returned
+ coefficients and of 'eval' (the fit function evaluated at 'energies' for a set of coefficients).
+ 
+ 'fit_trial' should throw an exception if the trial could not be fit.
+ */
+BootstrapResult run_bootstrap( const size_t num_trials,
+                               const std::vector<float> &energies,
+                               const double confidence_level,
+                               const std::function<std::vector<float>(size_t)> &fit_trial,
+                               const std::function<void(const std::vector<float> &,std::vector<float> &)> &eval )
+{
+  if( num_trials < 2 )
+    throw runtime_error( "Bootstrap requires at least two trials" );
+  
+  if( confidence_level <= 0.0 || confidence_level >= 1.0 )
+    throw runtime_error( "Bootstrap confidence level must be between zero and one" );
+  
+  vector<vector<float>> trial_coefs( num_trials );
+  
+  // Fit the trials in a few large chunks, rather than posting each (quick) fit to the pool.
+  const size_t nthreads = static_cast<size_t>( std::max( 1, SpecUtilsAsync::num_logical_cpu_cores() ) );
+  const size_t chunk_size = std::max( size_t(1), (num_trials + nthreads - 1) / nthreads );
+  
+  SpecUtilsAsync::ThreadPool pool;
+  for( size_t start = 0; start < num_trials; start += chunk_size )
+  {
+    const size_t stop = std::min( num_trials, start + chunk_size );
+    pool.post( [start,stop,&trial_coefs,&fit_trial](){
+      for( size_t trial = start; trial < stop; ++trial )
+      {
+        try
+        {
+          trial_coefs[trial] = fit_trial( trial );
+        }catch( std::exception & )
+        {
+          trial_coefs[trial].clear();
+        }
+      }//for( loop over trials in this chunk )
+    } );
+  }//for( loop over chunks )
+  pool.join();
+  
+  size_t ncoefs = 0;
+  for( const vector<float> &coefs : trial_coefs )
+    ncoefs = std::max( ncoefs, coefs.size() );
+  
+  vector<const vector<float> *> good_fits;
+  for( const vector<float> &coefs : trial_coefs )
+  {
+    if( !coefs.empty() && (coefs.size() == ncoefs)
+       && std::all_of( begin(coefs), end(coefs), [](float v){ return std::isfinite(v); } ) )
+      good_fits.push_back( &coefs );
+  }//for( const vector<float> &coefs : trial_coefs )
+  
+  if( (ncoefs == 0) || (2*good_fits.size() < num_trials) || (good_fits.size() < 2) )
+    throw runtime_error( "Only " + std::to_string(good_fits.size()) + " of "
+                         + std::to_string(num_trials) + " resampled data sets could be fit" );
+  
+  const size_t nfits = good_fits.size();
+  
+  BootstrapResult result;
+  result.num_successful_fits = nfits;
+  result.coef_means.assign( ncoefs, 0.0 );
+  result.coef_covariance.assign( ncoefs, vector<double>(ncoefs, 0.0) );
+  
+  for( const vector<float> *coefs : good_fits )
+  {
+    for( size_t i = 0; i < ncoefs; ++i )
+      result.coef_means[i] += (*coefs)[i];
+  }
+  for( size_t i = 0; i < ncoefs; ++i )
+    result.coef_means[i] /= nfits;
+  
+  for( const vector<float> *coefs : good_fits )
+  {
+    for( size_t i = 0; i < ncoefs; ++i )
+    {
+      const double di = (*coefs)[i] - result.coef_means[i];
+      for( size_t j = 0; j <= i; ++j )
+        result.coef_covariance[i][j] += di * ((*coefs)[j] - result.coef_means[j]);
+    }
+  }//for( const vector<float> *coefs : good_fits )
+  
+  for( size_t i = 0; i < ncoefs; ++i )
+  {
+    for( size_t j = 0; j <= i; ++j )
+    {
+      result.coef_covariance[i][j] /= (nfits - 1);
+      result.coef_covariance[j][i] = result.coef_covariance[i][j];
+    }
+  }//for( size_t i = 0; i < ncoefs; ++i )
+  
+  // Evaluate every fit at every energy, then take the percentiles at each energy.
+  const size_t nenergy = energies.size();
+  result.energies = energies;
+  result.lower_band.resize( nenergy );
+  result.upper_band.resize( nenergy );
+  
+  if( nenergy )
+  {
+    vector<float> values( nfits * nenergy ), fit_values( nenergy );
+    for( size_t fit = 0; fit < nfits; ++fit )
+    {
+      eval( *good_fits[fit], fit_values );
+      std::copy( begin(fit_values), end(fit_values), begin(values) + fit*nenergy );
+    }
+    
+    const double tail = 0.5*(1.0 - confidence_level);
+    const size_t lower_index = static_cast<size_t>( std::floor( tail*(nfits - 1) ) );
+    const size_t upper_index = static_cast<size_t>( std::ceil( (1.0 - tail)*(nfits - 1) ) );
+    
+    vector<float> at_energy( nfits );
+    for( size_t i = 0; i < nenergy; ++i )
+    {
+      for( size_t fit = 0; fit < nfits; ++fit )
+        at_energy[fit] = values[fit*nenergy + i];
+      
+      std::nth_element( begin(at_energy), begin(at_energy) + lower_index, end(at_energy) );
+      result.lower_band[i] = at_energy[lower_index];
+      std::nth_element( begin(at_energy), begin(at_energy) + upper_index, end(at_energy) );
+      result.upper_band[i] = at_energy[upper_index];
+    }//for( size_t i = 0; i < nenergy; ++i )
+  }//if( nenergy )
+  
+  return result;
+}//BootstrapResult run_bootstrap(...)
+  
+  
+/** Refits the GADRAS FWHM function to resampled peaks, starting from the nominal coefficients.
+ 
+ The nominal fit (#performResolutionFit) already scanned for the correct "A" minimum, and the
+ resampled peaks differ from the nominal ones only by their uncertainties, so a single local
+ minimization is enough; running the full fit (with its ten-step scan) for every trial is what made
+ resampling the GADRAS form slow.
+ */
+vector<float> refit_gadras_resolution( const std::deque< std::shared_ptr<const PeakDef> > &peaks,
+                                       const std::vector<float> &nominal_coefs )
+{
+  if( nominal_coefs.size() != 3 )
+    throw runtime_error( "refit_gadras_resolution: expected three coefficients" );
+  
+  DetectorResolutionFitness fitness( peaks, DetectorPeakResponse::kGadrasResolutionFcn );
+  
+  // Parameters that #performResolutionFit holds fixed for few peaks are held fixed here too.
+  ROOT::Minuit2::MnUserParameters inputPrams;
+  for( size_t i = 0; i < 3; ++i )
+  {
+    const string name( 1, static_cast<char>('A' + i) );
+    const double value = nominal_coefs[i];
+    const bool fixed = ((i == 0) && (peaks.size() < 3)) || ((i == 2) && (peaks.size() < 2));
+    if( fixed )
+      inputPrams.Add( name, value );
+    else
+      inputPrams.Add( name, value, std::max( 0.01, 0.05*std::fabs(value) ) );
+  }//for( size_t i = 0; i < 3; ++i )
+  
+  ROOT::Minuit2::MnUserParameterState inputParamState( inputPrams );
+  ROOT::Minuit2::MnStrategy strategy( 1 );
+  ROOT::Minuit2::MnMinimize fitter( fitness, inputParamState, strategy );
+  
+  const ROOT::Minuit2::FunctionMinimum minimum = fitter( 50000, 0.5 );
+  if( !minimum.IsValid() )
+    throw runtime_error( "refit_gadras_resolution: fit not valid" );
+  
+  vector<float> coefs;
+  for( const double p : fitter.Params() )
+    coefs.push_back( static_cast<float>(p) );
+  
+  return coefs;
+}//vector<float> refit_gadras_resolution(...)
+}//namespace
+  
+  
+BootstrapResult bootstrap_efficiency_fit( const std::vector<DetEffDataPoint> &data,
+                                          const int fcnOrder,
+                                          const size_t num_trials,
+                                          const std::vector<float> &energies,
+                                          const double confidence_level )
+{
+  if( data.empty() )
+    throw runtime_error( "MakeDrfFit::bootstrap_efficiency_fit(...): no input data" );
+  
+  if( fcnOrder < 1 || fcnOrder > static_cast<int>(data.size()) )
+    throw runtime_error( "MakeDrfFit::bootstrap_efficiency_fit(...): invalid fit order" );
+  
+  const auto fit_trial = [&data,fcnOrder]( const size_t trial ) -> vector<float> {
+    std::mt19937 generator( static_cast<std::mt19937::result_type>(trial + 1) );
+    std::normal_distribution<double> normal( 0.0, 1.0 );
+    
+    // The uncertainties are fractional, and the fit is done in log space, so sample there too; this
+    //  also keeps the efficiencies positive.
+    vector<DetEffDataPoint> resampled = data;
+    for( DetEffDataPoint &p : resampled )
+      p.efficiency *= static_cast<float>( std::exp( p.efficiency_uncert*normal(generator) ) );
+    
+    vector<float> coefs, uncerts;
+    fit_intrinsic_eff_least_linear_squares( resampled, fcnOrder, coefs, uncerts );
+    return coefs;
+  };//fit_trial
+  
+  const auto eval = [&energies]( const vector<float> &coefs, vector<float> &values ){
+    DetectorPeakResponse::expOfLogPowerSeriesEfficiencies( energies.data(), energies.size(),
+                                                           coefs, values.data() );
+  };
+  
+  return run_bootstrap( num_trials, energies, confidence_level, fit_trial, eval );
+}//bootstrap_efficiency_fit(...)
+  
+  
+BootstrapResult bootstrap_resolution_fit( const std::deque< std::shared_ptr<const PeakDef> > &peaks,
+                                          const DetectorPeakResponse::ResolutionFnctForm fnctnlForm,
+                                          const bool highResolution,
+                                          const int sqrtEqnOrder,
+                                          const std::vector<float> &nominal_coefs,
+                                          const size_t num_trials,
+                                          const std::vector<float> &energies,
+                                          const double confidence_level )
+{
+  if( peaks.empty() )
+    throw runtime_error( "MakeDrfFit::bootstrap_resolution_fit(...): no input peaks" );
+  
+  if( nominal_coefs.empty() )
+    throw runtime_error( "MakeDrfFit::bootstrap_resolution_fit(...): nominal coefficients required" );
+  
+  const auto fit_trial = [&]( const size_t trial ) -> vector<float> {
+    std::mt19937 generator( static_cast<std::mt19937::result_type>(trial + 1) );
+    std::normal_distribution<double> normal( 0.0, 1.0 );
+    
+    auto resampled = std::make_shared<std::deque< std::shared_ptr<const PeakDef> > >();
+    for( const shared_ptr<const PeakDef> &orig : peaks )
+    {
+      if( !orig || !orig->gausPeak() )
+        continue;
+      
+      // Same uncertainty as #fit_sqrt_poly_fwhm_lls assumes, sampled in log space to keep the
+      //  widths positive.
+      const double sigma = orig->sigma();
+      const double sigma_uncert = (orig->sigmaUncert() > 0.0) ? std::max( orig->sigmaUncert(), 0.01*sigma )
+                                                               : 0.05*sigma;
+      
+      auto peak = std::make_shared<PeakDef>( *orig );
+      peak->setSigma( sigma * std::exp( (sigma_uncert/sigma)*normal(generator) ) );
+      resampled->push_back( peak );
+    }//for( const shared_ptr<const PeakDef> &orig : peaks )
+    
+    vector<float> coefs, uncerts;
+    switch( fnctnlForm )
+    {
+      case DetectorPeakResponse::kSqrtEnergyPlusInverse:
+        fit_sqrt_poly_fwhm_lls( *resampled, 3, true, coefs, uncerts );
+        break;
+        
+      case DetectorPeakResponse::kSqrtPolynomial:
+        fit_sqrt_poly_fwhm_lls( *resampled, static_cast<int>(nominal_coefs.size()), false, coefs, uncerts );
+        break;
+        
+      case DetectorPeakResponse::kGadrasResolutionFcn:
+        coefs = refit_gadras_resolution( *resampled, nominal_coefs );
+        break;
+        
+      case DetectorPeakResponse::kNumResolutionFnctForm:
+        throw runtime_error( "invalid ResolutionFnctForm" );
+    }//switch( fnctnlForm )
+    
+    return coefs;
+  };//fit_trial
+  
+  const auto eval = [&energies,fnctnlForm]( const vector<float> &coefs, vector<float> &values ){
+    DetectorPeakResponse::peakResolutionFWHMs( energies.data(), energies.size(), fnctnlForm,
+                                               coefs, values.data() );
+  };
+  
+  return run_bootstrap( num_trials, energies, confidence_level, fit_trial, eval );
+}//bootstrap_resolution_fit(...)
 }//namespace MakeDrfFit
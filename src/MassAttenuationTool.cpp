@@ -24,12 +24,17 @@
 #include "InterSpec_config.h"
 
 #include <map>
+#include <cmath>
 #include <mutex>
+#include <cfloat>
 #include <cstdio>
+#include <cstdint>
 #include <string>
+#include <memory>
 #include <vector>
 #include <utility>
 #include <fstream>
+#include <algorithm>
 #include <stdexcept>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -122,6 +127,29 @@ namespace
     float FluorescenceYield[100]; //not used
   };//struct AttCoeffData
   
+  /** The total attenuation coefficient of each element is resampled onto a grid that is uniform in
+   log(energy), so the common case of looking up a coefficient is just computing a grid index and a
+   linear interpolation, instead of a binary search and pow(...) for each process.
+   The grid starts a little above the lowest energy the data is valid for, and with 256 nodes per
+   decade, ends at ~99.3 MeV; energies outside of the grid use the full calculation.
+   */
+  const double sm_uniform_grid_min_energy = 1.02*PhysicalUnits::keV;
+  const double sm_uniform_grid_log_step = std::log(10.0) / 256.0;
+  const size_t sm_uniform_grid_num_cells = 1277;
+  
+  /** The maximum relative difference, from the full calculation, of the linear interpolation within a
+   grid cell, before the cell is marked to always use the full calculation.  With 256 nodes per
+   decade, about 2% of cells (those with absorption edges) exceed this, and the largest difference
+   seen for the remaining cells, when checked at random energies, is about 1.2E-4.
+   */
+  const double sm_uniform_grid_tolerance = 1.0E-4;
+  
+  inline double uniform_grid_energy( const double grid_index )
+  {
+    return sm_uniform_grid_min_energy * std::exp( grid_index * sm_uniform_grid_log_step );
+  }
+  
+  
   struct ElementProccessCoeffients
   {
     MassAttenuation::GammaEmProcces m_proccess;
@@ -138,6 +166,20 @@ namespace
     int m_atomicNumber;
     ElementProccessCoeffients m_proccesses[static_cast<int>(MassAttenuation::GammaEmProcces::NumGammaEmProcces)];
     
+    /** The total attenuation coefficient (compton + photoelectric + pair production), evaluated at
+     each node of the uniform log-energy grid (see #uniform_grid_energy); filled by #fillUniformGrid.
+     */
+    std::vector<float> m_uniformGridMu;
+    
+    /** For each cell of the uniform grid (i.e., between nodes i and i+1), non-zero if linearly
+     interpolating #m_uniformGridMu isnt accurate enough (e.g., the cell contains an absorption
+     edge), and the coefficient must instead be calculated from #m_proccesses.
+     */
+    std::vector<uint8_t> m_uniformGridExact;
+    
+    /** Fills #m_uniformGridMu and #m_uniformGridExact; must be called after #loadTxt. */
+    void fillUniformGrid();
+    
     size_t memsize() const;
     
 #ifdef _WIN32
@@ -150,6 +192,56 @@ namespace
   };//struct ElementAttenuation
 
 
+  /** The number of elements, and hence atomic-number nodes, of #AtomicNumberEnergySurface. */
+  const size_t sm_num_an_nodes = static_cast<size_t>( MassAttenuation::sm_max_xs_atomic_number
+                                                      - MassAttenuation::sm_min_xs_atomic_number + 1 );
+  
+  
+  /** The (atomic number, log-energy) surface #MassAttenuation::massAttenuationCoeficientSmoothAN
+   interpolates on: log(μ) of every element, and its derivative with respect to atomic number, at
+   every node of the uniform log-energy grid.  Precomputing the derivatives (i.e., the cubic
+   Hermite tangents) means a fractional atomic number only needs the two elements on either side
+   of it, at the two grid nodes on either side of the energy.
+   
+   Takes up about 1.1 MB; built the first time it is needed, as it requires loading all elements.
+   */
+  struct AtomicNumberEnergySurface
+  {
+    /** Indexed by (grid node)*#sm_num_an_nodes + (atomic number - sm_min_xs_atomic_number). */
+    std::vector<float> m_logMu;
+    
+    /** Fritsch-Butland tangents of #m_logMu with respect to atomic number; same indexing. */
+    std::vector<float> m_dLogMuDAn;
+    
+    /** Indexed by (grid cell)*#sm_num_an_nodes + (atomic number - sm_min_xs_atomic_number); non-zero
+     if interpolating between the atomic number, and the next, would use an element whose
+     #ElementAttenuation::m_uniformGridExact is set for the cell (i.e., there is an absorption edge).
+     */
+    std::vector<uint8_t> m_exact;
+    
+    /** Sets 'mu', and if non-null 'dmu_dan', from the surface, and returns true; returns false,
+     without modifying anything, if the energy is off the grid, or in a cell marked #m_exact.
+     
+     \param an Atomic number, already clamped to the valid range.
+     */
+    bool interpolate( const float an, const float energy, float &mu, float *dmu_dan ) const;
+    
+    size_t memsize() const;
+  };//struct AtomicNumberEnergySurface
+  
+  
+  /** Fritsch-Butland tangent at a node, from the secants to its left and right: their harmonic
+   mean, or zero at a local extremum, which keeps a cubic Hermite interpolation monotonic between
+   nodes, so there is no overshoot near absorption edges.
+   */
+  inline float fritsch_butland_tangent( const float left_secant, const float right_secant )
+  {
+    if( (left_secant*right_secant) <= 0.0f )
+      return 0.0f;
+    return 2.0f*left_secant*right_secant / (left_secant + right_secant);
+  }
+  
+  
   /**
    Valid for for atomic numbers 1 through (and including) 98.
    Class should be thread safe... but not comprehensively tested yet.
@@ -205,11 +297,21 @@ namespace
      */
     float massAttenuationCoeficientFracAN( const float atomic_number, const float energy );
     
+    /** Same as #massAttenuationCoeficient, but for many energies at once. */
+    void massAttenuationCoeficients( const int atomic_number,
+                                     const std::vector<float> &energies,
+                                     std::vector<float> &coefficients );
     
     static float logLogInterpolate( const float energy,
                                    const std::vector<float> &logenergy,
                                    const std::vector<float> &logxs );
     
+    /** Returns the surface used for fractional atomic numbers, building it the first time called.
+     
+     Will throw ErrorLoadingDataException if the XS data of any element cannot be loaded.
+     */
+    const AtomicNumberEnergySurface &atomicNumberEnergySurface();
+    
     /** Gives approximatly how much memorry is being taken up by this object.
      * Gives ~722 kb on my 64 bit mac.
      * \returns approximate memory this object is taking up, in bytes.
@@ -229,6 +331,8 @@ namespace
 #endif
     
     std::atomic<const ElementAttenuation *> m_atten[98];
+    
+    std::atomic<const AtomicNumberEnergySurface *> m_anSurface;
   };//class MassAttenuationTool
   
   inline float calcMassAttenuationCoeficient( const float energy,
@@ -242,6 +346,65 @@ namespace
                                                   data->m_proccesses[static_cast<int>(process)].m_logEnergies,
                                                   data->m_proccesses[static_cast<int>(process)].m_logAttenuationCoeffs );
   }//calcMassAttenuationCoeficient(...)
+  
+  
+  /** Calculates compton + photoelectric + pair production from the tabulated data of each process,
+   without using the uniform log-energy grid.
+   */
+  inline float calcTotalMassAttenuationCoeficient( const float energy,
+                                                  const ElementAttenuation * const data )
+  {
+    float comptXs = 0.0, photoXs = 0.0, convXs = 0.0;
+    try
+    {
+      comptXs = calcMassAttenuationCoeficient( energy, MassAttenuation::GammaEmProcces::ComptonScatter, data );
+    }catch(...){}
+    
+    try
+    {
+      photoXs = calcMassAttenuationCoeficient( energy, MassAttenuation::GammaEmProcces::PhotoElectric, data );
+    }catch(...){}
+    
+    try
+    {
+      if( energy > 1024.0*PhysicalUnits::keV )
+      {
+        convXs = calcMassAttenuationCoeficient( energy, MassAttenuation::GammaEmProcces::PairProduction, data );
+      }
+    }catch(...){}
+    
+    return comptXs + photoXs + convXs;
+  }//calcTotalMassAttenuationCoeficient(...)
+  
+  
+  /** Returns the total attenuation coefficient by linearly interpolating the uniform log-energy grid,
+   or if the energy is outside the grid, or in a cell marked as needing the full calculation, the
+   full calculation is used.
+   
+   \param log_energy The natural log of the energy.
+   */
+  inline float uniformGridMassAttenuationCoeficient( const float energy, const float log_energy,
+                                                    const ElementAttenuation * const data )
+  {
+    static const float log_min = static_cast<float>( std::log(sm_uniform_grid_min_energy) );
+    static const float inv_step = static_cast<float>( 1.0 / sm_uniform_grid_log_step );
+    
+    const float x = (log_energy - log_min) * inv_step;
+    
+    //Note: NaN will fail this test, so will go to the full calculation, which will throw
+    if( (x >= 0.0f) && (x < static_cast<float>(sm_uniform_grid_num_cells)) )
+    {
+      const size_t cell = static_cast<size_t>( x );
+      if( !data->m_uniformGridExact[cell] )
+      {
+        const float * const mu = &(data->m_uniformGridMu[cell]);
+        const float frac = x - static_cast<float>( cell );
+        return mu[0] + frac*(mu[1] - mu[0]);
+      }
+    }//if( x is within the grid )
+    
+    return calcTotalMassAttenuationCoeficient( energy, data );
+  }//uniformGridMassAttenuationCoeficient(...)
 }//namespace
 
 
@@ -447,6 +610,82 @@ namespace MassAttenuation
   {
     return sm_xs_tool.massAttenuationCoeficientFracAN( atomic_number, energy );
   }
+  
+  void massAttenuationCoeficients( const int atomic_number, const std::vector<float> &energies,
+                                   std::vector<float> &coefficients )
+  {
+    sm_xs_tool.massAttenuationCoeficients( atomic_number, energies, coefficients );
+  }
+  
+  
+  float massAttenuationCoeficientSmoothAN( const float atomic_number, const float energy,
+                                           float *dmu_dan )
+  {
+    const float min_an = static_cast<float>( sm_min_xs_atomic_number );
+    const float max_an = static_cast<float>( sm_max_xs_atomic_number );
+    const bool clamped = ((atomic_number < min_an) || (atomic_number > max_an));
+    const float an = std::min( max_an, std::max( min_an, atomic_number ) );
+    
+    // Integer atomic numbers are by far the most common case, and the interpolation passes through
+    //  the nodes, so if the derivative isnt wanted, dont bother interpolating.
+    if( !dmu_dan && (an == std::floor(an)) )
+      return sm_xs_tool.massAttenuationCoeficient( static_cast<int>(an), energy );
+    
+#if( !USE_SNL_GAMMA_ATTENUATION_VALUES )
+    float surface_mu = 0.0f;
+    if( sm_xs_tool.atomicNumberEnergySurface().interpolate( an, energy, surface_mu, dmu_dan ) )
+    {
+      if( dmu_dan && clamped )
+        *dmu_dan = 0.0f;
+      return surface_mu;
+    }
+#endif
+    
+    // The energy is off the grid, or near an absorption edge of one of the nearby elements, so
+    //  interpolate in atomic number at exactly this energy.  The cubic between nodes k and k+1 only
+    //  depends on nodes k-1 through k+2, so we'll only compute log(μ) for those elements.
+    const int k = std::min( static_cast<int>( std::floor(an) ), sm_max_xs_atomic_number - 1 );
+    const float t = an - k;
+    
+    const int first_node = std::max( k - 1, sm_min_xs_atomic_number );
+    const int last_node = std::min( k + 2, sm_max_xs_atomic_number );
+    
+    float log_mus[4];
+    for( int node = first_node; node <= last_node; ++node )
+    {
+      const float node_mu = sm_xs_tool.massAttenuationCoeficient( node, energy );
+      log_mus[node - first_node] = std::log( std::max( node_mu, FLT_MIN ) );
+    }
+    
+    const auto y = [&log_mus,first_node]( const int node ) -> float {
+      return log_mus[node - first_node];
+    };
+    
+    const auto tangent = [&y]( const int node ) -> float {
+      if( node <= sm_min_xs_atomic_number )
+        return y(sm_min_xs_atomic_number+1) - y(sm_min_xs_atomic_number);
+      if( node >= sm_max_xs_atomic_number )
+        return y(sm_max_xs_atomic_number) - y(sm_max_xs_atomic_number-1);
+      return fritsch_butland_tangent( y(node) - y(node-1), y(node+1) - y(node) );
+    };//tangent lambda
+    
+    const float y0 = y(k), y1 = y(k+1);
+    const float d0 = tangent( k ), d1 = tangent( k+1 );
+    
+    const float t2 = t*t, t3 = t2*t;
+    const float log_mu = (2.0f*t3 - 3.0f*t2 + 1.0f)*y0 + (t3 - 2.0f*t2 + t)*d0
+                         + (-2.0f*t3 + 3.0f*t2)*y1 + (t3 - t2)*d1;
+    const float mu = std::exp( log_mu );
+    
+    if( dmu_dan )
+    {
+      const float dlogmu_dan = (6.0f*t2 - 6.0f*t)*y0 + (3.0f*t2 - 4.0f*t + 1.0f)*d0
+                               + (-6.0f*t2 + 6.0f*t)*y1 + (3.0f*t2 - 2.0f*t)*d1;
+      *dmu_dan = clamped ? 0.0f : mu*dlogmu_dan;
+    }//if( dmu_dan )
+    
+    return mu;
+  }//float massAttenuationCoeficientSmoothAN(...)
 
 
 /*
@@ -545,10 +784,47 @@ size_t ElementProccessCoeffients::memsize() const
 }//size_t memsize() const
 
 
+void ElementAttenuation::fillUniformGrid()
+{
+  m_uniformGridMu.resize( sm_uniform_grid_num_cells + 1 );
+  m_uniformGridExact.resize( sm_uniform_grid_num_cells, uint8_t(0) );
+  
+  for( size_t i = 0; i <= sm_uniform_grid_num_cells; ++i )
+  {
+    const float energy = static_cast<float>( uniform_grid_energy( static_cast<double>(i) ) );
+    m_uniformGridMu[i] = calcTotalMassAttenuationCoeficient( energy, this );
+  }
+  
+  //Check the interpolation, against the full calculation, at a few points within each cell; cells
+  //  containing an absorption edge will fail this, so will be marked to use the full calculation.
+  const double fracs[] = { 0.125, 0.25, 0.375, 0.5, 0.625, 0.75, 0.875 };
+  
+  for( size_t cell = 0; cell < sm_uniform_grid_num_cells; ++cell )
+  {
+    const double lower = m_uniformGridMu[cell], upper = m_uniformGridMu[cell+1];
+    
+    for( const double frac : fracs )
+    {
+      const float energy = static_cast<float>( uniform_grid_energy( cell + frac ) );
+      const double exact = calcTotalMassAttenuationCoeficient( energy, this );
+      const double interpolated = lower + frac*(upper - lower);
+      
+      if( !(fabs(interpolated - exact) <= sm_uniform_grid_tolerance*exact) )
+      {
+        m_uniformGridExact[cell] = 1;
+        break;
+      }
+    }//for( const double frac : fracs )
+  }//for( size_t cell = 0; cell < sm_uniform_grid_num_cells; ++cell )
+}//void fillUniformGrid()
+
+
 size_t ElementAttenuation::memsize() const
 {
   size_t size = sizeof(*this);
   size += m_symbol.capacity()*sizeof(std::string::value_type);
+  size += m_uniformGridMu.capacity()*sizeof(float);
+  size += m_uniformGridExact.capacity()*sizeof(uint8_t);
   
   for( const auto &p : m_proccesses )
     size += p.memsize();
@@ -557,6 +833,67 @@ size_t ElementAttenuation::memsize() const
 }//size_t memsize() const;
 
 
+bool AtomicNumberEnergySurface::interpolate( const float an, const float energy,
+                                             float &mu, float *dmu_dan ) const
+{
+  static const float log_min = static_cast<float>( std::log(sm_uniform_grid_min_energy) );
+  static const float inv_step = static_cast<float>( 1.0 / sm_uniform_grid_log_step );
+  
+  const float x = (std::log(energy) - log_min) * inv_step;
+  
+  //Note: NaN will fail this test
+  if( !((x >= 0.0f) && (x < static_cast<float>(sm_uniform_grid_num_cells))) )
+    return false;
+  
+  const size_t cell = static_cast<size_t>( x );
+  const int k = std::min( static_cast<int>( std::floor(an) ), MassAttenuation::sm_max_xs_atomic_number - 1 );
+  const size_t k_index = static_cast<size_t>( k - MassAttenuation::sm_min_xs_atomic_number );
+  
+  if( m_exact[cell*sm_num_an_nodes + k_index] )
+    return false;
+  
+  const float f = x - static_cast<float>( cell );
+  const float t = an - static_cast<float>( k );
+  const float t2 = t*t, t3 = t2*t;
+  
+  // Cubic Hermite basis functions in atomic number, and their derivatives
+  const float h00 = 2.0f*t3 - 3.0f*t2 + 1.0f, h10 = t3 - 2.0f*t2 + t;
+  const float h01 = -2.0f*t3 + 3.0f*t2,       h11 = t3 - t2;
+  const float dh00 = 6.0f*t2 - 6.0f*t,        dh10 = 3.0f*t2 - 4.0f*t + 1.0f;
+  const float dh01 = -6.0f*t2 + 6.0f*t,       dh11 = 3.0f*t2 - 2.0f*t;
+  
+  // Interpolate in atomic number at the grid nodes on either side of the energy, then linearly
+  //  interpolate μ in log(energy), so at integer atomic numbers the result is the same as the
+  //  elements uniform grid gives.
+  float node_mu[2], node_dlogmu[2];
+  for( size_t j = 0; j < 2; ++j )
+  {
+    const size_t index = (cell + j)*sm_num_an_nodes + k_index;
+    const float y0 = m_logMu[index], y1 = m_logMu[index+1];
+    const float d0 = m_dLogMuDAn[index], d1 = m_dLogMuDAn[index+1];
+    
+    node_mu[j] = std::exp( h00*y0 + h10*d0 + h01*y1 + h11*d1 );
+    node_dlogmu[j] = dh00*y0 + dh10*d0 + dh01*y1 + dh11*d1;
+  }//for( size_t j = 0; j < 2; ++j )
+  
+  mu = (1.0f - f)*node_mu[0] + f*node_mu[1];
+  
+  if( dmu_dan )
+    *dmu_dan = (1.0f - f)*node_mu[0]*node_dlogmu[0] + f*node_mu[1]*node_dlogmu[1];
+  
+  return true;
+}//bool AtomicNumberEnergySurface::interpolate(...)
+
+
+size_t AtomicNumberEnergySurface::memsize() const
+{
+  return sizeof(*this)
+         + m_logMu.capacity()*sizeof(float)
+         + m_dLogMuDAn.capacity()*sizeof(float)
+         + m_exact.capacity()*sizeof(uint8_t);
+}//size_t AtomicNumberEnergySurface::memsize() const
+
+
 size_t MassAttenuationTool::memsize() const
 {
   size_t size = sizeof(*this);
@@ -568,6 +905,9 @@ size_t MassAttenuationTool::memsize() const
     size += ptr ? ptr->memsize() : size_t(0);
   }
   
+  const AtomicNumberEnergySurface *surface = m_anSurface.load();
+  size += surface ? surface->memsize() : size_t(0);
+  
   return size;
 }//size_t ElementAttenuation::memsize() const
 
@@ -726,6 +1066,8 @@ MassAttenuationTool::MassAttenuationTool()
   
   for( auto &p : m_atten )
     p = nullptr;
+  
+  m_anSurface = nullptr;
 }
 
 #ifdef _WIN32
@@ -750,6 +1092,8 @@ MassAttenuationTool::~MassAttenuationTool()
     if( !changed )
       delete expected;
   }
+  
+  delete m_anSurface.exchange( nullptr );
 }//~MassAttenuationTool()
 
 
@@ -769,6 +1113,7 @@ const ElementAttenuation *MassAttenuationTool::attenuationData(
   {
     thisData = new ElementAttenuation();
     thisData->loadTxt( m_dataPath, atomic_number );
+    thisData->fillUniformGrid();
 
     const bool changed = m_atten[atomic_number-1].compare_exchange_strong( origptr, thisData );
       
@@ -796,6 +1141,62 @@ const ElementAttenuation *MassAttenuationTool::attenuationData(
 }//attenuationData(...)
 
 
+const AtomicNumberEnergySurface &MassAttenuationTool::atomicNumberEnergySurface()
+{
+  const AtomicNumberEnergySurface *origptr = m_anSurface.load();
+  if( origptr )
+    return *origptr;
+  
+  const size_t num_nodes = sm_uniform_grid_num_cells + 1;
+  
+  std::unique_ptr<AtomicNumberEnergySurface> surface( new AtomicNumberEnergySurface() );
+  surface->m_logMu.resize( num_nodes * sm_num_an_nodes );
+  surface->m_dLogMuDAn.resize( num_nodes * sm_num_an_nodes );
+  surface->m_exact.resize( sm_uniform_grid_num_cells * sm_num_an_nodes, uint8_t(0) );
+  
+  vector<const ElementAttenuation *> elements( sm_num_an_nodes );
+  for( size_t i = 0; i < sm_num_an_nodes; ++i )
+    elements[i] = attenuationData( MassAttenuation::sm_min_xs_atomic_number + static_cast<int>(i) );
+  
+  for( size_t node = 0; node < num_nodes; ++node )
+  {
+    float * const y = &(surface->m_logMu[node*sm_num_an_nodes]);
+    float * const d = &(surface->m_dLogMuDAn[node*sm_num_an_nodes]);
+    
+    for( size_t i = 0; i < sm_num_an_nodes; ++i )
+      y[i] = std::log( std::max( elements[i]->m_uniformGridMu[node], FLT_MIN ) );
+    
+    d[0] = y[1] - y[0];
+    d[sm_num_an_nodes-1] = y[sm_num_an_nodes-1] - y[sm_num_an_nodes-2];
+    for( size_t i = 1; (i + 1) < sm_num_an_nodes; ++i )
+      d[i] = fritsch_butland_tangent( y[i] - y[i-1], y[i+1] - y[i] );
+  }//for( loop over energy nodes )
+  
+  // The cubic between atomic numbers k and k+1 depends on elements k-1 through k+2
+  for( size_t cell = 0; cell < sm_uniform_grid_num_cells; ++cell )
+  {
+    for( size_t k_index = 0; (k_index + 1) < sm_num_an_nodes; ++k_index )
+    {
+      const size_t first = (k_index > 0) ? (k_index - 1) : k_index;
+      const size_t last = std::min( k_index + 2, sm_num_an_nodes - 1 );
+      
+      for( size_t i = first; i <= last; ++i )
+      {
+        if( elements[i]->m_uniformGridExact[cell] )
+          surface->m_exact[cell*sm_num_an_nodes + k_index] = 1;
+      }
+    }//for( loop over atomic numbers )
+  }//for( loop over energy cells )
+  
+  const bool changed = m_anSurface.compare_exchange_strong( origptr, surface.get() );
+  if( changed )
+    origptr = surface.release();
+  //else: another thread built the surface first; ours gets deleted, and we use theirs (origptr)
+  
+  return *origptr;
+}//const AtomicNumberEnergySurface &atomicNumberEnergySurface()
+
+
 float MassAttenuationTool::massAttenuationCoeficient( const int atomic_num,
                                                       const float energy )
 {
@@ -865,28 +1266,35 @@ float MassAttenuationTool::massAttenuationCoeficient( const int atomic_num,
   
   const ElementAttenuation * const data = attenuationData( atomic_num );
 
-  float comptXs = 0.0, photoXs = 0.0, convXs = 0.0;
-  try
-  {
-    comptXs = calcMassAttenuationCoeficient( energy, MassAttenuation::GammaEmProcces::ComptonScatter, data );
-  }catch(...){}
+  return uniformGridMassAttenuationCoeficient( energy, std::log(energy), data );
+#endif
+}//float massAttenuationCoeficient(...)
 
-  try
-  {
-    photoXs = calcMassAttenuationCoeficient( energy, MassAttenuation::GammaEmProcces::PhotoElectric, data );
-  }catch(...){}
 
-  try
-  {
-    if( energy > 1024.0*PhysicalUnits::keV )
-    {
-      convXs = calcMassAttenuationCoeficient( energy, MassAttenuation::GammaEmProcces::PairProduction, data );
-    }
-  }catch(...){}
+void MassAttenuationTool::massAttenuationCoeficients( const int atomic_number,
+                                                      const std::vector<float> &energies,
+                                                      std::vector<float> &coefficients )
+{
+  const size_t nenergies = energies.size();
+  coefficients.resize( nenergies );
   
-  return comptXs + photoXs + convXs;
+#if( USE_SNL_GAMMA_ATTENUATION_VALUES )
+  for( size_t i = 0; i < nenergies; ++i )
+    coefficients[i] = massAttenuationCoeficient( atomic_number, energies[i] );
+#else
+  const ElementAttenuation * const data = attenuationData( atomic_number );
+  
+  const float * const energy = energies.data();
+  float * const answer = coefficients.data();
+  
+  //Take the logs in a separate branchless loop, so the compiler can vectorize it
+  for( size_t i = 0; i < nenergies; ++i )
+    answer[i] = std::log( energy[i] );
+  
+  for( size_t i = 0; i < nenergies; ++i )
+    answer[i] = uniformGridMassAttenuationCoeficient( energy[i], answer[i], data );
 #endif
-}//float massAttenuationCoeficient(...)
+}//void massAttenuationCoeficients(...)
 
 
 float MassAttenuationTool::massAttenuationCoeficientFracAN( const float atomic_number, const float energy )
@@ -2451,6 +2451,8 @@ void search_for_peaks_worker( std::weak_ptr<const SpecUtils::Measurement> weak_d
     return;
   }
   
+  InterSpecApp::FitCpuTimer cpu_timer( sessionID );
+  
   try
   {
     *resultpeaks = ExperimentalAutomatedPeakSearch::search_for_peaks( data, drf, existingPeaks, singleThread );
@@ -2549,6 +2551,8 @@ void assign_srcs_from_ref_lines( const std::shared_ptr<const SpecUtils::Measurem
   
 void refit_peaks_from_right_click( InterSpec * const interspec, const double rightClickEnergy )
 {
+  InterSpecApp::FitCpuTimer cpu_timer( wApp ? wApp->sessionId() : string() );
+  
   try
   {
     PeakModel * const model = interspec->peakModel();
@@ -2844,6 +2848,8 @@ void fit_template_peaks( InterSpec *interspec, std::shared_ptr<const SpecUtils::
     return;
   }
   
+  InterSpecApp::FitCpuTimer cpu_timer( sessionid );
+  
   unique_copy_continuum( input_peaks );
   
   vector<PeakDef> candidate_peaks, data_def_peaks;
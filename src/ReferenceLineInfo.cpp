@@ -217,6 +217,7 @@ void ReferenceLineInfo::reset()
   labelTxt.clear();
   reactionsTxt.clear();
   lineColor = Wt::WColor();
+  linesJson.reset();
   showGammas = showXrays = showAlphas = showBetas = false;
   promptLinesOnly = showLines = isBackground = displayLines = false;
   lowerBrCuttoff = age = 0.0;
@@ -276,7 +277,23 @@ void ReferenceLineInfo::toJson( string &json ) const
              << ":" << iter->second;
   }
   
-  jsonstrm << "},lines:[";
+  jsonstrm << "},lines:";
+  
+  if( linesJson )
+    jsonstrm << *linesJson;
+  else
+    jsonstrm << linesToJson();
+  
+  jsonstrm << "}";
+  
+  json += jsonstrm.str();
+}//std::string toJson( const ReferenceLineInfo &displnuc )
+
+
+std::string ReferenceLineInfo::linesToJson() const
+{
+  std::stringstream jsonstrm;
+  jsonstrm << "[";
   
   bool printed = false;
   char intensity_buffer[32] = { '\0' };
@@ -382,10 +399,10 @@ void ReferenceLineInfo::toJson( string &json ) const
     printed = true;
   }//for( size_t i = 0; i < energies.size(); ++i )
   
-  jsonstrm <<"]}";
+  jsonstrm << "]";
   
-  json += jsonstrm.str();
-}//std::string toJson( const ReferenceLineInfo &displnuc )
+  return jsonstrm.str();
+}//std::string linesToJson() const
 
 
 void ReferenceLineInfo::sortByEnergy()
@@ -404,6 +421,8 @@ void ReferenceLineInfo::sortByEnergy()
   std::sort( sort_indices.begin(), sort_indices.end(),
             index_compare_assend<vector<double>&>(energies) );
   
+  linesJson.reset();
+  
   ReferenceLineInfo tmp = *this;
   for( size_t i = 0; i < len; ++i )
   {
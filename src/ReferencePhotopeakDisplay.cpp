@@ -23,7 +23,12 @@
 
 #include "InterSpec_config.h"
 
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
 #include <vector>
+#include <cstdlib>
 #include <algorithm>
 
 #include <boost/tuple/tuple.hpp>
@@ -437,6 +442,613 @@ namespace
     
   };//class RefGammaCsvResource
   
+  
+  
+  /** The gamma or xray energy below which we wont show lines for.
+   x-rays for nuclides were limited at above 10 keV, so we'll just impose this as a lower limit to
+   show to be consistent.
+   */
+  const float ns_lower_photon_energy = 10.0f;
+  
+  
+  /** A small least-recently-used cache of immutable objects, shared by all sessions.
+   All functions are thread-safe.
+   */
+  template<class T>
+  class SharedLruCache
+  {
+  public:
+    explicit SharedLruCache( const size_t max_entries )
+      : m_max_entries( max_entries ),
+        m_counter( 0 )
+    {
+    }
+    
+    std::shared_ptr<const T> find( const std::string &key )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      auto pos = m_cache.find( key );
+      if( pos == end(m_cache) )
+        return nullptr;
+      pos->second.second = ++m_counter;
+      return pos->second.first;
+    }//find(...)
+    
+    /** Inserts the value into the cache, unless another thread beat us to it, in which case the
+     already cached value is returned, so all callers share the same object.
+     */
+    std::shared_ptr<const T> insert( const std::string &key, std::shared_ptr<const T> value )
+    {
+      std::lock_guard<std::mutex> lock( m_mutex );
+      
+      auto pos = m_cache.find( key );
+      if( pos != end(m_cache) )
+      {
+        pos->second.second = ++m_counter;
+        return pos->second.first;
+      }
+      
+      m_cache[key] = std::make_pair( value, ++m_counter );
+      
+      while( m_cache.size() > m_max_entries )
+      {
+        auto oldest = begin(m_cache);
+        for( auto iter = begin(m_cache); iter != end(m_cache); ++iter )
+        {
+          if( iter->second.second < oldest->second.second )
+            oldest = iter;
+        }
+        m_cache.erase( oldest );
+      }//while( m_cache.size() > m_max_entries )
+      
+      return value;
+    }//insert(...)
+    
+  protected:
+    const size_t m_max_entries;
+    uint64_t m_counter;
+    std::mutex m_mutex;
+    std::map<std::string,std::pair<std::shared_ptr<const T>,uint64_t>> m_cache;
+  };//class SharedLruCache
+  
+  
+  /** The reactions, and their gammas, for the text the user entered (e.g., "Fe(n,n')"). */
+  struct ReactionLines
+  {
+    std::string reactions;
+    std::vector<ReactionGamma::ReactionPhotopeak> gammas;
+  };//struct ReactionLines
+  
+  
+  /** The lines of a source, before detector response, shielding, or normalization are applied. */
+  struct SourceLines
+  {
+    std::vector<double> energies, branchratios;
+    std::vector<SandiaDecay::ProductType> particle_type;
+    std::vector<const SandiaDecay::Transition *> transistions;
+    std::vector<const ReactionGamma::Reaction *> reactionPeaks;
+    std::vector<const BackgroundLine *> backgroundLines;
+    std::vector<DecayParticleModel::RowData> inforows;
+  };//struct SourceLines
+  
+  
+  /** Per-line detector and shielding response for a #SourceLines. */
+  struct LineResponse
+  {
+    /** Detector efficiency, divided by the peak sigma (since peak height goes as area/sigma). */
+    std::vector<double> detector_factor;
+    
+    /** Attenuation coefficient for unit thickness (or unit areal density, for generic shielding),
+     so the transmission fraction is exp(-attenuation_coef*thickness), and only the exponential
+     needs to be re-evaluated when just the thickness changes.
+     */
+    std::vector<double> attenuation_coef;
+  };//struct LineResponse
+  
+  
+  /** The normalized lines, as put into #ReferenceLineInfo, sorted by energy, with their JSON. */
+  struct DisplayLines
+  {
+    std::vector<double> energies, intensities;
+    std::vector<std::string> particlestrs, decaystrs, elementstrs;
+    std::map<std::string,double> particle_sf;
+    std::shared_ptr<const std::string> linesJson;
+  };//struct DisplayLines
+  
+  
+  SharedLruCache<ReactionLines> ns_reaction_lines_cache( 32 );
+  SharedLruCache<SourceLines> ns_source_lines_cache( 128 );
+  SharedLruCache<LineResponse> ns_line_response_cache( 64 );
+  SharedLruCache<DisplayLines> ns_display_lines_cache( 64 );
+  
+  
+  /** Decays the nuclide (if non-null), and collects the lines of the wanted particle types, as well
+   as the element x-rays, reaction gammas, and background lines.
+   */
+  shared_ptr<SourceLines> compute_source_lines( const SandiaDecay::Nuclide * const nuc,
+                                      const SandiaDecay::Element * const el,
+                                      const vector<ReactionGamma::ReactionPhotopeak> &rctnGammas,
+                                      const vector<const BackgroundLine *> &backgroundLines,
+                                      const double age,
+                                      const bool promptOnly,
+                                      const vector<SandiaDecay::ProductType> &types,
+                                      const bool showElementXrays )
+  {
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    
+    auto answer = make_shared<SourceLines>();
+    vector<double> &energies = answer->energies;
+    vector<double> &branchratios = answer->branchratios;
+    vector<SandiaDecay::ProductType> &particle_type = answer->particle_type;
+    vector<const SandiaDecay::Transition *> &transistions = answer->transistions;
+    vector<const ReactionGamma::Reaction *> &reactionPeaks = answer->reactionPeaks;
+    vector<const BackgroundLine *> &lineBackgrounds = answer->backgroundLines;
+    vector<DecayParticleModel::RowData> &inforows = answer->inforows;
+    
+    SandiaDecay::NuclideMixture mixture;
+    
+    if( nuc && promptOnly )
+      mixture.addNuclideInPromptEquilibrium( nuc, 1.0E-3 * SandiaDecay::curie );
+    else if( nuc )
+      mixture.addNuclideByActivity( nuc, 1.0E-3 * SandiaDecay::curie );
+    
+    const vector<SandiaDecay::NuclideActivityPair> activities = mixture.activity( age );
+    const double parent_activity = nuc ? mixture.activity( age, nuc ) : 0.0;
+    
+    DecayParticleModel::RowData positronrow;
+    positronrow.energy      = static_cast<float>( 510.9989 * PhysicalUnits::keV );
+    positronrow.branchRatio = 0.0f;
+    positronrow.particle    = SandiaDecay::GammaParticle; //SandiaDecay::positron
+    positronrow.responsibleNuc = 0;
+    std::set<const SandiaDecay::Nuclide *> positronparents;
+    std::set<const SandiaDecay::Transition *> positrontrans;
+    
+    for( SandiaDecay::ProductType type : types )
+    {
+      for( size_t nucIndex = 0; nucIndex < activities.size(); ++nucIndex )
+      {
+        const SandiaDecay::Nuclide *nuclide = activities[nucIndex].nuclide;
+        const double activity = activities[nucIndex].activity;
+        
+        const size_t n_decaysToChildren = nuclide->decaysToChildren.size();
+        
+        for( size_t decayIndex = 0; decayIndex < n_decaysToChildren; ++decayIndex )
+        {
+          const SandiaDecay::Transition *transition
+                                         = nuclide->decaysToChildren[decayIndex];
+          const size_t n_products = transition->products.size();
+          
+          for( size_t productNum = 0; productNum < n_products; ++productNum )
+          {
+            const SandiaDecay::RadParticle &particle
+                                              = transition->products[productNum];
+            
+            switch( particle.type )
+            {
+              case SandiaDecay::GammaParticle:
+              case SandiaDecay::XrayParticle:
+                if( particle.energy < ns_lower_photon_energy )
+                  continue;
+                break;
+                
+              case SandiaDecay::PositronParticle:
+              case SandiaDecay::BetaParticle:
+              case SandiaDecay::AlphaParticle:
+              case SandiaDecay::CaptureElectronParticle:
+                break;
+            }//switch( particle.type )
+            
+            
+            if( type == SandiaDecay::PositronParticle && particle.type == SandiaDecay::PositronParticle )
+            {
+              const double br = activity * particle.intensity
+                                * transition->branchRatio / parent_activity;
+              positronrow.branchRatio += 2.0*br;
+              positronrow.decayMode   = transition->mode;
+              positronparents.insert( transition->parent );
+              positrontrans.insert( transition );
+            }else if( (particle.type == type) && (particle.type == SandiaDecay::XrayParticle) )
+            {
+              size_t index = 0;
+              for( ; index < energies.size(); ++index )
+              {
+                if( fabs(energies[index] - particle.energy) < 1.0E-6 )
+                  break;
+              }
+              
+              const double br = activity * particle.intensity
+                                     * transition->branchRatio / parent_activity;
+              
+              if( index < energies.size() )
+              {
+                branchratios[index] += br;
+                inforows[index].branchRatio += br;
+              }else
+              {
+                transistions.push_back( NULL );
+                energies.push_back( particle.energy );
+                branchratios.push_back( br );
+                particle_type.push_back( SandiaDecay::XrayParticle );
+                reactionPeaks.push_back( NULL );
+                lineBackgrounds.push_back( NULL );
+                
+                DecayParticleModel::RowData row;
+                row.energy      = particle.energy;
+                row.branchRatio = br;
+                row.particle    = SandiaDecay::XrayParticle;
+                row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
+                row.responsibleNuc = nuc;
+                
+                inforows.push_back( row );
+              }
+            }else if( particle.type == type )
+            {
+              transistions.push_back( transition );
+              energies.push_back( particle.energy );
+              const double br = activity * particle.intensity
+                                     * transition->branchRatio / parent_activity;
+              branchratios.push_back( br );
+              particle_type.push_back( type );
+              
+              reactionPeaks.push_back( NULL );
+              lineBackgrounds.push_back( NULL );
+              
+              DecayParticleModel::RowData row;
+              row.energy      = particle.energy;
+              row.branchRatio = br;
+              row.particle    = particle.type;
+              row.decayMode   = transition->mode;
+              row.responsibleNuc = transition->parent;
+              inforows.push_back( row );
+            }//if( particle.type == type )
+          }//for( size_t productNum = 0; productNum < n_products; ++productNum )
+        }//for( size_t decayIndex = 0; decayIndex < n_decaysToChildren; ++decayIndex )
+      }//for( size_t nucIndex = 0; nucIndex < activities.size(); ++nucIndex )
+    }//for( SandiaDecay::ProductType type : types )
+    
+    if( positronrow.branchRatio > 0.0 )
+    {
+      if( positronparents.size() == 1 )
+        positronrow.responsibleNuc = *positronparents.begin();
+      
+      if( positrontrans.size() == 1 )
+        transistions.push_back( *positrontrans.begin() );
+      else
+        transistions.push_back( NULL );
+      energies.push_back( positronrow.energy );
+      branchratios.push_back( positronrow.branchRatio );
+      particle_type.push_back( SandiaDecay::GammaParticle );
+      reactionPeaks.push_back( NULL );
+      lineBackgrounds.push_back( NULL );
+      
+      inforows.push_back( positronrow );
+    }//if( positronrow.branchRatio > 0.0 )
+    
+    if( showElementXrays )
+    {
+      const SandiaDecay::Element *element = el;
+      if( !element )
+        element = db->element( nuc->atomicNumber );
+      
+      for( const SandiaDecay::EnergyIntensityPair &eip : element->xrays )
+      {
+        if( eip.energy < ns_lower_photon_energy )
+          continue;
+        
+        transistions.push_back( NULL );
+        energies.push_back( eip.energy );
+        branchratios.push_back( eip.intensity );
+        particle_type.push_back( SandiaDecay::XrayParticle );
+        reactionPeaks.push_back( NULL );
+        lineBackgrounds.push_back( NULL );
+        
+        DecayParticleModel::RowData row;
+        row.energy      = eip.energy;
+        row.branchRatio = eip.intensity;
+        row.particle    = SandiaDecay::XrayParticle;
+        row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
+        row.responsibleNuc = nuc;
+        
+        inforows.push_back( row );
+      }//for( const SandiaDecay::EnergyIntensityPair &eip : element->xrays )
+    }//if( showElementXrays )
+    
+    
+    for( const ReactionGamma::ReactionPhotopeak &eip : rctnGammas )
+    {
+      if( eip.energy < ns_lower_photon_energy )
+        continue;
+      
+      transistions.push_back( NULL );
+      energies.push_back( eip.energy );
+      branchratios.push_back( eip.abundance );
+      particle_type.push_back( SandiaDecay::GammaParticle );
+      reactionPeaks.push_back( eip.reaction );
+      lineBackgrounds.push_back( NULL );
+      
+      DecayParticleModel::RowData row;
+      row.energy      = eip.energy;
+      row.branchRatio = eip.abundance;
+      row.particle    = SandiaDecay::GammaParticle;
+      row.decayMode   = DecayParticleModel::RowData::ReactionToGammaMode;
+      row.responsibleNuc = nuc;
+      
+      inforows.push_back( row );
+    }//for( const SandiaDecay::EnergyIntensityPair &eip : element->xrays )
+    
+    
+    for( const BackgroundLine *bl : backgroundLines )
+    {
+      if( std::get<0>(*bl) < ns_lower_photon_energy )
+        continue;
+      
+      transistions.push_back( NULL );
+      energies.push_back( std::get<0>(*bl) );
+      branchratios.push_back( std::get<1>(*bl) );
+      particle_type.push_back( SandiaDecay::GammaParticle );
+      reactionPeaks.push_back( NULL );
+      lineBackgrounds.push_back( bl );
+      
+      DecayParticleModel::RowData row;
+      row.energy      = std::get<0>(*bl);
+      row.branchRatio = std::get<1>(*bl);
+      row.particle    = SandiaDecay::GammaParticle;
+      
+      switch( std::get<3>(*bl) )
+      {
+        case U238Series: case U235Series: case Th232Series: case Ra226Series:
+        case K40Background: case OtherBackground:
+          row.decayMode = DecayParticleModel::RowData::NormGammaDecayMode;
+          break;
+        case BackgroundXRay:
+          row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
+        break;
+        case BackgroundReaction:
+          row.decayMode   = DecayParticleModel::RowData::ReactionToGammaMode;
+        break;
+      }//switch( get<3>(*bl) )
+      
+      row.responsibleNuc = db->nuclide( std::get<2>(*bl) );
+      
+      inforows.push_back( row );
+    }//for( const BackgroundLine *bl : backgroundLines )
+    
+    return answer;
+  }//compute_source_lines(...)
+  
+  
+  /** Computes the per-line detector factors, and shielding attenuation coefficients.
+   
+   @param det The detector to use; may be nullptr.
+   @param material The shielding material; if nullptr, and 'generic_an' is greater than zero, then
+          generic shielding of that atomic number will be used.
+   */
+  shared_ptr<LineResponse> compute_line_response( const SourceLines &lines,
+                                                  const shared_ptr<const DetectorPeakResponse> &det,
+                                                  const Material * const material,
+                                                  const float generic_an )
+  {
+    const vector<double> &energies = lines.energies;
+    const vector<SandiaDecay::ProductType> &particle_type = lines.particle_type;
+    const size_t nlines = energies.size();
+    
+    auto answer = make_shared<LineResponse>();
+    answer->detector_factor.resize( nlines, 1.0 );
+    answer->attenuation_coef.resize( nlines, 0.0 );
+    
+    const auto is_photon = [&particle_type]( const size_t i ) -> bool {
+      return (particle_type[i] == SandiaDecay::GammaParticle) || (particle_type[i] == SandiaDecay::XrayParticle);
+    };
+    
+    //fold in detector response
+    if( det && det->isValid() )
+    {
+      for( size_t i = 0; i < nlines; ++i )
+        if( is_photon(i) )
+          answer->detector_factor[i] *= det->efficiency( energies[i], PhysicalUnits::m );
+      
+      //Peak height is: area*(1/(sigma*sqrt(2*pi)))*exp( -(x-mean)^2 / (2*sigma^2) ),
+      //  therefore peak height is proportianal to area/sigma, lets correct for this
+      if( det->hasResolutionInfo() )
+      {
+        vector<double> sigmas( nlines, 1.0 );
+        
+        try
+        {
+          for( size_t i = 0; i < nlines; ++i )
+          {
+            sigmas[i] = det->peakResolutionSigma( energies[i] );
+            if( sigmas[i] <= 0.0 )
+              throw exception();
+          }//for( size_t i = 0; i < nlines; ++i )
+          
+          for( size_t i = 0; i < nlines; ++i )
+            answer->detector_factor[i] /= sigmas[i];
+        }catch(...)
+        {
+          cerr << "Encountered a negative or zero peak width, not taking detector "
+               << "resolution into account, sorry :(" << endl;
+        }//try / catch
+      }//if( det->hasResolutionInfo() )
+    }//if( det && det->isValid() )
+    
+    //fold in shielding
+    if( material || (generic_an > 0.0f) )
+    {
+      try
+      {
+        for( size_t i = 0; i < nlines; ++i )
+        {
+          if( !is_photon(i) )
+            continue;
+          
+          const float energy = static_cast<float>( energies[i] );
+          if( material )
+            answer->attenuation_coef[i] = GammaInteractionCalc::transmition_length_coefficient( material, energy );
+          else
+            answer->attenuation_coef[i] = GammaInteractionCalc::mass_attenuation_coef( generic_an, energy );
+        }//for( size_t i = 0; i < nlines; ++i )
+      }catch( MassAttenuation::ErrorLoadingDataException & )
+      {
+        throw runtime_error( "Failed to open gamma XS data file" );
+      }catch( std::exception &e )
+      {
+        std::fill( begin(answer->attenuation_coef), end(answer->attenuation_coef), 0.0 );
+        
+        cerr << "ReferencePhotopeakDisplay::updateDisplayChange(): caught error " << e.what() << endl;
+#if( PERFORM_DEVELOPER_CHECKS )
+        char msg[512];
+        snprintf( msg, sizeof(msg), "Error caclulating attenuation: %s", e.what() );
+        log_developer_error( __func__, msg );
+#endif
+      }//try / catch
+    }//if( material || (generic_an > 0.0f) )
+    
+    return answer;
+  }//compute_line_response(...)
+  
+  
+  /** Applies the response to the source lines, normalizes them per particle type, and creates the
+   descriptions and JSON of the lines.
+   */
+  shared_ptr<DisplayLines> compute_display_lines( const SourceLines &lines,
+                                                  const LineResponse &response,
+                                                  const double shield_thickness,
+                                                  const double brCutoff,
+                                                  const SandiaDecay::Nuclide * const nuc,
+                                                  const SandiaDecay::Element * const el )
+  {
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    
+    const vector<double> &energies = lines.energies;
+    const vector<SandiaDecay::ProductType> &particle_type = lines.particle_type;
+    
+    vector<double> branchratios = lines.branchratios;
+    for( size_t i = 0; i < branchratios.size(); ++i )
+    {
+      branchratios[i] *= response.detector_factor[i];
+      if( response.attenuation_coef[i] > 0.0 )
+        branchratios[i] *= exp( -response.attenuation_coef[i] * shield_thickness );
+    }//for( size_t i = 0; i < branchratios.size(); ++i )
+    
+    //Some decays may not produce gammas, but do produce xrays (not verified) so
+    //  we want to normalize gammas and xrays relative to the largest branching
+    //  ratio gamma or xray.
+    double max_gamma_xray = 0.0;
+    
+    map<SandiaDecay::ProductType,double> maxbrs;
+    
+    for( size_t i = 0; i < branchratios.size(); ++i )
+    {
+      const SandiaDecay::ProductType type = particle_type[i];
+      
+      if( !maxbrs.count(type) )
+        maxbrs[type] = 0.0;
+      maxbrs[type] = max(maxbrs[type],branchratios[i]);
+      
+      if( type == SandiaDecay::GammaParticle || type == SandiaDecay::XrayParticle )
+        max_gamma_xray = std::max( max_gamma_xray, branchratios[i] );
+    }//for( size_t i = 0; i < branchratios.size(); ++i )
+    
+    ReferenceLineInfo info;
+    
+    for( size_t i = 0; i < branchratios.size(); ++i )
+    {
+      const double energy = energies[i];
+      
+      //If this is an xray caused by a decay, lets normalize its amplitude relative
+      //  to the gamma amplitudes.  If we are displaying just the xrays of an
+      //  element, than we will normalize them to go between zero and one.
+      const bool is_gamma = (particle_type[i] == SandiaDecay::GammaParticle);
+      const bool is_xray = (particle_type[i] == SandiaDecay::XrayParticle);
+      const bool is_decay_xray_gamma = (nuc && (is_gamma || is_xray));
+      const double br = branchratios[i] / (is_decay_xray_gamma ? max_gamma_xray : maxbrs[particle_type[i]]);
+      
+      const SandiaDecay::Transition *transition = lines.transistions[i];
+      const BackgroundLine *backLine = lines.backgroundLines.at(i);
+      
+      if( (transition || backLine) && (br <= brCutoff || IsInf(br) || IsNan(br)) )
+        continue;
+      
+      string particlestr, decaystr, elstr;
+      if( !is_xray )
+      {
+        const SandiaDecay::ProductType parttype
+                                 = SandiaDecay::ProductType( particle_type[i] );
+        particlestr = SandiaDecay::to_str( parttype );
+        
+        if( transition )
+        {
+          if( transition->parent )
+            decaystr = transition->parent->symbol;
+          if( transition->child )
+            decaystr += " to " + transition->child->symbol;
+          decaystr += string(" via ") + SandiaDecay::to_str(transition->mode);
+        }else if( lines.reactionPeaks.at(i) )
+        {
+          decaystr = lines.reactionPeaks[i]->name();
+        }else if( backLine )
+        {
+          const string &symbol = std::get<2>(*backLine);
+          if( symbol.size() )
+            decaystr += symbol + ", ";
+          
+          switch( std::get<3>(*backLine) )
+          {
+            case U238Series:    decaystr += "U238 series";         break;
+            case U235Series:    decaystr += "U235 series";         break;
+            case Th232Series:   decaystr += "Th232 series";        break;
+            case Ra226Series:   decaystr += "U238 (Ra226) series"; break;
+            case K40Background: decaystr += "Primordial";          break;
+            case OtherBackground: case BackgroundXRay: case BackgroundReaction:
+              decaystr += std::get<4>(*backLine);    break;
+          }//switch( get<3>(backgroundLines[i]) )
+        }//if( transition ) / else ...
+      }else
+      {
+        const SandiaDecay::Element *element = el;
+        if( !element && nuc )
+          element = db->element( nuc->atomicNumber );
+        
+        particlestr = "xray";
+        decaystr = "xray";
+        if( element )
+          elstr = element->name;
+        else if( backLine )
+          elstr = std::get<4>(*backLine);
+      }//if( xray ) / else
+      
+      info.energies.push_back(     energy );
+      info.intensities.push_back(  br );
+      info.particlestrs.push_back( particlestr );
+      info.decaystrs.push_back(    decaystr );
+      info.elementstrs.push_back(  elstr );
+    }//for( size_t i = 0; i < branchratios.size(); ++i )
+    
+    auto answer = make_shared<DisplayLines>();
+    
+    for( const auto &type_max : maxbrs )
+    {
+      const char *typestr = SandiaDecay::to_str( SandiaDecay::ProductType(type_max.first) );
+      answer->particle_sf[typestr] = type_max.second;
+      
+      if( type_max.first == SandiaDecay::GammaParticle || type_max.first == SandiaDecay::XrayParticle )
+        answer->particle_sf[typestr] = max_gamma_xray;
+    }//for( const auto &type_max : maxbrs )
+    
+    //Clientside javascript currently doesnt know about this garuntee that gamma
+    //  lines will be sorted by energy.
+    info.sortByEnergy();
+    
+    answer->linesJson = make_shared<const string>( info.linesToJson() );
+    answer->energies.swap( info.energies );
+    answer->intensities.swap( info.intensities );
+    answer->particlestrs.swap( info.particlestrs );
+    answer->decaystrs.swap( info.decaystrs );
+    answer->elementstrs.swap( info.elementstrs );
+    
+    return answer;
+  }//compute_display_lines(...)
 }//namespace
 
 bool DecayParticleModel::less_than( const DecayParticleModel::RowData &lhs,
@@ -1368,11 +1980,6 @@ std::map<std::string,std::vector<Wt::WColor>> ReferencePhotopeakDisplay::current
 
 void ReferencePhotopeakDisplay::updateDisplayChange()
 {
-  /** The gamma or xray energy below which we wont show lines for.
-   x-rays for nuclides were limited at above 10 keV, so we'll just impose this as a lower limit to show to be consistent.
-   */
-  const float lower_photon_energy = 10.0f;
-  
   bool show = true;
   show = (show && (!m_lowerBrCuttoff || m_lowerBrCuttoff->validate()==WValidator::Valid));
 
@@ -1400,12 +2007,21 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
       const ReactionGamma *rctnDb = ReactionGammaServer::database();
       if( rctnDb )
       {
-        reactions = rctnDb->gammas( isotxt, rctnGammas );
+        shared_ptr<const ReactionLines> rctnLines = ns_reaction_lines_cache.find( isotxt );
+        if( !rctnLines )
+        {
+          auto lines = make_shared<ReactionLines>();
+          lines->reactions = rctnDb->gammas( isotxt, lines->gammas );
+          //XXX - should use regex below to properly escape Fe(n,n')
+          SpecUtils::ireplace_all( lines->reactions, "'", "" );
+//          SpecUtils::replace_all( lines->reactions, "'", "\'" );
+          rctnLines = ns_reaction_lines_cache.insert( isotxt, lines );
+        }//if( !rctnLines )
+        
+        reactions = rctnLines->reactions;
+        rctnGammas = rctnLines->gammas;
         nuc = NULL;
         el = NULL;
-        //XXX - should use regex below to properly escape Fe(n,n')
-        SpecUtils::ireplace_all( reactions, "'", "" );
-//        SpecUtils::replace_all( reactions, "'", "\'" );
       }
     }catch( std::exception &e )
     {
@@ -1686,34 +2302,16 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
     }//if( age < 0.0 || !nuc )
   }//if( !show )
 
-  vector<DecayParticleModel::RowData> inforows;
-
   const double brCutoff = (m_lowerBrCuttoff ? m_lowerBrCuttoff->value() : 0.0);
 
 //  bool islogy = m_chart->yAxisIsLog();
 //  double chartMaxSf = (islogy ? log(2.5) : 1.0/1.1);
 
-  SandiaDecay::NuclideMixture mixture;
-
-  if( nuc && canHavePromptEquil && m_promptLinesOnly->isChecked() )
-  {
+  const bool promptOnly = (nuc && canHavePromptEquil && m_promptLinesOnly->isChecked());
+  if( promptOnly )
     age = 0.0;
-    mixture.addNuclideInPromptEquilibrium( nuc, 1.0E-3 * SandiaDecay::curie );
-  }else if( nuc )
-  {
-    mixture.addNuclideByActivity( nuc, 1.0E-3 * SandiaDecay::curie );
-  }//if( we want promt only ) / else
-
-  const vector<SandiaDecay::NuclideActivityPair> activities
-                                                     = mixture.activity( age );
-  const double parent_activity = nuc ? mixture.activity( age, nuc ) : 0.0;
-
-  vector<double> energies, branchratios;
-  vector<SandiaDecay::ProductType> particle_type;
-  vector<const SandiaDecay::Transition *> transistions;
+  
   vector<SandiaDecay::ProductType> types;
-  vector<const ReactionGamma::Reaction *> reactionPeaks;
-  std::vector<const BackgroundLine *> backgroundLines;
 
   if( !m_showGammas || m_showGammas->isChecked() )
   {
@@ -1728,426 +2326,115 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
   if( (!m_showXrays || m_showXrays->isChecked()) )
     types.push_back( SandiaDecay::XrayParticle );
   
-  DecayParticleModel::RowData positronrow;
-  positronrow.energy      = static_cast<float>( 510.9989 * PhysicalUnits::keV );
-  positronrow.branchRatio = 0.0f;
-  positronrow.particle    = SandiaDecay::GammaParticle; //SandiaDecay::positron
-  positronrow.responsibleNuc = 0;
-  std::set<const SandiaDecay::Nuclide *> positronparents;
-  std::set<const SandiaDecay::Transition *> positrontrans;
-
-  for( SandiaDecay::ProductType type : types )
-  {
-    for( size_t nucIndex = 0; nucIndex < activities.size(); ++nucIndex )
-    {
-      const SandiaDecay::Nuclide *nuclide = activities[nucIndex].nuclide;
-      const double activity = activities[nucIndex].activity;
-
-      const size_t n_decaysToChildren = nuclide->decaysToChildren.size();
-      
-      for( size_t decayIndex = 0; decayIndex < n_decaysToChildren; ++decayIndex )
-      {
-        const SandiaDecay::Transition *transition
-                                       = nuclide->decaysToChildren[decayIndex];
-        const size_t n_products = transition->products.size();
-
-        for( size_t productNum = 0; productNum < n_products; ++productNum )
-        {
-          const SandiaDecay::RadParticle &particle
-                                            = transition->products[productNum];
-          
-          switch( particle.type )
-          {
-            case SandiaDecay::GammaParticle:
-            case SandiaDecay::XrayParticle:
-              if( particle.energy < lower_photon_energy )
-                continue;
-              break;
-            
-            case SandiaDecay::PositronParticle:
-            case SandiaDecay::BetaParticle:
-            case SandiaDecay::AlphaParticle:
-            case SandiaDecay::CaptureElectronParticle:
-              break;
-          }//switch( particle.type )
-          
-          
-          if( type == SandiaDecay::PositronParticle && particle.type == SandiaDecay::PositronParticle )
-          {
-            const double br = activity * particle.intensity
-                              * transition->branchRatio / parent_activity;
-            positronrow.branchRatio += 2.0*br;
-            positronrow.decayMode   = transition->mode;
-            positronparents.insert( transition->parent );
-            positrontrans.insert( transition );
-          }else if( (particle.type == type) && (particle.type == SandiaDecay::XrayParticle) )
-          {
-            size_t index = 0;
-            for( ; index < energies.size(); ++index )
-            {
-              if( fabs(energies[index] - particle.energy) < 1.0E-6 )
-                break;
-            }
-            
-            const double br = activity * particle.intensity
-                                   * transition->branchRatio / parent_activity;
-            
-            if( index < energies.size() )
-            {
-              branchratios[index] += br;
-              inforows[index].branchRatio += br;
-            }else
-            {
-              transistions.push_back( NULL );
-              energies.push_back( particle.energy );
-              branchratios.push_back( br );
-              particle_type.push_back( SandiaDecay::XrayParticle );
-              reactionPeaks.push_back( NULL );
-              backgroundLines.push_back( NULL );
-            
-              DecayParticleModel::RowData row;
-              row.energy      = particle.energy;
-              row.branchRatio = br;
-              row.particle    = SandiaDecay::XrayParticle;
-              row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
-              row.responsibleNuc = nuc;
-            
-              inforows.push_back( row );
-            }
-          }else if( particle.type == type )
-          {
-            transistions.push_back( transition );
-            energies.push_back( particle.energy );
-            const double br = activity * particle.intensity
-                                   * transition->branchRatio / parent_activity;
-            branchratios.push_back( br );
-            particle_type.push_back( type );
-            
-            reactionPeaks.push_back( NULL );
-            backgroundLines.push_back( NULL );
-
-            DecayParticleModel::RowData row;
-            row.energy      = particle.energy;
-            row.branchRatio = br;
-            row.particle    = particle.type;
-            row.decayMode   = transition->mode;
-            row.responsibleNuc = transition->parent;
-            inforows.push_back( row );
-          }//if( particle.type == type )
-        }//for( size_t productNum = 0; productNum < n_products; ++productNum )
-      }//for( size_t decayIndex = 0; decayIndex < n_decaysToChildren; ++decayIndex )
-    }//for( size_t nucIndex = 0; nucIndex < activities.size(); ++nucIndex )
-  }//for( SandiaDecay::ProductType type : types )
-
-  if( positronrow.branchRatio > 0.0 )
-  {
-    if( positronparents.size() == 1 )
-      positronrow.responsibleNuc = *positronparents.begin();
-    
-    if( positrontrans.size() == 1 )
-      transistions.push_back( *positrontrans.begin() );
-    else
-      transistions.push_back( NULL );
-    energies.push_back( positronrow.energy );
-    branchratios.push_back( positronrow.branchRatio );
-    particle_type.push_back( SandiaDecay::GammaParticle );
-    reactionPeaks.push_back( NULL );
-    backgroundLines.push_back( NULL );
-    
-    inforows.push_back( positronrow );
-  }//if( positronrow.branchRatio > 0.0 )
-  
-  const bool showXrays = ((el && !nuc) && (!m_showXrays || m_showXrays->isChecked()));
+  const bool showElementXrays = ((el && !nuc) && (!m_showXrays || m_showXrays->isChecked()));
   
-  if( showXrays )
-  {
-    const SandiaDecay::Element *element = el;
-    if( !element )
-      element = db->element( nuc->atomicNumber );
-
-    for( const SandiaDecay::EnergyIntensityPair &eip : element->xrays )
-    {
-      if( eip.energy < lower_photon_energy )
-        continue;
-        
-      transistions.push_back( NULL );
-      energies.push_back( eip.energy );
-      branchratios.push_back( eip.intensity );
-      particle_type.push_back( SandiaDecay::XrayParticle );
-      reactionPeaks.push_back( NULL );
-      backgroundLines.push_back( NULL );
-
-      DecayParticleModel::RowData row;
-      row.energy      = eip.energy;
-      row.branchRatio = eip.intensity;
-      row.particle    = SandiaDecay::XrayParticle;
-      row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
-      row.responsibleNuc = nuc;
-
-      inforows.push_back( row );
-    }//for( const SandiaDecay::EnergyIntensityPair &eip : element->xrays )
-  }//if( m_showXrays->isChecked() )
-
+  // The lines are cached for all sessions in three stages: the decayed source, the per-line
+  //  detector and shielding coefficients, and the final normalized lines with their JSON.  This
+  //  way typing through nuclides only decays each source once, and changing just the shielding
+  //  thickness only re-evaluates an exponential per line.
+  //  Nuclide ages are quantized to 6 significant figures, with the lines computed at that age.
+  char agebuffer[32] = { '\0' };
+  if( nuc )
+    snprintf( agebuffer, sizeof(agebuffer), "%.6g", age );
+  const double cacheAge = nuc ? std::atof( agebuffer ) : age;
+  
+  string sourceKey = (nuc ? nuc->symbol : string()) + ";" + (el ? el->symbol : string())
+                     + ";" + (rctnGammas.empty() ? string() : isotxt)
+                     + ";" + std::to_string( m_currentlyShowingNuclide.backgroundLines.size() )
+                     + ";" + agebuffer + ";" + (promptOnly ? "p" : "") + (showElementXrays ? "x" : "")
+                     + ";";
+  for( const SandiaDecay::ProductType type : types )
+    sourceKey += std::to_string( static_cast<int>(type) ) + ",";
+  
+  shared_ptr<const SourceLines> srcLines = ns_source_lines_cache.find( sourceKey );
+  if( !srcLines )
+  {
+    shared_ptr<SourceLines> lines = compute_source_lines( nuc, el, rctnGammas,
+                                          m_currentlyShowingNuclide.backgroundLines, cacheAge,
+                                          promptOnly, types, showElementXrays );
+    srcLines = ns_source_lines_cache.insert( sourceKey, lines );
+  }//if( !srcLines )
   
-  for( const ReactionGamma::ReactionPhotopeak &eip : rctnGammas )
-  {
-    if( eip.energy < lower_photon_energy )
-      continue;
-    
-    transistions.push_back( NULL );
-    energies.push_back( eip.energy );
-    branchratios.push_back( eip.abundance );
-    particle_type.push_back( SandiaDecay::GammaParticle );
-    reactionPeaks.push_back( eip.reaction );
-    backgroundLines.push_back( NULL );
-
-    DecayParticleModel::RowData row;
-    row.energy      = eip.energy;
-    row.branchRatio = eip.abundance;
-    row.particle    = SandiaDecay::GammaParticle;
-    row.decayMode   = DecayParticleModel::RowData::ReactionToGammaMode;
-    row.responsibleNuc = nuc;
-
-    inforows.push_back( row );
-  }//for( const SandiaDecay::EnergyIntensityPair &eip : element->xrays )
-
-
-  for( const BackgroundLine *bl : m_currentlyShowingNuclide.backgroundLines )
-  {
-    if( std::get<0>(*bl) < lower_photon_energy )
-      continue;
-    
-    transistions.push_back( NULL );
-    energies.push_back( std::get<0>(*bl) );
-    branchratios.push_back( std::get<1>(*bl) );
-    particle_type.push_back( SandiaDecay::GammaParticle );
-    reactionPeaks.push_back( NULL );
-    backgroundLines.push_back( bl );
-    
-    DecayParticleModel::RowData row;
-    row.energy      = std::get<0>(*bl);
-    row.branchRatio = std::get<1>(*bl);
-    row.particle    = SandiaDecay::GammaParticle;
-    
-    switch( std::get<3>(*bl) )
-    {
-      case U238Series: case U235Series: case Th232Series: case Ra226Series:
-      case K40Background: case OtherBackground:
-        row.decayMode = DecayParticleModel::RowData::NormGammaDecayMode;
-        break;
-      case BackgroundXRay:
-        row.decayMode   = DecayParticleModel::RowData::XRayDecayMode;
-      break;
-      case BackgroundReaction:
-        row.decayMode   = DecayParticleModel::RowData::ReactionToGammaMode;
-      break;
-    }//switch( get<3>(*bl) )
-    
-    row.responsibleNuc = db->nuclide( std::get<2>(*bl) );
-    
-    inforows.push_back( row );
-  }//for( m_currentlyShowingNuclide.backgroundLines )
-
-//  double maxOrigbr = 0.0;
-//  for( size_t i = 0; i < inforows.size(); ++i )
-//    maxOrigbr = max( double(inforows[i].branchRatio), maxOrigbr );
-//  for( size_t i = 0; i < inforows.size(); ++i )
-//    inforows[i].branchRatio /= maxOrigbr;
-
   //Lets get rid of branching ratios that are incredible close to zero
   const float abs_min_br = FLT_MIN; //FLT_MIN is minimum, normalized, positive value of floats.
   vector<DecayParticleModel::RowData> inforowstouse;
-  for( size_t i = 0; i < inforows.size(); ++i )
-    if( inforows[i].branchRatio > abs_min_br && inforows[i].branchRatio >= brCutoff )
-      inforowstouse.push_back( inforows[i] );
+  for( const DecayParticleModel::RowData &row : srcLines->inforows )
+    if( row.branchRatio > abs_min_br && row.branchRatio >= brCutoff )
+      inforowstouse.push_back( row );
 
   m_particleModel->setRowData( inforowstouse );
 
-  //fold in detector response
-  std::shared_ptr<DetectorPeakResponse> det = m_detectorDisplay->detector();
-
-  //Wider peaks mean not as large value of 'y' for the peaks
-  if( det && det->isValid() )
-  {
-    for( size_t i = 0; i < branchratios.size(); ++i )
-      if( (particle_type[i] == SandiaDecay::GammaParticle) || (particle_type[i] == SandiaDecay::XrayParticle) )
-        branchratios[i] *= det->efficiency( energies[i], PhysicalUnits::m );
-  }//if( detector )
-
+  std::shared_ptr<const DetectorPeakResponse> det = m_detectorDisplay->detector();
+  if( det && !det->isValid() )
+    det.reset();
+  
+  //Get the shielding; shieldKey identifies the material (but not its thickness)
+  string shieldKey;
+  double shieldThickness = 0.0; //Areal density, for generic shielding
+  float genericAN = 0.0f;
+  std::shared_ptr<const Material> material;
   
-  //fold in shielding here....
   try
   {
-    std::shared_ptr<const Material> material;
-    boost::function<double(float)> att_coef_fcn;
-
     if( m_shieldingSelect->isGenericMaterial() )
     {
-      const float atomic_number = static_cast<float>(m_shieldingSelect->atomicNumber());
-      const float areal_density = static_cast<float>(m_shieldingSelect->arealDensity());
-      att_coef_fcn
-          = boost::bind( &GammaInteractionCalc::transmition_coefficient_generic,
-                         atomic_number, areal_density, boost::placeholders::_1 );
+      genericAN = static_cast<float>( m_shieldingSelect->atomicNumber() );
+      shieldThickness = m_shieldingSelect->arealDensity();
+      shieldKey = "AN=" + std::to_string( genericAN );
     }else
     {
       material = m_shieldingSelect->material();
-      if( !!material )
+      if( material )
       {
-        const float thick = static_cast<float>(m_shieldingSelect->thickness());
-        att_coef_fcn
-          = boost::bind( &GammaInteractionCalc::transmition_coefficient_material,
-                          material.get(), boost::placeholders::_1, thick );
-      }//if( !!material )
+        shieldThickness = m_shieldingSelect->thickness();
+        shieldKey = material->name + ";" + material->chemicalFormula()
+                    + ";" + std::to_string( material->density );
+      }
     }//if( isGenericMaterial ) / else
-
-    if( !att_coef_fcn.empty() )
-    {
-      for( size_t i = 0; i < branchratios.size(); ++i )
-        if( (particle_type[i] == SandiaDecay::GammaParticle) || (particle_type[i] == SandiaDecay::XrayParticle) )
-          branchratios[i] *= exp( -1.0 * att_coef_fcn( energies[i] ) );
-    }//if( att_coef_fcn )
-  }catch( MassAttenuation::ErrorLoadingDataException & )
-  {
-    throw runtime_error( "Failed to open gamma XS data file" );
   }catch( std::exception &e )
   {
+    shieldKey.clear();
+    shieldThickness = 0.0;
+    genericAN = 0.0f;
+    material.reset();
+    
     cerr << "ReferencePhotopeakDisplay::updateDisplayChange(): caught error " << e.what() << endl;
 #if( PERFORM_DEVELOPER_CHECKS )
     char msg[512];
-    snprintf( msg, sizeof(msg), "Error caclulating attenuation: %s", e.what() );
+    snprintf( msg, sizeof(msg), "Error getting shielding: %s", e.what() );
     log_developer_error( __func__, msg );
 #endif
-  }
-
+  }//try / catch
   
-  //Peak height is: area*(1/(sigma*sqrt(2*pi)))*exp( -(x-mean)^2 / (2*sigma^2) ),
-  //  therefore peak height is proportianal to area/sigma, lets correct for this
-  if( det && det->isValid() && det->hasResolutionInfo() )
+  const string responseKey = sourceKey + "|" + (det ? std::to_string( det->hashValue() ) : string("0"))
+                             + "|" + shieldKey;
+  shared_ptr<const LineResponse> response = ns_line_response_cache.find( responseKey );
+  if( !response )
   {
-    const vector<double> origbr = branchratios;
-    
-    try
-    {
-      for( size_t i = 0; i < branchratios.size(); ++i )
-      {
-        const double sigma = det->peakResolutionSigma( energies[i] );
-        if( sigma <= 0.0 )
-          throw exception();
-        branchratios[i] /= sigma;
-      }//for( size_t i = 0; i < branchratios.size(); ++i )
-    }catch(...)
-    {
-      branchratios = origbr;
-      cerr << "Encountered a negative or zero peak width, not taking detector "
-           << "resolution into account, sorry :(" << endl;
-    }//try / catch
-  }//if( detector->hasResolutionInfo() )
-
-  //Some decays may not produce gammas, but do produce xrays (not verified) so
-  //  we want to normalize gammas and xrays relative to the largest branching
-  //  ratio gamma or xray.
-  double max_gamma_xray = 0.0;
-
-  map<SandiaDecay::ProductType,double> maxbrs;
+    shared_ptr<LineResponse> computed = compute_line_response( *srcLines, det, material.get(),
+                                                               shieldKey.empty() ? 0.0f : genericAN );
+    response = ns_line_response_cache.insert( responseKey, computed );
+  }//if( !response )
   
-  for( size_t i = 0; i < branchratios.size(); ++i )
-  {
-    const SandiaDecay::ProductType type = particle_type[i];
-    
-    if( !maxbrs.count(type) )
-      maxbrs[type] = 0.0;
-//    if( (transistions[i]
-//         || inforows[i].decayMode==DecayParticleModel::RowData::ReactionToGammaMode
-//         || backgroundLines[i]) )
-      maxbrs[type] = max(maxbrs[type],branchratios[i]);
-
-    if( type == SandiaDecay::GammaParticle || type == SandiaDecay::XrayParticle )
-      max_gamma_xray = std::max( max_gamma_xray, branchratios[i] );
-  }//for( size_t i = 0; i < branchratios.size(); ++i )
+  char displaybuffer[64] = { '\0' };
+  snprintf( displaybuffer, sizeof(displaybuffer), "|%.6g|%.6g", shieldThickness, brCutoff );
+  const string displayKey = responseKey + displaybuffer;
   
-  for( size_t i = 0; i < branchratios.size(); ++i )
+  shared_ptr<const DisplayLines> displayLines = ns_display_lines_cache.find( displayKey );
+  if( !displayLines )
   {
-    const double energy = energies[i];
-    
-    //If this is an xray caused by a decay, lets normalize its amplitude relative
-    //  to the gamma amplitudes.  If we are displaying just the xrays of an
-    //  element, than we will normalize them to go between zero and one.
-    const bool is_gamma = (particle_type[i] == SandiaDecay::GammaParticle);
-    const bool is_xray = (particle_type[i] == SandiaDecay::XrayParticle);
-    const bool is_decay_xray_gamma = (nuc && (is_gamma || is_xray));
-    const double br = branchratios[i] / (is_decay_xray_gamma ? max_gamma_xray : maxbrs[particle_type[i]]);
-    
-    const SandiaDecay::Transition *transition = transistions[i];
-    const BackgroundLine *backLine = backgroundLines.at(i);
-    
-    if( (transition || backLine) && (br <= brCutoff || IsInf(br) || IsNan(br)) )
-      continue;
-    
-    string particlestr, decaystr, elstr;
-    if( !is_xray )
-    {
-      const SandiaDecay::ProductType parttype
-                               = SandiaDecay::ProductType( particle_type[i] );
-      particlestr = SandiaDecay::to_str( parttype );
-      
-      if( transition )
-      {
-        if( transition->parent )
-          decaystr = transition->parent->symbol;
-        if( transition->child )
-          decaystr += " to " + transition->child->symbol;
-        decaystr += string(" via ") + SandiaDecay::to_str(transition->mode);
-      }else if( reactionPeaks.at(i) )
-      {
-        decaystr = reactionPeaks[i]->name();
-      }else if( backLine )
-      {
-        const string &symbol = std::get<2>(*backLine);
-        if( symbol.size() )
-          decaystr += symbol + ", ";
-        
-        switch( std::get<3>(*backLine) )
-        {
-          case U238Series:    decaystr += "U238 series";         break;
-          case U235Series:    decaystr += "U235 series";         break;
-          case Th232Series:   decaystr += "Th232 series";        break;
-          case Ra226Series:   decaystr += "U238 (Ra226) series"; break;
-          case K40Background: decaystr += "Primordial";          break;
-          case OtherBackground: case BackgroundXRay: case BackgroundReaction:
-            decaystr += std::get<4>(*backLine);    break;
-        }//switch( get<3>(backgroundLines[i]) )
-      }//if( transition ) / else ...
-    }else
-    {
-      const SandiaDecay::Element *element = el;
-      if( !element )
-        element = db->element( nuc->atomicNumber );
-      
-      particlestr = "xray";
-      decaystr = "xray";
-      if( element )
-        elstr = element->name;
-      else if( backLine )
-        elstr = std::get<4>(*backLine);
-    }//if( xray ) / else
-    
-    m_currentlyShowingNuclide.energies.push_back(     energy );
-    m_currentlyShowingNuclide.intensities.push_back(  br );
-    m_currentlyShowingNuclide.particlestrs.push_back( particlestr );
-    m_currentlyShowingNuclide.decaystrs.push_back(    decaystr );
-    m_currentlyShowingNuclide.elementstrs.push_back(  elstr );
-  }//for( size_t i = 0; i < branchratios.size(); ++i )
+    shared_ptr<DisplayLines> computed = compute_display_lines( *srcLines, *response,
+                                                               shieldThickness, brCutoff, nuc, el );
+    displayLines = ns_display_lines_cache.insert( displayKey, computed );
+  }//if( !displayLines )
   
-  typedef std::map<SandiaDecay::ProductType,double>::const_iterator MaxBrIter;
-  
-  for( MaxBrIter iter = maxbrs.begin(); iter != maxbrs.end(); ++iter )
-  {
-    const char *typestr = SandiaDecay::to_str( SandiaDecay::ProductType(iter->first) );
-    m_currentlyShowingNuclide.particle_sf[typestr] = iter->second;
-    
-    if( iter->first == SandiaDecay::GammaParticle || iter->first == SandiaDecay::XrayParticle )
-      m_currentlyShowingNuclide.particle_sf[typestr] = max_gamma_xray;
-  }
+  m_currentlyShowingNuclide.energies     = displayLines->energies;
+  m_currentlyShowingNuclide.intensities  = displayLines->intensities;
+  m_currentlyShowingNuclide.particlestrs = displayLines->particlestrs;
+  m_currentlyShowingNuclide.decaystrs    = displayLines->decaystrs;
+  m_currentlyShowingNuclide.elementstrs  = displayLines->elementstrs;
+  m_currentlyShowingNuclide.particle_sf  = displayLines->particle_sf;
+  m_currentlyShowingNuclide.linesJson    = displayLines->linesJson;
   
   
 #if( PERFORM_DEVELOPER_CHECKS )
@@ -2165,10 +2452,7 @@ void ReferencePhotopeakDisplay::updateDisplayChange()
   
   
   
-  //Clientside javascript currently doesnt know about this garuntee that gamma
-  //  lines will be sorted by energy.
-  m_currentlyShowingNuclide.sortByEnergy();
-  
+  //The lines are already sorted by energy (see compute_display_lines(...)).
   //Also, we could play some tricks to eliminate some of the gamma lines that
   //  are so small in amplitude, they would never impact the user
   
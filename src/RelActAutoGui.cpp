@@ -1212,6 +1212,7 @@ RelActAutoGui::RelActAutoGui( InterSpec *viewer, Wt::WContainerWidget *parent )
   m_energy_ranges( nullptr ),
   m_free_peaks( nullptr ),
   m_is_calculating( false ),
+  m_calc_pending( false ),
   m_cancel_calc{},
   m_solution{},
   m_calc_started( this ),
@@ -4270,11 +4271,22 @@ void RelActAutoGui::startUpdatingCalculation()
   m_status_indicator->setText( "Calculating..." );
   m_status_indicator->show();
   
+  // If a calculation is already running, we wont start a second one to compete with it for the
+  //  CPU; instead we'll cancel it, and when it returns, #updateFromCalc or #handleCalcException
+  //  will start a new calculation with whatever the state is then.
+  if( m_is_calculating && m_cancel_calc )
+  {
+    m_cancel_calc->store( true );
+    m_calc_pending = true;
+    return;
+  }//if( a calculation is already running )
+  
   if( m_cancel_calc )
     m_cancel_calc->store( true );
   
   const string sessionid = wApp->sessionId();
   m_is_calculating = true;
+  m_calc_pending = false;
   m_cancel_calc = make_shared<std::atomic_bool>();
   m_cancel_calc->store( false );
   shared_ptr<atomic_bool> cancel_calc = m_cancel_calc;
@@ -4292,6 +4304,9 @@ void RelActAutoGui::startUpdatingCalculation()
   
   vector<shared_ptr<const PeakDef>> cached_all_peaks = m_cached_all_peaks;
   
+  // Start from the last solution; #RelActCalcAuto::solve will only use the parts still applicable
+  shared_ptr<const RelActCalcAuto::RelActAutoSolution> previous_solution = m_solution;
+  
   auto solution = make_shared<RelActCalcAuto::RelActAutoSolution>();
   auto error_msg = make_shared<string>();
   
@@ -4300,12 +4315,14 @@ void RelActAutoGui::startUpdatingCalculation()
   
   
   auto worker = [=](){
+    InterSpecApp::FitCpuTimer cpu_timer( sessionId );
+    
     try
     {
       RelActCalcAuto::RelActAutoSolution answer
         = RelActCalcAuto::solve( options, rois, nuclides, floating_peaks,
                                 foreground, background, cached_drf,
-                                cached_all_peaks, cancel_calc );
+                                cached_all_peaks, cancel_calc, previous_solution );
       
       WServer::instance()->post( sessionId, [=](){
         WApplication *app = WApplication::instance();
@@ -4359,6 +4376,22 @@ void RelActAutoGui::updateFromCalc( std::shared_ptr<RelActCalcAuto::RelActAutoSo
     return;
   
   m_is_calculating = false;
+  
+  // The user changed things while we were calculating, so this answer is out of date.
+  if( m_calc_pending )
+  {
+    if( answer->m_status == RelActCalcAuto::RelActAutoSolution::Status::Success )
+    {
+      if( answer->m_drf )
+        m_cached_drf = answer->m_drf;
+      if( !answer->m_spectrum_peaks.empty() )
+        m_cached_all_peaks = answer->m_spectrum_peaks;
+    }//if( the calculation finished before it was cancelled )
+    
+    startUpdatingCalculation();
+    return;
+  }//if( m_calc_pending )
+  
   m_status_indicator->hide();
   
   switch( answer->m_status )
@@ -4462,6 +4495,13 @@ void RelActAutoGui::handleCalcException( std::shared_ptr<std::string> message,
     return;
   
   m_is_calculating = false;
+  
+  if( m_calc_pending )
+  {
+    startUpdatingCalculation();
+    return;
+  }//if( m_calc_pending )
+  
   m_status_indicator->hide();
   
   string msg = "Calculation error: ";
@@ -65,7 +65,9 @@
 
 #include "InterSpec/PeakFit.h"
 #include "InterSpec/SpecMeas.h"
+#include "InterSpec/BatemanTable.h"
 #include "InterSpec/EnergyCal.h"
+#include "InterSpec/BackgroundPeakCache.h"
 #include "InterSpec/RelActCalc.h"
 #include "InterSpec/MakeDrfFit.h"
 #include "InterSpec/PeakFitUtils.h"
@@ -104,6 +106,16 @@ void sort_rois_by_energy( vector<RelActCalcAuto::RoiRange> &rois )
   });
 }//void sort_rois( vector<RoiRange> &rois )
 
+
+bool same_roi_range( const RelActCalcAuto::RoiRange &lhs, const RelActCalcAuto::RoiRange &rhs )
+{
+  return (lhs.lower_energy == rhs.lower_energy)
+         && (lhs.upper_energy == rhs.upper_energy)
+         && (lhs.continuum_type == rhs.continuum_type)
+         && (lhs.force_full_range == rhs.force_full_range)
+         && (lhs.allow_expand_for_peak_width == rhs.allow_expand_for_peak_width);
+}//bool same_roi_range(...)
+
 // We'll define some XML helper functions for serializing to/from XML
 //  (we should probably put these in a header somewhere and use through the code to minimize
 //   things a little)
@@ -555,6 +567,11 @@ struct NucInputGamma : public RelActCalcAuto::NucInputInfo
   
   vector<EnergyYield> nominal_gammas;
   
+  /** When the age is being fit, the precomputed decay chain, so #gammas_at_age doesnt need to
+   create and age a new nuclide mixture for each trial age.
+   */
+  std::shared_ptr<const BatemanTable> decay_table;
+  
   /** Returns the decay gammas along with their rate, and the transition that led to them (i.e.,
    where in the decay chain they come from).
    
@@ -707,7 +724,47 @@ struct NucInputGamma : public RelActCalcAuto::NucInputInfo
     //  nominal_age = PeakDef::defaultDecayTime( nuclide, nullptr );
     
     nominal_gammas = decay_gammas( nuclide, nominal_age, gammas_to_exclude );
+    
+    if( fit_age )
+    {
+      decay_table = make_shared<BatemanTable>( nuclide, false, gammas_to_exclude );
+    }//if( fit_age )
   }//NucInputGamma constructor
+  
+  
+  /** Returns the same thing as #decay_gammas, but using #decay_table, if it is available. */
+  vector<EnergyYield> gammas_at_age( const double age ) const
+  {
+    vector<BatemanTable::LineYield> lines;
+    
+    try
+    {
+      if( !decay_table )
+        throw std::logic_error( "no decay table" );
+      decay_table->evaluate( age, lines );
+    }catch( std::exception & )
+    {
+      return decay_gammas( nuclide, age, gammas_to_exclude );
+    }
+    
+    vector<EnergyYield> answer;
+    answer.reserve( lines.size() );
+    for( const BatemanTable::LineYield &line : lines )
+    {
+      if( line.yield <= 0.0 )
+        continue;
+      
+      answer.push_back( {} );
+      EnergyYield &info = answer.back();
+      info.energy = line.energy;
+      info.yield = line.yield;
+      info.transition_index = line.product_index;
+      info.transition = line.transition;
+      info.gamma_type = line.gamma_type;
+    }//for( const BatemanTable::LineYield &line : lines )
+    
+    return answer;
+  }//vector<EnergyYield> gammas_at_age( const double age ) const
 };//struct NucInputGamma
 
 
@@ -1052,8 +1109,103 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     
     return num_resids;
   }//size_t number_residuals() const
-  
-  /** Solve the problem, using the Ceres optimizer. */
+
+
+  /** Sets the starting parameter values to the final values of a previous solution, for the parts
+   of the problem that are unchanged from it: the energy calibration adjustments, the FWHM and
+   relative efficiency equations (if the same form and order), and the activity, age, and floating
+   peak amplitudes of nuclides and peaks that were in the previous problem.
+
+   Values are clamped to the bounds already set on the problem, and constant parameters are not
+   changed.  Returns the number of parameters that were set.
+   */
+  size_t set_warm_start_parameters( const RelActCalcAuto::RelActAutoSolution &prev,
+                                    ceres::Problem &problem,
+                                    vector<double> &parameters ) const
+  {
+    assert( parameters.size() == number_parameters() );
+
+    size_t num_set = 0;
+    double * const pars = parameters.data();
+
+    auto set_par = [&num_set, &problem, pars]( const size_t index, const double value ){
+      double * const par = pars + index;
+      if( IsNan(value) || IsInf(value) || problem.IsParameterBlockConstant(par) )
+        return;
+
+      const double lower = problem.GetParameterLowerBound( par, 0 );
+      const double upper = problem.GetParameterUpperBound( par, 0 );
+      *par = std::min( std::max( value, lower ), upper );
+      ++num_set;
+    };//set_par lamda
+
+    for( size_t i = 0; i < 2; ++i )
+    {
+      if( prev.m_fit_energy_cal[i] )
+        set_par( i, prev.m_energy_cal_adjustments[i] );
+    }
+
+    const size_t fwhm_start = 2;
+    const size_t num_fwhm_pars = num_parameters( m_options.fwhm_form );
+    const size_t rel_eff_start = fwhm_start + num_fwhm_pars;
+    const size_t num_rel_eff_par = m_options.rel_eff_eqn_order + 1;
+    const size_t acts_start = rel_eff_start + num_rel_eff_par;
+    const size_t free_peak_start = acts_start + 2*m_nuclides.size();
+
+    if( (prev.m_fwhm_form == m_options.fwhm_form)
+       && (prev.m_fwhm_coefficients.size() == num_fwhm_pars) )
+    {
+      for( size_t i = 0; i < num_fwhm_pars; ++i )
+        set_par( fwhm_start + i, prev.m_fwhm_coefficients[i] );
+    }
+
+    if( (prev.m_rel_eff_form == m_options.rel_eff_eqn_type)
+       && (prev.m_rel_eff_coefficients.size() == num_rel_eff_par) )
+    {
+      for( size_t i = 0; i < num_rel_eff_par; ++i )
+        set_par( rel_eff_start + i, prev.m_rel_eff_coefficients[i] );
+    }
+
+    for( size_t nuc_index = 0; nuc_index < m_nuclides.size(); ++nuc_index )
+    {
+      const NucInputGamma &nuc = m_nuclides[nuc_index];
+      for( const RelActCalcAuto::NuclideRelAct &prev_nuc : prev.m_rel_activities )
+      {
+        if( prev_nuc.nuclide != nuc.nuclide )
+          continue;
+
+        set_par( acts_start + 2*nuc_index, prev_nuc.rel_activity );
+
+        // Age parameters of nuclides whose age isnt fit, or is controlled by another nuclide, are
+        //  constant, so wont be changed.
+        if( prev_nuc.age_was_fit )
+          set_par( acts_start + 2*nuc_index + 1, prev_nuc.age );
+        break;
+      }//for( const RelActCalcAuto::NuclideRelAct &prev_nuc : prev.m_rel_activities )
+    }//for( loop over nuclides )
+
+    for( size_t peak_index = 0; peak_index < m_extra_peaks.size(); ++peak_index )
+    {
+      const RelActCalcAuto::FloatingPeak &peak = m_extra_peaks[peak_index];
+      for( const RelActCalcAuto::FloatingPeakResult &prev_peak : prev.m_floating_peaks )
+      {
+        if( fabs(prev_peak.energy - peak.energy) < 1.0E-3 )
+        {
+          set_par( free_peak_start + 2*peak_index, prev_peak.amplitude );
+          break;
+        }
+      }//for( const RelActCalcAuto::FloatingPeakResult &prev_peak : prev.m_floating_peaks )
+    }//for( loop over floating peaks )
+
+    return num_set;
+  }//size_t set_warm_start_parameters(...)
+
+
+  /** Solve the problem, using the Ceres optimizer.
+
+   If `warm_start` is non-null, it must be a solution for the same foreground and background; its
+   final parameter values will be used as the starting point (see #set_warm_start_parameters).
+   */
   static RelActCalcAuto::RelActAutoSolution solve_ceres( RelActCalcAuto::Options options,
                                                         std::vector<RelActCalcAuto::RoiRange> energy_ranges,
                                                         std::vector<RelActCalcAuto::NucInputInfo> nuclides,
@@ -1062,7 +1214,8 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
                                                         std::shared_ptr<const SpecUtils::Measurement> background,
                                                         const std::shared_ptr<const DetectorPeakResponse> input_drf,
                                                         std::vector<std::shared_ptr<const PeakDef>> all_peaks,
-                                                        std::shared_ptr<std::atomic_bool> cancel_calc
+                                                        std::shared_ptr<std::atomic_bool> cancel_calc,
+                                                        const RelActCalcAuto::RelActAutoSolution * const warm_start
                                                         )
   {
     const auto start_time = std::chrono::high_resolution_clock::now();
@@ -1113,12 +1266,14 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
         throw runtime_error( "RelActAutoCostFcn: live-time missing from spectrum." );
       
       const double lt_sf = foreground->live_time() / background->live_time();
-      const vector<float> &orig_back_counts = *background->gamma_counts();
-      const vector<float> &back_energies = *background->energy_calibration()->channel_energies();
-      const vector<float> &fore_energies = *foreground->energy_calibration()->channel_energies();
       
-      vector<float> background_counts;
-      SpecUtils::rebin_by_lower_edge( back_energies, orig_back_counts, fore_energies, background_counts );
+      // The background model is cached, along with its last few re-binnings, so re-solving against
+      //  the same background and foreground calibration doesnt re-bin the background each time.
+      const shared_ptr<const BackgroundPeakCache::BackgroundModel> back_model
+                                   = BackgroundPeakCache::background_model( background, {} );
+      const shared_ptr<const vector<float>> rebinned_back_counts
+                        = back_model->countsForCalibration( foreground->energy_calibration() );
+      const vector<float> &background_counts = *rebinned_back_counts;
       
       assert( background_counts.size() == channel_counts.size() );
       for( size_t i = 0; i < channel_counts.size(); ++i )
@@ -2042,6 +2197,16 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
     }//for( size_t extra_peak_index = 0; extra_peak_index < extra_peaks.size(); ++extra_peak_index )
     
     
+    // If we were given a previous solution to (nearly) the same problem, its final parameters are a
+    //  much better starting point than our estimates above, for what hasnt changed.
+    if( warm_start )
+    {
+      assert( (warm_start->m_foreground == foreground) && (warm_start->m_background == background) );
+      
+      cost_functor->set_warm_start_parameters( *warm_start, problem, parameters );
+    }//if( warm_start )
+    
+    
     // Okay - we've set our problem up
     ceres::Solver::Options ceres_options;
     ceres_options.linear_solver_type = ceres::DENSE_QR;
@@ -2444,6 +2609,19 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
   }//float fwhm(...)
   
   
+  /** Batch version of #fwhm; places the FWHM for each of the energies into `results`. */
+  void fwhms( const float *energies, const size_t nenergies, const std::vector<double> &x,
+              float *results ) const
+  {
+    const auto drf_start = begin(x) + 2;
+    const size_t num_drf_par = num_parameters(m_options.fwhm_form);
+    
+    const vector<float> drfx( drf_start, drf_start + num_drf_par );
+    
+    eval_fwhm( energies, nenergies, m_options.fwhm_form, drfx, results );
+  }//void fwhms(...)
+  
+  
   size_t nuclide_index( const SandiaDecay::Nuclide * const nuc ) const
   {
     assert( nuc );
@@ -2744,14 +2922,21 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
       {
         const double nuc_age = age(nucinfo.nuclide,x);
         aged_gammas_cache.reset( new vector<NucInputGamma::EnergyYield>() );
-        *aged_gammas_cache = NucInputGamma::decay_gammas( nucinfo.nuclide, nuc_age, nucinfo.gammas_to_exclude );
+        *aged_gammas_cache = nucinfo.gammas_at_age( nuc_age );
         gammas = aged_gammas_cache.get();
       }//if( age is fixed ) / else( age may vary )
       
       assert( gammas );
       
-      for( const NucInputGamma::EnergyYield &gamma : *gammas )
+      // Evaluate the FWHM of all the gammas at once, rather than one at a time
+      vector<float> gamma_fwhms( gammas->size() );
+      for( size_t i = 0; i < gammas->size(); ++i )
+        gamma_fwhms[i] = static_cast<float>( (*gammas)[i].energy );
+      fwhms( gamma_fwhms.data(), gamma_fwhms.size(), x, gamma_fwhms.data() );
+      
+      for( size_t gamma_index = 0; gamma_index < gammas->size(); ++gamma_index )
       {
+        const NucInputGamma::EnergyYield &gamma = (*gammas)[gamma_index];
         const double energy = gamma.energy;
         const double yield = gamma.yield;
         const size_t transition_index = gamma.transition_index;
@@ -2779,7 +2964,7 @@ struct RelActAutoCostFcn /* : ROOT::Minuit2::FCNBase() */
                               + std::to_string(gamma.energy) + " keV."  );
 
         
-        const double peak_fwhm = fwhm( gamma.energy, x );
+        const double peak_fwhm = gamma_fwhms[gamma_index];
         
         if( IsInf(peak_fwhm) || IsNan(peak_fwhm) )
         {
@@ -3672,6 +3857,15 @@ FwhmForm fwhm_form_from_str( const char *str )
 
 
 float eval_fwhm( const float energy, const FwhmForm form, const vector<float> &drfx )
+{
+  float fwhm;
+  eval_fwhm( &energy, 1, form, drfx, &fwhm );
+  return fwhm;
+}//float eval_fwhm( const float energy, const FwhmForm form, const vector<float> &drfx )
+
+
+void eval_fwhm( const float *energies, const size_t nenergies, const FwhmForm form,
+                const std::vector<float> &drfx, float *results )
 {
   DetectorPeakResponse::ResolutionFnctForm fctntype = DetectorPeakResponse::kNumResolutionFnctForm;
   switch( form )
@@ -3697,8 +3891,8 @@ float eval_fwhm( const float energy, const FwhmForm form, const vector<float> &d
   if( fctntype == DetectorPeakResponse::kNumResolutionFnctForm )
     throw runtime_error( "eval_fwhm: invalid FwhmForm" );
   
-  return DetectorPeakResponse::peakResolutionFWHM( energy, fctntype, drfx );
-}//float eval_fwhm( const float energy, const FwhmForm form, const vector<float> &drfx )
+  DetectorPeakResponse::peakResolutionFWHMs( energies, nenergies, fctntype, drfx, results );
+}//void eval_fwhm( const float *energies, const size_t nenergies, ... )
 
 
 void RoiRange::toXml( ::rapidxml::xml_node<char> *parent ) const
@@ -4933,10 +5127,44 @@ RelActAutoSolution solve( const Options options,
                          std::shared_ptr<const SpecUtils::Measurement> background,
                          std::shared_ptr<const DetectorPeakResponse> input_drf,
                          std::vector<std::shared_ptr<const PeakDef>> all_peaks,
-                         std::shared_ptr<std::atomic_bool> cancel_calc
+                         std::shared_ptr<std::atomic_bool> cancel_calc,
+                         std::shared_ptr<const RelActAutoSolution> previous_solution
                          )
 {
-  const RelActAutoSolution orig_sol = RelActAutoCostFcn::solve_ceres(
+  // A previous solution is only a useful starting point if it was successful, and for the same data
+  const RelActAutoSolution *warm_start = nullptr;
+  if( previous_solution
+     && (previous_solution->m_status == RelActAutoSolution::Status::Success)
+     && previous_solution->m_spectrum
+     && (previous_solution->m_foreground == foreground)
+     && (previous_solution->m_background == background) )
+  {
+    warm_start = previous_solution.get();
+  }
+  
+  bool all_roi_full_range = true;
+  for( const auto &roi : energy_ranges )
+    all_roi_full_range = (all_roi_full_range && roi.force_full_range && !roi.allow_expand_for_peak_width);
+  
+  // If the previous solution had exactly the same nuclides (the only thing, other than the input
+  //  ROIs, the significant-gamma ROI break-up below depends on), we can skip the initial solve using
+  //  the full input ROIs, and instead break up the ROIs based on the previous solution.
+  bool seed_rois_from_warm_start = (warm_start && !all_roi_full_range
+                    && (warm_start->m_rel_activities.size() == nuclides.size())
+                    && (warm_start->m_options.pu242_correlation_method == options.pu242_correlation_method));
+  for( size_t i = 0; seed_rois_from_warm_start && (i < nuclides.size()); ++i )
+    seed_rois_from_warm_start = (warm_start->m_rel_activities[i].nuclide == nuclides[i].nuclide);
+  
+  RelActAutoSolution orig_sol;
+  if( seed_rois_from_warm_start )
+  {
+    orig_sol = *warm_start;
+    orig_sol.m_num_function_eval_solution = 0;
+    orig_sol.m_num_function_eval_total = 0;
+    orig_sol.m_num_microseconds_eval = 0;
+  }else
+  {
+    orig_sol = RelActAutoCostFcn::solve_ceres(
                      options,
                      energy_ranges,
                      nuclides,
@@ -4945,23 +5173,23 @@ RelActAutoSolution solve( const Options options,
                      background,
                      input_drf,
                      all_peaks,
-                     cancel_calc );
+                     cancel_calc,
+                     warm_start );
   
-  bool all_roi_full_range = true;
-  for( const auto &roi : energy_ranges )
-    all_roi_full_range = (all_roi_full_range && roi.force_full_range && !roi.allow_expand_for_peak_width);
-  
-  if( all_roi_full_range
-     || (orig_sol.m_status != RelActAutoSolution::Status::Success)
-     || !orig_sol.m_spectrum )
-  {
-    return orig_sol;
-  }
+    if( all_roi_full_range
+       || (orig_sol.m_status != RelActAutoSolution::Status::Success)
+       || !orig_sol.m_spectrum )
+    {
+      return orig_sol;
+    }
+  }//if( seed_rois_from_warm_start ) / else
   
   // If we are here there was at least one ROI that didnt have force_full_range set, or had
   //  allow_expand_for_peak_width set.
   // So we will go through and adjust these ROIs based on peaks that are statistically significant,
   //  based on initial solution, and then re-fit.
+  //  Note: if `seed_rois_from_warm_start` is true, `orig_sol` is the previous solution (i.e., for
+  //        a different problem), so must not be returned.
     
   RelActAutoSolution current_sol = orig_sol;
   
@@ -4983,6 +5211,9 @@ RelActAutoSolution solve( const Options options,
        || !current_sol.m_spectrum->energy_calibration()
        || !current_sol.m_spectrum->energy_calibration()->valid() )
     {
+      if( seed_rois_from_warm_start )
+        return solve( options, energy_ranges, nuclides, extra_peaks, foreground, background,
+                      input_drf, all_peaks, cancel_calc, nullptr );
       return orig_sol;
     }
     
@@ -5095,6 +5326,32 @@ RelActAutoSolution solve( const Options options,
       if( roi.force_full_range )
         continue;
       
+      // When seeded from a previous solution, input ROIs the user hasnt changed keep the ROIs they
+      //  were broken up into last time, so only the new or edited ROIs are re-derived.
+      if( seed_rois_from_warm_start && (num_roi_iters == 0) && !roi.allow_expand_for_peak_width )
+      {
+        bool unchanged = false;
+        for( const RoiRange &prev_roi : warm_start->m_input_roi_ranges )
+          unchanged = (unchanged || same_roi_range(prev_roi, roi));
+        
+        if( unchanged )
+        {
+          for( const RoiRange &prev_final : warm_start->m_final_roi_ranges )
+          {
+            if( (prev_final.lower_energy >= roi.lower_energy)
+               && (prev_final.upper_energy <= roi.upper_energy) )
+            {
+              RoiRange reused = prev_final;
+              reused.force_full_range = true;
+              reused.allow_expand_for_peak_width = false;
+              significant_peak_ranges.push_back( reused );
+            }
+          }//for( const RoiRange &prev_final : warm_start->m_final_roi_ranges )
+          
+          continue;
+        }//if( unchanged )
+      }//if( seed_rois_from_warm_start && (num_roi_iters == 0) )
+      
       // Estimate
       for( const NuclideRelAct &rel_act : current_sol.m_rel_activities )
       {
@@ -5242,9 +5499,11 @@ RelActAutoSolution solve( const Options options,
     
     try
     {
+      // Each re-fit starts from the solution before it, which is usually already very close
       const RelActAutoSolution updated_sol
       = RelActAutoCostFcn::solve_ceres( options, updated_energy_ranges, nuclides, extra_peaks,
-                                       foreground, background, input_drf, all_peaks, cancel_calc );
+                                       foreground, background, input_drf, all_peaks, cancel_calc,
+                                       &current_sol );
       
       switch( updated_sol.m_status )
       {
@@ -5279,6 +5538,12 @@ RelActAutoSolution solve( const Options options,
       num_microseconds_eval += current_sol.m_num_microseconds_eval;
     }catch( std::exception &e )
     {
+      // If the very first fit failed, we dont have a solution to this problem yet, so we'll go
+      //  back to solving it from scratch.
+      if( seed_rois_from_warm_start && (num_roi_iters == 0) )
+        return solve( options, energy_ranges, nuclides, extra_peaks, foreground, background,
+                      input_drf, all_peaks, cancel_calc, nullptr );
+      
       stop_iterating = errored_out_of_iterating = true;
       current_sol.m_warnings.push_back( "Failed to break up energy ranges to ROIs with significant"
                                     " gamma counts: " + string(e.what())
@@ -5291,6 +5556,10 @@ RelActAutoSolution solve( const Options options,
   current_sol.m_num_function_eval_total = num_function_eval_total;
   current_sol.m_num_microseconds_eval = num_microseconds_eval;
   
+  // The re-fits were given the broken-up ROIs as input, but we want to record what the user asked
+  //  for (this is also what warm-starting from this solution compares against).
+  current_sol.m_input_roi_ranges = energy_ranges;
+  
   
   if( !errored_out_of_iterating && !stop_iterating )
     current_sol.m_warnings.push_back( "Final ROIs based on gamma line significances may not have been found." );
@@ -74,6 +74,7 @@
 #include "InterSpec/SimpleDialog.h"
 #include "InterSpec/WarningWidget.h"
 #include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/ExternalRidWorkerPool.h"
 #include "InterSpec/ReferencePhotopeakDisplay.h"
 
 
@@ -966,14 +967,9 @@ public:
 public:
   static void startExeAnalysis( string exe_path, ExternalRidWidget *parent, string drf, shared_ptr<SpecUtils::SpecFile> spec_file )
   {
-    vector<string> arguments;
-    arguments.push_back( "--mode=command-line" );
-    arguments.push_back( "--out-format=json" );
-    arguments.push_back( "--drf" );
-    arguments.push_back( drf );
-    
-    if( spec_file->num_measurements() < 2 )
-      arguments.push_back( "--synthesize-background=1" );
+    ExternalRid::AnalysisRequest request;
+    request.drf = drf;
+    request.synthesize_background = (spec_file->num_measurements() < 2);
     
     if( !locate_file(exe_path, false) )
     {
@@ -1027,7 +1023,7 @@ public:
       spec_file->write_2012_N42( tmpfile );
     }//end writing temp file
     
-    arguments.push_back( tmpfilename );
+    request.spectrum_file = tmpfilename;
     
     
     const string appsession = WApplication::instance()->sessionId();
@@ -1041,10 +1037,10 @@ public:
     else
       doUpdateFcn = boost::bind( &ExternalRidWidget::makeToastNotificationForAnaResult, rcode, result, m );
     
-    auto commandRunner = [tmpfilename,exe_path,arguments,doUpdateFcn,rcode,result,m,appsession](){
+    auto commandRunner = [tmpfilename,exe_path,request,doUpdateFcn,rcode,result,m,appsession](){
       try
       {
-        string results = run_external_command( exe_path, arguments );
+        string results = ExternalRid::WorkerPool::instance().analyze( exe_path, request );
         SpecUtils::trim( results );
         
         if( results.empty() )
@@ -1151,6 +1147,12 @@ public:
         if( drfs.empty() )
           throw runtime_error( "No output from running executable." );
         
+        // Get a worker loading its detector library now, so the first analysis wont have to wait
+        //  on a new process starting up.
+        string worker_exe = exe_path;
+        if( locate_file( worker_exe, false ) )
+          ExternalRid::WorkerPool::instance().prestart( worker_exe );
+        
         std::lock_guard<mutex> lock( *m );
         *success = 0;
         *result = drfs;
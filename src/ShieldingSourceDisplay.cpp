@@ -106,12 +106,12 @@
 #include "InterSpec/WarningWidget.h"
 #include "InterSpec/PhysicalUnits.h"
 #include "SandiaDecay/SandiaDecay.h"
-#include "SpecUtils/SpecUtilsAsync.h"
 #include "InterSpec/SwitchCheckbox.h"
 #include "InterSpec/ShieldingSelect.h"
 #include "InterSpec/SpecMeasManager.h"
 #include "InterSpec/RowStretchTreeView.h"
 #include "InterSpec/NativeFloatSpinBox.h"
+#include "InterSpec/BackgroundPeakCache.h"
 #include "InterSpec/MassAttenuationTool.h"
 #include "InterSpec/DecayDataBaseServer.h"
 #include "InterSpec/DetectorPeakResponse.h"
@@ -7084,22 +7084,27 @@ ShieldingSourceDisplay::Chi2FcnShrdPtr ShieldingSourceDisplay::shieldingFitnessF
   if( m_backgroundPeakSub->isChecked() )
   {
     std::shared_ptr<const SpecMeas> back = m_specViewer->measurment(SpecUtils::SpectrumType::Background);
+    std::shared_ptr<const SpecUtils::Measurement> backhist
+                      = m_specViewer->displayedHistogram(SpecUtils::SpectrumType::Background);
     typedef std::shared_ptr<const PeakDef> PeakPtr;
     typedef std::deque< std::shared_ptr<const PeakDef> > PeakDeque;
     std::shared_ptr<const PeakDeque > backpeaks;
     
-    if( back )
+    if( back && backhist )
     {
       const auto &displayed = m_specViewer->displayedSamples(SpecUtils::SpectrumType::Background);
       backpeaks = back->peaks( displayed );
-    }//if( back )
+    }//if( back && backhist )
     
     if( backpeaks && !backpeaks->empty() )
     {
       vector<PeakDef> backgroundpeaks;
       for( const PeakPtr &p : *backpeaks )
         backgroundpeaks.push_back( *p );
-      answer->setBackgroundPeaks( backgroundpeaks, back->gamma_live_time() );
+      
+      // The model is cached by background spectrum and peaks, so re-fitting against the same
+      //  background will re-use it.
+      answer->setBackground( BackgroundPeakCache::background_model( backhist, backgroundpeaks ) );
     }else
     {
       m_backgroundPeakSub->setUnChecked();
@@ -7644,6 +7649,8 @@ void ShieldingSourceDisplay::doModelFittingWork( const std::string wtsession,
   
   assert( results );
   
+  InterSpecApp::FitCpuTimer cpu_timer( wtsession );
+  
   results->succesful = ModelFitResults::FitStatus::InvalidOther;
   
   Chi2FcnShrdPtr chi2Fcn;
@@ -7704,6 +7711,13 @@ void ShieldingSourceDisplay::doModelFittingWork( const std::string wtsession,
     if( inputPrams->VariableParameters() < 1 )
       throw runtime_error( "No parameters are selected for fitting." );
     
+    // Let the chi2 function know which parameters are fixed, so it can skip computing their
+    //  derivatives when Minuit asks for the gradient.
+    vector<bool> fixedPars;
+    for( const ROOT::Minuit2::MinuitParameter &par : inputPrams->Parameters() )
+      fixedPars.push_back( par.IsFixed() || par.IsConst() );
+    chi2Fcn->setFixedParameters( fixedPars );
+    
     chi2Fcn->fittingIsStarting( sm_max_model_fit_time_ms );
     
     ROOT::Minuit2::MnUserParameterState inputParamState( *inputPrams );
@@ -7727,208 +7741,8 @@ void ShieldingSourceDisplay::doModelFittingWork( const std::string wtsession,
     
     ROOT::Minuit2::MnUserParameters fitParams = minimum.UserParameters();
     
-    //For some reason the fit to atomic number of generic shielding is horrible!
-    //  I'm probably screwing something up in the setup for Minuit, but as a
-    //  work around, lets manually coarsely scan AN, and then use the best found
-    //  AN to then perform another fit to fine tune it.
-    //Not a lot of validation went into this, but it does seem to work better.
-    //  For the life of me, I cant get Minuit to fit for AN and AD simultaneously well
-    vector<string> fit_generic_an;
-    for( auto &par : inputPrams->Parameters() )
-    {
-      const string &name = par.GetName();
-      if( (name.find("Generic_")!=string::npos)
-         && (name.find("_AN")!=string::npos)
-         && (name.find("_FIXED")==string::npos)
-         && !par.IsFixed() )  //Looks to be bug in Minuit, so we need the above "_FIXED"
-      {
-        fit_generic_an.push_back( name );
-      }
-    }//for( auto &par : inputPrams->Parameters() )
-    
-    
-    // If we have a self-attenuating or trace source, computation time becomes pretty large, so we
-    //  wont do the detailed AN scan in this case
-    //  TODO: check if we are fitting anything related to self-attenuating materials dimensions, and
-    //        if not, dont reject doing the AN scan.
-    if( !fit_generic_an.empty() )
-    {
-      for( size_t i = 0; i < chi2Fcn->numNuclides(); ++i )
-      {
-        const SandiaDecay::Nuclide * const nuc = chi2Fcn->nuclide( static_cast<int>(i) );
-        if( chi2Fcn->isVolumetricSource(nuc) )
-          fit_generic_an.clear();
-      }
-    }//if( check if we also have a self-attenuating source )
-    
-    
-    if( !fit_generic_an.empty() )  //should add in a check that we arnt doing self attenuating sources.
-    {
-      //Re-perform the fit scanning in atomic number to find best.
-      // TODO: Fix all other AN for the scan, and update inputPrams, so subsequent generic materials will use new AN
-      for( const auto &parname : fit_generic_an )
-      {
-        std::mutex best_an_mutex;
-        int best_an = static_cast<int>( std::round(minimum.UserParameters().Value(parname)) );
-        double best_chi2 = minimum.Fval();
-        ROOT::Minuit2::FunctionMinimum best_min = minimum;
-                                                     
-        vector<double> an_chi2s( MassAttenuation::sm_max_xs_atomic_number + 1, std::numeric_limits<double>::max() );
-        
-        auto calc_for_an = [&an_chi2s,&best_an_mutex,&best_an,&best_chi2,&best_min,inputPrams,&parname,chi2Fcn]( const int an ){
-          ROOT::Minuit2::MnUserParameters testpar;
-          
-          for( const auto &p : inputPrams->Parameters() )
-          {
-            const string name = p.Name();
-            if( name == parname )
-            {
-              testpar.Add( name, static_cast<double>(an) );
-            }else if( p.IsConst() || p.IsFixed() || (name.find("_FIXED") != string::npos) )
-            {
-              testpar.Add( name, p.Value() );
-            }else
-            {
-              testpar.Add( name, p.Value(), p.Error() );
-              if( p.HasLowerLimit() )
-                testpar.SetLowerLimit( name, p.LowerLimit() );
-              if( p.HasUpperLimit() )
-                testpar.SetUpperLimit( name, p.UpperLimit() );
-            }
-          }//for( const auto &p : inputPrams->Parameters() )
-          
-          try
-          {
-            ROOT::Minuit2::MnUserParameterState anInputParam( testpar );
-            ROOT::Minuit2::MnStrategy strategy( 2 ); //0 low, 1 medium, >=2 high
-            ROOT::Minuit2::MnMinimize anfitter( *chi2Fcn, anInputParam, strategy );
-            
-            const double tolerance = 2.0*inputPrams->VariableParameters();
-            const unsigned int maxFcnCall = 50000;  //default minuit2: 200 + 100 * npar + 5 * npar**2
-            
-            ROOT::Minuit2::FunctionMinimum anminimum = anfitter( maxFcnCall, tolerance );
-            for( int i = 0; !anminimum.IsValid() && i < 2; ++i )
-              anminimum = anfitter( maxFcnCall, tolerance );
-            
-            {// begin lock on best_an_mutex
-              std::lock_guard<std::mutex> lock( best_an_mutex );
-              
-              an_chi2s[an] = anminimum.Fval();
-              if( an_chi2s[an] < best_chi2 )
-              {
-                best_an = an;
-                best_chi2 = an_chi2s[an];
-                best_min = anminimum;
-              }
-            }// end lock on best_an_mutex
-          }catch( std::exception &e )
-          {
-            cerr << "Unexpected exception scanning in AN for shielding/src fit!" << endl;
-          }//try / catch
-        };//calc_for_an lambda
-        
-        
-        chi2Fcn->setSelfAttMultiThread( false ); //shouldnt affect anything, but JIC
-        
-        
-        SpecUtilsAsync::ThreadPool pool;
-        
-        const int initial_sn_skip = 5;
-        for( int an = MassAttenuation::sm_min_xs_atomic_number;
-            an < MassAttenuation::sm_max_xs_atomic_number;
-            an += initial_sn_skip )
-        {
-          pool.post( [&calc_for_an,an](){ calc_for_an(an); } );
-        }//for( loop over AN )
-        
-        pool.join();
-        
-        int detail_scan_start, detail_scan_end, best_coarse_an;
-        {// begin lock on best_an_mutex
-          std::lock_guard<std::mutex> lock( best_an_mutex );
-          
-          const auto min_coarse_chi2_iter = std::min_element( begin(an_chi2s), end(an_chi2s) );
-          best_coarse_an = static_cast<int>( min_coarse_chi2_iter - begin(an_chi2s) );
-          
-          //Now scan best_coarse_an +- (initial_sn_skip - 1),
-          // (clamp to MassAttenuation::sm_min_xs_atomic_number, MassAttenuation::sm_max_xs_atomic_number)
-          detail_scan_start = static_cast<int>( best_coarse_an - (initial_sn_skip - 1) );
-          detail_scan_end = static_cast<int>( best_coarse_an + initial_sn_skip );
-          detail_scan_start = std::max( detail_scan_start, MassAttenuation::sm_min_xs_atomic_number );
-          detail_scan_end = std::min( detail_scan_end, MassAttenuation::sm_max_xs_atomic_number );
-          
-          assert( detail_scan_start >= 1 );
-          assert( detail_scan_end <= MassAttenuation::sm_max_xs_atomic_number );
-          
-          if( (best_coarse_an < MassAttenuation::sm_min_xs_atomic_number)
-             || (best_coarse_an > MassAttenuation::sm_max_xs_atomic_number) )
-          {
-            detail_scan_start = detail_scan_end;
-          }
-        }// end lock on best_an_mutex
-        
-        
-        for( int an = detail_scan_start; an <= detail_scan_end; an += 1 )
-        {
-          if( an != best_coarse_an )
-            pool.post( [&calc_for_an,an](){ calc_for_an(an); } );
-        }//for( loop over AN )
-        
-        pool.join();
-        
-        {// begin lock on best_an_mutex
-          std::lock_guard<std::mutex> lock( best_an_mutex );
-          
-          best_an = std::min( best_an, MassAttenuation::sm_max_xs_atomic_number );
-          best_an = std::max( best_an, MassAttenuation::sm_min_xs_atomic_number );
-          
-          minimum = best_min;
-          fitParams = minimum.UserParameters();
-          
-          // TODO: explore updating inputPrams incase we are fitting multiple generic materials
-          //inputPrams->SetValue( parname, best_an );
-          
-          // We'll approximate errors on AN.  Extraordinarily rough right now.
-          // TODO: better estimate the actual lower_and upper AN; for now overestimating error,
-          //       sometimes horribly.
-          const double up = chi2Fcn->Up();
-          double lower_an = best_an, upper_an = best_an;
-          for( ; lower_an > MassAttenuation::sm_min_xs_atomic_number; --lower_an )
-          {
-            if( (an_chi2s[lower_an] != std::numeric_limits<double>::max())
-               && ((an_chi2s[lower_an] - best_chi2) >= up) )
-              break;
-          }
-          
-          for( ; upper_an < MassAttenuation::sm_max_xs_atomic_number; ++upper_an )
-          {
-            if( (an_chi2s[upper_an] != std::numeric_limits<double>::max())
-               && ((an_chi2s[upper_an] - best_chi2) >= up) )
-              break;
-          }
-          
-          float error = 0.5*(upper_an - lower_an);
-          
-          // If we are near the limits of atomic number, be a little more conservative since our
-          //  naive estimation may not have been able to fully go to the atomic number.
-          if( ((best_an + error) >= MassAttenuation::sm_max_xs_atomic_number)
-             || ((best_an - error) <= MassAttenuation::sm_min_xs_atomic_number) )
-          {
-            error = std::max( error, static_cast<float>(upper_an - best_an) );
-            error = std::max( error, static_cast<float>(best_an - lower_an) );
-          }
-          
-          
-          error = std::max( 1.0f, error );
-          
-          fitParams.SetError( parname, error );
-        }// end lock on best_an_mutex
-        
-        chi2Fcn->setSelfAttMultiThread( true ); //shouldnt affect anything, but JIC
-      }//for( const auto &parname : fit_generic_an )
-       
-    }//if( !fit_generic_an.empty() )
-    
+    // Generic shielding atomic numbers are fit along with everything else, as regular bounded
+    //  parameters; MassAttenuation::massAttenuationCoeficientSmoothAN makes the chi2 smooth in them.
     
     std::lock_guard<std::mutex> lock( results->m_mutex );
     
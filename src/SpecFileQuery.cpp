@@ -90,6 +90,161 @@ std::chrono::system_clock::time_point to_time_point( const boost::posix_time::pt
   
   return tp;
 }
+
+
+/** Escapes the SQL LIKE wildcards in `str` (using a backslash as the escape character), and adds the
+ '%' wildcard to the start and/or end, as requested.
+ */
+std::string sql_like_pattern( const std::string &str, const bool any_prefix, const bool any_suffix )
+{
+  std::string pattern = any_prefix ? "%" : "";
+  for( const char c : str )
+  {
+    if( (c == '%') || (c == '_') || (c == '\\') )
+      pattern += '\\';
+    pattern += c;
+  }
+  if( any_suffix )
+    pattern += '%';
+  
+  return pattern;
+}//sql_like_pattern(...)
+
+
+/** Sets lhs to "(lhs op rhs)". */
+void combine_sql( SpecFileQuery::SqlCondition &lhs, const char *op, const SpecFileQuery::SqlCondition &rhs )
+{
+  lhs.sql = "(" + lhs.sql + " " + op + " " + rhs.sql + ")";
+  lhs.values.insert( end(lhs.values), begin(rhs.values), end(rhs.values) );
+}//combine_sql(...)
+
+
+void negate_sql( SpecFileQuery::SqlCondition &cond )
+{
+  cond.sql = "(NOT " + cond.sql + ")";
+}//negate_sql(...)
+
+
+/** Converts the (sub-)expression fields[begin, end) of a #SpecFileQuery::SpecLogicTest into SQL,
+ following the same rules #SpecLogicTest::evaluate uses: parenthesis are evaluated first, then
+ NOT is applied to the following term, then AND and OR are applied strictly left-to-right.
+ */
+bool fields_to_sql( const std::vector<boost::any> &fields, const size_t begin, const size_t end,
+                    SpecFileQuery::SqlCondition &definite, SpecFileQuery::SqlCondition &possible )
+{
+  using namespace SpecFileQuery;
+  
+  definite = possible = SqlCondition{};
+  
+  if( begin >= end )
+  {
+    definite.sql = possible.sql = "1";
+    return true;
+  }
+  
+  bool have_term = false, negate_next = false;
+  LogicType pending_logic = NumLogicType;
+  
+  for( size_t i = begin; i < end; ++i )
+  {
+    SqlCondition term_definite, term_possible;
+    
+    if( const LogicType *logic = boost::any_cast<LogicType>( &(fields[i]) ) )
+    {
+      switch( *logic )
+      {
+        case LogicalNot:
+          if( negate_next || (have_term && (pending_logic == NumLogicType)) )
+            return false;
+          negate_next = true;
+          continue;
+          
+        case LogicalOr:
+        case LogicalAnd:
+          if( !have_term || negate_next || (pending_logic != NumLogicType) )
+            return false;
+          pending_logic = *logic;
+          continue;
+          
+        case LogicalOpenParan:
+        {
+          int nparen = 1;
+          size_t closepos = i + 1;
+          for( ; closepos < end; ++closepos )
+          {
+            if( const LogicType *l = boost::any_cast<LogicType>( &(fields[closepos]) ) )
+            {
+              if( *l == LogicalOpenParan )
+                ++nparen;
+              else if( *l == LogicalCloseParan )
+                --nparen;
+            }
+            
+            if( nparen == 0 )
+              break;
+          }//for( ; closepos < end; ++closepos )
+          
+          if( closepos >= end )
+            return false;
+          
+          if( !fields_to_sql( fields, i + 1, closepos, term_definite, term_possible ) )
+            return false;
+          
+          i = closepos;
+          break;
+        }//case LogicalOpenParan:
+          
+        case LogicalCloseParan:
+        case NumLogicType:
+          return false;
+      }//switch( *logic )
+    }else if( const SpecTest *test = boost::any_cast<SpecTest>( &(fields[i]) ) )
+    {
+      if( test->to_sql( term_definite ) )
+      {
+        term_possible = term_definite;
+      }else
+      {
+        term_definite.sql = "0";
+        term_possible.sql = "1";
+      }
+    }else if( boost::any_cast<EventXmlTest>( &(fields[i]) ) )
+    {
+      term_definite.sql = "0";
+      term_possible.sql = "1";
+    }else
+    {
+      return false;
+    }
+    
+    if( negate_next )
+    {
+      //Negating swaps which files definitely pass, with those that possibly pass
+      std::swap( term_definite, term_possible );
+      negate_sql( term_definite );
+      negate_sql( term_possible );
+      negate_next = false;
+    }//if( negate_next )
+    
+    if( !have_term )
+    {
+      definite = term_definite;
+      possible = term_possible;
+      have_term = true;
+    }else
+    {
+      if( pending_logic == NumLogicType )
+        return false;
+      
+      const char *op = (pending_logic == LogicalAnd) ? "AND" : "OR";
+      combine_sql( definite, op, term_definite );
+      combine_sql( possible, op, term_possible );
+      pending_logic = NumLogicType;
+    }
+  }//for( size_t i = begin; i < end; ++i )
+  
+  return (have_term && !negate_next && (pending_logic == NumLogicType));
+}//fields_to_sql(...)
 }//namespace
 
 namespace SpecFileQuery
@@ -795,6 +950,221 @@ namespace SpecFileQuery
   }//bool test( const SpecFileInfoToQuery &meas ) const
   
   
+  bool SpecTest::to_sql( SqlCondition &cond ) const
+  {
+    // Multi-valued fields, as well as the string fields (so they can be tested case-insensitively
+    //  using an index), are stored one-value-per-row in separate tables, see
+    //  SpecFileQueryDbCache::add_query_values(...).
+    const string text_in = string("file_path_hash IN (SELECT file_path_hash FROM ")
+                           + SpecFileQueryDbCache::sm_text_values_table + " WHERE field = ?";
+    const string numeric_in = string("file_path_hash IN (SELECT file_path_hash FROM ")
+                              + SpecFileQueryDbCache::sm_numeric_values_table + " WHERE field = ?";
+    
+    SqlCondition answer;
+    
+    // Creates an expression for a single-valued column (`col`), or for multi-valued fields (if
+    //  `col` is empty), where `tolerance` is used for equal/not-equal comparisons.
+    auto numeric_test = [&]( const string &col, const double tolerance, const char *not_equal_op ) -> bool {
+      if( IsNan(m_numeric) )
+        return false;
+      
+      const string val = col.empty() ? string("value") : col;
+      
+      string test;
+      switch( m_compareType )
+      {
+        case ValueIsExact:
+          test = (tolerance > 0.0) ? ("ABS(" + val + " - ?) < " + std::to_string(tolerance))
+                                   : (val + " = ?");
+          break;
+          
+        case ValueIsNotEqual:
+          test = (tolerance > 0.0) ? ("ABS(" + val + " - ?) " + not_equal_op + " " + std::to_string(tolerance))
+                                   : (val + " <> ?");
+          break;
+          
+        case ValueIsLessThan:    test = val + " < ?"; break;
+        case ValueIsGreaterThan: test = val + " > ?"; break;
+      }//switch( m_compareType )
+      
+      if( col.empty() )
+      {
+        answer.sql = numeric_in + " AND " + test + ")";
+        answer.values.push_back( static_cast<long long>(m_searchField) );
+      }else
+      {
+        answer.sql = test;
+      }
+      
+      answer.values.push_back( m_numeric );
+      return true;
+    };//numeric_test lambda
+    
+    switch( m_searchField )
+    {
+      case ParentPath:
+      case Filename:
+      case DetectorName:
+      case SerialNumber:
+      case Manufacturer:
+      case Model:
+      case Uuid:
+      case Remark:
+      case LocationName:
+      case AnalysisResultText:
+      {
+        answer.sql = text_in;
+        answer.values.push_back( static_cast<long long>(m_searchField) );
+        
+        //test_string(...) always passes empty search strings, but multi-valued fields must have
+        //  at least one value to pass, which is what just checking the field gives us.
+        if( !m_searchString.empty() )
+        {
+          bool prefix = false, suffix = false, negate = false;
+          switch( m_stringSearchType )
+          {
+            case TextIsExact:                                          break;
+            case TextNotEqual:         negate = true;                  break;
+            case TextIsContained:      prefix = suffix = true;         break;
+            case TextDoesNotContain:   prefix = suffix = negate = true; break;
+            case TextStartsWith:       suffix = true;                  break;
+            case TextDoesNotStartWith: suffix = negate = true;         break;
+            case TextEndsWith:         prefix = true;                  break;
+            case TextDoesNotEndWith:   prefix = negate = true;         break;
+              
+            case TextRegex:
+              return false;
+          }//switch( m_stringSearchType )
+          
+          //SQLite's LIKE is case-insensitive for ASCII characters, same as our string tests.
+          answer.sql += string(" AND value ") + (negate ? "NOT LIKE" : "LIKE") + " ? ESCAPE '\\'";
+          answer.values.push_back( sql_like_pattern( m_searchString, prefix, suffix ) );
+        }//if( !m_searchString.empty() )
+        
+        answer.sql += ")";
+        break;
+      }//case( a string field )
+        
+      case AnalysisResultNuclide:
+        //Requires the nuclide database to interpret results
+        return false;
+        
+      case HasRIIDAnalysis:
+        answer.sql = (m_discreteOption==1) ? "has_riid_analysis <> 0" : "has_riid_analysis = 0";
+        break;
+        
+      case DetectionSystemType:
+        answer.sql = "detector_type = ?";
+        answer.values.push_back( static_cast<long long>(m_discreteOption) );
+        break;
+        
+      case SearchMode:
+        answer.sql = (m_discreteOption==0) ? "passthrough = 0" : "passthrough <> 0";
+        break;
+        
+      case ContainedNuetronDetector:
+        answer.sql = (m_discreteOption==1) ? "contained_neutron <> 0" : "contained_neutron = 0";
+        break;
+        
+      case ContainedDeviationPairs:
+        answer.sql = (m_discreteOption==1) ? "contained_dev_pairs <> 0" : "contained_dev_pairs = 0";
+        break;
+        
+      case HasGps:
+        answer.sql = (m_discreteOption==1) ? "contained_gps <> 0" : "contained_gps = 0";
+        break;
+        
+      case EnergyCalibrationType:
+        answer.sql = numeric_in + " AND value = ?)";
+        answer.values.push_back( static_cast<long long>(m_searchField) );
+        answer.values.push_back( static_cast<long long>(m_discreteOption) );
+        break;
+        
+      case TotalLiveTime:
+        if( !numeric_test( "total_livetime", 0.001, ">=" ) )
+          return false;
+        break;
+        
+      case TotalRealTime:
+        if( !numeric_test( "total_realtime", 0.001, ">=" ) )
+          return false;
+        break;
+        
+      case IndividualSpectrumLiveTime:
+      case IndividualSpectrumRealTime:
+        if( !numeric_test( "", 0.001, ">" ) )
+          return false;
+        break;
+        
+      case NumberOfSamples:
+        if( !numeric_test( "number_of_samples", 0.0, "" ) )
+          return false;
+        break;
+        
+      case NumberOfRecords:
+        if( !numeric_test( "number_of_records", 0.0, "" ) )
+          return false;
+        break;
+        
+      case NumberOfGammaChannels:
+        if( !numeric_test( "", 0.0, "" ) )
+          return false;
+        break;
+        
+      case MaximumGammaEnergy:
+        if( !numeric_test( "", 0.1, ">" ) )
+          return false;
+        break;
+        
+      case Latitude:
+      case Longitude:
+        if( !numeric_test( (m_searchField==Latitude) ? "mean_latitude" : "mean_longitude", 0.000001, ">" ) )
+          return false;
+        answer.sql = "contained_gps <> 0 AND " + answer.sql;
+        break;
+        
+      case NeutronCountRate:
+      case GammaCountRate:
+        if( !numeric_test( "", 1.0E-6, ">" ) )
+          return false;
+        break;
+        
+      case StartTime:
+      {
+        if( m_time.is_special() )
+          return false;
+        
+        const boost::posix_time::ptime epoch(boost::gregorian::date(1970,1,1));
+        const boost::posix_time::time_duration::sec_type test_time = (m_time - epoch).total_seconds();
+        
+        string test;
+        switch( m_compareType )
+        {
+          case ValueIsExact:       test = "ABS(value - ?) < 60"; break;
+          case ValueIsNotEqual:    test = "ABS(value - ?) > 60"; break;
+          case ValueIsLessThan:    test = "value < ?";           break;
+          case ValueIsGreaterThan: test = "value > ?";           break;
+        }//switch( m_compareType )
+        
+        answer.sql = numeric_in + " AND " + test + ")";
+        answer.values.push_back( static_cast<long long>(m_searchField) );
+        answer.values.push_back( static_cast<long long>(test_time) );
+        break;
+      }//case StartTime:
+        
+      case NumFileDataFields:
+        answer.sql = "0";
+        break;
+    }//switch( m_searchField )
+    
+    //All tests fail for non-spectrum files, and NULL values (ex, NaN floats) should fail the test
+    cond.sql = "IFNULL(is_spectrum_file <> 0 AND " + answer.sql + ", 0)";
+    cond.values = std::move( answer.values );
+    
+    return true;
+  }//bool to_sql( SqlCondition &cond ) const
+  
+  
   
   const char *to_string( const FileDataField field )
   {
@@ -1563,6 +1933,19 @@ namespace SpecFileQuery
     return evaluate( m_fields, meas );
   }
   
+  
+  bool SpecLogicTest::to_sql( SqlCondition &definite, SqlCondition &possible ) const
+  {
+    if( !fields_to_sql( m_fields, 0, m_fields.size(), definite, possible ) )
+      return false;
+    
+    //evaluate(...) fails all entries that arent files, before anything else.
+    definite.sql = "is_file <> 0 AND " + definite.sql;
+    possible.sql = "is_file <> 0 AND " + possible.sql;
+    
+    return true;
+  }//bool to_sql( SqlCondition &definite, SqlCondition &possible ) const
+  
   void SpecLogicTest::isvalid()
   {
     if( m_fields.empty() )
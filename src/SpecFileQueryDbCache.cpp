@@ -24,6 +24,7 @@
 #include "InterSpec_config.h"
 
 #include <Wt/Utils>
+#include <Wt/WLogger>
 #include <Wt/Json/Value>
 #include <Wt/Json/Array>
 #include <Wt/Json/Parser>
@@ -50,6 +51,19 @@
 
 #include <boost/config.hpp>
 #include <boost/io/quoted.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/tuple/tuple.hpp>
+
+#if( defined(__linux__) && !ANDROID )
+#define USE_INOTIFY 1
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#else
+#define USE_INOTIFY 0
+#endif
 
 
 #if( defined(BOOST_NO_CXX11_HDR_CODECVT) )
@@ -115,6 +129,132 @@ namespace
     
     return true;
   }//xml_files_small_enough(...)
+  
+  
+  /** How long, in seconds, to wait after the last filesystem change before caching changed files;
+   files being copied in usually generate a number of events.
+   */
+  const double ns_watch_settle_seconds = 2.0;
+  
+  /** How often, in seconds, #SpecFileQueryDbCache::watch_directory re-scans the whole directory. */
+  const double ns_watch_rescan_seconds = 10.0*60.0;
+  
+  
+  /** Returns the modification time of a file, in seconds since the epoch, or zero on error. */
+  long long file_modification_time( const std::string &filepath )
+  {
+    boost::system::error_code ec;
+#ifdef _WIN32
+    const std::wstring wfilepath = SpecUtils::convert_from_utf8_to_utf16( filepath );
+    const std::time_t mtime = boost::filesystem::last_write_time( wfilepath, ec );
+#else
+    const std::time_t mtime = boost::filesystem::last_write_time( filepath, ec );
+#endif
+    
+    return ec ? 0 : static_cast<long long>( mtime );
+  }//file_modification_time(...)
+  
+  
+  /** Returns if the directory exists, and its contents can be listed; e.g., a network share that
+   has been unmounted will return false.
+   */
+  bool directory_is_readable( const std::string &dirpath )
+  {
+    if( !SpecUtils::is_directory( dirpath ) )
+      return false;
+    
+    boost::system::error_code ec;
+#ifdef _WIN32
+    const std::wstring wdirpath = SpecUtils::convert_from_utf8_to_utf16( dirpath );
+    boost::filesystem::directory_iterator iter( wdirpath, ec );
+#else
+    boost::filesystem::directory_iterator iter( dirpath, ec );
+#endif
+    
+    return !ec;
+  }//directory_is_readable(...)
+  
+  
+  /** Returns a FNV-1a hash of the files size, and its first and last 64 kb; reading the whole file
+   would be nearly as slow as parsing it, and this catches nearly all real modifications.
+   Returns zero on error.
+   */
+  long long fast_content_hash( const std::string &filepath )
+  {
+#ifdef _WIN32
+    const std::wstring wfilepath = SpecUtils::convert_from_utf8_to_utf16( filepath );
+    ifstream strm( wfilepath.c_str(), ios_base::binary|ios_base::in );
+#else
+    ifstream strm( filepath.c_str(), ios_base::binary|ios_base::in );
+#endif
+    
+    if( !strm.is_open() )
+      return 0;
+    
+    strm.seekg( 0, ios::end );
+    const std::streamoff filesize = strm.tellg();
+    strm.seekg( 0, ios::beg );
+    if( filesize < 0 )
+      return 0;
+    
+    uint64_t hash = 14695981039346656037ULL;
+    auto add_bytes = [&hash]( const char *data, const size_t len ){
+      for( size_t i = 0; i < len; ++i )
+      {
+        hash ^= static_cast<uint8_t>( data[i] );
+        hash *= 1099511628211ULL;
+      }
+    };
+    
+    const uint64_t size = static_cast<uint64_t>( filesize );
+    add_bytes( reinterpret_cast<const char *>(&size), sizeof(size) );
+    
+    const std::streamoff block_size = 64*1024;
+    vector<char> data( static_cast<size_t>( std::min( filesize, block_size ) ) );
+    if( !strm.read( data.data(), data.size() ) )
+      return 0;
+    add_bytes( data.data(), data.size() );
+    
+    if( filesize > block_size )
+    {
+      data.resize( static_cast<size_t>( std::min( filesize - block_size, block_size ) ) );
+      strm.seekg( filesize - static_cast<std::streamoff>(data.size()), ios::beg );
+      if( !strm.read( data.data(), data.size() ) )
+        return 0;
+      add_bytes( data.data(), data.size() );
+    }//if( filesize > block_size )
+    
+    //Zero means "unknown"
+    return (hash == 0) ? 1 : static_cast<long long>( hash );
+  }//fast_content_hash(...)
+  
+  
+  /** Adapts a std::function to a SpecUtils::file_match_function_t. */
+  bool call_file_filter( const std::string &filename, void *userdata )
+  {
+    const auto filter = static_cast<const std::function<bool(const std::string &)> *>( userdata );
+    return (*filter)( filename );
+  }//call_file_filter(...)
+  
+  
+  /** Adds the columns that were added to SpecFileInfoToQuery after the database may have been
+   persisted; errors (i.e., the column already exists) are ignored.
+   */
+  void add_missing_columns( Wt::Dbo::SqlConnection &db )
+  {
+    const char *columns[] = { "file_mtime", "content_hash" };
+    for( const char *col : columns )
+    {
+      try
+      {
+        db.executeSql( string("ALTER TABLE \"SpecFileInfoToQuery\" ADD COLUMN ")
+                       + col + " integer not null default 0" );
+      }catch( std::exception & )
+      {
+        //Column already exists
+      }
+    }//for( const char *col : columns )
+  }//void add_missing_columns( Wt::Dbo::SqlConnection &db )
 }//namespace
 
 
@@ -849,6 +989,7 @@ void SpecFileInfoToQuery::reset()
 {
   file_path.clear();
   file_size = file_path_hash = 0;
+  file_mtime = content_hash = 0;
   is_file = is_spectrum_file = is_event_xml_file = false;
   
   filename.clear();
@@ -895,6 +1036,8 @@ void SpecFileInfoToQuery::fill_info_from_file( const std::string filepath )
   
   file_size = SpecUtils::file_size(filepath);
   file_path_hash = std::hash<std::string>()(filepath);
+  file_mtime = file_modification_time( filepath );
+  content_hash = fast_content_hash( filepath );
   
   SpecUtils::SpecFile meas;
   const bool loaded = meas.load_file(filepath, SpecUtils::ParserType::Auto, filepath);
@@ -1072,7 +1215,9 @@ SpecFileQueryDbCache::SpecFileQueryDbCache( const bool use_db_caching,
   : m_use_db_caching( use_db_caching ),
     m_using_persist_caching( false ),
     m_fs_path( path ),
-    m_xmlfilters( xmlfilters )
+    m_have_query_values( false ),
+    m_xmlfilters( xmlfilters ),
+    m_stop_watching( false )
 {
   m_stop_caching = false;
   m_doing_caching = false;
@@ -1090,6 +1235,8 @@ SpecFileQueryDbCache::SpecFileQueryDbCache( const bool use_db_caching,
 
 SpecFileQueryDbCache::~SpecFileQueryDbCache()
 {
+  stop_watching();
+  
   if( m_use_db_caching )
   {
     std::unique_lock<std::mutex> lock( m_cv_mutex );
@@ -1133,11 +1280,14 @@ bool SpecFileQueryDbCache::open_db( const std::string &path, const bool create_t
     db_session->mapClass<SpecFileInfoToQuery>( "SpecFileInfoToQuery" );
     if( create_tables )
       db_session->createTables();
+    else
+      add_missing_columns( *db );
     
     m_use_db_caching = true;
     m_db_location = path;
     m_db_session = std::move( db_session );
     m_db = std::move( db );
+    m_have_query_values = init_query_value_tables();
   }catch( Wt::Dbo::Exception &e )
   {
     cerr << "Failed to create SpecFileQueryDbCache session, Dbo::Exception: " << e.what() << endl;
@@ -1186,6 +1336,7 @@ bool SpecFileQueryDbCache::init_existing_persisted_db()
     db->setProperty( "show-queries", "false" );
     db_session->setConnection( *db );
     db_session->mapClass<SpecFileInfoToQuery>( "SpecFileInfoToQuery" );
+    add_missing_columns( *db );
     
     
     //If there are any entries in the database, check the schema is okay by
@@ -1245,6 +1396,7 @@ bool SpecFileQueryDbCache::init_existing_persisted_db()
     m_db_session = std::move( db_session );
     m_db_location = persisted_path;
     m_using_persist_caching = true;
+    m_have_query_values = init_query_value_tables();
     return true;
   }catch( std::exception &e )
   {
@@ -1257,6 +1409,187 @@ bool SpecFileQueryDbCache::init_existing_persisted_db()
 }//bool init_existing_persisted_db()
 
 
+const char * const SpecFileQueryDbCache::sm_text_values_table = "SpecFileQueryTextValues";
+const char * const SpecFileQueryDbCache::sm_numeric_values_table = "SpecFileQueryNumericValues";
+
+
+bool SpecFileQueryDbCache::init_query_value_tables()
+{
+  if( !m_db || !m_db_session )
+    return false;
+  
+  const string text_table = sm_text_values_table;
+  const string numeric_table = sm_numeric_values_table;
+  
+  try
+  {
+    Wt::Dbo::Transaction trans( *m_db_session );
+    
+    const int have_tables = m_db_session->query<int>( "select count(1) from sqlite_master" )
+                              .where( "type = 'table' AND (name = ? OR name = ?)" )
+                              .bind( text_table ).bind( numeric_table ).resultValue();
+    
+    if( have_tables == 2 )
+    {
+      trans.commit();
+      return true;
+    }
+    
+    const double start_time = SpecUtils::get_wall_time();
+    
+    // The COLLATE NOCASE lets SQLite use the index for case-insensitive LIKE prefix searches.
+    m_db_session->execute( "DROP TABLE IF EXISTS " + text_table ).run();
+    m_db_session->execute( "DROP TABLE IF EXISTS " + numeric_table ).run();
+    m_db_session->execute( "CREATE TABLE " + text_table + " (file_path_hash INTEGER NOT NULL,"
+                           " field INTEGER NOT NULL, value TEXT NOT NULL COLLATE NOCASE)" ).run();
+    m_db_session->execute( "CREATE TABLE " + numeric_table + " (file_path_hash INTEGER NOT NULL,"
+                           " field INTEGER NOT NULL, value REAL)" ).run();
+    m_db_session->execute( "CREATE INDEX " + text_table + "_value ON "
+                           + text_table + " (field, value)" ).run();
+    m_db_session->execute( "CREATE INDEX " + text_table + "_file ON "
+                           + text_table + " (file_path_hash)" ).run();
+    m_db_session->execute( "CREATE INDEX " + numeric_table + "_value ON "
+                           + numeric_table + " (field, value)" ).run();
+    m_db_session->execute( "CREATE INDEX " + numeric_table + "_file ON "
+                           + numeric_table + " (file_path_hash)" ).run();
+    
+    // Indexes for the more commonly searched single-valued fields.
+    m_db_session->execute( "CREATE INDEX IF NOT EXISTS SpecFileInfoToQuery_detector_type ON"
+                           " \"SpecFileInfoToQuery\" (detector_type)" ).run();
+    m_db_session->execute( "CREATE INDEX IF NOT EXISTS SpecFileInfoToQuery_total_livetime ON"
+                           " \"SpecFileInfoToQuery\" (total_livetime)" ).run();
+    m_db_session->execute( "CREATE INDEX IF NOT EXISTS SpecFileInfoToQuery_total_realtime ON"
+                           " \"SpecFileInfoToQuery\" (total_realtime)" ).run();
+    
+    m_have_query_values = true;
+    
+    // If this is a database persisted before these tables existed, fill them out; this is a
+    //  one-time cost about equal to a single search of the cached files.
+    size_t nentries = 0;
+    auto results = m_db_session->find<SpecFileInfoToQuery>().resultList();
+    for( Dbo::collection<Dbo::ptr<SpecFileInfoToQuery>>::const_iterator iter = results.begin();
+        iter != results.end(); ++iter )
+    {
+      add_query_values( **iter );
+      ++nentries;
+    }
+    
+    trans.commit();
+    
+    if( nentries )
+      Wt::log("debug") << "Created file query value tables for " << nentries
+                       << " existing entries in " << (SpecUtils::get_wall_time() - start_time)
+                       << " seconds";
+    
+    return true;
+  }catch( std::exception &e )
+  {
+    cerr << "Failed to create file query value tables: " << e.what() << endl;
+  }
+  
+  m_have_query_values = false;
+  
+  return false;
+}//bool init_query_value_tables()
+
+
+void SpecFileQueryDbCache::add_query_values( const SpecFileInfoToQuery &info )
+{
+  using namespace SpecFileQuery;
+  
+  if( !m_have_query_values || !m_db_session )
+    return;
+  
+  const long long hash = info.file_path_hash;
+  const string text_insert = "INSERT INTO " + string(sm_text_values_table)
+                             + " (file_path_hash, field, value) VALUES (?, ?, ?)";
+  const string numeric_insert = "INSERT INTO " + string(sm_numeric_values_table)
+                                + " (file_path_hash, field, value) VALUES (?, ?, ?)";
+  
+  auto add_text = [&]( const FileDataField field, const std::string &value ){
+    m_db_session->execute( text_insert ).bind( hash ).bind( static_cast<int>(field) ).bind( value ).run();
+  };
+  
+  auto add_numeric = [&]( const FileDataField field, const double value ){
+    m_db_session->execute( numeric_insert ).bind( hash ).bind( static_cast<int>(field) ).bind( value ).run();
+  };
+  
+  // The single-valued string fields always get a row, so a search for an empty string will
+  //  match them, the same as SpecFileQuery::SpecTest::test_string(...)
+  add_text( FileDataField::ParentPath, SpecUtils::parent_path(info.filename) );
+  add_text( FileDataField::Filename, info.filename );
+  add_text( FileDataField::SerialNumber, info.serial_number );
+  add_text( FileDataField::Manufacturer, info.manufacturer );
+  add_text( FileDataField::Model, info.model );
+  add_text( FileDataField::Uuid, info.uuid );
+  add_text( FileDataField::LocationName, info.location_name );
+  
+  for( const string &name : info.detector_names )
+    add_text( FileDataField::DetectorName, name );
+  
+  set<string> remarks = info.file_remarks;
+  remarks.insert( begin(info.record_remarks), end(info.record_remarks) );
+  for( const string &remark : remarks )
+    add_text( FileDataField::Remark, remark );
+  
+  if( info.has_riid_analysis )
+  {
+    // Same strings SpecTest::test(...) searches for the AnalysisResultText field.
+    const SpecUtils::DetectorAnalysis &ana = info.riid_ana;
+    set<string> values{ ana.algorithm_name_ };
+    for( const auto &nv : ana.algorithm_component_versions_ )
+    {
+      values.insert( nv.first );
+      values.insert( nv.second );
+    }
+    values.insert( begin(ana.remarks_), end(ana.remarks_) );
+    for( const SpecUtils::DetectorAnalysisResult &r : ana.results_ )
+    {
+      values.insert( r.detector_ );
+      values.insert( r.id_confidence_ );
+      values.insert( r.nuclide_ );
+      values.insert( r.nuclide_type_ );
+      values.insert( r.remark_ );
+    }
+    
+    for( const string &value : values )
+      add_text( FileDataField::AnalysisResultText, value );
+  }//if( info.has_riid_analysis )
+  
+  for( const SpecUtils::EnergyCalType type : info.energy_cal_types )
+    add_numeric( FileDataField::EnergyCalibrationType, static_cast<int>(type) );
+  for( const float lt : info.individual_spectrum_live_time )
+    add_numeric( FileDataField::IndividualSpectrumLiveTime, lt );
+  for( const float rt : info.individual_spectrum_real_time )
+    add_numeric( FileDataField::IndividualSpectrumRealTime, rt );
+  for( const size_t nchannel : info.number_of_gamma_channels )
+  {
+    if( nchannel ) //SpecTest::test(...) skips zero channel measurements
+      add_numeric( FileDataField::NumberOfGammaChannels, static_cast<double>(nchannel) );
+  }
+  for( const float energy : info.max_gamma_energy )
+    add_numeric( FileDataField::MaximumGammaEnergy, energy );
+  for( const float cps : info.neutron_count_rate )
+    add_numeric( FileDataField::NeutronCountRate, cps );
+  for( const float cps : info.gamma_count_rate )
+    add_numeric( FileDataField::GammaCountRate, cps );
+  for( const std::time_t t : info.start_times )
+    add_numeric( FileDataField::StartTime, static_cast<double>(t) );
+}//void add_query_values( const SpecFileInfoToQuery &info )
+
+
+void SpecFileQueryDbCache::remove_query_values( const long long file_path_hash )
+{
+  if( !m_have_query_values || !m_db_session )
+    return;
+  
+  m_db_session->execute( "DELETE FROM " + string(sm_text_values_table) + " WHERE file_path_hash = ?" )
+    .bind( file_path_hash ).run();
+  m_db_session->execute( "DELETE FROM " + string(sm_numeric_values_table) + " WHERE file_path_hash = ?" )
+    .bind( file_path_hash ).run();
+}//void remove_query_values( const long long file_path_hash )
+
+
 #if( PERFORM_DEVELOPER_CHECKS )
 bool operator==( const SpecFileInfoToQuery &lhs, const SpecFileInfoToQuery &rhs )
 {
@@ -1266,6 +1599,10 @@ bool operator==( const SpecFileInfoToQuery &lhs, const SpecFileInfoToQuery &rhs
     return false;
   if( rhs.file_path_hash != lhs.file_path_hash )
     return false;
+  if( rhs.file_mtime != lhs.file_mtime )
+    return false;
+  if( rhs.content_hash != lhs.content_hash )
+    return false;
   if( rhs.is_file != lhs.is_file )
     return false;
   if( rhs.is_spectrum_file != lhs.is_spectrum_file )
@@ -1391,87 +1728,438 @@ void SpecFileQueryDbCache::cache_results( const std::vector<std::string> &&files
       }
     }//end lock on m_cv_mutex
     
-    try
-    {
-      {//begin lock on m_db_mutex
-        std::lock_guard<std::mutex> lock( m_db_mutex );
-        
-        const long long filenamehash = static_cast<long long>( std::hash<std::string>()(filename) );
-        const size_t filesize = SpecUtils::file_size(filename);
-        
-        Wt::Dbo::Transaction trans( *m_db_session );
-        auto results = m_db_session->find<SpecFileInfoToQuery>().where( "file_path_hash = ?" ).bind(filenamehash).resultList();
-        
-        bool have_in_db = false;
-        if( results.size() == 1 )
-        {
-          have_in_db = (results.front()->file_size == static_cast<long long>(filesize));
-          if( !have_in_db )
-            results.front().remove();
-        }if( results.size() > 1 )
+    cache_file( filename );
+  }//for( const string filename : files )
+  
+  
+  {//begin lock on m_cv_mutex
+    std::lock_guard<std::mutex> lock( m_cv_mutex );
+    m_doing_caching = false;
+    m_cv.notify_all();
+  }//end lock on m_cv_mutex
+}//void cache_results()
+
+
+void SpecFileQueryDbCache::cache_file( const std::string &filename )
+{
+  if( !m_use_db_caching || !SpecUtils::is_file(filename) )
+    return;
+  
+  try
+  {
+    {//begin lock on m_db_mutex
+      std::lock_guard<std::mutex> lock( m_db_mutex );
+      
+      if( !m_db || !m_db_session )
+        return;
+      
+      const long long filenamehash = static_cast<long long>( std::hash<std::string>()(filename) );
+      
+      Wt::Dbo::Transaction trans( *m_db_session );
+      auto results = m_db_session->find<SpecFileInfoToQuery>().where( "file_path_hash = ?" ).bind(filenamehash).resultList();
+      
+      bool have_in_db = false;
+      if( results.size() == 1 )
+      {
+        Wt::Dbo::ptr<SpecFileInfoToQuery> entry = results.front();
+        have_in_db = entry_is_current( entry, filename );
+        if( !have_in_db )
         {
-          for( auto p : results )
-            p.remove();
+          entry.remove();
+          remove_query_values( filenamehash );
         }
-        
-        if( have_in_db )
-          continue;
-        trans.commit();
-      }//end lock on m_db_mutex
+      }if( results.size() > 1 )
+      {
+        for( auto p : results )
+          p.remove();
+        remove_query_values( filenamehash );
+      }
       
-      auto dbinforaw = new SpecFileInfoToQuery();;
-      Wt::Dbo::ptr<SpecFileInfoToQuery> dbinfo( dbinforaw );
-      dbinforaw->fill_info_from_file(filename);
-      dbinforaw->fill_event_xml_filter_values(filename,m_xmlfilters);
+      trans.commit();
       
-      {//begin lock on m_db_mutex
-        std::lock_guard<std::mutex> lock( m_db_mutex );
-        Wt::Dbo::Transaction trans( *m_db_session );
-        
-        //We could be adding this file info uncessarily to the database, but I think end-logic will be fine...
-        m_db_session->add( dbinfo );
-        
-        trans.commit();
-      }//end lock on m_db_mutex
+      if( have_in_db )
+        return;
+    }//end lock on m_db_mutex
+    
+    auto dbinforaw = new SpecFileInfoToQuery();;
+    Wt::Dbo::ptr<SpecFileInfoToQuery> dbinfo( dbinforaw );
+    dbinforaw->fill_info_from_file(filename);
+    dbinforaw->fill_event_xml_filter_values(filename,m_xmlfilters);
+    
+    {//begin lock on m_db_mutex
+      std::lock_guard<std::mutex> lock( m_db_mutex );
+      Wt::Dbo::Transaction trans( *m_db_session );
       
+      //We could be adding this file info uncessarily to the database, but I think end-logic will be fine...
+      m_db_session->add( dbinfo );
+      add_query_values( *dbinfo );
+      
+      trans.commit();
+    }//end lock on m_db_mutex
+    
 #if( PERFORM_DEVELOPER_CHECKS )
-      {//Begin check we can read back in the identical object from the database
-        std::lock_guard<std::mutex> lock( m_db_mutex );
-        
-        Wt::Dbo::Transaction trans( *m_db_session );
-        auto results = m_db_session->find<SpecFileInfoToQuery>().where( "file_path_hash = ?" ).bind(dbinfo->file_path_hash).resultList();
-        if( !results.size() )
-        {
-          log_developer_error( __func__, "Failed to find SpecFileInfoToQuery I just saved!!  Programming logic error." );
-        }else
+    {//Begin check we can read back in the identical object from the database
+      std::lock_guard<std::mutex> lock( m_db_mutex );
+      
+      Wt::Dbo::Transaction trans( *m_db_session );
+      auto results = m_db_session->find<SpecFileInfoToQuery>().where( "file_path_hash = ?" ).bind(dbinfo->file_path_hash).resultList();
+      if( !results.size() )
+      {
+        log_developer_error( __func__, "Failed to find SpecFileInfoToQuery I just saved!!  Programming logic error." );
+      }else
+      {
+        auto fromdb = results.front();
+        if( !((*fromdb) == (*dbinfo)) )
         {
-          auto fromdb = results.front();
-          if( !((*fromdb) == (*dbinfo)) )
-          {
-            log_developer_error( __func__, "The SpecFileInfoToQuery from database is not equal to the one saved to database!  Programming logic error." );
-          }
+          log_developer_error( __func__, "The SpecFileInfoToQuery from database is not equal to the one saved to database!  Programming logic error." );
         }
-        trans.commit();
-      }//End check we can read back in the identical object from the database
+      }
+      trans.commit();
+    }//End check we can read back in the identical object from the database
 #endif
-    }catch( Wt::Dbo::Exception &e )
-    {
-      //I think we get here mostly when an entry for a particular hash is already
-      //  in the database.
-      cerr << "Dbo::Exception caching spec files to database - oh well: " << e.what() << endl;
-    }catch( std::exception &e )
+  }catch( Wt::Dbo::Exception &e )
+  {
+    //I think we get here mostly when an entry for a particular hash is already
+    //  in the database.
+    cerr << "Dbo::Exception caching spec files to database - oh well: " << e.what() << endl;
+  }catch( std::exception &e )
+  {
+    cerr << "std::exception caching spec files to database - oh well: " << e.what() << endl;
+  }
+}//void cache_file( const std::string &filename )
+
+
+void SpecFileQueryDbCache::remove_cached_file( const std::string &filepath )
+{
+  if( !m_use_db_caching )
+    return;
+  
+  try
+  {
+    std::lock_guard<std::mutex> lock( m_db_mutex );
+    
+    if( !m_db || !m_db_session )
+      return;
+    
+    const long long filenamehash = static_cast<long long>( std::hash<std::string>()(filepath) );
+    
+    Wt::Dbo::Transaction trans( *m_db_session );
+    auto results = m_db_session->find<SpecFileInfoToQuery>().where( "file_path_hash = ?" ).bind(filenamehash).resultList();
+    bool removed = false;
+    for( auto p : results )
     {
-      cerr << "std::exception caching spec files to database - oh well: " << e.what() << endl;
+      p.remove();
+      removed = true;
     }
-  }//for( const string filename : files )
+    if( removed )
+      remove_query_values( filenamehash );
+    trans.commit();
+  }catch( std::exception &e )
+  {
+    cerr << "Exception removing '" << filepath << "' from cache: " << e.what() << endl;
+  }
+}//void remove_cached_file( const std::string &filepath )
+
+
+bool SpecFileQueryDbCache::entry_is_current( Wt::Dbo::ptr<SpecFileInfoToQuery> &entry,
+                                             const std::string &filepath )
+{
+  const long long filesize = static_cast<long long>( SpecUtils::file_size(filepath) );
+  if( !entry || (entry->file_size != filesize) )
+    return false;
+  
+  const long long mtime = file_modification_time( filepath );
+  if( mtime && (entry->file_mtime == mtime) )
+    return true;
+  
+  //The modification time has changed (or we didnt know it); the file may have just been touched
+  //  or copied, so check the contents before we go through re-parsing it.
+  const long long hash = fast_content_hash( filepath );
+  if( !hash )
+    return false;
+  
+  //Entries cached before we tracked modification times only had their file size checked, so
+  //  we'll keep that behavior for them, but start tracking their modification time and contents.
+  if( entry->content_hash && (entry->content_hash != hash) )
+    return false;
+  
+  SpecFileInfoToQuery *info = entry.modify();
+  info->file_mtime = mtime;
+  info->content_hash = hash;
   
+  return true;
+}//bool entry_is_current(...)
+
+
+void SpecFileQueryDbCache::start_watching( const bool recursive,
+                                           std::function<bool(const std::string &)> filter )
+{
+  stop_watching();
+  
+  if( !m_use_db_caching || !filter )
+    return;
   
   {//begin lock on m_cv_mutex
+    //If caching was stopped (e.g., the user changed directories) while the initial caching was
+    //  happening, we shouldnt start watching.
     std::lock_guard<std::mutex> lock( m_cv_mutex );
-    m_doing_caching = false;
-    m_cv.notify_all();
+    if( m_stop_caching )
+      return;
   }//end lock on m_cv_mutex
-}//void cache_results()
+  
+  std::lock_guard<std::mutex> lock( m_watch_mutex );
+  m_stop_watching = false;
+  m_watch_thread = std::thread( &SpecFileQueryDbCache::watch_directory, this, recursive, filter );
+}//void start_watching(...)
+
+
+void SpecFileQueryDbCache::stop_watching()
+{
+  std::thread watcher;
+  
+  {
+    std::lock_guard<std::mutex> lock( m_watch_mutex );
+    m_stop_watching = true;
+    watcher = std::move( m_watch_thread );
+  }
+  
+  m_watch_cv.notify_all();
+  
+  if( watcher.joinable() )
+    watcher.join();
+}//void stop_watching()
+
+
+void SpecFileQueryDbCache::rescan_directory( const bool recursive,
+                                             const std::function<bool(const std::string &)> &filter )
+{
+  auto should_stop = [this]() -> bool {
+    std::lock_guard<std::mutex> lock( m_watch_mutex );
+    return m_stop_watching;
+  };
+  
+  void *filter_ptr = const_cast<void *>( static_cast<const void *>( &filter ) );
+  const vector<string> files = recursive
+                             ? SpecUtils::recursive_ls( m_fs_path, &call_file_filter, filter_ptr )
+                             : SpecUtils::ls_files_in_directory( m_fs_path, &call_file_filter, filter_ptr );
+  
+  for( const string &filename : files )
+  {
+    if( should_stop() )
+      return;
+    cache_file( filename );
+  }
+  
+  //Remove entries for files that have been deleted, or that no longer pass the filter.  We check
+  //  each file, rather than if it was in the listing, so that an empty listing (e.g., the share
+  //  was unmounted), or a non-recursive listing, doesnt remove valid entries.
+  if( !directory_is_readable( m_fs_path ) )
+    return;
+  
+  vector<string> cached_files;
+  try
+  {
+    std::lock_guard<std::mutex> lock( m_db_mutex );
+    if( !m_db || !m_db_session )
+      return;
+    
+    Wt::Dbo::Transaction trans( *m_db_session );
+    Dbo::collection<std::string> paths = m_db_session->query<std::string>(
+                                         "select file_path from \"SpecFileInfoToQuery\"" ).resultList();
+    for( Dbo::collection<std::string>::const_iterator iter = paths.begin(); iter != paths.end(); ++iter )
+      cached_files.push_back( *iter );
+    trans.commit();
+  }catch( std::exception &e )
+  {
+    cerr << "Failed to get cached files during rescan: " << e.what() << endl;
+    return;
+  }
+  
+  const std::set<string> current_files( begin(files), end(files) );
+  for( const string &filename : cached_files )
+  {
+    if( should_stop() )
+      return;
+    
+    if( current_files.count(filename) )
+      continue;
+    
+    if( !SpecUtils::is_file(filename) || !filter(filename) )
+      remove_cached_file( filename );
+  }//for( const string &filename : cached_files )
+}//void rescan_directory(...)
+
+
+void SpecFileQueryDbCache::watch_directory( const bool recursive,
+                                            const std::function<bool(const std::string &)> filter )
+{
+  // Files that have changed, or been removed, but we are waiting for changes to settle down before
+  //  acting on them, since files being copied in often generate multiple events.
+  std::set<string> changed_files, removed_files;
+  bool need_rescan = false;
+  double last_event_time = SpecUtils::get_wall_time();
+  double last_rescan_time = last_event_time;
+  
+#if( USE_INOTIFY )
+  const int inotify_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+  if( inotify_fd < 0 )
+    cerr << "Failed to initialize inotify: " << strerror(errno) << "; will only periodically re-scan '"
+         << m_fs_path << "'." << endl;
+  
+  std::map<int,string> watched_dirs;
+  
+  auto add_watches = [&]( const string &dir ){
+    if( inotify_fd < 0 )
+      return;
+    
+    vector<string> dirs{ dir };
+    if( recursive )
+    {
+      boost::system::error_code ec;
+      boost::filesystem::recursive_directory_iterator iter( dir, ec ), iter_end;
+      for( ; !ec && (iter != iter_end); iter.increment(ec) )
+      {
+        if( boost::filesystem::is_directory( iter->status() )
+            && !boost::filesystem::is_symlink( iter->symlink_status() ) )
+          dirs.push_back( iter->path().string<std::string>() );
+      }
+    }//if( recursive )
+    
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE;
+    for( const string &d : dirs )
+    {
+      const int wd = inotify_add_watch( inotify_fd, d.c_str(), mask );
+      if( wd >= 0 )
+        watched_dirs[wd] = d;
+      else
+        cerr << "Failed to watch '" << d << "': " << strerror(errno) << endl;
+    }
+  };//add_watches lambda
+  
+  add_watches( m_fs_path );
+  
+  alignas(struct inotify_event) char buffer[16*1024];
+#endif //USE_INOTIFY
+  
+  while( true )
+  {
+#if( USE_INOTIFY )
+    if( inotify_fd >= 0 )
+    {
+      struct pollfd pfd;
+      pfd.fd = inotify_fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      
+      const int npoll = poll( &pfd, 1, 1000 );
+      
+      ssize_t len = 0;
+      while( (npoll > 0) && ((len = read( inotify_fd, buffer, sizeof(buffer) )) > 0) )
+      {
+        last_event_time = SpecUtils::get_wall_time();
+        
+        for( char *ptr = buffer; ptr < (buffer + len); )
+        {
+          const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>( ptr );
+          ptr += sizeof(struct inotify_event) + event->len;
+          
+          if( event->mask & IN_Q_OVERFLOW )
+          {
+            need_rescan = true;
+            continue;
+          }
+          
+          const auto dir_pos = watched_dirs.find( event->wd );
+          if( dir_pos == end(watched_dirs) )
+            continue;
+          
+          if( event->mask & IN_IGNORED )
+          {
+            watched_dirs.erase( dir_pos );
+            continue;
+          }
+          
+          if( !event->len )
+            continue;
+          
+          const string path = SpecUtils::append_path( dir_pos->second, event->name );
+          
+          if( event->mask & IN_ISDIR )
+          {
+            if( event->mask & (IN_CREATE | IN_MOVED_TO) )
+            {
+              //A directory moved in may already have files in it
+              if( recursive )
+              {
+                add_watches( path );
+                for( const string &f : SpecUtils::recursive_ls( path, &call_file_filter,
+                                               const_cast<void *>( static_cast<const void *>(&filter) ) ) )
+                  changed_files.insert( f );
+              }
+            }else if( event->mask & (IN_DELETE | IN_MOVED_FROM) )
+            {
+              need_rescan |= recursive;
+            }
+          }else if( event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO) )
+          {
+            removed_files.erase( path );
+            changed_files.insert( path );
+          }else if( event->mask & (IN_DELETE | IN_MOVED_FROM) )
+          {
+            changed_files.erase( path );
+            removed_files.insert( path );
+          }
+        }//for( loop over events )
+      }//while( read events )
+    }else
+#endif //USE_INOTIFY
+    {
+      std::unique_lock<std::mutex> lock( m_watch_mutex );
+      m_watch_cv.wait_for( lock, std::chrono::seconds(1), [this](){ return m_stop_watching; } );
+    }
+    
+    {
+      std::lock_guard<std::mutex> lock( m_watch_mutex );
+      if( m_stop_watching )
+        break;
+    }
+    
+    const double now = SpecUtils::get_wall_time();
+    const bool settled = ((now - last_event_time) > ns_watch_settle_seconds);
+    
+    if( settled || ((changed_files.size() + removed_files.size()) > 1000) )
+    {
+      for( const string &filename : removed_files )
+        remove_cached_file( filename );
+      removed_files.clear();
+      
+      for( const string &filename : changed_files )
+      {
+        {
+          std::lock_guard<std::mutex> lock( m_watch_mutex );
+          if( m_stop_watching )
+            break;
+        }
+        
+        if( filter( filename ) )
+          cache_file( filename );
+      }//for( const string &filename : changed_files )
+      changed_files.clear();
+    }//if( time to process changes )
+    
+    if( (settled && need_rescan) || ((now - last_rescan_time) > ns_watch_rescan_seconds) )
+    {
+      rescan_directory( recursive, filter );
+      need_rescan = false;
+      last_rescan_time = SpecUtils::get_wall_time();
+    }
+  }//while( true )
+  
+#if( USE_INOTIFY )
+  if( inotify_fd >= 0 )
+    close( inotify_fd );
+#endif
+}//void watch_directory(...)
 
 
 void SpecFileQueryDbCache::stop_caching()
@@ -1653,7 +2341,6 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
   }
   
   const long long filenamehash = static_cast<long long>( std::hash<std::string>()(filepath) );
-  const size_t filesize = SpecUtils::file_size(filepath);
   
   try
   {
@@ -1673,15 +2360,22 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
       if( results.size() == 1 )
       {
         Wt::Dbo::ptr<SpecFileInfoToQuery> c = results.front();
-        if( c->file_size == filesize )
+        if( entry_is_current( c, filepath ) )
         {
           *info = *c;
+          trans.commit(); //entry_is_current may have updated the modification time
           return info;
         }
+        
+        //File has changed since we cached it
+        c.remove();
+        remove_query_values( filenamehash );
       }else
       {
         for( auto p : results )
           p.remove();
+        if( !results.empty() )
+          remove_query_values( filenamehash );
       }
       trans.commit();
     }//end check in DB
@@ -1699,6 +2393,7 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
       Wt::Dbo::Transaction trans( *m_db_session );
       
       m_db_session->add( dbinfo );
+      add_query_values( *dbinfo );
       trans.commit();
     }//end check in DB
   }catch( Wt::Dbo::Exception &e )
@@ -1718,4 +2413,102 @@ std::unique_ptr<SpecFileInfoToQuery> SpecFileQueryDbCache::spec_file_info( const
 }//SpecFileInfoToQuery spec_file_info( const std::string &filepath )
 
 
+const SpecFileQueryDbCache::PrefilterResults::Entry *
+SpecFileQueryDbCache::PrefilterResults::find( const std::string &filepath ) const
+{
+  const long long filenamehash = static_cast<long long>( std::hash<std::string>()(filepath) );
+  const auto pos = entries.find( filenamehash );
+  if( pos == end(entries) )
+    return nullptr;
+  
+  const long long filesize = static_cast<long long>( SpecUtils::file_size(filepath) );
+  if( (pos->second.file_size != filesize)
+     || (pos->second.file_mtime != file_modification_time(filepath)) )
+    return nullptr;
+  
+  return &(pos->second);
+}//PrefilterResults::find(...)
+
 
+std::unique_ptr<SpecFileQueryDbCache::PrefilterResults>
+                    SpecFileQueryDbCache::prefilter( const SpecFileQuery::SpecLogicTest &query )
+{
+  typedef PrefilterResults::Result Result;
+  
+  if( !m_use_db_caching )
+    return nullptr;
+  
+  SpecFileQuery::SqlCondition definite, possible;
+  if( !query.to_sql( definite, possible ) )
+    return nullptr;
+  
+  //If every test could be done in SQL, the two conditions are the same
+  const bool exact = (definite.sql == possible.sql);
+  
+  std::unique_ptr<PrefilterResults> answer( new PrefilterResults() );
+  
+  try
+  {
+    std::lock_guard<std::mutex> lock( m_db_mutex );
+    
+    if( !m_db || !m_db_session || !m_have_query_values )
+      return nullptr;
+    
+    const double start_time = SpecUtils::get_wall_time();
+    
+    Wt::Dbo::Transaction trans( *m_db_session );
+    
+    typedef boost::tuple<long long, long long, long long, bool, std::string> EntryRow;
+    Dbo::collection<EntryRow> rows = m_db_session->query<EntryRow>(
+                "select file_path_hash, file_size, file_mtime, is_spectrum_file, uuid"
+                " from \"SpecFileInfoToQuery\"" ).resultList();
+    for( Dbo::collection<EntryRow>::const_iterator iter = rows.begin(); iter != rows.end(); ++iter )
+    {
+      PrefilterResults::Entry &entry = answer->entries[boost::get<0>(*iter)];
+      entry.file_size = boost::get<1>(*iter);
+      entry.file_mtime = boost::get<2>(*iter);
+      entry.is_spectrum_file = boost::get<3>(*iter);
+      entry.uuid = boost::get<4>(*iter);
+      entry.result = Result::Fail;
+    }
+    
+    auto mark_matching = [&]( const SpecFileQuery::SqlCondition &cond, const Result result ){
+      Dbo::Query<long long> q = m_db_session->query<long long>(
+                                  "select file_path_hash from \"SpecFileInfoToQuery\"" ).where( cond.sql );
+      for( const boost::any &value : cond.values )
+      {
+        if( const double *d = boost::any_cast<double>( &value ) )
+          q.bind( *d );
+        else if( const long long *i = boost::any_cast<long long>( &value ) )
+          q.bind( *i );
+        else if( const std::string *str = boost::any_cast<std::string>( &value ) )
+          q.bind( *str );
+        else
+          throw runtime_error( "Unexpected SQL value type" );
+      }//for( const boost::any &value : cond.values )
+      
+      Dbo::collection<long long> hashes = q.resultList();
+      for( Dbo::collection<long long>::const_iterator iter = hashes.begin(); iter != hashes.end(); ++iter )
+      {
+        const auto pos = answer->entries.find( *iter );
+        if( pos != end(answer->entries) )
+          pos->second.result = result;
+      }
+    };//mark_matching lambda
+    
+    mark_matching( possible, (exact ? Result::Pass : Result::Undetermined) );
+    if( !exact )
+      mark_matching( definite, Result::Pass );
+    
+    trans.commit();
+    
+    Wt::log("debug") << "Prefiltered " << answer->entries.size() << " cached files in "
+                     << (SpecUtils::get_wall_time() - start_time) << " seconds";
+  }catch( std::exception &e )
+  {
+    cerr << "Failed to prefilter query using database: " << e.what() << endl;
+    return nullptr;
+  }
+  
+  return answer;
+}//prefilter(...)
@@ -23,11 +23,14 @@
 
 #include "InterSpec_config.h"
 
+#include <deque>
 #include <mutex>
 #include <atomic>
 #include <cerrno>
 #include <limits>
+#include <thread>
 #include <sstream>
+#include <condition_variable>
 
 #include <boost/regex.hpp>
 #include <boost/filesystem.hpp>
@@ -2009,7 +2012,10 @@ void SpecFileQueryWidget::basePathChanged()
   for( auto &i : m_path_caches )
   {
     if( i.second )
+    {
       i.second->stop_caching();
+      i.second->stop_watching();
+    }
   }
   
   const bool cache_in_db = m_cacheParseResults->isChecked();
@@ -2177,7 +2183,15 @@ void SpecFileQueryWidget::updateNumberFiles( const string srcdir,
   }
 
   if( database && database->caching_enabled() )
+  {
     database->cache_results( std::move(files) );
+    
+    //Keep the cache up to date as files are added or changed, so searches arent stale
+    if( !(*widgetdeleted) )
+      database->start_watching( recursive, [filterfcn,maxsize]( const std::string &filename ) -> bool {
+        return filterfcn( filename, (void *)&maxsize );
+      } );
+  }//if( database && database->caching_enabled() )
 }//updateNumberFiles
 
 
@@ -2445,16 +2459,114 @@ void SpecFileQueryWidget::updateSearchStatus( const size_t nfilestotal,
 
 
 
+namespace
+{
+  /** A fixed-capacity, multi-producer, multi-consumer queue used to connect the stages of the file
+   search; producers block when the queue is full, so the directory walk cant get arbitrarily far
+   ahead of the parsing.
+   */
+  template<class T>
+  class BoundedQueue
+  {
+  public:
+    explicit BoundedQueue( const size_t capacity )
+      : m_capacity( std::max( capacity, size_t(1) ) ),
+        m_closed( false )
+    {
+    }
+    
+    /** Waits up to `timeout` for room in the queue, returning false if there still was not room.
+     Throws if the queue has been closed.
+     */
+    bool push_for( const T &value, const std::chrono::milliseconds timeout )
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      if( !m_not_full.wait_for( lock, timeout, [this](){
+        return m_closed || (m_queue.size() < m_capacity); } ) )
+        return false;
+      
+      if( m_closed )
+        throw std::logic_error( "BoundedQueue closed" );
+      
+      m_queue.push_back( value );
+      lock.unlock();
+      m_not_empty.notify_one();
+      
+      return true;
+    }//push_for(...)
+    
+    /** Waits until there is a value, or queue is closed and empty; returns false in the latter case. */
+    bool pop( T &value )
+    {
+      std::unique_lock<std::mutex> lock( m_mutex );
+      m_not_empty.wait( lock, [this](){ return m_closed || !m_queue.empty(); } );
+      
+      if( m_queue.empty() )
+        return false;
+      
+      value = std::move( m_queue.front() );
+      m_queue.pop_front();
+      lock.unlock();
+      m_not_full.notify_one();
+      
+      return true;
+    }//pop(...)
+    
+    /** Causes pop() to return false once queue is empty, and pushes to throw. */
+    void close()
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_closed = true;
+      }
+      m_not_empty.notify_all();
+      m_not_full.notify_all();
+    }//close()
+    
+    /** Removes all values not yet popped. */
+    void clear()
+    {
+      {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_queue.clear();
+      }
+      m_not_full.notify_all();
+    }//clear()
+    
+  private:
+    const size_t m_capacity;
+    bool m_closed;
+    std::deque<T> m_queue;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+  };//class BoundedQueue
+}//namespace
+
+
 void testfile( const string &filename, vector<string> &result,
                const SpecFileQuery::SpecLogicTest &query,
                HaveSeenUuid &uniquecheck,
                std::shared_ptr< SpecFileQueryDbCache > database,
+               const SpecFileQueryDbCache::PrefilterResults *prefilter,
                const string &base_search_dir )
 {
+  typedef SpecFileQueryDbCache::PrefilterResults::Result PrefilterResult;
+  
   try
   {
     result.clear();
     
+    //If the file was already tested by the database, we can avoid retrieving it when it fails
+    const SpecFileQueryDbCache::PrefilterResults::Entry *cached
+                                             = prefilter ? prefilter->find( filename ) : nullptr;
+    if( cached && (cached->result == PrefilterResult::Fail) )
+    {
+      if( cached->is_spectrum_file )
+        uniquecheck.have_seen( cached->uuid );
+      return;
+    }//if( we know the file fails the test )
+    
     std::unique_ptr<SpecFileInfoToQuery> db_test_info = database->spec_file_info( filename );
     
     if( !db_test_info || !db_test_info->is_spectrum_file /*&& !db_test_info.is_event_xml_file*/ )
@@ -2463,7 +2575,8 @@ void testfile( const string &filename, vector<string> &result,
     if( uniquecheck.have_seen( db_test_info->uuid ) )
       return;
     
-    const bool testresult = query.test( *db_test_info );
+    const bool testresult = (cached && (cached->result == PrefilterResult::Pass))
+                            || query.test( *db_test_info );
     
     if( testresult )
       result = get_result_fields( *db_test_info, base_search_dir, database->xml_filters() );
@@ -2574,23 +2687,114 @@ void SpecFileQueryWidget::doSearch( const std::string basedir,
     int nupdates_sent = 0;
     double lastupdate = SpecUtils::get_wall_time();
     
-    //We could choose something like 100 for nfile_at_a_time with the only
-    //  dowsides being N42 files would parse any faster due to not enough
-    //  threads being available, and also the fact that when parsing multiple
-    //  file, hard drive bandwidth is probably the main limiting factor.
+    //The search is a pipeline: this thread walks the directory tree (or list of files), putting
+    //  candidate files onto a bounded queue, that worker threads pull from to parse (or retrieve
+    //  from the database cache) and test each file.  Matching results are sent to the GUI about
+    //  once a second as they come in, so no stage ever waits on the slowest file of a batch.
+    //  Parsing happens from file paths inside SpecFileQueryDbCache, so each worker does its own
+    //  reads, which still lets I/O of one file overlap with parsing others.
 #if( defined(WIN32) )
     //The penalty of multiple seeks is redicuolous on spinning drives - just use a single thread...
-    const int nfile_at_a_time = 1;
+    const size_t nworkers = 1;
 #else
-    const int nfile_at_a_time = SpecUtilsAsync::num_physical_cpu_cores();
+    const size_t nworkers = std::max( 1, SpecUtilsAsync::num_physical_cpu_cores() );
 #endif
     
-    SpecUtilsAsync::ThreadPool pool;
+    //Test all the files already cached in the database at once, using SQL, so only files that
+    //  pass, or are not cached, need to be retrieved from the database, or parsed.
+    std::unique_ptr<SpecFileQueryDbCache::PrefilterResults> prefilter;
+    if( database )
+      prefilter = database->prefilter( query );
+    const SpecFileQueryDbCache::PrefilterResults *prefilter_ptr = prefilter.get();
     
-#if( USE_DIRECTORY_ITERATOR_METHOD )
-    size_t ncheckssubmitted = 0;
+    BoundedQueue<string> file_queue( 8*nworkers );
     std::mutex result_mutex;
+    std::atomic<size_t> nfiles_checked( 0 );
+    size_t nfiles_submitted = 0;
     
+    vector<std::thread> workers;
+    
+    // Makes sure the workers are stopped, and joined, even if we exit because of an exception
+    //  (e.g., user cancelled search), since they reference local variables.
+    struct WorkerJoiner
+    {
+      BoundedQueue<string> &m_queue;
+      vector<std::thread> &m_workers;
+      ~WorkerJoiner()
+      {
+        m_queue.close();
+        for( std::thread &worker : m_workers )
+        {
+          if( worker.joinable() )
+            worker.join();
+        }
+      }
+    } worker_joiner{ file_queue, workers };
+    
+    for( size_t i = 0; i < nworkers; ++i )
+    {
+      workers.emplace_back( [&file_queue, &query, &uniqueCheck, &database, prefilter_ptr, &basedir,
+                             &result, &result_mutex, &nfiles_checked, stopUpdate](){
+        string filename;
+        while( file_queue.pop( filename ) )
+        {
+          if( stopUpdate->load() )
+          {
+            file_queue.clear();
+            continue;
+          }
+          
+          vector<string> testres;
+          testfile( filename, testres, query, uniqueCheck, database, prefilter_ptr, basedir );
+          if( !testres.empty() )
+          {
+            std::lock_guard<std::mutex> lock( result_mutex );
+            result->push_back( testres );
+          }
+          
+          ++nfiles_checked;
+        }//while( file_queue.pop( filename ) )
+      } );
+    }//for( size_t i = 0; i < nworkers; ++i )
+    
+#if( USE_DIRECTORY_ITERATOR_METHOD )
+    const size_t nfiles_total = 0;  //unknown, since we are walking the directories as we go
+#else
+    const size_t nfiles_total = static_cast<size_t>( nfiles );
+#endif
+    
+    // Sends results found so far to the GUI, if its been at least a second since last update.
+    auto send_update = [&]( const bool force ){
+      const double now = SpecUtils::get_wall_time();
+      if( !force && (now < (lastupdate + 1.0)) && nupdates_sent )
+        return;
+      
+      std::lock_guard<std::mutex> lock( result_mutex );
+      ++nupdates_sent;
+      num_files_pass += result->size();
+      WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
+                                                        this, nfiles_total, nfiles_checked.load(), "",
+                                                        result, widgetDeleted ) );
+      result = std::make_shared< vector<vector<string> > >();
+      lastupdate = now;
+    };//send_update lambda
+    
+    // Puts a file onto the queue, waiting if the queue is full, but still sending updates to the
+    //  GUI, and checking if the user has cancelled the search, while we wait.
+    auto submit_file = [&]( const string &filename ){
+      while( !file_queue.push_for( filename, std::chrono::milliseconds(250) ) )
+      {
+        if( stopUpdate->load() )
+          throw runtime_error("");
+        send_update( false );
+      }
+      
+      ++nfiles_submitted;
+      send_update( false );
+    };//submit_file lambda
+    
+    
+#if( USE_DIRECTORY_ITERATOR_METHOD )
 #ifdef _WIN32
     const std::wstring wbasedir = SpecUtils::convert_from_utf8_to_utf16( basedir );
     boost::filesystem::recursive_directory_iterator diriter( wbasedir, boost::filesystem::symlink_option::recurse );
@@ -2643,37 +2847,7 @@ void SpecFileQueryWidget::doSearch( const std::string basedir,
       
       
       if( is_file && filterfcn( filename, (void *)&maxsize ) )
-      {
-        if( (ncheckssubmitted % nfile_at_a_time) == 0 )
-        {
-          pool.join();
-          
-          const double now = SpecUtils::get_wall_time();
-          if( now > (lastupdate + 1.0) || !nupdates_sent )
-          {
-            ++nupdates_sent;
-            num_files_pass += result->size();
-            
-            std::unique_lock<std::mutex> lock( result_mutex );
-            WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
-                                                              this, 0, ncheckssubmitted, "", result, widgetDeleted ) );
-            result = std::make_shared< vector<vector<string> > >();
-            lastupdate = now;
-          }
-        }
-        
-        pool.post( [filename,&query,&uniqueCheck,&database,&basedir,&result,&result_mutex](){
-          vector<string> testres;
-          testfile( filename, testres, query, uniqueCheck, database, basedir );
-          if( !testres.empty() )
-          {
-            std::unique_lock<std::mutex> lock( result_mutex );
-            result->push_back( testres );
-          }
-        } );
-        
-        ++ncheckssubmitted;
-      }//if( this is a potential file we should check on )
+        submit_file( filename );
       
       boost::system::error_code ec;
       diriter.increment(ec);
@@ -2684,41 +2858,32 @@ void SpecFileQueryWidget::doSearch( const std::string basedir,
       }
     }//while( diriter != dirend )
     
-    pool.join();
-    
 #else
     
-    for( int i = 0; i < nfiles; i += nfile_at_a_time )
+    for( const string &filename : files )
     {
       if( stopUpdate->load() )
         throw runtime_error("");
       
-      const int nfilethisone = std::min( nfiles-i, nfile_at_a_time );
-      
-      vector< vector<string> > testres( nfilethisone );
-      
-      for( int j = 0; j < nfilethisone; ++j )
-        pool.post( boost::bind( &testfile, boost::cref(files[i+j]), boost::ref(testres[j]),
-                                boost::cref(query), boost::ref(uniqueCheck), database,
-                                boost::cref(basedir) ) );
-      pool.join();
-      
-      for( int j = 0; j < nfilethisone; ++j )
-        if( testres[j].size() )
-          result->push_back( testres[j] );
-      
-      const double now = SpecUtils::get_wall_time();
-      if( now > (lastupdate + 2.0) || !nupdates_sent )
-      {
-        ++nupdates_sent;
-        num_files_pass += result->size();
-        WServer::instance()->post( sessionid, boost::bind(&SpecFileQueryWidget::updateSearchStatus,
-                                                          this, nfiles, i+nfilethisone, "", result, widgetDeleted ) );
-        result = std::make_shared< vector<vector<string> > >();
-        lastupdate = now;
-      }
-    }//for( size_t i = 0; i < nfiles; ++i  )
+      submit_file( filename );
+    }//for( const string &filename : files )
+    
 #endif //USE_DIRECTORY_ITERATOR_METHOD
+    
+    // No more files; wait for the workers to finish up, sending updates to the GUI as we go.
+    file_queue.close();
+    while( nfiles_checked.load() < nfiles_submitted )
+    {
+      if( stopUpdate->load() )
+        throw runtime_error("");
+      
+      std::this_thread::sleep_for( std::chrono::milliseconds(50) );
+      send_update( false );
+    }//while( waiting on workers )
+    
+    for( std::thread &worker : workers )
+      worker.join();
+    
   }catch( ... )
   {
     const double total_clock_time = (SpecUtils::get_wall_time() - starttime);
@@ -24,6 +24,7 @@
 #include "InterSpec_config.h"
 
 #include <deque>
+#include <atomic>
 #include <vector>
 #include <string>
 #include <memory>
@@ -112,6 +113,7 @@
 #include "SpecUtils/Filesystem.h"
 #include "SpecUtils/StringAlgo.h"
 #include "SpecUtils/ParseUtils.h"
+#include "SpecUtils/SpecUtilsAsync.h"
 #include "InterSpec/SimpleDialog.h"
 #include "InterSpec/InterSpecApp.h"
 #include "InterSpec/EnergyCalTool.h"
@@ -452,6 +454,99 @@ namespace
     }//~FileUploadDialog()
     
   };//class FileUploadDialog
+  
+  
+  /** Parses a spectrum file the same way #SpectraFileHeader::setFile does, but without touching
+   any session state, so it can be called without holding the WApplication::UpdateLock.
+   
+   Throws std::runtime_error on failure.
+   */
+  std::shared_ptr<SpecMeas> parse_dropped_file( const std::string &displayName,
+                                                const std::string &filename )
+  {
+    string orig_file_ending;
+    const size_t pos = displayName.find_last_of( '.' );
+    if( pos != string::npos )
+      orig_file_ending = displayName.substr( pos+1 );
+    SpecUtils::to_lower_ascii( orig_file_ending );
+    
+    if( !SpecUtils::is_file(filename) )
+      throw runtime_error( "Could not access file '" + displayName + "'" );
+    
+    auto meas = std::make_shared<SpecMeas>();
+    if( !meas->load_file( filename, SpecUtils::ParserType::Auto, orig_file_ending ) )
+      throw runtime_error( "Could not open '" + displayName
+                           + "' with any of the available decoders, sorry." );
+    
+    meas->set_filename( displayName );
+    meas->reset_modified();
+    meas->reset_modified_since_decode();
+    
+    return meas;
+  }//std::shared_ptr<SpecMeas> parse_dropped_file(...)
+  
+  
+  /** Parses a spectrum file inflated from a ZIP archive.  N42 files are parsed directly from
+   memory; the other formats can only be auto-detected when parsing from a file, so are written to
+   a temporary file first.  Does not touch any session state.
+   
+   Throws std::runtime_error on failure.
+   */
+  std::shared_ptr<SpecMeas> parse_file_from_zip( const std::string &displayName,
+                                                 std::vector<char> &data )
+  {
+    if( data.empty() )
+      throw runtime_error( "'" + displayName + "' is empty" );
+    
+    size_t first_char = 0;
+    if( (data.size() >= 3) && (data[0] == '\xEF') && (data[1] == '\xBB') && (data[2] == '\xBF') )
+      first_char = 3; //UTF-8 BOM
+    while( (first_char < data.size()) && isspace( static_cast<unsigned char>(data[first_char]) ) )
+      ++first_char;
+    
+    if( (first_char < data.size()) && (data[first_char] == '<') )
+    {
+      auto meas = std::make_shared<SpecMeas>();
+      
+      data.push_back( '\0' );
+      const bool loaded = meas->load_N42_from_data( &data.front(), &data.front() + data.size() - 1 );
+      data.pop_back();
+      
+      if( loaded )
+      {
+        meas->set_filename( displayName );
+        meas->reset_modified();
+        meas->reset_modified_since_decode();
+        
+        return meas;
+      }//if( loaded )
+    }//if( looks like XML )
+    
+    const string tmpfile = SpecUtils::temp_file_name( "", SpecUtils::temp_dir() );
+    
+    try
+    {
+      {
+#ifdef _WIN32
+        const std::wstring wtmpfile = SpecUtils::convert_from_utf8_to_utf16(tmpfile);
+        ofstream tmpfilestrm( wtmpfile.c_str(), ios::out | ios::binary );
+#else
+        ofstream tmpfilestrm( tmpfile.c_str(), ios::out | ios::binary );
+#endif
+        if( !tmpfilestrm.write( &data.front(), data.size() ) )
+          throw runtime_error( "Failed to write temporary file" );
+      }
+      
+      std::shared_ptr<SpecMeas> meas = parse_dropped_file( displayName, tmpfile );
+      SpecUtils::remove_file( tmpfile );
+      
+      return meas;
+    }catch( std::exception & )
+    {
+      SpecUtils::remove_file( tmpfile );
+      throw;
+    }//try / catch
+  }//std::shared_ptr<SpecMeas> parse_file_from_zip(...)
 }//namespace
 
 
@@ -718,55 +813,214 @@ void SpecMeasManager::extractAndOpenFromZip( const std::string &spoolName,
                                              AuxWindow *window,
                                              WModelIndex index )
 {
-  try
+  //const string fileInZip = selection->valueText().toUTF8();
+  vector<string> filesInZip;
+  if( index.isValid() )
+  {
+    filesInZip.push_back( Wt::asString(index.data()).toUTF8() );
+  }else
   {
-    //const string fileInZip = selection->valueText().toUTF8();
-    if( !index.isValid() )
+    //WModelIndexSet is ordered by row, so files will be in same order as displayed
+    const WModelIndexSet selected = table->selectedIndexes();
+    for( const WModelIndex &selindex : selected )
     {
-      WModelIndexSet selected = table->selectedIndexes();
-      if( selected.size() )
-        index = *selected.begin();
+      const WModelIndex nameindex = table->model()->index( selindex.row(), 0 );
+      filesInZip.push_back( Wt::asString(nameindex.data()).toUTF8() );
     }
+  }//if( index.isValid() ) / else
+  
+  const SpecUtils::SpectrumType type = SpecUtils::SpectrumType( group->checkedId() );
+  
+  delete window;
+  window = nullptr;
+  
+  if( filesInZip.empty() )
+  {
+    passMessage( "Error extracting file from zip", 2 );
+    return;
+  }
+  
+  // Inflating and parsing may take a while, so is done off of the event loop; if more than one file
+  //  was selected, we'll let the user know whats going on, and let them cancel.
+  SimpleDialog *dialog = nullptr;
+  auto cancelled = std::make_shared<std::atomic<bool>>( false );
+  if( filesInZip.size() > 1 )
+  {
+    dialog = new SimpleDialog( "Parsing Files", "This may take a second." );
+    WPushButton *cancel = dialog->addButton( "Cancel" );
+    cancel->clicked().connect( std::bind( [cancelled](){ cancelled->store( true ); } ) );
+  }//if( filesInZip.size() > 1 )
+  
+  // Results of the background parse; only touched by the worker until its posted back to the session
+  struct ZipParseResults
+  {
+    vector<std::shared_ptr<SpecMeas>> parsed;
+    vector<string> errors;
+    string error;
     
-    if( !index.isValid() )
-      throw runtime_error( "No file selected" );
+    /** If a single file was requested, and it isnt a spectrum file, its contents are written here,
+     so it can be checked for being a non-spectrum file (e.g., a CSV of peaks).
+     */
+    string non_spec_tmpfile;
+  };//struct ZipParseResults
+  
+  auto results = std::make_shared<ZipParseResults>();
+  
+  // Called in the session, with the WApplication::UpdateLock, once parsing is done.
+  auto finish = [this,filesInZip,type,dialog,cancelled,results](){
+    if( dialog && !cancelled->load() )
+      dialog->accept();
     
-    const SpecUtils::SpectrumType type = SpecUtils::SpectrumType( group->checkedId() );
+    // If the user clicked "Cancel", the dialog is already being deleted; just discard the results.
+    if( cancelled->load() )
+    {
+      if( !results->non_spec_tmpfile.empty() )
+        SpecUtils::remove_file( results->non_spec_tmpfile );
+      return;
+    }//if( cancelled->load() )
     
-    const string fileInZip = Wt::asString(index.data()).toUTF8();
+    if( !results->error.empty() )
+    {
+      cerr << "Error extracting files from zip: " << results->error << endl;
+      passMessage( "Error extracting file from zip", 2 );
+      wApp->triggerUpdate();
+      return;
+    }//if( !results->error.empty() )
     
-    const string tmppath = SpecUtils::temp_dir();
-    string tmpfile = SpecUtils::temp_file_name( "", tmppath );
+    if( !results->non_spec_tmpfile.empty() )
+    {
+      if( !handleNonSpectrumFile( filesInZip[0], results->non_spec_tmpfile ) )
+        displayInvalidFileMsg( filesInZip[0], results->errors[0] );
+      
+      SpecUtils::remove_file( results->non_spec_tmpfile );
+      wApp->triggerUpdate();
+      return;
+    }//if( a single, non-spectrum, file )
     
-    ifstream zipfilestrm( spoolName.c_str(), ios::in | ios::binary );
+    size_t nadded = 0, nfailed = 0;
+    for( size_t i = 0; i < results->parsed.size(); ++i )
+    {
+      const std::shared_ptr<SpecMeas> &meas = results->parsed[i];
+      if( !meas )
+      {
+        ++nfailed;
+        cerr << "Failed to parse '" << filesInZip[i] << "' from zip: " << results->errors[i] << endl;
+        continue;
+      }//if( !meas )
+      
+      try
+      {
+        std::shared_ptr<SpectraFileHeader> header = addFile( filesInZip[i], meas );
+        
+        if( nadded == 0 )
+        {
+          const int modelRow = m_fileModel->index( header ).row();
+          displayFile( modelRow, meas, type, true, true, SpecMeasManager::VariantChecksToDo::DerivedDataAndEnergy );
+        }//if( nadded == 0 )
+        
+        ++nadded;
+      }catch( std::exception &e )
+      {
+        ++nfailed;
+        cerr << "Failed to add '" << filesInZip[i] << "' from zip: " << e.what() << endl;
+      }//try / catch
+    }//for( size_t i = 0; i < results->parsed.size(); ++i )
     
-    ZipArchive::FilenameToZipHeaderMap headers
-                                    = ZipArchive::open_zip_file( zipfilestrm );
+    if( nadded > 1 )
+      passMessage( "Added " + std::to_string(nadded - 1) + " more files from the ZIP file to the"
+                   " Spectrum Manager.", 0 );
     
-    if( !headers.count(fileInZip) )
-      throw runtime_error( "Couldnt find file in zip" );
-
-    size_t nbytewritten = 0;
+    if( nfailed )
+      passMessage( "Failed to parse " + std::to_string(nfailed) + " of the files in the ZIP file.", 2 );
     
+    wApp->triggerUpdate();
+  };//finish
+  
+  const string sessionId = wApp->sessionId();
+  
+  auto worker = [spoolName,filesInZip,cancelled,results,finish,sessionId](){
+    try
     {
+      ZipArchive::MappedZipArchive archive( spoolName );
+      const ZipArchive::FilenameToZipHeaderMap &headers = archive.headers();
+      
+      vector<std::shared_ptr<const ZipArchive::ZipFileHeader>> toExtract;
+      for( const string &fileInZip : filesInZip )
+      {
+        const auto pos = headers.find( fileInZip );
+        if( pos == end(headers) )
+          throw runtime_error( "Couldnt find '" + fileInZip + "' in zip" );
+        toExtract.push_back( pos->second );
+      }//for( const string &fileInZip : filesInZip )
+      
+      // Inflate all the files into memory in parallel, then parse them all in parallel; parsed
+      //  files arent added to the session until all the parsing is done.
+      vector<ZipArchive::MappedZipArchive::ExtractedFile> extracted = archive.read_files( toExtract );
+      
+      vector<std::shared_ptr<SpecMeas>> &parsed = results->parsed;
+      vector<string> &errors = results->errors;
+      parsed.resize( extracted.size() );
+      errors.resize( extracted.size() );
+      
+      std::atomic<size_t> next_file( 0 );
+      const auto parse_worker = [&extracted,&parsed,&errors,&next_file,&cancelled](){
+        for( size_t i = next_file++; (i < extracted.size()) && !cancelled->load(); i = next_file++ )
+        {
+          try
+          {
+            if( !extracted[i].error.empty() )
+              throw runtime_error( extracted[i].error );
+            
+            parsed[i] = parse_file_from_zip( extracted[i].header->filename, extracted[i].data );
+          }catch( std::exception &e )
+          {
+            errors[i] = e.what();
+          }//try / catch
+        }//for( loop over files )
+      };//parse_worker
+      
+      if( extracted.size() == 1 )
+      {
+        parse_worker();
+      }else
+      {
+        const int ncores = std::max( 1, SpecUtilsAsync::num_logical_cpu_cores() );
+        const size_t nthreads = std::min( static_cast<size_t>(ncores), extracted.size() );
+        
+        SpecUtilsAsync::ThreadPool pool;
+        for( size_t i = 0; i < nthreads; ++i )
+          pool.post( parse_worker );
+        pool.join();
+      }//if( extracted.size() == 1 ) / else
+      
+      // If a single file was requested, and it isnt a spectrum file, we'll check if its some other
+      //  type of file we know about (e.g., a CSV of peaks), once we are back in the session.
+      if( (parsed.size() == 1) && !parsed[0] && extracted[0].error.empty() )
+      {
+        const string tmpfile = SpecUtils::temp_file_name( "", SpecUtils::temp_dir() );
+        
+        {
 #ifdef _WIN32
-      const std::wstring wtmpfile = SpecUtils::convert_from_utf8_to_utf16(tmpfile);
-      ofstream tmpfilestrm( wtmpfile.c_str(), ios::out | ios::binary );
+          const std::wstring wtmpfile = SpecUtils::convert_from_utf8_to_utf16(tmpfile);
+          ofstream tmpfilestrm( wtmpfile.c_str(), ios::out | ios::binary );
 #else
-      ofstream tmpfilestrm( tmpfile.c_str(), ios::out | ios::binary );
+          ofstream tmpfilestrm( tmpfile.c_str(), ios::out | ios::binary );
 #endif
-      nbytewritten = read_file_from_zip( zipfilestrm, headers[fileInZip], tmpfilestrm );
-    }
-    
-    handleFileDropWorker( fileInZip, tmpfile, type, nullptr, wApp );
+          if( !extracted[0].data.empty() )
+            tmpfilestrm.write( &(extracted[0].data.front()), extracted[0].data.size() );
+        }
+        
+        results->non_spec_tmpfile = tmpfile;
+      }//if( a single, non-spectrum, file )
+    }catch( std::exception &e )
+    {
+      results->error = e.what();
+    }//try / catch
     
-    SpecUtils::remove_file( tmpfile );
-  }catch( std::exception & )
-  {
-    passMessage( "Error extracting file from zip", 2 );
-  }//try / catch
+    WServer::instance()->post( sessionId, finish );
+  };//worker
   
-  delete window;
+  WServer::instance()->ioService().boost::asio::io_service::post( worker );
 }//SpecMeasManager::extractAndOpenFromZip(...)
 
 
@@ -790,7 +1044,7 @@ bool SpecMeasManager::handleZippedFile( const std::string &name,
     
     
     vector<string> filenames;
-    vector<uint32_t> uncompresssize;
+    vector<uint64_t> uncompresssize;
     for( const ZipArchive::FilenameToZipHeaderMap::value_type &t : headers )
     {
       filenames.push_back( t.first );
@@ -810,7 +1064,7 @@ bool SpecMeasManager::handleZippedFile( const std::string &name,
     txt += " is a ZIP file.";
     txt += (m_viewer->isPhone() ? "<br />" : "<br /><br />");
     
-    txt += "Select which file in it you'd like to open";
+    txt += "Select which file(s) in it you'd like to open";
     
     WText *t = new WText( txt );
     //WSelectionBox *selection = new WSelectionBox();
@@ -818,7 +1072,7 @@ bool SpecMeasManager::handleZippedFile( const std::string &name,
     RowStretchTreeView *table = new RowStretchTreeView();
     table->setRootIsDecorated( false );
     table->setAlternatingRowColors( true );
-    table->setSelectionMode( Wt::SingleSelection );
+    table->setSelectionMode( Wt::ExtendedSelection );
     table->addStyleClass( "FilesInZipTable" );
     WStandardItemModel *model = new WStandardItemModel( table );
     table->setModel( model );
@@ -1899,14 +2153,33 @@ void SpecMeasManager::handleFileDropWorker( const std::string &name,
                      const std::string &spoolName,
                      SpecUtils::SpectrumType type,
                      SimpleDialog *dialog,
-                     Wt::WApplication *app )
+                     Wt::WApplication *app,
+                     std::shared_ptr<std::atomic<bool>> cancelled )
 {
-  // We are outside of the application loop here - we could parse the spectrum file here, instead
-  //  of during the loop - but this
-  
   if( !app )
     app = WApplication::instance();
   
+  const bool is_zip = (name.length() > 4)
+                      && SpecUtils::iequals_ascii( name.substr(name.length()-4), ".zip");
+  
+  // We are outside of the application loop here, so we will parse the spectrum file before taking
+  //  the WApplication::UpdateLock; this keeps the session responsive while large files are parsed,
+  //  and lets multiple dropped files be parsed at the same time.  The lock is then only needed to
+  //  add the already parsed file to the model and display it.
+  std::shared_ptr<SpecMeas> measurement;
+  string parse_error;
+  
+  if( !is_zip && !(cancelled && cancelled->load()) )
+  {
+    try
+    {
+      measurement = parse_dropped_file( name, spoolName );
+    }catch( std::exception &e )
+    {
+      parse_error = e.what();
+    }
+  }//if( !is_zip && !cancelled )
+  
   WApplication::UpdateLock lock( app );
  
   if( app && !lock )
@@ -1918,16 +2191,22 @@ void SpecMeasManager::handleFileDropWorker( const std::string &name,
  
   assert( WApplication::instance() );
   
+  // If the user clicked "Cancel", the dialog is already being deleted; just discard the result.
+  if( cancelled && cancelled->load() )
+    return;
+  
   // Make sure we trigger a app update
-  BOOST_SCOPE_EXIT(app,dialog){
+  BOOST_SCOPE_EXIT(app,dialog,cancelled){
     
     // TODO: there is a bit of a delay between upload completing, and showing the dialog - should check into that
     // TODO: check that the dialog is actually deleted correctly in all cases.
     if( dialog )
     {
       auto accept = boost::bind(&SimpleDialog::accept, dialog);
-      WServer::instance()->post( wApp->sessionId(), std::bind([accept](){
-        accept();
+      WServer::instance()->post( wApp->sessionId(), std::bind([accept,cancelled](){
+        // The "Cancel" button deletes the dialog, so only accept it if that wasnt clicked
+        if( !cancelled || !cancelled->load() )
+          accept();
         WApplication::instance()->triggerUpdate();
       }) );
       dialog = nullptr;
@@ -1937,21 +2216,27 @@ void SpecMeasManager::handleFileDropWorker( const std::string &name,
   } BOOST_SCOPE_EXIT_END
   
  
-  if( name.length() > 4
-     && SpecUtils::iequals_ascii( name.substr(name.length()-4), ".zip")
-     && handleZippedFile( name, spoolName, type ) )
-  {
+  if( is_zip && handleZippedFile( name, spoolName, type ) )
     return;
-  }
-  
   
   try
   {
-    std::shared_ptr<SpecMeas> measurement;
     std::shared_ptr<SpectraFileHeader> header;
+    int modelRow = -1;
+    
+    if( measurement )
+    {
+      header = addFile( name, measurement );
+      modelRow = m_fileModel->index( header ).row();
+    }else if( is_zip )
+    {
+      // A ".zip" file that wasnt a zip archive of spectrum files; parse it like any other file
+      modelRow = setFile( name, spoolName, header, measurement );
+    }else
+    {
+      throw runtime_error( parse_error );
+    }
     
-    const int modelRow = setFile( name, spoolName, header, measurement );
-
     displayFile( modelRow, measurement, type, true, true, SpecMeasManager::VariantChecksToDo::DerivedDataAndEnergy );
     
     //It is the responsibility of the caller to clean up the file.
@@ -1979,9 +2264,15 @@ void SpecMeasManager::handleFileDrop( const std::string &name,
     return;
   }
   
-  // Its a larger file - display a message letting the user know its being parsed.
+  // Its a larger file - display a message letting the user know its being parsed, and let them
+  //  cancel it.  Since parsing happens without the WApplication::UpdateLock, the "Cancel" click
+  //  is processed while parsing is still going on.
   auto dialog = new SimpleDialog( "Parsing File", "This may take a second." );
   
+  auto cancelled = std::make_shared<std::atomic<bool>>( false );
+  WPushButton *cancel = dialog->addButton( "Cancel" );
+  cancel->clicked().connect( std::bind( [cancelled](){ cancelled->store( true ); } ) );
+  
   wApp->triggerUpdate();
   
 // When using WServer::instance()->post(...) it seems the "Parsing File" isnt always shown, but
@@ -1992,7 +2283,7 @@ void SpecMeasManager::handleFileDrop( const std::string &name,
 //                                          name, spoolName, type, dialog, wApp ) );
   
   WServer::instance()->ioService().boost::asio::io_service::post( boost::bind( &SpecMeasManager::handleFileDropWorker, this,
-                                                    name, spoolName, type, dialog, wApp ) );
+                                                    name, spoolName, type, dialog, wApp, cancelled ) );
 }//handleFileDrop(...)
 
 void SpecMeasManager::displayInvalidFileMsg( std::string filename, std::string errormsg )
@@ -4503,6 +4794,50 @@ void SpecMeasManager::removeFromSpectrumInfoCache( std::shared_ptr<const SpecMea
 }//void SpecMeasManager::removeFromSpectrumInfoCache(...) const
 
 
+size_t SpecMeasManager::cachedSpectraMemorySize( const std::set<const SpecMeas *> &exclude ) const
+{
+  // The same SpecMeas may be in m_tempSpectrumInfoCache, and kept by its header, so only count once
+  std::set<const SpecMeas *> counted = exclude;
+  
+  size_t nbytes = 0;
+  for( const std::shared_ptr<const SpecMeas> &meas : m_tempSpectrumInfoCache )
+  {
+    if( meas && counted.insert(meas.get()).second )
+      nbytes += meas->memmorysize();
+  }
+  
+  const SpectraFileModel * const fileModel = m_fileModel;
+  for( int row = 0; fileModel && (row < fileModel->rowCount()); ++row )
+  {
+    const std::shared_ptr<const SpectraFileHeader> header = fileModel->fileHeader( row );
+    const std::shared_ptr<const SpecMeas> meas = header ? header->cachedMeasurement() : nullptr;
+    if( meas && counted.insert(meas.get()).second )
+      nbytes += meas->memmorysize();
+  }//for( loop over files )
+  
+  return nbytes;
+}//size_t cachedSpectraMemorySize( const std::set<const SpecMeas *> &exclude ) const
+
+
+void SpecMeasManager::releaseCachedSpectra( const std::set<const SpecMeas *> &exclude )
+{
+  clearTempSpectrumInfoCache();
+  
+  for( int row = 0; m_fileModel && (row < m_fileModel->rowCount()); ++row )
+  {
+    std::shared_ptr<SpectraFileHeader> header = m_fileModel->fileHeader( row );
+    std::shared_ptr<SpecMeas> meas = header ? header->cachedMeasurement() : nullptr;
+    if( !meas || exclude.count(meas.get()) )
+      continue;
+    
+    // If the save cant be started, the header keeps the SpecMeas in memory, so we leave it be; if
+    //  writing the file fails later on, the header will go back to keeping it in memory.
+    if( header->saveToFileSystem( meas ) )
+      header->releaseCacheReference();
+  }//for( loop over files )
+}//void releaseCachedSpectra( const std::set<const SpecMeas *> &exclude )
+
+
 void SpecMeasManager::addToTempSpectrumInfoCache( std::shared_ptr<const SpecMeas> meas ) const
 {
   if( sm_maxTempCacheSize == 0 )
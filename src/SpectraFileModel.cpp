@@ -1128,7 +1128,7 @@ void SpectraFileHeader::saveToFileSystemImmediately( SpecMeas *meas ) const
 
 
 
-void SpectraFileHeader::saveToFileSystem( std::shared_ptr<SpecMeas> measurment ) const
+bool SpectraFileHeader::saveToFileSystem( std::shared_ptr<SpecMeas> measurment ) const
 {
   bool success = false;
   std::shared_ptr<SpecMeas> info;
@@ -1216,7 +1216,9 @@ void SpectraFileHeader::saveToFileSystem( std::shared_ptr<SpecMeas> measurment )
       m_weakMeasurmentPtr = info;
     }
   }//if( !success )
-}//void saveToFileSystem()
+  
+  return success;
+}//bool saveToFileSystem()
 
 
 struct SpectraHeaderMaker
@@ -1477,6 +1479,13 @@ std::shared_ptr<SpecMeas> SpectraFileHeader::measurementIfInMemory() const
 }//std::shared_ptr<SpecMeas> measurementIfInMemory()
 
 
+std::shared_ptr<SpecMeas> SpectraFileHeader::cachedMeasurement() const
+{
+  RecursiveLock lock( m_mutex );
+  return m_cachedMeasurement;
+}//std::shared_ptr<SpecMeas> cachedMeasurement() const
+
+
 int SpectraFileHeader::numSamples() const
 {
   return m_numSamples;
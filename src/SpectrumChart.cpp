@@ -1596,6 +1596,11 @@ void SpectrumChart::iterateSpectrum( SpectrumRenderIterator *iterator,
   
   
   const int nrow = (!!m ? m->rowCount() : 0);
+  if( !m )
+    return;
+  
+  //Re-used between segments and series to avoid allocations.
+  vector<double> rowEdges, rowValues;
   
   for( unsigned g = 0; g < seriesv.size(); ++g )
   {
@@ -1668,33 +1673,62 @@ void SpectrumChart::iterateSpectrum( SpectrumRenderIterator *iterator,
             painter.setClipPath(clipPath);
             painter.setClipping(true);
             
-            for( int row = minRow; row <= maxRow; ++row )
+            //Grab the rows contiguously, rather than through the item model
+            //  interface, which costs a WModelIndex and boost::any per channel.
+            m->rowValues( series.modelColumn(), minRow, maxRow, rowEdges, rowValues );
+            const size_t nvalues = rowValues.size();
+            
+            if( drawHist )
             {
-              int c = series.XSeriesColumn();
-              if( c == -1 )
-                c = XSeriesColumn();
-              const int column = series.modelColumn();
-              const WModelIndex xIndex = m->index( row, c );
-              const WModelIndex yIndex = m->index( row, column );
-              
-              if( !yIndex.isValid() || !xIndex.isValid() )
-                continue;
-              
-              const double y = asNumber( m->data(yIndex) );
-              
-              if( !drawHist )
+              for( size_t i = 0; i < nvalues; ++i )
+              {
+                iterator->newValue( series, rowEdges[i], rowValues[i], 0, WModelIndex(), WModelIndex() );
+                iterator->newValue( series, rowEdges[i+1], rowValues[i], 0, WModelIndex(), WModelIndex() );
+              }
+            }else if( pxPerBin >= 0.5 || !(maxx > minx) )
+            {
+              for( size_t i = 0; i < nvalues; ++i )
               {
-                const double x = asNumber( m->data(xIndex) );
-                iterator->newValue( series, x, y, 0, xIndex, yIndex );
-              }else
+                const double x = 0.5*(rowEdges[i] + rowEdges[i+1]);
+                iterator->newValue( series, x, rowValues[i], 0, WModelIndex(), WModelIndex() );
+              }
+            }else
+            {
+              //More than two rows per pixel (e.g., 16k channel spectra), so
+              //  for each pixel column we only draw its minimum and maximum
+              //  value, in the order they occur; this looks the same, but keeps
+              //  the path to a couple points per pixel instead of per channel.
+              const double pxPerX = (maxXPx - minXPx) / (maxx - minx);
+              auto pixel = [&]( const size_t i ) -> int {
+                const double x = 0.5*(rowEdges[i] + rowEdges[i+1]);
+                return static_cast<int>( std::floor( (x - minx) * pxPerX ) );
+              };
+              
+              size_t start = 0;
+              while( start < nvalues )
               {
-                //should consider if (pxPerBin > 3*penWidth)
-                const double x_start = m->rowLowEdge( xIndex.row() );
-                const double x_end = x_start + m->rowWidth( xIndex.row() );
-                iterator->newValue( series, x_start, y, 0, xIndex, yIndex );
-                iterator->newValue( series, x_end, y, 0, xIndex, yIndex );
-              }//if( pxPerBin < 3.0 )
-            }//for( unsigned row = 0; row < rows; ++row )
+                const int startPixel = pixel( start );
+                size_t minIndex = start, maxIndex = start, stop = start + 1;
+                for( ; (stop < nvalues) && (pixel(stop) == startPixel); ++stop )
+                {
+                  if( rowValues[stop] < rowValues[minIndex] )
+                    minIndex = stop;
+                  if( rowValues[stop] > rowValues[maxIndex] )
+                    maxIndex = stop;
+                }
+                
+                const size_t first = std::min( minIndex, maxIndex );
+                const size_t second = std::max( minIndex, maxIndex );
+                
+                iterator->newValue( series, 0.5*(rowEdges[first] + rowEdges[first+1]),
+                                    rowValues[first], 0, WModelIndex(), WModelIndex() );
+                if( second != first )
+                  iterator->newValue( series, 0.5*(rowEdges[second] + rowEdges[second+1]),
+                                      rowValues[second], 0, WModelIndex(), WModelIndex() );
+                
+                start = stop;
+              }//while( start < nvalues )
+            }//if( drawHist ) / else if / else
             
             iterator->endSegment();
             painter.restore();
@@ -26,6 +26,7 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
 
 // Disable streamsize <=> size_t warnings in boost
@@ -665,6 +666,103 @@ boost::any SpectrumDataModel::displayBinValue( int row,
 }//displayBinValue(...)
 
 
+bool SpectrumDataModel::rowValues( const int column, int firstRow, int lastRow,
+                                   std::vector<double> &lowEdges,
+                                   std::vector<double> &values ) const
+{
+  lowEdges.clear();
+  values.clear();
+  
+  std::shared_ptr<const Measurement> xHist = histUsedForXAxis();
+  if( !xHist || (column == X_AXIS_COLUMN) || !columnHasData( column ) )
+    return false;
+  
+  const int rebin = ( m_rebinFactor > 1 ) ? m_rebinFactor : 1;
+  const size_t nchannel = xHist->num_gamma_channels();
+  const int numRows = static_cast<int>(nchannel) / rebin;
+  
+  firstRow = std::max( firstRow, 0 );
+  lastRow = std::min( lastRow, numRows - 1 );
+  if( lastRow < firstRow )
+    return false;
+  
+  const size_t nrows = static_cast<size_t>( lastRow - firstRow + 1 );
+  
+  lowEdges.resize( nrows + 1 );
+  for( size_t i = 0; i < nrows; ++i )
+    lowEdges[i] = xHist->gamma_channel_lower( (firstRow + i) * rebin );
+  lowEdges[nrows] = xHist->gamma_channel_upper( std::min( (lastRow + 1)*rebin - 1, static_cast<int>(nchannel) - 1 ) );
+  
+  values.resize( nrows, 0.0 );
+  
+  //Adds 'mult' times the (scaled) contents of a histogram to values.
+  auto add_column = [&]( const ColumnType col, const double mult ) {
+    std::shared_ptr<const Measurement> hist;
+    double sf = 1.0;
+    switch( col )
+    {
+      case X_AXIS_COLUMN:      return;
+      case DATA_COLUMN:        hist = m_data;                                 break;
+      case SECOND_DATA_COLUMN: hist = m_secondData; sf = secondDataScaledBy(); break;
+      case BACKGROUND_COLUMN:  hist = m_background; sf = backgroundScaledBy(); break;
+    }//switch( col )
+    
+    if( !hist )
+      return;
+    
+    const std::shared_ptr<const vector<float>> &counts = hist->gamma_channel_contents();
+    
+    if( counts && (hist->channel_energies() == xHist->channel_energies()) )
+    {
+      const vector<float> &channel_contents = *counts;
+      const size_t ncounts = channel_contents.size();
+      
+      for( size_t i = 0; i < nrows; ++i )
+      {
+        const size_t firstBin = (firstRow + i) * rebin;
+        const size_t lastBin = std::min( firstBin + rebin, ncounts );
+        
+        double integral = 0.0;
+        for( size_t bin = firstBin; bin < lastBin; ++bin )
+          integral += channel_contents[bin];
+        values[i] += mult * sf * integral;
+      }//for( size_t i = 0; i < nrows; ++i )
+    }else
+    {
+      //Different binning; displayBinValue(...) does the interpolation (and scaling)
+      for( size_t i = 0; i < nrows; ++i )
+        values[i] += mult * asNumber( displayBinValue( firstRow + static_cast<int>(i), col ) );
+    }
+  };//add_column lambda
+  
+  switch( column )
+  {
+    case DATA_COLUMN:
+      add_column( DATA_COLUMN, 1.0 );
+      if( m_backgroundSubtract && m_background )
+        add_column( BACKGROUND_COLUMN, -1.0 );
+      break;
+      
+    case SECOND_DATA_COLUMN:
+      add_column( SECOND_DATA_COLUMN, 1.0 );
+      if( m_backgroundSubtract && !m_secondDataOwnAxis && m_background )
+        add_column( BACKGROUND_COLUMN, -1.0 );
+      break;
+      
+    case BACKGROUND_COLUMN:
+      add_column( BACKGROUND_COLUMN, 1.0 );
+      break;
+      
+    default:
+      lowEdges.clear();
+      values.clear();
+      return false;
+  }//switch( column )
+  
+  return true;
+}//bool rowValues(...)
+
+
 boost::any SpectrumDataModel::data( const WModelIndex &index, int role ) const
 {
   if( role != Wt::DisplayRole )
@@ -25,11 +25,19 @@ extern "C"{
 #include <zlib.h>
 }
 
+#include <atomic>
 #include <string>
 #include <memory>
+#include <cstring>
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
+#include <streambuf>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "SpecUtils/SpecUtilsAsync.h"
 
 #include "InterSpec/ZipArchive.h"
 
@@ -53,6 +61,162 @@ inline istream &binaryRead( istream &stream, T &x )
 }
 
 
+namespace
+{
+  /** Value of 16 or 32 bit fields that indicates the actual value is in a ZIP64 record. */
+  const uint16_t sm_zip64_16bit_marker = 0xFFFF;
+  const uint32_t sm_zip64_32bit_marker = 0xFFFFFFFF;
+  
+  
+  /** A read-only, seekable, streambuf over a block of memory, so the std::istream based parsing
+   code can be used on memory-mapped archives.  Each thread reading from the memory should use its
+   own instance.
+   */
+  class MemoryStreamBuf : public std::streambuf
+  {
+  public:
+    MemoryStreamBuf( const char *data, const size_t size )
+    {
+      char *begin = const_cast<char *>( data );
+      setg( begin, begin, begin + size );
+    }
+    
+  protected:
+    virtual pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+                              std::ios_base::openmode which ) override
+    {
+      off_type pos = off;
+      if( dir == std::ios_base::cur )
+        pos += (gptr() - eback());
+      else if( dir == std::ios_base::end )
+        pos += (egptr() - eback());
+      
+      if( (pos < 0) || (pos > (egptr() - eback())) )
+        return pos_type( off_type(-1) );
+      
+      setg( eback(), eback() + pos, egptr() );
+      return pos_type( pos );
+    }//seekoff(...)
+    
+    virtual pos_type seekpos( pos_type pos, std::ios_base::openmode which ) override
+    {
+      return seekoff( off_type(pos), std::ios_base::beg, which );
+    }
+  };//class MemoryStreamBuf
+  
+  
+  /** Inflates (or copies, if stored uncompressed) the entry described by 'header', passing the
+   uncompressed data, in chunks, to 'write( const char *data, size_t nbytes )'.
+   
+   Returns number of uncompressed bytes; throws std::exception on error.
+   */
+  template<class Writer>
+  size_t inflate_entry( std::istream &instrm, const ZipFileHeader &header, Writer &&write )
+  {
+    instrm.seekg( static_cast<std::streamoff>(header.header_offset) );
+    
+    ZipFileHeader localheader;
+    if( !localheader.init( instrm, false ) )
+      throw runtime_error( "ZipArchive: error reading header from stream" );
+    
+    const size_t buffer_size = 16*1024;
+    unsigned char in[buffer_size], out[buffer_size];
+    const uint16_t DEFLATE = 8;
+    const uint16_t UNCOMPRESSED = 0;
+    
+    uint64_t total_read = 0;
+    size_t total_uncompressed = 0;
+    
+    if( header.compression_type == DEFLATE ) //should maybye use localheader
+    {
+      z_stream strm;
+      strm.zalloc   = Z_NULL;
+      strm.zfree    = Z_NULL;
+      strm.opaque   = Z_NULL;
+      strm.avail_in = 0;
+      strm.next_in  = Z_NULL;
+      
+      // initialize the inflate
+      const int result = inflateInit2( &strm, -MAX_WBITS );
+      if( result != Z_OK )
+        throw runtime_error( "ZipArchive: gzip inflateInit2 didnt return Z_OK" );
+      
+      // Make sure we free the zlib state, even if we throw
+      struct InflateEnder
+      {
+        z_stream *m_strm;
+        ~InflateEnder(){ inflateEnd( m_strm ); }
+      } inflate_ender{ &strm };
+      
+      int ret = Z_OK;
+      while( ret != Z_STREAM_END )
+      {
+        if( strm.avail_in == 0 ) // buffer empty, read some more from file
+        {
+          if( header.compressed_size <= total_read )
+            throw runtime_error( "ZipArchive: read size error" );
+          
+          const size_t nToRead = static_cast<size_t>( std::min( static_cast<uint64_t>(buffer_size),
+                                                         header.compressed_size - total_read ) );
+          instrm.read( (char*)in, nToRead );
+          strm.avail_in = static_cast<unsigned int>( instrm.gcount() );
+          if( strm.avail_in == 0 )
+            throw runtime_error( "ZipArchive: unexpected end of archive" );
+          
+          total_read += strm.avail_in;
+          strm.next_in = (Bytef*)in;
+        }//if( strm.avail_in == 0 )
+        
+        strm.avail_out = static_cast<unsigned int>( buffer_size );
+        strm.next_out = (Bytef*)out;
+        
+        ret = inflate( &strm, Z_NO_FLUSH ); // decompress
+        switch( ret )
+        {
+          case Z_STREAM_ERROR:
+            throw runtime_error( "ZipArchive: libz error Z_STREAM_ERROR" );
+          
+          case Z_NEED_DICT:
+          case Z_DATA_ERROR:
+          case Z_MEM_ERROR:
+            throw runtime_error( "ZipArchive: gzip error "
+                                 + string(strm.msg ? strm.msg : "(no msg)") );
+          default:
+            break;
+        }//switch( ret )
+        
+        const size_t unzip_count = buffer_size - strm.avail_out;
+        if( unzip_count )
+          write( (const char *)out, unzip_count );
+        
+        total_uncompressed += unzip_count;
+      }//while( ret != Z_STREAM_END )
+      
+      return total_uncompressed;
+    }else if( header.compression_type == UNCOMPRESSED )
+    {
+      while( total_read < header.compressed_size )
+      {
+        const size_t nToRead = static_cast<size_t>( std::min( static_cast<uint64_t>(buffer_size),
+                                                         header.compressed_size - total_read ) );
+        instrm.read( (char*)out, nToRead );
+        const size_t nread = static_cast<size_t>( instrm.gcount() );
+        if( nread == 0 )
+          throw runtime_error( "ZipArchive: unexpected end of archive" );
+        
+        write( (const char *)out, nread );
+        total_read += nread;
+      }//while( total_read < header.compressed_size )
+      
+      return static_cast<size_t>( total_read );
+    }else
+    {
+      throw runtime_error( "ZipArchive: unrecognized compression" );
+    }//if( header.compression_type == DEFLATE ) / else UNCOMPRESSED / else
+  }//size_t inflate_entry(...)
+}//namespace
+
+
 bool ZipFileHeader::init( istream& istream, const bool globalHeader )
 {
   uint32_t sig;
@@ -78,15 +242,17 @@ bool ZipFileHeader::init( istream& istream, const bool globalHeader )
     }
   }//if( globalHeader ) / else
   
-  // Read rest of header
+  // Read rest of header; sizes and offsets are 32 bits here, but if they are 0xFFFFFFFF, the
+  //  actual values are in the ZIP64 extended information extra field.
+  uint32_t compressed_size32, uncompressed_size32, header_offset32 = 0;
   binaryRead( istream, version );
   binaryRead( istream, flags );
   binaryRead( istream, compression_type );
   binaryRead( istream, stamp_date );
   binaryRead( istream, stamp_time );
   binaryRead( istream, crc );
-  binaryRead( istream, compressed_size );
-  binaryRead( istream, uncompressed_size );
+  binaryRead( istream, compressed_size32 );
+  binaryRead( istream, uncompressed_size32 );
   
   uint16_t filename_length,extra_length;
   binaryRead( istream, filename_length );
@@ -101,11 +267,15 @@ bool ZipFileHeader::init( istream& istream, const bool globalHeader )
     binaryRead( istream, disk_number_start ); // disk# start
     binaryRead( istream, int_file_attrib ); // internal file
     binaryRead( istream, ext_file_attrib ); // ext final
-    binaryRead( istream, header_offset ); // rel offset
+    binaryRead( istream, header_offset32 ); // rel offset
   }//if( globalHeader )
   
-  uint16_t bufflen = std::max( filename_length, extra_length );
-  bufflen = std::max( bufflen, comment_length ) + 1;
+  compressed_size = compressed_size32;
+  uncompressed_size = uncompressed_size32;
+  header_offset = header_offset32;
+  
+  size_t bufflen = std::max( filename_length, extra_length );
+  bufflen = std::max( bufflen, static_cast<size_t>(comment_length) ) + 1;
       
   vector<char> buff( bufflen );
   
@@ -114,10 +284,46 @@ bool ZipFileHeader::init( istream& istream, const bool globalHeader )
   filename = string( &buff[0] );
   
   istream.read( &buff[0],extra_length);
+  
+  // Look for the ZIP64 extended information extra field (header ID 0x0001); its 64-bit values are
+  //  only present for the fields whose 32-bit values were 0xFFFFFFFF, and in this order.
+  for( size_t pos = 0; (pos + 4) <= extra_length; )
+  {
+    uint16_t field_id, field_length;
+    memcpy( &field_id, &buff[pos], 2 );
+    memcpy( &field_length, &buff[pos+2], 2 );
+    pos += 4;
+    
+    const size_t field_end = pos + field_length;
+    if( field_end > extra_length )
+      break;
+    
+    if( field_id == 0x0001 )
+    {
+      size_t field_pos = pos;
+      const auto read_uint64 = [&buff,&field_pos,field_end]( uint64_t &value ){
+        if( (field_pos + 8) <= field_end )
+        {
+          memcpy( &value, &buff[field_pos], 8 );
+          field_pos += 8;
+        }
+      };
+      
+      if( uncompressed_size32 == sm_zip64_32bit_marker )
+        read_uint64( uncompressed_size );
+      if( compressed_size32 == sm_zip64_32bit_marker )
+        read_uint64( compressed_size );
+      if( globalHeader && (header_offset32 == sm_zip64_32bit_marker) )
+        read_uint64( header_offset );
+    }//if( field_id == 0x0001 )
+    
+    pos = field_end;
+  }//for( loop over extra fields )
+  
   if( globalHeader )
     istream.read( &buff[0],comment_length);
   
-  return true;
+  return !!istream;
 }//bool init( istream& istream, const bool globalHeader )
 
 
@@ -128,100 +334,9 @@ size_t read_file_from_zip( std::istream &instrm,
   if( !header )
     throw runtime_error( "ZipArchive: no zip file header passed in to read" );
   
-  instrm.seekg( header->header_offset );
-  
-  unsigned int total_read = 0;
-  int total_uncompressed = 0;
-  const unsigned int buffer_size = 512;
-  unsigned char in[buffer_size], out[buffer_size];
-  const uint16_t DEFLATE = 8;
-  const uint16_t UNCOMPRESSED = 0;
-    
-  z_stream strm;
-    
-  strm.zalloc   = Z_NULL;
-  strm.zfree    = Z_NULL;
-  strm.opaque   = Z_NULL;
-  strm.avail_in = 0;
-  strm.next_in  = Z_NULL;
-  
-
-  ZipFileHeader localheader;
-  if( !localheader.init( instrm, false ) )
-    throw runtime_error( "ZipArchive: error reading header from stream" );
-  
-  
-  // initialize the inflate
-  if( header->compression_type == DEFLATE ) //should maybye use localheader
-  {
-    int result = inflateInit2( &strm, -MAX_WBITS );
-    if( result != Z_OK )
-      throw runtime_error( "ZipArchive: gzip inflateInit2 didnt return Z_OK" );
-    
-    bool end_of_file = false;
-    while( !end_of_file )
-    {
-      strm.avail_out = buffer_size-4;
-      strm.next_out = (Bytef*)(out+4);
-      
-      while( strm.avail_out != 0 )
-      {
-        if( strm.avail_in == 0 ) // buffer empty, read some more from file
-        {
-          if( header->compressed_size <= total_read )
-            throw runtime_error( "ZipArchive: read size error" );
-          
-          const unsigned int nToRead = std::min( buffer_size,
-                                        header->compressed_size - total_read );
-             
-          instrm.read( (char*)in, nToRead );
-          strm.avail_in = static_cast<unsigned int>( instrm.gcount() );
-          total_read += strm.avail_in;
-          strm.next_in = (Bytef*)in;
-        }//if( strm.avail_in == 0 )
-        
-        const int ret = inflate( &strm, Z_NO_FLUSH ); // decompress
-        switch( ret )
-        {
-          case Z_STREAM_ERROR:
-            throw runtime_error( "ZipArchive: libz error Z_STREAM_ERROR" );
-          
-          case Z_NEED_DICT:
-          case Z_DATA_ERROR:
-          case Z_MEM_ERROR:
-            throw runtime_error( "ZipArchive: gzip error "
-                                 + string(strm.msg ? strm.msg : "(no msg)") );
-          default:
-            break;
-        }//switch( ret )
-        
-        if( ret == Z_STREAM_END )
-        {
-          end_of_file = true;
-          break;
-        }
-      }//while( strm.avail_out != 0 )
-      
-      const int unzip_count = buffer_size - strm.avail_out - 4;
-      
-      output.write( (const char *) (out + 4), unzip_count );
-      
-      total_uncompressed += unzip_count;
-    }
-    
-    inflateEnd( &strm );
-    return total_uncompressed;
-  }else if( header->compression_type == UNCOMPRESSED )
-  {
-    const size_t nread = std::min( buffer_size - 4,
-                                   header->uncompressed_size - total_read );
-    instrm.read( (char*)(out+4), nread );
-    return static_cast<size_t>( instrm.gcount() );
-  }else
-  {
-    throw runtime_error( "ZipArchive: unrecognized compression" );
-  }//if( header->compression_type == DEFLATE ) / else UNCOMPRESSED / else
-  
+  return inflate_entry( instrm, *header, [&output]( const char *data, const size_t nbytes ){
+    output.write( data, nbytes );
+  } );
 }//size_t read_file_from_zip(...)
 
 
@@ -249,13 +364,13 @@ std::map<std::string, std::shared_ptr<const ZipFileHeader> >
   
   instrm.read( buf.get(),read_start);
   
-  bool foundheader = false;
-  size_t headerstart = -1;
-  for( size_t i = 0; static_cast<std::streamoff>(i) < read_start-3; i++)
+  // Search backwards, since the end of central directory record is the last thing in the file,
+  //  except for the comment.
+  std::streamoff headerstart = -1;
+  for( std::streamoff i = read_start - 4; i >= 0; --i )
   {
     if( buf[i]==0x50 && buf[i+1]==0x4b && buf[i+2]==0x05 && buf[i+3]==0x06 )
     {
-      foundheader = true;
       headerstart = i;
       break;
     }
@@ -266,36 +381,92 @@ std::map<std::string, std::shared_ptr<const ZipFileHeader> >
     throw runtime_error( "ZipArchive: Couldnt find zip header" );
   
   const std::streamoff nbytesFromEnd = read_start - headerstart;
-  instrm.seekg( end_position - nbytesFromEnd );
+  const std::streamoff end_of_central_pos = end_position - nbytesFromEnd;
+  instrm.seekg( end_of_central_pos );
   
   uint32_t word;
-  uint16_t this_disk_num, end_disk_num, num_files, num_files_this_disk;
+  uint16_t this_disk_num, end_disk_num, num_files16, num_files_this_disk16;
   binaryRead( instrm, word ); // end of central
   binaryRead( instrm, this_disk_num ); // this disk number
   binaryRead( instrm, end_disk_num ); // this disk number
   
-  if( this_disk_num != end_disk_num || this_disk_num != 0 )
-    throw runtime_error( "ZipArchive: multi-disk zip files not supported" );
+  binaryRead( instrm, num_files16 );
+  binaryRead( instrm, num_files_this_disk16 );
   
-  binaryRead( instrm, num_files );
-  binaryRead( instrm, num_files_this_disk );
+  uint32_t header_size32, header_offset32;
+  binaryRead( instrm, header_size32 ); // size of header
+  binaryRead( instrm, header_offset32 ); // offset to header
   
-  if( num_files != num_files_this_disk )
+  uint64_t num_files = num_files16, num_files_this_disk = num_files_this_disk16;
+  uint64_t header_offset = header_offset32;
+  
+  // If any of the fields are saturated, this is a ZIP64 archive, and the actual values are in the
+  //  ZIP64 end of central directory record, which is pointed to by a locator that immediately
+  //  precedes the end of central directory record.
+  if( (num_files16 == sm_zip64_16bit_marker)
+      || (num_files_this_disk16 == sm_zip64_16bit_marker)
+      || (header_size32 == sm_zip64_32bit_marker)
+      || (header_offset32 == sm_zip64_32bit_marker) )
+  {
+    const std::streamoff locator_size = 20;
+    if( end_of_central_pos < locator_size )
+      throw runtime_error( "ZipArchive: missing ZIP64 end of central directory locator" );
+    
+    instrm.seekg( end_of_central_pos - locator_size );
+    
+    uint32_t locator_sig, zip64_disk, total_disks;
+    uint64_t zip64_end_offset;
+    binaryRead( instrm, locator_sig );
+    binaryRead( instrm, zip64_disk );
+    binaryRead( instrm, zip64_end_offset );
+    binaryRead( instrm, total_disks );
+    
+    if( !instrm || (locator_sig != 0x07064b50) )
+      throw runtime_error( "ZipArchive: invalid ZIP64 end of central directory locator" );
+    
+    if( zip64_disk != 0 || total_disks > 1 )
+      throw runtime_error( "ZipArchive: multi-disk zip files not supported" );
+    
+    instrm.seekg( static_cast<std::streamoff>(zip64_end_offset) );
+    
+    uint32_t zip64_sig, zip64_this_disk, zip64_cd_disk;
+    uint16_t version_made_by, version_needed;
+    uint64_t record_size, zip64_header_size;
+    binaryRead( instrm, zip64_sig );
+    binaryRead( instrm, record_size );
+    binaryRead( instrm, version_made_by );
+    binaryRead( instrm, version_needed );
+    binaryRead( instrm, zip64_this_disk );
+    binaryRead( instrm, zip64_cd_disk );
+    binaryRead( instrm, num_files_this_disk );
+    binaryRead( instrm, num_files );
+    binaryRead( instrm, zip64_header_size );
+    binaryRead( instrm, header_offset );
+    
+    if( !instrm || (zip64_sig != 0x06064b50) )
+      throw runtime_error( "ZipArchive: invalid ZIP64 end of central directory record" );
+    
+    if( zip64_this_disk != 0 || zip64_cd_disk != 0 )
+      throw runtime_error( "ZipArchive: multi-disk zip files not supported" );
+  }else if( this_disk_num != end_disk_num || this_disk_num != 0 )
+  {
     throw runtime_error( "ZipArchive: multi-disk zip files not supported" );
+  }//if( a ZIP64 archive ) / else
   
-  uint32_t header_size, header_offset;
-  binaryRead( instrm, header_size ); // size of header
-  binaryRead( instrm, header_offset ); // offset to header
+  if( num_files != num_files_this_disk )
+    throw runtime_error( "ZipArchive: multi-disk zip files not supported" );
   
   //lets read all the file headers
   map<std::string, std::shared_ptr<const ZipFileHeader> > answer;
-  instrm.seekg( header_offset );
-  for( uint16_t i = 0; i < num_files; ++i )
+  instrm.seekg( static_cast<std::streamoff>(header_offset) );
+  for( uint64_t i = 0; i < num_files; ++i )
   {
     std::shared_ptr<ZipFileHeader> header( new ZipFileHeader );
     const bool valid = header->init( instrm, true );
     if( valid )
       answer[header->filename] = header;
+    else if( !instrm )
+      break;
   }
   
   if( answer.empty() )
@@ -303,5 +474,102 @@ std::map<std::string, std::shared_ptr<const ZipFileHeader> >
   
   return answer;
 }
-}//namespace ZipArchive
 
+
+MappedZipArchive::MappedZipArchive( const std::string &filename )
+  : m_data( nullptr ),
+    m_size( 0 )
+{
+  try
+  {
+    using namespace boost::interprocess;
+    m_file.reset( new file_mapping( filename.c_str(), read_only ) );
+    m_region.reset( new mapped_region( *m_file, read_only ) );
+  }catch( std::exception &e )
+  {
+    throw runtime_error( "ZipArchive: unable to memory map file: " + string(e.what()) );
+  }//try / catch
+  
+  m_data = static_cast<const char *>( m_region->get_address() );
+  m_size = m_region->get_size();
+  
+  MemoryStreamBuf buffer( m_data, m_size );
+  std::istream instrm( &buffer );
+  m_headers = open_zip_file( instrm );
+}//MappedZipArchive constructor
+
+
+MappedZipArchive::~MappedZipArchive()
+{
+  // Defined here, so the boost::interprocess types are complete for the std::unique_ptr's
+}
+
+
+const FilenameToZipHeaderMap &MappedZipArchive::headers() const
+{
+  return m_headers;
+}
+
+
+std::vector<char> MappedZipArchive::read_file( std::shared_ptr<const ZipFileHeader> header ) const
+{
+  if( !header )
+    throw runtime_error( "ZipArchive: no zip file header passed in to read" );
+  
+  if( header->header_offset >= m_size )
+    throw runtime_error( "ZipArchive: invalid local header offset" );
+  
+  std::vector<char> answer;
+  
+  // Deflate can compress by at most ~1032:1, so dont trust a header that claims more than that
+  const uint64_t max_uncompressed = 1032*header->compressed_size + 1024;
+  answer.reserve( static_cast<size_t>( std::min( header->uncompressed_size, max_uncompressed ) ) );
+  
+  MemoryStreamBuf buffer( m_data, m_size );
+  std::istream instrm( &buffer );
+  
+  inflate_entry( instrm, *header, [&answer]( const char *data, const size_t nbytes ){
+    answer.insert( answer.end(), data, data + nbytes );
+  } );
+  
+  return answer;
+}//std::vector<char> read_file( std::shared_ptr<const ZipFileHeader> header ) const
+
+
+std::vector<MappedZipArchive::ExtractedFile> MappedZipArchive::read_files(
+                  const std::vector<std::shared_ptr<const ZipFileHeader>> &headers ) const
+{
+  std::vector<ExtractedFile> answer( headers.size() );
+  for( size_t i = 0; i < headers.size(); ++i )
+    answer[i].header = headers[i];
+  
+  // Archives may have thousands of entries, so instead of posting a job per entry, we will post a
+  //  job per core, and have each job pull the next entry to inflate.
+  std::atomic<size_t> next_entry( 0 );
+  const auto worker = [this,&answer,&next_entry](){
+    for( size_t i = next_entry++; i < answer.size(); i = next_entry++ )
+    {
+      ExtractedFile &result = answer[i];
+      try
+      {
+        result.data = read_file( result.header );
+      }catch( std::exception &e )
+      {
+        result.data.clear();
+        result.error = e.what();
+      }//try / catch
+    }//for( loop over entries )
+  };//worker
+  
+  const size_t ncores = static_cast<size_t>( std::max( 1, SpecUtilsAsync::num_logical_cpu_cores() ) );
+  const size_t nthreads = std::min( ncores, answer.size() );
+  
+  SpecUtilsAsync::ThreadPool pool;
+  for( size_t i = 0; i < nthreads; ++i )
+    pool.post( worker );
+  
+  pool.join();
+  
+  return answer;
+}//std::vector<ExtractedFile> read_files(...) const
+}//namespace ZipArchive
@@ -0,0 +1,229 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/** A stand-in for the Full-Spectrum executable, for testing #ExternalRid::WorkerPool.
+
+ Supports the two ways InterSpec runs the executable:
+   - "--mode=command-line --out-format=json --drf <drf> [--synthesize-background=1] <file>", which
+     writes the JSON results to stdout and exits.
+   - "--mode=http-server --http-address=<address> --http-port=<port>", which serves the "/info" and
+     "/analysis" POST requests of the REST service, one at a time, until killed.
+
+ Results are JSON of the form
+   {"code": 0, "drf": "<drf>", "mode": "<command-line or http-server>", "pid": <pid>,
+    "requestNumber": <nth analysis this process has done>}
+ and a DRF of "invalid" causes an error (non-zero exit code, or HTTP status 400).
+
+ Behavior can be altered with environment variables:
+   - MOCK_FULL_SPEC_NO_SERVER: if set, the web-service mode fails to start.
+   - MOCK_FULL_SPEC_STARTUP_DELAY: milliseconds to wait before listening in web-service mode.
+   - MOCK_FULL_SPEC_ANALYSIS_DELAY: milliseconds each analysis takes.
+ */
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <boost/asio.hpp>
+#include <boost/process/environment.hpp>
+
+using namespace std;
+
+
+namespace
+{
+  int env_milliseconds( const char *name )
+  {
+    const char *value = std::getenv( name );
+    return value ? std::atoi( value ) : 0;
+  }
+
+
+  string results_json( const string &drf, const string &mode, const int request_number )
+  {
+    return "{\"code\": 0, \"drf\": \"" + drf + "\", \"mode\": \"" + mode + "\", \"pid\": "
+           + std::to_string( boost::this_process::get_id() ) + ", \"requestNumber\": "
+           + std::to_string( request_number ) + "}";
+  }
+
+
+  int run_command_line( int argc, char **argv )
+  {
+    string drf, filename;
+    for( int i = 1; i < argc; ++i )
+    {
+      const string arg = argv[i];
+      if( (arg == "--drf") && ((i + 1) < argc) )
+        drf = argv[++i];
+      else if( arg.substr( 0, 2 ) != "--" )
+        filename = arg;
+    }
+
+    if( drf == "invalid" )
+    {
+      cerr << "Invalid DRF" << endl;
+      return EXIT_FAILURE;
+    }
+
+    if( !ifstream( filename.c_str() ).is_open() )
+    {
+      cerr << "Could not open '" << filename << "'" << endl;
+      return EXIT_FAILURE;
+    }
+
+    std::this_thread::sleep_for( std::chrono::milliseconds( env_milliseconds("MOCK_FULL_SPEC_ANALYSIS_DELAY") ) );
+
+    cout << results_json( drf, "command-line", 1 ) << endl;
+
+    return EXIT_SUCCESS;
+  }//int run_command_line( int argc, char **argv )
+
+
+  int run_http_server( int argc, char **argv )
+  {
+    namespace asio = boost::asio;
+
+    if( std::getenv( "MOCK_FULL_SPEC_NO_SERVER" ) )
+    {
+      cerr << "Unrecognized mode" << endl;
+      return EXIT_FAILURE;
+    }
+
+    unsigned short port = 0;
+    string address = "127.0.0.1";
+    for( int i = 1; i < argc; ++i )
+    {
+      const string arg = argv[i];
+      if( arg.substr( 0, 12 ) == "--http-port=" )
+        port = static_cast<unsigned short>( std::atoi( arg.c_str() + 12 ) );
+      else if( arg.substr( 0, 15 ) == "--http-address=" )
+        address = arg.substr( 15 );
+    }
+
+    std::this_thread::sleep_for( std::chrono::milliseconds( env_milliseconds("MOCK_FULL_SPEC_STARTUP_DELAY") ) );
+
+    asio::io_context ioc;
+    asio::ip::tcp::acceptor acceptor( ioc, asio::ip::tcp::endpoint(asio::ip::make_address(address), port) );
+
+    int num_analyses = 0;
+
+    while( true )
+    {
+      asio::ip::tcp::socket socket( ioc );
+      acceptor.accept( socket );
+
+      boost::system::error_code ec;
+      asio::streambuf buffer;
+      const size_t header_size = asio::read_until( socket, buffer, "\r\n\r\n", ec );
+      if( ec )
+        continue;
+
+      const string data( asio::buffers_begin(buffer.data()), asio::buffers_end(buffer.data()) );
+      const string header = data.substr( 0, header_size );
+
+      size_t content_length = 0;
+      const size_t length_pos = header.find( "Content-Length: " );
+      if( length_pos != string::npos )
+        content_length = static_cast<size_t>( std::atol( header.c_str() + length_pos + 16 ) );
+
+      string body = data.substr( header_size );
+      if( body.size() < content_length )
+      {
+        string remaining( content_length - body.size(), '\0' );
+        asio::read( socket, asio::buffer(&remaining[0], remaining.size()), ec );
+        if( ec )
+          continue;
+        body += remaining;
+      }//if( body.size() < content_length )
+
+      int status = 200;
+      string content;
+
+      if( header.compare( 0, 11, "POST /info " ) == 0 )
+      {
+        content = "{\"versions\": {\"mock_full_spec\": \"1\"}}";
+      }else if( header.compare( 0, 15, "POST /analysis " ) == 0 )
+      {
+        const string drf_key = "{\"drf\": \"";
+        const size_t drf_start = body.find( drf_key );
+        const size_t drf_end = (drf_start == string::npos) ? drf_start : body.find( '"', drf_start + drf_key.size() );
+
+        if( (drf_end == string::npos) || (body.find( "name=\"foreground\"" ) == string::npos) )
+        {
+          status = 400;
+          content = "Invalid analysis request";
+        }else
+        {
+          const string drf = body.substr( drf_start + drf_key.size(), drf_end - drf_start - drf_key.size() );
+
+          std::this_thread::sleep_for( std::chrono::milliseconds( env_milliseconds("MOCK_FULL_SPEC_ANALYSIS_DELAY") ) );
+
+          if( drf == "invalid" )
+          {
+            status = 400;
+            content = "Invalid DRF";
+          }else
+          {
+            content = results_json( drf, "http-server", ++num_analyses );
+          }
+        }//if( invalid request ) / else
+      }else
+      {
+        status = 404;
+        content = "Not found";
+      }
+
+      const string response = "HTTP/1.0 " + std::to_string(status)
+                              + ((status == 200) ? " OK" : " Error") + "\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Content-Length: " + std::to_string(content.size()) + "\r\n"
+                              "\r\n" + content;
+      asio::write( socket, asio::buffer(response), ec );
+      socket.shutdown( asio::ip::tcp::socket::shutdown_both, ec );
+    }//while( true )
+
+    return EXIT_SUCCESS;
+  }//int run_http_server( int argc, char **argv )
+}//namespace
+
+
+int main( int argc, char **argv )
+{
+  for( int i = 1; i < argc; ++i )
+  {
+    const string arg = argv[i];
+    if( arg == "--mode=command-line" )
+      return run_command_line( argc, argv );
+
+    if( arg == "--mode=http-server" )
+      return run_http_server( argc, argv );
+  }//for( int i = 1; i < argc; ++i )
+
+  cerr << "Usage: " << argv[0] << " --mode=command-line|--mode=http-server ..." << endl;
+
+  return EXIT_FAILURE;
+}//int main( int argc, char **argv )
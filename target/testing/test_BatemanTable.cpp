@@ -0,0 +1,234 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#define BOOST_TEST_MODULE test_BatemanTable
+#include <boost/test/included/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "InterSpec/BatemanTable.h"
+#include "InterSpec/DecayDataBaseServer.h"
+
+using namespace std;
+
+// SANDIA_DECAY_XML is defined by CMake to be the path of the nuclear decay database.
+
+
+namespace
+{
+  /** Sets the decay database file once, for all the test cases. */
+  struct DecayDataBaseFixture
+  {
+    DecayDataBaseFixture()
+    {
+      DecayDataBaseServer::setDecayXmlFile( SANDIA_DECAY_XML );
+    }
+  };//struct DecayDataBaseFixture
+
+
+  const SandiaDecay::Nuclide *nuclide( const string &symbol )
+  {
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    BOOST_REQUIRE( db );
+    const SandiaDecay::Nuclide *nuc = db->nuclide( symbol );
+    BOOST_REQUIRE_MESSAGE( nuc, "Could not find " << symbol );
+    return nuc;
+  }//nuclide(...)
+
+
+  /** The photon lines, summed by energy, from a #SandiaDecay::NuclideMixture; normalized the same as
+   #BatemanTable (a parent activity of 1.0 at the given age).
+   */
+  map<double,double> mixture_yields( const SandiaDecay::Nuclide *parent, const double age,
+                                     const bool include_xrays )
+  {
+    SandiaDecay::NuclideMixture mix;
+    mix.addAgedNuclideByActivity( parent, 1.0, age );
+    vector<SandiaDecay::EnergyRatePair> photons
+                      = mix.gammas( 0.0, SandiaDecay::NuclideMixture::OrderByEnergy, true );
+    if( include_xrays )
+    {
+      const vector<SandiaDecay::EnergyRatePair> xrays
+                                  = mix.xrays( 0.0, SandiaDecay::NuclideMixture::OrderByEnergy );
+      photons.insert( end(photons), begin(xrays), end(xrays) );
+    }
+
+    map<double,double> yields;
+    for( const SandiaDecay::EnergyRatePair &erp : photons )
+      yields[erp.energy] += erp.numPerSecond;
+
+    return yields;
+  }//mixture_yields(...)
+
+
+  /** Nuclides with long and branching decay chains, and the ages (in units of their half-lives) to
+   check them at.
+   */
+  const char * const sm_nuclides[] = { "Pu241", "Pu239", "U238", "U235", "Th232", "Ra226",
+                                       "Ba133", "Eu152", "Co60", "Cs137" };
+  const double sm_ages_in_half_lives[] = { 0.0, 0.001, 0.05, 0.5, 1.0, 2.0 };
+}//namespace
+
+
+BOOST_GLOBAL_FIXTURE( DecayDataBaseFixture );
+
+
+BOOST_AUTO_TEST_CASE( YieldsMatchMixture )
+{
+  for( const char * const symbol : sm_nuclides )
+  {
+    const SandiaDecay::Nuclide * const parent = nuclide( symbol );
+
+    for( const bool include_xrays : {false, true} )
+    {
+      const BatemanTable table( parent, include_xrays );
+
+      vector<BatemanTable::LineYield> lines;
+      for( const double num_half_lives : sm_ages_in_half_lives )
+      {
+        const double age = num_half_lives * parent->halfLife;
+        table.evaluate( age, lines, false );
+
+        map<double,double> table_yields;
+        for( const BatemanTable::LineYield &line : lines )
+          table_yields[line.energy] += line.yield;
+
+        const map<double,double> mix_yields = mixture_yields( parent, age, include_xrays );
+
+        double max_yield = 0.0;
+        for( const auto &ey : mix_yields )
+          max_yield = std::max( max_yield, ey.second );
+
+        for( const auto &ey : mix_yields )
+        {
+          const auto pos = table_yields.find( ey.first );
+          const double table_yield = (pos == end(table_yields)) ? 0.0 : pos->second;
+          const double diff = fabs( table_yield - ey.second );
+          const bool close = (diff <= 1.0E-5*std::max(fabs(table_yield),fabs(ey.second)))
+                             || (diff <= 1.0E-9*max_yield);
+          BOOST_CHECK_MESSAGE( close, symbol << " at " << num_half_lives << " half-lives, "
+                               << ey.first << " keV (x-rays=" << include_xrays << "): table gives "
+                               << table_yield << ", mixture gives " << ey.second );
+        }//for( const auto &ey : mix_yields )
+      }//for( const double num_half_lives : sm_ages_in_half_lives )
+    }//for( const bool include_xrays : {false, true} )
+  }//for( const char * const symbol : sm_nuclides )
+}//BOOST_AUTO_TEST_CASE( YieldsMatchMixture )
+
+
+BOOST_AUTO_TEST_CASE( AgeDerivativeMatchesNumerical )
+{
+  for( const char * const symbol : sm_nuclides )
+  {
+    const SandiaDecay::Nuclide * const parent = nuclide( symbol );
+    const BatemanTable table( parent, true );
+
+    vector<BatemanTable::LineYield> lines, upper_lines, lower_lines;
+    for( const double num_half_lives : sm_ages_in_half_lives )
+    {
+      const double age = num_half_lives * parent->halfLife;
+      const double h = std::max( 1.0E-4*age, 1.0E-6*parent->halfLife );
+      if( age <= h )
+        continue;
+
+      table.evaluate( age, lines, true );
+      table.evaluate( age + h, upper_lines, false );
+      table.evaluate( age - h, lower_lines, false );
+      BOOST_REQUIRE_EQUAL( lines.size(), upper_lines.size() );
+      BOOST_REQUIRE_EQUAL( lines.size(), lower_lines.size() );
+
+      double max_yield = 0.0;
+      for( const BatemanTable::LineYield &line : lines )
+        max_yield = std::max( max_yield, line.yield );
+
+      for( size_t i = 0; i < lines.size(); ++i )
+      {
+        const double numeric = (upper_lines[i].yield - lower_lines[i].yield) / (2.0*h);
+        const double analytic = lines[i].dyield_dage;
+        const double diff = fabs( numeric - analytic );
+        const bool close = (diff <= 1.0E-3*std::max(fabs(numeric),fabs(analytic)))
+                           || (diff <= 1.0E-9*max_yield/parent->halfLife);
+        BOOST_CHECK_MESSAGE( close, symbol << " at " << num_half_lives << " half-lives, "
+                             << lines[i].energy << " keV: analytic derivative " << analytic
+                             << ", numerical " << numeric );
+      }//for( size_t i = 0; i < lines.size(); ++i )
+    }//for( const double num_half_lives : sm_ages_in_half_lives )
+  }//for( const char * const symbol : sm_nuclides )
+}//BOOST_AUTO_TEST_CASE( AgeDerivativeMatchesNumerical )
+
+
+BOOST_AUTO_TEST_CASE( EvaluateBenchmark )
+{
+  // Not a pass/fail test; reports the cost of getting the photon lines at a new age, as is done for
+  //  every trial age when fitting ages.  Run with "--log_level=message" to see the results.
+  typedef std::chrono::high_resolution_clock Clock;
+
+  const size_t num_evaluations = 200;
+
+  for( const char * const symbol : { "Pu241", "U238", "Eu152" } )
+  {
+    const SandiaDecay::Nuclide * const parent = nuclide( symbol );
+
+    double sum = 0.0;  //Keep the compiler from optimizing the loops away
+
+    auto start = Clock::now();
+    const BatemanTable table( parent, false );
+    const double construct_us = std::chrono::duration<double,std::micro>( Clock::now() - start ).count();
+
+    vector<BatemanTable::LineYield> lines;
+    start = Clock::now();
+    for( size_t i = 0; i < num_evaluations; ++i )
+    {
+      table.evaluate( (0.01 + i) * 0.01 * parent->halfLife, lines, true );
+      sum += lines.empty() ? 0.0 : lines.front().yield;
+    }
+    const double table_us = std::chrono::duration<double,std::micro>( Clock::now() - start ).count();
+
+    start = Clock::now();
+    for( size_t i = 0; i < num_evaluations; ++i )
+    {
+      const map<double,double> yields = mixture_yields( parent, (0.01 + i) * 0.01 * parent->halfLife, false );
+      sum += yields.empty() ? 0.0 : yields.begin()->second;
+    }
+    const double mixture_us = std::chrono::duration<double,std::micro>( Clock::now() - start ).count();
+
+    stringstream msg;
+    msg << symbol << ": table construction " << construct_us << " us, per-age evaluation "
+        << (table_us / num_evaluations) << " us (with derivatives), per-age NuclideMixture "
+        << (mixture_us / num_evaluations) << " us (checksum " << sum << ")";
+    BOOST_TEST_MESSAGE( msg.str() );
+
+    BOOST_CHECK( std::isfinite( sum ) );
+  }//for( loop over nuclides )
+}//BOOST_AUTO_TEST_CASE( EvaluateBenchmark )
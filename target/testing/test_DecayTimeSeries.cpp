@@ -0,0 +1,167 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "InterSpec_config.h"
+
+#include <map>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define BOOST_TEST_MODULE test_DecayTimeSeries
+#include <boost/test/included/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "InterSpec/DecayTimeSeries.h"
+#include "InterSpec/DecayDataBaseServer.h"
+
+using namespace std;
+
+// SANDIA_DECAY_XML is defined by CMake to be the path of the nuclear decay database.
+
+
+namespace
+{
+  /** Sets the decay database file once, for all the test cases. */
+  struct DecayDataBaseFixture
+  {
+    DecayDataBaseFixture()
+    {
+      DecayDataBaseServer::setDecayXmlFile( SANDIA_DECAY_XML );
+    }
+  };//struct DecayDataBaseFixture
+
+
+  const SandiaDecay::Nuclide *nuclide( const string &symbol )
+  {
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    BOOST_REQUIRE( db );
+    const SandiaDecay::Nuclide *nuc = db->nuclide( symbol );
+    BOOST_REQUIRE_MESSAGE( nuc, "Could not find " << symbol );
+    return nuc;
+  }//nuclide(...)
+
+
+  /** Checks the activities #DecayTimeSeries gives for a mixture, at each of 'times', against
+   #SandiaDecay::NuclideMixture::activity.
+   */
+  void check_against_mixture( const SandiaDecay::NuclideMixture &mixture,
+                              const vector<double> &times, const string &description )
+  {
+    for( const bool include_stable : {false, true} )
+    {
+      const DecayTimeSeries series( mixture, include_stable );
+      const vector<const SandiaDecay::Nuclide *> &nucs = series.nuclides();
+      const size_t num_nuc = series.numNuclides();
+      BOOST_REQUIRE_EQUAL( nucs.size(), num_nuc );
+      BOOST_CHECK( num_nuc > 0 );
+
+      vector<double> activities;
+      series.activities( times, activities );
+      BOOST_REQUIRE_EQUAL( activities.size(), times.size() * num_nuc );
+
+      for( size_t time_index = 0; time_index < times.size(); ++time_index )
+      {
+        const double t = times[time_index];
+
+        map<const SandiaDecay::Nuclide *,double> expected;
+        double max_activity = 0.0;
+        for( const SandiaDecay::NuclideActivityPair &nap : mixture.activity( t ) )
+        {
+          expected[nap.nuclide] += nap.activity;
+          max_activity = std::max( max_activity, fabs(nap.activity) );
+        }
+
+        for( size_t n = 0; n < num_nuc; ++n )
+        {
+          const auto pos = expected.find( nucs[n] );
+          const double mix_act = (pos == end(expected)) ? 0.0 : pos->second;
+          const double series_act = activities[time_index*num_nuc + n];
+
+          const double diff = fabs( series_act - mix_act );
+          const bool close = (diff <= 1.0E-6*std::max(fabs(series_act),fabs(mix_act)))
+                             || (diff <= 1.0E-12*max_activity);
+          BOOST_CHECK_MESSAGE( close, description << ", " << nucs[n]->symbol << " at t=" << t
+                               << " s: series gives " << series_act << ", mixture gives " << mix_act );
+        }//for( size_t n = 0; n < num_nuc; ++n )
+      }//for( loop over times )
+    }//for( const bool include_stable : {false, true} )
+  }//check_against_mixture(...)
+}//namespace
+
+
+BOOST_GLOBAL_FIXTURE( DecayDataBaseFixture );
+
+
+BOOST_AUTO_TEST_CASE( ActivitiesMatchMixture )
+{
+  // Nuclides with long and branching decay chains, and ones without any progeny
+  const char * const symbols[] = { "Pu241", "U238", "U235", "Th232", "Ra226", "Eu152", "Co60", "Cs137" };
+
+  // Unsorted, and not evenly spaced, in units of the parents half-life
+  const double num_half_lives[] = { 1.0, 0.0, 0.001, 3.0, 0.05, 0.5 };
+
+  for( const char * const symbol : symbols )
+  {
+    const SandiaDecay::Nuclide * const parent = nuclide( symbol );
+
+    SandiaDecay::NuclideMixture mixture;
+    mixture.addNuclideByActivity( parent, 1.0E-3 * SandiaDecay::curie );
+
+    vector<double> times;
+    for( const double n : num_half_lives )
+      times.push_back( n * parent->halfLife );
+
+    check_against_mixture( mixture, times, symbol );
+  }//for( const char * const symbol : symbols )
+
+  // A mixture with several parents, some already aged, sharing parts of their decay chains
+  SandiaDecay::NuclideMixture mixture;
+  mixture.addAgedNuclideByActivity( nuclide("U238"), 1.0E-3 * SandiaDecay::curie, 20.0 * 365.25 * 86400.0 );
+  mixture.addAgedNuclideByActivity( nuclide("U235"), 5.0E-5 * SandiaDecay::curie, 20.0 * 365.25 * 86400.0 );
+  mixture.addNuclideByActivity( nuclide("Pu239"), 2.0E-4 * SandiaDecay::curie );
+  mixture.addNuclideByActivity( nuclide("Pu241"), 1.0E-3 * SandiaDecay::curie );
+
+  const double year = 365.25 * 86400.0;
+  check_against_mixture( mixture, { 0.0, 1.0*year, 0.1*year, 100.0*year, 1.0E4*year }, "U/Pu mixture" );
+}//BOOST_AUTO_TEST_CASE( ActivitiesMatchMixture )
+
+
+BOOST_AUTO_TEST_CASE( EmptyMixture )
+{
+  // No nuclides means no columns, so the result should be empty no matter how many times are asked
+  //  for (this used to index into the empty result).
+  SandiaDecay::NuclideMixture mixture;
+  const DecayTimeSeries series( mixture );
+  BOOST_CHECK_EQUAL( series.numNuclides(), size_t(0) );
+
+  vector<double> activities( 5, 1.0 );
+  series.activities( { 0.0, 1.0, 1000.0 }, activities );
+  BOOST_CHECK( activities.empty() );
+
+  series.activities( {}, activities );
+  BOOST_CHECK( activities.empty() );
+}//BOOST_AUTO_TEST_CASE( EmptyMixture )
@@ -0,0 +1,333 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+#define BOOST_TEST_MODULE test_ExternalRidWorkerPool
+#include <boost/test/included/unit_test.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include "InterSpec/ExternalRidWorkerPool.h"
+
+using namespace std;
+
+// MOCK_FULL_SPEC_EXE is defined by CMake to be the path of the mock_full_spec executable.
+
+
+namespace
+{
+  void set_env( const char *name, const char *value )
+  {
+#ifdef _WIN32
+    _putenv_s( name, value ? value : "" );
+#else
+    if( value )
+      setenv( name, value, 1 );
+    else
+      unsetenv( name );
+#endif
+  }//void set_env(...)
+
+
+  /** Sets the mock executables environment variables for the duration of a test case. */
+  struct MockEnvironment
+  {
+    MockEnvironment( const char *no_server, const char *startup_delay, const char *analysis_delay )
+    {
+      set_env( "MOCK_FULL_SPEC_NO_SERVER", no_server );
+      set_env( "MOCK_FULL_SPEC_STARTUP_DELAY", startup_delay );
+      set_env( "MOCK_FULL_SPEC_ANALYSIS_DELAY", analysis_delay );
+    }
+
+    ~MockEnvironment()
+    {
+      set_env( "MOCK_FULL_SPEC_NO_SERVER", nullptr );
+      set_env( "MOCK_FULL_SPEC_STARTUP_DELAY", nullptr );
+      set_env( "MOCK_FULL_SPEC_ANALYSIS_DELAY", nullptr );
+    }
+  };//struct MockEnvironment
+
+
+  /** A spectrum file for the mock executable to "analyze"; removed on destruction. */
+  struct SpectrumFile
+  {
+    string path;
+
+    SpectrumFile()
+    {
+      path = (boost::filesystem::temp_directory_path()
+              / boost::filesystem::unique_path( "mock_full_spec_%%%%-%%%%.n42" )).string();
+      ofstream output( path.c_str() );
+      output << "<?xml version=\"1.0\"?>\n<RadInstrumentData></RadInstrumentData>\n";
+    }
+
+    ~SpectrumFile()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove( path, ec );
+    }
+  };//struct SpectrumFile
+
+
+  ExternalRid::AnalysisRequest make_request( const SpectrumFile &file, const string &drf )
+  {
+    ExternalRid::AnalysisRequest request;
+    request.spectrum_file = file.path;
+    request.drf = drf;
+    request.synthesize_background = true;
+    return request;
+  }
+
+
+  bool wait_for_idle_worker( ExternalRid::WorkerPool &pool, const size_t num_wanted )
+  {
+    const auto give_up_time = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while( std::chrono::steady_clock::now() < give_up_time )
+    {
+      if( pool.numIdleWorkers( MOCK_FULL_SPEC_EXE ) >= num_wanted )
+        return true;
+      std::this_thread::sleep_for( std::chrono::milliseconds(20) );
+    }
+
+    return false;
+  }//bool wait_for_idle_worker(...)
+
+
+  bool contains( const string &haystack, const string &needle )
+  {
+    return haystack.find( needle ) != string::npos;
+  }
+
+
+  double seconds_since( const std::chrono::steady_clock::time_point start )
+  {
+    return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+  }
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( CommandLineArguments )
+{
+  ExternalRid::AnalysisRequest request;
+  request.spectrum_file = "/tmp/spectrum.n42";
+  request.drf = "Detective-EX200";
+
+  request.synthesize_background = false;
+  const vector<string> expected{ "--mode=command-line", "--out-format=json", "--drf",
+                                 "Detective-EX200", "/tmp/spectrum.n42" };
+  BOOST_CHECK( ExternalRid::command_line_arguments( request ) == expected );
+
+  request.synthesize_background = true;
+  const vector<string> expected_synth{ "--mode=command-line", "--out-format=json", "--drf",
+                                       "Detective-EX200", "--synthesize-background=1",
+                                       "/tmp/spectrum.n42" };
+  BOOST_CHECK( ExternalRid::command_line_arguments( request ) == expected_synth );
+}//BOOST_AUTO_TEST_CASE( CommandLineArguments )
+
+
+BOOST_AUTO_TEST_CASE( FirstAnalysisDoesntWaitOnWorkerStartup )
+{
+  MockEnvironment env( nullptr, "3000", nullptr );
+  SpectrumFile file;
+
+  ExternalRid::WorkerPool pool{ ExternalRid::WorkerPool::Options() };
+
+  const auto start = std::chrono::steady_clock::now();
+  const string first = pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") );
+  BOOST_CHECK_LT( seconds_since( start ), 2.0 );
+  BOOST_CHECK( contains( first, "\"mode\": \"command-line\"" ) );
+  BOOST_CHECK( contains( first, "\"drf\": \"Detective-EX200\"" ) );
+
+  // The worker started in the background should be used once ready, and then reused.
+  BOOST_REQUIRE( wait_for_idle_worker( pool, 1 ) );
+
+  const string second = pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") );
+  BOOST_CHECK( contains( second, "\"mode\": \"http-server\"" ) );
+  BOOST_CHECK( contains( second, "\"requestNumber\": 1}" ) );
+
+  const string third = pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") );
+  BOOST_CHECK( contains( third, "\"mode\": \"http-server\"" ) );
+  BOOST_CHECK( contains( third, "\"requestNumber\": 2}" ) );
+  BOOST_CHECK_EQUAL( pool.numIdleWorkers( MOCK_FULL_SPEC_EXE ), 1 );
+}//BOOST_AUTO_TEST_CASE( FirstAnalysisDoesntWaitOnWorkerStartup )
+
+
+BOOST_AUTO_TEST_CASE( FallsBackWhenWorkerCantStart )
+{
+  MockEnvironment env( "1", nullptr, nullptr );
+  SpectrumFile file;
+
+  ExternalRid::WorkerPool::Options options;
+  options.startup_retry_delay = std::chrono::seconds(1);
+
+  ExternalRid::WorkerPool pool( options );
+  pool.prestart( MOCK_FULL_SPEC_EXE );
+
+  // Give the worker time to fail to start
+  std::this_thread::sleep_for( std::chrono::milliseconds(500) );
+
+  for( int i = 0; i < 3; ++i )
+  {
+    const string result = pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") );
+    BOOST_CHECK( contains( result, "\"mode\": \"command-line\"" ) );
+  }
+
+  BOOST_CHECK_EQUAL( pool.numIdleWorkers( MOCK_FULL_SPEC_EXE ), 0 );
+
+  // A single exit could be a lost race for the port, so a worker is tried again after the back-off;
+  //  the second exit in a row means the executable doesnt support the web-service mode.
+  std::this_thread::sleep_for( std::chrono::milliseconds(1500) );
+  pool.prestart( MOCK_FULL_SPEC_EXE );
+  std::this_thread::sleep_for( std::chrono::milliseconds(500) );
+
+  // So even once the executable could start as a service, it shouldnt be tried again.
+  set_env( "MOCK_FULL_SPEC_NO_SERVER", nullptr );
+  std::this_thread::sleep_for( std::chrono::milliseconds(2500) );
+  pool.prestart( MOCK_FULL_SPEC_EXE );
+  std::this_thread::sleep_for( std::chrono::milliseconds(500) );
+  BOOST_CHECK_EQUAL( pool.numIdleWorkers( MOCK_FULL_SPEC_EXE ), 0 );
+}//BOOST_AUTO_TEST_CASE( FallsBackWhenWorkerCantStart )
+
+
+BOOST_AUTO_TEST_CASE( RetriesAfterStartupTimeout )
+{
+  MockEnvironment env( nullptr, "3000", nullptr );
+  SpectrumFile file;
+
+  ExternalRid::WorkerPool::Options options;
+  options.startup_timeout = std::chrono::seconds(1);
+  options.startup_retry_delay = std::chrono::seconds(1);
+
+  ExternalRid::WorkerPool pool( options );
+  pool.prestart( MOCK_FULL_SPEC_EXE );
+
+  // Give the worker time to time out
+  std::this_thread::sleep_for( std::chrono::milliseconds(1500) );
+  BOOST_CHECK_EQUAL( pool.numIdleWorkers( MOCK_FULL_SPEC_EXE ), 0 );
+
+  // Once the executable starts quickly again, and the back-off has passed, a worker should be used.
+  set_env( "MOCK_FULL_SPEC_STARTUP_DELAY", nullptr );
+  std::this_thread::sleep_for( std::chrono::milliseconds(1500) );
+  pool.prestart( MOCK_FULL_SPEC_EXE );
+  BOOST_REQUIRE( wait_for_idle_worker( pool, 1 ) );
+
+  const string result = pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") );
+  BOOST_CHECK( contains( result, "\"mode\": \"http-server\"" ) );
+}//BOOST_AUTO_TEST_CASE( RetriesAfterStartupTimeout )
+
+
+BOOST_AUTO_TEST_CASE( AnalysisErrorKeepsWorker )
+{
+  MockEnvironment env( nullptr, nullptr, nullptr );
+  SpectrumFile file;
+
+  ExternalRid::WorkerPool pool{ ExternalRid::WorkerPool::Options() };
+  pool.prestart( MOCK_FULL_SPEC_EXE );
+  BOOST_REQUIRE( wait_for_idle_worker( pool, 1 ) );
+
+  BOOST_CHECK_THROW( pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "invalid") ),
+                     std::exception );
+  BOOST_CHECK_EQUAL( pool.numIdleWorkers( MOCK_FULL_SPEC_EXE ), 1 );
+
+  const string result = pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") );
+  BOOST_CHECK( contains( result, "\"mode\": \"http-server\"" ) );
+
+  // The command-line mode should report errors too
+  set_env( "MOCK_FULL_SPEC_NO_SERVER", "1" );
+  ExternalRid::WorkerPool no_worker_pool{ ExternalRid::WorkerPool::Options() };
+  BOOST_CHECK_THROW( no_worker_pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "invalid") ),
+                     std::exception );
+}//BOOST_AUTO_TEST_CASE( AnalysisErrorKeepsWorker )
+
+
+BOOST_AUTO_TEST_CASE( AnalysisTimeout )
+{
+  MockEnvironment env( nullptr, nullptr, "4000" );
+  SpectrumFile file;
+
+  ExternalRid::WorkerPool::Options options;
+  options.analysis_timeout = std::chrono::seconds(1);
+
+  ExternalRid::WorkerPool pool( options );
+
+  // Before a worker is ready, the analysis is run as its own process, which should be terminated.
+  auto start = std::chrono::steady_clock::now();
+  BOOST_CHECK_THROW( pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") ),
+                     std::exception );
+  BOOST_CHECK_LT( seconds_since( start ), 3.0 );
+
+  // And a worker that doesnt respond in time should be terminated, and not reused.
+  BOOST_REQUIRE( wait_for_idle_worker( pool, 1 ) );
+  start = std::chrono::steady_clock::now();
+  BOOST_CHECK_THROW( pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") ),
+                     std::exception );
+  BOOST_CHECK_LT( seconds_since( start ), 3.0 );
+  BOOST_CHECK_EQUAL( pool.numIdleWorkers( MOCK_FULL_SPEC_EXE ), 0 );
+}//BOOST_AUTO_TEST_CASE( AnalysisTimeout )
+
+
+BOOST_AUTO_TEST_CASE( ConcurrencyLimit )
+{
+  MockEnvironment env( "1", nullptr, "500" );
+  SpectrumFile file;
+
+  ExternalRid::WorkerPool::Options options;
+  options.max_concurrent = 2;
+
+  ExternalRid::WorkerPool pool( options );
+
+  const auto start = std::chrono::steady_clock::now();
+
+  std::atomic<int> num_failed( 0 );
+  vector<std::thread> threads;
+  for( int i = 0; i < 4; ++i )
+  {
+    threads.emplace_back( [&pool,&file,&num_failed](){
+      try
+      {
+        pool.analyze( MOCK_FULL_SPEC_EXE, make_request(file, "Detective-EX200") );
+      }catch( std::exception & )
+      {
+        ++num_failed;
+      }
+    } );
+  }
+
+  for( std::thread &t : threads )
+    t.join();
+
+  BOOST_CHECK_EQUAL( num_failed.load(), 0 );
+
+  // Four half-second analyses, two at a time, should take at least a second.
+  BOOST_CHECK_GE( seconds_since( start ), 0.95 );
+}//BOOST_AUTO_TEST_CASE( ConcurrencyLimit )
@@ -0,0 +1,445 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "InterSpec_config.h"
+
+#include <set>
+#include <deque>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#define BOOST_TEST_MODULE test_MakeDrfBatch
+#include <boost/test/included/unit_test.hpp>
+
+#include "SandiaDecay/SandiaDecay.h"
+
+#include "SpecUtils/SpecFile.h"
+#include "SpecUtils/DateTime.h"
+#include "SpecUtils/Filesystem.h"
+
+#include "InterSpec/PeakDef.h"
+#include "InterSpec/MakeDrf.h"
+#include "InterSpec/SpecMeas.h"
+#include "InterSpec/MakeDrfFit.h"
+#include "InterSpec/MakeDrfChart.h"
+#include "InterSpec/MakeDrfBatch.h"
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/MassAttenuationTool.h"
+#include "InterSpec/DecayDataBaseServer.h"
+#include "InterSpec/GammaInteractionCalc.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+using namespace std;
+
+// SANDIA_DECAY_XML, INTERSPEC_DATA_DIR, and EXAMPLE_SPECTRA_DIR are defined by CMake to be the
+//  nuclear decay database, the "data" directory, and the "example_spectra" directory.
+
+
+namespace
+{
+  /** Sets the decay database and cross-section data directory once, for all the test cases. */
+  struct DataFixture
+  {
+    DataFixture()
+    {
+      DecayDataBaseServer::setDecayXmlFile( SANDIA_DECAY_XML );
+      MassAttenuation::set_data_directory( INTERSPEC_DATA_DIR );
+    }
+  };//struct DataFixture
+
+
+  /** Temporary files, removed when this goes out of scope. */
+  struct TempFiles
+  {
+    ~TempFiles()
+    {
+      for( const string &f : files )
+        SpecUtils::remove_file( f );
+    }
+
+    /** Creates a new (placeholder) file in the temporary directory, and returns its path. */
+    string create( const string &contents = "placeholder" )
+    {
+      const string path = SpecUtils::temp_file_name( "test_MakeDrfBatch", SpecUtils::temp_dir() );
+      files.push_back( path );
+
+      ofstream output( path.c_str(), ios::out | ios::binary );
+      BOOST_REQUIRE_MESSAGE( output, "Could not create '" << path << "'" );
+      output << contents;
+
+      return path;
+    }
+
+    vector<string> files;
+  };//struct TempFiles
+
+
+  const SandiaDecay::Nuclide *nuclide( const string &symbol )
+  {
+    const SandiaDecay::SandiaDecayDataBase *db = DecayDataBaseServer::database();
+    BOOST_REQUIRE( db );
+    const SandiaDecay::Nuclide *nuc = db->nuclide( symbol );
+    BOOST_REQUIRE_MESSAGE( nuc, "Could not find " << symbol );
+    return nuc;
+  }//nuclide(...)
+
+
+  vector<MakeDrfBatch::DetectorDef> parse( const string &manifest, const string &basedir )
+  {
+    istringstream input( manifest );
+    return MakeDrfBatch::parse_manifest( input, basedir );
+  }
+
+
+  /** Checks parsing 'manifest' throws, with a message containing 'expected'. */
+  void check_error( const string &manifest, const string &basedir, const string &expected )
+  {
+    try
+    {
+      parse( manifest, basedir );
+      BOOST_ERROR( "No exception for manifest:\n" << manifest );
+    }catch( std::exception &e )
+    {
+      const string msg = e.what();
+      BOOST_CHECK_MESSAGE( msg.find(expected) != string::npos,
+                           "Error '" << msg << "' does not contain '" << expected << "'" );
+    }//try / catch
+  }//check_error(...)
+
+
+  /** Assigns the nuclide line nearest a peak to it, the same as a user in the GUI would; the search
+   window is kept narrow so a stronger neighboring line isnt chosen instead.
+   */
+  void assign_nuclide( PeakDef &peak, const SandiaDecay::Nuclide *nuc )
+  {
+    const SandiaDecay::Transition *transition = nullptr;
+    size_t index = 0;
+    PeakDef::SourceGammaType type;
+    PeakDef::findNearestPhotopeak( nuc, peak.mean(), 2.0*peak.sigma(), false, transition, index, type );
+    BOOST_REQUIRE_MESSAGE( transition || (type == PeakDef::AnnihilationGamma),
+                           "No " << nuc->symbol << " line near " << peak.mean() << " keV" );
+    peak.setNuclearTransition( nuc, transition, static_cast<int>(index), type );
+  }//assign_nuclide(...)
+}//namespace
+
+
+BOOST_GLOBAL_FIXTURE( DataFixture );
+
+
+BOOST_AUTO_TEST_CASE( ManifestGrammar )
+{
+  TempFiles temp;
+  const string relfile = temp.create();
+  const string absfile = temp.create();
+  const string basedir = SpecUtils::parent_path( relfile );
+  const string relname = SpecUtils::filename( relfile );
+
+  const string manifest =
+    "# A comment, then a blank line\n"
+    "\n"
+    "detector: HPGe 1; 6.5 cm; P-type; room 112\n"
+    "Option: eff_order=6\n"
+    "option: eff_units=MeV\n"
+    "option: fwhm_form = sqrt_poly\n"
+    "option: sqrt_order=3\n"
+    "option: air_attenuation=false\n"
+    "  file: " + relname + "\n"
+    "source: Ba133; 9.8 uCi; 25 cm; uncert=3%; assay=2019-06-01; age=1.5 y\n"
+    "source: Co60; 0.88 uCi; 50 cm; uncert=5; an=26; ad=2.5; age=0.5 HL\n"
+    "background: " + absfile + "\n"
+    "\n"
+    "detector: NaI; 3 in\n"
+    "file: " + relname + "\n"
+    "source: Cs137; 1 MBq; 1 m\n";
+
+  const vector<MakeDrfBatch::DetectorDef> dets = parse( manifest, basedir );
+  BOOST_REQUIRE_EQUAL( dets.size(), size_t(2) );
+
+  // The first detector, with all the options, and source fields, given
+  const MakeDrfBatch::DetectorDef &hpge = dets[0];
+  BOOST_CHECK_EQUAL( hpge.name, "HPGe 1" );
+  BOOST_CHECK_EQUAL( hpge.description, "P-type; room 112" );
+  BOOST_CHECK_CLOSE( hpge.diameter, 6.5*PhysicalUnits::cm, 1.0E-6 );
+  BOOST_CHECK_EQUAL( hpge.eff_order, 6 );
+  BOOST_CHECK( hpge.eff_in_mev );
+  BOOST_CHECK_EQUAL( hpge.fwhm_form, DetectorPeakResponse::kSqrtPolynomial );
+  BOOST_CHECK_EQUAL( hpge.sqrt_eqn_order, 3 );
+  BOOST_CHECK( !hpge.air_attenuation );
+
+  BOOST_REQUIRE_EQUAL( hpge.files.size(), size_t(2) );
+  BOOST_CHECK_EQUAL( hpge.files[0].filename, SpecUtils::append_path(basedir, relname) );
+  BOOST_CHECK( !hpge.files[0].is_background );
+  BOOST_CHECK_EQUAL( hpge.files[1].filename, absfile );
+  BOOST_CHECK( hpge.files[1].is_background );
+  BOOST_CHECK( hpge.files[1].sources.empty() );
+
+  BOOST_REQUIRE_EQUAL( hpge.files[0].sources.size(), size_t(2) );
+  const MakeDrfBatch::SourceDef &ba133 = hpge.files[0].sources[0];
+  BOOST_CHECK( ba133.nuclide == nuclide("Ba133") );
+  BOOST_CHECK_CLOSE( ba133.activity, 9.8*PhysicalUnits::microCi, 1.0E-6 );
+  BOOST_CHECK_CLOSE( ba133.distance, 25.0*PhysicalUnits::cm, 1.0E-6 );
+  BOOST_CHECK_CLOSE( ba133.activity_uncertainty, 0.03, 1.0E-6 );
+  BOOST_CHECK( ba133.assay_date == SpecUtils::time_from_string("2019-06-01") );
+  BOOST_CHECK( !SpecUtils::is_special(ba133.assay_date) );
+  BOOST_CHECK_CLOSE( ba133.age_at_assay, 1.5*PhysicalUnits::year, 1.0E-6 );
+  BOOST_CHECK_EQUAL( ba133.shield_areal_density, 0.0f );
+
+  // The uncertainty is in percent whether or not the '%' is given, and ages can be in half-lives.
+  const MakeDrfBatch::SourceDef &co60 = hpge.files[0].sources[1];
+  BOOST_CHECK( co60.nuclide == nuclide("Co60") );
+  BOOST_CHECK_CLOSE( co60.activity, 0.88*PhysicalUnits::microCi, 1.0E-6 );
+  BOOST_CHECK_CLOSE( co60.distance, 50.0*PhysicalUnits::cm, 1.0E-6 );
+  BOOST_CHECK_CLOSE( co60.activity_uncertainty, 0.05, 1.0E-6 );
+  BOOST_CHECK( SpecUtils::is_special(co60.assay_date) );
+  BOOST_CHECK_CLOSE( co60.age_at_assay, 0.5*co60.nuclide->halfLife, 1.0E-4 );
+  BOOST_CHECK_EQUAL( co60.shield_atomic_number, 26.0f );
+  BOOST_CHECK_CLOSE( co60.shield_areal_density, 2.5*PhysicalUnits::g/PhysicalUnits::cm2, 1.0E-4 );
+
+  // The second detector, with everything defaulted
+  const MakeDrfBatch::DetectorDef &nai = dets[1];
+  BOOST_CHECK_EQUAL( nai.name, "NaI" );
+  BOOST_CHECK( nai.description.empty() );
+  BOOST_CHECK_CLOSE( nai.diameter, 3.0*2.54*PhysicalUnits::cm, 1.0E-6 );
+  BOOST_CHECK( nai.eff_order <= 0 );
+  BOOST_CHECK( !nai.eff_in_mev );
+  BOOST_CHECK_EQUAL( nai.fwhm_form, DetectorPeakResponse::kGadrasResolutionFcn );
+  BOOST_CHECK( nai.air_attenuation );
+
+  BOOST_REQUIRE_EQUAL( nai.files.size(), size_t(1) );
+  BOOST_REQUIRE_EQUAL( nai.files[0].sources.size(), size_t(1) );
+  const MakeDrfBatch::SourceDef &cs137 = nai.files[0].sources[0];
+  BOOST_CHECK( cs137.nuclide == nuclide("Cs137") );
+  BOOST_CHECK_CLOSE( cs137.activity, 1.0*PhysicalUnits::MBq, 1.0E-6 );
+  BOOST_CHECK_CLOSE( cs137.distance, 1.0*PhysicalUnits::m, 1.0E-6 );
+  BOOST_CHECK_EQUAL( cs137.activity_uncertainty, 0.0 );
+  BOOST_CHECK( SpecUtils::is_special(cs137.assay_date) );
+  BOOST_CHECK( cs137.age_at_assay <= 0.0 );
+}//BOOST_AUTO_TEST_CASE( ManifestGrammar )
+
+
+BOOST_AUTO_TEST_CASE( ManifestErrors )
+{
+  TempFiles temp;
+  const string filepath = temp.create();
+  const string basedir = SpecUtils::parent_path( filepath );
+  const string file = "file: " + SpecUtils::filename( filepath ) + "\n";
+  const string det = "# Detector\n\ndetector: Det; 5 cm\n";  // The detector is on line 3
+
+  check_error( det + "no colon here\n", basedir, "Manifest line 4 has no 'key:'" );
+  check_error( det + "file: " + filepath + "\nsomething: else\n", basedir, "Manifest line 5: unknown key 'something'" );
+  check_error( "option: eff_order=3\n", basedir, "Manifest line 1: a 'detector:' line must come first" );
+  check_error( "\ndetector: Det\n", basedir, "Manifest line 2: detector must have a name and diameter" );
+  check_error( "detector: Det; five cm\n", basedir, "Manifest line 1: " );
+
+  // Options
+  check_error( det + "option: eff_order\n", basedir, "Manifest line 4: option must be of the form 'key=value'" );
+  check_error( det + "option: eff_order=9\n", basedir, "Manifest line 4: eff_order must be between 1 and 8" );
+  check_error( det + "option: eff_order=0\n", basedir, "Manifest line 4: eff_order must be between 1 and 8" );
+  check_error( det + "option: eff_units=eV\n", basedir, "Manifest line 4: eff_units must be keV or MeV" );
+  check_error( det + "option: fwhm_form=cubic\n", basedir, "Manifest line 4: invalid fwhm_form 'cubic'" );
+  check_error( det + "option: eff_ordr=3\n", basedir, "Manifest line 4: unknown option 'eff_ordr'" );
+
+  // Files
+  check_error( det + "file:\n", basedir, "Manifest line 4: no filename given" );
+  check_error( det + "file: not_a_file.n42\n", basedir, "Manifest line 4: file '"
+               + SpecUtils::append_path(basedir, "not_a_file.n42") + "' does not exist" );
+  check_error( det + "option: eff_order=3\n", basedir, "Detector 'Det' has no files" );
+
+  // Sources
+  check_error( det + "source: Cs137; 1 uCi; 1 m\n", basedir, "Manifest line 4: a source must follow a 'file:' line" );
+  check_error( det + "background: " + filepath + "\nsource: Cs137; 1 uCi; 1 m\n", basedir,
+               "Manifest line 5: a source must follow a 'file:' line" );
+  check_error( det + file + "source: Cs137; 1 uCi\n", basedir, "Manifest line 5: source must have a nuclide, activity, and distance" );
+  check_error( det + file + "source: Xx999; 1 uCi; 1 m\n", basedir, "Manifest line 5: invalid nuclide 'Xx999'" );
+  check_error( det + file + "source: Cs137; 1 furlong; 1 m\n", basedir, "Manifest line 5: " );
+  check_error( det + file + "source: Cs137; 1 uCi; 1 uCi\n", basedir, "Manifest line 5: " );
+  check_error( det + file + "source: Cs137; 1 uCi; 1 m; 5%\n", basedir, "Manifest line 5: source field '5%' is not of the form 'key=value'" );
+  check_error( det + file + "source: Cs137; 1 uCi; 1 m; uncert=five\n", basedir, "Manifest line 5: " );
+  check_error( det + file + "source: Cs137; 1 uCi; 1 m; assay=yesterday-ish\n", basedir, "Manifest line 5: invalid assay date 'yesterday-ish'" );
+  check_error( det + file + "source: Cs137; 1 uCi; 1 m; age=old\n", basedir, "Manifest line 5: " );
+  check_error( det + file + "source: Cs137; 1 uCi; 1 m; ad=2.5\n", basedir, "Manifest line 5: source shielding must have an atomic number" );
+  check_error( det + file + "source: Cs137; 1 uCi; 1 m; shielding=lead\n", basedir, "Manifest line 5: unknown source field 'shielding'" );
+}//BOOST_AUTO_TEST_CASE( ManifestErrors )
+
+
+BOOST_AUTO_TEST_CASE( ExampleManifest )
+{
+  // The manifest shipped in the example_spectra directory, for the documentation.
+  const string path = SpecUtils::append_path( EXAMPLE_SPECTRA_DIR, "make_drf_batch_manifest.txt" );
+  ifstream input( path.c_str(), ios::in | ios::binary );
+  BOOST_REQUIRE_MESSAGE( input, "Could not open '" << path << "'" );
+
+  const vector<MakeDrfBatch::DetectorDef> dets = MakeDrfBatch::parse_manifest( input, EXAMPLE_SPECTRA_DIR );
+  BOOST_REQUIRE_EQUAL( dets.size(), size_t(1) );
+  BOOST_CHECK( dets[0].eff_in_mev );
+  BOOST_CHECK_EQUAL( dets[0].eff_order, 3 );
+  BOOST_CHECK_EQUAL( dets[0].fwhm_form, DetectorPeakResponse::kSqrtEnergyPlusInverse );
+
+  BOOST_REQUIRE_EQUAL( dets[0].files.size(), size_t(2) );
+  BOOST_CHECK( !dets[0].files[0].is_background );
+  BOOST_CHECK( dets[0].files[1].is_background );
+  BOOST_REQUIRE_EQUAL( dets[0].files[0].sources.size(), size_t(1) );
+  BOOST_CHECK( dets[0].files[0].sources[0].nuclide == nuclide("Ba133") );
+  BOOST_CHECK_CLOSE( dets[0].files[0].sources[0].activity_uncertainty, 0.05, 1.0E-6 );
+}//BOOST_AUTO_TEST_CASE( ExampleManifest )
+
+
+BOOST_AUTO_TEST_CASE( SavedPeaksMatchGui )
+{
+  // Save an N42 with peaks, like a user would after fitting peaks and assigning nuclides in the GUI,
+  //  and check the batch makes the same efficiency points from it the #MakeDrf tool would.
+  const SandiaDecay::Nuclide * const ba133 = nuclide( "Ba133" );
+  const SandiaDecay::Nuclide * const k40 = nuclide( "K40" );
+
+  const string specfile = SpecUtils::append_path( EXAMPLE_SPECTRA_DIR, "ba133_source_640s_20100317.n42" );
+  auto meas = make_shared<SpecMeas>();
+  BOOST_REQUIRE( meas->load_file( specfile, SpecUtils::ParserType::Auto, specfile ) );
+
+  // {mean, area, nuclide to assign}; peak means are a little off from the line energies, as fit
+  //  peaks would be.
+  struct PeakInfo { double mean; double area; const SandiaDecay::Nuclide *nuc; };
+  const PeakInfo infos[] = {
+    { 81.4, 25000.0, ba133 },
+    { 276.1, 4000.0, ba133 },
+    { 303.3, 9000.0, nullptr },   // Should be matched to the 302.85 keV line by energy
+    { 356.5, 30000.0, ba133 },
+    { 384.2, 3500.0, ba133 },
+    { 661.7, 1000.0, nullptr },   // No Ba133 line, so should be skipped
+    { 1460.5, 800.0, k40 }        // Not a source in the file, so should be skipped
+  };
+
+  std::deque<std::shared_ptr<const PeakDef>> peaks;
+  for( const PeakInfo &info : infos )
+  {
+    auto peak = make_shared<PeakDef>( info.mean, 0.03*info.mean, info.area );
+    peak->setPeakAreaUncert( 0.02*info.area );
+    if( info.nuc )
+      assign_nuclide( *peak, info.nuc );
+    peaks.push_back( peak );
+  }//for( const PeakInfo &info : infos )
+
+  const set<int> samples = meas->sample_numbers();
+  meas->setPeaks( peaks, samples );
+
+  TempFiles temp;
+  const string n42file = temp.create();
+  BOOST_REQUIRE( meas->save2012N42File( n42file ) );
+
+  const double activity = 10.0*PhysicalUnits::microCi;
+  const double distance = 1.0*PhysicalUnits::m;
+  const double diameter = 7.62*PhysicalUnits::cm;
+  const string manifest = "detector: Test; 7.62 cm\n"
+                          "file: " + n42file + "\n"
+                          "source: Ba133; 10 uCi; 1 m; uncert=5%\n";
+
+  const vector<MakeDrfBatch::DetectorDef> dets = parse( manifest, "" );
+  BOOST_REQUIRE_EQUAL( dets.size(), size_t(1) );
+
+  const MakeDrf::FitResults results = MakeDrfBatch::fit_detector( dets[0] );
+
+  // Peaks are summed over the samples the peaks were saved for, and all detectors.
+  auto saved = make_shared<SpecMeas>();
+  BOOST_REQUIRE( saved->load_file( n42file, SpecUtils::ParserType::Auto, n42file ) );
+  const std::shared_ptr<const SpecUtils::Measurement> summed
+                              = saved->sum_measurements( samples, saved->detector_names(), nullptr );
+  BOOST_REQUIRE( summed );
+  const float live_time = summed->live_time();
+
+  // The photon lines of the source; without an assay date the activity is at the measurement time,
+  //  and the default age is used, the same as #MakeDrfSrcDef.
+  SandiaDecay::NuclideMixture mix;
+  mix.addAgedNuclideByActivity( ba133, activity, PeakDef::defaultDecayTime(ba133, nullptr) );
+  const vector<SandiaDecay::EnergyRatePair> lines
+                      = mix.photons( 0.0, SandiaDecay::NuclideMixture::HowToOrder::OrderByEnergy );
+
+  const float expected_energies[] = { 80.9979f, 276.3989f, 302.8508f, 356.0129f, 383.8485f };
+  BOOST_REQUIRE_EQUAL( results.data.size(), sizeof(expected_energies)/sizeof(expected_energies[0]) );
+
+  for( size_t i = 0; i < results.data.size(); ++i )
+  {
+    const MakeDrfChart::DataPoint &point = results.data[i];
+    const PeakInfo &info = infos[i];  //The first five peaks are the ones that should be used
+
+    BOOST_CHECK_MESSAGE( fabs(point.energy - expected_energies[i]) < 0.1,
+                         "Point " << i << " energy " << point.energy << " vs line at " << expected_energies[i] );
+    BOOST_CHECK_CLOSE( point.peak_area, info.area, 1.0E-4 );
+    BOOST_CHECK_CLOSE( point.peak_area_uncertainty, 0.02*info.area, 1.0E-4 );
+    BOOST_CHECK_CLOSE( point.livetime, live_time, 1.0E-4 );
+    BOOST_CHECK_CLOSE( point.distance, distance, 1.0E-6 );
+
+    // The source rate, computed the way #MakeDrf::handleSourcesUpdates does: all lines within
+    //  1.25 sigma of the assigned line, attenuated by the air between source and detector.
+    const double width = 1.25*0.03*info.mean;
+    const double mu_air = GammaInteractionCalc::transmission_length_coefficient_air( point.energy );
+    double rate = 0.0;
+    for( const SandiaDecay::EnergyRatePair &r : lines )
+    {
+      if( fabs(r.energy - point.energy) < width )
+        rate += r.numPerSecond * exp( -mu_air * distance );
+    }
+    BOOST_REQUIRE( rate > 0.0 );
+
+    BOOST_CHECK_CLOSE( point.source_count_rate, rate, 1.0E-3 );
+    BOOST_CHECK_CLOSE( point.source_count_rate_uncertainty, 0.05*rate, 1.0E-3 );
+
+    const double solid_angle = DetectorPeakResponse::fractionalSolidAngle( diameter, distance );
+    const double expected_eff = info.area / (rate * live_time * solid_angle);
+    const double batch_eff = point.peak_area / (point.source_count_rate * point.livetime * solid_angle);
+    BOOST_CHECK_CLOSE( batch_eff, expected_eff, 1.0E-3 );
+
+    // And the same through the function the GUI uses
+    MakeDrfChart::DataPoint guipoint;
+    guipoint.energy = point.energy;
+    guipoint.livetime = live_time;
+    guipoint.peak_area = static_cast<float>( info.area );
+    guipoint.peak_area_uncertainty = static_cast<float>( 0.02*info.area );
+
+    MakeDrf::PeakSourceRate src;
+    src.rate = rate;
+    src.distance = distance;
+    src.fractionalUncert = 0.05;
+
+    const MakeDrfFit::DetEffDataPoint guieff = MakeDrf::efficiencyDataPoint( guipoint, {src}, diameter );
+    BOOST_CHECK_CLOSE( guieff.efficiency, expected_eff, 1.0E-3 );
+    BOOST_CHECK_CLOSE( guieff.efficiency_uncert, sqrt(0.02*0.02 + 0.05*0.05), 1.0E-3 );
+    BOOST_CHECK_CLOSE( guipoint.source_count_rate, point.source_count_rate, 1.0E-4 );
+    BOOST_CHECK_CLOSE( guipoint.source_count_rate_uncertainty, point.source_count_rate_uncertainty, 1.0E-4 );
+  }//for( size_t i = 0; i < results.data.size(); ++i )
+
+  // Five points, so five efficiency parameters, and the fit should go through all of them.
+  BOOST_REQUIRE_EQUAL( results.effCoefs.size(), size_t(5) );
+  BOOST_CHECK( !results.effInMeV );
+  for( const MakeDrfChart::DataPoint &point : results.data )
+  {
+    const double solid_angle = DetectorPeakResponse::fractionalSolidAngle( diameter, distance );
+    const double eff = point.peak_area / (point.source_count_rate * point.livetime * solid_angle);
+    const double fit_eff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( point.energy, results.effCoefs );
+    BOOST_CHECK_CLOSE( fit_eff, eff, 1.0 );
+  }
+}//BOOST_AUTO_TEST_CASE( SavedPeaksMatchGui )
@@ -0,0 +1,239 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+#define BOOST_TEST_MODULE test_MakeDrfFit
+#include <boost/test/included/unit_test.hpp>
+
+#include "InterSpec/MakeDrfFit.h"
+#include "InterSpec/DetectorPeakResponse.h"
+
+using namespace std;
+
+
+namespace
+{
+  /** Intrinsic efficiency coefficients, for energy in MeV, roughly those of a 3x3 NaI detector. */
+  const vector<float> sm_true_coefs{ -1.6f, -0.9f, -0.12f };
+
+
+  /** Efficiencies evaluated exactly from #sm_true_coefs, at common calibration source energies
+   (in MeV), with a variety of fractional uncertainties.
+   */
+  vector<MakeDrfFit::DetEffDataPoint> synthetic_data()
+  {
+    const pair<float,float> energy_uncerts[] = {
+      {0.0595f, 0.06f}, {0.0810f, 0.03f}, {0.1218f, 0.02f}, {0.2447f, 0.03f},
+      {0.3560f, 0.04f}, {0.6617f, 0.02f}, {0.7789f, 0.03f}, {1.1732f, 0.025f},
+      {1.3325f, 0.025f}, {1.4081f, 0.05f}, {2.6145f, 0.08f}
+    };
+
+    vector<MakeDrfFit::DetEffDataPoint> data;
+    for( const pair<float,float> &eu : energy_uncerts )
+    {
+      MakeDrfFit::DetEffDataPoint point;
+      point.energy = eu.first;
+      point.efficiency = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( eu.first, sm_true_coefs );
+      point.efficiency_uncert = eu.second;
+      data.push_back( point );
+    }
+
+    return data;
+  }//synthetic_data()
+
+
+  /** The coefficient covariance from the Hessian of the log-space chi2, (A^T W A)^-1, where
+   A_ij = log(energy_i)^j, and W is diagonal with the inverse squares of the fractional uncertainties.
+
+   Since the resampled data is exactly linear in log-space, this is what the resampled covariance
+   should converge to.
+   */
+  vector<vector<double>> hessian_covariance( const vector<MakeDrfFit::DetEffDataPoint> &data,
+                                             const size_t order )
+  {
+    // Build the augmented matrix [alpha | I], and reduce it with Gauss-Jordan elimination
+    vector<vector<double>> aug( order, vector<double>(2*order, 0.0) );
+    for( const MakeDrfFit::DetEffDataPoint &p : data )
+    {
+      const double weight = 1.0 / (p.efficiency_uncert * p.efficiency_uncert);
+      for( size_t i = 0; i < order; ++i )
+        for( size_t j = 0; j < order; ++j )
+          aug[i][j] += weight * std::pow( log(p.energy), double(i + j) );
+    }
+
+    for( size_t i = 0; i < order; ++i )
+      aug[i][order + i] = 1.0;
+
+    for( size_t col = 0; col < order; ++col )
+    {
+      size_t pivot = col;
+      for( size_t row = col + 1; row < order; ++row )
+        if( fabs(aug[row][col]) > fabs(aug[pivot][col]) )
+          pivot = row;
+      std::swap( aug[col], aug[pivot] );
+      BOOST_REQUIRE( fabs(aug[col][col]) > 0.0 );
+
+      const double scale = aug[col][col];
+      for( double &v : aug[col] )
+        v /= scale;
+
+      for( size_t row = 0; row < order; ++row )
+      {
+        if( row == col )
+          continue;
+        const double factor = aug[row][col];
+        for( size_t k = 0; k < 2*order; ++k )
+          aug[row][k] -= factor * aug[col][k];
+      }
+    }//for( size_t col = 0; col < order; ++col )
+
+    vector<vector<double>> covariance( order, vector<double>(order) );
+    for( size_t i = 0; i < order; ++i )
+      for( size_t j = 0; j < order; ++j )
+        covariance[i][j] = aug[i][order + j];
+
+    return covariance;
+  }//hessian_covariance(...)
+}//namespace
+
+
+BOOST_AUTO_TEST_CASE( EfficiencyCovarianceMatchesHessian )
+{
+  const vector<MakeDrfFit::DetEffDataPoint> data = synthetic_data();
+  const size_t order = sm_true_coefs.size();
+  const size_t num_trials = 2000;
+
+  const MakeDrfFit::BootstrapResult result
+        = MakeDrfFit::bootstrap_efficiency_fit( data, static_cast<int>(order), num_trials, {} );
+
+  BOOST_CHECK_EQUAL( result.num_successful_fits, num_trials );
+  BOOST_REQUIRE_EQUAL( result.coef_means.size(), order );
+  BOOST_REQUIRE_EQUAL( result.coef_covariance.size(), order );
+  BOOST_CHECK( result.energies.empty() && result.lower_band.empty() && result.upper_band.empty() );
+
+  const vector<vector<double>> expected = hessian_covariance( data, order );
+
+  for( size_t i = 0; i < order; ++i )
+  {
+    BOOST_REQUIRE_EQUAL( result.coef_covariance[i].size(), order );
+
+    // With 2000 trials the standard deviations should be good to a few percent.
+    const double expected_sigma = sqrt( expected[i][i] );
+    const double sigma = sqrt( result.coef_covariance[i][i] );
+    BOOST_CHECK_MESSAGE( fabs(sigma - expected_sigma) < 0.1*expected_sigma,
+                         "Coefficient " << i << " resampled uncertainty " << sigma
+                         << " vs " << expected_sigma << " from the Hessian" );
+
+    BOOST_CHECK_MESSAGE( fabs(result.coef_means[i] - sm_true_coefs[i]) < 0.15*expected_sigma,
+                         "Coefficient " << i << " resampled mean " << result.coef_means[i]
+                         << " vs true value " << sm_true_coefs[i] );
+
+    // The coefficients are strongly correlated, so check the off-diagonal terms too.
+    for( size_t j = 0; j < i; ++j )
+    {
+      const double scale = sqrt( expected[i][i] * expected[j][j] );
+      BOOST_CHECK_MESSAGE( fabs(result.coef_covariance[i][j] - expected[i][j]) < 0.1*scale,
+                           "Covariance (" << i << "," << j << ") of " << result.coef_covariance[i][j]
+                           << " vs " << expected[i][j] << " from the Hessian" );
+      BOOST_CHECK_EQUAL( result.coef_covariance[i][j], result.coef_covariance[j][i] );
+    }
+  }//for( size_t i = 0; i < order; ++i )
+}//BOOST_AUTO_TEST_CASE( EfficiencyCovarianceMatchesHessian )
+
+
+BOOST_AUTO_TEST_CASE( EfficiencyBandMatchesPropagatedUncertainty )
+{
+  const vector<MakeDrfFit::DetEffDataPoint> data = synthetic_data();
+  const size_t order = sm_true_coefs.size();
+  const vector<vector<double>> covariance = hessian_covariance( data, order );
+
+  vector<float> energies;
+  for( float energy = 0.06f; energy <= 2.6f; energy += 0.1f )
+    energies.push_back( energy );
+
+  const MakeDrfFit::BootstrapResult result
+        = MakeDrfFit::bootstrap_efficiency_fit( data, static_cast<int>(order), 2000, energies );
+
+  BOOST_REQUIRE( result.energies == energies );
+  BOOST_REQUIRE_EQUAL( result.lower_band.size(), energies.size() );
+  BOOST_REQUIRE_EQUAL( result.upper_band.size(), energies.size() );
+
+  for( size_t i = 0; i < energies.size(); ++i )
+  {
+    const double energy = energies[i];
+    const double eff = DetectorPeakResponse::expOfLogPowerSeriesEfficiency( energies[i], sm_true_coefs );
+
+    // The true efficiency is the median of the resampled efficiencies, so must be inside the band.
+    BOOST_CHECK_MESSAGE( (result.lower_band[i] < eff) && (eff < result.upper_band[i]),
+                         "At " << energy << " MeV, efficiency " << eff << " not in band ["
+                         << result.lower_band[i] << ", " << result.upper_band[i] << "]" );
+
+    // The 68% band should be +-1 sigma of log(eff), as propagated from the coefficient covariance.
+    double log_eff_variance = 0.0;
+    for( size_t j = 0; j < order; ++j )
+      for( size_t k = 0; k < order; ++k )
+        log_eff_variance += std::pow( log(energy), double(j + k) ) * covariance[j][k];
+
+    const double expected_half_width = sqrt( log_eff_variance );
+    const double half_width = 0.5*log( result.upper_band[i] / result.lower_band[i] );
+    BOOST_CHECK_MESSAGE( fabs(half_width - expected_half_width) < 0.15*expected_half_width,
+                         "At " << energy << " MeV, band half-width (in log eff) " << half_width
+                         << " vs " << expected_half_width << " propagated from the Hessian" );
+  }//for( size_t i = 0; i < energies.size(); ++i )
+}//BOOST_AUTO_TEST_CASE( EfficiencyBandMatchesPropagatedUncertainty )
+
+
+BOOST_AUTO_TEST_CASE( ResamplingIsReproducible )
+{
+  const vector<MakeDrfFit::DetEffDataPoint> data = synthetic_data();
+  const vector<float> energies{ 0.1f, 0.5f, 1.0f, 2.0f };
+
+  // Sampling is seeded by trial number, so the thread count or scheduling shouldnt matter.
+  const MakeDrfFit::BootstrapResult first = MakeDrfFit::bootstrap_efficiency_fit( data, 3, 200, energies );
+  const MakeDrfFit::BootstrapResult second = MakeDrfFit::bootstrap_efficiency_fit( data, 3, 200, energies );
+
+  BOOST_CHECK( first.coef_means == second.coef_means );
+  BOOST_CHECK( first.coef_covariance == second.coef_covariance );
+  BOOST_CHECK( first.lower_band == second.lower_band );
+  BOOST_CHECK( first.upper_band == second.upper_band );
+}//BOOST_AUTO_TEST_CASE( ResamplingIsReproducible )
+
+
+BOOST_AUTO_TEST_CASE( InvalidInput )
+{
+  const vector<MakeDrfFit::DetEffDataPoint> data = synthetic_data();
+
+  BOOST_CHECK_THROW( MakeDrfFit::bootstrap_efficiency_fit( {}, 3, 100, {} ), std::exception );
+  BOOST_CHECK_THROW( MakeDrfFit::bootstrap_efficiency_fit( data, 0, 100, {} ), std::exception );
+  BOOST_CHECK_THROW( MakeDrfFit::bootstrap_efficiency_fit( data, static_cast<int>(data.size() + 1), 100, {} ), std::exception );
+  BOOST_CHECK_THROW( MakeDrfFit::bootstrap_efficiency_fit( data, 3, 1, {} ), std::exception );
+  BOOST_CHECK_THROW( MakeDrfFit::bootstrap_efficiency_fit( data, 3, 100, {}, 1.0 ), std::exception );
+  BOOST_CHECK_THROW( MakeDrfFit::bootstrap_efficiency_fit( data, 3, 100, {}, 0.0 ), std::exception );
+}//BOOST_AUTO_TEST_CASE( InvalidInput )
@@ -0,0 +1,293 @@
+/* InterSpec: an application to analyze spectral gamma radiation data.
+
+ Copyright 2018 National Technology & Engineering Solutions of Sandia, LLC
+ (NTESS). Under the terms of Contract DE-NA0003525 with NTESS, the U.S.
+ Government retains certain rights in this software.
+ For questions contact William Johnson via email at wcjohns@sandia.gov, or
+ alternative emails of interspec@sandia.gov.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "InterSpec_config.h"
+
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#define BOOST_TEST_MODULE test_MassAttenuation
+#include <boost/test/included/unit_test.hpp>
+
+#include "InterSpec/PhysicalUnits.h"
+#include "InterSpec/MassAttenuationTool.h"
+
+using namespace std;
+
+// INTERSPEC_DATA_DIR is defined by CMake to be the "data" directory of the source tree.
+
+
+namespace
+{
+  /** Sets the cross-section data directory once, for all the test cases. */
+  struct DataDirectoryFixture
+  {
+    DataDirectoryFixture()
+    {
+      MassAttenuation::set_data_directory( INTERSPEC_DATA_DIR );
+    }
+  };//struct DataDirectoryFixture
+
+
+  /** The total attenuation coefficient computed from the tabulated data of each process, the same as
+   the uniform log-energy grid is checked against when it is filled.
+   */
+  float full_calculation( const int atomic_number, const float energy )
+  {
+    using MassAttenuation::GammaEmProcces;
+
+    float compton = 0.0f, photo = 0.0f, pair = 0.0f;
+    try
+    {
+      compton = MassAttenuation::massAttenuationCoeficient( atomic_number, energy, GammaEmProcces::ComptonScatter );
+    }catch( std::exception & ){}
+
+    try
+    {
+      photo = MassAttenuation::massAttenuationCoeficient( atomic_number, energy, GammaEmProcces::PhotoElectric );
+    }catch( std::exception & ){}
+
+    try
+    {
+      if( energy > 1024.0*PhysicalUnits::keV )
+        pair = MassAttenuation::massAttenuationCoeficient( atomic_number, energy, GammaEmProcces::PairProduction );
+    }catch( std::exception & ){}
+
+    return compton + photo + pair;
+  }//float full_calculation(...)
+
+
+  /** Energies uniformly distributed in log(energy), over the range the uniform grid covers. */
+  vector<float> random_energies( const size_t num_energies, const unsigned int seed )
+  {
+    std::mt19937 gen( seed );
+    std::uniform_real_distribution<double> log_energy( std::log(1.02*PhysicalUnits::keV),
+                                                       std::log(99.0*PhysicalUnits::MeV) );
+
+    vector<float> energies( num_energies );
+    for( float &energy : energies )
+      energy = static_cast<float>( std::exp( log_energy(gen) ) );
+
+    return energies;
+  }//vector<float> random_energies(...)
+}//namespace
+
+
+BOOST_GLOBAL_FIXTURE( DataDirectoryFixture );
+
+
+BOOST_AUTO_TEST_CASE( UniformGridAccuracy )
+{
+  double max_rel_diff = 0.0;
+  int max_diff_an = 0;
+  float max_diff_energy = 0.0f;
+
+  for( int an = MassAttenuation::sm_min_xs_atomic_number; an <= MassAttenuation::sm_max_xs_atomic_number; ++an )
+  {
+    for( const float energy : random_energies( 20000, static_cast<unsigned int>(an) ) )
+    {
+      const double expected = full_calculation( an, energy );
+      const double lookup = MassAttenuation::massAttenuationCoeficient( an, energy );
+
+      // Near the top of the energy range, some light elements have no tabulated data for any
+      //  process, and zero is returned by both.
+      if( expected <= 0.0 )
+      {
+        BOOST_CHECK_EQUAL( lookup, 0.0 );
+        continue;
+      }
+      
+      const double rel_diff = std::fabs( lookup - expected ) / expected;
+      if( rel_diff > max_rel_diff )
+      {
+        max_rel_diff = rel_diff;
+        max_diff_an = an;
+        max_diff_energy = energy;
+      }
+    }//for( loop over energies )
+  }//for( loop over atomic numbers )
+
+  BOOST_TEST_MESSAGE( "Largest relative difference of grid lookup from full calculation: "
+                      << max_rel_diff << " (AN=" << max_diff_an << ", energy="
+                      << max_diff_energy/PhysicalUnits::keV << " keV)" );
+
+  // The grid tolerance is 1E-4 at the cell check points; allow a little more between them.
+  BOOST_CHECK_LT( max_rel_diff, 2.0E-4 );
+}//BOOST_AUTO_TEST_CASE( UniformGridAccuracy )
+
+
+BOOST_AUTO_TEST_CASE( BatchMatchesSingle )
+{
+  const vector<float> energies = random_energies( 5000, 42 );
+
+  for( int an = MassAttenuation::sm_min_xs_atomic_number; an <= MassAttenuation::sm_max_xs_atomic_number; ++an )
+  {
+    vector<float> batch;
+    MassAttenuation::massAttenuationCoeficients( an, energies, batch );
+    BOOST_REQUIRE_EQUAL( batch.size(), energies.size() );
+
+    for( size_t i = 0; i < energies.size(); ++i )
+    {
+      const float single = MassAttenuation::massAttenuationCoeficient( an, energies[i] );
+      BOOST_CHECK_CLOSE( batch[i], single, 1.0E-4 );
+    }
+  }//for( loop over atomic numbers )
+}//BOOST_AUTO_TEST_CASE( BatchMatchesSingle )
+
+
+BOOST_AUTO_TEST_CASE( SmoothAtomicNumberSurface )
+{
+  // Asking for the derivative, at integer atomic numbers, uses the precomputed (atomic number,
+  //  energy) surface, which should give the same coefficients as each elements own grid.
+  for( int an = MassAttenuation::sm_min_xs_atomic_number; an <= MassAttenuation::sm_max_xs_atomic_number; ++an )
+  {
+    for( const float energy : random_energies( 2000, 1000u + static_cast<unsigned int>(an) ) )
+    {
+      const float single = MassAttenuation::massAttenuationCoeficient( an, energy );
+      if( single <= 0.0f )
+        continue;
+      
+      float dmu_dan = 0.0f;
+      const float smooth = MassAttenuation::massAttenuationCoeficientSmoothAN( static_cast<float>(an), energy, &dmu_dan );
+      BOOST_CHECK_CLOSE( smooth, single, 1.0E-3 );
+    }//for( loop over energies )
+  }//for( loop over atomic numbers )
+  
+  // The analytic derivative should match a finite difference, and the coefficient should be
+  //  continuous across integer atomic numbers.
+  const float fracs[] = { 0.25f, 0.5f, 0.75f };
+  const float h = 0.01f;
+  size_t num_checked = 0, num_bad_derivs = 0, num_discontinuous = 0;
+  
+  for( int k = MassAttenuation::sm_min_xs_atomic_number; k < MassAttenuation::sm_max_xs_atomic_number; ++k )
+  {
+    for( const float energy : random_energies( 200, 2000u + static_cast<unsigned int>(k) ) )
+    {
+      // Near the top of the energy range, some light elements have no tabulated data, and the
+      //  interpolation drops many orders of magnitude within a fraction of an atomic number, which
+      //  a finite difference cant follow; so only check where the elements it uses have data.
+      bool have_data = true;
+      for( int node = std::max( k - 1, MassAttenuation::sm_min_xs_atomic_number );
+          node <= std::min( k + 2, MassAttenuation::sm_max_xs_atomic_number ); ++node )
+      {
+        have_data = have_data && (MassAttenuation::massAttenuationCoeficient( node, energy ) > 0.0f);
+      }
+      
+      for( size_t i = 0; have_data && (i < sizeof(fracs)/sizeof(fracs[0])); ++i )
+      {
+        const float an = k + fracs[i];
+        float dmu_dan = 0.0f;
+        const double mu = MassAttenuation::massAttenuationCoeficientSmoothAN( an, energy, &dmu_dan );
+        const double upper = MassAttenuation::massAttenuationCoeficientSmoothAN( an + h, energy );
+        const double lower = MassAttenuation::massAttenuationCoeficientSmoothAN( an - h, energy );
+        const double numerical = (upper - lower) / (2.0*h);
+        
+        ++num_checked;
+        if( std::fabs(dmu_dan - numerical) > (1.0E-2*std::fabs(numerical) + 1.0E-3*mu) )
+          ++num_bad_derivs;
+      }//for( loop over fractional atomic numbers )
+      
+      if( k > MassAttenuation::sm_min_xs_atomic_number )
+      {
+        const double at_node = MassAttenuation::massAttenuationCoeficient( k, energy );
+        const double below = MassAttenuation::massAttenuationCoeficientSmoothAN( k - 1.0E-3f, energy );
+        const double above = MassAttenuation::massAttenuationCoeficientSmoothAN( k + 1.0E-3f, energy );
+        if( (at_node > 0.0)
+           && ((std::fabs(below - at_node) > 0.01*at_node) || (std::fabs(above - at_node) > 0.01*at_node)) )
+          ++num_discontinuous;
+      }//if( k > MassAttenuation::sm_min_xs_atomic_number )
+    }//for( loop over energies )
+  }//for( loop over atomic numbers )
+  
+  BOOST_CHECK_GT( num_checked, 50000 );
+  BOOST_CHECK_EQUAL( num_bad_derivs, 0 );
+  BOOST_CHECK_EQUAL( num_discontinuous, 0 );
+}//BOOST_AUTO_TEST_CASE( SmoothAtomicNumberSurface )
+
+
+BOOST_AUTO_TEST_CASE( LookupBenchmark )
+{
+  // Not a pass/fail test; reports the cost of the different ways of getting coefficients.
+  //  Run with "--log_level=message" to see the results.
+  typedef std::chrono::high_resolution_clock Clock;
+
+  const vector<float> energies = random_energies( 100000, 7 );
+  const int atomic_numbers[] = { 6, 26, 82 };
+  const size_t num_lookups = energies.size() * (sizeof(atomic_numbers) / sizeof(atomic_numbers[0]));
+
+  double sum = 0.0;  //Keep the compiler from optimizing the loops away
+
+  auto start = Clock::now();
+  for( const int an : atomic_numbers )
+  {
+    for( const float energy : energies )
+      sum += full_calculation( an, energy );
+  }
+  const double full_ns = std::chrono::duration<double,std::nano>( Clock::now() - start ).count();
+
+  start = Clock::now();
+  for( const int an : atomic_numbers )
+  {
+    for( const float energy : energies )
+      sum += MassAttenuation::massAttenuationCoeficient( an, energy );
+  }
+  const double single_ns = std::chrono::duration<double,std::nano>( Clock::now() - start ).count();
+
+  vector<float> batch;
+  start = Clock::now();
+  for( const int an : atomic_numbers )
+  {
+    MassAttenuation::massAttenuationCoeficients( an, energies, batch );
+    for( const float mu : batch )
+      sum += mu;
+  }
+  const double batch_ns = std::chrono::duration<double,std::nano>( Clock::now() - start ).count();
+
+  // Fractional atomic numbers, with the derivative, as when fitting a generic shieldings AN
+  start = Clock::now();
+  for( const int an : atomic_numbers )
+  {
+    for( const float energy : energies )
+    {
+      float dmu_dan = 0.0f;
+      sum += MassAttenuation::massAttenuationCoeficientSmoothAN( an + 0.4f, energy, &dmu_dan );
+      sum += dmu_dan;
+    }
+  }
+  const double smooth_ns = std::chrono::duration<double,std::nano>( Clock::now() - start ).count();
+
+  stringstream msg;
+  msg << "Per-lookup cost: full calculation " << (full_ns / num_lookups) << " ns, "
+      << "grid lookup " << (single_ns / num_lookups) << " ns, "
+      << "batched grid lookup " << (batch_ns / num_lookups) << " ns, "
+      << "fractional atomic number with derivative " << (smooth_ns / num_lookups) << " ns"
+      << " (checksum " << sum << ")";
+  BOOST_TEST_MESSAGE( msg.str() );
+
+  BOOST_CHECK( std::isfinite( sum ) );
+}//BOOST_AUTO_TEST_CASE( LookupBenchmark )